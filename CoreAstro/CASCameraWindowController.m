@@ -127,7 +127,9 @@
 
 @property (nonatomic,assign) BOOL invert;
 @property (nonatomic,assign) BOOL equalise;
+@property (nonatomic,assign) BOOL localEqualise; // equalise over tiles with the contrast limited, picks out faint detail next to bright cores
 @property (nonatomic,assign) BOOL medianFilter;
+@property (nonatomic,assign) BOOL sharpen;
 @property (nonatomic,assign) BOOL showPlateSolution;
 @property (nonatomic,assign) BOOL showHistogram;
 @property (nonatomic,assign) BOOL enableGuider;
@@ -140,6 +142,7 @@
 @property (nonatomic,strong) CASImageProcessor* imageProcessor;
 @property (nonatomic,strong) CASGuideAlgorithm* guideAlgorithm;
 @property (nonatomic,strong) CASImageDebayer* imageDebayer;
+@property (nonatomic,strong) CASFilterPipeline* filterPipeline;
 @property (nonatomic,strong) CASLibraryBrowserViewController* libraryViewController;
 @property (nonatomic,strong) CASColourAdjustments* colourAdjustments;
 @property (nonatomic,readonly) CASCCDExposureLibrary* library;
@@ -187,6 +190,7 @@
     
     self.imageDebayer = [CASImageDebayer imageDebayerWithIdentifier:nil];
     self.imageProcessor = [CASImageProcessor imageProcessorWithIdentifier:nil];
+    self.filterPipeline = [[CASFilterPipeline alloc] init];
     self.guideAlgorithm = [CASGuideAlgorithm guideAlgorithmWithIdentifier:nil];
         
     self.exposuresController = [[CASExposuresController alloc] init];
@@ -307,6 +311,7 @@
         if (_cameraController){
             [_cameraController addObserver:self forKeyPath:@"state" options:0 context:(__bridge void *)(self)];
             [_cameraController addObserver:self forKeyPath:@"progress" options:0 context:(__bridge void *)(self)];
+            _cameraController.guideAlgorithm.debayerMode = self.debayerMode;
         }
         [self configureForCameraController];
     }
@@ -476,6 +481,16 @@
     }
 }
 
+- (void)setLocalEqualise:(BOOL)localEqualise
+{
+    if (_localEqualise != localEqualise){
+        _localEqualise = localEqualise;
+        if (self.equalise){
+            [self _resetAndRedisplayCurrentExposure];
+        }
+    }
+}
+
 - (void)setMedianFilter:(BOOL)medianFilter
 {
     if (_medianFilter != medianFilter){
@@ -484,6 +499,14 @@
     }
 }
 
+- (void)setSharpen:(BOOL)sharpen
+{
+    if (_sharpen != sharpen){
+        _sharpen = sharpen;
+        [self _resetAndRedisplayCurrentExposure];
+    }
+}
+
 - (void)setShowPlateSolution:(BOOL)showPlateSolution
 {
     if (_showPlateSolution != showPlateSolution){
@@ -501,6 +524,9 @@
 {
     if (self.imageDebayer.mode != debayerMode){
         self.imageDebayer.mode = debayerMode;
+        // stars are found on the superpixel luminance of raw colour frames, both when displayed and when guiding
+        self.guideAlgorithm.debayerMode = debayerMode;
+        self.cameraController.guideAlgorithm.debayerMode = debayerMode;
         [self _resetAndRedisplayCurrentExposure];
     }
 }
@@ -541,7 +567,10 @@
 
 - (void)setScaleSubframe:(BOOL)scaleSubframe
 {
-    self.imageView.scaleSubframe = scaleSubframe;
+    if (self.imageView.scaleSubframe != scaleSubframe){
+        self.imageView.scaleSubframe = scaleSubframe;
+        [self displayExposure:self.currentExposure]; // decides whether the pipeline can be used
+    }
 }
 
 - (void)updateExposureIndicator
@@ -644,24 +673,54 @@
             [exposureFormatter setTimeStyle:NSDateFormatterMediumStyle];
         });
         
-        // debayer if required
-        if (self.imageDebayer.mode != kCASImageDebayerNone){
-            CASCCDExposure* debayeredExposure = [self.imageDebayer debayer:exposure adjustRed:self.colourAdjustments.redAdjust green:self.colourAdjustments.greenAdjust blue:self.colourAdjustments.blueAdjust all:self.colourAdjustments.allAdjust];
-            if (debayeredExposure){
-                exposure = debayeredExposure;
-            }
-        }
-        
-        if (self.medianFilter){
-            exposure = [self.imageProcessor medianFilter:exposure];
-        }
-        
-        if (self.equalise){
-            exposure = [self.imageProcessor equalise:exposure];
+        // the pipeline does everything but sharpening and the colour adjustments a visible tile at a time. the view only
+        // uses it for full frames and scaled subframes so anything else still goes through the processor here first
+        const CASExposeParams params = exposure.params;
+        const BOOL fullFrame = (params.origin.x == 0 && params.origin.y == 0 && params.size.width == params.frame.width && params.size.height == params.frame.height);
+        CASColourAdjustments* colour = self.colourAdjustments;
+        const BOOL adjustColour = (colour.redAdjust != 1 || colour.greenAdjust != 1 || colour.blueAdjust != 1 || colour.allAdjust != 1);
+        if (!self.sharpen && !adjustColour && (fullFrame || self.scaleSubframe)){
+            
+            CASFilterPipeline* pipeline = self.filterPipeline;
+            pipeline.debayerMode = self.imageDebayer.mode;
+            pipeline.medianFilter = self.medianFilter;
+            pipeline.equalise = self.equalise;
+            pipeline.equalisationMode = self.localEqualise ? kCASFilterPipelineEqualiseLocal : kCASFilterPipelineEqualiseGlobal;
+            pipeline.invert = self.invert;
+            self.imageView.filterPipeline = pipeline;
         }
-        
-        if (self.invert){
-            exposure = [self.imageProcessor invert:exposure];
+        else {
+            
+            self.imageView.filterPipeline = nil;
+            
+            // debayer if required
+            if (self.imageDebayer.mode != kCASImageDebayerNone){
+                CASCCDExposure* debayeredExposure = [self.imageDebayer debayer:exposure adjustRed:self.colourAdjustments.redAdjust green:self.colourAdjustments.greenAdjust blue:self.colourAdjustments.blueAdjust all:self.colourAdjustments.allAdjust];
+                if (debayeredExposure){
+                    exposure = debayeredExposure;
+                }
+            }
+            
+            if (self.medianFilter){
+                exposure = [self.imageProcessor medianFilter:exposure];
+            }
+            
+            if (self.sharpen){
+                exposure = [self.imageProcessor unsharpMask:exposure];
+            }
+            
+            if (self.equalise){
+                if (self.localEqualise){
+                    exposure = [self.imageProcessor equaliseLocally:exposure];
+                }
+                else {
+                    exposure = [self.imageProcessor equalise:exposure];
+                }
+            }
+            
+            if (self.invert){
+                exposure = [self.imageProcessor invert:exposure];
+            }
         }
         
         self.imageView.currentExposure = exposure;
@@ -1088,11 +1147,21 @@
     self.equalise = !self.equalise;
 }
 
+- (IBAction)toggleLocalEqualisation:(id)sender
+{
+    self.localEqualise = !self.localEqualise;
+}
+
 - (IBAction)toggleMedianFilter:(id)sender
 {
     self.medianFilter = !self.medianFilter;
 }
 
+- (IBAction)toggleSharpen:(id)sender
+{
+    self.sharpen = !self.sharpen;
+}
+
 - (IBAction)toggleShowPlateSolution:(id)sender
 {
     self.showPlateSolution = !self.showPlateSolution;
@@ -1336,9 +1405,17 @@
             item.state = self.equalise;
             break;
             
+        case 10008:
+            item.state = self.localEqualise;
+            break;
+            
         case 10006:
             item.state = self.medianFilter;
             break;
+            
+        case 10007:
+            item.state = self.sharpen;
+            break;
 
         case 10003:
             item.state = self.imageView.showReticle;
@@ -40,6 +40,7 @@ typedef enum {
 @property (nonatomic,assign) NSInteger progressInterval;
 @property (nonatomic,assign) CGFloat progress;
 @property (nonatomic,strong) CASImageProcessor* imageProcessor;
+@property (nonatomic,strong) CASFilterPipeline* filterPipeline; // if set, full frames are displayed through it a visible tile at a time
 @property (nonatomic,strong) CASGuideAlgorithm* guideAlgorithm;
 @property (nonatomic,strong) id<CASExposureViewDelegate> exposureViewDelegate;
 @property (nonatomic,assign) CGRect selectionRect;
@@ -135,6 +135,7 @@ const CGPoint kCASImageViewInvalidStarLocation = {-1,-1};
     BOOL _showSelection:1;
     BOOL _draggingSelection:1;
     BOOL _displayedFirstImage:1;
+    BOOL _displayingTiles:1;
     BOOL _autoContrastStretch;
     NSSize _draggingSelectionOffset;
     CASTaggedLayer* _dragHandleLayer;
@@ -484,13 +485,37 @@ const CGPoint kCASImageViewInvalidStarLocation = {-1,-1};
     
     self.displayingScaledSubframe = NO;
 
+    // grab a local copy as we're going to use this a bit
+    const CASExposeParams params = _currentExposure.params;
+    const BOOL fullFrame = (params.origin.x == 0 && params.origin.y == 0 && params.size.width == params.frame.width && params.size.height == params.frame.height);
+    
+    _displayingTiles = NO;
+    
     if (!_currentExposure){
         clearImage();
     }
+    else if (self.filterPipeline && (fullFrame || self.scaleSubframe)){
+        
+        // nothing's rendered up front, the tiles are worked out as they're drawn so zoomed in only the visible ones are
+        CGImageRef tiledImage = [self.filterPipeline newTiledDisplayImageWithExposure:_currentExposure];
+        self.imageIsStretched = NO;
+        if (!tiledImage){
+            clearImage();
+        }
+        else {
+            [self drawImage:tiledImage withPipeline:self.filterPipeline exposure:_currentExposure];
+            [self setImage:tiledImage resetDisplay:resetDisplay];
+            _displayingTiles = YES;
+            CGImageRelease(tiledImage);
+        }
+    }
     else {
         
-        CASCCDImage* image = [_currentExposure newImage];
-        if (!image){
+        // the contrast stretch goes straight to 8-bit when possible, otherwise the float image goes through the filter chain
+        CGImageRef stretchedImage = [self newStretchedImage];
+        CASCCDImage* image = stretchedImage ? nil : [_currentExposure newImage];
+        self.imageIsStretched = (stretchedImage != NULL);
+        if (!stretchedImage && !image){
             clearImage();
         }
         else {
@@ -498,17 +523,21 @@ const CGPoint kCASImageViewInvalidStarLocation = {-1,-1};
             // todo; this is madly inefficient :)
             
             CGImageRef CGImage2 = NULL; // this is just to silence analyser warnings as it doesn't see the reassignment to CGImage below
-            CGImageRef CGImage = image.CGImage; // the dimensions of this are divided by the binning factor todo; image.CIImage
+            CGImageRef CGImage = stretchedImage ? stretchedImage : image.CGImage; // the dimensions of this are divided by the binning factor todo; image.CIImage
             if (CGImage){
                 
-                // grab a local copy as we're going to use this a bit
-                const CASExposeParams params = _currentExposure.params;
-                
                 // draw subframes as an inset within a full frame sized gray background unless the scaleSubframe flag is set
                 if (!self.scaleSubframe){
                     
                     // todo; this is using the unbinned co-ords but should probably be using binned
-                    CGContextRef bitmap = [image newContextOfSize:CASSizeMake(params.frame.width, params.frame.height)];
+                    const CASSize frameSize = CASSizeMake(params.frame.width, params.frame.height);
+                    CGContextRef bitmap = nil;
+                    if (stretchedImage){
+                        bitmap = _currentExposure.rgba ? [CASCCDImage newRGBBitmapContextWithSize:frameSize] : [CASCCDImage newGrayBitmapContextWithSize:frameSize];
+                    }
+                    else {
+                        bitmap = [image newContextOfSize:frameSize];
+                    }
                     if (!bitmap){
                         CGImage = nil;
                     }
@@ -541,6 +570,7 @@ const CGPoint kCASImageViewInvalidStarLocation = {-1,-1};
             }
             
             CGImageRelease(CGImage2);
+            CGImageRelease(stretchedImage);
         }
     }
 }
@@ -1170,6 +1200,75 @@ const CGPoint kCASImageViewInvalidStarLocation = {-1,-1};
 
 #pragma mark - Contrast Stretch
 
+- (BOOL)canStretchWithTable
+{
+    // the debayer and median filters run before the stretch in the filter chain so can't be applied to an already stretched image
+    return (self.contrastStretch && !self.debayer && !self.medianFilter);
+}
+
+- (CGImageRef)newStretchedImage
+{
+    if (![self canStretchWithTable]){
+        return NULL;
+    }
+    
+    CASImageProcessor* proc = [CASImageProcessor imageProcessorWithIdentifier:nil];
+    
+    const CASContrastStretchBounds bounds = {self.stretchMin,self.stretchMax,1.0};
+    
+    return [proc newDisplayImage:self.currentExposure linearContrastStretchBounds:bounds midtone:0.5 gamma:self.stretchGamma];
+}
+
+- (void)_updateStretchedImageImpl
+{
+    if (_currentExposure && (self.imageIsStretched || [self canStretchWithTable]) && !_displayingTiles){ // tiles pick up the stretch as they're redrawn
+        [self displayExposureWithReset:NO];
+    }
+}
+
+- (void)updateStretchedImage
+{
+    // coalesce the changes to the min and max when the stretch is configured
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_updateStretchedImageImpl) object:nil];
+    [self performSelector:@selector(_updateStretchedImageImpl) withObject:nil afterDelay:0 inModes:@[NSRunLoopCommonModes]];
+}
+
+- (void)setContrastStretch:(BOOL)contrastStretch
+{
+    [super setContrastStretch:contrastStretch];
+    [self updateStretchedImage];
+}
+
+- (void)setStretchMin:(float)stretchMin
+{
+    [super setStretchMin:stretchMin];
+    [self updateStretchedImage];
+}
+
+- (void)setStretchMax:(float)stretchMax
+{
+    [super setStretchMax:stretchMax];
+    [self updateStretchedImage];
+}
+
+- (void)setStretchGamma:(float)stretchGamma
+{
+    [super setStretchGamma:stretchGamma];
+    [self updateStretchedImage];
+}
+
+- (void)setDebayer:(BOOL)debayer
+{
+    [super setDebayer:debayer];
+    [self updateStretchedImage];
+}
+
+- (void)setMedianFilter:(BOOL)medianFilter
+{
+    [super setMedianFilter:medianFilter];
+    [self updateStretchedImage];
+}
+
 - (void)configureContrastStretch
 {
     CASImageProcessor* proc = [CASImageProcessor imageProcessorWithIdentifier:nil];
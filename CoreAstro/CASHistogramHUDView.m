@@ -32,15 +32,9 @@
         _exposure = exposure;
         if (_exposure){
             
-            CGFloat max = 0;
-            NSArray* histogram = [self.imageProcessor histogram:_exposure];
-            NSMutableData* data = [NSMutableData dataWithLength:[histogram count] * sizeof(float)];
-            float* fp = (float*)[data mutableBytes];
-            for (NSNumber* n in histogram){
-                const float f = [n floatValue];
-                max = MAX(max,f);
-                *fp++ = f;
-            }
+            // the exposure's cached histogram, the same one the statistics and stretch use
+            float max = 0;
+            NSData* data = [_exposure.histogram floatCountsWithBinCount:256 maximum:&max];
             self.graphView.max = max;
             self.graphView.samples = data;
         }
@@ -8,11 +8,15 @@
 
 #import "CASZoomableView.h"
 
+@class CASFilterPipeline;
+@class CASCCDExposure;
+
 @interface CASImageView : CASZoomableView
 @property (nonatomic,strong,readonly) CIImage* image;
 @property (nonatomic,assign) CGImageRef CGImage;
 @property (nonatomic,strong) NSURL* url;
 - (void)setCGImage:(CGImageRef)CGImage resetDisplay:(BOOL)resetDisplay;
+- (void)drawImage:(CGImageRef)CGImage withPipeline:(CASFilterPipeline*)pipeline exposure:(CASCCDExposure*)exposure; // while CGImage is displayed just the visible tiles are rendered from the exposure, through the pipeline rather than the filters below
 @end
 
 typedef struct CASVector {
@@ -24,6 +28,7 @@ typedef struct CASVector {
 @property (nonatomic) BOOL medianFilter;
 @property (nonatomic) BOOL contrastStretch;
 @property (nonatomic) float stretchMin, stretchMax, stretchGamma; // contrast stretch 0->1
+@property (nonatomic) BOOL imageIsStretched; // the image was rendered with the contrast stretch already applied so the filter chain skips it
 @property (nonatomic) BOOL debayer;
 @property (nonatomic) CASVector debayerOffset;
 @property (nonatomic) CGRect extent;
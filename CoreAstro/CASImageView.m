@@ -8,6 +8,7 @@
 
 #import "CASImageView.h"
 #import "CASCenteringClipView.h"
+#import <CoreAstro/CoreAstro.h>
 #import <QuartzCore/QuartzCore.h>
 
 @interface CASTiledLayer : CATiledLayer
@@ -32,13 +33,16 @@
 
 @implementation CASImageView {
     CGImageRef _cgImage;
-    BOOL _invert, _medianFilter, _contrastStretch, _debayer;
+    BOOL _invert, _medianFilter, _contrastStretch, _imageIsStretched, _debayer;
     float _stretchMin, _stretchMax, _stretchGamma;
     CASVector _debayerOffset;
     CIImage* _filteredCIImage;
     NSMutableDictionary* _filterCache;
     CGRect _extent;
     BOOL _flipVertical, _flipHorizontal;
+    CGImageRef _pipelineImage; // not retained, only compared against
+    CASFilterPipeline* _pipeline;
+    CASCCDExposure* _pipelineExposure;
 }
 
 + (void)loadCIPluginWithName:(NSString*)name
@@ -63,6 +67,7 @@
 {
     CASTiledLayer* layer = [[CASTiledLayer alloc] init];
     layer.tileSize = CGSizeMake(1024, 1024); // todo; this value really needs to come from OpenGL
+    layer.levelsOfDetail = 6; // zoomed out tiles are drawn at 1/2 to 1/32 scale, from the exposure's pyramid when there's a pipeline
     return layer;
 }
 
@@ -208,7 +213,7 @@
         image = [median valueForKey:@"outputImage"];
     }
     
-    if (self.contrastStretch){
+    if (self.contrastStretch && !self.imageIsStretched){
         CIFilter* stretch = [self filterWithName:@"CASContrastStretchFilter"];
         if (stretch){
             [stretch setDefaults];
@@ -285,6 +290,13 @@
 
 - (void)setCGImage:(CGImageRef)CGImage resetDisplay:(BOOL)resetDisplay
 {
+    @synchronized(self){
+        if (CGImage != _pipelineImage){
+            _pipelineImage = NULL;
+            _pipeline = nil;
+            _pipelineExposure = nil;
+        }
+    }
     if (_cgImage != CGImage){
         if (_cgImage){
             // CGImageRelease(_cgImage);
@@ -329,8 +341,74 @@
     }
 }
 
+- (void)drawImage:(CGImageRef)CGImage withPipeline:(CASFilterPipeline*)pipeline exposure:(CASCCDExposure*)exposure
+{
+    @synchronized(self){
+        _pipelineImage = (pipeline && exposure) ? CGImage : NULL;
+        _pipeline = _pipelineImage ? pipeline : nil;
+        _pipelineExposure = _pipelineImage ? exposure : nil;
+    }
+    [self updatePipeline];
+}
+
+// the pipeline does the view's own adjustments the filters would otherwise, the other stages are set by whoever made it.
+// its tile cache drops anything rendered with the old ones
+- (void)updatePipeline
+{
+    CASFilterPipeline* pipeline;
+    @synchronized(self){
+        pipeline = _pipeline;
+    }
+    if (pipeline){
+        pipeline.contrastStretch = self.contrastStretch;
+        pipeline.stretchMin = self.stretchMin;
+        pipeline.stretchMax = self.stretchMax;
+        pipeline.stretchGamma = self.stretchGamma;
+        pipeline.flipVertical = self.flipVertical;
+        pipeline.flipHorizontal = self.flipHorizontal;
+    }
+}
+
 - (void)drawLayer:(CALayer *)layer inContext:(CGContextRef)context
 {
+    CGImageRef pipelineImage;
+    CASFilterPipeline* pipeline;
+    CASCCDExposure* exposure;
+    @synchronized(self){
+        pipelineImage = _pipelineImage;
+        pipeline = _pipeline;
+        exposure = _pipelineExposure;
+    }
+    if (pipeline){
+        
+        // just the tiles under the clip, the image's rows run top down and the layer's bottom up
+        const CGRect clip = CGRectIntegral(CGContextGetClipBoundingBox(context));
+        const CGFloat width = CGImageGetWidth(pipelineImage), height = CGImageGetHeight(pipelineImage);
+        const CGRect visible = CGRectIntersection(clip,CGRectMake(0,0,width,height));
+        if (!CGRectIsEmpty(visible)){
+            
+            // zoomed out the pyramid level with about a pixel per device pixel, the region's rounded out to its pixels
+            NSUInteger level = 0;
+            const CGFloat scale = fabs(CGContextGetCTM(context).a);
+            while (scale > 0 && level < 5 && scale * (2 << level) <= 1){
+                ++level;
+            }
+            const NSInteger step = 1 << level;
+            const NSInteger left = (NSInteger)visible.origin.x / step * step, top = (NSInteger)(height - CGRectGetMaxY(visible)) / step * step;
+            const NSInteger right = ((NSInteger)CGRectGetMaxX(visible) + step - 1) / step * step, bottom = ((NSInteger)(height - visible.origin.y) + step - 1) / step * step;
+            const CASRect region = CASRectMake2(left,top,right - left,bottom - top);
+            
+            // the level used may be a finer one, the region's rounded to its pixels too so the image starts at its origin
+            CGImageRef image = [pipeline newDisplayImageWithExposure:exposure region:region level:&level];
+            if (image){
+                const CGFloat drawnWidth = CGImageGetWidth(image) << level, drawnHeight = CGImageGetHeight(image) << level;
+                CGContextDrawImage(context,CGRectMake(left,height - top - drawnHeight,drawnWidth,drawnHeight),image);
+                CGImageRelease(image);
+            }
+        }
+        return;
+    }
+    
     [self filteredCIImage];
     if (_filteredCIImage){
         const CGRect clip = CGContextGetClipBoundingBox(context);
@@ -400,6 +478,7 @@
     @synchronized(self){
         _filteredCIImage = nil; // crude, we should be able to update filters in the chain
     }
+    [self updatePipeline];
     [self.layer setNeedsDisplay];
 }
 
@@ -442,6 +521,19 @@
     }
 }
 
+- (BOOL)imageIsStretched
+{
+    return _imageIsStretched;
+}
+
+- (void)setImageIsStretched:(BOOL)imageIsStretched
+{
+    if (imageIsStretched != _imageIsStretched){
+        _imageIsStretched = imageIsStretched;
+        [self resetFilteredImage];
+    }
+}
+
 - (float)stretchMin
 {
     return _stretchMin;
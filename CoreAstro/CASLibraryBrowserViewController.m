@@ -25,6 +25,7 @@
 @property (assign) NSUInteger version;
 - (IBAction)editTitleOK:(NSButton*)sender;
 - (IBAction)editTitleCancel:(NSButton*)sender;
+- (void)thumbnailsChanged;
 @end
 
 @interface CASCCDExposure (CASLibraryBrowserViewController)<NSPasteboardWriting>
@@ -122,6 +123,30 @@
 
 @implementation CASCCDExposureWrapper {
     NSImage* _image;
+    CASCCDExposureIO* _thumbnailIO; // the io the placeholder's waiting on
+    NSUInteger _thumbnailVersion;
+    BOOL _thumbnailFailed; // don't keep asking for one that can't be made
+    BOOL _waitingForSlot; // the thumbnail queue was full, ask again once something's come off it
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+// shown until the exposure's thumbnail has been made in the background
++ (NSImage*)placeholderImage
+{
+    static NSImage* placeholder = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        placeholder = [[NSImage alloc] initWithSize:NSMakeSize(256, 171)];
+        [placeholder lockFocus];
+        [[NSColor darkGrayColor] set];
+        NSRectFill(NSMakeRect(0, 0, 256, 171));
+        [placeholder unlockFocus];
+    });
+    return placeholder;
 }
 
 - (NSString *)imageRepresentationType
@@ -140,11 +165,40 @@
             exposure = exposure.debayeredExposure;
         }
         _image = exposure.thumbnail;
-        if (!_image){
-            // NSLog(@"No thumbnail for %@",self.exposure.date); // make one from the full res image
+        if (!_image && !_thumbnailIO && !_thumbnailFailed && !_waitingForSlot){
+            // make one from the pyramid, or the full res image if there isn't one yet, and show the placeholder until it's there
+            if ([exposure.io writeThumbnailOfExposure:exposure]){
+                _thumbnailIO = exposure.io;
+                [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(thumbnailWritten:) name:kCASCCDExposureIOThumbnailNotification object:_thumbnailIO];
+            }
+            else if (exposure.io){
+                // any thumbnail finishing frees up a place in the queue
+                _waitingForSlot = YES;
+                [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(thumbnailSlotFreed:) name:kCASCCDExposureIOThumbnailNotification object:nil];
+            }
         }
     }
-	return _image;
+	return (!_image && (_thumbnailIO || _waitingForSlot || _thumbnailFailed)) ? [[self class] placeholderImage] : _image;
+}
+
+- (void)thumbnailWritten:(NSNotification*)note
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:kCASCCDExposureIOThumbnailNotification object:_thumbnailIO];
+    _thumbnailIO = nil;
+    _thumbnailFailed = ![[note.userInfo objectForKey:kCASCCDExposureIOThumbnailWrittenKey] boolValue];
+    if (!_thumbnailFailed){
+        _image = nil;
+        ++_thumbnailVersion;
+        [self.viewController thumbnailsChanged];
+    }
+}
+
+- (void)thumbnailSlotFreed:(NSNotification*)note
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:kCASCCDExposureIOThumbnailNotification object:nil];
+    _waitingForSlot = NO;
+    ++_thumbnailVersion;
+    [self.viewController thumbnailsChanged];
 }
 
 - (NSString *)imageUID
@@ -168,7 +222,7 @@
 
 - (NSUInteger) imageVersion
 {
-    return self.viewController.version;
+    return self.viewController.version + _thumbnailVersion;
 //    NSDate* date;
 //    if ([self.exposure.io.url getResourceValue:&date forKey:NSURLContentModificationDateKey error:nil]){
 //        NSLog(@"self.exposure.io.url: %@ -> %@",self.exposure.io.url,date);
@@ -219,6 +273,13 @@
     }
 }
 
+// coalesces the reloads from thumbnails finishing, several can come in together
+- (void)thumbnailsChanged
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget:self.browserView selector:@selector(reloadData) object:nil];
+    [self.browserView performSelector:@selector(reloadData) withObject:nil afterDelay:0];
+}
+
 #pragma mark - Exposures
 
 - (void)setExposuresController:(CASExposuresController *)exposuresController
@@ -51,6 +51,7 @@ typedef enum {
 
 @property (nonatomic,weak) id<CASImageProcessor> imageProcessor;
 @property (nonatomic,copy,readonly) NSString* status;
+@property (nonatomic,assign) NSInteger debayerMode; // kCASImageDebayerRGGB etc to find stars in raw colour frames on their superpixel luminance
 
 @property (nonatomic,assign,readonly) CGPoint starLocation; // current start point
 @property (nonatomic,assign,readonly) CGPoint lockLocation; // start guide point
@@ -32,6 +32,10 @@
 //
 
 #import "CASAutoGuider.h"
+#import "CASCCDExposure+Pixels.h"
+#import "CASCCDExposureLibrary.h"
+#import "CASExposureDefectMap.h"
+#import "CASImageDebayer.h"
 #import <vector>
 #import <ApplicationServices/ApplicationServices.h>
 
@@ -67,6 +71,94 @@ enum {
     kGuidingModeGuiding
 };
 
+// PHD's star finder, the best fit of a fixed PSF anywhere in the frame. only where the best fit is matters so 16-bit
+// samples are used as they are rather than scaled to 0-1 like floatPixels
+template <typename T>
+static void CASGuiderLocateStar(const CASPixelView<const T>& view, double& xpos, double& ypos)
+{
+    xpos = ypos = -1;
+    
+    const T* exposurePixels = view.pixels;
+    const NSInteger width = view.width, height = view.height;
+    const NSInteger linesize = view.stride;
+    
+    float A, B1, B2, C1, C2, C3, D1, D2, D3;
+	double PSF[14] = { 0.906, 0.584, 0.365, .117, .049, -0.05, -.064, -.074, -.094 };
+	double mean;
+	double PSF_fit;
+	double BestPSF_fit = 0.0;
+    const int border = 40;
+    
+	for (NSInteger y=border; height > border && y<height-border; y++) {
+        
+		for (NSInteger x=border; width > border && x<width-border; x++) {
+            
+			A =  (float) *(exposurePixels + linesize * y + x);
+            
+            B1 = (float) *(exposurePixels + linesize * (y-1) + x) + (float) *(exposurePixels + linesize * (y+1) + x) + (float) *(exposurePixels + linesize * y + (x + 1)) + (float) *(exposurePixels + linesize * y + (x-1));
+			
+			B2 = (float) *(exposurePixels + linesize * (y-1) + (x-1)) + (float) *(exposurePixels + linesize * (y-1) + (x+1)) + (float) *(exposurePixels + linesize * (y+1) + (x + 1)) + (float) *(exposurePixels + linesize * (y+1) + (x-1));
+			
+            C1 = (float) *(exposurePixels + linesize * (y-2) + x) + (float) *(exposurePixels + linesize * (y+2) + x) + (float) *(exposurePixels + linesize * y + (x + 2)) + (float) *(exposurePixels + linesize * y + (x-2));
+			
+            C2 = (float) *(exposurePixels + linesize * (y-2) + (x-1)) + (float) *(exposurePixels + linesize * (y-2) + (x+1)) + (float) *(exposurePixels + linesize * (y+2) + (x + 1)) + (float) *(exposurePixels + linesize * (y+2) + (x-1)) +
+            (float) *(exposurePixels + linesize * (y-1) + (x-2)) + (float) *(exposurePixels + linesize * (y-1) + (x+2)) + (float) *(exposurePixels + linesize * (y+1) + (x + 2)) + (float) *(exposurePixels + linesize * (y+1) + (x-2));
+			
+			C3 = (float) *(exposurePixels + linesize * (y-2) + (x-2)) + (float) *(exposurePixels + linesize * (y-2) + (x+2)) + (float) *(exposurePixels + linesize * (y+2) + (x + 2)) + (float) *(exposurePixels + linesize * (y+2) + (x-2));
+			
+            D1 = (float) *(exposurePixels + linesize * (y-3) + x) + (float) *(exposurePixels + linesize * (y+3) + x) + (float) *(exposurePixels + linesize * y + (x + 3)) + (float) *(exposurePixels + linesize * y + (x-3));
+			
+            D2 = (float) *(exposurePixels + linesize * (y-3) + (x-1)) + (float) *(exposurePixels + linesize * (y-3) + (x+1)) + (float) *(exposurePixels + linesize * (y+3) + (x + 1)) + (float) *(exposurePixels + linesize * (y+3) + (x-1)) +
+            (float) *(exposurePixels + linesize * (y-1) + (x-3)) + (float) *(exposurePixels + linesize * (y-1) + (x+3)) + (float) *(exposurePixels + linesize * (y+1) + (x + 3)) + (float) *(exposurePixels + linesize * (y+1) + (x-3));
+			
+            D3 = 0.0;
+            
+            NSInteger i;
+            const T* uptr;
+			uptr = exposurePixels + linesize * (y-4) + (x-4);
+			for (i=0; i<9; i++, uptr++)
+				D3 = D3 + *uptr;
+            
+			uptr = exposurePixels + linesize * (y-3) + (x-4);
+			for (i=0; i<3; i++, uptr++)
+				D3 = D3 + *uptr;
+            
+			uptr = uptr + 2;
+			for (i=0; i<3; i++, uptr++)
+				D3 = D3 + *uptr;
+            
+			D3 = D3 + (float) *(exposurePixels + linesize * (y-2) + (x-4)) + (float) *(exposurePixels + linesize * (y-2) + (x+4)) + (float) *(exposurePixels + linesize * (y-2) + (x-3)) + (float) *(exposurePixels + linesize * (y-2) + (x-3)) +
+            (float) *(exposurePixels + linesize * (y+2) + (x-4)) + (float) *(exposurePixels + linesize * (y+2) + (x+4)) + (float) *(exposurePixels + linesize * (y+2) + (x - 3)) + (float) *(exposurePixels + linesize * (y+2) + (x-3)) +
+            (float) *(exposurePixels + linesize * y + (x + 4)) + (float) *(exposurePixels + linesize * y + (x-4));
+            
+			uptr = exposurePixels + linesize * (y+4) + (x-4);
+			for (i=0; i<9; i++, uptr++)
+				D3 = D3 + *uptr;
+            
+			uptr = exposurePixels + linesize * (y+3) + (x-4);
+			for (i=0; i<3; i++, uptr++)
+				D3 = D3 + *uptr;
+            
+			uptr = uptr + 2;
+			for (i=0; i<3; i++, uptr++)
+				D3 = D3 + *uptr;
+            
+			mean = (A+B1+B2+C1+C2+C3+D1+D2+D3)/85.0;
+            
+			PSF_fit = PSF[0] * (A-mean) + PSF[1] * (B1 - 4.0*mean) + PSF[2] * (B2 - 4.0 * mean) +
+            PSF[3] * (C1 - 4.0*mean) + PSF[4] * (C2 - 8.0*mean) + PSF[5] * (C3 - 4.0 * mean) +
+            PSF[6] * (D1 - 4.0*mean) + PSF[7] * (D2 - 8.0*mean) + PSF[8] * (D3 - 48.0 * mean);
+            
+            
+			if (PSF_fit > BestPSF_fit) {
+				BestPSF_fit = PSF_fit;
+				xpos = x;
+				ypos = y;
+			}
+        }
+    }
+}
+
 @interface CASGuideAlgorithm ()
 @property (nonatomic,copy) NSString* status;
 @end
@@ -112,7 +204,7 @@ enum {
     NSFileHandle* logFile;
 }
 
-@synthesize imageProcessor;
+@synthesize imageProcessor, debayerMode;
 
 + (id<CASGuideAlgorithm>)guideAlgorithmWithIdentifier:(NSString*)ident
 {
@@ -199,99 +291,44 @@ enum {
     [logFile writeData:[string dataUsingEncoding:NSUTF8StringEncoding]];
 }
 
+// raw colour frames folded to one luminance pixel per 2x2 block so the colour sites don't look like structure,
+// positions in it map back to the exposure as 2 * p + 0.5
+- (CASCCDExposure*)_superpixel:(CASCCDExposure*)exposure
+{
+    id<CASImageProcessor> processor = self.imageProcessor ?: [CASImageProcessor imageProcessorWithIdentifier:nil];
+    return [processor superpixel:exposure mode:self.debayerMode luminance:YES];
+}
+
 - (NSArray*)locateStars:(CASCCDExposure*)exposure
 {
+    if (self.debayerMode != kCASImageDebayerNone && !exposure.rgba){
+        NSArray* stars = [self locateStars:[self _superpixel:exposure]];
+        NSMutableArray* result = stars ? [NSMutableArray arrayWithCapacity:[stars count]] : nil;
+        for (NSValue* star in stars){
+            const NSPoint p = [star pointValue];
+            [result addObject:[NSValue valueWithPoint:NSMakePoint(p.x * 2 + 0.5, p.y * 2 + 0.5)]];
+        }
+        return result;
+    }
+    
 //    if (exposure.params.bps != 16){
 //        NSLog(@"%@: only works with 16-bit images",NSStringFromSelector(_cmd));
 //        return nil;
 //    }
     
-    float* exposurePixels = (float*)[exposure.floatPixels bytes];
-    if (!exposurePixels){
+    const CASPixels pixels = exposure.samples;
+    if (pixels.format != kCASPixelFormatUInt16 && pixels.format != kCASPixelFormatFloat){
         return nil;
     }
 
     const NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
     
-    double xpos = -1, ypos = -1;
-    
-    const CASSize size = exposure.actualSize;
-    const NSInteger linesize = size.width;
-    
-    float A, B1, B2, C1, C2, C3, D1, D2, D3;
-	double PSF[14] = { 0.906, 0.584, 0.365, .117, .049, -0.05, -.064, -.074, -.094 };
-	double mean;
-	double PSF_fit;
-	double BestPSF_fit = 0.0;
-    const int border = 40;
-    
-	for (NSInteger y=border; size.height > border && y<size.height-border; y++) {
-        
-		for (NSInteger x=border; linesize > border && x<linesize-border; x++) {
-            
-			A =  (float) *(exposurePixels + linesize * y + x);
-            
-            B1 = (float) *(exposurePixels + linesize * (y-1) + x) + (float) *(exposurePixels + linesize * (y+1) + x) + (float) *(exposurePixels + linesize * y + (x + 1)) + (float) *(exposurePixels + linesize * y + (x-1));
-			
-			B2 = (float) *(exposurePixels + linesize * (y-1) + (x-1)) + (float) *(exposurePixels + linesize * (y-1) + (x+1)) + (float) *(exposurePixels + linesize * (y+1) + (x + 1)) + (float) *(exposurePixels + linesize * (y+1) + (x-1));
-			
-            C1 = (float) *(exposurePixels + linesize * (y-2) + x) + (float) *(exposurePixels + linesize * (y+2) + x) + (float) *(exposurePixels + linesize * y + (x + 2)) + (float) *(exposurePixels + linesize * y + (x-2));
-			
-            C2 = (float) *(exposurePixels + linesize * (y-2) + (x-1)) + (float) *(exposurePixels + linesize * (y-2) + (x+1)) + (float) *(exposurePixels + linesize * (y+2) + (x + 1)) + (float) *(exposurePixels + linesize * (y+2) + (x-1)) +
-            (float) *(exposurePixels + linesize * (y-1) + (x-2)) + (float) *(exposurePixels + linesize * (y-1) + (x+2)) + (float) *(exposurePixels + linesize * (y+1) + (x + 2)) + (float) *(exposurePixels + linesize * (y+1) + (x-2));
-			
-			C3 = (float) *(exposurePixels + linesize * (y-2) + (x-2)) + (float) *(exposurePixels + linesize * (y-2) + (x+2)) + (float) *(exposurePixels + linesize * (y+2) + (x + 2)) + (float) *(exposurePixels + linesize * (y+2) + (x-2));
-			
-            D1 = (float) *(exposurePixels + linesize * (y-3) + x) + (float) *(exposurePixels + linesize * (y+3) + x) + (float) *(exposurePixels + linesize * y + (x + 3)) + (float) *(exposurePixels + linesize * y + (x-3));
-			
-            D2 = (float) *(exposurePixels + linesize * (y-3) + (x-1)) + (float) *(exposurePixels + linesize * (y-3) + (x+1)) + (float) *(exposurePixels + linesize * (y+3) + (x + 1)) + (float) *(exposurePixels + linesize * (y+3) + (x-1)) +
-            (float) *(exposurePixels + linesize * (y-1) + (x-3)) + (float) *(exposurePixels + linesize * (y-1) + (x+3)) + (float) *(exposurePixels + linesize * (y+1) + (x + 3)) + (float) *(exposurePixels + linesize * (y+1) + (x-3));
-			
-            D3 = 0.0;
-            
-            NSInteger i;
-            float *uptr;
-			uptr = exposurePixels + linesize * (y-4) + (x-4);
-			for (i=0; i<9; i++, uptr++)
-				D3 = D3 + *uptr;
-            
-			uptr = exposurePixels + linesize * (y-3) + (x-4);
-			for (i=0; i<3; i++, uptr++)
-				D3 = D3 + *uptr;
-            
-			uptr = uptr + 2;
-			for (i=0; i<3; i++, uptr++)
-				D3 = D3 + *uptr;
-            
-			D3 = D3 + (float) *(exposurePixels + linesize * (y-2) + (x-4)) + (float) *(exposurePixels + linesize * (y-2) + (x+4)) + (float) *(exposurePixels + linesize * (y-2) + (x-3)) + (float) *(exposurePixels + linesize * (y-2) + (x-3)) +
-            (float) *(exposurePixels + linesize * (y+2) + (x-4)) + (float) *(exposurePixels + linesize * (y+2) + (x+4)) + (float) *(exposurePixels + linesize * (y+2) + (x - 3)) + (float) *(exposurePixels + linesize * (y+2) + (x-3)) +
-            (float) *(exposurePixels + linesize * y + (x + 4)) + (float) *(exposurePixels + linesize * y + (x-4));
-            
-			uptr = exposurePixels + linesize * (y+4) + (x-4);
-			for (i=0; i<9; i++, uptr++)
-				D3 = D3 + *uptr;
-            
-			uptr = exposurePixels + linesize * (y+3) + (x-4);
-			for (i=0; i<3; i++, uptr++)
-				D3 = D3 + *uptr;
-            
-			uptr = uptr + 2;
-			for (i=0; i<3; i++, uptr++)
-				D3 = D3 + *uptr;
-            
-			mean = (A+B1+B2+C1+C2+C3+D1+D2+D3)/85.0;
-            
-			PSF_fit = PSF[0] * (A-mean) + PSF[1] * (B1 - 4.0*mean) + PSF[2] * (B2 - 4.0 * mean) +
-            PSF[3] * (C1 - 4.0*mean) + PSF[4] * (C2 - 8.0*mean) + PSF[5] * (C3 - 4.0 * mean) +
-            PSF[6] * (D1 - 4.0*mean) + PSF[7] * (D2 - 8.0*mean) + PSF[8] * (D3 - 48.0 * mean);
-            
-            
-			if (PSF_fit > BestPSF_fit) {
-				BestPSF_fit = PSF_fit;
-				xpos = x;
-				ypos = y;
-			}
-        }
+    double xpos, ypos;
+    if (pixels.format == kCASPixelFormatUInt16){
+        CASGuiderLocateStar(CASPixelsView<uint16_t>(pixels),xpos,ypos);
+    }
+    else {
+        CASGuiderLocateStar(CASPixelsView<float>(pixels),xpos,ypos);
     }
     
     NSLog(@"%@: %fs",NSStringFromSelector(_cmd),[NSDate timeIntervalSinceReferenceDate] - start);
@@ -316,27 +353,34 @@ typedef struct {
     NSAssert(!exposure.rgba, @"Star locator can't handle rgba images");
     
     NSInteger base_x, base_y;  // expected position in image (potentially cropped) coordinates
-	NSInteger start_x, start_y, rowsize;
+	NSInteger start_x, start_y;
 	NSInteger x, y, searchsize;
-	float *dataptr;
 	double lval, maxlval, mean;
 	double max, nearmax1, nearmax2, sval, localmin;
 	double mass, mx, my, val;
 
-    const CASSize size = exposure.actualSize;
-    float* exposurePixels = (float*)[exposure.floatPixels bytes];
-
     base_x = (int) CGRectGetMidX(area) ;
 	base_y = (int) CGRectGetMidY(area);
     
-	dataptr = exposurePixels;
-	rowsize = size.width;
 	searchsize = CGRectGetWidth(area) * 2 + 1;
 	maxlval = nearmax1 = nearmax2 = max = 0;
 	start_x = base_x - CGRectGetWidth(area); // u-left corner of local area
 	start_y = base_y - CGRectGetWidth(area);
 	mean=0;
     
+    // only the search area and the centroid box around wherever the peak turns up, one pixel inside it at most,
+    // need to be 0-1 floats. anything outside the frame reads as 0
+    const NSInteger margin = 8;
+    const NSInteger local_x = MAX(0,start_x - margin), local_y = MAX(0,start_y - margin);
+    const CASPixels local = CASPixelsRegion(exposure.samples,local_x,local_y,start_x + searchsize + margin - local_x,start_y + searchsize + margin - local_y);
+    std::vector<float> localPixels(local.width * local.height);
+    CASPixelsToFloat(local,localPixels.data(),local.width);
+    const auto pixel = [&](NSInteger px, NSInteger py) -> float {
+        px -= local_x;
+        py -= local_y;
+        return (px < 0 || py < 0 || px >= (NSInteger)local.width || py >= (NSInteger)local.height) ? 0 : localPixels[py * local.width + px];
+    };
+    
 	// figure the local offset
 	localmin = 1.0;
     //	localmin = 0;
@@ -344,10 +388,10 @@ typedef struct {
 	double localmean = 0.0;
 	for (y=0; y<searchsize; y++) {
 		for (x=0; x<searchsize; x++) {
-			if (*(dataptr + (start_x + x) + rowsize * (start_y + y-1)) < localmin)
-				localmin = *(dataptr + (start_x + x) + rowsize * (start_y + y-1));
-            //			localmin += *(dataptr + (start_x + x) + rowsize * (start_y + y-1));
-			localmean = localmean + (double)  *(dataptr + (start_x + x) + rowsize * (start_y + y-1));
+			if (pixel(start_x + x, start_y + y-1) < localmin)
+				localmin = pixel(start_x + x, start_y + y-1);
+            //			localmin += pixel(start_x + x, start_y + y-1);
+			localmean = localmean + (double)  pixel(start_x + x, start_y + y-1);
             
 		}
 	}
@@ -356,18 +400,18 @@ typedef struct {
 	// get rough guess on star's location
 	for (y=0; y<searchsize; y++) {
 		for (x=0; x<searchsize; x++) {
-			lval = *(dataptr + (start_x + x) + rowsize * (start_y + y)) +  // combine adjacent pixels to smooth image
-            *(dataptr + (start_x + x+1) + rowsize * (start_y + y)) +		// find max of this smoothed area and set
-            *(dataptr + (start_x + x-1) + rowsize * (start_y + y)) +		// base_x and y to be this spot
-            *(dataptr + (start_x + x) + rowsize * (start_y + y+1)) +
-            *(dataptr + (start_x + x) + rowsize * (start_y + y-1)) +
-            *(dataptr + (start_x + x) + rowsize * (start_y + y));  // weigh current pixel by 2x
+			lval = pixel(start_x + x, start_y + y) +  // combine adjacent pixels to smooth image
+            pixel(start_x + x+1, start_y + y) +		// find max of this smoothed area and set
+            pixel(start_x + x-1, start_y + y) +		// base_x and y to be this spot
+            pixel(start_x + x, start_y + y+1) +
+            pixel(start_x + x, start_y + y-1) +
+            pixel(start_x + x, start_y + y);  // weigh current pixel by 2x
 			if (lval >= maxlval) {
 				base_x = start_x + x;
 				base_y = start_y + y;
 				maxlval = lval;
 			}
-			sval = *(dataptr + (start_x + x) + rowsize * (start_y + y)) -localmin;
+			sval = pixel(start_x + x, start_y + y) -localmin;
 			if ( sval >= max) {
 				nearmax2 = nearmax1;
 				nearmax1 = max;
@@ -396,7 +440,7 @@ typedef struct {
 	//frame->SetStatusText(wxString::Format("%f",threshold),1);
 	for (y=0; y<ft_range; y++) {
 		for (x=0; x<ft_range; x++) {
-			val = (double) *(dataptr + (base_x + (x-hft_range)) + rowsize*(base_y + (y-hft_range))) - threshold;
+			val = (double) pixel(base_x + (x-hft_range), base_y + (y-hft_range)) - threshold;
 			if (val < 0.0) val=0.0;
 			mx = mx + (double) (base_x + x-hft_range) * val;
 			my = my + (double) (base_y + y-hft_range) * val;
@@ -408,7 +452,7 @@ typedef struct {
 		threshold = localmean;
 		for (y=0; y<ft_range; y++) {
 			for (x=0; x<ft_range; x++) {
-				val = (double) *(dataptr + (base_x + (x-hft_range)) + rowsize*(base_y + (y-hft_range))) - threshold;
+				val = (double) pixel(base_x + (x-hft_range), base_y + (y-hft_range)) - threshold;
 				if (val < 0.0) val=0.0;
 				mx = mx + (double) (base_x + x-hft_range) * val;
 				my = my + (double) (base_y + y-hft_range) * val;
@@ -421,7 +465,7 @@ typedef struct {
 		threshold = localmin;
 		for (y=0; y<ft_range; y++) {
 			for (x=0; x<ft_range; x++) {
-				val = (double) *(dataptr + (base_x + (x-hft_range)) + rowsize*(base_y + (y-hft_range))) - threshold;
+				val = (double) pixel(base_x + (x-hft_range), base_y + (y-hft_range)) - threshold;
 				if (val < 0.0) val=0.0;
 				mx = mx + (double) (base_x + x-hft_range) * val;
 				my = my + (double) (base_y + y-hft_range) * val;
@@ -551,13 +595,28 @@ typedef struct {
 }
 
 - (NSPoint)locateStar:(CASCCDExposure*)exposure inArea:(CGRect)area {
+    if (self.debayerMode != kCASImageDebayerNone && !exposure.rgba){
+        CASCCDExposure* superpixel = [self _superpixel:exposure];
+        if (!superpixel){
+            return NSZeroPoint;
+        }
+        const CASStarQuality quality = [self _locateStar:superpixel inArea:CGRectMake(CGRectGetMinX(area) / 2, CGRectGetMinY(area) / 2, CGRectGetWidth(area) / 2, CGRectGetHeight(area) / 2)];
+        return quality.mass == 0 ? NSZeroPoint : NSMakePoint(quality.mx / quality.mass * 2 + 0.5, quality.my / quality.mass * 2 + 0.5);
+    }
     const CASStarQuality quality = [self _locateStar:exposure inArea:area];
     return quality.mass == 0 ? NSZeroPoint : NSMakePoint(quality.mx / quality.mass, quality.my / quality.mass);
 }
 
 - (CASCCDExposure*)processGuideFrame:(CASCCDExposure*)exposure error:(NSError**)errorPtr {
     
-    exposure = [self.imageProcessor medianFilter:exposure];
+    // with a map of the camera's defects only those pixels need replacing rather than median filtering the whole frame
+    CASExposureDefectMap* defects = [[CASCCDExposureLibrary sharedLibrary] defectMapForDeviceID:exposure.deviceID];
+    if ([defects canCorrectExposure:exposure]){
+        exposure = [self.imageProcessor correctDefects:exposure map:defects];
+    }
+    else {
+        exposure = [self.imageProcessor medianFilter:exposure];
+    }
     
     const NSInteger result = [self updateStarLocation:exposure];
     if (result != STAR_OK){
@@ -48,7 +48,10 @@
 @interface CASCombineProcessor : CASBatchProcessor
 enum {
     kCASCombineProcessorSum,
-    kCASCombineProcessorAverage
+    kCASCombineProcessorAverage,
+    kCASCombineProcessorMedian,
+    kCASCombineProcessorKappaSigma,
+    kCASCombineProcessorWinsorizedSigma
 };
 @property (nonatomic,assign) NSInteger mode;
 @end
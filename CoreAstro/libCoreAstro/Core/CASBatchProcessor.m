@@ -28,6 +28,7 @@
 #import "CASCCDExposureLibrary.h"
 #import "CASCCDExposureIO.h"
 #import "CASImageDebayer.h"
+#import "CASExposureBackground.h"
 #import <Accelerate/Accelerate.h>
 
 @interface CASBatchProcessor ()
@@ -47,6 +48,7 @@
 @implementation CASCombineProcessor { // todo; bench this against -averageSum, upgrage -averageSum to vDSP, combine the two models
     vImage_Buffer _final;
     NSInteger _totalExposureTimeMS;
+    NSMutableArray* _exposures;
 }
 
 - (void)start
@@ -54,6 +56,12 @@
     [super start];
     
     bzero(&_final,sizeof(_final));
+    _exposures = [NSMutableArray arrayWithCapacity:100];
+}
+
+- (BOOL)rejectsOutliers
+{
+    return (self.mode != kCASCombineProcessorSum && self.mode != kCASCombineProcessorAverage);
 }
 
 - (void)processExposure:(CASCCDExposure*)exposure withInfo:(NSDictionary*)info
@@ -66,6 +74,18 @@
         self.first = exposure;
     }
     
+    if (self.rejectsOutliers){
+        // just collect them, the samples are read a strip at a time from the exposures' files when they're combined
+        if (exposure.actualSize.width != self.first.actualSize.width || exposure.actualSize.height != self.first.actualSize.height){
+            NSLog(@"%@: Ignoring exposure as it's the wrong size",NSStringFromSelector(_cmd));
+            return;
+        }
+        ++self.count;
+        _totalExposureTimeMS += exposure.params.ms;
+        [_exposures addObject:exposure];
+        return;
+    }
+    
     if (!_final.data){
         _final.data = calloc(size.width*size.height*sizeof(float),1);
         if (!_final.data){
@@ -96,22 +116,90 @@
     vDSP_vadd(fbuf,1,_final.data,1,_final.data,1,_final.width*_final.height);
 }
 
+- (NSString*)modeString
+{
+    switch (self.mode) {
+        case kCASCombineProcessorAverage:
+            return @"average";
+        case kCASCombineProcessorMedian:
+            return @"median";
+        case kCASCombineProcessorKappaSigma:
+            return @"kappa-sigma";
+        case kCASCombineProcessorWinsorizedSigma:
+            return @"winsorized-sigma";
+        default:
+            return @"sum";
+    }
+}
+
+- (void)normaliseBackground:(float*)pixels of:(CASCCDExposure*)exposure
+{
+    if (!self.background){
+        self.background = self.first.background;
+    }
+    CASExposureBackground* background = exposure.background;
+    if (!self.background || !background || background == self.background){
+        return;
+    }
+    
+    const NSInteger width = _actualSize.width;
+    NSMutableData* rows = [NSMutableData dataWithLength:2*width*sizeof(float)];
+    float* reference = (float*)[rows mutableBytes];
+    float* level = reference + width;
+    if (!reference){
+        return;
+    }
+    for (NSInteger y = 0; y < _actualSize.height; ++y){
+        [self.background getLevel:reference rms:NULL ofRow:y];
+        [background getLevel:level rms:NULL ofRow:y];
+        float* row = pixels + y * width;
+        vDSP_vsub(level,1,reference,1,reference,1,width); // reference - level
+        vDSP_vadd(row,1,reference,1,row,1,width);
+    }
+}
+
 - (void)completeWithBlock:(void(^)(NSError* error,CASCCDExposure*))block
 {
-    if (self.mode == kCASCombineProcessorAverage){
+    NSData* combinedPixels = nil;
+    
+    if (self.rejectsOutliers){
         
-        float fcount = self.count;
-        vDSP_vsdiv(_final.data,1,(float*)&fcount,_final.data,1,_final.width*_final.height);
+        CASImageProcessorCombineMode mode = kCASImageProcessorCombineMedian;
+        if (self.mode == kCASCombineProcessorKappaSigma){
+            mode = kCASImageProcessorCombineKappaSigma;
+        }
+        else if (self.mode == kCASCombineProcessorWinsorizedSigma){
+            mode = kCASImageProcessorCombineWinsorizedSigma;
+        }
+        CASCCDExposure* combined = [self.imageProcessor combine:_exposures params:[self.imageProcessor defaultCombineParamsWithMode:mode]];
+        [_exposures removeAllObjects];
+        if (!combined){
+            block([NSError errorWithDomain:NSStringFromClass([self class]) code:1 userInfo:@{NSLocalizedFailureReasonErrorKey:@"Failed to combine the exposures"}],nil);
+            return;
+        }
+        combinedPixels = combined.floatPixels;
+        _final.width = combined.actualSize.width;
+        _final.height = combined.actualSize.height;
+        _final.rowBytes = _final.width*sizeof(float);
+    }
+    else {
+        
+        if (self.mode == kCASCombineProcessorAverage){
+            
+            float fcount = self.count;
+            vDSP_vsdiv(_final.data,1,(float*)&fcount,_final.data,1,_final.width*_final.height);
+        }
+        combinedPixels = [NSData dataWithBytesNoCopy:_final.data length:_final.height*_final.rowBytes freeWhenDone:YES];
     }
 
     NSInteger exposureTime = 0;
-    if (self.mode == kCASCombineProcessorAverage){
+    if (self.mode != kCASCombineProcessorSum){
         exposureTime = _totalExposureTimeMS / self.count;
     }else{
         exposureTime = _totalExposureTimeMS;
     }
 
-    CASCCDExposure* result = [CASCCDExposure exposureWithFloatPixels:[NSData dataWithBytesNoCopy:_final.data length:_final.height*_final.rowBytes freeWhenDone:YES]
+    CASCCDExposure* result = [CASCCDExposure exposureWithFloatPixels:combinedPixels
                                                               camera:nil
                                                               params:CASExposeParamsMake(_final.width,_final.height,0,0,_final.width,_final.height,1,1,self.first.params.bps,exposureTime)
                                                                 time:[NSDate date]];
@@ -119,11 +207,14 @@
     result.type = self.first.type;
 
     NSMutableDictionary* mutableMeta = [NSMutableDictionary dictionaryWithDictionary:result.meta];
-    NSString* modeStr = (self.mode == kCASCombineProcessorAverage) ? @"average" : @"sum";
+    NSString* modeStr = [self modeString];
     [mutableMeta setObject:@[@{@"stack":@{@"images":self.history,@"mode":modeStr}}] forKey:@"history"];
     if (self.mode == kCASCombineProcessorAverage){
         exposureTime = _totalExposureTimeMS / self.count;
         [mutableMeta setObject:[NSString stringWithFormat:@"Average of %@",self.first.displayName] forKey:@"displayName"];
+    }else if (self.rejectsOutliers){
+        exposureTime = _totalExposureTimeMS / self.count;
+        [mutableMeta setObject:[NSString stringWithFormat:@"%@ of %@",[modeStr capitalizedString],self.first.displayName] forKey:@"displayName"];
     }else{
         exposureTime = _totalExposureTimeMS;
         [mutableMeta setObject:[NSString stringWithFormat:@"Sum of %@",self.first.displayName] forKey:@"displayName"];
@@ -151,29 +242,13 @@
 
 @end
 
-@implementation CASCCDCorrectionProcessor {
-    CASCCDExposure* _normalisedFlat;
-}
+@implementation CASCCDCorrectionProcessor
 
 - (BOOL)save
 {
     return NO;
 }
 
-- (CASCCDExposure*)_subtractDarkBiasFromExposure:(CASCCDExposure*)exposure
-{
-    if (self.dark){
-        return [self.imageProcessor subtract:self.dark from:exposure];
-    }
-    else if (self.bias){
-        return [self.imageProcessor subtract:self.bias from:exposure];
-    }
-    
-    // todo; dark, bias history
-
-    return [exposure copy];
-}
-
 - (void)start
 {
     [super start];
@@ -182,15 +257,8 @@
     if (!self.dark) self.dark = self.project.masterDark;
     if (!self.bias) self.bias = self.project.masterBias;
     
-    // todo; flat darks and bias frames
-
-    // create a normalised flat
-    if (self.flat){
-        
-        self.flat = [self _subtractDarkBiasFromExposure:self.flat];
-        
-        _normalisedFlat = [self.imageProcessor normalise:self.flat];
-    }
+    // todo; flat darks
+    // todo; dark, bias history
 }
 
 - (void)processExposure:(CASCCDExposure*)exposure withInfo:(NSDictionary*)info
@@ -210,42 +278,19 @@
         self.first = exposure;
     }
     
-    // subtract dark/bias from exposure
-    self.result = [self _subtractDarkBiasFromExposure:exposure];
+    // subtract dark/bias and divide out the flat in a single pass, the image processor caches the master frame statistics between exposures
+    self.result = [self.imageProcessor calibrate:exposure bias:self.bias dark:self.dark flat:self.flat];
+    if (!self.result){
+        NSLog(@"%@: Failed to calibrate exposure",NSStringFromSelector(_cmd));
+        return;
+    }
     
-    // divide out the flat if we've got one
     if (self.flat){
     
-        const CASSize size1 = self.flat.actualSize;
-        const CASSize size2 = self.result.actualSize;
-        if (size1.width != size2.width || size1.height != size2.height){
-            NSLog(@"%@: Image sizes don't match",NSStringFromSelector(_cmd));
-            return;
-        }
-        
-        float* fbuf = (float*)[self.result.floatPixels bytes];
-        float* fnorm = (float*)[_normalisedFlat.floatPixels bytes];
-        if (!fbuf || !fnorm){
-            NSLog(@"%@: Out of memory",NSStringFromSelector(_cmd));
-            return;
-        }
-        
-        NSMutableData* corrected = [NSMutableData dataWithLength:[self.flat.floatPixels length]];
-        if (!corrected){
-            NSLog(@"%@: Out of memory",NSStringFromSelector(_cmd));
-            return;
-        }
-        
-        vDSP_vdiv(fnorm,1,fbuf,1,(float*)[corrected mutableBytes],1,[corrected length]/sizeof(float));
-        
-        self.result = [CASCCDExposure exposureWithFloatPixels:corrected
-                                                       camera:nil // exposure.camera
-                                                       params:self.result.params
-                                                         time:[NSDate date]];
-        
         NSMutableDictionary* mutableMeta = [NSMutableDictionary dictionaryWithDictionary:self.first.meta];
-        [mutableMeta setObject:@[@{@"flat-correction":@{@"flat":self.flat.uuid,@"light":self.result.uuid}}] forKey:@"history"];
+        [mutableMeta setObject:@[@{@"flat-correction":@{@"flat":self.flat.uuid,@"light":exposure.uuid}}] forKey:@"history"];
         [mutableMeta setObject:@"Flat Corrected" forKey:@"displayName"];
+        [mutableMeta setObject:self.result.uuid forKey:@"uuid"];
         id device = [self.first.meta objectForKey:@"device"];
         if (device){
             [mutableMeta setObject:device forKey:@"device"];
@@ -315,6 +360,7 @@
 @property (nonatomic,strong) CASCCDExposure* first;
 @property (nonatomic,strong) NSMutableData* working;
 @property (nonatomic,strong) NSMutableData* accumulate;
+@property (nonatomic,strong) CASExposureBackground* background;
 @property (nonatomic,strong) NSMutableArray* history;
 @end
 
@@ -352,6 +398,39 @@
     return _guideAlgorithm;
 }
 
+// the pattern a debayered exposure was made with, from the last debayer entry in its history
+- (NSInteger)debayerModeOfExposure:(CASCCDExposure*)exposure
+{
+    id history = exposure.meta[@"history"];
+    if (history && ![history isKindOfClass:[NSArray class]]){
+        history = @[history];
+    }
+    for (id entry in [history reverseObjectEnumerator]){
+        NSString* mode = [entry isKindOfClass:[NSDictionary class]] ? entry[@"debayer"][@"mode"] : nil;
+        if (mode){
+            const NSUInteger index = [@[@"RGGB",@"GRBG",@"BGGR",@"GBRG"] indexOfObject:mode];
+            return (index == NSNotFound) ? kCASImageDebayerNone : kCASImageDebayerRGGB + index;
+        }
+    }
+    return kCASImageDebayerNone;
+}
+
+// the luminance of the search area. debayered exposures have it interpolated straight from the raw frame rather
+// than copying the subframe out of the RGBA one and reducing that
+- (CASCCDExposure*)searchFrameOfExposure:(CASCCDExposure*)exposure raw:(CASCCDExposure*)raw
+{
+    if (exposure != raw && exposure.rgba){
+        const NSInteger mode = [self debayerModeOfExposure:exposure];
+        if (mode != kCASImageDebayerNone){
+            CASCCDExposure* luminance = [self.imageProcessor luminance:raw mode:mode rect:_initialSearchFrame];
+            if (luminance){
+                return luminance;
+            }
+        }
+    }
+    return [self.imageProcessor luminance:[exposure subframeWithRect:_initialSearchFrame]];
+}
+
 - (void)processExposure:(CASCCDExposure*)exposure withInfo:(NSDictionary*)info
 {
     NSParameterAssert(exposure);
@@ -362,6 +441,7 @@
     }
      
     // use a corrected exposure for stacking if one is available (similarly for debayered)
+    CASCCDExposure* raw = exposure.correctedExposure ?: exposure;
     exposure = [self exposureFromExposure:exposure];
     
     if (!self.first){
@@ -397,7 +477,7 @@
             }
             
             // locate the reference star making sure we're using a luminance frame
-            CASCCDExposure* subframe = [self.imageProcessor luminance:[self.first subframeWithRect:_initialSearchFrame]];
+            CASCCDExposure* subframe = [self searchFrameOfExposure:self.first raw:raw];
 
             NSArray* stars = [self.guideAlgorithm locateStars:subframe];
             if (![stars count]){
@@ -437,7 +517,7 @@
     }
         
     // search within the same area that we found the reference star for the corresponding one
-    const NSPoint star = [self.guideAlgorithm locateStar:[self.imageProcessor luminance:[exposure subframeWithRect:_initialSearchFrame]] inArea:_searchFrame];
+    const NSPoint star = [self.guideAlgorithm locateStar:[self searchFrameOfExposure:exposure raw:raw] inArea:_searchFrame];
     if (star.x == -1){
         NSLog(@"%@: Found no stars in exposure frame",NSStringFromSelector(_cmd));
         return;
@@ -508,6 +588,12 @@
         }
     }
     
+    // bring the sky up or down to the reference frame's so changing gradients through the night don't smear into
+    // the stack, the maps are smooth enough that the small translation above doesn't matter
+    if (!exposure.rgba){
+        [self normaliseBackground:output.data of:exposure];
+    }
+    
     // add the translated pixels to accumulation buffer
     const NSInteger length = exposure.rgba ? _actualSize.width*_actualSize.height*4 : _actualSize.width*_actualSize.height;
     vDSP_vadd([self.accumulate mutableBytes],1,output.data,1,[self.accumulate mutableBytes],1,length);
@@ -568,15 +654,24 @@
 @interface CASCCDDebayerProcessor : CASBatchProcessor
 @property (nonatomic,assign) NSInteger mode;
 @property (nonatomic,strong) CASImageDebayer* imageDebayer;
+- (id)initWithAlgorithm:(NSString*)algorithm;
 @end
 
 @implementation CASCCDDebayerProcessor
 
 - (id)init
+{
+    return [self initWithAlgorithm:nil];
+}
+
+- (id)initWithAlgorithm:(NSString*)algorithm
 {
     self = [super init];
     if (self) {
-        self.imageDebayer = [CASImageDebayer imageDebayerWithIdentifier:nil];
+        self.imageDebayer = [CASImageDebayer imageDebayerWithIdentifier:algorithm];
+        if (!self.imageDebayer){
+            self = nil;
+        }
     }
     return self;
 }
@@ -601,7 +696,10 @@
     self.imageDebayer.mode = self.mode; // todo; should really be an arg to -debayer:
     
     CASCCDExposure* debayered = [self.imageDebayer debayer:exposure];
-    
+
+    // cache as 16-bit planes, 6 bytes a pixel rather than 16 for RGBA floats
+    debayered = [self.imageProcessor compactColour:debayered format:kCASCCDExposureFormatRGBUInt16] ?: debayered;
+
     // fixup metadata
     NSMutableDictionary* mutableMeta = [NSMutableDictionary dictionaryWithDictionary:debayered.meta];
 
@@ -636,7 +734,19 @@
             modeStr = @"GBRG";
             break;
     }
-    [history addObject:@{@"debayer":@{@"images":exposure.uuid,@"mode":modeStr}}];
+    NSString* algorithmStr;
+    switch (self.imageDebayer.algorithm) {
+        case kCASImageDebayerVNG:
+            algorithmStr = @"VNG";
+            break;
+        case kCASImageDebayerAHD:
+            algorithmStr = @"AHD";
+            break;
+        default:
+            algorithmStr = @"bilinear";
+            break;
+    }
+    [history addObject:@{@"debayer":@{@"images":exposure.uuid,@"mode":modeStr,@"algorithm":algorithmStr}}];
     [mutableMeta setObject:[history copy] forKey:@"history"];
     
     // preserve exposure time
@@ -819,11 +929,22 @@
         @{@"id":@"stack.average",@"name":@"Quick Stack"},
         @{@"id":@"combine.sum",@"name":@"Combine Sum"},
         @{@"id":@"combine.average",@"name":@"Combine Average"},
+        @{@"id":@"combine.median",@"name":@"Combine Median"},
+        @{@"id":@"combine.kappa-sigma",@"name":@"Combine Kappa-Sigma"},
+        @{@"id":@"combine.winsorized-sigma",@"name":@"Combine Winsorized Sigma"},
         @{@"category":@"Debayer",@"actions":@[
                   @{@"id":@"debayer.RGGB",@"name":@"Debayer RGGB"},
                   @{@"id":@"debayer.GRBG",@"name":@"Debayer GRBG"},
                   @{@"id":@"debayer.BGGR",@"name":@"Debayer BGGR"},
-                  @{@"id":@"debayer.GBRG",@"name":@"Debayer GBRG"}]},
+                  @{@"id":@"debayer.GBRG",@"name":@"Debayer GBRG"},
+                  @{@"id":@"debayer.vng.RGGB",@"name":@"Debayer RGGB (VNG)"},
+                  @{@"id":@"debayer.vng.GRBG",@"name":@"Debayer GRBG (VNG)"},
+                  @{@"id":@"debayer.vng.BGGR",@"name":@"Debayer BGGR (VNG)"},
+                  @{@"id":@"debayer.vng.GBRG",@"name":@"Debayer GBRG (VNG)"},
+                  @{@"id":@"debayer.ahd.RGGB",@"name":@"Debayer RGGB (AHD)"},
+                  @{@"id":@"debayer.ahd.GRBG",@"name":@"Debayer GRBG (AHD)"},
+                  @{@"id":@"debayer.ahd.BGGR",@"name":@"Debayer BGGR (AHD)"},
+                  @{@"id":@"debayer.ahd.GBRG",@"name":@"Debayer GBRG (AHD)"}]},
         @{@"id":@"revert",@"name":@"Revert to Original"}
     ] : nil;
 }
@@ -842,6 +963,24 @@
         return combine;
     }
     
+    if ([@"combine.median" isEqualToString:identifier]){
+        CASCombineProcessor* combine = [[CASCombineProcessor alloc] init];
+        combine.mode = kCASCombineProcessorMedian;
+        return combine;
+    }
+    
+    if ([@"combine.kappa-sigma" isEqualToString:identifier]){
+        CASCombineProcessor* combine = [[CASCombineProcessor alloc] init];
+        combine.mode = kCASCombineProcessorKappaSigma;
+        return combine;
+    }
+    
+    if ([@"combine.winsorized-sigma" isEqualToString:identifier]){
+        CASCombineProcessor* combine = [[CASCombineProcessor alloc] init];
+        combine.mode = kCASCombineProcessorWinsorizedSigma;
+        return combine;
+    }
+    
     if ([@"stack.average" isEqualToString:identifier]){
         CASCCDStackingProcessor* stack = [[CASCCDStackingProcessor alloc] init];
         return stack;
@@ -854,9 +993,15 @@
 
     if ([identifier hasPrefix:@"debayer."]){
         
-        CASCCDDebayerProcessor* debayer = [[CASCCDDebayerProcessor alloc] init];
+        // debayer.<pattern> for bilinear, debayer.<algorithm>.<pattern> for the others
+        NSArray* components = [identifier componentsSeparatedByString:@"."];
+        NSString* algorithm = ([components count] == 3) ? components[1] : nil;
+        CASCCDDebayerProcessor* debayer = [[CASCCDDebayerProcessor alloc] initWithAlgorithm:algorithm];
         
-        if ([identifier hasSuffix:@"RGGB"]){
+        if (!debayer){
+            NSLog(@"Unrecognised debayer identifier %@",identifier);
+        }
+        else if ([identifier hasSuffix:@"RGGB"]){
             debayer.mode = kCASImageDebayerRGGB;
         }
         else if ([identifier hasSuffix:@"GRBG"]){
@@ -0,0 +1,49 @@
+//
+//  CASCCDExposure+Pixels.m
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import "CASCCDExposure+Pixels.h"
+
+@implementation CASCCDExposure (Pixels)
+
+- (CASPixels)samples
+{
+    const CASSize size = self.actualSize;
+    const NSInteger pixelCount = size.width * size.height;
+    
+    if (self.format == kCASCCDExposureFormatUInt16 && !self.rgba){
+        NSData* pixels = self.pixels;
+        if (pixelCount && [pixels length] >= pixelCount * sizeof(uint16_t)){
+            return CASPixelsMake(kCASPixelFormatUInt16,[pixels bytes],size.width,size.height,size.width);
+        }
+    }
+    
+    NSData* floatPixels = self.floatPixels;
+    if (pixelCount && [floatPixels length] >= pixelCount * self.pixelSize){
+        return CASPixelsMake(self.rgba ? kCASPixelFormatRGBAFloat : kCASPixelFormatFloat,[floatPixels bytes],size.width,size.height,size.width);
+    }
+    
+    return CASPixelsMake(kCASPixelFormatNone,NULL,0,0,0);
+}
+
+@end
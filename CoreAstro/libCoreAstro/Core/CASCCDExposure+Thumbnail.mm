@@ -0,0 +1,57 @@
+//
+//  CASCCDExposure+Thumbnail.mm
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import "CASCCDExposure+Thumbnail.h"
+#import "CASCCDExposure+Pixels.h"
+#import "CASThumbnail.h"
+
+@implementation CASCCDExposure (Thumbnail)
+
+- (CGImageRef)newThumbnailImageWithWidth:(NSInteger)width
+{
+    CASCCDExposure* level = [self pyramidExposureForSize:CASSizeMake(width,0)];
+    const CASPixels samples = level.samples;
+    if (CASPixelsIsEmpty(samples) || width < 1){
+        NSLog(@"%@: no pixels",NSStringFromSelector(_cmd));
+        return NULL;
+    }
+    
+    const CASSize size = CASSizeMake(width,CASThumbnailHeight(samples.width,samples.height,width));
+    const BOOL rgba = (samples.format == kCASPixelFormatRGBAFloat);
+    CGContextRef context = rgba ? [CASCCDImage newRGBBitmapContextWithSize:size] : [CASCCDImage newGrayBitmapContextWithSize:size];
+    uint8_t* data = (uint8_t*)CGBitmapContextGetData(context);
+    
+    CGImageRef result = NULL;
+    if (!data){
+        NSLog(@"%@: failed to create bitmap of size %@",NSStringFromSelector(_cmd),NSStringFromCASSize(size));
+    }
+    else if (CASThumbnailRender(samples,size.width,size.height,data,CGBitmapContextGetBytesPerRow(context))){
+        result = CGBitmapContextCreateImage(context);
+    }
+    CGContextRelease(context);
+    
+    return result;
+}
+
+@end
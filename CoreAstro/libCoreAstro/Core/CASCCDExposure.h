@@ -27,14 +27,15 @@
 #import "CASCCDImage.h"
 #import "CASScriptableObject.h"
 
-@class CASCCDDevice, CASCCDExposureIO;
+@class CASCCDDevice, CASCCDExposureIO, CASExposureStatistics, CASExposureHistogram, CASExposurePyramid, CASExposureBackground;
 
 @interface CASCCDExposure : CASScriptableObject<NSCopying>
 
 // represents the raw pixels of an exposure, contains metadata describing the source camera and exposure settings. saves the data to a persistent store
 
-@property (nonatomic,strong) NSData* pixels; // original 16-bit unsigned int samples
+@property (nonatomic,strong) NSData* pixels; // original 16-bit unsigned int samples, or three planes of red, green and blue for the compact colour formats
 @property (nonatomic,strong) NSData* floatPixels; // float values rescaled to 0.0-1.0 for better compatibility with vImage, CoreImage, etc
+@property (nonatomic,readonly) NSMutableData* mutableFloatPixels; // the same for writing to in place, copied first if they're shared with a copy of this exposure
 
 @property (nonatomic,readonly) BOOL hasPixels;
 @property (nonatomic,strong) NSDictionary* meta;
@@ -44,7 +45,8 @@
 @property (nonatomic,readonly) NSInteger maxPixelValue;
 @property (nonatomic,readonly) NSInteger pixelSize;
 
-@property (nonatomic,readonly) BOOL rgba;
+@property (nonatomic,readonly) BOOL rgba; // colour, the float pixels are RGBA whether or not the samples are held as planes
+@property (nonatomic,readonly) BOOL planar; // colour held as planes of 16-bit samples or halves
 @property (nonatomic,readonly) CASSize actualSize; // frame.size / bin.size
 
 @property (nonatomic,readonly) NSDate* date;
@@ -79,7 +81,9 @@ typedef enum {
 typedef enum CASCCDExposureFormat {
     kCASCCDExposureFormatUInt16 = 0,
     kCASCCDExposureFormatFloat = 1,
-    kCASCCDExposureFormatFloatRGBA = 2
+    kCASCCDExposureFormatFloatRGBA = 2,
+    kCASCCDExposureFormatRGBUInt16 = 3,    // planar colour in pixels, floatPixels expands them to RGBA
+    kCASCCDExposureFormatRGBHalf = 4       // likewise, half precision floats
 } CASCCDExposureFormat;
 
 @property (nonatomic,assign) CASCCDExposureFormat format;
@@ -91,6 +95,15 @@ typedef enum CASCCDExposureFormat {
 
 - (CASCCDExposure*)subframeWithRect:(CASRect)rect;
 
+@property (nonatomic,readonly) CASExposureStatistics* statistics; // computed on first use and kept until the pixels change
+@property (nonatomic,readonly) CASExposureHistogram* histogram; // likewise, full resolution
+@property (nonatomic,readonly) CASExposureBackground* background; // likewise, mono exposures only
+- (void)invalidateStatistics; // call after modifying the pixel buffers in place, drops the histogram, background and pyramid too
+
+@property (nonatomic,readonly) CASExposurePyramid* pyramid; // likewise, read back from the store if it's been saved there
+- (CASCCDExposure*)exposureAtPyramidLevel:(NSUInteger)level; // level 0 is this exposure
+- (CASCCDExposure*)pyramidExposureForSize:(CASSize)size; // the smallest level at least as big as size, this exposure if none are
+
 - (void)reset;
 
 - (void)deleteExposure;
@@ -98,6 +111,7 @@ typedef enum CASCCDExposureFormat {
 + (id)exposureWithPixels:(NSData*)pixels camera:(CASCCDDevice*)camera params:(CASExposeParams)params time:(NSDate*)time;
 + (id)exposureWithFloatPixels:(NSData*)pixels camera:(CASCCDDevice*)camera params:(CASExposeParams)expParams time:(NSDate*)time;
 + (id)exposureWithRGBAFloatPixels:(NSData*)pixels camera:(CASCCDDevice*)camera params:(CASExposeParams)expParams time:(NSDate*)time;
++ (id)exposureWithRGBPixels:(NSData*)pixels format:(CASCCDExposureFormat)format camera:(CASCCDDevice*)camera params:(CASExposeParams)expParams time:(NSDate*)time; // kCASCCDExposureFormatRGBUInt16 or kCASCCDExposureFormatRGBHalf planes
 
 + (id)exposureWithTestStars:(NSArray*)stars params:(CASExposeParams)expParams;
 
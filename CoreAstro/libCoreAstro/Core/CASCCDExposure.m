@@ -26,13 +26,31 @@
 #import "CASCCDExposure.h"
 #import "CASCCDExposureIO.h"
 #import "CASCCDDevice.h"
+#import "CASExposureStatistics.h"
+#import "CASExposureHistogram.h"
+#import "CASExposurePyramid.h"
+#import "CASExposureBackground.h"
 #import "CASUtilities.h"
+#import "CASFramePoolData.h"
+#import "CASColourPlanes.h"
 #import <Accelerate/Accelerate.h>
 #import <QuartzCore/QuartzCore.h>
 
+// the exposures holding the same float pixels since one was copied from another. whichever wants to write to
+// them first while there's more than one holder takes its own copy, the others carry on sharing
+@interface CASCCDExposurePixelShare : NSObject {
+@public
+    NSInteger _holders;
+}
+@end
+
+@implementation CASCCDExposurePixelShare
+@end
+
 @implementation CASCCDExposure {
     NSData* _pixels;
     NSData* _floatPixels;
+    CASCCDExposurePixelShare* _floatPixelsShare;
     NSDictionary* _meta;
     enum {
         kCASCCDExposureReadMeta = 1,
@@ -40,23 +58,61 @@
     };
     NSInteger _readState;
     NSURL* _pngURL; // tmp hack
+    CASExposureStatistics* _statistics;
+    CASExposureHistogram* _histogram;
+    CASExposurePyramid* _pyramid;
+    CASExposureBackground* _background;
+    BOOL _pixelsChanged; // since they were read from the store, so any pyramid saved there is out of date
+    BOOL _readingFromStore;
 }
 
 - (id)copyWithZone:(NSZone *)zone
 {
     CASCCDExposure* result = nil;
-    NSMutableData* floatPixels = [NSMutableData dataWithLength:[self.floatPixels length]];
-    if ([floatPixels mutableBytes]){
-        memcpy([floatPixels mutableBytes], [self.floatPixels bytes], [self.floatPixels length]);
-        result = [CASCCDExposure exposureWithFloatPixels:floatPixels camera:nil params:self.params time:[NSDate date]];
-        NSMutableDictionary* meta = [[NSMutableDictionary alloc] initWithDictionary:self.meta copyItems:YES]; // or serialize/deserialize
-        [meta setObject:CASCreateUUID() forKey:@"uuid"];
-        result.meta = [meta copy];
-        result.format = kCASCCDExposureFormatFloat;
+    @synchronized(self){
+        
+        // the copy shares the float pixels, and anything worked out from them, until one of them wants to write to them
+        NSData* floatPixels = self.floatPixels;
+        if (floatPixels){
+            result = [CASCCDExposure exposureWithPixels:floatPixels camera:nil params:self.params time:[NSDate date] floatPixels:YES rgba:self.rgba];
+            NSMutableDictionary* meta = [[NSMutableDictionary alloc] initWithDictionary:self.meta copyItems:YES]; // or serialize/deserialize
+            [meta setObject:CASCreateUUID() forKey:@"uuid"];
+            result.meta = [meta copy];
+            result.format = self.rgba ? kCASCCDExposureFormatFloatRGBA : kCASCCDExposureFormatFloat;
+            
+            if (!_floatPixelsShare){
+                _floatPixelsShare = [[CASCCDExposurePixelShare alloc] init];
+                _floatPixelsShare->_holders = 1;
+            }
+            @synchronized(_floatPixelsShare){
+                ++_floatPixelsShare->_holders;
+            }
+            result->_floatPixelsShare = _floatPixelsShare;
+            result->_statistics = _statistics;
+            result->_histogram = _histogram;
+            result->_pyramid = _pyramid;
+            result->_background = _background;
+        }
     }
     return result;
 }
 
+- (void)dealloc
+{
+    [self leaveFloatPixelsShare];
+}
+
+// call with self locked
+- (void)leaveFloatPixelsShare
+{
+    if (_floatPixelsShare){
+        @synchronized(_floatPixelsShare){
+            --_floatPixelsShare->_holders;
+        }
+        _floatPixelsShare = nil;
+    }
+}
+
 - (NSDate*) date
 {
     return [NSDate dateWithTimeIntervalSinceReferenceDate:[[self.meta objectForKey:@"time"] doubleValue]];
@@ -178,7 +234,9 @@
             return;
         }
         _readState = readPixels ? kCASCCDExposureReadPixels : kCASCCDExposureReadMeta;
+        _readingFromStore = YES;
         [self.io readExposure:self readPixels:readPixels error:nil];
+        _readingFromStore = NO;
     }
 }
 
@@ -195,20 +253,35 @@
         if (!_floatPixels){
             
             NSData* pixels = self.pixels;
-            if (pixels){
+            if (pixels && self.planar){
+                
+                // colour planes expand to RGBA for display and everything that works on the float pixels. the pyramid and
+                // thumbnail read the planes themselves so just saving a planar exposure doesn't make these
+                const NSInteger count = [pixels length] / (3 * sizeof(uint16_t));
+                const CASColourPlanesFormat format = (self.format == kCASCCDExposureFormatRGBHalf) ? kCASColourPlanesHalf : kCASColourPlanesUInt16;
+                NSMutableData* floatPixels = [CASFramePoolData uninitialisedDataWithLength:count * 4 * sizeof(float)];
+                if (!floatPixels){
+                    NSLog(@"*** Out of memory converting to float pixels");
+                }
+                else if (CASColourPlanesToRGBA([pixels bytes],count,format,(float*)[floatPixels mutableBytes])){
+                    _floatPixels = floatPixels;
+                }
+            }
+            else if (pixels){
                 
                 //const NSTimeInterval duration = CASTimeBlock(^{
                 
                 const NSInteger count = [pixels length] / sizeof(uint16_t);
-                float* fp = malloc(count * sizeof(float));
-                if (!fp){
+                NSMutableData* floatPixels = [CASFramePoolData uninitialisedDataWithLength:count * sizeof(float)];
+                if (!floatPixels){
                     NSLog(@"*** Out of memory converting to float pixels");
                 }
                 else{
+                    float* fp = (float*)[floatPixels mutableBytes];
                     vDSP_vfltu16((uint16_t*)[pixels bytes],1,fp,1,count);
                     const float max = self.maxPixelValue;
                     vDSP_vsdiv(fp,1,(float*)&max,fp,1,count);
-                    _floatPixels = [NSData dataWithBytesNoCopy:fp length:(count * sizeof(float))];
+                    _floatPixels = floatPixels;
                 }
                 //});
                 // NSLog(@"floatPixels: %fs",duration);
@@ -218,6 +291,157 @@
     return _floatPixels;
 }
 
+- (NSMutableData*)mutableFloatPixels
+{
+    @synchronized(self){
+        
+        NSData* floatPixels = self.floatPixels;
+        if (!floatPixels){
+            return nil;
+        }
+        
+        BOOL shared = NO;
+        if (_floatPixelsShare){
+            @synchronized(_floatPixelsShare){
+                shared = (_floatPixelsShare->_holders > 1);
+            }
+        }
+        if (shared || ![floatPixels isKindOfClass:[NSMutableData class]]){
+            floatPixels = [CASFramePoolData dataWithBytes:[floatPixels bytes] length:[floatPixels length]];
+            if (!floatPixels){
+                NSLog(@"*** Out of memory copying float pixels");
+                return nil;
+            }
+        }
+        
+        [self leaveFloatPixelsShare];
+        _floatPixels = floatPixels;
+        _statistics = nil;
+        _histogram = nil;
+        _pyramid = nil;
+        _background = nil;
+        _pixelsChanged = YES;
+        
+        // once they've been written to the float pixels rather than the 16-bit samples or colour planes are the frame
+        if (self.format == kCASCCDExposureFormatUInt16){
+            self.format = kCASCCDExposureFormatFloat;
+        }
+        else if (self.planar){
+            self.format = kCASCCDExposureFormatFloatRGBA;
+        }
+        
+        return (NSMutableData*)_floatPixels;
+    }
+}
+
+- (void)setPixels:(NSData *)pixels
+{
+    @synchronized(self){
+        // setting nil just unloads them (see -reset) and reading them back in from the store doesn't change them
+        if (pixels && pixels != _pixels && !_readingFromStore){
+            _statistics = nil;
+            _histogram = nil;
+            _pyramid = nil;
+            _background = nil;
+            _pixelsChanged = YES;
+        }
+        _pixels = pixels;
+    }
+}
+
+- (void)setFloatPixels:(NSData *)floatPixels
+{
+    @synchronized(self){
+        if (floatPixels && floatPixels != _floatPixels && !_readingFromStore){
+            _statistics = nil;
+            _histogram = nil;
+            _pyramid = nil;
+            _background = nil;
+            _pixelsChanged = YES;
+        }
+        if (floatPixels != _floatPixels){
+            [self leaveFloatPixelsShare];
+        }
+        _floatPixels = floatPixels;
+    }
+}
+
+- (CASExposureStatistics*)statistics
+{
+    @synchronized(self){
+        if (!_statistics){
+            _statistics = [CASExposureStatistics statisticsWithExposure:self];
+        }
+        return _statistics;
+    }
+}
+
+- (CASExposureHistogram*)histogram
+{
+    @synchronized(self){
+        if (!_histogram){
+            _histogram = [CASExposureHistogram histogramWithExposure:self];
+        }
+        return _histogram;
+    }
+}
+
+- (CASExposureBackground*)background
+{
+    @synchronized(self){
+        if (!_background){
+            _background = [CASExposureBackground backgroundWithExposure:self];
+        }
+        return _background;
+    }
+}
+
+- (void)invalidateStatistics
+{
+    @synchronized(self){
+        _statistics = nil;
+        _histogram = nil;
+        _pyramid = nil;
+        _background = nil;
+        _pixelsChanged = YES;
+    }
+}
+
+- (CASExposurePyramid*)pyramid
+{
+    @synchronized(self){
+        if (!_pyramid && !_pixelsChanged){
+            _pyramid = [CASExposurePyramid pyramidWithExposure:self data:[self.io readPyramid]];
+        }
+        if (!_pyramid){
+            _pyramid = [CASExposurePyramid pyramidWithExposure:self];
+            
+            // saved exposures from before there were pyramids get one the first time it's needed
+            if (_pyramid && !_pixelsChanged){
+                [self.io writePyramid:_pyramid.data error:nil];
+            }
+        }
+        return _pyramid;
+    }
+}
+
+- (CASCCDExposure*)exposureAtPyramidLevel:(NSUInteger)level
+{
+    return level ? [self.pyramid exposureAtLevel:level ofExposure:self] : self;
+}
+
+- (CASCCDExposure*)pyramidExposureForSize:(CASSize)size
+{
+    CASExposurePyramid* pyramid = self.pyramid;
+    for (NSUInteger level = pyramid.levelCount; level > 1; --level){
+        const CASSize levelSize = [pyramid sizeOfLevel:level - 1];
+        if (levelSize.width >= size.width && levelSize.height >= size.height){
+            return [pyramid exposureAtLevel:level - 1 ofExposure:self];
+        }
+    }
+    return self;
+}
+
 - (BOOL)hasPixels
 {
     return (_pixels != nil);
@@ -304,7 +528,14 @@
 
 - (BOOL) rgba
 {
-    return ([[self.meta valueForKey:@"format"] integerValue] == kCASCCDExposureFormatFloatRGBA);
+    const NSInteger format = [[self.meta valueForKey:@"format"] integerValue];
+    return (format == kCASCCDExposureFormatFloatRGBA || format == kCASCCDExposureFormatRGBUInt16 || format == kCASCCDExposureFormatRGBHalf);
+}
+
+- (BOOL) planar
+{
+    const NSInteger format = [[self.meta valueForKey:@"format"] integerValue];
+    return (format == kCASCCDExposureFormatRGBUInt16 || format == kCASCCDExposureFormatRGBHalf);
 }
 
 - (NSString*)note
@@ -350,7 +581,7 @@
     
     const NSInteger pixelSize = self.pixelSize;
 
-    NSData* subframePixels = [NSMutableData dataWithLength:rect.size.width*rect.size.height*pixelSize]; // bin size
+    NSData* subframePixels = [CASFramePoolData dataWithLength:rect.size.width*rect.size.height*pixelSize]; // bin size
     if (!subframePixels){
         return nil;
     }
@@ -543,6 +774,19 @@
     return [[self class] exposureWithPixels:pixels camera:camera params:expParams time:time floatPixels:YES rgba:YES];
 }
 
++ (id)exposureWithRGBPixels:(NSData*)pixels format:(CASCCDExposureFormat)format camera:(CASCCDDevice*)camera params:(CASExposeParams)expParams time:(NSDate*)time
+{
+    if (format != kCASCCDExposureFormatRGBUInt16 && format != kCASCCDExposureFormatRGBHalf){
+        NSLog(@"%@: not a planar colour format",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    CASCCDExposure* result = [[self class] exposureWithPixels:pixels camera:camera params:expParams time:time floatPixels:NO rgba:NO];
+    NSMutableDictionary* meta = [NSMutableDictionary dictionaryWithDictionary:result.meta];
+    [meta setObject:[NSNumber numberWithInteger:format] forKey:@"format"];
+    result.meta = [meta copy];
+    return result;
+}
+
 + (id)exposureWithTestStars:(NSArray*)stars params:(CASExposeParams)expParams
 {
     const CGFloat kCASStarRadius = 2.5;
@@ -25,6 +25,9 @@
 
 #import "CASCCDExposure.h"
 
+extern NSString* const kCASCCDExposureIOThumbnailNotification;
+extern NSString* const kCASCCDExposureIOThumbnailWrittenKey; // NSNumber BOOL in the notification's userInfo, NO if one couldn't be made
+
 @interface CASCCDExposureIO : NSObject
 
 @property (nonatomic,copy) NSURL* url;
@@ -38,7 +41,12 @@
 
 + (NSString*)sanitizeExposurePath:(NSString*)path;
 
-@property (nonatomic,readonly) NSImage* thumbnail;
+@property (nonatomic,readonly) NSImage* thumbnail; // nil until one's been made
+
+// makes the thumbnail on a background queue, -writeExposure:writePixels: does this itself once the samples and metadata
+// are saved. kCASCCDExposureIOThumbnailNotification is posted on the main thread with this as the object when it's
+// done, whether or not it worked. NO if the format doesn't keep thumbnails or too many are already waiting
+- (BOOL)writeThumbnailOfExposure:(CASCCDExposure*)exposure;
 
 - (BOOL)writeExposure:(CASCCDExposure*)exposure writePixels:(BOOL)writePixels error:(NSError**)error;
 - (BOOL)readExposure:(CASCCDExposure*)exposure readPixels:(BOOL)readPixels error:(NSError**)error;
@@ -46,4 +54,11 @@
 
 - (NSURL*)derivedDataURLForName:(NSString*)name;
 
+// the exposure's pyramid as saved alongside it, nil if the format doesn't save one or it hasn't been yet
+- (NSData*)readPyramid;
+- (BOOL)writePyramid:(NSData*)pyramid error:(NSError**)error;
+
+// the uncompressed samples in native byte order if the format stores them that way so they can be read a strip at a time, nil otherwise
+- (NSURL*)samplesURL;
+
 @end
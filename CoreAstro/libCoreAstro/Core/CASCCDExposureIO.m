@@ -24,13 +24,22 @@
 //
 
 #import "CASCCDExposureIO.h"
+#import "CASColourPlanes.h"
 #import "CASFITSUtilities.h"
+#import "CASExposurePyramid.h"
+#import "CASCCDExposure+Thumbnail.h"
 #import <Accelerate/Accelerate.h>
 
 #if CAS_ENABLE_FITS
 #import "fitsio.h"
 #endif
 
+// thumbnails waiting to be made at most
+#define CAS_EXPOSURE_THUMBNAIL_QUEUE_LIMIT 4
+
+NSString* const kCASCCDExposureIOThumbnailNotification = @"kCASCCDExposureIOThumbnailNotification";
+NSString* const kCASCCDExposureIOThumbnailWrittenKey = @"kCASCCDExposureIOThumbnailWrittenKey";
+
 @interface CASCCDExposureIOv1 : CASCCDExposureIO
 @end
 
@@ -46,6 +55,11 @@
     return [[self url] URLByAppendingPathExtension:@"plist"];
 }
 
+- (NSURL*)samplesURL
+{
+    return [self pixelsURL];
+}
+
 - (BOOL)writeExposure:(CASCCDExposure*)exposure writePixels:(BOOL)writePixels error:(NSError**)errorPtr
 {
     NSError* error = nil;
@@ -132,6 +146,11 @@
     return @"thumbnail.png";
 }
 
+- (NSString*)pyramidKey
+{
+    return @"pyramid.data";
+}
+
 - (NSString*)derivedKey
 {
     return @"derived";
@@ -147,6 +166,116 @@
     return [name length] ? [self.derivedURL URLByAppendingPathComponent:name] : nil;
 }
 
+- (NSURL*)samplesURL
+{
+    NSFileWrapper* wrapper = [[NSFileWrapper alloc] initWithURL:self.url options:0 error:nil];
+    NSFileWrapper* samples = [[wrapper fileWrappers] objectForKey:[self pixelsKey]];
+    return samples.filename ? [self.url URLByAppendingPathComponent:samples.filename] : nil;
+}
+
+- (NSData*)readPyramid
+{
+    NSFileWrapper* wrapper = [[NSFileWrapper alloc] initWithURL:self.url options:0 error:nil];
+    NSString* pyramidName = [[[wrapper fileWrappers] objectForKey:[self pyramidKey]] filename];
+    return pyramidName ? [NSData dataWithContentsOfURL:[self.url URLByAppendingPathComponent:pyramidName] options:NSDataReadingMappedIfSafe error:nil] : nil;
+}
+
+- (BOOL)writePyramid:(NSData*)pyramid error:(NSError**)error
+{
+    if (!pyramid){
+        return NO;
+    }
+    NSURL* pyramidURL = [self.url URLByAppendingPathComponent:[self pyramidKey]];
+    if (![pyramid writeToURL:pyramidURL options:NSDataWritingAtomic error:error]){
+        NSLog(@"Failed to write pyramid to %@",pyramidURL);
+        return NO;
+    }
+    return YES;
+}
+
+// create a thumbnail (could use the QuickLook generator but that then introduces an unnecessary dependency)
+- (BOOL)writeThumbnailImageOfExposure:(CASCCDExposure*)exposure
+{
+    CGImageRef thumb = [exposure newThumbnailImageWithWidth:256];
+    if (!thumb){
+        NSLog(@"Failed to create thumbnail image for %@",self.url);
+        return NO;
+    }
+    
+    BOOL written = NO;
+    NSURL* thumbURL = [self.url URLByAppendingPathComponent:[self thumbKey]];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithURL((__bridge CFURLRef)thumbURL, CFSTR("public.png"), 1, nil);
+    if (!destination){
+        NSLog(@"Failed to create image destination for thumbnail at %@",thumbURL);
+    }
+    else{
+        CGImageDestinationAddImage(destination, thumb, nil);
+        written = CGImageDestinationFinalize(destination);
+        if (!written){
+            NSLog(@"Failed to write thumbnail to %@",thumbURL);
+        }
+        CFRelease(destination);
+    }
+    CGImageRelease(thumb);
+    
+    return written;
+}
+
+- (BOOL)writeThumbnailOfExposure:(CASCCDExposure*)exposure writePyramid:(BOOL)writePyramid
+{
+    NSURL* url = self.url;
+    if (!exposure || !url){
+        return NO;
+    }
+    
+    // each one waiting holds on to its exposure's pixels so there's a limit, past that they're left to be asked for
+    static dispatch_queue_t queue;
+    static dispatch_semaphore_t slots;
+    static NSMutableSet* pending;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("org.coreastro.exposure-thumbnails", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+        slots = dispatch_semaphore_create(CAS_EXPOSURE_THUMBNAIL_QUEUE_LIMIT);
+        pending = [NSMutableSet setWithCapacity:CAS_EXPOSURE_THUMBNAIL_QUEUE_LIMIT];
+    });
+    
+    @synchronized(pending){
+        if ([pending containsObject:url]){
+            return YES;
+        }
+        if (dispatch_semaphore_wait(slots, DISPATCH_TIME_NOW)){
+            NSLog(@"Thumbnail queue is full, leaving %@ for later",url);
+            return NO;
+        }
+        [pending addObject:url];
+    }
+    
+    dispatch_async(queue, ^{
+        BOOL written;
+        @autoreleasepool {
+            if (writePyramid){
+                [self writePyramid:exposure.pyramid.data error:nil];
+            }
+            written = [self writeThumbnailImageOfExposure:exposure];
+        }
+        @synchronized(pending){
+            [pending removeObject:url];
+        }
+        dispatch_semaphore_signal(slots);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [[NSNotificationCenter defaultCenter] postNotificationName:kCASCCDExposureIOThumbnailNotification object:self userInfo:@{kCASCCDExposureIOThumbnailWrittenKey:@(written)}];
+        });
+    });
+    
+    return YES;
+}
+
+- (BOOL)writeThumbnailOfExposure:(CASCCDExposure*)exposure
+{
+    return [self writeThumbnailOfExposure:exposure writePyramid:NO];
+}
+
 - (NSImage*)thumbnail
 {
     NSError* error = nil;
@@ -172,13 +301,11 @@
         
         NSString* metaName = nil;
         NSString* samplesName = nil;
-        NSString* thumbName = nil;
         
         NSDictionary* wrappers = [wrapper fileWrappers];
         if ([wrappers count]){
             metaName = [[wrappers objectForKey:[self metaKey]] filename];
             samplesName = [[wrappers objectForKey:[self pixelsKey]] filename];
-            thumbName = [[wrappers objectForKey:[self thumbKey]] filename];
         }
         if (!metaName){
             metaName = [wrapper addRegularFileWithContents:nil preferredFilename:[self metaKey]];
@@ -186,9 +313,6 @@
         if (!samplesName){
             samplesName = [wrapper addRegularFileWithContents:nil preferredFilename:[self pixelsKey]];
         }
-        if (!thumbName){
-            thumbName = [wrapper addRegularFileWithContents:nil preferredFilename:[self thumbKey]];
-        }
         
         // write samples and metadata
         NSDictionary* dict = [NSDictionary dictionaryWithObjectsAndKeys:[exposure.meta copy],@"exposure",[NSNumber numberWithInteger:1],@"version",nil];
@@ -202,6 +326,7 @@
                         [exposure.floatPixels writeToURL:[self.url URLByAppendingPathComponent:samplesName] options:NSDataWritingAtomic error:&error];
                         break;
                     default:
+                        // 16-bit samples, or the colour planes of the compact colour formats just as they're held
                         NSAssert(exposure.pixels, @"Pixel format set to integer but no pixels");
                         [exposure.pixels writeToURL:[self.url URLByAppendingPathComponent:samplesName] options:NSDataWritingAtomic error:&error];
                         break;
@@ -209,36 +334,9 @@
             }
         }
         
-        // create a thumbnail (could use the QuickLook generator but that then introduces an unnecessary dependency)
-        if (writePixels){
-            
-            CASCCDImage* image = [exposure newImage];
-            if (image){
-                
-                const CASSize size = image.size;
-                const NSInteger thumbWidth = 256;
-                const CASSize thumbSize = CASSizeMake(thumbWidth, thumbWidth * ((float)size.height/(float)size.width));
-                CGImageRef thumb = [image newImageWithSize:thumbSize];
-                if (!thumb){
-                    NSLog(@"Failed to create thumbnail image of size %@",NSStringFromCASSize(thumbSize));
-                }
-                else{
-                    
-                    NSURL* thumbURL = [self.url URLByAppendingPathComponent:thumbName];
-                    CGImageDestinationRef destination = CGImageDestinationCreateWithURL((__bridge CFURLRef)thumbURL, CFSTR("public.png"), 1, nil);
-                    if (!destination){
-                        NSLog(@"Failed to create image destination for thumbnail at %@",thumbURL);
-                    }
-                    else{
-                        CGImageDestinationAddImage(destination, thumb, nil);
-                        if (!CGImageDestinationFinalize(destination)){
-                            NSLog(@"Failed to write thumbnail to %@",thumbURL);
-                        }
-                        CFRelease(destination);
-                    }
-                    CGImageRelease(thumb);
-                }
-            }
+        // the pyramid and thumbnail follow on in the background so capture isn't held up
+        if (writePixels && !error){
+            [self writeThumbnailOfExposure:exposure writePyramid:YES];
         }
     }
     
@@ -283,6 +381,7 @@
                             exposure.floatPixels = pixels;
                             break;
                         default:
+                            // likewise the colour planes, which are expanded to RGBA float pixels when they're wanted
                             exposure.pixels = pixels;
                             break;
                     }
@@ -371,6 +470,37 @@ static NSError* (^createFITSError)(NSInteger,NSString*) = ^(NSInteger status,NSS
     }
 }
 
+// colour exposures as three planes of 0-1 floats, red then green then blue
+- (NSData*)floatPlanesOfExposure:(CASCCDExposure*)exposure
+{
+    const CASSize size = exposure.actualSize;
+    const NSInteger count = size.width * size.height;
+    NSMutableData* planes = [NSMutableData dataWithLength:3 * count * sizeof(float)];
+    float* p = (float*)[planes mutableBytes];
+    if (!p){
+        return nil;
+    }
+    
+    if (exposure.format == kCASCCDExposureFormatRGBHalf){
+        NSData* pixels = exposure.pixels;
+        for (NSInteger plane = 0; plane < 3; ++plane){
+            if (!CASColourPlaneToFloat([pixels bytes],count,kCASColourPlanesHalf,plane,p + plane * count)){
+                return nil;
+            }
+        }
+    }
+    else {
+        const float* rgba = (const float*)[exposure.floatPixels bytes];
+        if (!rgba){
+            return nil;
+        }
+        for (NSInteger plane = 0; plane < 3; ++plane){
+            cblas_scopy((int)count,rgba + plane,4,p + plane * count,1);
+        }
+    }
+    return planes;
+}
+
 - (BOOL)writeExposure:(CASCCDExposure*)exposure writePixels:(BOOL)writePixels error:(NSError**)errorPtr
 {
     NSError* error = nil;
@@ -398,6 +528,7 @@ static NSError* (^createFITSError)(NSInteger,NSString*) = ^(NSInteger status,NSS
             float zero = 0;
             NSInteger pixelCount = 0;
             NSData* pixelData = nil;
+            int planes = 1;
             switch ([[exposure.meta objectForKey:@"format"] integerValue]) {
                 case kCASCCDExposureFormatFloat:
                     format = FLOAT_IMG;
@@ -407,7 +538,22 @@ static NSError* (^createFITSError)(NSInteger,NSString*) = ^(NSInteger status,NSS
                     scale = exposure.maxPixelValue;
                     break;
                 case kCASCCDExposureFormatFloatRGBA:
-                    NSLog(@"*** Unsupported format"); // write as planar rgb ?
+                case kCASCCDExposureFormatRGBHalf:
+                    // a cube of red, green and blue float planes
+                    format = FLOAT_IMG;
+                    datatype = TFLOAT;
+                    pixelData = [self floatPlanesOfExposure:exposure];
+                    pixelCount = [pixelData length]/sizeof(float);
+                    scale = exposure.maxPixelValue;
+                    planes = 3;
+                    break;
+                case kCASCCDExposureFormatRGBUInt16:
+                    format = USHORT_IMG;
+                    datatype = TUSHORT;
+                    zero = 32768;
+                    pixelData = exposure.pixels;
+                    pixelCount = [pixelData length]/sizeof(uint16_t);
+                    planes = 3;
                     break;
                 default:
                     format = USHORT_IMG;
@@ -419,8 +565,8 @@ static NSError* (^createFITSError)(NSInteger,NSString*) = ^(NSInteger status,NSS
             }
 
             const CASSize size = exposure.actualSize;
-            long naxes[2] = { size.width, size.height };
-            if ( fits_create_img(fptr, format, 2, naxes, &status) ){
+            long naxes[3] = { size.width, size.height, planes };
+            if ( fits_create_img(fptr, format, (planes > 1) ? 3 : 2, naxes, &status) ){
                 error = createFITSError(status,[NSString stringWithFormat:@"Failed to create FITS file %d",status]);
             }
             else {
@@ -978,4 +1124,12 @@ static NSError* (^createFITSError)(NSInteger,NSString*) = ^(NSInteger status,NSS
 
 - (NSURL*)derivedDataURLForName:(NSString*)name { return nil; }
 
+- (NSURL*)samplesURL { return nil; }
+
+- (NSData*)readPyramid { return nil; }
+
+- (BOOL)writePyramid:(NSData*)pyramid error:(NSError**)error { return YES; }
+
+- (BOOL)writeThumbnailOfExposure:(CASCCDExposure*)exposure { return NO; }
+
 @end
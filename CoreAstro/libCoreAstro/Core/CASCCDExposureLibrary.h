@@ -25,6 +25,8 @@
 
 #import "CASCCDExposure.h"
 
+@class CASExposureDefectMap;
+
 @interface CASCCDExposureLibraryProject : NSObject
 
 @property (nonatomic,copy,readonly) NSString* uuid;
@@ -67,6 +69,10 @@
 
 - (void)projectWasUpdated:(CASCCDExposureLibraryProject*)project;
 
+// each camera's defect map, rebuilt in the background from a project's master dark and flat whenever they change
+- (CASExposureDefectMap*)defectMapForDeviceID:(NSString*)deviceID; // nil if there isn't one for that camera
+- (void)updateDefectMapWithProject:(CASCCDExposureLibraryProject*)project;
+
 extern NSString* kCASCCDExposureLibraryExposureAddedNotification;
 
 @end
@@ -26,6 +26,7 @@
 #import "CASCCDExposureLibrary.h"
 #import "CASCCDExposureIO.h"
 #import "CASUtilities.h"
+#import "CASExposureDefectMap.h"
 
 @interface CASCCDExposureLibrary ()
 @end
@@ -54,9 +55,10 @@
             self.uuid = uuid;
         }
         self.name = [coder decodeObjectForKey:@"name"];
-        self.masterBias = [[CASCCDExposureLibrary sharedLibrary] exposureWithUUID:[coder decodeObjectForKey:@"masterBias"]];
-        self.masterDark = [[CASCCDExposureLibrary sharedLibrary] exposureWithUUID:[coder decodeObjectForKey:@"masterDark"]];
-        self.masterFlat = [[CASCCDExposureLibrary sharedLibrary] exposureWithUUID:[coder decodeObjectForKey:@"masterFlat"]];
+        // not through the setters, loading them isn't a change that needs the defect map rebuilding
+        _masterBias = [[CASCCDExposureLibrary sharedLibrary] exposureWithUUID:[coder decodeObjectForKey:@"masterBias"]];
+        _masterDark = [[CASCCDExposureLibrary sharedLibrary] exposureWithUUID:[coder decodeObjectForKey:@"masterDark"]];
+        _masterFlat = [[CASCCDExposureLibrary sharedLibrary] exposureWithUUID:[coder decodeObjectForKey:@"masterFlat"]];
         self.parent = [coder decodeObjectForKey:@"parent"];
         self.children = [coder decodeObjectForKey:@"children"];
         NSArray* uuids = [coder decodeObjectForKey:@"exposures"];
@@ -129,6 +131,7 @@
     if (masterDark != _masterDark){
         _masterDark = masterDark;
         [[CASCCDExposureLibrary sharedLibrary] projectWasUpdated:self];
+        [[CASCCDExposureLibrary sharedLibrary] updateDefectMapWithProject:self];
     }
 }
 
@@ -145,6 +148,7 @@
     if (masterFlat != _masterFlat){
         _masterFlat = masterFlat;
         [[CASCCDExposureLibrary sharedLibrary] projectWasUpdated:self];
+        [[CASCCDExposureLibrary sharedLibrary] updateDefectMapWithProject:self];
     }
 }
 
@@ -172,6 +176,7 @@ static NSString* const kCASCCDExposureLibraryLocationKey = @"CASCCDExposureLibra
 @implementation CASCCDExposureLibrary {
     NSMutableArray* _projects;
     NSMutableArray* _exposures;
+    NSMutableDictionary* _defectMaps;
 }
 
 @synthesize exposures = _exposures;
@@ -337,6 +342,25 @@ NSString* kCASCCDExposureLibraryExposureAddedNotification = @"kCASCCDExposureLib
     }
 }
 
+- (void)makeFilesReadOnlyAtPath:(NSString*)path
+{
+    // make sure all the files are read-only (what about the wrapper ?)
+    NSString* subPath = nil;
+    NSDirectoryEnumerator* dir = [[NSFileManager defaultManager] enumeratorAtPath:path];
+    while ((subPath = [dir nextObject]) != nil) {
+        subPath = [path stringByAppendingPathComponent:subPath];
+        BOOL isDirectory;
+        if ([[NSFileManager defaultManager] fileExistsAtPath:subPath isDirectory:&isDirectory]){
+            if (!isDirectory){
+                NSDictionary* attrs = [NSDictionary dictionaryWithObject:[NSNumber numberWithInteger:0444] forKey:NSFilePosixPermissions]; // todo; get the current perms and modify rather than set this absolute value
+                if (attrs){
+                    [[NSFileManager defaultManager] setAttributes:attrs ofItemAtPath:subPath error:nil];
+                }
+            }
+        }
+    }
+}
+
 - (void)addExposure:(CASCCDExposure*)exposure save:(BOOL)save block:(void (^)(NSError*,NSURL*))block
 {
     [self addExposure:exposure toProject:nil save:save block:block];
@@ -370,25 +394,21 @@ NSString* kCASCCDExposureLibraryExposureAddedNotification = @"kCASCCDExposureLib
             // create the exposure io object
             exposure.io = [CASCCDExposureIO exposureIOWithPath:path];
             
+            // the thumbnail and pyramid are written in the background after the exposure so they're locked down once they're there
+            __block id thumbnailObserver = [[NSNotificationCenter defaultCenter] addObserverForName:kCASCCDExposureIOThumbnailNotification object:exposure.io queue:nil usingBlock:^(NSNotification* note) {
+                [[NSNotificationCenter defaultCenter] removeObserver:thumbnailObserver];
+                thumbnailObserver = nil;
+                [self makeFilesReadOnlyAtPath:path];
+            }];
+            
             // write the exposure
             NSError* error = nil;
             if ([exposure.io writeExposure:exposure writePixels:YES error:&error]){
-                
-                // make sure all the files are read-only (what about the wrapper ?)
-                NSString* subPath = nil;
-                NSDirectoryEnumerator* dir = [[NSFileManager defaultManager] enumeratorAtPath:path];
-                while ((subPath = [dir nextObject]) != nil) {
-                    subPath = [path stringByAppendingPathComponent:subPath];
-                    BOOL isDirectory;
-                    if ([[NSFileManager defaultManager] fileExistsAtPath:subPath isDirectory:&isDirectory]){
-                        if (!isDirectory){
-                            NSDictionary* attrs = [NSDictionary dictionaryWithObject:[NSNumber numberWithInteger:0444] forKey:NSFilePosixPermissions]; // todo; get the current perms and modify rather than set this absolute value
-                            if (attrs){
-                                [[NSFileManager defaultManager] setAttributes:attrs ofItemAtPath:subPath error:nil];
-                            }
-                        }
-                    }
-                }
+                [self makeFilesReadOnlyAtPath:path];
+            }
+            else {
+                [[NSNotificationCenter defaultCenter] removeObserver:thumbnailObserver];
+                thumbnailObserver = nil;
             }
             
             complete(error,[NSURL fileURLWithPath:path]);
@@ -489,4 +509,102 @@ NSString* kCASCCDExposureLibraryExposureAddedNotification = @"kCASCCDExposureLib
     [self writeProjectsArchive];
 }
 
+- (NSString*)defectMapPathForDeviceID:(NSString*)deviceID
+{
+    NSString* name = [deviceID stringByReplacingOccurrencesOfString:@"/" withString:@"-"];
+    return [[[[self root] stringByAppendingPathComponent:@"Defects"] stringByAppendingPathComponent:name] stringByAppendingPathExtension:@"defects"];
+}
+
+- (CASExposureDefectMap*)defectMapForDeviceID:(NSString*)deviceID
+{
+    if (![deviceID length]){
+        return nil;
+    }
+    
+    // asked for on every guide frame so keep them, including that there isn't one
+    BOOL missing = NO;
+    @synchronized(self){
+        if (!_defectMaps){
+            _defectMaps = [NSMutableDictionary dictionaryWithCapacity:2];
+        }
+        id map = _defectMaps[deviceID];
+        if (!map){
+            map = [CASExposureDefectMap defectMapWithData:[NSData dataWithContentsOfFile:[self defectMapPathForDeviceID:deviceID]]];
+            _defectMaps[deviceID] = map ?: [NSNull null];
+            missing = (map == nil);
+        }
+        if (map != [NSNull null]){
+            return map;
+        }
+    }
+    
+    // projects loaded with masters already set never went through the setters, so make one from their masters in the
+    // background and it'll be picked up once it's done
+    if (missing){
+        CASCCDExposureLibraryProject* project = [self projectWithMastersForDeviceID:deviceID inProjects:self.projects];
+        if (project){
+            [self updateDefectMapWithProject:project];
+        }
+    }
+    
+    return nil;
+}
+
+- (CASCCDExposureLibraryProject*)projectWithMastersForDeviceID:(NSString*)deviceID inProjects:(NSArray*)projects
+{
+    for (CASCCDExposureLibraryProject* project in projects){
+        // the same camera -updateDefectMapWithProject: would make the map for
+        if ([(project.masterDark.deviceID ?: project.masterFlat.deviceID) isEqualToString:deviceID]){
+            return project;
+        }
+        CASCCDExposureLibraryProject* child = [self projectWithMastersForDeviceID:deviceID inProjects:project.children];
+        if (child){
+            return child;
+        }
+    }
+    return nil;
+}
+
+- (void)updateDefectMapWithProject:(CASCCDExposureLibraryProject*)project
+{
+    CASCCDExposure* dark = project.masterDark;
+    CASCCDExposure* flat = project.masterFlat;
+    NSString* deviceID = dark.deviceID ?: flat.deviceID;
+    if (![deviceID length]){
+        return;
+    }
+    if (dark && flat && ![flat.deviceID isEqualToString:deviceID]){
+        flat = nil;
+    }
+    
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("org.coreastro.defect-maps", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+    });
+    
+    dispatch_async(queue, ^{
+        
+        CASExposureDefectMap* map = [CASExposureDefectMap defectMapWithDark:dark flat:flat];
+        if (!map){
+            return;
+        }
+        
+        NSError* error;
+        NSString* path = [self defectMapPathForDeviceID:deviceID];
+        [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
+        if (![map.data writeToFile:path options:NSDataWritingAtomic error:&error]){
+            NSLog(@"Failed to write defect map for %@: %@",deviceID,error);
+        }
+        
+        @synchronized(self){
+            if (!_defectMaps){
+                _defectMaps = [NSMutableDictionary dictionaryWithCapacity:2];
+            }
+            _defectMaps[deviceID] = map;
+        }
+    });
+}
+
 @end
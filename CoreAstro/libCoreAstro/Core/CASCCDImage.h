@@ -43,6 +43,7 @@
 - (CGContextRef)newContextOfSize:(CASSize)size;
 
 + (CGContextRef)newRGBBitmapContextWithSize:(CASSize)size; // RGBA context
++ (CGContextRef)newGrayBitmapContextWithSize:(CASSize)size; // 8bps Gray
 + (CGContextRef)newFloatBitmapContextWithSize:(CASSize)size; // floating point Gray
 + (CGContextRef)newRGBAFloatBitmapContextWithSize:(CASSize)size; // RGBA floating point context
 + (CGContextRef)newBitmapContextWithSize:(CASSize)size bitsPerPixel:(NSInteger)bitsPerPixel; // 16bps Gray
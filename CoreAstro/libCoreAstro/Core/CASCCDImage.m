@@ -193,6 +193,15 @@
     return context;
 }
 
++ (CGContextRef)newGrayBitmapContextWithSize:(CASSize)size
+{
+    CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceGenericGray);
+    CGContextRef context = CGBitmapContextCreate(nil, size.width, size.height, 8, size.width, space, kCGImageAlphaNone);
+    CFRelease(space);
+    
+    return context;
+}
+
 + (CGContextRef)newFloatBitmapContextWithSize:(CASSize)size
 {
     CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceGenericGray);
@@ -0,0 +1,49 @@
+//
+//  CASExposureBackground.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+#import "CASCCDProperties.h"
+
+@class CASCCDExposure;
+
+// the sky level and noise across a mono exposure in the same 0-1 units as floatPixels, estimated over a mesh of
+// cells and interpolated back up to full resolution (see CASBackground.h). cached on the exposure by -[CASCCDExposure background]
+@interface CASExposureBackground : NSObject
+
++ (instancetype)backgroundWithExposure:(CASCCDExposure*)exposure; // nil for colour exposures
+
+@property (nonatomic,readonly) float level; // medians over the mesh
+@property (nonatomic,readonly) float rms;
+@property (nonatomic,readonly) CASSize meshSize; // cells across and down
+
+- (float)levelAtX:(float)x y:(float)y;
+- (float)rmsAtX:(float)x y:(float)y;
+
+// a full resolution row of each map, either may be NULL
+- (void)getLevel:(float*)level rms:(float*)rms ofRow:(NSUInteger)row;
+
+// pixels - level + pedestal for a float frame the size of the exposure, in and out may be the same
+- (BOOL)subtractFromPixels:(const float*)pixels into:(float*)output pedestal:(float)pedestal;
+
+@end
@@ -0,0 +1,100 @@
+//
+//  CASExposureBackground.mm
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import "CASExposureBackground.h"
+#import "CASCCDExposure+Pixels.h"
+#import "CASUtilities.h"
+#import "CASBackground.h"
+#import "CASParallel.h"
+
+@implementation CASExposureBackground {
+    CASBackground _background;
+}
+
++ (instancetype)backgroundWithExposure:(CASCCDExposure*)exposure
+{
+    if (exposure.rgba){
+        return nil;
+    }
+    
+    // straight from the camera's 16-bit samples when there are some
+    const CASPixels samples = exposure.samples;
+    
+    CASExposureBackground* result = [[CASExposureBackground alloc] init];
+    __block BOOL estimated = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
+        estimated = CASBackgroundEstimate(samples,CASBackgroundDefaultParameters(),result->_background,CASParallelApply);
+    });
+    if (!estimated){
+        NSLog(@"%@: no pixels",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    return result;
+}
+
+- (float)level
+{
+    return _background.globalLevel;
+}
+
+- (float)rms
+{
+    return _background.globalRMS;
+}
+
+- (CASSize)meshSize
+{
+    return CASSizeMake(_background.meshWidth,_background.meshHeight);
+}
+
+- (float)levelAtX:(float)x y:(float)y
+{
+    return CASBackgroundLevelAt(_background,x,y);
+}
+
+- (float)rmsAtX:(float)x y:(float)y
+{
+    return CASBackgroundRMSAt(_background,x,y);
+}
+
+- (void)getLevel:(float*)level rms:(float*)rms ofRow:(NSUInteger)row
+{
+    CASBackgroundRow(_background,row,level,rms);
+}
+
+- (BOOL)subtractFromPixels:(const float*)pixels into:(float*)output pedestal:(float)pedestal
+{
+    return CASBackgroundSubtract(_background,pixels,output,_background.width,pedestal,CASParallelApply);
+}
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"%@: level %f, rms %f, mesh %ldx%ld",
+            [super description],self.level,self.rms,(long)_background.meshWidth,(long)_background.meshHeight];
+}
+
+@end
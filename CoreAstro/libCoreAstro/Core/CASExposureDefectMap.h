@@ -0,0 +1,48 @@
+//
+//  CASExposureDefectMap.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+#import "CASCCDProperties.h"
+
+@class CASCCDExposure;
+
+// a camera's hot and cold pixels and bad columns found from an unbinned master dark and flat, kept as short lists
+// of coordinates so correcting a frame only touches those pixels. the library keeps the latest one for each camera
+@interface CASExposureDefectMap : NSObject
+
++ (instancetype)defectMapWithDark:(CASCCDExposure*)dark flat:(CASCCDExposure*)flat; // either may be nil but not both
++ (instancetype)defectMapWithData:(NSData*)data; // as saved, nil if it's not a defect map
+
+@property (nonatomic,readonly) NSData* data; // for saving, a few bytes a defect
+@property (nonatomic,readonly) CASSize size; // of the sensor
+@property (nonatomic,readonly) NSUInteger hotPixelCount;
+@property (nonatomic,readonly) NSUInteger coldPixelCount;
+@property (nonatomic,readonly) NSUInteger badColumnCount;
+
+- (BOOL)canCorrectExposure:(CASCCDExposure*)exposure; // mono, unbinned and from a sensor this size, subframes included
+
+// replaces the defects in pixels, a copy of the exposure's samples in the format it's held in. returns the number of pixels changed
+- (NSUInteger)correctPixels:(NSMutableData*)pixels ofExposure:(CASCCDExposure*)exposure;
+
+@end
@@ -0,0 +1,130 @@
+//
+//  CASExposureDefectMap.mm
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import "CASExposureDefectMap.h"
+#import "CASCCDExposure+Pixels.h"
+#import "CASUtilities.h"
+#import "CASDefectMap.h"
+
+// bayer sensors need neighbours of the same colour, two away. mono ones lose little by using them too
+static const size_t kCASExposureDefectMapStep = 2;
+
+@implementation CASExposureDefectMap {
+    CASDefectMap _map;
+}
+
++ (instancetype)defectMapWithDark:(CASCCDExposure*)dark flat:(CASCCDExposure*)flat
+{
+    // masters have to cover the whole sensor at 1x1 so that defects are at the coordinates every frame is taken at
+    CASCCDExposure* masters[] = { dark, flat };
+    for (int i = 0; i < 2; ++i){
+        CASCCDExposure* master = masters[i];
+        if (master && (master.rgba || master.isSubframe || master.params.bin.width != 1 || master.params.bin.height != 1)){
+            NSLog(@"%@: %@ isn't a full frame, unbinned mono exposure",NSStringFromSelector(_cmd),master.displayName);
+            return nil;
+        }
+    }
+    
+    const CASPixels darkSamples = dark ? dark.samples : CASPixels();
+    const CASPixels flatSamples = flat ? flat.samples : CASPixels();
+    
+    CASExposureDefectMap* result = [[CASExposureDefectMap alloc] init];
+    __block BOOL built = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
+        built = CASDefectMapBuild(darkSamples,flatSamples,CASDefectThresholdsDefault(),result->_map);
+    });
+    if (!built){
+        NSLog(@"%@: failed to find the defects of %@ and %@",NSStringFromSelector(_cmd),dark.displayName,flat.displayName);
+        return nil;
+    }
+    
+    NSLog(@"%@: %ld hot, %ld cold, %ld columns in %fs",NSStringFromSelector(_cmd),(long)result.hotPixelCount,(long)result.coldPixelCount,(long)result.badColumnCount,time);
+    
+    return result;
+}
+
++ (instancetype)defectMapWithData:(NSData*)data
+{
+    CASExposureDefectMap* result = [[CASExposureDefectMap alloc] init];
+    if (!CASDefectMapDecode([data bytes],[data length],result->_map)){
+        return nil;
+    }
+    return result;
+}
+
+- (NSData*)data
+{
+    std::vector<uint8_t> bytes;
+    CASDefectMapEncode(_map,bytes);
+    return [NSData dataWithBytes:bytes.data() length:bytes.size()];
+}
+
+- (CASSize)size
+{
+    return CASSizeMake(_map.width,_map.height);
+}
+
+- (NSUInteger)hotPixelCount
+{
+    return _map.hot.size();
+}
+
+- (NSUInteger)coldPixelCount
+{
+    return _map.cold.size();
+}
+
+- (NSUInteger)badColumnCount
+{
+    return _map.columns.size();
+}
+
+- (BOOL)canCorrectExposure:(CASCCDExposure*)exposure
+{
+    const CASExposeParams params = exposure.params;
+    return exposure && !exposure.rgba &&
+        params.bin.width == 1 && params.bin.height == 1 &&
+        params.frame.width == _map.width && params.frame.height == _map.height;
+}
+
+- (NSUInteger)correctPixels:(NSMutableData*)pixels ofExposure:(CASCCDExposure*)exposure
+{
+    if (![self canCorrectExposure:exposure]){
+        return 0;
+    }
+    
+    const CASSize size = exposure.actualSize;
+    const CASPoint origin = exposure.params.origin;
+    const BOOL floatPixels = (exposure.format != kCASCCDExposureFormatUInt16);
+    if (origin.x < 0 || origin.y < 0 || [pixels length] < size.width * size.height * (floatPixels ? sizeof(float) : sizeof(uint16_t))){
+        return 0;
+    }
+    
+    if (floatPixels){
+        return CASDefectMapCorrect(_map,(float*)[pixels mutableBytes],size.width,size.height,size.width,origin.x,origin.y,kCASExposureDefectMapStep);
+    }
+    return CASDefectMapCorrect(_map,(uint16_t*)[pixels mutableBytes],size.width,size.height,size.width,origin.x,origin.y,kCASExposureDefectMapStep);
+}
+
+@end
@@ -0,0 +1,45 @@
+//
+//  CASExposureHistogram.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+@class CASCCDExposure;
+
+// immutable full resolution histogram of an exposure, 65536 bins per channel with 16-bit samples binned
+// exactly. cached on the exposure by -[CASCCDExposure histogram] and shared by the statistics, the stretch
+// and the histogram view so the pixels are only binned once
+@interface CASExposureHistogram : NSObject
+
++ (instancetype)histogramWithExposure:(CASCCDExposure*)exposure;
+
+@property (nonatomic,readonly) NSInteger channelCount; // 1, or 3 for RGBA exposures
+@property (nonatomic,readonly) NSInteger binCount;
+
+// binCount counts for the channel
+- (const uint32_t*)countsForChannel:(NSInteger)channel;
+
+// binCount floats with all the channels added together for display, binCount must be a power of 2
+- (NSData*)floatCountsWithBinCount:(NSInteger)binCount maximum:(float*)maximum;
+
+@end
@@ -0,0 +1,119 @@
+//
+//  CASExposureHistogram.mm
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import "CASExposureHistogram.h"
+#import "CASCCDExposure.h"
+#import "CASUtilities.h"
+#import "CASHistogram.h"
+#import "CASParallel.h"
+#import <vector>
+
+@implementation CASExposureHistogram {
+    NSInteger _channelCount;
+    std::vector<uint32_t> _counts;
+}
+
++ (instancetype)histogramWithExposure:(CASCCDExposure*)exposure
+{
+    CASExposureHistogram* result = [[CASExposureHistogram alloc] init];
+    
+    __block BOOL computed = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
+        
+        if (exposure.format == kCASCCDExposureFormatUInt16 && exposure.pixels){
+            
+            NSData* pixels = exposure.pixels;
+            result->_channelCount = 1;
+            result->_counts.resize(CAS_HISTOGRAM_BINS);
+            computed = CASHistogramCompute((const uint16_t*)[pixels bytes],[pixels length]/sizeof(uint16_t),1,1,result->_counts.data(),CASParallelApply);
+        }
+        else {
+            
+            // red, green and blue in one pass, alpha is skipped
+            NSData* pixels = exposure.floatPixels;
+            const size_t stride = exposure.rgba ? 4 : 1;
+            result->_channelCount = exposure.rgba ? 3 : 1;
+            result->_counts.resize(result->_channelCount * CAS_HISTOGRAM_BINS);
+            computed = CASHistogramCompute((const float*)[pixels bytes],[pixels length]/(stride * sizeof(float)),stride,result->_channelCount,result->_counts.data(),CASParallelApply);
+        }
+    });
+    
+    if (!computed){
+        NSLog(@"%@: no pixels",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    return result;
+}
+
+- (NSInteger)channelCount
+{
+    return _channelCount;
+}
+
+- (NSInteger)binCount
+{
+    return CAS_HISTOGRAM_BINS;
+}
+
+- (const uint32_t*)countsForChannel:(NSInteger)channel
+{
+    if (channel < 0 || channel >= _channelCount){
+        return NULL;
+    }
+    return _counts.data() + channel * CAS_HISTOGRAM_BINS;
+}
+
+- (NSData*)floatCountsWithBinCount:(NSInteger)binCount maximum:(float*)maximum
+{
+    if (binCount < 1 || binCount > CAS_HISTOGRAM_BINS || (binCount & (binCount - 1))){
+        NSLog(@"%@: bin count must be a power of 2 no more than %d",NSStringFromSelector(_cmd),CAS_HISTOGRAM_BINS);
+        return nil;
+    }
+    
+    std::vector<uint32_t> reduced(binCount), total(binCount);
+    for (NSInteger channel = 0; channel < _channelCount; ++channel){
+        CASHistogramReduce([self countsForChannel:channel],reduced.data(),binCount);
+        for (NSInteger i = 0; i < binCount; ++i){
+            total[i] += reduced[i];
+        }
+    }
+    
+    float max = 0;
+    NSMutableData* result = [NSMutableData dataWithLength:binCount * sizeof(float)];
+    float* fp = (float*)[result mutableBytes];
+    for (NSInteger i = 0; i < binCount; ++i){
+        fp[i] = total[i];
+        max = MAX(max,fp[i]);
+    }
+    if (maximum){
+        *maximum = max;
+    }
+    
+    return [result copy];
+}
+
+@end
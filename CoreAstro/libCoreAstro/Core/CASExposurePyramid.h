@@ -0,0 +1,46 @@
+//
+//  CASExposurePyramid.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+#import "CASCCDProperties.h"
+
+@class CASCCDExposure;
+
+// an exposure at successively halved resolutions, each level a 2x2 average of the one above in the format the
+// exposure's held in, for drawing thumbnails and zoomed out views without going through the whole frame. cached
+// on the exposure and saved alongside it by -[CASCCDExposure pyramid]. level 0 is the exposure itself
+@interface CASExposurePyramid : NSObject
+
++ (instancetype)pyramidWithExposure:(CASCCDExposure*)exposure;
++ (instancetype)pyramidWithExposure:(CASCCDExposure*)exposure data:(NSData*)data; // as saved, nil if it's not of this exposure's frame
+
+@property (nonatomic,readonly) NSUInteger levelCount; // including level 0
+@property (nonatomic,readonly) NSData* data; // for saving
+
+- (CASSize)sizeOfLevel:(NSUInteger)level;
+
+// a new exposure of the level, binned by 2^level more than the exposure and otherwise with the same settings
+- (CASCCDExposure*)exposureAtLevel:(NSUInteger)level ofExposure:(CASCCDExposure*)exposure;
+
+@end
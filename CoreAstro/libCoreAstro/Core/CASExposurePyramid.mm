@@ -0,0 +1,230 @@
+//
+//  CASExposurePyramid.mm
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import "CASExposurePyramid.h"
+#import "CASCCDExposure+Pixels.h"
+#import "CASUtilities.h"
+#import "CASPyramid.h"
+#import "CASParallel.h"
+#import "CASColourPlanes.h"
+#import <algorithm>
+#import <vector>
+
+// rows of planar colour expanded at a time, even so that each strip halves on its own
+#define CAS_EXPOSURE_PYRAMID_STRIP_ROWS 64
+
+// leads the saved levels so they can be checked against the exposure they're read back for
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+} CASExposurePyramidHeader;
+
+static const uint32_t kCASExposurePyramidMagic = 0x50534143; // 'CASP' little endian
+
+@implementation CASExposurePyramid {
+    NSData* _data;
+    CASPixelFormat _format;
+    size_t _width, _height;
+}
+
+// the format -samples hands back for the exposure, without reading its pixels in to find out
+static CASPixelFormat CASExposurePyramidFormat(CASCCDExposure* exposure)
+{
+    if (exposure.rgba){
+        return kCASPixelFormatRGBAFloat;
+    }
+    return (exposure.format == kCASCCDExposureFormatUInt16) ? kCASPixelFormatUInt16 : kCASPixelFormatFloat;
+}
+
+// planar colour is expanded to RGBA a strip at a time and halved straight into the first level, so that building the
+// pyramid doesn't leave the exposure holding a whole frame of RGBA floats in its floatPixels
+static bool CASExposurePyramidBuildFromPlanes(CASCCDExposure* exposure, size_t width, size_t height, void* pyramid)
+{
+    const size_t count = width * height;
+    const CASColourPlanesFormat format = (exposure.format == kCASCCDExposureFormatRGBHalf) ? kCASColourPlanesHalf : kCASColourPlanesUInt16;
+    NSData* pixels = exposure.pixels;
+    if ([pixels length] < CASColourPlanesLength(format,count)){
+        return false;
+    }
+    
+    const CASPixels first = CASPyramidLevel(kCASPixelFormatRGBAFloat,pyramid,width,height,1);
+    if (CASPixelsIsEmpty(first)){
+        return true; // small enough not to have any levels
+    }
+    
+    std::vector<float> strip(CAS_EXPOSURE_PYRAMID_STRIP_ROWS * width * 4);
+    for (size_t row = 0; row < height; row += CAS_EXPOSURE_PYRAMID_STRIP_ROWS){
+        const size_t rows = std::min<size_t>(CAS_EXPOSURE_PYRAMID_STRIP_ROWS,height - row);
+        if (!CASColourPlanesRangeToRGBA([pixels bytes],count,format,row * width,rows * width,strip.data())){
+            return false;
+        }
+        float* out = (float*)first.data + (row / 2) * first.stride * 4;
+        if (!CASPyramidHalve(CASPixelsMake(kCASPixelFormatRGBAFloat,strip.data(),width,rows,width),out,first.stride,CASParallelApply)){
+            return false;
+        }
+    }
+    
+    // the rest of the levels follow the first
+    return CASPyramidBuild(first,(float*)first.data + first.width * first.height * 4,CASParallelApply);
+}
+
++ (instancetype)pyramidWithExposure:(CASCCDExposure*)exposure
+{
+    const BOOL planar = exposure.planar;
+    const CASSize size = exposure.actualSize;
+    const CASPixels samples = planar ? CASPixelsMake(kCASPixelFormatNone,NULL,0,0,0) : exposure.samples;
+    const CASPixelFormat format = planar ? kCASPixelFormatRGBAFloat : samples.format;
+    const size_t width = planar ? size.width : samples.width;
+    const size_t height = planar ? size.height : samples.height;
+    if (!planar && CASPixelsIsEmpty(samples)){
+        NSLog(@"%@: no pixels",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    NSMutableData* data = [NSMutableData dataWithLength:sizeof(CASExposurePyramidHeader) + CASPyramidSize(format,width,height)];
+    if (!data){
+        NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    CASExposurePyramidHeader* header = (CASExposurePyramidHeader*)[data mutableBytes];
+    header->magic = kCASExposurePyramidMagic;
+    header->format = format;
+    header->width = (uint32_t)width;
+    header->height = (uint32_t)height;
+    
+    __block BOOL built = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
+        if (planar){
+            built = CASExposurePyramidBuildFromPlanes(exposure,width,height,header + 1);
+        }
+        else {
+            built = CASPyramidBuild(samples,header + 1,CASParallelApply);
+        }
+    });
+    if (!built){
+        NSLog(@"%@: failed to build levels of a %ldx%ld frame",NSStringFromSelector(_cmd),(long)width,(long)height);
+        return nil;
+    }
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    CASExposurePyramid* result = [[CASExposurePyramid alloc] init];
+    result->_data = data;
+    result->_format = format;
+    result->_width = width;
+    result->_height = height;
+    return result;
+}
+
++ (instancetype)pyramidWithExposure:(CASCCDExposure*)exposure data:(NSData*)data
+{
+    if ([data length] < sizeof(CASExposurePyramidHeader)){
+        return nil;
+    }
+    const CASExposurePyramidHeader* header = (const CASExposurePyramidHeader*)[data bytes];
+    const CASSize size = exposure.actualSize;
+    const CASPixelFormat format = CASExposurePyramidFormat(exposure);
+    if (header->magic != kCASExposurePyramidMagic || header->format != format || header->width != size.width || header->height != size.height){
+        return nil;
+    }
+    if ([data length] != sizeof(CASExposurePyramidHeader) + CASPyramidSize(format,size.width,size.height)){
+        return nil;
+    }
+    
+    CASExposurePyramid* result = [[CASExposurePyramid alloc] init];
+    result->_data = data;
+    result->_format = format;
+    result->_width = size.width;
+    result->_height = size.height;
+    return result;
+}
+
+- (NSUInteger)levelCount
+{
+    return 1 + CASPyramidLevelCount(_width,_height);
+}
+
+- (NSData*)data
+{
+    return _data;
+}
+
+- (CASSize)sizeOfLevel:(NSUInteger)level
+{
+    size_t width, height;
+    CASPyramidLevelSize(_width,_height,level,&width,&height);
+    return CASSizeMake(width,height);
+}
+
+- (CASCCDExposure*)exposureAtLevel:(NSUInteger)level ofExposure:(CASCCDExposure*)exposure
+{
+    if (!level){
+        return exposure;
+    }
+    
+    const CASPixels pixels = CASPyramidLevel(_format,(const CASExposurePyramidHeader*)[_data bytes] + 1,_width,_height,level);
+    if (CASPixelsIsEmpty(pixels)){
+        return nil;
+    }
+    NSData* levelPixels = [NSData dataWithBytes:pixels.data length:pixels.width * pixels.height * CASPixelFormatSize(_format)];
+    
+    // binned up so the level covers the same part of the sensor, the frame grows to fit if the level's been rounded up
+    CASExposeParams params = exposure.params;
+    params.bin.width <<= level;
+    params.bin.height <<= level;
+    params.size = CASSizeMake(pixels.width * params.bin.width,pixels.height * params.bin.height);
+    params.frame.width = MAX(params.frame.width,params.origin.x + params.size.width);
+    params.frame.height = MAX(params.frame.height,params.origin.y + params.size.height);
+    
+    CASCCDExposure* result = nil;
+    CASCCDExposureFormat format = kCASCCDExposureFormatUInt16;
+    switch (_format) {
+        case kCASPixelFormatUInt16:
+            result = [CASCCDExposure exposureWithPixels:levelPixels camera:nil params:params time:exposure.date];
+            break;
+        case kCASPixelFormatFloat:
+            result = [CASCCDExposure exposureWithFloatPixels:levelPixels camera:nil params:params time:exposure.date];
+            format = kCASCCDExposureFormatFloat;
+            break;
+        case kCASPixelFormatRGBAFloat:
+            result = [CASCCDExposure exposureWithRGBAFloatPixels:levelPixels camera:nil params:params time:exposure.date];
+            format = kCASCCDExposureFormatFloatRGBA;
+            break;
+        default:
+            break;
+    }
+    
+    // otherwise the same exposure as far as its metadata goes
+    NSMutableDictionary* meta = [[NSMutableDictionary alloc] initWithDictionary:exposure.meta copyItems:YES];
+    [meta setObject:CASCreateUUID() forKey:@"uuid"];
+    [meta setObject:[NSNumber numberWithInteger:format] forKey:@"format"];
+    [meta setObject:NSStringFromCASExposeParams(params) forKey:@"exposure"];
+    result.meta = [meta copy];
+    
+    return result;
+}
+
+@end
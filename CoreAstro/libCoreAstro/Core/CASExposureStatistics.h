@@ -0,0 +1,47 @@
+//
+//  CASExposureStatistics.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+@class CASCCDExposure;
+
+// immutable summary of an exposure's pixels in the same 0-1 units as floatPixels, worked out in a
+// single pass and cached on the exposure by -[CASCCDExposure statistics]. colour exposures use their luminance
+@interface CASExposureStatistics : NSObject
+
++ (instancetype)statisticsWithExposure:(CASCCDExposure*)exposure;
+
+@property (nonatomic,readonly) NSUInteger count;
+@property (nonatomic,readonly) float minimum;
+@property (nonatomic,readonly) float maximum;
+@property (nonatomic,readonly) float mean;
+@property (nonatomic,readonly) float standardDeviation;
+@property (nonatomic,readonly) float median;
+@property (nonatomic,readonly) float medianAbsoluteDeviation;
+@property (nonatomic,readonly) BOOL exact; // percentiles are exact rather than to within 1/65536 of the range, true for 16-bit exposures
+
+// fraction is 0-1, 0.5 is the median
+- (float)percentile:(float)fraction;
+
+@end
@@ -0,0 +1,128 @@
+//
+//  CASExposureStatistics.mm
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#import "CASExposureStatistics.h"
+#import "CASExposureHistogram.h"
+#import "CASCCDExposure.h"
+#import "CASUtilities.h"
+#import "CASStatistics.h"
+#import "CASParallel.h"
+
+@implementation CASExposureStatistics {
+    CASStatistics _statistics;
+}
+
++ (instancetype)statisticsWithExposure:(CASCCDExposure*)exposure
+{
+    CASExposureStatistics* result = [[CASExposureStatistics alloc] init];
+    
+    __block BOOL computed = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
+        
+        if (exposure.format == kCASCCDExposureFormatUInt16 && exposure.pixels){
+            
+            // straight from the camera's samples via the exposure's histogram, which the histogram view then
+            // gets for free, and this gets an exact median without going through floats
+            const uint32_t* counts = [exposure.histogram countsForChannel:0];
+            computed = counts && CASStatisticsFromHistogram(counts,1.0/exposure.maxPixelValue,result->_statistics);
+        }
+        else if (exposure.rgba){
+            
+            // luminance is worked out chunk by chunk inside the statistics pass rather than into a frame of its own
+            const CASSize size = exposure.actualSize;
+            const NSInteger pixelCount = size.width * size.height;
+            NSData* rgba = exposure.floatPixels;
+            if ([rgba length] >= pixelCount * 4 * sizeof(float)){
+                computed = CASStatisticsComputeLuminance((const float*)[rgba bytes],pixelCount,result->_statistics,CASParallelApply);
+            }
+        }
+        else {
+            
+            NSData* pixels = exposure.floatPixels;
+            computed = CASStatisticsCompute((const float*)[pixels bytes],[pixels length]/sizeof(float),result->_statistics,CASParallelApply);
+        }
+    });
+    
+    if (!computed){
+        NSLog(@"%@: no pixels",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    return result;
+}
+
+- (NSUInteger)count
+{
+    return _statistics.count;
+}
+
+- (float)minimum
+{
+    return _statistics.minimum;
+}
+
+- (float)maximum
+{
+    return _statistics.maximum;
+}
+
+- (float)mean
+{
+    return _statistics.mean;
+}
+
+- (float)standardDeviation
+{
+    return _statistics.standardDeviation;
+}
+
+- (float)median
+{
+    return _statistics.median;
+}
+
+- (float)medianAbsoluteDeviation
+{
+    return _statistics.medianDeviation;
+}
+
+- (BOOL)exact
+{
+    return _statistics.exact;
+}
+
+- (float)percentile:(float)fraction
+{
+    return CASStatisticsPercentile(_statistics,fraction);
+}
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"%@: count %lu, min %f, max %f, mean %f, sd %f, median %f, mad %f",
+            [super description],(unsigned long)self.count,self.minimum,self.maximum,self.mean,self.standardDeviation,self.median,self.medianAbsoluteDeviation];
+}
+
+@end
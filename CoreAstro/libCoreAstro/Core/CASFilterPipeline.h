@@ -10,9 +10,23 @@
 #import "CASImageDebayer.h"
 #import "CASImageProcessor.h"
 
+// the stages are recorded as a graph and only worked out, a tile at a time, when an output is asked for. calibration,
+// debayering, luminance, flips, the contrast stretch and inverting run that way without full size intermediates,
+// equalisation and the median filter need the whole frame and run on the preprocessed exposure if they're set.
+// display output can be asked for a region at a time, only the tiles under it are rendered and they're kept
+// until the exposure or the stages change so panning around a large frame only renders what's newly in view, and
+// zoomed out views can be rendered from a smaller level of the exposure's pyramid
+enum {
+    kCASFilterPipelineEqualiseGlobal = 0,   // the whole frame's histogram flattened
+    kCASFilterPipelineEqualiseLocal         // contrast limited adaptive equalisation over tiles
+};
+
 @interface CASFilterPipeline : NSObject
 @property (nonatomic,assign) BOOL equalise;
+@property (nonatomic,assign) NSInteger equalisationMode; // how equalise is done when it's set
 @property (nonatomic,assign) NSInteger debayerMode;
+@property (nonatomic,strong) CASCCDExposure *bias, *dark, *flat; // calibration masters, any can be nil
+@property (nonatomic) BOOL luminance; // reduce debayered exposures to mono
 
 @property (nonatomic) BOOL invert;
 @property (nonatomic) BOOL medianFilter;
@@ -22,7 +36,11 @@
 //@property (nonatomic) CGRect extent;
 @property (nonatomic) BOOL flipVertical, flipHorizontal;
 
-- (CASCCDExposure*)preprocessedExposureWithExposure:(CASCCDExposure*)exposure;
+- (CASCCDExposure*)preprocessedExposureWithExposure:(CASCCDExposure*)exposure; // calibrated, debayered, luminance then equalised
 - (CIImage*)filteredImageWithExposure:(CASCCDExposure*)exposure;
-- (CVPixelBufferRef)pixelBufferWithExposure:(CASCCDExposure*)exposure;
+- (CGImageRef)newDisplayImageWithExposure:(CASCCDExposure*)exposure CF_RETURNS_RETAINED; // all the stages straight to 8-bit
+- (CGImageRef)newDisplayImageWithExposure:(CASCCDExposure*)exposure region:(CASRect)region CF_RETURNS_RETAINED; // just the region, from the top left, with tiles cached between calls
+- (CGImageRef)newDisplayImageWithExposure:(CASCCDExposure*)exposure region:(CASRect)region level:(NSUInteger*)level CF_RETURNS_RETAINED; // the same from a level of the exposure's pyramid, a pixel for every 2^level of region rounded out. level is set to the one used, 0 if the stages to run need the full frame
+- (CGImageRef)newTiledDisplayImageWithExposure:(CASCCDExposure*)exposure CF_RETURNS_RETAINED; // full size but only the rows read are rendered, through the same cache
+- (CVPixelBufferRef)pixelBufferWithExposure:(CASCCDExposure*)exposure CF_RETURNS_RETAINED; // the same as 32BGRA for movies
 @end
@@ -0,0 +1,537 @@
+//
+//  CASFilterPipeline.m
+//  CoreAstro
+//
+//  Created by Simon Taylor on 11/30/13.
+//  Copyright (c) 2013 Mako Technology Ltd. All rights reserved.
+//
+
+#import "CASFilterPipeline.h"
+#import "CASCCDExposure+Pixels.h"
+#import "CASFramePoolData.h"
+#import "CASUtilities.h"
+#import "CASOpGraph.h"
+#import "CASParallel.h"
+#import <QuartzCore/QuartzCore.h>
+#import <CoreVideo/CoreVideo.h>
+
+@interface CASFilterPipeline ()
+- (BOOL)renderTilesOfExposure:(CASCCDExposure*)exposure level:(NSUInteger*)level with:(BOOL (^)(const CASOpGraph& graph, CASOpTileCache* cache))render;
+@end
+
+// what a tiled display image reads its rows from
+@interface CASFilterPipelineImageSource : NSObject
+@property (nonatomic,strong) CASFilterPipeline* pipeline;
+@property (nonatomic,strong) CASCCDExposure* exposure;
+@property (nonatomic) size_t width, height, bytesPerPixel;
+@end
+
+@implementation CASFilterPipelineImageSource
+@end
+
+// renders the whole rows under [position,position+count) through the tile cache and copies out the bytes asked for
+static size_t CASFilterPipelineImageSourceGetBytes(void* info, void* buffer, off_t position, size_t count)
+{
+    @autoreleasepool {
+        
+        CASFilterPipelineImageSource* source = (__bridge CASFilterPipelineImageSource*)info;
+        const size_t bytesPerRow = source.width * source.bytesPerPixel;
+        const size_t size = bytesPerRow * source.height;
+        if (position < 0 || (size_t)position >= size || !count){
+            return 0;
+        }
+        count = MIN(count,size - (size_t)position);
+        
+        const size_t top = (size_t)position / bytesPerRow, bottom = ((size_t)position + count - 1) / bytesPerRow;
+        const CASOpRegion region = { 0, top, source.width, bottom - top + 1 };
+        NSMutableData* rows = [CASFramePoolData uninitialisedDataWithLength:region.height * bytesPerRow];
+        if (!rows){
+            return 0;
+        }
+        const BOOL success = [source.pipeline renderTilesOfExposure:source.exposure level:NULL with:^BOOL(const CASOpGraph& graph, CASOpTileCache* cache) {
+            if (graph.width() != source.width || graph.height() != source.height || graph.channelCount() != (source.bytesPerPixel == 4 ? 4 : 1)){
+                return NO; // the pipeline's changed under the image
+            }
+            return CASOpGraphRenderRegion(graph,(source.bytesPerPixel == 4) ? kCASOpDisplayRGBA8 : kCASOpDisplayGray8,region,(uint8_t*)[rows mutableBytes],bytesPerRow,cache,CASParallelApply);
+        }];
+        if (!success){
+            return 0;
+        }
+        memcpy(buffer,(const uint8_t*)[rows bytes] + ((size_t)position - top * bytesPerRow),count);
+        return count;
+    }
+}
+
+static void CASFilterPipelineImageSourceRelease(void* info)
+{
+    CFRelease(info);
+}
+
+@implementation CASFilterPipeline {
+    CASImageProcessor* _imageProcessor;
+    NSMutableDictionary* _filterCache;
+    CASOpTileCache* _tileCache;
+    CASCCDExposure* _tileSource;
+    CASCCDExposure* _tileExposure;
+    NSArray* _tileSettings;
+    NSMutableDictionary* _tileLevels;
+}
+
+- (void)dealloc
+{
+    delete _tileCache;
+}
+
+- (CASImageProcessor*)imageProcessor
+{
+    if (!_imageProcessor){
+        _imageProcessor = [CASImageProcessor imageProcessorWithIdentifier:nil];
+    }
+    return _imageProcessor;
+}
+
+// the stages that need the whole frame, these have to be run on a preprocessed exposure before the display stages
+- (BOOL)needsWholeFrame
+{
+    return self.equalise || self.medianFilter;
+}
+
+// records the preprocessing stages, and the display ones too if asked, for the exposure. the masters' pixels the graph
+// points into are added to retained which has to be kept until the graph's been evaluated
+- (void)recordGraph:(CASOpGraph&)graph forExposure:(CASCCDExposure*)exposure preprocess:(BOOL)preprocess display:(BOOL)display retaining:(NSMutableArray*)retained
+{
+    if (preprocess){
+        
+        if ((self.bias || self.dark || self.flat) && !exposure.rgba){
+            const CASSize size = exposure.actualSize;
+            CASCalibrationMasters masters = { NULL, NULL, NULL, (size_t)(size.width * size.height) };
+            const float** pointers[] = { &masters.bias, &masters.dark, &masters.flat };
+            NSArray* exposures = @[self.bias ? self.bias : [NSNull null],self.dark ? self.dark : [NSNull null],self.flat ? self.flat : [NSNull null]];
+            BOOL usable = YES;
+            for (NSInteger i = 0; i < 3 && usable; ++i){
+                CASCCDExposure* master = exposures[i];
+                if (master == (id)[NSNull null]){
+                    continue;
+                }
+                const CASSize masterSize = master.actualSize;
+                NSData* pixels = master.floatPixels;
+                if (master.rgba || masterSize.width != size.width || masterSize.height != size.height || !pixels){
+                    usable = NO;
+                }
+                else {
+                    [retained addObject:pixels];
+                    *pointers[i] = (const float*)[pixels bytes];
+                }
+            }
+            if (!usable){
+                NSLog(@"%@: calibration masters don't match the exposure, skipping calibration",NSStringFromSelector(_cmd));
+            }
+            else {
+                // as the processor does, the mean of the offset subtracted flat is the difference of the means
+                CASCalibrationStatistics statistics = { 0 };
+                if (self.flat){
+                    CASCCDExposure* flatOffset = self.bias ? self.bias : self.dark;
+                    statistics.flatMean = self.flat.statistics.mean - (flatOffset ? flatOffset.statistics.mean : 0);
+                }
+                graph.calibrate(masters,statistics);
+            }
+        }
+        
+        if (self.debayerMode != kCASImageDebayerNone && !exposure.rgba){
+            graph.debayer((CASBayerPattern)(self.debayerMode - kCASImageDebayerRGGB));
+        }
+        
+        if (self.luminance){
+            graph.luminance(); // mono already if there's nothing to debayer
+        }
+    }
+    
+    if (display){
+        
+        graph.flip(self.flipHorizontal,self.flipVertical);
+        
+        if (self.contrastStretch){
+            graph.stretch(CASDisplayStretchMake(self.stretchMin,self.stretchMax,0.5,self.stretchGamma));
+        }
+        
+        if (self.invert){
+            graph.invert();
+        }
+    }
+}
+
+- (CASCCDExposure*)exposureWithPixels:(NSData*)pixels rgba:(BOOL)rgba from:(CASCCDExposure*)exposure
+{
+    CASCCDExposure* result = rgba ?
+        [CASCCDExposure exposureWithRGBAFloatPixels:pixels camera:nil params:exposure.params time:[NSDate date]] :
+        [CASCCDExposure exposureWithFloatPixels:pixels camera:nil params:exposure.params time:[NSDate date]];
+    NSMutableDictionary* meta = [[NSMutableDictionary alloc] initWithDictionary:exposure.meta copyItems:YES];
+    [meta setObject:CASCreateUUID() forKey:@"uuid"];
+    result.meta = [meta copy];
+    result.format = rgba ? kCASCCDExposureFormatFloatRGBA : kCASCCDExposureFormatFloat;
+    return result;
+}
+
+- (CASCCDExposure*)preprocessedExposureWithExposure:(CASCCDExposure*)exposure
+{
+    NSMutableArray* retained = [NSMutableArray arrayWithCapacity:3];
+    CASOpGraph graph(exposure.samples);
+    [self recordGraph:graph forExposure:exposure preprocess:YES display:NO retaining:retained];
+    
+    if (!graph.ops.empty()){
+        
+        const size_t channelCount = graph.channelCount();
+        NSMutableData* pixels = [CASFramePoolData uninitialisedDataWithLength:graph.width() * graph.height() * channelCount * sizeof(float)];
+        if (!pixels){
+            NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+            return nil;
+        }
+        
+        const bool success = CASOpGraphEvaluate(graph,(float*)[pixels mutableBytes],graph.width() * channelCount,CASParallelApply);
+        [retained removeAllObjects];
+        if (!success){
+            NSLog(@"%@: failed to evaluate %ld stages",NSStringFromSelector(_cmd),(long)graph.ops.size());
+            return nil;
+        }
+        
+        exposure = [self exposureWithPixels:pixels rgba:(channelCount == 4) from:exposure];
+    }
+    
+    if (self.medianFilter){
+        exposure = [self.imageProcessor medianFilter:exposure];
+    }
+    
+    if (self.equalise){
+        if (self.equalisationMode == kCASFilterPipelineEqualiseLocal){
+            exposure = [self.imageProcessor equaliseLocally:exposure];
+        }
+        else {
+            exposure = [self.imageProcessor equalise:exposure];
+        }
+    }
+    
+    return exposure;
+}
+
+// renders the display output of the exposure with render(graph) which is handed the finished graph, going straight
+// from the exposure's samples unless there are whole frame stages to run on the preprocessed exposure first
+- (BOOL)renderExposure:(CASCCDExposure*)exposure with:(BOOL (^)(const CASOpGraph& graph))render
+{
+    const BOOL wholeFrame = [self needsWholeFrame];
+    if (wholeFrame){
+        exposure = [self preprocessedExposureWithExposure:exposure];
+        if (!exposure){
+            return NO;
+        }
+    }
+    
+    NSMutableArray* retained = [NSMutableArray arrayWithCapacity:3];
+    CASOpGraph graph(exposure.samples);
+    [self recordGraph:graph forExposure:exposure preprocess:!wholeFrame display:YES retaining:retained];
+    
+    const BOOL success = render(graph);
+    [retained removeAllObjects];
+    
+    return success;
+}
+
+- (CGImageRef)newDisplayImageWithExposure:(CASCCDExposure*)exposure
+{
+    __block CGImageRef result = NULL;
+    
+    [self renderExposure:exposure with:^BOOL(const CASOpGraph& graph) {
+        
+        const CASSize size = CASSizeMake(graph.width(),graph.height());
+        const BOOL rgba = (graph.channelCount() == 4);
+        CGContextRef context = rgba ? [CASCCDImage newRGBBitmapContextWithSize:size] : [CASCCDImage newGrayBitmapContextWithSize:size];
+        uint8_t* data = (uint8_t*)CGBitmapContextGetData(context);
+        if (!data){
+            NSLog(@"%@: failed to create bitmap of size %@",NSStringFromSelector(_cmd),NSStringFromCASSize(size));
+        }
+        else if (CASOpGraphRender(graph,rgba ? kCASOpDisplayRGBA8 : kCASOpDisplayGray8,data,CGBitmapContextGetBytesPerRow(context),CASParallelApply)){
+            result = CGBitmapContextCreateImage(context);
+        }
+        CGContextRelease(context);
+        
+        return (result != NULL);
+    }];
+    
+    return result;
+}
+
+// the exposure display tiles of exposure are rendered from, preprocessed if there are whole frame stages. it's kept
+// until the exposure or the preprocessing changes, which clears the tile cache as that only knows the address of
+// the samples, and holding on to it stops its pixels being freed and the address reused. call with self locked
+- (CASCCDExposure*)tileExposureWithExposure:(CASCCDExposure*)exposure
+{
+    NSArray* settings = @[@([self needsWholeFrame]),@(self.equalise),@(self.equalisationMode),@(self.medianFilter),@(self.debayerMode),@(self.luminance),
+                          self.bias ? self.bias : [NSNull null],self.dark ? self.dark : [NSNull null],self.flat ? self.flat : [NSNull null]];
+    if (exposure != _tileSource || ![settings isEqualToArray:_tileSettings]){
+        _tileSource = exposure;
+        _tileSettings = settings;
+        _tileExposure = [self needsWholeFrame] ? [self preprocessedExposureWithExposure:exposure] : exposure;
+        if (!_tileExposure){
+            _tileSource = nil; // try again next time
+        }
+        if (!_tileCache){
+            _tileCache = new CASOpTileCache();
+        }
+        _tileCache->clear();
+        [_tileLevels removeAllObjects];
+    }
+    return _tileExposure;
+}
+
+// the level of the tile exposure's pyramid to render from, level is clamped to the ones there are. raw samples can't
+// be averaged before they're debayered or calibrated against full size masters so it's only once those are done, or
+// if they aren't set. the levels are kept with the tile exposure so their samples stay put for the cache. call with self locked
+- (CASCCDExposure*)tileExposureAtLevel:(NSUInteger*)level
+{
+    const BOOL preprocessed = [self needsWholeFrame] || _tileExposure.rgba;
+    if (!preprocessed && (self.bias || self.dark || self.flat || self.debayerMode != kCASImageDebayerNone)){
+        *level = 0;
+    }
+    if (!*level){
+        return _tileExposure;
+    }
+    
+    const NSUInteger levelCount = _tileExposure.pyramid.levelCount;
+    *level = levelCount ? MIN(*level,levelCount - 1) : 0;
+    CASCCDExposure* result = [_tileLevels objectForKey:@(*level)];
+    if (!result){
+        result = [_tileExposure exposureAtPyramidLevel:*level];
+        if (!result){
+            *level = 0;
+            return _tileExposure;
+        }
+        if (!_tileLevels){
+            _tileLevels = [NSMutableDictionary dictionaryWithCapacity:levelCount];
+        }
+        [_tileLevels setObject:result forKey:@(*level)];
+    }
+    return result;
+}
+
+// as renderExposure:with: but for tiles of the display output, render is handed the tile cache too. tiled layers
+// draw from several threads at once, the cache can be shared but the exposure has to be settled first. with a level
+// the graph's of that level of the pyramid, level is set to the one it could use
+- (BOOL)renderTilesOfExposure:(CASCCDExposure*)exposure level:(NSUInteger*)level with:(BOOL (^)(const CASOpGraph& graph, CASOpTileCache* cache))render
+{
+    if (!exposure){
+        return NO;
+    }
+    
+    BOOL wholeFrame;
+    CASCCDExposure* tileExposure;
+    CASOpTileCache* cache;
+    @synchronized(self){
+        wholeFrame = [self needsWholeFrame];
+        tileExposure = [self tileExposureWithExposure:exposure];
+        if (tileExposure && level){
+            tileExposure = [self tileExposureAtLevel:level];
+        }
+        cache = _tileCache;
+    }
+    if (!tileExposure){
+        return NO;
+    }
+    
+    NSMutableArray* retained = [NSMutableArray arrayWithCapacity:3];
+    CASOpGraph graph(tileExposure.samples);
+    [self recordGraph:graph forExposure:tileExposure preprocess:!wholeFrame display:YES retaining:retained];
+    const BOOL success = render(graph,cache);
+    [retained removeAllObjects];
+    
+    return success;
+}
+
+- (CGImageRef)newDisplayImageWithExposure:(CASCCDExposure*)exposure region:(CASRect)region
+{
+    return [self newDisplayImageWithExposure:exposure region:region level:NULL];
+}
+
+- (CGImageRef)newDisplayImageWithExposure:(CASCCDExposure*)exposure region:(CASRect)region level:(NSUInteger*)level
+{
+    __block CGImageRef result = NULL;
+    
+    [self renderTilesOfExposure:exposure level:level with:^BOOL(const CASOpGraph& graph, CASOpTileCache* cache) {
+        
+        // into the level's pixels, rounded out, and clipped to its frame
+        const NSInteger scale = level ? (NSInteger)1 << *level : 1;
+        const NSInteger left = MAX(0,region.origin.x) / scale, top = MAX(0,region.origin.y) / scale;
+        const NSInteger right = MIN((NSInteger)graph.width(),(region.origin.x + (NSInteger)region.size.width + scale - 1) / scale);
+        const NSInteger bottom = MIN((NSInteger)graph.height(),(region.origin.y + (NSInteger)region.size.height + scale - 1) / scale);
+        if (right <= left || bottom <= top){
+            return NO;
+        }
+        const CASOpRegion clipped = { (size_t)left, (size_t)top, (size_t)(right - left), (size_t)(bottom - top) };
+        
+        const CASSize size = CASSizeMake(clipped.width,clipped.height);
+        const BOOL rgba = (graph.channelCount() == 4);
+        CGContextRef context = rgba ? [CASCCDImage newRGBBitmapContextWithSize:size] : [CASCCDImage newGrayBitmapContextWithSize:size];
+        uint8_t* data = (uint8_t*)CGBitmapContextGetData(context);
+        if (!data){
+            NSLog(@"%@: failed to create bitmap of size %@",NSStringFromSelector(_cmd),NSStringFromCASSize(size));
+        }
+        else if (CASOpGraphRenderRegion(graph,rgba ? kCASOpDisplayRGBA8 : kCASOpDisplayGray8,clipped,data,CGBitmapContextGetBytesPerRow(context),cache,CASParallelApply)){
+            result = CGBitmapContextCreateImage(context);
+        }
+        CGContextRelease(context);
+        
+        return (result != NULL);
+    }];
+    
+    return result;
+}
+
+- (CGImageRef)newTiledDisplayImageWithExposure:(CASCCDExposure*)exposure
+{
+    __block size_t width = 0, height = 0, channelCount = 0;
+    [self renderTilesOfExposure:exposure level:NULL with:^BOOL(const CASOpGraph& graph, CASOpTileCache* cache) {
+        width = graph.width();
+        height = graph.height();
+        channelCount = graph.channelCount();
+        return YES;
+    }];
+    if (!width || !height){
+        return NULL;
+    }
+    
+    CASFilterPipelineImageSource* source = [[CASFilterPipelineImageSource alloc] init];
+    source.pipeline = self;
+    source.exposure = exposure;
+    source.width = width;
+    source.height = height;
+    source.bytesPerPixel = (channelCount == 4) ? 4 : 1;
+    
+    const CGDataProviderDirectCallbacks callbacks = { 0, NULL, NULL, CASFilterPipelineImageSourceGetBytes, CASFilterPipelineImageSourceRelease };
+    CGDataProviderRef provider = CGDataProviderCreateDirect((void*)CFBridgingRetain(source),width * height * source.bytesPerPixel,&callbacks);
+    if (!provider){
+        return NULL;
+    }
+    
+    // the same layouts as CASCCDImage's bitmap contexts
+    CGColorSpaceRef space = CGColorSpaceCreateWithName((channelCount == 4) ? kCGColorSpaceGenericRGB : kCGColorSpaceGenericGray);
+    CGImageRef result = CGImageCreate(width,height,8,8 * source.bytesPerPixel,width * source.bytesPerPixel,space,(channelCount == 4) ? kCGImageAlphaPremultipliedLast : kCGImageAlphaNone,provider,NULL,false,kCGRenderingIntentDefault);
+    CFRelease(space);
+    CGDataProviderRelease(provider);
+    
+    return result;
+}
+
+- (CVPixelBufferRef)pixelBufferWithExposure:(CASCCDExposure*)exposure
+{
+    __block CVPixelBufferRef result = NULL;
+    
+    [self renderExposure:exposure with:^BOOL(const CASOpGraph& graph) {
+        
+        NSDictionary *options = @{(id)kCVPixelBufferCGImageCompatibilityKey:@YES,
+                                  (id)kCVPixelBufferCGBitmapContextCompatibilityKey:@YES};
+        CVPixelBufferRef pixelBuffer = NULL;
+        if (CVPixelBufferCreate(kCFAllocatorDefault,graph.width(),graph.height(),kCVPixelFormatType_32BGRA,(__bridge CFDictionaryRef)options,&pixelBuffer) != kCVReturnSuccess){
+            NSLog(@"%@: failed to create pixel buffer of size %ldx%ld",NSStringFromSelector(_cmd),(long)graph.width(),(long)graph.height());
+            return NO;
+        }
+        
+        bool success = false;
+        if (CVPixelBufferLockBaseAddress(pixelBuffer,0) == kCVReturnSuccess){
+            success = CASOpGraphRender(graph,kCASOpDisplayBGRA8,(uint8_t*)CVPixelBufferGetBaseAddress(pixelBuffer),CVPixelBufferGetBytesPerRow(pixelBuffer),CASParallelApply);
+            CVPixelBufferUnlockBaseAddress(pixelBuffer,0);
+        }
+        if (success){
+            result = pixelBuffer;
+        }
+        else {
+            CVPixelBufferRelease(pixelBuffer);
+        }
+        
+        return success;
+    }];
+    
+    return result;
+}
+
+- (CIFilter*)filterWithName:(NSString*)name
+{
+    CIFilter* result; // arc nils it
+    @synchronized(self){
+        if (!_filterCache){
+            _filterCache = [NSMutableDictionary dictionaryWithCapacity:5];
+        }
+        result = _filterCache[name];
+        if (!result){
+            result = [CIFilter filterWithName:name];
+            if (result){
+                _filterCache[name] = result;
+            }
+        }
+    }
+    return result;
+}
+
+- (CIImage*)filteredImageWithExposure:(CASCCDExposure*)exposure
+{
+    CASCCDImage* ccdImage = [exposure newImage];
+    CIImage* image = [CIImage imageWithCGImage:ccdImage.CGImage options:@{kCIImageColorSpace:[NSNull null]}];
+    if (image){
+
+        
+        //    if (!CGRectIsNull(_extent)){
+        //        // set roi on filters - does this mean I have to sublcass all the filters ?
+        //        // or at least have a wrapper than composites with the underlying filter ?
+        //    }
+        
+        // todo; allow filter order to be set externally ?
+        // todo; set roi to the area of the subframe using CIFilterShape
+        
+        if (self.flipVertical || self.flipHorizontal){
+            
+            CIFilter* flip = [self filterWithName:@"CIAffineTransform"];
+            [flip setDefaults];
+            [flip setValue:image forKey:@"inputImage"];
+            
+            NSAffineTransform* transform = [NSAffineTransform transform];
+            if (self.flipVertical){
+                [transform scaleXBy:1.0 yBy:-1.0];
+                [transform translateXBy:0 yBy:-image.extent.size.height];
+            }
+            if (self.flipHorizontal){
+                [transform scaleXBy:-1.0 yBy:1.0];
+                [transform translateXBy:-image.extent.size.width yBy:0];
+            }
+            [flip setValue:transform forKey:@"inputTransform"];
+            
+            image = [flip valueForKey:@"outputImage"];
+        }
+        
+        if (self.medianFilter){
+            CIFilter* median = [self filterWithName:@"CIMedianFilter"];
+            [median setDefaults];
+            [median setValue:image forKey:@"inputImage"];
+            image = [median valueForKey:@"outputImage"];
+        }
+        
+        if (self.contrastStretch){
+            CIFilter* stretch = [self filterWithName:@"CASContrastStretchFilter"];
+            if (stretch){
+                [stretch setDefaults];
+                [stretch setValue:image forKey:@"inputImage"];
+                [stretch setValue:@(self.stretchMin) forKey:@"inputMin"];
+                [stretch setValue:@(self.stretchMax) forKey:@"inputMax"];
+                [stretch setValue:@(self.stretchGamma) forKey:@"inputGamma"];
+                image = [stretch valueForKey:@"outputImage"];
+            }
+        }
+        
+        if (self.invert){
+            CIFilter* invert = [self filterWithName:@"CIColorInvert"];
+            [invert setDefaults];
+            [invert setValue:image forKey:@"inputImage"];
+            image = [invert valueForKey:@"outputImage"];
+        }
+    }
+    
+    return [image imageByCroppingToRect:image.extent]; // this seems to be required to prevent the filtered image from having infinite extent
+}
+
+@end
@@ -0,0 +1,122 @@
+//
+//  CASFramePoolData.m
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#import "CASFramePoolData.h"
+#import "CASFramePool.h"
+
+@implementation CASFramePoolData {
+    void* _buffer;
+    NSUInteger _length;
+}
+
+- (id)initWithLength:(NSUInteger)length zero:(BOOL)zero
+{
+    self = [super init];
+    if (self){
+        _buffer = CASFramePoolAllocate(length);
+        if (!_buffer){
+            const CASFramePoolStatistics stats = CASFramePoolGetStatistics();
+            NSLog(@"*** Frame pool couldn't allocate %lu bytes, %lu in use with a limit of %lu",(unsigned long)length,(unsigned long)stats.bytesInUse,(unsigned long)stats.limit);
+            return nil;
+        }
+        _length = length;
+        if (zero){
+            bzero(_buffer, length);
+        }
+    }
+    return self;
+}
+
+- (id)init
+{
+    return [self initWithLength:0 zero:NO];
+}
+
+- (id)initWithCapacity:(NSUInteger)capacity
+{
+    self = [self initWithLength:capacity zero:NO];
+    if (self){
+        _length = 0;
+    }
+    return self;
+}
+
+- (id)initWithLength:(NSUInteger)length
+{
+    return [self initWithLength:length zero:YES];
+}
+
+- (id)initWithBytes:(const void *)bytes length:(NSUInteger)length
+{
+    self = [self initWithLength:length zero:NO];
+    if (self && length){
+        memcpy(_buffer, bytes, length);
+    }
+    return self;
+}
+
++ (instancetype)uninitialisedDataWithLength:(NSUInteger)length
+{
+    return [[self alloc] initWithLength:length zero:NO];
+}
+
+- (void)dealloc
+{
+    CASFramePoolFree(_buffer);
+}
+
+- (NSUInteger)length
+{
+    return _length;
+}
+
+- (const void *)bytes
+{
+    return _buffer;
+}
+
+- (void *)mutableBytes
+{
+    return _buffer;
+}
+
+- (void)setLength:(NSUInteger)length
+{
+    if (length > CASFramePoolCapacity(_buffer)){
+        void* buffer = CASFramePoolAllocate(length);
+        if (!buffer){
+            [NSException raise:NSMallocException format:@"Frame pool couldn't grow data to %lu bytes",(unsigned long)length];
+        }
+        memcpy(buffer, _buffer, _length);
+        CASFramePoolFree(_buffer);
+        _buffer = buffer;
+    }
+    if (length > _length){
+        bzero((uint8_t*)_buffer + _length, length - _length);
+    }
+    _length = length;
+}
+
+@end
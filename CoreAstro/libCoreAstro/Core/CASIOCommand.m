@@ -25,6 +25,7 @@
 
 #import "CASIOCommand.h"
 #import "CASIOTransport.h"
+#import "CASFramePoolData.h"
 
 @implementation CASIOCommand
 
@@ -51,10 +52,16 @@
     if (!error){
         const NSInteger readSize = [self readSize];
         if (readSize > 0){
-            NSMutableData* responseData = [NSMutableData dataWithLength:readSize];
+            // zeroed as not every transport fills it
+            NSMutableData* responseData = [CASFramePoolData dataWithLength:readSize];
             // sleep/suspend in the case of expose ?
             //const NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
-            error = [transport receive:responseData];
+            if (!responseData){
+                error = [NSError errorWithDomain:@"CASIOCommand" code:2 userInfo:[NSDictionary dictionaryWithObjectsAndKeys:[NSString stringWithFormat:@"CASIOCommand: not enough memory to read %ld bytes",readSize],NSLocalizedDescriptionKey,nil]];
+            }
+            else {
+                error = [transport receive:responseData];
+            }
             if (!error){
                 //NSLog(@"Read %ld bytes in %f seconds",[responseData length],[NSDate timeIntervalSinceReferenceDate] - start);
                 if ([responseData length] < readSize && !self.allowsUnderrun){
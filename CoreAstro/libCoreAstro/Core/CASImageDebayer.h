@@ -35,7 +35,14 @@ enum {
     kCASImageDebayerGBRG
 };
 
+enum {
+    kCASImageDebayerBilinear = 0,
+    kCASImageDebayerVNG,
+    kCASImageDebayerAHD
+};
+
 @property (nonatomic,assign) NSInteger mode;
+@property (nonatomic,assign) NSInteger algorithm; // bilinear for previews, VNG or AHD for final processing
 - (CASCCDExposure*)debayer:(CASCCDExposure*)image;
 @end
 
@@ -44,6 +51,6 @@ enum {
 - (CASCCDExposure*)debayer:(CASCCDExposure*)image;
 - (CASCCDExposure*)debayer:(CASCCDExposure*)image adjustRed:(float)red green:(float)green blue:(float)blue all:(float)all;
 
-+ (id<CASImageDebayer>)imageDebayerWithIdentifier:(NSString*)ident;
++ (id<CASImageDebayer>)imageDebayerWithIdentifier:(NSString*)ident; // nil or @"bilinear", @"vng" or @"ahd"
 
 @end
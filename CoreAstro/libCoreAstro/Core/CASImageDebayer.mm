@@ -22,11 +22,13 @@
 //  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 //  IN THE SOFTWARE.
 //
-//  Very basic liner interpolation debayering.
+//  Debayering through the kernels, bilinear for previews and VNG or AHD for final processing.
 
 #import "CASImageDebayer.h"
 #import "CASUtilities.h"
-#import <Accelerate/Accelerate.h>
+#import "CASParallel.h"
+#import "CASFramePoolData.h"
+#import "CASDebayer.h"
 
 typedef struct { float r,g,b,a; } fpixel_t;
 
@@ -37,10 +39,24 @@ typedef struct { float r,g,b,a; } fpixel_t;
 @implementation CASImageDebayer 
 
 @synthesize mode = _mode;
+@synthesize algorithm = _algorithm;
 
 + (id<CASImageDebayer>)imageDebayerWithIdentifier:(NSString*)ident;
 {
-    return [[[self class] alloc] init];
+    NSInteger algorithm = kCASImageDebayerBilinear;
+    if ([@"vng" isEqualToString:ident]){
+        algorithm = kCASImageDebayerVNG;
+    }
+    else if ([@"ahd" isEqualToString:ident]){
+        algorithm = kCASImageDebayerAHD;
+    }
+    else if (ident && ![@"bilinear" isEqualToString:ident]){
+        NSLog(@"No debayer with identifier %@",ident);
+        return nil;
+    }
+    CASImageDebayer* debayer = [[[self class] alloc] init];
+    debayer.algorithm = algorithm;
+    return debayer;
 }
 
 - (CASCCDExposure*)debayer:(CASCCDExposure*)exposure adjustRed:(float)red green:(float)green blue:(float)blue all:(float)all
@@ -56,267 +72,47 @@ typedef struct { float r,g,b,a; } fpixel_t;
         return nil;
     }
     
+    const NSInteger mode = self.mode;
+    if (mode < kCASImageDebayerRGGB || mode > kCASImageDebayerGBRG){
+        NSLog(@"%@: unknown mode %ld",NSStringFromSelector(_cmd),(long)mode);
+        return nil;
+    }
+    const CASBayerPattern pattern = (CASBayerPattern)(mode - kCASImageDebayerRGGB);
+    
+    CASDebayerAlgorithm algorithm = kCASDebayerBilinear;
+    switch (self.algorithm) {
+        case kCASImageDebayerVNG:
+            algorithm = kCASDebayerVNG;
+            break;
+        case kCASImageDebayerAHD:
+            algorithm = kCASDebayerAHD;
+            break;
+    }
+    
     const NSInteger finalPixelsLength = (size.width * size.height * sizeof(fpixel_t));
-    NSMutableData* finalPixels = [NSMutableData dataWithLength:finalPixelsLength];
+    NSMutableData* finalPixels = [CASFramePoolData dataWithLength:finalPixelsLength];
     if (!finalPixels){
         CASThrowOOMException([self class]);
     }
     
-    float *gp = (float*)[exposure.floatPixels bytes];
-    fpixel_t *cp = (fpixel_t*)[finalPixels mutableBytes];
-        
-    #define clip(x,lim) ((x) < 0 ? 0 : (x) >= (lim) ? (lim-1) : (x))
-    #define clipx(x) clip(x,size.width)
-    #define clipy(y) clip(y,size.height)
-    #define source_pixel(x,y) (*(gp + clipx(x) + clipy(y) * size.width))
-    #define destination_pixel(x,y) *(cp + clipx(x) + clipy(y) * size.width)
-    #define make_rgba(rx,gx,bx,ax) { .r = rx, .g = gx, .b = bx, .a = ax };
-
+    const float* gp = (const float*)[exposure.floatPixels bytes];
+    float* cp = (float*)[finalPixels mutableBytes];
+    
+    __block bool debayered = false;
     const NSTimeInterval time = CASTimeBlock(^{
-
-        dispatch_apply(size.height/2, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH,0), ^(size_t row){
-            
-            const size_t y = 2*row;
-            
-            for (size_t x = 0; x < size.width; x += 2){
-                
-                const float a = 1.0;
-                
-                // RG|RG|RG|RG
-                // GB|GB|GB|GB
-                // RG|RG|RG|RG
-                // GB|GB|GB|GB
-                
-                if (self.mode == kCASImageDebayerRGGB){
-                    
-                    size_t i = x, j = y;
-                    
-                    float r1 = source_pixel(i,j);
-                    float g1 = (source_pixel(i-1,j) + source_pixel(i,j-1) + source_pixel(i,j+1) + source_pixel(i+1,j))/4;
-                    float b1 = (source_pixel(i-1,j-1) + source_pixel(i+1,j-1) + source_pixel(i+1,j+1) + source_pixel(i-1,j+1))/4;
-                    
-                    r1 = all * red * r1;
-                    g1 = all * green * g1;
-                    b1 = all * blue * b1;
-                    
-                    destination_pixel(i,j) = make_rgba(r1,g1,b1,a);
-                    
-                    i = x + 1, j = y + 1;
-                    
-                    float r2 = (source_pixel(i-1,j-1) + source_pixel(i+1,j-1) + source_pixel(i+1,j+1) + source_pixel(i-1,j+1))/4;
-                    float g2 = (source_pixel(i-1,j) + source_pixel(i,j-1) + source_pixel(i,j+1) + source_pixel(i+1,j))/4;
-                    float b2 = source_pixel(i,j);
-                    
-                    r2 = all * red * r2;
-                    g2 = all * green * g2;
-                    b2 = all * blue * b2;
-                    
-                    destination_pixel(i,j) = make_rgba(r2,g2,b2,a);
-                    
-                    i = x + 1, j = y;
-                    
-                    float r3 = (source_pixel(i,j - 1) + source_pixel(i,j + 1))/2;
-                    float g3 = source_pixel(i,j);
-                    float b3 = (source_pixel(i - 1,j) + source_pixel(i + 1,j))/2;
-                    
-                    r3 = all * red * r3;
-                    g3 = all * green * g3;
-                    b3 = all * blue * b3;
-                    
-                    destination_pixel(i,j) = make_rgba(r3,g3,b3,a);
-                    
-                    i = x, j = y + 1;
-                    
-                    float r4 = (source_pixel(i - 1,j) + source_pixel(i + 1,j))/2;
-                    float g4 = source_pixel(i,j);
-                    float b4 = (source_pixel(i,j - 1) + source_pixel(i,j + 1))/2;
-                    
-                    r4 = all * red * r4;
-                    g4 = all * green * g4;
-                    b4 = all * blue * b4;
-                    
-                    destination_pixel(i,j) = make_rgba(r4,g4,b4,a);
-                }
-                
-                // GR|GR|GR|GR
-                // BG|BG|BG|BG
-                // GR|GR|GR|GR
-                // BG|BG|BG|BG
-                
-                if (self.mode == kCASImageDebayerGRBG){
-                    
-                    size_t i = x + 1, j = y;
-                    
-                    float r1 = source_pixel(i,j);
-                    float g1 = (source_pixel(i-1,j) + source_pixel(i,j-1) + source_pixel(i,j+1) + source_pixel(i+1,j))/4;
-                    float b1 = (source_pixel(i-1,j-1) + source_pixel(i+1,j-1) + source_pixel(i+1,j+1) + source_pixel(i-1,j+1))/4;
-                    
-                    r1 = all * red * r1;
-                    g1 = all * green * g1;
-                    b1 = all * blue * b1;
-                    
-                    destination_pixel(i,j) = make_rgba(r1,g1,b1,a);
-                    
-                    i = x, j = y + 1;
-                    
-                    float r2 = (source_pixel(i-1,j-1) + source_pixel(i+1,j-1) + source_pixel(i+1,j+1) + source_pixel(i-1,j+1))/4;
-                    float g2 = (source_pixel(i-1,j) + source_pixel(i,j-1) + source_pixel(i,j+1) + source_pixel(i+1,j))/4;
-                    float b2 = source_pixel(i,j);
-                    
-                    r2 = all * red * r2;
-                    g2 = all * green * g2;
-                    b2 = all * blue * b2;
-                    
-                    destination_pixel(i,j) = make_rgba(r2,g2,b2,a);
-                    
-                    i = x, j = y;
-                    
-                    float r3 = (source_pixel(i-1,j) + source_pixel(i+1,j))/2;
-                    float g3 = source_pixel(i,j);
-                    float b3 = (source_pixel(i,j-1) + source_pixel(i,j+1))/2;
-                    
-                    r3 = all * red * r3;
-                    g3 = all * green * g3;
-                    b3 = all * blue * b3;
-                    
-                    destination_pixel(i,j) = make_rgba(r3,g3,b3,a);
-                    
-                    i = x + 1, j = y + 1;
-                    
-                    float r4 = (source_pixel(i,j-1) + source_pixel(i,j+1))/2;
-                    float g4 = source_pixel(i,j);
-                    float b4 = (source_pixel(i-1,j) + source_pixel(i+1,j))/2;
-                    
-                    r4 = all * red * r4;
-                    g4 = all * green * g4;
-                    b4 = all * blue * b4;
-                    
-                    destination_pixel(i,j) = make_rgba(r4,g4,b4,a);
-                }
-                
-                // BG|BG|BG|BG
-                // GR|GR|GR|GR
-                // BG|BG|BG|BG
-                // GR|GR|GR|GR
-                
-                if (self.mode == kCASImageDebayerBGGR){
-                    
-                    size_t i = x + 1, j = y + 1;
-                    
-                    float r1 = source_pixel(i,j);
-                    float g1 = (source_pixel(i-1,j) + source_pixel(i,j-1) + source_pixel(i,j+1) + source_pixel(i+1,j))/4;
-                    float b1 = (source_pixel(i-1,j-1) + source_pixel(i+1,j-1) + source_pixel(i+1,j+1) + source_pixel(i-1,j+1))/4;
-                    
-                    r1 = all * red * r1;
-                    g1 = all * green * g1;
-                    b1 = all * blue * b1;
-                    
-                    destination_pixel(i,j) = make_rgba(r1,g1,b1,a);
-                    
-                    i = x, j = y;
-                    
-                    float r2 = (source_pixel(i-1,j-1) + source_pixel(i+1,j-1) + source_pixel(i+1,j+1) + source_pixel(i-1,j+1))/4;
-                    float g2 = (source_pixel(i-1,j) + source_pixel(i,j-1) + source_pixel(i,j+1) + source_pixel(i+1,j))/4;
-                    float b2 = source_pixel(i,j);
-                    
-                    r2 = all * red * r2;
-                    g2 = all * green * g2;
-                    b2 = all * blue * b2;
-                    
-                    destination_pixel(i,j) = make_rgba(r2,g2,b2,a);
-                    
-                    i = x + 1, j = y;
-                    
-                    float r3 = (source_pixel(i,j - 1) + source_pixel(i,j + 1))/2;
-                    float g3 = source_pixel(i,j);
-                    float b3 = (source_pixel(i - 1,j) + source_pixel(i + 1,j))/2;
-                    
-                    r3 = all * red * r3;
-                    g3 = all * green * g3;
-                    b3 = all * blue * b3;
-                    
-                    destination_pixel(i,j) = make_rgba(r3,g3,b3,a);
-                    
-                    i = x, j = y + 1;
-                    
-                    float r4 = (source_pixel(i - 1,j) + source_pixel(i + 1,j))/2;
-                    float g4 = source_pixel(i,j);
-                    float b4 = (source_pixel(i,j - 1) + source_pixel(i,j + 1))/2;
-                    
-                    r4 = all * red * r4;
-                    g4 = all * green * g4;
-                    b4 = all * blue * b4;
-                    
-                    destination_pixel(i,j) = make_rgba(r4,g4,b4,a);
-                }
-                
-                // GB|GB|GB|GB
-                // RG|RG|RG|RG
-                // GB|GB|GB|GB
-                // RG|RG|RG|RG
-                
-                if (self.mode == kCASImageDebayerGBRG){
-                    
-                    size_t i = x, j = y + 1;
-                    
-                    float r1 = source_pixel(i,j);
-                    float g1 = (source_pixel(i-1,j) + source_pixel(i,j-1) + source_pixel(i,j+1) + source_pixel(i+1,j))/4;
-                    float b1 = (source_pixel(i-1,j-1) + source_pixel(i+1,j-1) + source_pixel(i+1,j+1) + source_pixel(i-1,j+1))/4;
-                    
-                    r1 = all * red * r1;
-                    g1 = all * green * g1;
-                    b1 = all * blue * b1;
-                    
-                    destination_pixel(i,j) = make_rgba(r1,g1,b1,a);
-                    
-                    i = x + 1, j = y;
-                    
-                    float r2 = (source_pixel(i-1,j-1) + source_pixel(i+1,j-1) + source_pixel(i+1,j+1) + source_pixel(i-1,j+1))/4;
-                    float g2 = (source_pixel(i-1,j) + source_pixel(i,j-1) + source_pixel(i,j+1) + source_pixel(i+1,j))/4;
-                    float b2 = source_pixel(i,j);
-                    
-                    r2 = all * red * r2;
-                    g2 = all * green * g2;
-                    b2 = all * blue * b2;
-                    
-                    destination_pixel(i,j) = make_rgba(r2,g2,b2,a);
-                    
-                    i = x, j = y;
-                    
-                    float r3 = (source_pixel(i,j-1) + source_pixel(i,j+1))/2;
-                    float g3 = source_pixel(i,j);
-                    float b3 = (source_pixel(i-1,j) + source_pixel(i+1,j))/2;
-                    
-                    r3 = all * red * r3;
-                    g3 = all * green * g3;
-                    b3 = all * blue * b3;
-                    
-                    destination_pixel(i,j) = make_rgba(r3,g3,b3,a);
-                    
-                    i = x + 1, j = y + 1;
-                    
-                    float r4 = (source_pixel(i-1,j) + source_pixel(i+1,j))/2;
-                    float g4 = source_pixel(i,j);
-                    float b4 = (source_pixel(i,j-1) + source_pixel(i,j+1))/2;
-                    
-                    r4 = all * red * r4;
-                    g4 = all * green * g4;
-                    b4 = all * blue * b4;
-                    
-                    destination_pixel(i,j) = make_rgba(r4,g4,b4,a);
-                }
-            }
-            
-        });
         
-        float low = 0, high = 1;
-        vDSP_vclip((float*)cp,1,&low,&high,(float*)cp,1,finalPixelsLength/4);
+        // bands of tiles read straight from the whole frame, the white balance and clamping are done as each pixel's written
+        debayered = CASDebayerFrame(gp,size.width,size.width,size.height,pattern,algorithm,all * red,all * green,all * blue,cp,size.width * 4,CASParallelApply);
     });
+    if (!debayered){
+        NSLog(@"%@: failed to debayer an exposure of %ldx%ld",NSStringFromSelector(_cmd),size.width,size.height);
+        return nil;
+    }
     
     // update params to indicate the original exposure
     CASCCDExposure* finalExposure = [CASCCDExposure exposureWithRGBAFloatPixels:finalPixels camera:/*exposure.camera*/nil params:exposure.params time:[NSDate date]];
     
-    NSLog(@"debayer: %fs (r:%f, g:%f, b:%f, a:%f)",time,red,green,blue,all);
+    NSLog(@"debayer: %fs (algorithm:%ld, r:%f, g:%f, b:%f, a:%f)",time,(long)self.algorithm,red,green,blue,all);
     
     return finalExposure;
 }
@@ -25,6 +25,8 @@
 
 #import "CASImageMetrics.h"
 #import "CASCCDExposure.h"
+#import "CASExposureBackground.h"
+#import <vector>
 #import "CASHalfFluxDiameter.h"
 
 @implementation CASImageMetrics
@@ -55,6 +57,16 @@
         const CASSize size = exposure.actualSize;
         const NSInteger length = [exposure.floatPixels length]/sizeof(float);
         
+        // take the sky off first so a gradient doesn't drag the centroid and widen the diameter
+        std::vector<float> flattened;
+        CASExposureBackground* background = exposure.background;
+        if (background){
+            flattened.resize(length);
+            if ([background subtractFromPixels:pixels into:flattened.data() pedestal:0]){
+                pixels = flattened.data();
+            }
+        }
+        
         switch (mode) {
                 
             case CASImageMetricsHFDModeFast:
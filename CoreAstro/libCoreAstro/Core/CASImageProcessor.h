@@ -25,26 +25,65 @@
 
 #import "CASCCDExposure.h"
 
+@class CASExposureDefectMap;
+
 // todo; make this a factory for image processor modules that can describe their actions for an exposure's history
 
 @protocol CASImageProcessor <NSObject>
 @optional
 
 - (CASCCDExposure*)equalise:(CASCCDExposure*)exposure;
-- (CASCCDExposure*)unsharpMask:(CASCCDExposure*)exposure;
-- (CASCCDExposure*)medianFilter:(CASCCDExposure*)exposure;
+- (CASCCDExposure*)equaliseLocally:(CASCCDExposure*)exposure; // 8x8 tiles with a clip limit of 40
+- (CASCCDExposure*)equaliseLocally:(CASCCDExposure*)exposure tiles:(NSInteger)tiles clipLimit:(float)clipLimit; // contrast limited adaptive equalisation over tiles x tiles, colour exposures a channel at a time
+- (CASCCDExposure*)unsharpMask:(CASCCDExposure*)exposure; // sigma 1.5, amount 1
+- (CASCCDExposure*)unsharpMask:(CASCCDExposure*)exposure sigma:(float)sigma amount:(float)amount; // in + amount * (in - blur)
+- (CASCCDExposure*)gaussianBlur:(CASCCDExposure*)exposure sigma:(float)sigma;
+- (CASCCDExposure*)differenceOfGaussians:(CASCCDExposure*)exposure sigma1:(float)sigma1 sigma2:(float)sigma2; // blur(sigma1) - blur(sigma2)
+- (CASCCDExposure*)subtractBackground:(CASCCDExposure*)exposure; // the exposure's mesh background, keeping the median sky level, colour exposures use the gaussian version
+- (CASCCDExposure*)subtractBackground:(CASCCDExposure*)exposure sigma:(float)sigma; // removes gradients wider than sigma, keeping the median sky level
+- (CASCCDExposure*)convolve:(CASCCDExposure*)exposure kernel:(CASCCDExposure*)kernel; // any size of mono kernel centred on its middle pixel, through the FFT
+- (CASCCDExposure*)psfFromExposure:(CASCCDExposure*)exposure star:(CGPoint)star radius:(NSInteger)radius; // (2r+1)x(2r+1) with the sky taken off and normalised, nil without a star there
+- (CASCCDExposure*)deconvolve:(CASCCDExposure*)exposure psf:(CASCCDExposure*)psf iterations:(NSInteger)iterations; // Richardson-Lucy with a measured psf
+- (BOOL)offsetOfExposure:(CASCCDExposure*)exposure fromReference:(CASCCDExposure*)reference offset:(CGPoint*)offset; // phase correlation to a fraction of a pixel, the same size only
+- (CASCCDExposure*)medianFilter:(CASCCDExposure*)exposure; // 3x3
+- (CASCCDExposure*)medianFilter:(CASCCDExposure*)exposure radius:(NSInteger)radius; // (2r+1)x(2r+1), 16-bit exposures are filtered and returned as 16-bit
+- (CASCCDExposure*)correctDefects:(CASCCDExposure*)exposure map:(CASExposureDefectMap*)map; // just the map's hot, cold and column pixels, nil unless it can correct the exposure
 - (CASCCDExposure*)invert:(CASCCDExposure*)exposure;
 - (CASCCDExposure*)normalise:(CASCCDExposure*)exposure;
 
 - (CASCCDExposure*)subtract:(CASCCDExposure*)darkOrBias from:(CASCCDExposure*)exposure;
 - (void)divideFlat:(CASCCDExposure*)flat into:(CASCCDExposure*)exposure;
 
+// single pass calibration, any of the masters may be nil. IC = [(IR - ID) * M] / (IF - IB)
+- (CASCCDExposure*)calibrate:(CASCCDExposure*)exposure bias:(CASCCDExposure*)bias dark:(CASCCDExposure*)dark flat:(CASCCDExposure*)flat;
+
 - (CASCCDExposure*)medianSum:(NSArray*)exposures;
 - (CASCCDExposure*)averageSum:(NSArray*)exposures;
 
+typedef enum {
+    kCASImageProcessorCombineAverage,
+    kCASImageProcessorCombineMedian,
+    kCASImageProcessorCombineKappaSigma,
+    kCASImageProcessorCombineWinsorizedSigma,
+    kCASImageProcessorCombineLinearFit
+} CASImageProcessorCombineMode;
+typedef struct {
+    CASImageProcessorCombineMode mode;
+    float kappaLow, kappaHigh; // rejection thresholds in sigma for the clipping modes
+    NSInteger iterations;
+    NSUInteger memoryLimit; // bytes, 0 for the default
+} CASImageProcessorCombineParams;
+- (CASImageProcessorCombineParams)defaultCombineParamsWithMode:(CASImageProcessorCombineMode)mode;
+
+// combines the exposures a strip at a time, exposures without pixels loaded are read from their files so memory use is bounded by params.memoryLimit
+- (CASCCDExposure*)combine:(NSArray*)exposures params:(CASImageProcessorCombineParams)params;
+
 - (CASCCDExposure*)removeBayerMatrix:(CASCCDExposure*)exposure;
+- (CASCCDExposure*)superpixel:(CASCCDExposure*)exposure mode:(NSInteger)mode luminance:(BOOL)luminance; // each 2x2 block of a raw frame in the kCASImageDebayerRGGB etc mode as one pixel, binned 2x2 from the exposure
 
 - (CASCCDExposure*)luminance:(CASCCDExposure*)exposure;
+- (CASCCDExposure*)luminance:(CASCCDExposure*)exposure mode:(NSInteger)mode rect:(CASRect)rect; // as -luminance: of the bilinear debayered subframe, straight from the raw frame in the kCASImageDebayerRGGB etc mode
+- (CASCCDExposure*)compactColour:(CASCCDExposure*)exposure format:(CASCCDExposureFormat)format; // RGBA as kCASCCDExposureFormatRGBUInt16 or kCASCCDExposureFormatRGBHalf planes, 6 bytes a pixel rather than 16
 
 - (NSArray*)histogram:(CASCCDExposure*)exposure;
 
@@ -65,6 +104,10 @@ typedef struct {
 
 - (CASCCDExposure*)rescaleExposure:(CASCCDExposure*)exposure linearContrastStretchBounds:(CASContrastStretchBounds)bounds;
 
+// 8-bit gray or RGBA image of the exposure for display, stretched through a lookup table so 16-bit exposures never need converting
+// to float. bounds are as returned for a maxPixelValue of 1, midtone is the midtones transfer balance (0.5 for none) and gamma as in CASContrastStretchFilter
+- (CGImageRef)newDisplayImage:(CASCCDExposure*)exposure linearContrastStretchBounds:(CASContrastStretchBounds)bounds midtone:(float)midtone gamma:(float)gamma CF_RETURNS_RETAINED;
+
 @end
 
 @interface CASImageProcessor : NSObject<CASImageProcessor>
@@ -22,17 +22,37 @@
 //  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 //  IN THE SOFTWARE.
 //
-//  Basic image processing routines. With the exception of using GCD, completely
-//  unoptimised and just begging for some SSE/AVX/OpenCL/vDSP improvements
+//  Basic image processing routines. Work is split across cores with GCD, the per-pixel
+//  loops are done by the portable SIMD kernels in CASKernels.h
 
 #import "CASImageProcessor.h"
 #import "CASCCDExposure.h"
+#import "CASCCDExposure+Pixels.h"
 #import "CASUtilities.h"
+#import "CASKernels.h"
+#import "CASCalibration.h"
+#import "CASMedianFilter.h"
+#import "CASStackCombine.h"
+#import "CASGaussian.h"
+#import "CASBackground.h"
+#import "CASCLAHE.h"
+#import "CASColourPlanes.h"
+#import "CASDebayer.h"
+#import "CASImageDebayer.h"
+#import "CASFFT.h"
+#import "CASDisplayStretch.h"
+#import "CASParallel.h"
+#import "CASFramePoolData.h"
+#import "CASCCDExposureIO.h"
+#import "CASExposureStatistics.h"
+#import "CASExposureHistogram.h"
+#import "CASExposureDefectMap.h"
+#import "CASExposureBackground.h"
 #import <Accelerate/Accelerate.h>
 #import <algorithm>
+#import <vector>
 
 typedef float cas_pixel_t;
-typedef struct { float r,g,b,a; } cas_fpixel_t;
 
 @implementation CASImageProcessor {
     void* _equalisationBuffer;
@@ -72,16 +92,17 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
     return YES;
 }
 
-- (NSInteger)standardGroupSize
+// for reading from, results write to the buffer for their mutableFloatPixels
+- (vImage_Buffer)vImageBufferForExposure:(CASCCDExposure*)exposure
 {
-    return 4;
+    return [self vImageBufferForExposure:exposure pixels:exposure.floatPixels];
 }
 
-- (vImage_Buffer)vImageBufferForExposure:(CASCCDExposure*)exposure
+- (vImage_Buffer)vImageBufferForExposure:(CASCCDExposure*)exposure pixels:(NSData*)pixels
 {
     const CASSize size = [exposure actualSize];
     vImage_Buffer buffer = {
-        (void*)[exposure.floatPixels bytes],
+        (void*)[pixels bytes],
         size.height,
         size.width,
         exposure.rgba ? size.width * sizeof(float) * 4 : size.width * sizeof(cas_pixel_t)
@@ -115,25 +136,26 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
     
     const NSTimeInterval time = CASTimeBlock(^{
 
-        result = [exposure_ copy]; // returns a floating point exposure
+        result = [self resultWithEmptyFloatPixelsFrom:exposure_];
         if (!result){
             NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
         }
         else {
             
-            vImage_Buffer buffer = [self vImageBufferForExposure:result];
+            const vImage_Buffer source = [self vImageBufferForExposure:exposure_];
+            vImage_Buffer buffer = [self vImageBufferForExposure:result pixels:result.mutableFloatPixels];
             
             vImage_Error error = kvImageNoError;
             if (result.rgba){
                 
-                error = vImageEqualization_ARGBFFFF(&buffer,&buffer,nil,numberOfBins,0,1,kvImageGetTempBufferSize); // docs state that this still works even though the source data is RGBA not ARGB
+                error = vImageEqualization_ARGBFFFF(&source,&buffer,nil,numberOfBins,0,1,kvImageGetTempBufferSize); // docs state that this still works even though the source data is RGBA not ARGB
                 if (error > 0){
                     [self allocateEqualisationBufferWithSize:error];
                     if (!_equalisationBuffer){
                         error = memFullErr;
                     }
                     else {
-                        error = vImageEqualization_ARGBFFFF(&buffer,&buffer,_equalisationBuffer,numberOfBins,0,1,kvImageNoFlags);
+                        error = vImageEqualization_ARGBFFFF(&source,&buffer,_equalisationBuffer,numberOfBins,0,1,kvImageNoFlags);
                     }
                 }
                 if (error != kvImageNoError){
@@ -142,14 +164,14 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
             }
             else {
                 
-                error = vImageEqualization_PlanarF(&buffer,&buffer,NULL,numberOfBins,0,1,kvImageGetTempBufferSize);
+                error = vImageEqualization_PlanarF(&source,&buffer,NULL,numberOfBins,0,1,kvImageGetTempBufferSize);
                 if (error > 0){
                     [self allocateEqualisationBufferWithSize:error];
                     if (!_equalisationBuffer){
                         error = memFullErr;
                     }
                     else {
-                        error = vImageEqualization_PlanarF(&buffer,&buffer,_equalisationBuffer,numberOfBins,0,1,kvImageNoFlags);
+                        error = vImageEqualization_PlanarF(&source,&buffer,_equalisationBuffer,numberOfBins,0,1,kvImageNoFlags);
                     }
                 }
                 if (error != kvImageNoError){
@@ -164,56 +186,338 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
     return result;
 }
 
+// runs a float plane filter over the exposure, colour exposures a channel at a time with alpha left as it is
+- (CASCCDExposure*)filterPlanes:(CASCCDExposure*)exposure selector:(SEL)cmd filter:(BOOL(^)(const float* in,float* out,size_t width,size_t height))filter
+{
+    CASCCDExposure* result = [self resultWithEmptyFloatPixelsFrom:exposure];
+    if (!result){
+        NSLog(@"%@: out of memory",NSStringFromSelector(cmd));
+        return nil;
+    }
+    
+    const CASSize size = [exposure actualSize];
+    const NSInteger pixelCount = size.width * size.height;
+    const float* input = (const float*)[exposure.floatPixels bytes];
+    float* output = (float*)[result.mutableFloatPixels mutableBytes];
+    
+    NSMutableData* planes = nil;
+    if (exposure.rgba){
+        planes = [CASFramePoolData uninitialisedDataWithLength:2 * pixelCount * sizeof(float)];
+        if (!planes){
+            NSLog(@"%@: out of memory",NSStringFromSelector(cmd));
+            return nil;
+        }
+    }
+    
+    __block BOOL filtered = YES;
+    const NSTimeInterval time = CASTimeBlock(^{
+        
+        if (!exposure.rgba){
+            filtered = filter(input,output,size.width,size.height);
+        }
+        else {
+            
+            float* plane = (float*)[planes mutableBytes];
+            float* planeOut = plane + pixelCount;
+            for (NSInteger channel = 0; channel < 3 && filtered; ++channel){
+                CASParallelFor(pixelCount, 0, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i){
+                        plane[i] = input[i * 4 + channel];
+                    }
+                });
+                filtered = filter(plane,planeOut,size.width,size.height);
+                if (filtered){
+                    // the result's pixels are new so the alpha comes across with the first channel
+                    CASParallelFor(pixelCount, 0, [&](size_t begin, size_t end) {
+                        for (size_t i = begin; i < end; ++i){
+                            output[i * 4 + channel] = planeOut[i];
+                        }
+                        if (channel == 0){
+                            for (size_t i = begin; i < end; ++i){
+                                output[i * 4 + 3] = input[i * 4 + 3];
+                            }
+                        }
+                    });
+                }
+            }
+        }
+    });
+    
+    if (!filtered){
+        NSLog(@"%@: unsupported",NSStringFromSelector(cmd));
+        return nil;
+    }
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(cmd),time);
+    
+    return result;
+}
+
 - (CASCCDExposure*)unsharpMask:(CASCCDExposure*)exposure
 {
-    NSLog(@"%@: not implemented",NSStringFromSelector(_cmd));
-    return nil;
+    return [self unsharpMask:exposure sigma:1.5 amount:1];
 }
 
-- (CASCCDExposure*)medianFilter:(CASCCDExposure*)exposure_
+- (CASCCDExposure*)unsharpMask:(CASCCDExposure*)exposure sigma:(float)sigma amount:(float)amount
 {
-    const NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    return [self filterPlanes:exposure selector:_cmd filter:^BOOL(const float* in, float* out, size_t width, size_t height) {
+        return CASGaussianUnsharpMask(in,out,width,height,sigma,amount,CASParallelApply);
+    }];
+}
+
+- (CASCCDExposure*)gaussianBlur:(CASCCDExposure*)exposure sigma:(float)sigma
+{
+    return [self filterPlanes:exposure selector:_cmd filter:^BOOL(const float* in, float* out, size_t width, size_t height) {
+        return CASGaussianBlur(in,out,width,height,sigma,CASParallelApply);
+    }];
+}
+
+- (CASCCDExposure*)differenceOfGaussians:(CASCCDExposure*)exposure sigma1:(float)sigma1 sigma2:(float)sigma2
+{
+    return [self filterPlanes:exposure selector:_cmd filter:^BOOL(const float* in, float* out, size_t width, size_t height) {
+        return CASGaussianDifference(in,out,width,height,sigma1,sigma2,CASParallelApply);
+    }];
+}
+
+- (CASCCDExposure*)equaliseLocally:(CASCCDExposure*)exposure
+{
+    const CASCLAHEParameters parameters = CASCLAHEDefaultParameters();
+    return [self equaliseLocally:exposure tiles:parameters.tilesX clipLimit:parameters.clipLimit];
+}
+
+- (CASCCDExposure*)equaliseLocally:(CASCCDExposure*)exposure tiles:(NSInteger)tiles clipLimit:(float)clipLimit
+{
+    if (tiles < 1 || clipLimit < 0){
+        NSLog(@"%@: invalid parameters",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    const CASCLAHEParameters parameters = { (size_t)tiles, (size_t)tiles, clipLimit };
     
-    const CASSize size = [exposure_ actualSize];
+    // equalise the camera's 16-bit samples directly when we have them rather than going through floats
+    if (exposure.format == kCASCCDExposureFormatUInt16){
+        
+        CASCCDExposure* result = [self resultWithEmptyFloatPixelsFrom:exposure];
+        const CASPixels samples = exposure.samples;
+        if (!result || CASPixelsIsEmpty(samples)){
+            NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+            return nil;
+        }
+        
+        __block bool equalised = false;
+        const NSTimeInterval time = CASTimeBlock(^{
+            equalised = CASCLAHE(samples,parameters,(float*)[result.mutableFloatPixels mutableBytes],samples.width,CASParallelApply);
+        });
+        if (!equalised){
+            NSLog(@"%@: unsupported",NSStringFromSelector(_cmd));
+            return nil;
+        }
+        
+        NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+        
+        return result;
+    }
     
-    const NSInteger groupCount = [self standardGroupSize];
-    const NSInteger rowsPerGroup = (size.height - 2) / groupCount;
+    return [self filterPlanes:exposure selector:_cmd filter:^BOOL(const float* in, float* out, size_t width, size_t height) {
+        return CASCLAHE(CASPixelsMake(kCASPixelFormatFloat,in,width,height,width),parameters,out,width,CASParallelApply);
+    }];
+}
 
-    __block CASCCDExposure* result = [exposure_ copy]; // returns a floating point exposure
-    if (!result){
+- (CASCCDExposure*)subtractBackground:(CASCCDExposure*)exposure
+{
+    CASExposureBackground* background = exposure.background;
+    if (!background){
+        return [self subtractBackground:exposure sigma:CAS_BACKGROUND_MESH_SIZE];
+    }
+    const float pedestal = background.level;
+    return [self filterPlanes:exposure selector:_cmd filter:^BOOL(const float* in, float* out, size_t width, size_t height) {
+        return [background subtractFromPixels:in into:out pedestal:pedestal];
+    }];
+}
+
+- (CASCCDExposure*)subtractBackground:(CASCCDExposure*)exposure sigma:(float)sigma
+{
+    // keep the sky at its original level so the result still displays with the same stretch
+    const float pedestal = exposure.statistics.median;
+    return [self filterPlanes:exposure selector:_cmd filter:^BOOL(const float* in, float* out, size_t width, size_t height) {
+        return CASGaussianSubtractBackground(in,out,width,height,sigma,pedestal,CASParallelApply);
+    }];
+}
+
+- (CASCCDExposure*)convolve:(CASCCDExposure*)exposure kernel:(CASCCDExposure*)kernel
+{
+    if (kernel.rgba){
+        NSLog(@"%@: colour kernels aren't supported",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    NSData* kernelPixels = kernel.floatPixels;
+    const CASSize kernelSize = kernel.actualSize;
+    return [self filterPlanes:exposure selector:_cmd filter:^BOOL(const float* in, float* out, size_t width, size_t height) {
+        return CASFFTConvolve(in,out,width,height,(const float*)[kernelPixels bytes],kernelSize.width,kernelSize.height,CASParallelApply);
+    }];
+}
+
+- (CASCCDExposure*)psfFromExposure:(CASCCDExposure*)exposure star:(CGPoint)star radius:(NSInteger)radius
+{
+    if (exposure.rgba){
+        exposure = [self luminance:exposure];
+    }
+    
+    const CASSize size = [exposure actualSize];
+    const NSInteger psfSize = 2 * radius + 1;
+    NSMutableData* pixels = [NSMutableData dataWithLength:psfSize * psfSize * sizeof(float)];
+    if (radius < 1 || ![pixels mutableBytes]){
+        return nil;
+    }
+    if (!CASFFTMeasurePSF((const float*)[exposure.floatPixels bytes],size.width,size.height,star.x,star.y,radius,(float*)[pixels mutableBytes])){
+        NSLog(@"%@: no star at %f,%f",NSStringFromSelector(_cmd),star.x,star.y);
+        return nil;
+    }
+    
+    CASCCDExposure* result = [CASCCDExposure exposureWithFloatPixels:pixels
+                                                              camera:nil
+                                                              params:CASExposeParamsMake(psfSize,psfSize,0,0,psfSize,psfSize,1,1,exposure.params.bps,0)
+                                                                time:[NSDate date]];
+    result.format = kCASCCDExposureFormatFloat;
+    return result;
+}
+
+- (CASCCDExposure*)deconvolve:(CASCCDExposure*)exposure psf:(CASCCDExposure*)psf iterations:(NSInteger)iterations
+{
+    if (psf.rgba || iterations < 0){
+        NSLog(@"%@: needs a mono psf",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    NSData* psfPixels = psf.floatPixels;
+    const CASSize psfSize = psf.actualSize;
+    return [self filterPlanes:exposure selector:_cmd filter:^BOOL(const float* in, float* out, size_t width, size_t height) {
+        return CASFFTRichardsonLucy(in,out,width,height,(const float*)[psfPixels bytes],psfSize.width,psfSize.height,(int)iterations,CASParallelApply);
+    }];
+}
+
+- (BOOL)offsetOfExposure:(CASCCDExposure*)exposure fromReference:(CASCCDExposure*)reference offset:(CGPoint*)offset
+{
+    const CASSize size = [exposure actualSize];
+    if (!offset || size.width != reference.actualSize.width || size.height != reference.actualSize.height){
+        return NO;
+    }
+    if (exposure.rgba){
+        exposure = [self luminance:exposure];
+    }
+    if (reference.rgba){
+        reference = [self luminance:reference];
+    }
+    
+    float dx = 0, dy = 0;
+    if (!CASFFTRegister((const float*)[reference.floatPixels bytes],(const float*)[exposure.floatPixels bytes],size.width,size.height,dx,dy,CASParallelApply)){
+        return NO;
+    }
+    *offset = CGPointMake(dx,dy);
+    
+    return YES;
+}
+
+// a float exposure with the same meta and size as the given one but new pixels, for out of place processing that
+// writes every pixel so there's no need to copy the originals first
+- (CASCCDExposure*)resultWithEmptyFloatPixelsFrom:(CASCCDExposure*)exposure
+{
+    const CASSize size = [exposure actualSize];
+    NSMutableData* pixels = [CASFramePoolData uninitialisedDataWithLength:size.width * size.height * exposure.pixelSize];
+    if (![pixels mutableBytes]){
+        return nil;
+    }
+    CASCCDExposure* result = [self resultWithPixels:pixels floatPixels:YES from:exposure];
+    if (exposure.rgba){
+        result.format = kCASCCDExposureFormatFloatRGBA;
+    }
+    return result;
+}
+
+- (CASCCDExposure*)resultWithPixels:(NSData*)pixels floatPixels:(BOOL)floatPixels from:(CASCCDExposure*)exposure
+{
+    CASCCDExposure* result = nil;
+    if (floatPixels){
+        result = [CASCCDExposure exposureWithFloatPixels:pixels camera:nil params:exposure.params time:[NSDate date]];
+    }
+    else {
+        result = [CASCCDExposure exposureWithPixels:pixels camera:nil params:exposure.params time:[NSDate date]];
+    }
+    NSMutableDictionary* meta = [[NSMutableDictionary alloc] initWithDictionary:exposure.meta copyItems:YES];
+    [meta setObject:CASCreateUUID() forKey:@"uuid"];
+    result.meta = [meta copy];
+    result.format = floatPixels ? kCASCCDExposureFormatFloat : kCASCCDExposureFormatUInt16;
+    return result;
+}
+
+- (CASCCDExposure*)medianFilter:(CASCCDExposure*)exposure
+{
+    return [self medianFilter:exposure radius:1];
+}
+
+- (CASCCDExposure*)medianFilter:(CASCCDExposure*)exposure radius:(NSInteger)radius
+{
+    if (exposure.rgba || radius < 0 || radius > CAS_MEDIAN_FILTER_MAX_RADIUS){
+        NSLog(@"%@: unsupported",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    const CASSize size = [exposure actualSize];
+    const NSInteger pixelCount = size.width * size.height;
+    
+    // filter the camera's 16-bit samples directly when we have them rather than going through floats
+    const BOOL floatPixels = (exposure.format != kCASCCDExposureFormatUInt16);
+    NSData* input = floatPixels ? exposure.floatPixels : exposure.pixels;
+    NSMutableData* output = [CASFramePoolData uninitialisedDataWithLength:pixelCount * (floatPixels ? sizeof(float) : sizeof(uint16_t))];
+    if (!input || ![output mutableBytes]){
         NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+        return nil;
     }
-    else{
+    
+    const NSTimeInterval time = CASTimeBlock(^{
         
-        cas_pixel_t* exposurePixels = (cas_pixel_t*)[exposure_.floatPixels bytes];
-        cas_pixel_t* outputPixels = (cas_pixel_t*)[result.floatPixels bytes];
-
-        dispatch_apply(groupCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t groupIndex) {
+        const void* inputPixels = [input bytes];
+        void* outputPixels = [output mutableBytes];
+        
+        CASParallelFor(CASMedianFilterTileCount(size.height), 1, [&](size_t begin, size_t end) {
             
-            // todo: AVX
-            const NSInteger startRow = 1 + rowsPerGroup * groupIndex;
-            const NSInteger rowsInThisGroup = (groupIndex == groupCount - 1) ? rowsPerGroup + (size.height - 2) % rowsPerGroup : rowsPerGroup;
-            for (NSInteger y = startRow; y < startRow + rowsInThisGroup; ++y){
-                
-                for (NSInteger x = 1; x < size.width - 1; ++x){
-                    
-                    int i = 0;
-                    cas_pixel_t window[9];
-                    for (NSInteger y1 = y-1; y1 <= y+1; ++y1){
-                        for (NSInteger x1 = x-1; x1 <= x+1; ++x1){
-                            window[i++] = exposurePixels[x1 + y1 * size.width];
-                        }
-                    }
-                    std::nth_element(window, window + 4, window + 9);
-                    outputPixels[x + y * size.width] = window[4];
+            for (size_t tile = begin; tile < end; ++tile){
+                const NSInteger startRow = tile * CAS_MEDIAN_FILTER_TILE_ROWS;
+                const NSInteger rowCount = MIN(CAS_MEDIAN_FILTER_TILE_ROWS, size.height - startRow);
+                if (floatPixels){
+                    CASMedianFilterRows((const float*)inputPixels,(float*)outputPixels,size.width,size.height,(int)radius,startRow,rowCount);
+                }
+                else {
+                    CASMedianFilterRows((const uint16_t*)inputPixels,(uint16_t*)outputPixels,size.width,size.height,(int)radius,startRow,rowCount);
                 }
             }
         });
+    });
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    return [self resultWithPixels:output floatPixels:floatPixels from:exposure];
+}
+
+- (CASCCDExposure*)correctDefects:(CASCCDExposure*)exposure map:(CASExposureDefectMap*)map
+{
+    if (![map canCorrectExposure:exposure]){
+        NSLog(@"%@: unsupported",NSStringFromSelector(_cmd));
+        return nil;
     }
     
-    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),[NSDate timeIntervalSinceReferenceDate] - start);
+    // only the defects are touched so copying the frame is most of the work
+    const BOOL floatPixels = (exposure.format != kCASCCDExposureFormatUInt16);
+    NSData* input = floatPixels ? exposure.floatPixels : exposure.pixels;
+    NSMutableData* output = [CASFramePoolData uninitialisedDataWithLength:[input length]];
+    if (!input || ![output mutableBytes]){
+        NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+        return nil;
+    }
     
-    return result;
+    // runs on every guide frame so no timing log here
+    memcpy([output mutableBytes],[input bytes],[input length]);
+    [map correctPixels:output ofExposure:exposure];
+    
+    return [self resultWithPixels:output floatPixels:floatPixels from:exposure];
 }
 
 - (CASCCDExposure*)invert:(CASCCDExposure*)exposure_
@@ -228,43 +532,15 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
             
             const CASSize size = [result actualSize];
             
-            const NSInteger groupCount = [self standardGroupSize];
-            const NSInteger pixelCount = size.width * size.height;
-            const NSInteger pixelsPerGroup = pixelCount / groupCount;
+            // rgba pixels are inverted component-wise, alpha included, so both formats are just a run of floats
+            const NSInteger valueCount = size.width * size.height * (result.rgba ? 4 : 1);
             
-            if (result.rgba){
-                
-                cas_fpixel_t* exposurePixels = (cas_fpixel_t*)[result.floatPixels bytes];
-                
-                dispatch_apply(groupCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t groupIndex) {
-                    
-                    // todo: AVX
-                    const NSInteger offset = pixelsPerGroup * groupIndex;
-                    const NSInteger pixelsInThisGroup = (groupIndex == groupCount - 1) ? pixelsPerGroup + pixelCount % pixelsPerGroup : pixelsPerGroup;
-                    for (NSInteger i = offset; i < pixelsInThisGroup + offset; ++i){
-                        cas_fpixel_t pixel = exposurePixels[i];
-                        pixel.r = 1.0 - pixel.r;
-                        pixel.g = 1.0 - pixel.g;
-                        pixel.b = 1.0 - pixel.b;
-                        pixel.a = 1.0 - pixel.a;
-                        exposurePixels[i] = pixel;
-                    }
-                });
-            }
-            else {
-                cas_pixel_t* exposurePixels = (cas_pixel_t*)[result.floatPixels bytes];
-                
-                dispatch_apply(groupCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t groupIndex) {
-                    
-                    // todo: AVX
-                    const NSInteger offset = pixelsPerGroup * groupIndex;
-                    const NSInteger pixelsInThisGroup = (groupIndex == groupCount - 1) ? pixelsPerGroup + pixelCount % pixelsPerGroup : pixelsPerGroup;
-                    for (NSInteger i = offset; i < pixelsInThisGroup + offset; ++i){
-                        const float pixel = exposurePixels[i];
-                        exposurePixels[i] = 1.0 - pixel;
-                    }
-                });
-            }
+            // the invert kernel works in place, the copy shares the original's pixels until here
+            float* exposurePixels = (float*)[result.mutableFloatPixels mutableBytes];
+            
+            CASParallelFor(valueCount, 0, [&](size_t begin, size_t end) {
+                CASKernels().invert(exposurePixels + begin,end - begin);
+            });
         });
 
         NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
@@ -275,22 +551,21 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
 
 - (CASCCDExposure*)normalise:(CASCCDExposure*)exposure
 {
-    __block CASCCDExposure* result = [exposure copy]; // returns a floating point exposure
+    // get average flat value, nothing to do if it's zero
+    float average = exposure.statistics.mean;
+    if (average == 0){
+        return [exposure copy];
+    }
+    
+    __block CASCCDExposure* result = [self resultWithEmptyFloatPixelsFrom:exposure];
     if (!result){
         NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
     }
     else{
         
-        // get average flat value
-        float average = 0;
-        float* fbuf = (float*)[result.floatPixels bytes];
-        vDSP_meamgv(fbuf,1,&average,[result.floatPixels length]/sizeof(float));
-        
-        if (average != 0){
-            
-            // divide by the average
-            vDSP_vsdiv(fbuf,1,(float*)&average,fbuf,1,[result.floatPixels length]/sizeof(float));
-        }
+        // divide by the average
+        NSData* pixels = exposure.floatPixels;
+        vDSP_vsdiv((float*)[pixels bytes],1,(float*)&average,(float*)[result.mutableFloatPixels mutableBytes],1,[pixels length]/sizeof(float));
     }
     
     return result;
@@ -298,46 +573,98 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
 
 - (CASCCDExposure*)removeBayerMatrix:(CASCCDExposure*)exposure_
 {
-    __block CASCCDExposure* result = [exposure_ copy]; // returns a floating point exposure
-    if (!result){
-        NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+    if (exposure_.rgba){
+        NSLog(@"%@: needs a raw frame",NSStringFromSelector(_cmd));
+        return nil;
     }
-    else{
+    
+    // each 2x2 block is averaged straight from the samples. the superpixels are RGBA with red and blue on one diagonal
+    // and the mean of the other two as green so a quarter of red and blue plus half of green is the mean of all four
+    // whichever the pattern is, then that's scaled back up to full size
+    const CASPixels samples = exposure_.samples;
+    const size_t width = samples.width / 2, height = samples.height / 2;
+    NSMutableData* superpixels = [CASFramePoolData uninitialisedDataWithLength:width * height * 4 * sizeof(float)];
+    NSMutableData* means = [CASFramePoolData uninitialisedDataWithLength:width * height * sizeof(float)];
+    CASCCDExposure* result = [self resultWithEmptyFloatPixelsFrom:exposure_];
+    if (!width || !height || !superpixels || !means || !result){
+        NSLog(@"%@: out of memory or too small",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    __block BOOL success = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
         
-        const NSTimeInterval time = CASTimeBlock(^{
+        float* rgba = (float*)[superpixels mutableBytes];
+        float* mean = (float*)[means mutableBytes];
+        if (CASDebayerSuperpixel(samples,kCASBayerRGGB,false,rgba,width * 4,CASParallelApply)){
             
-            const CASSize size = [result actualSize];
-
-            vImage_Buffer source = [self vImageBufferForExposure:result];
+            const float quarter = 0.25, half = 0.5;
+            vDSP_vadd(rgba,4,rgba + 2,4,mean,1,width * height);
+            vDSP_vsmsma(mean,1,&quarter,rgba + 1,4,&half,mean,1,width * height);
             
-            vImage_Buffer destination = {
-                (void*)malloc(size.height/2 * size.width/2 * sizeof(cas_pixel_t)),
-                size.height/2,
-                size.width/2,
-                size.width/2 * sizeof(cas_pixel_t)
+            const vImage_Buffer destination = {
+                mean,
+                height,
+                width,
+                width * sizeof(float)
             };
-            
-            if (!source.data || !destination.data){
-                NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
-            }
-            else {
-                
-                // scale down to half size
-                vImageScale_PlanarF(&source,&destination,nil,kvImageHighQualityResampling);
-                
-                // scale back up to full size
-                vImageScale_PlanarF(&destination,&source,nil,kvImageHighQualityResampling);
-                
-                // probably a better way of doing this with a convolution filter ?
-                
-                // cleanup
-                free(destination.data);
-            }
-        });
-        
-        NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+            vImage_Buffer output = [self vImageBufferForExposure:result pixels:result.mutableFloatPixels];
+            success = (output.data && vImageScale_PlanarF(&destination,&output,nil,kvImageHighQualityResampling) == kvImageNoError);
+        }
+    });
+    if (!success){
+        NSLog(@"%@: failed to remove the bayer matrix",NSStringFromSelector(_cmd));
+        return nil;
     }
     
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    return result;
+}
+
+- (CASCCDExposure*)superpixel:(CASCCDExposure*)exposure mode:(NSInteger)mode luminance:(BOOL)luminance
+{
+    if (mode < kCASImageDebayerRGGB || mode > kCASImageDebayerGBRG || exposure.rgba){
+        NSLog(@"%@: needs a raw frame and a bayer pattern",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    // straight from the 16-bit samples when there are some, the float frame never gets made
+    const CASPixels samples = exposure.samples;
+    const size_t width = samples.width / 2, height = samples.height / 2;
+    const size_t channels = luminance ? 1 : 4;
+    NSMutableData* pixels = [CASFramePoolData uninitialisedDataWithLength:width * height * channels * sizeof(float)];
+    if (!width || !height || !pixels){
+        NSLog(@"%@: out of memory or too small",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    __block BOOL success = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
+        success = CASDebayerSuperpixel(samples,(CASBayerPattern)(mode - kCASImageDebayerRGGB),luminance,(float*)[pixels mutableBytes],width * channels,CASParallelApply);
+    });
+    if (!success){
+        return nil;
+    }
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    // binned 2x2 so it covers the same part of the sensor and positions scale back with the binning
+    CASExposeParams params = exposure.params;
+    params.bin.width <<= 1;
+    params.bin.height <<= 1;
+    params.size = CASSizeMake(width * params.bin.width,height * params.bin.height);
+    
+    CASCCDExposure* result = luminance ?
+        [CASCCDExposure exposureWithFloatPixels:pixels camera:nil params:params time:exposure.date] :
+        [CASCCDExposure exposureWithRGBAFloatPixels:pixels camera:nil params:params time:exposure.date];
+    const CASCCDExposureFormat format = luminance ? kCASCCDExposureFormatFloat : kCASCCDExposureFormatFloatRGBA;
+    
+    NSMutableDictionary* meta = [[NSMutableDictionary alloc] initWithDictionary:exposure.meta copyItems:YES];
+    [meta setObject:CASCreateUUID() forKey:@"uuid"];
+    [meta setObject:[NSNumber numberWithInteger:format] forKey:@"format"];
+    [meta setObject:NSStringFromCASExposeParams(params) forKey:@"exposure"];
+    result.meta = [meta copy];
+    
     return result;
 }
 
@@ -353,25 +680,18 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
     }
     else{
         
-        typedef struct { float r,g,b,a; } rgba_pixel_t;
-        
         const CASSize size = result.actualSize;
         const NSInteger count = size.width * size.height;
         
-        result.floatPixels = [NSMutableData dataWithLength:count * sizeof(float)];
+        result.floatPixels = [CASFramePoolData dataWithLength:count * sizeof(float)];
         result.format = kCASCCDExposureFormatFloat;
         
         float* fp = (float*)[result.floatPixels bytes];
-        rgba_pixel_t* rgbp = (rgba_pixel_t*)[exposure.floatPixels bytes];
+        const float* rgbp = (const float*)[exposure.floatPixels bytes];
         if (fp && rgbp){
             
-            dispatch_apply(size.height, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t row) {
-                
-                float* fp1 = fp + row * size.width;
-                rgba_pixel_t* rgbp1 = rgbp + row * size.width;
-                for (NSInteger i = 0; i < size.width; i++, fp1++, rgbp1++){
-                    *fp1 = MIN(1.0,(0.2126*rgbp1->r) + (0.7152*rgbp1->g) + (0.0722*rgbp1->b));
-                }
+            CASParallelFor(count, 0, [&](size_t begin, size_t end) {
+                CASKernels().luminance(rgbp + begin * 4,fp + begin,end - begin);
             });
         }
     }
@@ -379,6 +699,84 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
     return result;
 }
 
+- (CASCCDExposure*)luminance:(CASCCDExposure*)exposure mode:(NSInteger)mode rect:(CASRect)rect
+{
+    if (mode < kCASImageDebayerRGGB || mode > kCASImageDebayerGBRG || exposure.rgba){
+        NSLog(@"%@: needs a raw frame and a bayer pattern",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    const CASExposeParams params = exposure.params;
+    if (rect.size.width < 1 || rect.size.height < 1 || params.bin.width < 1 || params.bin.height < 1){
+        return nil;
+    }
+    
+    // clipped to the frame as -subframeWithRect: does, rect being in full frame co-ords
+    const CASSize size = params.size;
+    rect.origin.x = MAX(rect.origin.x - params.origin.x,0);
+    rect.origin.y = MAX(rect.origin.y - params.origin.y,0);
+    rect.size.width = MIN(rect.size.width,size.width);
+    rect.size.height = MIN(rect.size.height,size.height);
+    if (rect.origin.x + rect.size.width > size.width){
+        rect.origin.x = size.width - rect.size.width;
+    }
+    if (rect.origin.y + rect.size.height > size.height){
+        rect.origin.y = size.height - rect.size.height;
+    }
+    
+    const size_t x = rect.origin.x / params.bin.width, y = rect.origin.y / params.bin.height;
+    const size_t width = rect.size.width / params.bin.width, height = rect.size.height / params.bin.height;
+    NSMutableData* pixels = [CASFramePoolData uninitialisedDataWithLength:width * height * sizeof(float)];
+    if (!pixels){
+        NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    // the search area alone is interpolated, from the 16-bit samples when there are some
+    const CASPixels samples = exposure.samples;
+    if (!CASDebayerLuminance(samples,(CASBayerPattern)(mode - kCASImageDebayerRGGB),x,y,width,height,(float*)[pixels mutableBytes],width,CASParallelApply)){
+        return nil;
+    }
+    
+    CASExposeParams subframeParams = params;
+    subframeParams.origin = rect.origin;
+    subframeParams.size = rect.size;
+    CASCCDExposure* result = [CASCCDExposure exposureWithFloatPixels:pixels camera:nil params:subframeParams time:[NSDate date]];
+    result.format = kCASCCDExposureFormatFloat;
+    return result;
+}
+
+- (CASCCDExposure*)compactColour:(CASCCDExposure*)exposure format:(CASCCDExposureFormat)format
+{
+    if (!exposure.rgba || (format != kCASCCDExposureFormatRGBUInt16 && format != kCASCCDExposureFormatRGBHalf)){
+        NSLog(@"%@: needs a colour exposure and a planar format",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    if (exposure.format == format){
+        return exposure;
+    }
+    
+    const CASSize size = exposure.actualSize;
+    const NSInteger count = size.width * size.height;
+    const CASColourPlanesFormat planesFormat = (format == kCASCCDExposureFormatRGBHalf) ? kCASColourPlanesHalf : kCASColourPlanesUInt16;
+    const float* rgba = (const float*)[exposure.floatPixels bytes];
+    NSMutableData* planes = [CASFramePoolData uninitialisedDataWithLength:CASColourPlanesLength(planesFormat,count)];
+    if (!rgba || !planes){
+        NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    if (!CASColourPlanesFromRGBA(rgba,count,planesFormat,[planes mutableBytes])){
+        return nil;
+    }
+    
+    // otherwise the same exposure as far as its metadata goes
+    CASCCDExposure* result = [CASCCDExposure exposureWithRGBPixels:planes format:format camera:nil params:exposure.params time:exposure.date];
+    NSMutableDictionary* meta = [[NSMutableDictionary alloc] initWithDictionary:exposure.meta copyItems:YES];
+    [meta setObject:CASCreateUUID() forKey:@"uuid"];
+    [meta setObject:[NSNumber numberWithInteger:format] forKey:@"format"];
+    result.meta = [meta copy];
+    return result;
+}
+
 // IC = (IR - IB)
 - (CASCCDExposure*)subtract:(CASCCDExposure*)darkOrBias from:(CASCCDExposure*)exposure
 {
@@ -387,20 +785,21 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
         return nil;
     }
  
-    __block CASCCDExposure* result = [exposure copy]; // returns a floating point exposure
+    __block CASCCDExposure* result = [self resultWithEmptyFloatPixelsFrom:exposure];
     if (!result){
         NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
     }
     else{
 
-        float* fbuf = (float*)[result.floatPixels bytes];
-        float* fdarkOrBias = (float*)[darkOrBias.floatPixels bytes];
+        NSMutableData* output = result.mutableFloatPixels;
+        const float* fbuf = (const float*)[exposure.floatPixels bytes];
+        const float* fdarkOrBias = (const float*)[darkOrBias.floatPixels bytes];
         if (!fbuf || !fdarkOrBias){
             NSLog(@"%@: Out of memory",NSStringFromSelector(_cmd));
             result = nil;
         }
         else {
-            vDSP_vsub(fdarkOrBias,1,fbuf,1,fbuf,1,[result.floatPixels length]/sizeof(float));
+            vDSP_vsub(fdarkOrBias,1,fbuf,1,(float*)[output mutableBytes],1,[output length]/sizeof(float));
         }
     }
     
@@ -419,55 +818,210 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
     
     const CASSize size = [exposure actualSize];
 
-    const NSInteger groupCount = [self standardGroupSize];
     const NSInteger pixelCount = size.width * size.height;
-    const NSInteger pixelsPerGroup = pixelCount / groupCount;
     
-    cas_pixel_t* flatPixels = (cas_pixel_t*)[flat.floatPixels bytes];
-    cas_pixel_t* exposurePixels = (cas_pixel_t*)[exposure.floatPixels bytes];
+    const cas_pixel_t* flatPixels = (cas_pixel_t*)[flat.floatPixels bytes];
+    cas_pixel_t* exposurePixels = (cas_pixel_t*)[exposure.mutableFloatPixels mutableBytes];
 
-    __block double* totalPixelValues = (double*)malloc(sizeof(double) * groupCount);
-    bzero(totalPixelValues, sizeof(double) * groupCount);
+    const float mean = flat.statistics.mean;
     
-    dispatch_apply(groupCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t groupIndex) {
-        
-        // todo: AVX
-        const NSInteger offset = pixelsPerGroup * groupIndex;
-        const NSInteger pixelsInThisGroup = (groupIndex == groupCount - 1) ? pixelsPerGroup + pixelCount % pixelsPerGroup : pixelsPerGroup;
-        for (NSInteger i = offset; i < pixelsInThisGroup + offset; ++i){
-            const double flat = flatPixels[i];
-            totalPixelValues[groupIndex] += flat;
-        }
+    CASParallelFor(pixelCount, 0, [&](size_t begin, size_t end) {
+        CASKernels().divideFlat(exposurePixels + begin,flatPixels + begin,mean,end - begin);
     });
-    
-    double averagePixelValue = 0;
-    for (NSInteger i = 0; i < groupCount; ++i){
-        averagePixelValue += totalPixelValues[i];
+    [exposure invalidateStatistics];
+
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),[NSDate timeIntervalSinceReferenceDate] - start);
+}
+
+- (CASCCDExposure*)calibrate:(CASCCDExposure*)exposure bias:(CASCCDExposure*)bias dark:(CASCCDExposure*)dark flat:(CASCCDExposure*)flat
+{
+    if (exposure.rgba){
+        NSLog(@"%@: unsupported",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    for (CASCCDExposure* master in @[bias ? bias : [NSNull null],dark ? dark : [NSNull null],flat ? flat : [NSNull null]]){
+        if (master != (id)[NSNull null] && (master.rgba || ![self preflightA:master b:exposure])){
+            NSLog(@"%@: unsupported",NSStringFromSelector(_cmd));
+            return nil;
+        }
     }
-    averagePixelValue /= pixelCount;
     
-    free(totalPixelValues);
+    const CASSize size = [exposure actualSize];
+    const NSInteger pixelCount = size.width * size.height;
 
-    dispatch_apply(groupCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t groupIndex) {
+    NSData* biasPixels = bias.floatPixels;
+    NSData* darkPixels = dark.floatPixels;
+    NSData* flatPixels = flat.floatPixels;
+    
+    // 16-bit lights are widened a tile at a time as they're calibrated rather than expanded to floats up front
+    const CASPixels light = exposure.samples;
+    const CASPixelView<const uint16_t> lightSamples = CASPixelsView<uint16_t>(light);
+    const CASPixelView<const float> lightPixels = CASPixelsView<float>(light);
+    NSMutableData* corrected = [CASFramePoolData uninitialisedDataWithLength:pixelCount * sizeof(float)];
+    if ((lightSamples.empty() && lightPixels.empty()) || ![corrected mutableBytes] || (bias && !biasPixels) || (dark && !darkPixels) || (flat && !flatPixels)){
+        NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    const CASCalibrationMasters masters = {
+        (const float*)[biasPixels bytes],
+        (const float*)[darkPixels bytes],
+        (const float*)[flatPixels bytes],
+        (size_t)pixelCount
+    };
+    
+    // the masters are the same for every light in a batch and cache their statistics, the mean of the offset
+    // subtracted flat is just the difference of the two means
+    CASCalibrationStatistics statistics = { 0 };
+    if (flat){
+        CASCCDExposure* flatOffset = bias ? bias : dark;
+        statistics.flatMean = flat.statistics.mean - (flatOffset ? flatOffset.statistics.mean : 0);
+    }
+    
+    const NSTimeInterval time = CASTimeBlock(^{
         
-        // todo: AVX
-        const NSInteger offset = pixelsPerGroup * groupIndex;
-        const NSInteger pixelsInThisGroup = (groupIndex == groupCount - 1) ? pixelsPerGroup + pixelCount % pixelsPerGroup : pixelsPerGroup;
-        for (NSInteger i = offset; i < pixelsInThisGroup + offset; ++i){
-            const double pixel = exposurePixels[i];
-            const double flat = flatPixels[i];
-            const double correction = flat != 0 ? (averagePixelValue / flat) : 1;
-            exposurePixels[i] = correction != 0 ? pixel / correction : pixel;
-        }
+        const size_t tileCount = CASCalibrationTileCount(pixelCount);
+        
+        float* correctedPixels = (float*)[corrected mutableBytes];
+        
+        CASParallelFor(tileCount, 1, [&](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; ++tile){
+                const size_t start = tile * CAS_CALIBRATION_TILE_PIXELS;
+                const size_t count = MIN(CAS_CALIBRATION_TILE_PIXELS,pixelCount - start);
+                if (!lightSamples.empty()){
+                    CASCalibrateRange(lightSamples.pixels,masters,statistics,correctedPixels,start,count);
+                }
+                else {
+                    CASCalibrateRange(lightPixels.pixels,masters,statistics,correctedPixels,start,count);
+                }
+            }
+        });
     });
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
 
-    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),[NSDate timeIntervalSinceReferenceDate] - start);
+    return [self resultWithPixels:corrected floatPixels:YES from:exposure];
 }
 
 - (CASCCDExposure*)medianSum:(NSArray*)exposures
 {
-    NSLog(@"%@: not implemented",NSStringFromSelector(_cmd));
-    return nil;
+    return [self combine:exposures params:[self defaultCombineParamsWithMode:kCASImageProcessorCombineMedian]];
+}
+
+- (CASImageProcessorCombineParams)defaultCombineParamsWithMode:(CASImageProcessorCombineMode)mode
+{
+    const CASStackCombineParameters defaults = CASStackCombineDefaultParameters((CASStackCombineMode)mode);
+    CASImageProcessorCombineParams params;
+    params.mode = mode;
+    params.kappaLow = defaults.kappaLow;
+    params.kappaHigh = defaults.kappaHigh;
+    params.iterations = defaults.iterations;
+    params.memoryLimit = defaults.memoryLimit;
+    return params;
+}
+
+- (CASCCDExposure*)combine:(NSArray*)exposures params:(CASImageProcessorCombineParams)params
+{
+    CASCCDExposure* firstExposure = [exposures firstObject];
+    for (CASCCDExposure* exposure in exposures){
+        if (exposure.rgba || ![self preflightA:firstExposure b:exposure]){
+            NSLog(@"%@: unsupported",NSStringFromSelector(_cmd));
+            return nil;
+        }
+    }
+    if (!firstExposure){
+        return nil;
+    }
+    
+    const CASSize size = [firstExposure actualSize];
+    const NSInteger pixelCount = size.width * size.height;
+    const size_t frameCount = [exposures count];
+    
+    // exposures that have been reset are read a strip at a time from their samples file rather than being loaded whole,
+    // hold on to the data and paths for the ones we do use so that they outlive the combine
+    NSMutableArray* keepAlive = [NSMutableArray arrayWithCapacity:frameCount];
+    std::vector<CASStackFrame> frames(frameCount);
+    for (size_t i = 0; i < frameCount; ++i){
+        
+        CASCCDExposure* exposure = exposures[i];
+        CASStackFrame& frame = frames[i];
+        frame.format = (exposure.format == kCASCCDExposureFormatFloat) ? kCASStackSampleFloat : kCASStackSampleUInt16;
+        frame.offset = 0;
+        
+        NSURL* samplesURL = exposure.hasPixels ? nil : [exposure.io samplesURL];
+        if (samplesURL){
+            NSString* path = [samplesURL path];
+            [keepAlive addObject:path];
+            frame.pixels = NULL;
+            frame.path = [path fileSystemRepresentation];
+        }
+        else {
+            NSData* pixels = (frame.format == kCASStackSampleFloat) ? exposure.floatPixels : exposure.pixels;
+            if (!pixels){
+                NSLog(@"%@: no pixels for exposure %@",NSStringFromSelector(_cmd),exposure);
+                return nil;
+            }
+            [keepAlive addObject:pixels];
+            frame.pixels = [pixels bytes];
+            frame.path = NULL;
+        }
+    }
+    
+    CASStackCombineParameters parameters = CASStackCombineDefaultParameters((CASStackCombineMode)params.mode);
+    parameters.kappaLow = params.kappaLow;
+    parameters.kappaHigh = params.kappaHigh;
+    parameters.iterations = (int)params.iterations;
+    parameters.memoryLimit = params.memoryLimit;
+    
+    const size_t stripRows = CASStackStripRows(size.width, size.height, frameCount, parameters.memoryLimit);
+    NSMutableData* strip = [CASFramePoolData uninitialisedDataWithLength:stripRows * size.width * frameCount * sizeof(float)];
+    NSMutableData* output = [CASFramePoolData uninitialisedDataWithLength:pixelCount * sizeof(float)];
+    if (![strip mutableBytes] || ![output mutableBytes]){
+        NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    __block BOOL failed = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
+        
+        float* stripPixels = (float*)[strip mutableBytes];
+        float* outputPixels = (float*)[output mutableBytes];
+        const CASStackFrame* stackFrames = frames.data();
+        std::vector<char> stripRead(frameCount);
+        
+        for (NSInteger row = 0; row < size.height; row += stripRows){
+            
+            const size_t rowCount = MIN(stripRows, (size_t)(size.height - row));
+            const size_t planePixels = rowCount * size.width;
+            
+            // each frame gets its own flag, checked once the workers are done
+            CASParallelFor(frameCount, 1, [&](size_t begin, size_t end) {
+                for (size_t f = begin; f < end; ++f){
+                    stripRead[f] = CASStackReadStrip(stackFrames[f],size.width,row,rowCount,stripPixels + f * planePixels);
+                }
+            });
+            if (std::find(stripRead.begin(),stripRead.end(),0) != stripRead.end()){
+                failed = YES;
+                break;
+            }
+            
+            // split into whole blocks so that no two ranges share a block
+            const size_t blockCount = (planePixels + CAS_STACK_COMBINE_BLOCK - 1) / CAS_STACK_COMBINE_BLOCK;
+            CASParallelFor(blockCount, 0, [&](size_t begin, size_t end) {
+                const size_t start = begin * CAS_STACK_COMBINE_BLOCK;
+                CASStackCombineRange(stripPixels,frameCount,planePixels,parameters,outputPixels + row * size.width,start,MIN(end * CAS_STACK_COMBINE_BLOCK, planePixels) - start);
+            });
+        }
+    });
+    
+    if (failed){
+        NSLog(@"%@: failed to read exposure samples",NSStringFromSelector(_cmd));
+        return nil;
+    }
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    return [self resultWithPixels:output floatPixels:YES from:firstExposure];
 }
 
 - (CASCCDExposure*)averageSum:(NSArray*)exposures
@@ -494,7 +1048,7 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
 
     CASCCDExposure* result = [[CASCCDExposure alloc] init];
     
-    result.floatPixels = [NSMutableData dataWithLength:size.width * size.height * sizeof(cas_pixel_t)];
+    result.floatPixels = [CASFramePoolData dataWithLength:size.width * size.height * sizeof(cas_pixel_t)];
     result.params = firstExposure.params;
     
     // check pixels allocated
@@ -502,36 +1056,26 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
     // what params to set ?
     
     // grab the pixel pointers
-    NSInteger index = 0;
-    cas_pixel_t** pixels = (cas_pixel_t**)malloc(sizeof(cas_pixel_t*) * [exposures count]);
+    std::vector<const cas_pixel_t*> pixels;
     for (CASCCDExposure* exposure in exposures){
-        pixels[index++] = (cas_pixel_t*)[exposure.floatPixels bytes];
+        pixels.push_back((const cas_pixel_t*)[exposure.floatPixels bytes]);
     }
     
-    const NSInteger count = [exposures count];
-    const NSInteger groupCount = [self standardGroupSize];
+    const NSInteger count = pixels.size();
     const NSInteger pixelCount = size.width * size.height;
-    const NSInteger pixelsPerGroup = pixelCount / groupCount;
     
     cas_pixel_t* average = (cas_pixel_t*)[result.floatPixels bytes];
+    const cas_pixel_t* const* planes = pixels.data();
     
-    dispatch_apply(groupCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t groupIndex) {
+    CASParallelFor(pixelCount, 0, [&](size_t begin, size_t end) {
         
-        // todo: AVX
-        const NSInteger offset = pixelsPerGroup * groupIndex;
-        const NSInteger pixelsInThisGroup = (groupIndex == groupCount - 1) ? pixelsPerGroup + pixelCount % pixelsPerGroup : pixelsPerGroup;
-        for (NSInteger i = offset; i < pixelsInThisGroup + offset; ++i){
-            
-            CGFloat total = 0;
-            for (NSInteger j = 0; j < index; ++j){
-                total += pixels[j][i];
-            }
-            average[i] = (cas_pixel_t)(total/count);
+        std::vector<const cas_pixel_t*> rangePlanes(count);
+        for (NSInteger j = 0; j < count; ++j){
+            rangePlanes[j] = planes[j] + begin;
         }
+        CASKernels().average(rangePlanes.data(),count,average + begin,end - begin);
     });
     
-    free(pixels);
-    
     NSLog(@"%@: %fs",NSStringFromSelector(_cmd),[NSDate timeIntervalSinceReferenceDate] - start);
     
     return result;
@@ -539,107 +1083,45 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
 
 - (NSArray*)histogram:(CASCCDExposure*)exposure
 {
-    __block NSMutableArray* result = nil;
-
-    const NSTimeInterval time = CASTimeBlock(^{
-        
-        vImage_Buffer buffer = [self vImageBufferForExposure:exposure];
-        
-        const NSInteger count = 256;
-        vImagePixelCount histogram[count];
-        vImageHistogramCalculation_PlanarF(&buffer,histogram,count,0,1,0);
-        
-        result = [NSMutableArray arrayWithCapacity:count];
-        for (NSInteger i = 0; i < count; ++i){
-            [result addObject:[NSNumber numberWithFloat:(float)histogram[i]]];
-        }
-    });
+    // 256 bins summed down from the exposure's cached full resolution histogram
+    NSData* counts = [exposure.histogram floatCountsWithBinCount:256 maximum:NULL];
+    if (!counts){
+        return nil;
+    }
     
-    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    const float* fp = (const float*)[counts bytes];
+    const NSInteger count = [counts length]/sizeof(float);
+    NSMutableArray* result = [NSMutableArray arrayWithCapacity:count];
+    for (NSInteger i = 0; i < count; ++i){
+        [result addObject:[NSNumber numberWithFloat:fp[i]]];
+    }
     
     return [result copy];
 }
 
 - (CGFloat)medianPixelValue:(CASCCDExposure*)exposure
 {
-    float median = 0;
-    
-    if ([exposure.floatPixels length]){
-        float* copy = (float*)malloc([exposure.floatPixels length]);
-        if (copy){
-            memcpy(copy, [exposure.floatPixels bytes], [exposure.floatPixels length]);
-            const size_t count = [exposure.floatPixels length]/sizeof(float);
-            vDSP_vsort(copy,count,1);
-            median = copy[count/2]; // todo; average of two middle values if count is even
-            free(copy);
-        }
-    }
-    
-    return median;
+    return exposure.statistics.median;
 }
 
 - (CGFloat)averagePixelValue:(CASCCDExposure*)exposure
 {
-    float average = 0;
-
-    if (exposure.floatPixels){
-        vDSP_meamgv((float*)[exposure.floatPixels bytes],1,&average,[exposure.floatPixels length]/sizeof(float));
-    }
-
-    return average;
+    return exposure.statistics.mean;
 }
 
 - (CGFloat)minimumPixelValue:(CASCCDExposure*)exposure
 {
-    float min = 0;
-    
-    if (exposure.floatPixels){
-        vDSP_minmgv((float*)[exposure.floatPixels bytes],1,&min,[exposure.floatPixels length]/sizeof(float));
-    }
-    
-    return min;
+    return exposure.statistics.minimum;
 }
 
 - (CGFloat)maximumPixelValue:(CASCCDExposure*)exposure
 {
-    float max = 0;
-    
-    if (exposure.floatPixels){
-        vDSP_maxmgv((float*)[exposure.floatPixels bytes],1,&max,[exposure.floatPixels length]/sizeof(float));
-    }
-    
-    return max;
+    return exposure.statistics.maximum;
 }
 
 - (CGFloat)standardDeviationPixelValue:(CASCCDExposure*)exposure
 {
-    float stdev = 0;
-    
-    if (exposure.floatPixels){
-        
-        NSMutableData* working = [NSMutableData dataWithLength:[exposure.floatPixels length]];
-        if (working){
-            
-            // calculate the average
-            float average = 0;
-            vDSP_meamgv((float*)[exposure.floatPixels bytes],1,&average,[exposure.floatPixels length]/sizeof(float));
-                        
-            // create a vector of signal - mean
-            float minusAverage = -average;
-            vDSP_vsadd((float*)[exposure.floatPixels bytes],1,&minusAverage,(float*)[working mutableBytes],1,[working length]/sizeof(float));
-            
-            // square all the values in the difference vector
-            vDSP_vsq((float*)[working mutableBytes],1,(float*)[working mutableBytes],1,[working length]/sizeof(float));
-            
-            // calculate average
-            vDSP_meamgv((float*)[working mutableBytes],1,&average,[working length]/sizeof(float));
-            
-            // take square root
-            stdev = sqrtf(average);
-        }
-    }
-    
-    return stdev;
+    return exposure.statistics.standardDeviation;
 }
 
 - (CASContrastStretchBounds)linearContrastStretchBoundsForExposure:(CASCCDExposure*)exposure
@@ -647,77 +1129,14 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
                                                         upperLimit:(float)upperLimit
                                                      maxPixelValue:(float)maxPixelValue
 {
-    __block CASContrastStretchBounds result = {0,0,0};
+    CASContrastStretchBounds result = {0,0,0};
     
-    float* pixels = (float*)[exposure.floatPixels bytes];
-    if (pixels){
-
-        const NSTimeInterval time = CASTimeBlock(^{
-            
-            vImage_Buffer buffer = [self vImageBufferForExposure:exposure];
-            
-            const NSInteger binCount = 4096;
-            vImagePixelCount* histogram = (vImagePixelCount*)malloc(sizeof(vImagePixelCount) * binCount);
-            
-            vImageHistogramCalculation_PlanarF(&buffer,histogram,binCount,0,maxPixelValue,kvImageNoFlags);
-            
-            if (0){
-                NSMutableString* s = [NSMutableString new];
-                for (int i = 0; i < binCount; ++i){
-                    [s appendFormat:@"%lu ",histogram[i]];
-                }
-                NSLog(@"%@",s);
-            }
-
-            const CASSize actualSize = exposure.actualSize;
-            const size_t pixelCount = actualSize.width*actualSize.height;
-            
-            const float lowerThreshold = pixelCount * lowerLimit;
-            const float upperThreshold = pixelCount * upperLimit;
-            const float pixelsPerBin = maxPixelValue / (float)binCount;
-            
-            NSUInteger total = 0;
-            result.lower = -1;
-            result.upper = -1;
-            result.maxPixelValue = maxPixelValue;
-            for (NSInteger bin = 0; bin < binCount; ++bin){
-                
-                total += histogram[bin];
-                if (result.lower == -1 && total >= lowerThreshold){
-                    result.lower = bin * pixelsPerBin;
-                }
-                if (result.upper == -1 && total >= upperThreshold){
-                    result.upper = bin * pixelsPerBin;
-                }
-            }
-            
-            if (result.lower == -1){
-                result.lower = 0;
-            }
-            if (result.upper == -1){
-                result.upper = maxPixelValue;
-            }
-            
-            //            NSLog(@"CASFITSPreviewer: lower %ld, upper %ld, pixelsPerBin: %ld",(unsigned long)lower,(unsigned long)upper,pixelsPerBin);
-            
-//            const float scaler = maxPixelValue/(upper - lower);
-//            for (int i = 0; i < pixelCount; ++i){
-//                const float p = pixels[i];
-//                if (p < lower){
-//                    pixels[i] = 0;
-//                }
-//                else if (p > upper){
-//                    pixels[i] = maxPixelValue;
-//                }
-//                else {
-//                    pixels[i] = (p - lower)*scaler;
-//                }
-//            }
-            
-            free(histogram);
-        });
-        
-        NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    // the percentiles come from the exposure's cached histogram so restretching the same exposure is free
+    CASExposureStatistics* statistics = exposure.statistics;
+    if (statistics){
+        result.lower = MAX(0, MIN(maxPixelValue, [statistics percentile:lowerLimit]));
+        result.upper = MAX(0, MIN(maxPixelValue, [statistics percentile:upperLimit]));
+        result.maxPixelValue = maxPixelValue;
     }
     
     return result;
@@ -725,40 +1144,76 @@ typedef struct { float r,g,b,a; } cas_fpixel_t;
 
 - (CASCCDExposure*)rescaleExposure:(CASCCDExposure*)exposure linearContrastStretchBounds:(CASContrastStretchBounds)bounds
 {
-    __block CASCCDExposure* result = [exposure copy];
+    CASCCDExposure* result = [self resultWithEmptyFloatPixelsFrom:exposure];
     if (!result){
         NSLog(@"%@: out of memory",NSStringFromSelector(_cmd));
+        return nil;
     }
-    else{
+    
+    // stretched straight into the result's new pixels
+    __block BOOL success = NO;
+    const NSTimeInterval time = CASTimeBlock(^{
+        NSData* pixels = exposure.floatPixels;
+        success = CASDisplayStretchRescale((const float*)[pixels bytes],(float*)[result.mutableFloatPixels mutableBytes],[pixels length]/sizeof(float),bounds.lower,bounds.upper,bounds.maxPixelValue,CASParallelApply);
+    });
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    if (!success){
+        NSLog(@"%@: invalid bounds %f-%f",NSStringFromSelector(_cmd),bounds.lower,bounds.upper);
+        return nil;
+    }
+    
+    return result;
+}
+
+- (CGImageRef)newDisplayImage:(CASCCDExposure*)exposure linearContrastStretchBounds:(CASContrastStretchBounds)bounds midtone:(float)midtone gamma:(float)gamma
+{
+    const CASSize size = exposure.actualSize;
+    const BOOL rgba = exposure.rgba;
+    const size_t channelCount = rgba ? 4 : 1;
+
+    // 16-bit frames are stretched straight from the camera samples, only processed ones need their float pixels
+    const CASPixels pixels = exposure.samples;
+    if (CASPixelsIsEmpty(pixels) || pixels.width != (size_t)size.width || pixels.height != (size_t)size.height){
+        NSLog(@"%@: no pixels",NSStringFromSelector(_cmd));
+        return NULL;
+    }
+    
+    CGContextRef context = rgba ? [CASCCDImage newRGBBitmapContextWithSize:size] : [CASCCDImage newGrayBitmapContextWithSize:size];
+    uint8_t* data = (uint8_t*)CGBitmapContextGetData(context);
+    if (!data){
+        NSLog(@"%@: failed to create bitmap of size %@",NSStringFromSelector(_cmd),NSStringFromCASSize(size));
+        CGContextRelease(context);
+        return NULL;
+    }
+    
+    __block CGImageRef result = NULL;
+    const NSTimeInterval time = CASTimeBlock(^{
         
-        const NSTimeInterval time = CASTimeBlock(^{
-            
-            float* pixels = (float*)[exposure.floatPixels bytes];
-            if (pixels){
-                
-                const CASSize actualSize = exposure.actualSize;
-                const size_t pixelCount = actualSize.width*actualSize.height;
-                
-                const float scaler = bounds.maxPixelValue/(bounds.upper - bounds.lower);
-                for (int i = 0; i < pixelCount; ++i){
-                    const float p = pixels[i];
-                    if (p < bounds.lower){
-                        pixels[i] = 0;
-                    }
-                    else if (p > bounds.upper){
-                        pixels[i] = bounds.maxPixelValue;
-                    }
-                    else {
-                        pixels[i] = (p - bounds.lower)*scaler;
-                    }
-                }
-            }
-        });
+        std::vector<uint8_t> table(CAS_DISPLAY_STRETCH_TABLE_SIZE);
+        const CASDisplayStretch stretch = CASDisplayStretchMake(bounds.lower,bounds.upper,midtone,gamma);
+        const size_t bytesPerRow = CGBitmapContextGetBytesPerRow(context);
         
-        NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
-    }
+        bool success;
+        if (pixels.format == kCASPixelFormatUInt16){
+            CASDisplayStretchBuildTable(stretch,exposure.maxPixelValue,table.data());
+            success = CASDisplayStretchApplyTable((const uint16_t*)pixels.data,size.width,size.height,channelCount,table.data(),data,bytesPerRow,CASParallelApply);
+        }
+        else {
+            CASDisplayStretchBuildTable(stretch,CAS_PIXEL_UINT16_MAX,table.data());
+            success = CASDisplayStretchApplyTable((const float*)pixels.data,size.width,size.height,channelCount,table.data(),data,bytesPerRow,CASParallelApply);
+        }
+        if (success){
+            result = CGBitmapContextCreateImage(context);
+        }
+    });
+    
+    NSLog(@"%@: %fs",NSStringFromSelector(_cmd),time);
+    
+    CGContextRelease(context);
     
-    return nil;
+    return result;
 }
 
 @end
@@ -8,11 +8,35 @@
 
 #import "CASImageStacker.h"
 #import "CASCCDExposure.h"
+#import "CASColourPlanes.h"
 #import <Accelerate/Accelerate.h>
 
 @implementation CASImageStacker
 
 
+// one plane of the exposure as floats, read straight from the samples when it's planar colour so the RGBA floats are never built
+static const float* CASImageStackerPlane(CASCCDExposure* exposure,NSInteger plane,NSInteger planeCount,float* scratch,NSInteger pixelCount)
+{
+    if (planeCount == 1){
+        NSData* floatPixels = exposure.floatPixels;
+        return ([floatPixels length] < pixelCount*sizeof(float)) ? NULL : (const float*)[floatPixels bytes];
+    }
+    if (exposure.planar){
+        const CASColourPlanesFormat format = (exposure.format == kCASCCDExposureFormatRGBHalf) ? kCASColourPlanesHalf : kCASColourPlanesUInt16;
+        NSData* pixels = exposure.pixels;
+        if ([pixels length] < CASColourPlanesLength(format,pixelCount)){
+            return NULL;
+        }
+        return CASColourPlaneToFloat([pixels bytes],pixelCount,format,plane,scratch) ? scratch : NULL;
+    }
+    NSData* floatPixels = exposure.floatPixels;
+    if ([floatPixels length] < pixelCount*4*sizeof(float)){
+        return NULL;
+    }
+    cblas_scopy((int)pixelCount,(const float*)[floatPixels bytes] + plane,4,scratch,1);
+    return scratch;
+}
+
 - (void)stackWithProvider:(void(^)(NSInteger index,CASCCDExposure** exposure,CASImageStackerInfo* info))provider count:(NSInteger)count block:(void(^)(CASCCDExposure*))block
 {
     NSParameterAssert(provider);
@@ -20,7 +44,11 @@
     NSParameterAssert(count > 1);
 
     CASCCDExposure* first = nil;
+    float* inputData = nil;
     float* outputData = nil;
+    NSInteger planeCount = 1;
+    NSInteger accumulated = 0;
+    BOOL failed = NO;
 
     vImage_Buffer final;
     bzero(&final,sizeof(final));
@@ -39,12 +67,15 @@
         }
         if (!first){
             first = exposure;
+            planeCount = first.rgba ? 3 : 1;
         }
         
         const CASSize size = exposure.actualSize;
+        const NSInteger pixelCount = size.width*size.height;
 
         if (!final.data){
-            final.data = calloc(size.width*size.height*sizeof(float),1);
+            // colour accumulates as 3 float planes rather than RGBA
+            final.data = calloc(planeCount*pixelCount*sizeof(float),1);
             final.width = size.width;
             final.height = size.height;
             final.rowBytes = size.width*sizeof(float);
@@ -61,13 +92,37 @@
             return;
         }
         
-        float* fbuf = (float*)[exposure.floatPixels bytes];
+        if (exposure.rgba != first.rgba){
+            NSLog(@"%@: Ignoring exposure as it doesn't match the colour of the first",NSStringFromSelector(_cmd));
+            continue;
+        }
+        
         if (!outputData){
-            outputData = malloc(size.width*size.height*sizeof(float));
+            outputData = malloc(pixelCount*sizeof(float));
+        }
+        if (!inputData && planeCount > 1){
+            // a scratch plane for each colour so they're all read before any of them are added
+            inputData = malloc(planeCount*pixelCount*sizeof(float));
+        }
+        if (!outputData || (planeCount > 1 && !inputData)){
+            NSLog(@"%@: Out of memory",NSStringFromSelector(_cmd));
+            failed = YES;
+            break;
+        }
+        
+        const float* planes[3] = { NULL, NULL, NULL };
+        BOOL readPlanes = YES;
+        for (NSInteger plane = 0; plane < planeCount && readPlanes; ++plane){
+            planes[plane] = CASImageStackerPlane(exposure,plane,planeCount,inputData + plane*pixelCount,pixelCount);
+            readPlanes = (planes[plane] != NULL);
+        }
+        if (!readPlanes){
+            NSLog(@"%@: Ignoring exposure as its pixels couldn't be read",NSStringFromSelector(_cmd));
+            continue;
         }
         
         vImage_Buffer input = {
-            .data = fbuf,
+            .data = inputData,
             .width = size.width,
             .height = size.height,
             .rowBytes = size.width * sizeof(float)
@@ -105,34 +160,89 @@
             @"uuid":exposure.uuid,@"translate":translateInfo,@"angle":rotateInfo,@"mode":@"average"
          }];
         
-        if (CGAffineTransformIsIdentity(xform)){
-            memcpy(outputData,fbuf,size.width*size.height*sizeof(float));
-        }
-        else {
-            const vImage_AffineTransform vxform = {
-                .a = xform.a, .b = xform.b, .c = xform.c, .d = xform.d,
-                .tx = xform.tx, .ty = xform.ty
-            };
-            vImageAffineWarp_PlanarF(&input, &output, nil, &vxform, 0, kvImageHighQualityResampling);
+        const vImage_AffineTransform vxform = {
+            .a = xform.a, .b = xform.b, .c = xform.c, .d = xform.d,
+            .tx = xform.tx, .ty = xform.ty
+        };
+
+        for (NSInteger plane = 0; plane < planeCount; ++plane){
+            
+            const float* fbuf = planes[plane];
+            float* accumulation = (float*)final.data + plane*pixelCount;
+            
+            // add to accumulation buffer, warping first if needed
+            if (CGAffineTransformIsIdentity(xform)){
+                vDSP_vadd(accumulation,1,fbuf,1,accumulation,1,pixelCount);
+            }
+            else {
+                input.data = (void*)fbuf;
+                vImageAffineWarp_PlanarF(&input, &output, nil, &vxform, 0, kvImageHighQualityResampling);
+                vDSP_vadd(accumulation,1,output.data,1,accumulation,1,pixelCount);
+            }
         }
         
-        // add to accumulation buffer
-        vDSP_vadd(final.data,1,output.data,1,final.data,1,final.width*final.height);
+        ++accumulated;
     }
 
+    if (inputData){
+        free(inputData);
+    }
     if (outputData){
         free(outputData);
     }
     
-    if (final.data){
-        // divide by number of images
-        if (count > 1){
-            float fcount = count;
-            vDSP_vsdiv(final.data,1,(float*)&fcount,final.data,1,final.width*final.height);
+    if (failed || !accumulated){
+        if (!failed){
+            NSLog(@"%@: No exposures to stack",NSStringFromSelector(_cmd));
+        }
+        free(final.data);
+        return;
+    }
+    
+    const NSInteger pixelCount = final.width*final.height;
+
+    // divide by the number of images actually added, skipped ones would otherwise darken the stack
+    if (accumulated > 1){
+        float fcount = accumulated;
+        vDSP_vsdiv(final.data,1,(float*)&fcount,final.data,1,planeCount*pixelCount);
+    }
+    
+    CASCCDExposure* result = nil;
+    if (planeCount == 1){
+        result = [CASCCDExposure exposureWithFloatPixels:[NSData dataWithBytesNoCopy:final.data length:final.height*final.rowBytes freeWhenDone:YES] camera:nil params:first.params time:nil];
+    }
+    else if (first.planar){
+        // keep the stack in the same compact format as its inputs
+        const CASColourPlanesFormat format = (first.format == kCASCCDExposureFormatRGBHalf) ? kCASColourPlanesHalf : kCASColourPlanesUInt16;
+        NSMutableData* planes = [NSMutableData dataWithLength:CASColourPlanesLength(format,pixelCount)];
+        for (NSInteger plane = 0; plane < planeCount && planes; ++plane){
+            if (!CASColourPlaneFromFloat((const float*)final.data + plane*pixelCount,pixelCount,format,plane,[planes mutableBytes])){
+                planes = nil;
+            }
+        }
+        free(final.data);
+        if (planes){
+            result = [CASCCDExposure exposureWithRGBPixels:planes format:first.format camera:nil params:first.params time:nil];
         }
     }
+    else {
+        NSMutableData* rgba = [NSMutableData dataWithLength:pixelCount*4*sizeof(float)];
+        if (rgba){
+            float* p = (float*)[rgba mutableBytes];
+            for (NSInteger plane = 0; plane < planeCount; ++plane){
+                cblas_scopy((int)pixelCount,(const float*)final.data + plane*pixelCount,1,p + plane,4);
+            }
+            const float alpha = 1;
+            vDSP_vfill(&alpha,p + 3,4,pixelCount);
+            result = [CASCCDExposure exposureWithRGBAFloatPixels:rgba camera:nil params:first.params time:nil];
+        }
+        free(final.data);
+    }
     
-    CASCCDExposure* result = [CASCCDExposure exposureWithFloatPixels:[NSData dataWithBytesNoCopy:final.data length:final.height*final.rowBytes freeWhenDone:YES] camera:nil params:first.params time:nil];
+    if (!result){
+        NSLog(@"%@: Out of memory",NSStringFromSelector(_cmd));
+        return;
+    }
     
     NSMutableDictionary* mutableMeta = [NSMutableDictionary dictionaryWithDictionary:result.meta];
     [mutableMeta setObject:@{@"stack":stackHistory} forKey:@"history"];
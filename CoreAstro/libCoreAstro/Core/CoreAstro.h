@@ -36,6 +36,11 @@
 #import <CoreAstro/CASDeviceFactory.h>
 #import <CoreAstro/CASDeviceManager.h>
 #import <CoreAstro/CASImageProcessor.h>
+#import <CoreAstro/CASExposureStatistics.h>
+#import <CoreAstro/CASExposureHistogram.h>
+#import <CoreAstro/CASExposurePyramid.h>
+#import <CoreAstro/CASExposureDefectMap.h>
+#import <CoreAstro/CASExposureBackground.h>
 #import <CoreAstro/CASImageDebayer.h>
 #import <CoreAstro/CASIOCommand.h>
 #import <CoreAstro/CASIOTransport.h>
@@ -56,3 +61,4 @@
 #import <CoreAstro/CASImageMetrics.h>
 #import <CoreAstro/CASFilterPipeline.h>
 #import <CoreAstro/CASExposureSettings.h>
+#import <CoreAstro/CASFramePoolData.h>
@@ -0,0 +1,455 @@
+//
+//  CASBackground.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+#include "CASBackground.h"
+#include <algorithm>
+#include <math.h>
+
+// cells with fewer than this fraction of their samples left after clipping are mostly object, not sky
+#define CAS_BACKGROUND_MIN_KEPT 0.25f
+
+namespace {
+
+void CASBackgroundApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+float CASBackgroundMedian(std::vector<float>& values)
+{
+    const size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    float median = values[middle];
+    if (!(values.size() & 1)){
+        median = (median + *std::max_element(values.begin(), values.begin() + middle)) / 2;
+    }
+    return median;
+}
+
+// fine histogram of the low bytes of the samples in [lower,upper] whose high byte is bin
+void CASBackgroundFine(const std::vector<uint16_t>& samples, uint32_t lower, uint32_t upper, size_t bin, uint32_t* fine)
+{
+    std::fill(fine, fine + 256, 0);
+    for (size_t i = 0; i < samples.size(); ++i){
+        const uint32_t s = samples[i];
+        fine[s & 0xff] += ((s >> 8) == bin);
+    }
+    for (size_t i = 0; i < 256; ++i){
+        const uint32_t value = (uint32_t)((bin << 8) | i);
+        if (value < lower || value > upper){
+            fine[i] = 0;
+        }
+    }
+}
+
+size_t CASBackgroundBin(const uint32_t* histogram, size_t& rank)
+{
+    size_t bin = 0;
+    while (rank >= histogram[bin]){
+        rank -= histogram[bin++];
+    }
+    return bin;
+}
+
+// median of the count samples in [lower,upper] from the coarse histogram of their high bytes and a pass over them
+// for the low bytes within the bin it falls in, the same two level scheme as the median filter uses. even counts
+// average the middle two, which are nearly always in the same bin
+double CASBackgroundMedian(const std::vector<uint16_t>& samples, const uint32_t* coarse, uint32_t lower, uint32_t upper, size_t count)
+{
+    size_t ranks[2] = { (count - 1) / 2, count / 2 };
+    size_t bins[2];
+    for (int r = 0; r < 2; ++r){
+        bins[r] = CASBackgroundBin(coarse, ranks[r]);
+    }
+    
+    uint32_t fine[256];
+    double median = 0;
+    for (int r = 0; r < 2; ++r){
+        if (!r || bins[1] != bins[0]){
+            CASBackgroundFine(samples, lower, upper, bins[r], fine);
+        }
+        median += (double)((bins[r] << 8) | CASBackgroundBin(fine, ranks[r])) / 2;
+    }
+    return median;
+}
+
+// clips the samples about their median until nothing more goes, then estimates the sky as SExtractor does: the mode
+// from 2.5 * median - 1.5 * mean unless the mean and median disagree enough that the cell must be crowded, when the
+// median is safer. samples are 16-bit so every pass is a count rather than a sort and the sums are exact. false if
+// too little sky is left to go on
+bool CASBackgroundCell(const std::vector<uint16_t>& samples, const CASBackgroundParameters& parameters, float& level, float& rms)
+{
+    const size_t initial = samples.size();
+    if (initial < 2){
+        return false;
+    }
+    
+    uint32_t lower = 0, upper = CAS_PIXEL_UINT16_MAX;
+    double median = 0, mean = 0, sigma = 0;
+    for (int iteration = 0;; ++iteration){
+        
+        uint32_t coarse[256] = { 0 };
+        uint64_t sum = 0, sumSquares = 0;
+        uint32_t minimum = CAS_PIXEL_UINT16_MAX, maximum = 0;
+        size_t count = 0;
+        for (size_t i = 0; i < samples.size(); ++i){
+            const uint32_t s = samples[i];
+            if (s >= lower && s <= upper){
+                ++coarse[s >> 8];
+                sum += s;
+                sumSquares += s * s;
+                minimum = std::min(minimum, s);
+                maximum = std::max(maximum, s);
+                ++count;
+            }
+        }
+        if (count < std::max<size_t>(2, initial * CAS_BACKGROUND_MIN_KEPT)){
+            return false;
+        }
+        
+        median = CASBackgroundMedian(samples, coarse, lower, upper, count);
+        mean = (double)sum / count;
+        sigma = sqrt(std::max(0.0, (double)sumSquares / count - mean * mean));
+        
+        if (iteration >= parameters.iterations){
+            break;
+        }
+        const double clip = parameters.clipSigma * sigma;
+        if (median - clip <= minimum && median + clip >= maximum){
+            break;
+        }
+        lower = (uint32_t)std::max(0.0, ceil(median - clip));
+        upper = (uint32_t)std::min<double>(CAS_PIXEL_UINT16_MAX, floor(median + clip));
+    }
+    
+    const double mode = (sigma > 0 && fabs(mean - median) < 0.3 * sigma) ? 2.5 * median - 1.5 * mean : median;
+    level = (float)(mode / CAS_PIXEL_UINT16_MAX);
+    rms = (float)(sigma / CAS_PIXEL_UINT16_MAX);
+    return true;
+}
+
+struct CASBackgroundEstimation {
+    CASPixels frame;
+    CASBackgroundParameters parameters;
+    CASBackground* background;
+    std::vector<uint8_t>* valid;
+    
+    static uint16_t sample(uint16_t s) {
+        return s;
+    }
+    
+    static uint16_t sample(float s) {
+        return (uint16_t)(std::min(1.0f, std::max(0.0f, s)) * CAS_PIXEL_UINT16_MAX + 0.5f);
+    }
+    
+    template <typename T>
+    void gather(size_t cx, size_t cy, std::vector<uint16_t>& samples) const {
+        const size_t meshSize = parameters.meshSize;
+        const size_t right = std::min(frame.width, (cx + 1) * meshSize), bottom = std::min(frame.height, (cy + 1) * meshSize);
+        samples.clear();
+        for (size_t y = cy * meshSize; y < bottom; ++y){
+            const T* row = (const T*)frame.data + y * frame.stride;
+            for (size_t x = cx * meshSize; x < right; ++x){
+                if (row[x] == row[x]){
+                    samples.push_back(sample(row[x]));
+                }
+            }
+        }
+    }
+    
+    static void work(void* context, size_t cy) {
+        const CASBackgroundEstimation& estimation = *(const CASBackgroundEstimation*)context;
+        CASBackground& background = *estimation.background;
+        std::vector<uint16_t> samples;
+        samples.reserve(estimation.parameters.meshSize * estimation.parameters.meshSize);
+        for (size_t cx = 0; cx < background.meshWidth; ++cx){
+            if (estimation.frame.format == kCASPixelFormatUInt16){
+                estimation.gather<uint16_t>(cx, cy, samples);
+            }
+            else {
+                estimation.gather<float>(cx, cy, samples);
+            }
+            const size_t i = cx + cy * background.meshWidth;
+            (*estimation.valid)[i] = CASBackgroundCell(samples, estimation.parameters, background.level[i], background.rms[i]);
+        }
+    }
+};
+
+// cells that were all object take the average of their good neighbours, spreading inwards until every cell has a value
+bool CASBackgroundFill(CASBackground& background, std::vector<uint8_t>& valid)
+{
+    const ptrdiff_t width = background.meshWidth, height = background.meshHeight;
+    if (std::find(valid.begin(), valid.end(), 1) == valid.end()){
+        return false;
+    }
+    
+    std::vector<uint8_t> filled(valid);
+    for (bool missing = true; missing;){
+        missing = false;
+        for (ptrdiff_t y = 0; y < height; ++y){
+            for (ptrdiff_t x = 0; x < width; ++x){
+                const ptrdiff_t i = x + y * width;
+                if (valid[i]){
+                    continue;
+                }
+                double level = 0, rms = 0;
+                int count = 0;
+                for (ptrdiff_t ny = std::max<ptrdiff_t>(0, y - 1); ny <= std::min(height - 1, y + 1); ++ny){
+                    for (ptrdiff_t nx = std::max<ptrdiff_t>(0, x - 1); nx <= std::min(width - 1, x + 1); ++nx){
+                        if (valid[nx + ny * width]){
+                            level += background.level[nx + ny * width];
+                            rms += background.rms[nx + ny * width];
+                            ++count;
+                        }
+                    }
+                }
+                if (count){
+                    background.level[i] = level / count;
+                    background.rms[i] = rms / count;
+                    filled[i] = 1;
+                }
+                else {
+                    missing = true;
+                }
+            }
+        }
+        valid = filled;
+    }
+    return true;
+}
+
+// the window shrinks towards the edges to stay centred on the cell, otherwise a gradient across the frame would pull
+// the edge cells in towards the middle
+void CASBackgroundFilter(std::vector<float>& cells, size_t width, size_t height, size_t filterSize)
+{
+    const ptrdiff_t radius = filterSize / 2;
+    if (!radius){
+        return;
+    }
+    
+    std::vector<float> filtered(cells.size()), window;
+    for (ptrdiff_t y = 0; y < (ptrdiff_t)height; ++y){
+        const ptrdiff_t ry = std::min(radius, std::min<ptrdiff_t>(y, height - 1 - y));
+        for (ptrdiff_t x = 0; x < (ptrdiff_t)width; ++x){
+            const ptrdiff_t rx = std::min(radius, std::min<ptrdiff_t>(x, width - 1 - x));
+            window.clear();
+            for (ptrdiff_t ny = y - ry; ny <= y + ry; ++ny){
+                for (ptrdiff_t nx = x - rx; nx <= x + rx; ++nx){
+                    window.push_back(cells[nx + ny * width]);
+                }
+            }
+            filtered[x + y * width] = CASBackgroundMedian(window);
+        }
+    }
+    cells.swap(filtered);
+}
+
+// Catmull-Rom weights for the four cells around a point t of the way between the middle two
+void CASBackgroundWeights(float t, float* weights)
+{
+    const float t2 = t * t, t3 = t2 * t;
+    weights[0] = 0.5f * (-t3 + 2 * t2 - t);
+    weights[1] = 0.5f * (3 * t3 - 5 * t2 + 2);
+    weights[2] = 0.5f * (-3 * t3 + 4 * t2 + t);
+    weights[3] = 0.5f * (t3 - t2);
+}
+
+// the first of the four cells around pixel coordinate p and the weights for them, held flat past the outer cell centres
+void CASBackgroundTaps(float p, size_t meshSize, size_t count, ptrdiff_t* taps, float* weights)
+{
+    const float u = std::min<float>(count - 1, std::max(0.0f, (p + 0.5f) / meshSize - 0.5f));
+    const ptrdiff_t i = std::min<ptrdiff_t>(count - 1, (ptrdiff_t)u);
+    for (ptrdiff_t k = 0; k < 4; ++k){
+        taps[k] = std::min<ptrdiff_t>(count - 1, std::max<ptrdiff_t>(0, i - 1 + k));
+    }
+    CASBackgroundWeights(u - i, weights);
+}
+
+// interpolates whole rows. pixels between the same pair of cell centres share their four cells so each run of them
+// is a weighted sum of four constants, with the weights worked out once and held a tap at a time
+struct CASBackgroundInterpolator {
+    const CASBackground& background;
+    std::vector<ptrdiff_t> starts;      // first pixel of each run, followed by the width
+    std::vector<ptrdiff_t> taps;        // four per run
+    std::vector<float> weights[4];
+    std::vector<float> column;
+    
+    explicit CASBackgroundInterpolator(const CASBackground& background) : background(background), column(background.meshWidth) {
+        for (int k = 0; k < 4; ++k){
+            weights[k].resize(background.width);
+        }
+        ptrdiff_t t[4], previous = -1;
+        float w[4];
+        for (size_t x = 0; x < background.width; ++x){
+            CASBackgroundTaps(x, background.meshSize, background.meshWidth, t, w);
+            if (t[1] != previous){
+                starts.push_back(x);
+                taps.insert(taps.end(), t, t + 4);
+                previous = t[1];
+            }
+            for (int k = 0; k < 4; ++k){
+                weights[k][x] = w[k];
+            }
+        }
+        starts.push_back(background.width);
+    }
+    
+    void row(const std::vector<float>& cells, size_t y, float* out) {
+        ptrdiff_t rows[4];
+        float w[4];
+        CASBackgroundTaps(y, background.meshSize, background.meshHeight, rows, w);
+        const size_t meshWidth = background.meshWidth;
+        for (size_t cx = 0; cx < meshWidth; ++cx){
+            column[cx] = w[0] * cells[cx + rows[0] * meshWidth] + w[1] * cells[cx + rows[1] * meshWidth] +
+                         w[2] * cells[cx + rows[2] * meshWidth] + w[3] * cells[cx + rows[3] * meshWidth];
+        }
+        const float* w0 = weights[0].data();
+        const float* w1 = weights[1].data();
+        const float* w2 = weights[2].data();
+        const float* w3 = weights[3].data();
+        for (size_t run = 0; run + 1 < starts.size(); ++run){
+            const ptrdiff_t* t = &taps[4 * run];
+            const float c0 = column[t[0]], c1 = column[t[1]], c2 = column[t[2]], c3 = column[t[3]];
+            for (ptrdiff_t x = starts[run]; x < starts[run + 1]; ++x){
+                out[x] = w0[x] * c0 + w1[x] * c1 + w2[x] * c2 + w3[x] * c3;
+            }
+        }
+    }
+};
+
+float CASBackgroundAt(const CASBackground& background, const std::vector<float>& cells, float x, float y)
+{
+    ptrdiff_t columns[4], rows[4];
+    float wx[4], wy[4];
+    CASBackgroundTaps(x, background.meshSize, background.meshWidth, columns, wx);
+    CASBackgroundTaps(y, background.meshSize, background.meshHeight, rows, wy);
+    float value = 0;
+    for (int j = 0; j < 4; ++j){
+        for (int i = 0; i < 4; ++i){
+            value += wy[j] * wx[i] * cells[columns[i] + rows[j] * background.meshWidth];
+        }
+    }
+    return value;
+}
+
+struct CASBackgroundSubtraction {
+    const CASBackground* background;
+    const float* in;
+    float* out;
+    size_t stride;
+    float pedestal;
+    
+    static void work(void* context, size_t index) {
+        const CASBackgroundSubtraction& subtraction = *(const CASBackgroundSubtraction*)context;
+        const CASBackground& background = *subtraction.background;
+        CASBackgroundInterpolator interpolator(background);
+        std::vector<float> level(background.width);
+        const size_t end = std::min(background.height, (index + 1) * CAS_BACKGROUND_BAND);
+        for (size_t y = index * CAS_BACKGROUND_BAND; y < end; ++y){
+            interpolator.row(background.level, y, level.data());
+            const float* in = subtraction.in + y * subtraction.stride;
+            float* out = subtraction.out + y * subtraction.stride;
+            for (size_t x = 0; x < background.width; ++x){
+                out[x] = in[x] - level[x] + subtraction.pedestal;
+            }
+        }
+    }
+};
+
+}
+
+CASBackgroundParameters CASBackgroundDefaultParameters()
+{
+    CASBackgroundParameters parameters = { CAS_BACKGROUND_MESH_SIZE, 3, 3.0f, 10 };
+    return parameters;
+}
+
+bool CASBackgroundEstimate(const CASPixels& frame, const CASBackgroundParameters& parameters, CASBackground& background, CASBackgroundApply apply)
+{
+    if (CASPixelsIsEmpty(frame) || (frame.format != kCASPixelFormatUInt16 && frame.format != kCASPixelFormatFloat) || !parameters.meshSize || !parameters.filterSize){
+        return false;
+    }
+    
+    background.width = frame.width;
+    background.height = frame.height;
+    background.meshSize = parameters.meshSize;
+    background.meshWidth = (frame.width + parameters.meshSize - 1) / parameters.meshSize;
+    background.meshHeight = (frame.height + parameters.meshSize - 1) / parameters.meshSize;
+    background.level.assign(background.meshWidth * background.meshHeight, 0.0f);
+    background.rms.assign(background.meshWidth * background.meshHeight, 0.0f);
+    
+    std::vector<uint8_t> valid(background.level.size());
+    CASBackgroundEstimation estimation = { frame, parameters, &background, &valid };
+    (apply ? apply : CASBackgroundApplyInOrder)(background.meshHeight, &estimation, CASBackgroundEstimation::work);
+    
+    if (!CASBackgroundFill(background, valid)){
+        return false;
+    }
+    
+    CASBackgroundFilter(background.level, background.meshWidth, background.meshHeight, parameters.filterSize);
+    CASBackgroundFilter(background.rms, background.meshWidth, background.meshHeight, parameters.filterSize);
+    
+    std::vector<float> cells(background.level);
+    background.globalLevel = CASBackgroundMedian(cells);
+    cells = background.rms;
+    background.globalRMS = CASBackgroundMedian(cells);
+    
+    return true;
+}
+
+void CASBackgroundRow(const CASBackground& background, size_t y, float* level, float* rms)
+{
+    if (y >= background.height || background.level.empty()){
+        return;
+    }
+    CASBackgroundInterpolator interpolator(background);
+    if (level){
+        interpolator.row(background.level, y, level);
+    }
+    if (rms){
+        interpolator.row(background.rms, y, rms);
+    }
+}
+
+float CASBackgroundLevelAt(const CASBackground& background, float x, float y)
+{
+    return background.level.empty() ? 0 : CASBackgroundAt(background, background.level, x, y);
+}
+
+float CASBackgroundRMSAt(const CASBackground& background, float x, float y)
+{
+    return background.rms.empty() ? 0 : CASBackgroundAt(background, background.rms, x, y);
+}
+
+bool CASBackgroundSubtract(const CASBackground& background, const float* in, float* out, size_t stride, float pedestal, CASBackgroundApply apply)
+{
+    if (!in || !out || background.level.empty() || stride < background.width){
+        return false;
+    }
+    
+    CASBackgroundSubtraction subtraction = { &background, in, out, stride, pedestal };
+    (apply ? apply : CASBackgroundApplyInOrder)((background.height + CAS_BACKGROUND_BAND - 1) / CAS_BACKGROUND_BAND, &subtraction, CASBackgroundSubtraction::work);
+    return true;
+}
@@ -0,0 +1,77 @@
+//
+//  CASBackground.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Sky background and noise maps in the manner of SExtractor. The frame is split into a mesh of cells,
+//  each cell's samples are sigma clipped about their median to leave the sky, the mesh is median filtered
+//  to take out cells still dominated by a bright star or galaxy and then interpolated back up to full
+//  resolution with bicubic splines through the cell centres. The level and RMS maps are shared by background
+//  subtraction, the HFD and normalising frames for stacking.
+
+#ifndef __CASBackground_h__
+#define __CASBackground_h__
+
+#include "CASPixelView.h"
+#include <vector>
+
+// cells are this many pixels across, the last row and column of cells take whatever's left over
+#define CAS_BACKGROUND_MESH_SIZE 64
+
+// rows of output per unit of work when interpolating back to full resolution
+#define CAS_BACKGROUND_BAND 64
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order on the calling thread
+typedef void (*CASBackgroundApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+struct CASBackgroundParameters {
+    size_t meshSize;        // pixels along the side of a cell
+    size_t filterSize;      // cells across the median filter run over the mesh, 1 for none
+    float clipSigma;        // samples further than this many standard deviations from the median are clipped
+    int iterations;         // clipping passes at most, it usually stops sooner once nothing more is clipped
+};
+
+// 64 pixel cells, 3x3 filter, 3 sigma and 10 passes
+CASBackgroundParameters CASBackgroundDefaultParameters();
+
+// level and rms are in the same 0-1 units as exposures, one value per cell in rows of meshWidth
+struct CASBackground {
+    size_t width, height;
+    size_t meshSize, meshWidth, meshHeight;
+    std::vector<float> level;
+    std::vector<float> rms;
+    float globalLevel, globalRMS;   // medians over the cells
+};
+
+// mono 16-bit or float frames, NaNs are ignored. false for anything else or if there are no samples
+bool CASBackgroundEstimate(const CASPixels& frame, const CASBackgroundParameters& parameters, CASBackground& background, CASBackgroundApply apply = NULL);
+
+// row y of the level and rms at full resolution, either may be NULL
+void CASBackgroundRow(const CASBackground& background, size_t y, float* level, float* rms);
+
+float CASBackgroundLevelAt(const CASBackground& background, float x, float y);
+float CASBackgroundRMSAt(const CASBackground& background, float x, float y);
+
+// out = in - level + pedestal for a float frame the size the background was estimated at, out may be in
+bool CASBackgroundSubtract(const CASBackground& background, const float* in, float* out, size_t stride, float pedestal, CASBackgroundApply apply = NULL);
+
+#endif
@@ -0,0 +1,241 @@
+//
+//  CASCLAHE.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+#include "CASCLAHE.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+void CASCLAHEApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+// where a sample falls along the histogram in bins, 0 to CAS_CLAHE_BINS
+inline float CASCLAHEPosition(uint16_t value)
+{
+    return value * (CAS_CLAHE_BINS / (float)CAS_PIXEL_UINT16_MAX);
+}
+
+inline float CASCLAHEPosition(float value)
+{
+    return value > 0 ? (value < 1 ? value * CAS_CLAHE_BINS : CAS_CLAHE_BINS) : 0; // NaNs fail the first test
+}
+
+inline size_t CASCLAHEBin(float position)
+{
+    const size_t bin = (size_t)position;
+    return bin < CAS_CLAHE_BINS ? bin : CAS_CLAHE_BINS - 1;
+}
+
+// for each pixel along an axis the tiles whose centres are either side of it and how far it is from the first to the
+// second. pixels outside the outer centres only use the outer tile
+void CASCLAHEAxis(const std::vector<size_t>& edges, size_t count, uint32_t* first, uint32_t* second, float* weight)
+{
+    const size_t tiles = edges.size() - 1;
+    std::vector<float> centres(tiles);
+    for (size_t t = 0; t < tiles; ++t){
+        centres[t] = (edges[t] + edges[t + 1]) / 2.0f;
+    }
+    size_t t = 0;
+    for (size_t i = 0; i < count; ++i){
+        const float p = i + 0.5f;
+        while (t + 1 < tiles && centres[t + 1] <= p){
+            ++t;
+        }
+        if (p <= centres[t] || t + 1 == tiles){
+            first[i] = second[i] = (uint32_t)t;
+            weight[i] = 0;
+        }
+        else {
+            first[i] = (uint32_t)t;
+            second[i] = (uint32_t)(t + 1);
+            weight[i] = (p - centres[t]) / (centres[t + 1] - centres[t]);
+        }
+    }
+}
+
+struct CASCLAHEMapping {
+    
+    CASPixels frame;
+    float clipLimit;
+    size_t tilesX, tilesY;
+    std::vector<size_t> edgesX, edgesY;
+    std::vector<float> curves;          // CAS_CLAHE_BINS + 1 cumulative fractions per tile, tiles in rows
+    std::vector<uint32_t> left, right;  // per column, offsets of the curves either side within a row of tiles
+    std::vector<float> across;          // per column, weight of the right hand curve
+    std::vector<uint32_t> top, bottom;  // per row, the rows of tiles above and below
+    std::vector<float> down;            // per row, weight of the lower row of tiles
+    float* out;
+    size_t outStride;
+    
+    template <typename T>
+    void curve(size_t tile) {
+        
+        const size_t tx = tile % tilesX, ty = tile / tilesX;
+        const size_t x0 = edgesX[tx], x1 = edgesX[tx + 1], y0 = edgesY[ty], y1 = edgesY[ty + 1];
+        const size_t count = (x1 - x0) * (y1 - y0);
+        
+        uint32_t histogram[CAS_CLAHE_BINS];
+        std::fill(histogram, histogram + CAS_CLAHE_BINS, 0);
+        for (size_t y = y0; y < y1; ++y){
+            const T* row = (const T*)frame.data + y * frame.stride;
+            for (size_t x = x0; x < x1; ++x){
+                ++histogram[CASCLAHEBin(CASCLAHEPosition(row[x]))];
+            }
+        }
+        
+        // clip and spread what was clipped evenly, fractionally rather than piling the remainder into some bins
+        double excess = 0;
+        if (clipLimit > 0){
+            const uint32_t limit = std::max<uint32_t>(1, (uint32_t)(clipLimit * count / CAS_CLAHE_BINS));
+            for (size_t i = 0; i < CAS_CLAHE_BINS; ++i){
+                if (histogram[i] > limit){
+                    excess += histogram[i] - limit;
+                    histogram[i] = limit;
+                }
+            }
+        }
+        const double spread = excess / CAS_CLAHE_BINS, scale = 1.0 / count;
+        
+        float* c = &curves[tile * (CAS_CLAHE_BINS + 1)];
+        double sum = 0;
+        c[0] = 0;
+        for (size_t i = 0; i < CAS_CLAHE_BINS; ++i){
+            sum += histogram[i] + spread;
+            c[i + 1] = (float)std::min(1.0, sum * scale);
+        }
+    }
+    
+    static void curveWork(void* context, size_t tile) {
+        CASCLAHEMapping& mapping = *(CASCLAHEMapping*)context;
+        if (mapping.frame.format == kCASPixelFormatUInt16){
+            mapping.curve<uint16_t>(tile);
+        }
+        else {
+            mapping.curve<float>(tile);
+        }
+    }
+    
+    template <typename T>
+    void map(size_t band) const {
+        
+        const size_t y0 = band * CAS_CLAHE_BAND, y1 = std::min(frame.height, y0 + CAS_CLAHE_BAND);
+        
+        const size_t curveSize = CAS_CLAHE_BINS + 1;
+        for (size_t y = y0; y < y1; ++y){
+            
+            const T* row = (const T*)frame.data + y * frame.stride;
+            float* o = out + y * outStride;
+            const float* upper = &curves[top[y] * tilesX * curveSize];
+            const float* lower = &curves[bottom[y] * tilesX * curveSize];
+            const float wy = down[y];
+            
+            for (size_t x = 0; x < frame.width; ++x){
+                const float p = CASCLAHEPosition(row[x]);
+                const size_t bin = CASCLAHEBin(p);
+                const float f = p - bin;
+                const float* ul = upper + left[x] + bin;
+                const float* ur = upper + right[x] + bin;
+                const float* ll = lower + left[x] + bin;
+                const float* lr = lower + right[x] + bin;
+                const float u = ul[0] + (ul[1] - ul[0]) * f, v = ur[0] + (ur[1] - ur[0]) * f;
+                const float l = ll[0] + (ll[1] - ll[0]) * f, m = lr[0] + (lr[1] - lr[0]) * f;
+                const float wx = across[x];
+                const float a = u + (v - u) * wx, b = l + (m - l) * wx;
+                o[x] = a + (b - a) * wy;
+            }
+        }
+    }
+    
+    static void mapWork(void* context, size_t band) {
+        const CASCLAHEMapping& mapping = *(const CASCLAHEMapping*)context;
+        if (mapping.frame.format == kCASPixelFormatUInt16){
+            mapping.map<uint16_t>(band);
+        }
+        else {
+            mapping.map<float>(band);
+        }
+    }
+};
+
+std::vector<size_t> CASCLAHEEdges(size_t length, size_t tiles)
+{
+    std::vector<size_t> edges(tiles + 1);
+    for (size_t t = 0; t <= tiles; ++t){
+        edges[t] = t * length / tiles;
+    }
+    return edges;
+}
+
+}
+
+CASCLAHEParameters CASCLAHEDefaultParameters()
+{
+    CASCLAHEParameters parameters = { 8, 8, 40 };
+    return parameters;
+}
+
+bool CASCLAHE(const CASPixels& frame, const CASCLAHEParameters& parameters, float* out, size_t outStride, CASCLAHEApply apply)
+{
+    if (CASPixelsIsEmpty(frame) || (frame.format != kCASPixelFormatUInt16 && frame.format != kCASPixelFormatFloat) || !out || outStride < frame.width){
+        return false;
+    }
+    
+    if (!apply){
+        apply = CASCLAHEApplyInOrder;
+    }
+    
+    CASCLAHEMapping mapping;
+    mapping.frame = frame;
+    mapping.clipLimit = parameters.clipLimit;
+    mapping.tilesX = std::min(std::max<size_t>(parameters.tilesX, 1), frame.width);
+    mapping.tilesY = std::min(std::max<size_t>(parameters.tilesY, 1), frame.height);
+    mapping.edgesX = CASCLAHEEdges(frame.width, mapping.tilesX);
+    mapping.edgesY = CASCLAHEEdges(frame.height, mapping.tilesY);
+    mapping.curves.resize(mapping.tilesX * mapping.tilesY * (CAS_CLAHE_BINS + 1));
+    mapping.out = out;
+    mapping.outStride = outStride;
+    
+    // the column weights are the same on every row and the row weights on every column so work them out once
+    mapping.left.resize(frame.width);
+    mapping.right.resize(frame.width);
+    mapping.across.resize(frame.width);
+    CASCLAHEAxis(mapping.edgesX, frame.width, mapping.left.data(), mapping.right.data(), mapping.across.data());
+    for (size_t x = 0; x < frame.width; ++x){
+        mapping.left[x] *= CAS_CLAHE_BINS + 1;
+        mapping.right[x] *= CAS_CLAHE_BINS + 1;
+    }
+    mapping.top.resize(frame.height);
+    mapping.bottom.resize(frame.height);
+    mapping.down.resize(frame.height);
+    CASCLAHEAxis(mapping.edgesY, frame.height, mapping.top.data(), mapping.bottom.data(), mapping.down.data());
+    
+    apply(mapping.tilesX * mapping.tilesY, &mapping, CASCLAHEMapping::curveWork);
+    apply((frame.height + CAS_CLAHE_BAND - 1) / CAS_CLAHE_BAND, &mapping, CASCLAHEMapping::mapWork);
+    
+    return true;
+}
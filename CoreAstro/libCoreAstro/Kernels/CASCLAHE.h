@@ -0,0 +1,57 @@
+//
+//  CASCLAHE.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Contrast limited adaptive histogram equalisation for previews, after OpenCV's CLAHE but on 16-bit and float
+//  frames directly. The frame is split into a grid of tiles, each tile's histogram is clipped at a multiple of
+//  its mean bin count with the excess spread back over every bin and turned into a cumulative mapping, and each
+//  pixel is mapped through the four nearest tiles' curves weighted by its distance from their centres. Unlike
+//  global equalisation faint nebulosity in one part of the frame isn't flattened by a bright core elsewhere.
+
+#ifndef __CASCLAHE_h__
+#define __CASCLAHE_h__
+
+#include "CASPixelView.h"
+
+// histogram bins per tile, the same resolution as the global equalisation
+#define CAS_CLAHE_BINS 4096
+
+// rows of output per unit of work when mapping
+#define CAS_CLAHE_BAND 64
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order on the calling thread
+typedef void (*CASCLAHEApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+struct CASCLAHEParameters {
+    size_t tilesX, tilesY;  // tiles across and down, clamped to the frame size
+    float clipLimit;        // bins are clipped at this multiple of their mean count, which caps how steep the mapping gets, 0 for plain adaptive equalisation
+};
+
+// 8x8 tiles clipped at 40 times the mean, as OpenCV
+CASCLAHEParameters CASCLAHEDefaultParameters();
+
+// mono 16-bit or float frames, float samples are clamped to 0-1 and NaNs taken as 0. out gets 0-1 floats in rows
+// outStride floats apart. false for anything else
+bool CASCLAHE(const CASPixels& frame, const CASCLAHEParameters& parameters, float* out, size_t outStride, CASCLAHEApply apply = NULL);
+
+#endif
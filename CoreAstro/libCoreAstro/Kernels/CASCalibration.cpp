@@ -0,0 +1,80 @@
+//
+//  CASCalibration.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASCalibration.h"
+#include "CASPixelView.h"
+
+static const float* CASCalibrationLightOffset(const CASCalibrationMasters& masters)
+{
+    return masters.dark ? masters.dark : masters.bias;
+}
+
+static const float* CASCalibrationFlatOffset(const CASCalibrationMasters& masters)
+{
+    return masters.bias ? masters.bias : masters.dark;
+}
+
+double CASCalibrationFlatTotal(const CASCalibrationMasters& masters, size_t start, size_t count)
+{
+    if (!masters.flat){
+        return 0;
+    }
+    
+    const CASKernelTable& kernels = CASKernels();
+    double total = kernels.sum(masters.flat + start, count);
+    const float* flatOffset = CASCalibrationFlatOffset(masters);
+    if (flatOffset){
+        total -= kernels.sum(flatOffset + start, count);
+    }
+    return total;
+}
+
+CASCalibrationStatistics CASCalibrationStatisticsForMasters(const CASCalibrationMasters& masters)
+{
+    CASCalibrationStatistics statistics = { 0 };
+    if (masters.flat && masters.count){
+        statistics.flatMean = CASCalibrationFlatTotal(masters, 0, masters.count) / masters.count;
+    }
+    return statistics;
+}
+
+void CASCalibrateRange(const float* light, const CASCalibrationMasters& masters, const CASCalibrationStatistics& statistics, float* out, size_t start, size_t count)
+{
+    const float* offset = CASCalibrationLightOffset(masters);
+    const float* flatOffset = CASCalibrationFlatOffset(masters);
+    
+    CASKernels().calibrate(light + start,
+                           offset ? offset + start : NULL,
+                           masters.flat ? masters.flat + start : NULL,
+                           (masters.flat && flatOffset) ? flatOffset + start : NULL,
+                           statistics.flatMean,
+                           out + start,
+                           count);
+}
+
+void CASCalibrateRange(const uint16_t* light, const CASCalibrationMasters& masters, const CASCalibrationStatistics& statistics, float* out, size_t start, size_t count)
+{
+    CASKernels().widenU16(light + start, CAS_PIXEL_UINT16_MAX, out + start, count);
+    CASCalibrateRange(out, masters, statistics, out, start, count);
+}
@@ -0,0 +1,69 @@
+//
+//  CASCalibration.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Fused bias/dark/flat calibration. The master frame statistics are computed once
+//  up front, after which each light is calibrated tile by tile in a single pass that
+//  reads the light and master tiles together and writes straight to the output.
+
+#ifndef __CASCalibration_h__
+#define __CASCalibration_h__
+
+#include "CASKernels.h"
+
+// pixels per calibration tile, with four inputs and one output this keeps a tile's working set around 1.25MB
+#define CAS_CALIBRATION_TILE_PIXELS (64*1024)
+
+// any of the masters may be NULL. the dark is assumed to include the bias signal so lights have
+// the dark subtracted if there is one and the bias otherwise, while the flat is bias subtracted
+// in preference to dark subtracted as flat exposures are usually too short to collect dark current
+struct CASCalibrationMasters {
+    const float* bias;
+    const float* dark;
+    const float* flat;
+    size_t count;
+};
+
+struct CASCalibrationStatistics {
+    double flatMean; // mean of the offset subtracted flat, 0 if there's no flat
+};
+
+// sum of the offset subtracted flat over [start,start+count), in double precision so that tile totals can be combined
+double CASCalibrationFlatTotal(const CASCalibrationMasters& masters, size_t start, size_t count);
+
+// convenience single threaded version of the above over the whole frame
+CASCalibrationStatistics CASCalibrationStatisticsForMasters(const CASCalibrationMasters& masters);
+
+// calibrates light[start,start+count) into out[start,start+count), out may be the same buffer as light
+void CASCalibrateRange(const float* light, const CASCalibrationMasters& masters, const CASCalibrationStatistics& statistics, float* out, size_t start, size_t count);
+
+// the same straight from 16-bit camera samples, each tile is widened to 0-1 floats in out and calibrated in place
+// so the light never has to be expanded to floats as a whole
+void CASCalibrateRange(const uint16_t* light, const CASCalibrationMasters& masters, const CASCalibrationStatistics& statistics, float* out, size_t start, size_t count);
+
+inline size_t CASCalibrationTileCount(size_t count)
+{
+    return (count + CAS_CALIBRATION_TILE_PIXELS - 1) / CAS_CALIBRATION_TILE_PIXELS;
+}
+
+#endif
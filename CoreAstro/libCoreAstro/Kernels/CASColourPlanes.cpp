@@ -0,0 +1,222 @@
+//
+//  CASColourPlanes.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#include "CASColourPlanes.h"
+#include "CASPixelView.h"
+#include "CASParallel.h"
+#include <algorithm>
+#include <string.h>
+
+uint16_t CASHalfFromFloat(float value)
+{
+    uint32_t f;
+    memcpy(&f, &value, sizeof f);
+    const uint32_t sign = (f >> 16) & 0x8000;
+    f &= 0x7fffffff;
+    
+    uint32_t h;
+    if (f >= (127 + 16) << 23){
+        // too big for a half, or already an infinity or NaN
+        h = (f > 0x7f800000) ? 0x7e00 : 0x7c00;
+    }
+    else if (f < (127 - 14) << 23){
+        // subnormal or zero, adding the magic number has the FPU round the mantissa into the bottom bits
+        const uint32_t magic = (127 - 15 + 23 - 10 + 1) << 23;
+        float m, r;
+        memcpy(&m, &magic, sizeof m);
+        memcpy(&r, &f, sizeof r);
+        r += m;
+        memcpy(&h, &r, sizeof h);
+        h -= magic;
+    }
+    else {
+        // rebias the exponent and round the 13 bits that go to nearest, ties to the even mantissa
+        const uint32_t odd = (f >> 13) & 1;
+        f += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+        h = f >> 13;
+    }
+    return (uint16_t)(h | sign);
+}
+
+float CASFloatFromHalf(uint16_t half)
+{
+    const uint32_t exponent = half & 0x7c00;
+    uint32_t f = (uint32_t)(half & 0x7fff) << 13;
+    if (exponent == 0x7c00){
+        f += (uint32_t)(255 - 31) << 23;
+    }
+    else if (exponent == 0){
+        // subnormal, normalised by letting the FPU take the implicit bit back off
+        const uint32_t magic = 113 << 23;
+        f += magic;
+        float m, r;
+        memcpy(&m, &magic, sizeof m);
+        memcpy(&r, &f, sizeof r);
+        r -= m;
+        memcpy(&f, &r, sizeof f);
+    }
+    else {
+        f += (uint32_t)(127 - 15) << 23;
+    }
+    f |= (uint32_t)(half & 0x8000) << 16;
+    
+    float value;
+    memcpy(&value, &f, sizeof value);
+    return value;
+}
+
+size_t CASColourPlanesLength(CASColourPlanesFormat format, size_t count)
+{
+    (void)format; // both are 16-bit
+    return 3 * count * sizeof(uint16_t);
+}
+
+namespace {
+
+// an RGBA pixel loaded or stored in one go, only float aligned as rows of RGBA floats needn't be any more than that
+typedef float CASColourPlanesRGBA __attribute__((vector_size(4 * sizeof(float)), aligned(sizeof(float))));
+
+struct CASColourSampleUInt16 {
+    static float toFloat(uint16_t sample) { return CASPixelTraits<uint16_t>::toFloat(sample); }
+    static uint16_t fromFloat(float value) { return (uint16_t)(std::min(1.0f, std::max(0.0f, value)) * CAS_PIXEL_UINT16_MAX + 0.5f); }
+};
+
+struct CASColourSampleHalf {
+    static float toFloat(uint16_t sample) { return CASFloatFromHalf(sample); }
+    static uint16_t fromFloat(float value) { return CASHalfFromFloat(value); }
+};
+
+template <typename Sample>
+void CASColourPlanesFromRGBA(const float* rgba, size_t count, uint16_t* planes, size_t begin, size_t end)
+{
+    uint16_t* r = planes;
+    uint16_t* g = planes + count;
+    uint16_t* b = planes + 2 * count;
+    for (size_t i = begin; i < end; ++i){
+        const float* p = rgba + i * 4;
+        r[i] = Sample::fromFloat(p[0]);
+        g[i] = Sample::fromFloat(p[1]);
+        b[i] = Sample::fromFloat(p[2]);
+    }
+}
+
+// rgba holds the pixels from start on
+template <typename Sample>
+void CASColourPlanesToRGBA(const uint16_t* planes, size_t count, float* rgba, size_t start, size_t begin, size_t end)
+{
+    const uint16_t* r = planes;
+    const uint16_t* g = planes + count;
+    const uint16_t* b = planes + 2 * count;
+    for (size_t i = begin; i < end; ++i){
+        const CASColourPlanesRGBA p = { Sample::toFloat(r[i]), Sample::toFloat(g[i]), Sample::toFloat(b[i]), 1 };
+        *(CASColourPlanesRGBA*)(rgba + (i - start) * 4) = p;
+    }
+}
+
+template <typename Sample>
+void CASColourPlaneToFloat(const uint16_t* plane, float* out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i){
+        out[i] = Sample::toFloat(plane[i]);
+    }
+}
+
+template <typename Sample>
+void CASColourPlaneFromFloat(const float* in, uint16_t* plane, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i){
+        plane[i] = Sample::fromFloat(in[i]);
+    }
+}
+
+enum CASColourPlanesOperation {
+    kCASColourPlanesFromRGBA,
+    kCASColourPlanesToRGBA,
+    kCASColourPlaneToFloat,
+    kCASColourPlaneFromFloat
+};
+
+template <typename Sample>
+void CASColourPlanesRun(CASColourPlanesOperation operation, const void* in, void* out, size_t count, size_t plane, size_t start, size_t begin, size_t end)
+{
+    switch (operation) {
+        case kCASColourPlanesFromRGBA:
+            CASColourPlanesFromRGBA<Sample>((const float*)in, count, (uint16_t*)out, begin, end);
+            break;
+        case kCASColourPlanesToRGBA:
+            CASColourPlanesToRGBA<Sample>((const uint16_t*)in, count, (float*)out, start, begin, end);
+            break;
+        case kCASColourPlaneToFloat:
+            CASColourPlaneToFloat<Sample>((const uint16_t*)in + plane * count, (float*)out, begin, end);
+            break;
+        case kCASColourPlaneFromFloat:
+            CASColourPlaneFromFloat<Sample>((const float*)in, (uint16_t*)out + plane * count, begin, end);
+            break;
+    }
+}
+
+// runs the operation over pixels [start,start + length) of count
+bool CASColourPlanesRun(CASColourPlanesOperation operation, CASColourPlanesFormat format, const void* in, void* out, size_t count, size_t plane, size_t start, size_t length)
+{
+    if (!in || !out || !length || start > count || length > count - start || plane > 2 || (format != kCASColourPlanesUInt16 && format != kCASColourPlanesHalf)){
+        return false;
+    }
+    CASParallelFor(length, CAS_COLOUR_PLANES_CHUNK_PIXELS, [&](size_t begin, size_t end){
+        if (format == kCASColourPlanesHalf){
+            CASColourPlanesRun<CASColourSampleHalf>(operation, in, out, count, plane, start, start + begin, start + end);
+        }
+        else {
+            CASColourPlanesRun<CASColourSampleUInt16>(operation, in, out, count, plane, start, start + begin, start + end);
+        }
+    });
+    return true;
+}
+
+}
+
+bool CASColourPlanesFromRGBA(const float* rgba, size_t count, CASColourPlanesFormat format, void* planes)
+{
+    return CASColourPlanesRun(kCASColourPlanesFromRGBA, format, rgba, planes, count, 0, 0, count);
+}
+
+bool CASColourPlanesToRGBA(const void* planes, size_t count, CASColourPlanesFormat format, float* rgba)
+{
+    return CASColourPlanesRun(kCASColourPlanesToRGBA, format, planes, rgba, count, 0, 0, count);
+}
+
+bool CASColourPlanesRangeToRGBA(const void* planes, size_t count, CASColourPlanesFormat format, size_t start, size_t length, float* rgba)
+{
+    return CASColourPlanesRun(kCASColourPlanesToRGBA, format, planes, rgba, count, 0, start, length);
+}
+
+bool CASColourPlaneToFloat(const void* planes, size_t count, CASColourPlanesFormat format, size_t plane, float* out)
+{
+    return CASColourPlanesRun(kCASColourPlaneToFloat, format, planes, out, count, plane, 0, count);
+}
+
+bool CASColourPlaneFromFloat(const float* in, size_t count, CASColourPlanesFormat format, size_t plane, void* planes)
+{
+    return CASColourPlanesRun(kCASColourPlaneFromFloat, format, in, planes, count, plane, 0, count);
+}
@@ -0,0 +1,78 @@
+//
+//  CASColourPlanes.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Colour frames held as three planes of red, green and blue samples rather than RGBA floats, either 16-bit
+//  scaled as exposures scale them or IEEE half precision floats. Both are 6 bytes a pixel against 16 for RGBA
+//  with its constant alpha, so debayered frames and colour stacks take three eighths of the memory. They're
+//  expanded to RGBA for display, or a plane at a time for processing that works on one channel. Plain C so the
+//  Objective-C side can call it, each conversion runs over chunks of pixels in parallel.
+
+
+#ifndef __CASColourPlanes_h__
+#define __CASColourPlanes_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+// pixels per unit of parallel work
+#define CAS_COLOUR_PLANES_CHUNK_PIXELS (256*1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    kCASColourPlanesUInt16,
+    kCASColourPlanesHalf
+} CASColourPlanesFormat;
+
+// IEEE 754 binary16, rounding to nearest even. values too big for a half become infinities and NaNs stay NaNs
+uint16_t CASHalfFromFloat(float value);
+float CASFloatFromHalf(uint16_t half);
+
+// bytes for the three planes of count pixels
+size_t CASColourPlanesLength(CASColourPlanesFormat format, size_t count);
+
+// count RGBA pixels into the planes, red then green then blue each count samples long, dropping alpha. 16-bit
+// samples are clamped to 0-1 and rounded, halves keep values outside it
+bool CASColourPlanesFromRGBA(const float* rgba, size_t count, CASColourPlanesFormat format, void* planes);
+
+// and back again with an alpha of 1
+bool CASColourPlanesToRGBA(const void* planes, size_t count, CASColourPlanesFormat format, float* rgba);
+
+// the same for pixels [start,start + length) of the planes into length RGBA pixels, to expand a strip at a time
+bool CASColourPlanesRangeToRGBA(const void* planes, size_t count, CASColourPlanesFormat format, size_t start, size_t length, float* rgba);
+
+// one of the planes, 0 for red to 2 for blue, to or from count floats
+bool CASColourPlaneToFloat(const void* planes, size_t count, CASColourPlanesFormat format, size_t plane, float* out);
+bool CASColourPlaneFromFloat(const float* in, size_t count, CASColourPlanesFormat format, size_t plane, void* planes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
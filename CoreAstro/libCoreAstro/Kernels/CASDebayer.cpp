@@ -0,0 +1,711 @@
+//
+//  CASDebayer.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#include "CASDebayer.h"
+#include <algorithm>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+
+namespace {
+
+// an RGBA pixel written with a single store, only float aligned as rows of RGBA floats needn't be any more than that
+typedef float CASDebayerRGBA __attribute__((vector_size(4 * sizeof(float)), aligned(sizeof(float))));
+
+// reflects coordinates one off either end of the frame back onto the sample two along, which is the same colour
+inline size_t CASDebayerReflect(ptrdiff_t c, size_t limit)
+{
+    if (c < 0){
+        return (limit > 1) ? 1 : 0;
+    }
+    if ((size_t)c >= limit){
+        return (limit > 1) ? limit - 2 : 0;
+    }
+    return c;
+}
+
+// what's written for each pixel. RGBA with white balance for previews, each channel scaled and clamped to 0-1, or as
+// it is for the plain debayer, or just the luminance when only brightness matters
+struct CASDebayerUnbalanced {
+    static const size_t channels = 4;
+    void operator()(float* o, float r, float g, float b) const {
+        const CASDebayerRGBA pixel = { r, g, b, 1 };
+        *(CASDebayerRGBA*)o = pixel;
+    }
+};
+
+struct CASDebayerBalanced {
+    static const size_t channels = 4;
+    float red, green, blue;
+    static float clamp(float v) { return std::min(std::max(v, 0.0f), 1.0f); }
+    void operator()(float* o, float r, float g, float b) const {
+        const CASDebayerRGBA pixel = { clamp(r * red), clamp(g * green), clamp(b * blue), 1 };
+        *(CASDebayerRGBA*)o = pixel;
+    }
+};
+
+// the weights of the luminance kernel, along with the scale that takes 16-bit samples to 0-1
+struct CASDebayerLuminanceWeights {
+    static const size_t channels = 1;
+    float red, green, blue;
+    void operator()(float* o, float r, float g, float b) const {
+        *o = r * red + g * green + b * blue;
+    }
+};
+
+// a red or blue site, green from the four beside it and the other colour from the four diagonals
+template <bool RedRow, typename T, typename Output>
+inline void CASDebayerColourSite(const T* above, const T* row, const T* below, size_t left, size_t x, size_t right, const Output& output, float* o)
+{
+    const float c = row[x];
+    const float cross = ((row[left] + row[right]) * 0.5f + (above[x] + below[x]) * 0.5f) * 0.5f;
+    const float diagonal = (above[left] + above[right] + below[left] + below[right]) * 0.25f;
+    RedRow ? output(o, c, cross, diagonal) : output(o, diagonal, cross, c);
+}
+
+// a green site, red from whichever neighbours are on a red row or column
+template <bool RedRow, typename T, typename Output>
+inline void CASDebayerGreenSite(const T* above, const T* row, const T* below, size_t left, size_t x, size_t right, const Output& output, float* o)
+{
+    const float horizontal = (row[left] + row[right]) * 0.5f;
+    const float vertical = (above[x] + below[x]) * 0.5f;
+    RedRow ? output(o, horizontal, row[x], vertical) : output(o, vertical, row[x], horizontal);
+}
+
+// any pixel, with neighbours off the frame reflected
+template <bool RedRow, typename T, typename Output>
+inline void CASDebayerEdgeSite(const T* above, const T* row, const T* below, size_t x, size_t frameWidth, bool colour, const Output& output, float* o)
+{
+    const size_t left = CASDebayerReflect((ptrdiff_t)x - 1, frameWidth);
+    const size_t right = CASDebayerReflect((ptrdiff_t)x + 1, frameWidth);
+    if (colour){
+        CASDebayerColourSite<RedRow>(above, row, below, left, x, right, output, o);
+    }
+    else {
+        CASDebayerGreenSite<RedRow>(above, row, below, left, x, right, output, o);
+    }
+}
+
+// columns [begin,end) of a row whose neighbours are all inside the frame, a colour site and then a green one each time
+// round with nothing to test or clip. colour says whether begin is a colour site
+template <bool RedRow, typename T, typename Output>
+void CASDebayerInteriorRow(const T* above, const T* row, const T* below, size_t begin, size_t end, bool colour, const Output& output, float* o)
+{
+    size_t x = begin;
+    if (!colour && x < end){
+        CASDebayerGreenSite<RedRow>(above, row, below, x - 1, x, x + 1, output, o);
+        ++x, o += Output::channels;
+    }
+    for (; x + 1 < end; x += 2, o += 2 * Output::channels){
+        CASDebayerColourSite<RedRow>(above, row, below, x - 1, x, x + 1, output, o);
+        CASDebayerGreenSite<RedRow>(above, row, below, x, x + 1, x + 2, output, o + Output::channels);
+    }
+    if (x < end){
+        CASDebayerColourSite<RedRow>(above, row, below, x - 1, x, x + 1, output, o);
+    }
+}
+
+// one row of the region, the interior fast path between whichever ends of it are on the edges of the frame
+template <bool RedRow, typename T, typename Output>
+void CASDebayerRow(const T* above, const T* row, const T* below, bool interior, size_t rx, size_t frameWidth, size_t x, size_t width, const Output& output, float* o)
+{
+    size_t begin = x, end = x + width;
+    if (interior){
+        begin = std::min(std::max<size_t>(x, 1), end);
+        end = std::max(begin, std::min(x + width, frameWidth - 1));
+    }
+    else {
+        begin = end;
+    }
+    for (size_t fx = x; fx < begin; ++fx){
+        CASDebayerEdgeSite<RedRow>(above, row, below, fx, frameWidth, (fx & 1) == rx, output, o + (fx - x) * Output::channels);
+    }
+    CASDebayerInteriorRow<RedRow>(above, row, below, begin, end, (begin & 1) == rx, output, o + (begin - x) * Output::channels);
+    for (size_t fx = std::max(begin, end); fx < x + width; ++fx){
+        CASDebayerEdgeSite<RedRow>(above, row, below, fx, frameWidth, (fx & 1) == rx, output, o + (fx - x) * Output::channels);
+    }
+}
+
+template <typename T, typename Output>
+bool CASDebayerBilinear(const T* in, size_t inStride, size_t inX, size_t inY, size_t frameWidth, size_t frameHeight, CASBayerPattern pattern, size_t x, size_t y, size_t width, size_t height, const Output& output, float* out, size_t outStride)
+{
+    if (!in || !out || x < inX || y < inY || x + width > frameWidth || y + height > frameHeight || outStride < width * Output::channels){
+        return false;
+    }
+    
+    // parity of the red sites, the blue ones are diagonally opposite
+    const size_t rx = (pattern == kCASBayerGRBG || pattern == kCASBayerBGGR);
+    const size_t ry = (pattern == kCASBayerGBRG || pattern == kCASBayerBGGR);
+    
+    for (size_t j = 0; j < height; ++j){
+        
+        const size_t fy = y + j;
+        const T* above = in + (CASDebayerReflect((ptrdiff_t)fy - 1, frameHeight) - inY) * inStride - inX;
+        const T* row = in + (fy - inY) * inStride - inX;
+        const T* below = in + (CASDebayerReflect((ptrdiff_t)fy + 1, frameHeight) - inY) * inStride - inX;
+        const bool interior = (fy > 0 && fy + 1 < frameHeight);
+        float* o = out + j * outStride;
+        
+        // blue rows have their colour sites on the other columns from red ones
+        if ((fy & 1) == ry){
+            CASDebayerRow<true>(above, row, below, interior, rx, frameWidth, x, width, output, o);
+        }
+        else {
+            CASDebayerRow<false>(above, row, below, interior, rx ^ 1, frameWidth, x, width, output, o);
+        }
+    }
+    
+    return true;
+}
+
+}
+
+bool CASDebayerBilinear(const float* in, size_t inStride, size_t inX, size_t inY, size_t frameWidth, size_t frameHeight, CASBayerPattern pattern, size_t x, size_t y, size_t width, size_t height, float* out, size_t outStride)
+{
+    return CASDebayerBilinear(in, inStride, inX, inY, frameWidth, frameHeight, pattern, x, y, width, height, CASDebayerUnbalanced(), out, outStride);
+}
+
+bool CASDebayerBilinearBalanced(const float* in, size_t inStride, size_t inX, size_t inY, size_t frameWidth, size_t frameHeight, CASBayerPattern pattern, size_t x, size_t y, size_t width, size_t height, float red, float green, float blue, float* out, size_t outStride)
+{
+    const CASDebayerBalanced balance = { red, green, blue };
+    return CASDebayerBilinear(in, inStride, inX, inY, frameWidth, frameHeight, pattern, x, y, width, height, balance, out, outStride);
+}
+
+namespace {
+
+// mirrors coordinates off either end back into [0,limit) about the end samples, which keeps the colour of the site
+inline ptrdiff_t CASDebayerMirror(ptrdiff_t c, ptrdiff_t limit)
+{
+    if (limit < 2){
+        return 0;
+    }
+    while (c < 0 || c >= limit){
+        c = (c < 0) ? -c : 2 * (limit - 1) - c;
+    }
+    return c;
+}
+
+// where a pixel sits in the mosaic, greens are told apart by the colour on their row
+enum CASDebayerSite {
+    kCASDebayerSiteRed,
+    kCASDebayerSiteGreenOnRed,
+    kCASDebayerSiteGreenOnBlue,
+    kCASDebayerSiteBlue
+};
+
+// a tile of the frame copied into scratch along with margin pixels all round, reflected where they run off the frame
+struct CASDebayerWindow {
+    
+    std::vector<float> raw;
+    size_t width, height, margin;
+    size_t x, y;            // frame position of the tile proper, which starts margin pixels in
+    size_t rx, ry;          // parity of the red sites in window coordinates
+    
+    void fill(const float* in, size_t inStride, size_t frameWidth, size_t frameHeight, CASBayerPattern pattern, size_t x_, size_t y_, size_t w, size_t h, size_t margin_) {
+        x = x_, y = y_, margin = margin_;
+        width = w + 2 * margin, height = h + 2 * margin;
+        raw.resize(width * height);
+        for (size_t j = 0; j < height; ++j){
+            const float* row = in + CASDebayerMirror((ptrdiff_t)(y + j) - (ptrdiff_t)margin, frameHeight) * inStride;
+            float* o = &raw[j * width];
+            for (size_t i = 0; i < width; ++i){
+                o[i] = row[CASDebayerMirror((ptrdiff_t)(x + i) - (ptrdiff_t)margin, frameWidth)];
+            }
+        }
+        // window coordinates are offset by the margin from the frame's
+        rx = ((pattern == kCASBayerGRBG || pattern == kCASBayerBGGR) + margin) & 1;
+        ry = ((pattern == kCASBayerGBRG || pattern == kCASBayerBGGR) + margin) & 1;
+    }
+    
+    CASDebayerSite site(size_t i, size_t j) const {
+        const bool redRow = ((y + j) & 1) == ry, redColumn = ((x + i) & 1) == rx;
+        if (redRow){
+            return redColumn ? kCASDebayerSiteRed : kCASDebayerSiteGreenOnRed;
+        }
+        return redColumn ? kCASDebayerSiteGreenOnBlue : kCASDebayerSiteBlue;
+    }
+};
+
+// red, green and blue from a site's own sample and the two others it estimates. colour sites give green and then the
+// diagonal colour, green sites the colour on their row and then the one on their column
+inline void CASDebayerAssemble(CASDebayerSite site, float own, float first, float second, float* rgb)
+{
+    switch (site) {
+        case kCASDebayerSiteRed:
+            rgb[0] = own, rgb[1] = first, rgb[2] = second;
+            break;
+        case kCASDebayerSiteBlue:
+            rgb[0] = second, rgb[1] = first, rgb[2] = own;
+            break;
+        case kCASDebayerSiteGreenOnRed:
+            rgb[0] = first, rgb[1] = own, rgb[2] = second;
+            break;
+        case kCASDebayerSiteGreenOnBlue:
+            rgb[0] = second, rgb[1] = own, rgb[2] = first;
+            break;
+    }
+}
+
+inline void CASDebayerStore(const float* rgb, const CASDebayerBalanced& balance, float* o)
+{
+    balance(o, rgb[0], rgb[1], rgb[2]);
+}
+
+// one of north, east, south or west for VNG. Q(a,b) is a along the direction and b to its right
+template <int UX, int UY, bool Green>
+inline void CASDebayerVNGAxis(const float* p, ptrdiff_t s, float& gradient, float& own, float& first, float& second)
+{
+    #define Q(a,b) p[((a) * UX - (b) * UY) + ((a) * UY + (b) * UX) * s]
+    gradient = fabsf(Q(1,0) - Q(-1,0)) + fabsf(Q(2,0) - Q(0,0)) +
+        (fabsf(Q(1,-1) - Q(-1,-1)) + fabsf(Q(1,1) - Q(-1,1)) + fabsf(Q(2,-1) - Q(0,-1)) + fabsf(Q(2,1) - Q(0,1))) * 0.5f;
+    own = (Q(2,0) + Q(0,0)) * 0.5f;
+    if (!Green){
+        first = Q(1,0);
+        second = (Q(1,-1) + Q(1,1)) * 0.5f;
+    }
+    else {
+        // the sample along the direction is the row's colour for east and west, the column's for north and south
+        const float along = Q(1,0), across = (Q(0,-1) + Q(0,1) + Q(2,-1) + Q(2,1)) * 0.25f;
+        first = UX ? along : across;
+        second = UX ? across : along;
+    }
+    #undef Q
+}
+
+// one of the diagonals. R(a,b) is a across and b down, flipped into the quadrant
+template <int SX, int SY, bool Green>
+inline void CASDebayerVNGDiagonal(const float* p, ptrdiff_t s, float& gradient, float& own, float& first, float& second)
+{
+    #define R(a,b) p[(a) * SX + (b) * SY * s]
+    const float common = fabsf(R(1,1) - R(-1,-1)) + fabsf(R(2,2) - R(0,0));
+    if (!Green){
+        gradient = common + (fabsf(R(0,1) - R(-1,0)) + fabsf(R(1,0) - R(0,-1)) + fabsf(R(1,2) - R(0,1)) + fabsf(R(2,1) - R(1,0))) * 0.5f;
+        own = (R(2,2) + R(0,0)) * 0.5f;
+        first = (R(1,2) + R(0,1) + R(2,1) + R(1,0)) * 0.25f;
+        second = R(1,1);
+    }
+    else {
+        gradient = common + fabsf(R(1,2) - R(-1,0)) + fabsf(R(2,1) - R(0,-1));
+        own = R(1,1);
+        first = (R(1,0) + R(1,2)) * 0.5f;
+        second = (R(0,1) + R(2,1)) * 0.5f;
+    }
+    #undef R
+}
+
+// VNG after Chang, Cheung and Pang. gradients in eight directions are worked out over the 5x5 neighbourhood, those no
+// more than 1.5 x the smallest + 0.5 x the range are kept and the site's missing colours are its own sample plus the
+// average colour difference along the kept directions
+template <bool Green>
+inline void CASDebayerVNGPixel(const float* p, ptrdiff_t s, float& first, float& second)
+{
+    float gradients[8], owns[8], firsts[8], seconds[8];
+    CASDebayerVNGAxis<0, -1, Green>(p, s, gradients[0], owns[0], firsts[0], seconds[0]);
+    CASDebayerVNGAxis<1, 0, Green>(p, s, gradients[1], owns[1], firsts[1], seconds[1]);
+    CASDebayerVNGAxis<0, 1, Green>(p, s, gradients[2], owns[2], firsts[2], seconds[2]);
+    CASDebayerVNGAxis<-1, 0, Green>(p, s, gradients[3], owns[3], firsts[3], seconds[3]);
+    CASDebayerVNGDiagonal<1, -1, Green>(p, s, gradients[4], owns[4], firsts[4], seconds[4]);
+    CASDebayerVNGDiagonal<1, 1, Green>(p, s, gradients[5], owns[5], firsts[5], seconds[5]);
+    CASDebayerVNGDiagonal<-1, -1, Green>(p, s, gradients[6], owns[6], firsts[6], seconds[6]);
+    CASDebayerVNGDiagonal<-1, 1, Green>(p, s, gradients[7], owns[7], firsts[7], seconds[7]);
+    
+    float smallest = gradients[0], largest = gradients[0];
+    for (int d = 1; d < 8; ++d){
+        smallest = std::min(smallest, gradients[d]);
+        largest = std::max(largest, gradients[d]);
+    }
+    const float threshold = 1.5f * smallest + 0.5f * (largest - smallest);
+    
+    // summed with masks rather than branches, which directions pass is as good as random
+    float own = 0, a = 0, b = 0, count = 0;
+    for (int d = 0; d < 8; ++d){
+        const float keep = (gradients[d] <= threshold) ? 1.0f : 0.0f;
+        own += keep * owns[d], a += keep * firsts[d], b += keep * seconds[d];
+        count += keep;
+    }
+    first = p[0] + (a - own) / count;
+    second = p[0] + (b - own) / count;
+}
+
+void CASDebayerVNGTile(const CASDebayerWindow& window, size_t w, size_t h, const CASDebayerBalanced& balance, float* out, size_t outStride)
+{
+    const ptrdiff_t s = window.width;
+    for (size_t j = 0; j < h; ++j){
+        const size_t wj = j + window.margin;
+        float* o = out + j * outStride;
+        for (size_t i = 0; i < w; ++i, o += 4){
+            const size_t wi = i + window.margin;
+            const float* p = &window.raw[wj * s + wi];
+            const CASDebayerSite site = window.site(wi, wj);
+            float first, second, rgb[3];
+            if (site == kCASDebayerSiteGreenOnRed || site == kCASDebayerSiteGreenOnBlue){
+                CASDebayerVNGPixel<true>(p, s, first, second);
+            }
+            else {
+                CASDebayerVNGPixel<false>(p, s, first, second);
+            }
+            CASDebayerAssemble(site, p[0], first, second, rgb);
+            CASDebayerStore(rgb, balance, o);
+        }
+    }
+}
+
+// the Lab companding function over 0-1 in steps of 1/CAS_DEBAYER_LAB_TABLE_SIZE, cube roots being most of the cost of AHD
+#define CAS_DEBAYER_LAB_TABLE_SIZE 65536
+
+inline float CASDebayerLabF(float t)
+{
+    return (t > 0.008856f) ? cbrtf(t) : 7.787f * t + 16.0f / 116.0f;
+}
+
+struct CASDebayerLabTable {
+    std::vector<float> f;
+    CASDebayerLabTable() : f(CAS_DEBAYER_LAB_TABLE_SIZE + 2) {
+        for (size_t i = 0; i < f.size(); ++i){
+            f[i] = CASDebayerLabF(i / (float)CAS_DEBAYER_LAB_TABLE_SIZE);
+        }
+    }
+    float operator()(float t) const {
+        if (t >= 1){
+            return CASDebayerLabF(t);
+        }
+        const float position = t * CAS_DEBAYER_LAB_TABLE_SIZE;
+        const size_t i = (size_t)position;
+        return f[i] + (f[i + 1] - f[i]) * (position - i);
+    }
+};
+
+// CIELab from linear sRGB primaries, near enough for comparing how alike neighbouring pixels are
+inline void CASDebayerLab(const CASDebayerLabTable& table, const float* rgb, float* lab)
+{
+    const float r = std::max(rgb[0], 0.0f), g = std::max(rgb[1], 0.0f), b = std::max(rgb[2], 0.0f);
+    const float fx = table((0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.9505f);
+    const float fy = table(0.2126f * r + 0.7152f * g + 0.0722f * b);
+    const float fz = table((0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.0890f);
+    lab[0] = 116.0f * fy - 16.0f;
+    lab[1] = 500.0f * (fx - fy);
+    lab[2] = 200.0f * (fy - fz);
+}
+
+// scratch for AHD, the two directions' greens, colours, Lab and homogeneity over the window
+struct CASDebayerAHDScratch {
+    std::vector<float> green[2], rgb[2], lab[2];
+    std::vector<uint8_t> homogeneity[2];
+};
+
+// AHD after Hirakawa and Parks. green is interpolated along rows and along columns, each with a 5 tap filter clamped
+// to its neighbours, red and blue follow from colour differences to the interpolated greens, and each pixel takes
+// whichever direction has more neighbours close to it in Lab over its 3x3 neighbourhood, the average where they tie
+void CASDebayerAHDTile(const CASDebayerWindow& window, size_t w, size_t h, CASDebayerAHDScratch& scratch, const CASDebayerBalanced& balance, float* out, size_t outStride)
+{
+    const size_t W = window.width, H = window.height;
+    const ptrdiff_t s = W;
+    const float* raw = window.raw.data();
+    const ptrdiff_t steps[2] = { 1, s }; // along rows, along columns
+    static const CASDebayerLabTable table;
+    
+    for (int d = 0; d < 2; ++d){
+        scratch.green[d].resize(W * H);
+        scratch.rgb[d].resize(W * H * 3);
+        scratch.lab[d].resize(W * H * 3);
+        scratch.homogeneity[d].resize(W * H);
+    }
+    
+    // green both ways, 2 in from the edges of the window
+    for (size_t j = 2; j < H - 2; ++j){
+        for (size_t i = 2; i < W - 2; ++i){
+            const size_t k = j * W + i;
+            const CASDebayerSite site = window.site(i, j);
+            if (site == kCASDebayerSiteGreenOnRed || site == kCASDebayerSiteGreenOnBlue){
+                scratch.green[0][k] = scratch.green[1][k] = raw[k];
+                continue;
+            }
+            for (int d = 0; d < 2; ++d){
+                const ptrdiff_t t = steps[d];
+                const float* p = raw + k;
+                const float g = ((p[-t] + p[0] + p[t]) * 2 - p[-2 * t] - p[2 * t]) * 0.25f;
+                scratch.green[d][k] = std::min(std::max(g, std::min(p[-t], p[t])), std::max(p[-t], p[t]));
+            }
+        }
+    }
+    
+    // red and blue both ways and their Lab, 3 in
+    for (int d = 0; d < 2; ++d){
+        const float* green = scratch.green[d].data();
+        for (size_t j = 3; j < H - 3; ++j){
+            for (size_t i = 3; i < W - 3; ++i){
+                const size_t k = j * W + i;
+                const float* p = raw + k;
+                const float* g = green + k;
+                const CASDebayerSite site = window.site(i, j);
+                float first, second;
+                if (site == kCASDebayerSiteGreenOnRed || site == kCASDebayerSiteGreenOnBlue){
+                    first = p[0] + ((p[-1] - g[-1]) + (p[1] - g[1])) * 0.5f;
+                    second = p[0] + ((p[-s] - g[-s]) + (p[s] - g[s])) * 0.5f;
+                    CASDebayerAssemble(site, p[0], first, second, &scratch.rgb[d][k * 3]);
+                }
+                else {
+                    first = g[0];
+                    second = g[0] + ((p[-s - 1] - g[-s - 1]) + (p[-s + 1] - g[-s + 1]) + (p[s - 1] - g[s - 1]) + (p[s + 1] - g[s + 1])) * 0.25f;
+                    CASDebayerAssemble(site, p[0], first, second, &scratch.rgb[d][k * 3]);
+                }
+                CASDebayerLab(table, &scratch.rgb[d][k * 3], &scratch.lab[d][k * 3]);
+            }
+        }
+    }
+    
+    // how many of each pixel's four neighbours are within the tolerances, which are the smaller of the differences
+    // across the interpolation direction in each image, 4 in
+    const ptrdiff_t neighbours[4] = { -1, 1, -s, s };
+    for (size_t j = 4; j < H - 4; ++j){
+        for (size_t i = 4; i < W - 4; ++i){
+            const size_t k = j * W + i;
+            float ldiff[2][4], abdiff[2][4];
+            for (int d = 0; d < 2; ++d){
+                const float* lab = &scratch.lab[d][k * 3];
+                for (int n = 0; n < 4; ++n){
+                    const float* other = lab + neighbours[n] * 3;
+                    ldiff[d][n] = fabsf(lab[0] - other[0]);
+                    abdiff[d][n] = (lab[1] - other[1]) * (lab[1] - other[1]) + (lab[2] - other[2]) * (lab[2] - other[2]);
+                }
+            }
+            const float leps = std::min(std::max(ldiff[0][0], ldiff[0][1]), std::max(ldiff[1][2], ldiff[1][3]));
+            const float abeps = std::min(std::max(abdiff[0][0], abdiff[0][1]), std::max(abdiff[1][2], abdiff[1][3]));
+            for (int d = 0; d < 2; ++d){
+                uint8_t count = 0;
+                for (int n = 0; n < 4; ++n){
+                    count += (ldiff[d][n] <= leps && abdiff[d][n] <= abeps);
+                }
+                scratch.homogeneity[d][k] = count;
+            }
+        }
+    }
+    
+    // the tile proper, margin in
+    for (size_t j = 0; j < h; ++j){
+        const size_t wj = j + window.margin;
+        float* o = out + j * outStride;
+        for (size_t i = 0; i < w; ++i, o += 4){
+            const size_t k = wj * W + i + window.margin;
+            int score[2] = { 0, 0 };
+            for (int d = 0; d < 2; ++d){
+                const uint8_t* m = &scratch.homogeneity[d][k];
+                score[d] = m[-s - 1] + m[-s] + m[-s + 1] + m[-1] + m[0] + m[1] + m[s - 1] + m[s] + m[s + 1];
+            }
+            const float* rows = &scratch.rgb[0][k * 3];
+            const float* columns = &scratch.rgb[1][k * 3];
+            if (score[0] != score[1]){
+                CASDebayerStore(score[0] > score[1] ? rows : columns, balance, o);
+            }
+            else {
+                const float rgb[3] = { (rows[0] + columns[0]) * 0.5f, (rows[1] + columns[1]) * 0.5f, (rows[2] + columns[2]) * 0.5f };
+                CASDebayerStore(rgb, balance, o);
+            }
+        }
+    }
+}
+
+struct CASDebayerFrameWork {
+    
+    const float* in;
+    size_t inStride, width, height;
+    CASBayerPattern pattern;
+    CASDebayerAlgorithm algorithm;
+    CASDebayerBalanced balance;
+    float* out;
+    size_t outStride;
+    
+    // a band of tiles, sharing one window and one lot of scratch
+    static void work(void* context, size_t band) {
+        const CASDebayerFrameWork& frame = *(const CASDebayerFrameWork*)context;
+        const size_t y = band * CAS_DEBAYER_TILE_SIZE, h = std::min<size_t>(CAS_DEBAYER_TILE_SIZE, frame.height - y);
+        
+        if (frame.algorithm == kCASDebayerBilinear){
+            CASDebayerBilinear(frame.in, frame.inStride, 0, 0, frame.width, frame.height, frame.pattern, 0, y, frame.width, h, frame.balance, frame.out + y * frame.outStride, frame.outStride);
+            return;
+        }
+        
+        CASDebayerWindow window;
+        CASDebayerAHDScratch scratch;
+        const size_t margin = (frame.algorithm == kCASDebayerVNG) ? CAS_DEBAYER_VNG_MARGIN : CAS_DEBAYER_AHD_MARGIN;
+        for (size_t x = 0; x < frame.width; x += CAS_DEBAYER_TILE_SIZE){
+            const size_t w = std::min<size_t>(CAS_DEBAYER_TILE_SIZE, frame.width - x);
+            float* o = frame.out + y * frame.outStride + x * 4;
+            window.fill(frame.in, frame.inStride, frame.width, frame.height, frame.pattern, x, y, w, h, margin);
+            if (frame.algorithm == kCASDebayerVNG){
+                CASDebayerVNGTile(window, w, h, frame.balance, o, frame.outStride);
+            }
+            else {
+                CASDebayerAHDTile(window, w, h, scratch, frame.balance, o, frame.outStride);
+            }
+        }
+    }
+};
+
+void CASDebayerApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+}
+
+bool CASDebayerFrame(const float* in, size_t inStride, size_t width, size_t height, CASBayerPattern pattern, CASDebayerAlgorithm algorithm, float red, float green, float blue, float* out, size_t outStride, CASDebayerApply apply)
+{
+    if (!in || !out || width < 2 || height < 2 || inStride < width || outStride < width * 4){
+        return false;
+    }
+    
+    CASDebayerFrameWork frame = { in, inStride, width, height, pattern, algorithm, { red, green, blue }, out, outStride };
+    (apply ? apply : CASDebayerApplyInOrder)((height + CAS_DEBAYER_TILE_SIZE - 1) / CAS_DEBAYER_TILE_SIZE, &frame, CASDebayerFrameWork::work);
+    return true;
+}
+
+namespace {
+
+// rows of superpixels for each unit of work, the same number of raw rows as a band of tiles
+#define CAS_DEBAYER_SUPERPIXEL_BAND (CAS_DEBAYER_TILE_SIZE / 2)
+
+// every output is a weighted sum of the four samples of a block, top left, top right, bottom left, bottom right, so
+// the pattern only picks the weights and the loop is the same straight line code whichever it is
+template <typename T>
+struct CASDebayerSuperpixelWork {
+    
+    CASPixelView<const T> view;
+    bool luminance;
+    CASDebayerRGBA rgba[4];
+    float weights[4];
+    float* out;
+    size_t outStride;
+    
+    CASDebayerSuperpixelWork(const CASPixelView<const T>& view_, CASBayerPattern pattern, bool luminance_, float* out_, size_t outStride_) : view(view_), luminance(luminance_), out(out_), outStride(outStride_) {
+        const size_t rx = (pattern == kCASBayerGRBG || pattern == kCASBayerBGGR);
+        const size_t ry = (pattern == kCASBayerGBRG || pattern == kCASBayerBGGR);
+        const float scale = CASPixelTraits<T>::toFloat(1);
+        for (size_t i = 0; i < 4; ++i){
+            const bool redRow = (i >> 1) == ry, redColumn = (i & 1) == rx;
+            const CASDebayerRGBA red = { scale, 0, 0, 0 }, green = { 0, scale * 0.5f, 0, 0 }, blue = { 0, 0, scale, 0 };
+            rgba[i] = (redRow && redColumn) ? red : (!redRow && !redColumn) ? blue : green;
+            weights[i] = (redRow && redColumn) ? 0.2126f * scale : (!redRow && !redColumn) ? 0.0722f * scale : 0.7152f * 0.5f * scale;
+        }
+    }
+    
+    static void work(void* context, size_t band) {
+        const CASDebayerSuperpixelWork& frame = *(const CASDebayerSuperpixelWork*)context;
+        const size_t width = frame.view.width / 2, height = frame.view.height / 2;
+        const size_t y0 = band * CAS_DEBAYER_SUPERPIXEL_BAND, y1 = std::min<size_t>(y0 + CAS_DEBAYER_SUPERPIXEL_BAND, height);
+        for (size_t y = y0; y < y1; ++y){
+            const T* top = frame.view.row(y * 2);
+            const T* bottom = frame.view.row(y * 2 + 1);
+            float* o = frame.out + y * frame.outStride;
+            if (frame.luminance){
+                const float w0 = frame.weights[0], w1 = frame.weights[1], w2 = frame.weights[2], w3 = frame.weights[3];
+                for (size_t x = 0; x < width; ++x){
+                    o[x] = w0 * top[x * 2] + w1 * top[x * 2 + 1] + w2 * bottom[x * 2] + w3 * bottom[x * 2 + 1];
+                }
+            }
+            else {
+                const CASDebayerRGBA w0 = frame.rgba[0], w1 = frame.rgba[1], w2 = frame.rgba[2], w3 = frame.rgba[3], alpha = { 0, 0, 0, 1 };
+                for (size_t x = 0; x < width; ++x){
+                    *(CASDebayerRGBA*)(o + x * 4) = alpha + w0 * (float)top[x * 2] + w1 * (float)top[x * 2 + 1] + w2 * (float)bottom[x * 2] + w3 * (float)bottom[x * 2 + 1];
+                }
+            }
+        }
+    }
+};
+
+template <typename T>
+bool CASDebayerSuperpixel(const CASPixelView<const T>& view, CASBayerPattern pattern, bool luminance, float* out, size_t outStride, CASDebayerApply apply)
+{
+    if (view.empty() || view.width < 2 || view.height < 2 || !out || outStride < (view.width / 2) * (luminance ? 1 : 4)){
+        return false;
+    }
+    
+    CASDebayerSuperpixelWork<T> frame(view, pattern, luminance, out, outStride);
+    (apply ? apply : CASDebayerApplyInOrder)((view.height / 2 + CAS_DEBAYER_SUPERPIXEL_BAND - 1) / CAS_DEBAYER_SUPERPIXEL_BAND, &frame, CASDebayerSuperpixelWork<T>::work);
+    return true;
+}
+
+}
+
+bool CASDebayerSuperpixel(const CASPixels& frame, CASBayerPattern pattern, bool luminance, float* out, size_t outStride, CASDebayerApply apply)
+{
+    switch (CASPixelsIsEmpty(frame) ? kCASPixelFormatNone : frame.format) {
+        case kCASPixelFormatUInt16:
+            return CASDebayerSuperpixel(CASPixelsView<uint16_t>(frame), pattern, luminance, out, outStride, apply);
+        case kCASPixelFormatFloat:
+            return CASDebayerSuperpixel(CASPixelsView<float>(frame), pattern, luminance, out, outStride, apply);
+        default:
+            return false;
+    }
+}
+
+namespace {
+
+template <typename T>
+struct CASDebayerLuminanceWork {
+    
+    CASPixelView<const T> view;
+    CASBayerPattern pattern;
+    size_t x, y, width, height;
+    CASDebayerLuminanceWeights weights;
+    float* out;
+    size_t outStride;
+    
+    // a band of rows of the region, read straight from the frame as the bilinear debayer reads its window
+    static void work(void* context, size_t band) {
+        const CASDebayerLuminanceWork& region = *(const CASDebayerLuminanceWork*)context;
+        const size_t j = band * CAS_DEBAYER_TILE_SIZE, h = std::min<size_t>(CAS_DEBAYER_TILE_SIZE, region.height - j);
+        CASDebayerBilinear(region.view.pixels, region.view.stride, 0, 0, region.view.width, region.view.height, region.pattern, region.x, region.y + j, region.width, h, region.weights, region.out + j * region.outStride, region.outStride);
+    }
+};
+
+template <typename T>
+bool CASDebayerLuminance(const CASPixelView<const T>& view, CASBayerPattern pattern, size_t x, size_t y, size_t width, size_t height, float* out, size_t outStride, CASDebayerApply apply)
+{
+    if (view.empty() || view.width < 2 || view.height < 2 || !out || !width || !height || x + width > view.width || y + height > view.height || outStride < width){
+        return false;
+    }
+    
+    const float scale = CASPixelTraits<T>::toFloat(1);
+    CASDebayerLuminanceWork<T> region = { view, pattern, x, y, width, height, { 0.2126f * scale, 0.7152f * scale, 0.0722f * scale }, out, outStride };
+    (apply ? apply : CASDebayerApplyInOrder)((height + CAS_DEBAYER_TILE_SIZE - 1) / CAS_DEBAYER_TILE_SIZE, &region, CASDebayerLuminanceWork<T>::work);
+    return true;
+}
+
+}
+
+bool CASDebayerLuminance(const CASPixels& frame, CASBayerPattern pattern, size_t x, size_t y, size_t width, size_t height, float* out, size_t outStride, CASDebayerApply apply)
+{
+    switch (CASPixelsIsEmpty(frame) ? kCASPixelFormatNone : frame.format) {
+        case kCASPixelFormatUInt16:
+            return CASDebayerLuminance(CASPixelsView<uint16_t>(frame), pattern, x, y, width, height, out, outStride, apply);
+        case kCASPixelFormatFloat:
+            return CASDebayerLuminance(CASPixelsView<float>(frame), pattern, x, y, width, height, out, outStride, apply);
+        default:
+            return false;
+    }
+}
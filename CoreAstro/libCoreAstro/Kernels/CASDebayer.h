@@ -0,0 +1,95 @@
+//
+//  CASDebayer.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Demosaicing of raw colour frames a region at a time, so it can run tile by tile as part of a longer
+//  chain of processing without the whole frame going through each step in turn. Rows are specialised on
+//  whether they carry red or blue sites so the interior alternates between the two kinds of site with no
+//  tests, and only the pixels on the edges of the frame look up reflected neighbours.
+//
+//  For final processing there's also VNG, which averages colour differences along whichever of eight directions
+//  have the smallest gradients, and AHD, which interpolates green along rows and along columns and picks whichever
+//  gives the more homogeneous colour around each pixel. Both work on whole frames split into overlapping tiles,
+//  each copied with its margin into scratch that's reused from tile to tile so memory doesn't grow with the frame.
+//
+//  Where only positions and brightness matter, finding stars or measuring focus, the superpixel debayer folds each
+//  2x2 block straight into one pixel at half the resolution, reading the raw samples once and interpolating nothing.
+//  At full resolution the bilinear rows can write luminance instead of RGBA, again straight from the raw samples.
+
+
+#ifndef __CASDebayer_h__
+#define __CASDebayer_h__
+
+#include <stddef.h>
+#include "CASPixelView.h"
+
+// the colours of the top left 2x2 block of the sensor, in the same order as kCASImageDebayerRGGB etc
+enum CASBayerPattern {
+    kCASBayerRGGB,
+    kCASBayerGRBG,
+    kCASBayerBGGR,
+    kCASBayerGBRG
+};
+
+enum CASDebayerAlgorithm {
+    kCASDebayerBilinear,
+    kCASDebayerVNG,     // variable number of gradients
+    kCASDebayerAHD      // adaptive homogeneity directed
+};
+
+// rows and columns either side of a region that are read to interpolate it
+#define CAS_DEBAYER_BILINEAR_MARGIN 1
+#define CAS_DEBAYER_VNG_MARGIN 2
+#define CAS_DEBAYER_AHD_MARGIN 5
+
+// the side of the square tiles whole frames are demosaiced in, a band of tiles for each unit of work
+#define CAS_DEBAYER_TILE_SIZE 128
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order on the calling thread
+typedef void (*CASDebayerApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+// bilinear interpolation of the width x height region at x,y of a frameWidth x frameHeight raw frame into RGBA
+// with an alpha of 1. in holds the frame from inX,inY, inStride floats a row, and must cover the region plus
+// CAS_DEBAYER_BILINEAR_MARGIN either side, clipped to the frame. neighbours off the edges of the frame are
+// reflected back onto a sample of the same colour. out is outStride floats a row
+bool CASDebayerBilinear(const float* in, size_t inStride, size_t inX, size_t inY, size_t frameWidth, size_t frameHeight, CASBayerPattern pattern, size_t x, size_t y, size_t width, size_t height, float* out, size_t outStride);
+
+// the same with red, green and blue multiplied by their scales and clamped to 0-1, for white balancing previews
+bool CASDebayerBilinearBalanced(const float* in, size_t inStride, size_t inX, size_t inY, size_t frameWidth, size_t frameHeight, CASBayerPattern pattern, size_t x, size_t y, size_t width, size_t height, float red, float green, float blue, float* out, size_t outStride);
+
+// a whole width x height frame, inStride floats a row, with the algorithm into RGBA scaled and clamped as for
+// CASDebayerBilinearBalanced. neighbours off the edges are reflected onto samples of the same colour. false for frames
+// too small to have a full 2x2 block
+bool CASDebayerFrame(const float* in, size_t inStride, size_t width, size_t height, CASBayerPattern pattern, CASDebayerAlgorithm algorithm, float red, float green, float blue, float* out, size_t outStride, CASDebayerApply apply = NULL);
+
+// each 2x2 block of a raw 16-bit or float frame into one pixel of a (width / 2) x (height / 2) frame, dropping any
+// odd last row or column. RGBA has red, the mean of the two greens, blue and an alpha of 1, luminance weights them
+// as the luminance kernel does. 16-bit samples are scaled to 0-1 as exposures do. out is outStride floats a row
+bool CASDebayerSuperpixel(const CASPixels& frame, CASBayerPattern pattern, bool luminance, float* out, size_t outStride, CASDebayerApply apply = NULL);
+
+// the luminance of the width x height region at x,y of a raw 16-bit or float frame, interpolated as CASDebayerBilinear
+// would and weighted as the luminance kernel does but without the RGBA in between, for finding stars in part of a
+// colour frame. the pattern is that of the whole frame. 16-bit samples are scaled to 0-1, out is outStride floats a row
+bool CASDebayerLuminance(const CASPixels& frame, CASBayerPattern pattern, size_t x, size_t y, size_t width, size_t height, float* out, size_t outStride, CASDebayerApply apply = NULL);
+
+#endif
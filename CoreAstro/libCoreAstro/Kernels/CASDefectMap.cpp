@@ -0,0 +1,443 @@
+//
+//  CASDefectMap.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+#include "CASDefectMap.h"
+#include "CASStatistics.h"
+#include <algorithm>
+#include <iterator>
+#include <math.h>
+#include <string.h>
+
+// MAD to standard deviation for normally distributed noise
+#define CAS_DEFECT_MAD_SIGMA 1.4826f
+
+// pairs of columns either side a column is compared against
+#define CAS_DEFECT_COLUMN_RADIUS 3
+
+// 'CASD' followed by the version, then the sizes and list lengths
+#define CAS_DEFECT_MAGIC 0x44534143
+#define CAS_DEFECT_VERSION 1
+
+namespace {
+
+// the frame's samples as 0-1 floats, the same as exposures scale them
+std::vector<float> CASDefectSamples(const CASPixels& frame)
+{
+    std::vector<float> samples(frame.width * frame.height);
+    for (size_t y = 0; y < frame.height; ++y){
+        float* out = samples.data() + y * frame.width;
+        if (frame.format == kCASPixelFormatUInt16){
+            const uint16_t* in = (const uint16_t*)frame.data + y * frame.stride;
+            for (size_t x = 0; x < frame.width; ++x){
+                out[x] = in[x] / (float)CAS_PIXEL_UINT16_MAX;
+            }
+        }
+        else {
+            memcpy(out, (const float*)frame.data + y * frame.stride, frame.width * sizeof(float));
+        }
+    }
+    return samples;
+}
+
+// never let a perfectly flat synthetic or saturated frame make every pixel an outlier
+float CASDefectSigma(float medianDeviation)
+{
+    return std::max(CAS_DEFECT_MAD_SIGMA * medianDeviation, 1.0f / CAS_PIXEL_UINT16_MAX);
+}
+
+float CASDefectMedian(std::vector<float>& values)
+{
+    if (values.empty()){
+        return 0;
+    }
+    const size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    float median = values[middle];
+    if (!(values.size() & 1)){
+        median = (median + *std::max_element(values.begin(), values.begin() + middle)) / 2;
+    }
+    return median;
+}
+
+// flags columns whose mean stands out from the columns around it rather than from the frame as a whole so that
+// vignetting in flats and amp glow in darks don't count
+void CASDefectFindColumns(const std::vector<float>& samples, size_t width, size_t height, float lower, float upper, float sigmas, std::vector<bool>& bad)
+{
+    std::vector<double> sums(width);
+    for (size_t y = 0; y < height; ++y){
+        const float* row = samples.data() + y * width;
+        for (size_t x = 0; x < width; ++x){
+            sums[x] += std::min(upper, std::max(lower, row[x])); // so single hot or cold pixels don't drag a column
+        }
+    }
+    
+    // against the average of each pair of columns either side of it so that a steady gradient cancels out, columns
+    // at the edges extrapolate from the two next to them
+    std::vector<float> residuals(width), neighbours;
+    for (size_t x = 0; x < width; ++x){
+        neighbours.clear();
+        for (size_t k = 1; k <= CAS_DEFECT_COLUMN_RADIUS && k <= x && x + k < width; ++k){
+            neighbours.push_back((sums[x - k] + sums[x + k]) / (2 * height));
+        }
+        if (neighbours.empty() && width > 2){
+            const double a = (x ? sums[x - 1] : sums[x + 1]) / height, b = (x ? sums[x - 2] : sums[x + 2]) / height;
+            neighbours.push_back(2 * a - b);
+        }
+        residuals[x] = neighbours.empty() ? 0 : (float)(sums[x] / height) - CASDefectMedian(neighbours);
+    }
+    
+    std::vector<float> deviations(width);
+    for (size_t x = 0; x < width; ++x){
+        deviations[x] = fabsf(residuals[x]);
+    }
+    const float limit = sigmas * CASDefectSigma(CASDefectMedian(deviations));
+    for (size_t x = 0; x < width; ++x){
+        if (fabsf(residuals[x]) > limit){
+            bad[x] = true;
+        }
+    }
+}
+
+// median of the up to four neighbours of a pixel
+float CASDefectNeighbourMedian(float* values, int count)
+{
+    std::sort(values, values + count);
+    return (count & 1) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+// the median of the pixels two away in each direction, the nearest of the same colour on a bayer sensor and close
+// enough that vignetting doesn't matter
+float CASDefectNeighbourMedian(const std::vector<float>& samples, size_t width, size_t height, size_t x, size_t y)
+{
+    float values[4];
+    int count = 0;
+    if (x >= 2){
+        values[count++] = samples[(x - 2) + y * width];
+    }
+    if (x + 2 < width){
+        values[count++] = samples[(x + 2) + y * width];
+    }
+    if (y >= 2){
+        values[count++] = samples[x + (y - 2) * width];
+    }
+    if (y + 2 < height){
+        values[count++] = samples[x + (y + 2) * width];
+    }
+    return count ? CASDefectNeighbourMedian(values, count) : 0;
+}
+
+bool CASDefectContains(const std::vector<uint32_t>& list, uint32_t value)
+{
+    return std::binary_search(list.begin(), list.end(), value);
+}
+
+// each neighbour is a fixed offset from the defect, so as the defects are visited in order the neighbours are too and
+// finding whether one is a defect as well only ever has to move forward through the list
+struct CASDefectCursor {
+    const std::vector<uint32_t>* list;
+    size_t index;
+    explicit CASDefectCursor(const std::vector<uint32_t>& list) : list(&list), index(0) {}
+    bool contains(uint32_t value) {
+        while (index < list->size() && (*list)[index] < value){
+            ++index;
+        }
+        return index < list->size() && (*list)[index] == value;
+    }
+};
+
+template <typename T>
+T CASDefectRound(float value);
+
+template <>
+uint16_t CASDefectRound<uint16_t>(float value)
+{
+    return (uint16_t)std::min<float>(CAS_PIXEL_UINT16_MAX, std::max(0.0f, value + 0.5f));
+}
+
+template <>
+float CASDefectRound<float>(float value)
+{
+    return value;
+}
+
+template <typename T>
+size_t CASDefectCorrect(const CASDefectMap& map, T* pixels, size_t width, size_t height, size_t stride, size_t originX, size_t originY, size_t step)
+{
+    if (!pixels || !width || !height || stride < width || !step || originX + width > map.width || originY + height > map.height){
+        return 0;
+    }
+    
+    size_t corrected = 0;
+    
+    // the lists are in raster order so only the part covering the frame's rows needs to be walked, merged so that
+    // a single pass over them in order can tell which neighbours are defects as well
+    const uint32_t first = (uint32_t)(originY * map.width), last = (uint32_t)((originY + height) * map.width);
+    std::vector<uint32_t> defects;
+    std::merge(std::lower_bound(map.hot.begin(), map.hot.end(), first), std::lower_bound(map.hot.begin(), map.hot.end(), last),
+               std::lower_bound(map.cold.begin(), map.cold.end(), first), std::lower_bound(map.cold.begin(), map.cold.end(), last),
+               std::back_inserter(defects));
+    
+    const ptrdiff_t offsets[4][2] = { { -(ptrdiff_t)step, 0 }, { (ptrdiff_t)step, 0 }, { 0, -(ptrdiff_t)step }, { 0, (ptrdiff_t)step } };
+    CASDefectCursor cursors[4] = { CASDefectCursor(defects), CASDefectCursor(defects), CASDefectCursor(defects), CASDefectCursor(defects) };
+    for (size_t i = 0; i < defects.size(); ++i){
+        
+        const size_t sx = defects[i] % map.width, sy = defects[i] / map.width;
+        if (sx < originX || sx >= originX + width){
+            continue;
+        }
+        
+        const size_t x = sx - originX, y = sy - originY;
+        float values[4];
+        int count = 0;
+        for (int n = 0; n < 4; ++n){
+            const ptrdiff_t nx = x + offsets[n][0], ny = y + offsets[n][1];
+            if (nx < 0 || ny < 0 || nx >= (ptrdiff_t)width || ny >= (ptrdiff_t)height){
+                continue;
+            }
+            if (cursors[n].contains((uint32_t)(nx + originX + (ny + originY) * map.width)) || CASDefectContains(map.columns, (uint32_t)(nx + originX))){
+                continue;
+            }
+            values[count++] = pixels[nx + ny * stride];
+        }
+        if (!count){
+            continue;
+        }
+        
+        pixels[x + y * stride] = CASDefectRound<T>(CASDefectNeighbourMedian(values, count));
+        ++corrected;
+    }
+    
+    for (std::vector<uint32_t>::const_iterator c = std::lower_bound(map.columns.begin(), map.columns.end(), (uint32_t)originX); c != map.columns.end() && *c < originX + width; ++c){
+        
+        const size_t x = *c - originX;
+        const bool left = x >= step && !CASDefectContains(map.columns, (uint32_t)(*c - step));
+        const bool right = x + step < width && !CASDefectContains(map.columns, (uint32_t)(*c + step));
+        if (!left && !right){
+            continue;
+        }
+        
+        for (size_t y = 0; y < height; ++y){
+            T* row = pixels + y * stride;
+            if (left && right){
+                row[x] = CASDefectRound<T>(((float)row[x - step] + (float)row[x + step]) / 2);
+            }
+            else {
+                row[x] = left ? row[x - step] : row[x + step];
+            }
+        }
+        corrected += height;
+    }
+    
+    return corrected;
+}
+
+void CASDefectPut(std::vector<uint8_t>& bytes, uint32_t value)
+{
+    while (value >= 0x80){
+        bytes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((uint8_t)value);
+}
+
+bool CASDefectGet(const uint8_t*& bytes, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && bytes < end; shift += 7){
+        const uint8_t byte = *bytes++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)){
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+CASDefectThresholds CASDefectThresholdsDefault()
+{
+    CASDefectThresholds thresholds = { 8.0f, 0.5f, 6.0f };
+    return thresholds;
+}
+
+bool CASDefectMapBuild(const CASPixels& dark, const CASPixels& flat, const CASDefectThresholds& thresholds, CASDefectMap& map)
+{
+    const bool hasDark = !CASPixelsIsEmpty(dark), hasFlat = !CASPixelsIsEmpty(flat);
+    if (!hasDark && !hasFlat){
+        return false;
+    }
+    if ((hasDark && dark.format != kCASPixelFormatUInt16 && dark.format != kCASPixelFormatFloat) ||
+        (hasFlat && flat.format != kCASPixelFormatUInt16 && flat.format != kCASPixelFormatFloat)){
+        return false;
+    }
+    if (hasDark && hasFlat && (dark.width != flat.width || dark.height != flat.height)){
+        return false;
+    }
+    
+    const size_t width = hasDark ? dark.width : flat.width, height = hasDark ? dark.height : flat.height;
+    if ((uint64_t)width * height > UINT32_MAX){
+        return false;
+    }
+    
+    std::vector<bool> badColumns(width);
+    std::vector<float> darkSamples, flatSamples;
+    float hotLimit = 0;
+    const float coldFraction = thresholds.coldFraction;
+    
+    if (hasDark){
+        darkSamples = CASDefectSamples(dark);
+        CASStatistics statistics;
+        if (!CASStatisticsCompute(darkSamples.data(), darkSamples.size(), statistics)){
+            return false;
+        }
+        hotLimit = statistics.median + thresholds.hotSigma * CASDefectSigma(statistics.medianDeviation);
+        CASDefectFindColumns(darkSamples, width, height, 0, hotLimit, thresholds.columnSigma, badColumns);
+    }
+    
+    if (hasFlat){
+        flatSamples = CASDefectSamples(flat);
+        CASStatistics statistics;
+        if (!CASStatisticsCompute(flatSamples.data(), flatSamples.size(), statistics)){
+            return false;
+        }
+        const float lower = statistics.median * thresholds.coldFraction;
+        CASDefectFindColumns(flatSamples, width, height, lower, statistics.median + (statistics.median - lower), thresholds.columnSigma, badColumns);
+    }
+    
+    map.width = width;
+    map.height = height;
+    map.hot.clear();
+    map.cold.clear();
+    map.columns.clear();
+    for (size_t x = 0; x < width; ++x){
+        if (badColumns[x]){
+            map.columns.push_back((uint32_t)x);
+        }
+    }
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            if (badColumns[x]){
+                continue;
+            }
+            const size_t i = x + y * width;
+            if (hasDark && darkSamples[i] > hotLimit){
+                map.hot.push_back((uint32_t)i);
+            }
+            else if (hasFlat && flatSamples[i] < coldFraction * CASDefectNeighbourMedian(flatSamples, width, height, x, y)){
+                map.cold.push_back((uint32_t)i);
+            }
+        }
+    }
+    
+    return true;
+}
+
+bool CASDefectMapIsDefect(const CASDefectMap& map, size_t x, size_t y)
+{
+    if (x >= map.width || y >= map.height){
+        return false;
+    }
+    const uint32_t i = (uint32_t)(x + y * map.width);
+    return CASDefectContains(map.columns, (uint32_t)x) || CASDefectContains(map.hot, i) || CASDefectContains(map.cold, i);
+}
+
+size_t CASDefectMapCorrect(const CASDefectMap& map, uint16_t* pixels, size_t width, size_t height, size_t stride, size_t originX, size_t originY, size_t step)
+{
+    return CASDefectCorrect(map, pixels, width, height, stride, originX, originY, step);
+}
+
+size_t CASDefectMapCorrect(const CASDefectMap& map, float* pixels, size_t width, size_t height, size_t stride, size_t originX, size_t originY, size_t step)
+{
+    return CASDefectCorrect(map, pixels, width, height, stride, originX, originY, step);
+}
+
+void CASDefectMapEncode(const CASDefectMap& map, std::vector<uint8_t>& bytes)
+{
+    bytes.clear();
+    const uint32_t header[] = {
+        CAS_DEFECT_MAGIC, CAS_DEFECT_VERSION, (uint32_t)map.width, (uint32_t)map.height,
+        (uint32_t)map.hot.size(), (uint32_t)map.cold.size(), (uint32_t)map.columns.size()
+    };
+    for (size_t i = 0; i < sizeof(header)/sizeof(header[0]); ++i){
+        CASDefectPut(bytes, header[i]);
+    }
+    const std::vector<uint32_t>* lists[] = { &map.hot, &map.cold, &map.columns };
+    for (size_t l = 0; l < 3; ++l){
+        uint32_t previous = 0;
+        for (size_t i = 0; i < lists[l]->size(); ++i){
+            const uint32_t value = (*lists[l])[i];
+            CASDefectPut(bytes, value - previous);
+            previous = value;
+        }
+    }
+}
+
+bool CASDefectMapDecode(const void* bytes, size_t length, CASDefectMap& map)
+{
+    if (!bytes){
+        return false;
+    }
+    
+    const uint8_t* p = (const uint8_t*)bytes;
+    const uint8_t* end = p + length;
+    uint32_t header[7];
+    for (size_t i = 0; i < 7; ++i){
+        if (!CASDefectGet(p, end, header[i])){
+            return false;
+        }
+    }
+    if (header[0] != CAS_DEFECT_MAGIC || header[1] != CAS_DEFECT_VERSION){
+        return false;
+    }
+    
+    // every entry takes at least a byte, so a count bigger than what's left is a corrupt file
+    const uint64_t total = (uint64_t)header[4] + header[5] + header[6];
+    if (total > (uint64_t)(end - p)){
+        return false;
+    }
+    
+    CASDefectMap decoded;
+    decoded.width = header[2];
+    decoded.height = header[3];
+    std::vector<uint32_t>* lists[] = { &decoded.hot, &decoded.cold, &decoded.columns };
+    const uint64_t limits[] = { (uint64_t)decoded.width * decoded.height, (uint64_t)decoded.width * decoded.height, decoded.width };
+    for (size_t l = 0; l < 3; ++l){
+        uint64_t value = 0;
+        lists[l]->reserve(header[4 + l]);
+        for (uint32_t i = 0; i < header[4 + l]; ++i){
+            uint32_t delta;
+            if (!CASDefectGet(p, end, delta)){
+                return false;
+            }
+            value += delta;
+            if (value >= limits[l] || (i && !delta)){
+                return false;
+            }
+            lists[l]->push_back((uint32_t)value);
+        }
+    }
+    
+    map = decoded;
+    return true;
+}
@@ -0,0 +1,69 @@
+//
+//  CASDefectMap.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Hot and cold pixels and bad columns of a sensor, found once from its master dark and flat and kept as
+//  short sorted lists of coordinates. Correcting a frame only visits those coordinates, replacing each
+//  with its good neighbours of the same colour, so it's cheap enough to run on every guide frame in place
+//  of a median filter over the whole thing.
+
+#ifndef __CASDefectMap_h__
+#define __CASDefectMap_h__
+
+#include "CASPixelView.h"
+#include <vector>
+
+// pixels are y * width + x at the sensor's full, unbinned size, all three lists are ascending
+struct CASDefectMap {
+    size_t width, height;
+    std::vector<uint32_t> hot;
+    std::vector<uint32_t> cold;
+    std::vector<uint32_t> columns;
+};
+
+struct CASDefectThresholds {
+    float hotSigma;         // dark pixels this many robust standard deviations above the dark's median are hot
+    float coldFraction;     // flat pixels below this fraction of their neighbours are cold
+    float columnSigma;      // columns whose mean is this many robust standard deviations from their neighbours' are bad
+};
+
+CASDefectThresholds CASDefectThresholdsDefault();
+
+// dark and flat are mono 16-bit or float frames the same size, either can be empty but not both. pixels in a bad
+// column are left out of the hot and cold lists as the whole column gets replaced anyway
+bool CASDefectMapBuild(const CASPixels& dark, const CASPixels& flat, const CASDefectThresholds& thresholds, CASDefectMap& map);
+
+bool CASDefectMapIsDefect(const CASDefectMap& map, size_t x, size_t y);
+
+// corrects the width x height frame in place, its top left at originX,originY on the sensor for subframes. defects are
+// replaced by the median of the good pixels step away in each direction, or the average of the good columns step to
+// either side; step is 1 for mono sensors and 2 for bayer ones so only pixels of the same colour are used. returns
+// the number of pixels changed
+size_t CASDefectMapCorrect(const CASDefectMap& map, uint16_t* pixels, size_t width, size_t height, size_t stride, size_t originX, size_t originY, size_t step);
+size_t CASDefectMapCorrect(const CASDefectMap& map, float* pixels, size_t width, size_t height, size_t stride, size_t originX, size_t originY, size_t step);
+
+// a few bytes a defect, coordinates are stored as variable length differences from the previous one
+void CASDefectMapEncode(const CASDefectMap& map, std::vector<uint8_t>& bytes);
+bool CASDefectMapDecode(const void* bytes, size_t length, CASDefectMap& map);
+
+#endif
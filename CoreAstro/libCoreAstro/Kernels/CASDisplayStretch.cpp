@@ -0,0 +1,171 @@
+//
+//  CASDisplayStretch.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASDisplayStretch.h"
+#include <algorithm>
+#include <math.h>
+
+// samples per unit of work when rescaling
+static const size_t kCASDisplayStretchRescalePixels = 64 * 1024;
+
+static void CASDisplayStretchApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+CASDisplayStretch CASDisplayStretchMake(float lower, float upper, float midtone, float gamma)
+{
+    CASDisplayStretch stretch = { lower, upper, midtone, gamma };
+    return stretch;
+}
+
+void CASDisplayStretchBuildTable(const CASDisplayStretch& stretch, float maxSampleValue, uint8_t* table)
+{
+    const double lower = std::max(0.0f, stretch.lower) * (double)maxSampleValue;
+    const double upper = std::max(stretch.lower, stretch.upper) * (double)maxSampleValue;
+    const double m = stretch.midtone;
+    const bool mtf = (m > 0 && m < 1 && m != 0.5);
+    const bool gamma = (stretch.gamma > 0 && stretch.gamma != 1);
+    
+    // only the samples between the black and white points need the transfer functions evaluating
+    const size_t first = std::min<double>(CAS_DISPLAY_STRETCH_TABLE_SIZE, ceil(lower));
+    const size_t last = std::min<double>(CAS_DISPLAY_STRETCH_TABLE_SIZE, floor(upper) + 1);
+    std::fill(table, table + first, 0);
+    std::fill(table + std::max(first, last), table + CAS_DISPLAY_STRETCH_TABLE_SIZE, 255);
+    
+    const double scale = (upper > lower) ? 1.0 / (upper - lower) : 0;
+    for (size_t i = first; i < last; ++i){
+        double x = (i - lower) * scale;
+        if (mtf){
+            x = ((m - 1) * x) / (((2 * m - 1) * x) - m);
+        }
+        if (gamma){
+            x = pow(x, (double)stretch.gamma);
+        }
+        table[i] = (uint8_t)(std::min(1.0, std::max(0.0, x)) * 255.0 + 0.5);
+    }
+}
+
+struct CASDisplayStretchU16Sampler {
+    typedef uint16_t Sample;
+    static inline uint16_t index(uint16_t v) { return v; }
+};
+
+struct CASDisplayStretchFloatSampler {
+    typedef float Sample;
+    static inline uint16_t index(float v) { return (uint16_t)(std::min(1.0f, std::max(0.0f, v)) * 65535.0f + 0.5f); }
+};
+
+template <typename Sampler>
+struct CASDisplayStretchPass {
+    const typename Sampler::Sample* pixels;
+    size_t width, height, channelCount;
+    const uint8_t* table;
+    uint8_t* out;
+    size_t bytesPerRow;
+    
+    static void tile(void* context, size_t tile) {
+        const CASDisplayStretchPass& pass = *(const CASDisplayStretchPass*)context;
+        const size_t start = tile * CAS_DISPLAY_STRETCH_TILE_ROWS;
+        const size_t end = std::min(pass.height, start + CAS_DISPLAY_STRETCH_TILE_ROWS);
+        const uint8_t* table = pass.table;
+        for (size_t y = start; y < end; ++y){
+            const typename Sampler::Sample* p = pass.pixels + y * pass.width * pass.channelCount;
+            uint8_t* o = pass.out + y * pass.bytesPerRow;
+            if (pass.channelCount == 1){
+                for (size_t x = 0; x < pass.width; ++x){
+                    o[x] = table[Sampler::index(p[x])];
+                }
+            }
+            else {
+                for (size_t x = 0; x < pass.width; ++x, p += 4, o += 4){
+                    o[0] = table[Sampler::index(p[0])];
+                    o[1] = table[Sampler::index(p[1])];
+                    o[2] = table[Sampler::index(p[2])];
+                    o[3] = 255;
+                }
+            }
+        }
+    }
+};
+
+template <typename Sampler>
+static bool CASDisplayStretchApplyTableT(const typename Sampler::Sample* pixels, size_t width, size_t height, size_t channelCount, const uint8_t* table, uint8_t* out, size_t bytesPerRow, CASDisplayStretchApply apply)
+{
+    if (!pixels || !table || !out || (channelCount != 1 && channelCount != 4) || bytesPerRow < width * channelCount){
+        return false;
+    }
+    if (!apply){
+        apply = CASDisplayStretchApplyInOrder;
+    }
+    
+    CASDisplayStretchPass<Sampler> pass = { pixels, width, height, channelCount, table, out, bytesPerRow };
+    const size_t tileCount = (height + CAS_DISPLAY_STRETCH_TILE_ROWS - 1) / CAS_DISPLAY_STRETCH_TILE_ROWS;
+    apply(tileCount, &pass, CASDisplayStretchPass<Sampler>::tile);
+    return true;
+}
+
+bool CASDisplayStretchApplyTable(const uint16_t* pixels, size_t width, size_t height, size_t channelCount, const uint8_t* table, uint8_t* out, size_t bytesPerRow, CASDisplayStretchApply apply)
+{
+    return CASDisplayStretchApplyTableT<CASDisplayStretchU16Sampler>(pixels, width, height, channelCount, table, out, bytesPerRow, apply);
+}
+
+bool CASDisplayStretchApplyTable(const float* pixels, size_t width, size_t height, size_t channelCount, const uint8_t* table, uint8_t* out, size_t bytesPerRow, CASDisplayStretchApply apply)
+{
+    return CASDisplayStretchApplyTableT<CASDisplayStretchFloatSampler>(pixels, width, height, channelCount, table, out, bytesPerRow, apply);
+}
+
+struct CASDisplayStretchRescalePass {
+    const float* in;
+    float* out;
+    size_t count;
+    float lower, upper, scale;
+    
+    static void tile(void* context, size_t tile) {
+        const CASDisplayStretchRescalePass& pass = *(const CASDisplayStretchRescalePass*)context;
+        const size_t start = tile * kCASDisplayStretchRescalePixels;
+        const size_t end = std::min(pass.count, start + kCASDisplayStretchRescalePixels);
+        const float lower = pass.lower, upper = pass.upper, scale = pass.scale;
+        // min/max rather than branches so this vectorises
+        for (size_t i = start; i < end; ++i){
+            pass.out[i] = (std::min(upper, std::max(lower, pass.in[i])) - lower) * scale;
+        }
+    }
+};
+
+bool CASDisplayStretchRescale(const float* in, float* out, size_t count, float lower, float upper, float maximum, CASDisplayStretchApply apply)
+{
+    if (!in || !out || !(upper > lower)){
+        return false;
+    }
+    if (!apply){
+        apply = CASDisplayStretchApplyInOrder;
+    }
+    
+    CASDisplayStretchRescalePass pass = { in, out, count, lower, upper, maximum / (upper - lower) };
+    apply((count + kCASDisplayStretchRescalePixels - 1) / kCASDisplayStretchRescalePixels, &pass, CASDisplayStretchRescalePass::tile);
+    return true;
+}
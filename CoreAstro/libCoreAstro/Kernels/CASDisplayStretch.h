@@ -0,0 +1,65 @@
+//
+//  CASDisplayStretch.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Display stretch for previews. The stretch is baked into a 65536 entry table of 8-bit values
+//  once per frame so the pass over the pixels is a single lookup per sample, going straight from
+//  the camera's 16-bit samples, or 0-1 floats quantised to 16 bits, to 8-bit gray or RGBA.
+
+#ifndef __CASDisplayStretch_h__
+#define __CASDisplayStretch_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAS_DISPLAY_STRETCH_TABLE_SIZE 65536
+
+// rows per unit of work
+#define CAS_DISPLAY_STRETCH_TILE_ROWS 64
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order on the calling thread
+typedef void (*CASDisplayStretchApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+struct CASDisplayStretch {
+    float lower, upper; // black and white points as 0-1 fractions of the full scale sample value
+    float midtone;      // midtones transfer balance applied after the clamp, 0.5 leaves it linear
+    float gamma;        // then pow(x,gamma) as the CoreImage contrast stretch filter does, 1 leaves it linear
+};
+
+// the default is the full range with no transfer function
+CASDisplayStretch CASDisplayStretchMake(float lower, float upper, float midtone = 0.5f, float gamma = 1.0f);
+
+// fills CAS_DISPLAY_STRETCH_TABLE_SIZE entries, entry i is the display value of the sample i / maxSampleValue
+void CASDisplayStretchBuildTable(const CASDisplayStretch& stretch, float maxSampleValue, uint8_t* table);
+
+// maps the samples through the table into 8-bit rows bytesPerRow apart. channelCount is 1 for gray or 4 for
+// RGBA where the output alpha is always opaque. float samples are quantised as 16-bit with NaNs counting as 0
+// so the table for them should be built with a maxSampleValue of 65535
+bool CASDisplayStretchApplyTable(const uint16_t* pixels, size_t width, size_t height, size_t channelCount, const uint8_t* table, uint8_t* out, size_t bytesPerRow, CASDisplayStretchApply apply = NULL);
+bool CASDisplayStretchApplyTable(const float* pixels, size_t width, size_t height, size_t channelCount, const uint8_t* table, uint8_t* out, size_t bytesPerRow, CASDisplayStretchApply apply = NULL);
+
+// out = (clamp(in, lower, upper) - lower) * maximum / (upper - lower), the same linear stretch in float for
+// exposures that are processed further. out may be in
+bool CASDisplayStretchRescale(const float* in, float* out, size_t count, float lower, float upper, float maximum, CASDisplayStretchApply apply = NULL);
+
+#endif
@@ -0,0 +1,775 @@
+//
+//  CASFFT.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  The complex transforms are decimation in time over the factors, recursing down to the input
+//  and then running the butterflies for each radix on the way back up.
+
+#include "CASFFT.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <math.h>
+
+// elements per unit of work in the pointwise passes
+#define CAS_FFT_CHUNK (64*1024)
+
+// smallest estimate Richardson-Lucy divides by
+#define CAS_FFT_RL_EPSILON 1e-6f
+
+// products written out so they don't go through the NaN and infinity handling of std::complex multiplication
+static inline CASFFTComplex CASFFTMultiply(const CASFFTComplex& a, const CASFFTComplex& b)
+{
+    return CASFFTComplex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+static inline CASFFTComplex CASFFTMultiplyConjugate(const CASFFTComplex& a, const CASFFTComplex& b) // conj(a) * b
+{
+    return CASFFTComplex(a.real() * b.real() + a.imag() * b.imag(), a.real() * b.imag() - a.imag() * b.real());
+}
+
+static bool CASFFTSmooth(size_t n)
+{
+    const size_t primes[] = { 2, 3, 5 };
+    for (size_t i = 0; i < 3 && n > 1; ++i){
+        while (n % primes[i] == 0){
+            n /= primes[i];
+        }
+    }
+    return n == 1;
+}
+
+size_t CASFFTGoodSize(size_t n)
+{
+    size_t size = std::max<size_t>(n, 2);
+    size += size % 2;
+    while (!CASFFTSmooth(size)){
+        size += 2;
+    }
+    return size;
+}
+
+static bool CASFFTMakeFactors(size_t length, CASFFTFactors& plan)
+{
+    plan.length = length;
+    plan.factors.clear();
+    for (size_t n = length; n > 1;){
+        size_t p;
+        if (n % 4 == 0){
+            p = 4;
+        }
+        else if (n % 2 == 0){
+            p = 2;
+        }
+        else if (n % 3 == 0){
+            p = 3;
+        }
+        else if (n % 5 == 0){
+            p = 5;
+        }
+        else {
+            return false;
+        }
+        n /= p;
+        plan.factors.push_back(p);
+        plan.factors.push_back(n);
+    }
+    plan.twiddles.resize(length);
+    for (size_t k = 0; k < length; ++k){
+        const double phase = -2 * M_PI * k / length;
+        plan.twiddles[k] = CASFFTComplex(cos(phase), sin(phase));
+    }
+    return true;
+}
+
+// the butterflies work on CAS_FFT_LANES sequences at once with element k of each in the k'th lane vector, real
+// and imaginary parts apart, and leave it to the compiler to map the vectors onto whatever registers the target has
+typedef float CASFFTLane __attribute__((vector_size(CAS_FFT_LANES * sizeof(float)), aligned(sizeof(float))));
+
+static void CASFFTButterfly2(CASFFTLane* re, CASFFTLane* im, size_t fstride, const CASFFTComplex* twiddles, size_t m)
+{
+    for (size_t k = 0; k < m; ++k){
+        const float wr = twiddles[k * fstride].real(), wi = twiddles[k * fstride].imag();
+        const CASFFTLane tr = re[k + m] * wr - im[k + m] * wi;
+        const CASFFTLane ti = re[k + m] * wi + im[k + m] * wr;
+        re[k + m] = re[k] - tr;
+        im[k + m] = im[k] - ti;
+        re[k] += tr;
+        im[k] += ti;
+    }
+}
+
+static void CASFFTButterfly3(CASFFTLane* re, CASFFTLane* im, size_t fstride, const CASFFTComplex* twiddles, size_t m)
+{
+    const float sin3 = twiddles[fstride * m].imag(); // -sin(2 pi / 3)
+    for (size_t k = 0; k < m; ++k){
+        const float w1r = twiddles[k * fstride].real(), w1i = twiddles[k * fstride].imag();
+        const float w2r = twiddles[2 * k * fstride].real(), w2i = twiddles[2 * k * fstride].imag();
+        const size_t k1 = k + m, k2 = k + 2 * m;
+        const CASFFTLane s1r = re[k1] * w1r - im[k1] * w1i, s1i = re[k1] * w1i + im[k1] * w1r;
+        const CASFFTLane s2r = re[k2] * w2r - im[k2] * w2i, s2i = re[k2] * w2i + im[k2] * w2r;
+        const CASFFTLane sr = s1r + s2r, si = s1i + s2i;
+        const CASFFTLane dr = (s1r - s2r) * sin3, di = (s1i - s2i) * sin3;
+        const CASFFTLane ar = re[k] - 0.5f * sr, ai = im[k] - 0.5f * si;
+        re[k] += sr;
+        im[k] += si;
+        re[k1] = ar - di;
+        im[k1] = ai + dr;
+        re[k2] = ar + di;
+        im[k2] = ai - dr;
+    }
+}
+
+static void CASFFTButterfly4(CASFFTLane* re, CASFFTLane* im, size_t fstride, const CASFFTComplex* twiddles, size_t m)
+{
+    for (size_t k = 0; k < m; ++k){
+        const float w1r = twiddles[k * fstride].real(), w1i = twiddles[k * fstride].imag();
+        const float w2r = twiddles[2 * k * fstride].real(), w2i = twiddles[2 * k * fstride].imag();
+        const float w3r = twiddles[3 * k * fstride].real(), w3i = twiddles[3 * k * fstride].imag();
+        const size_t k1 = k + m, k2 = k + 2 * m, k3 = k + 3 * m;
+        const CASFFTLane s0r = re[k1] * w1r - im[k1] * w1i, s0i = re[k1] * w1i + im[k1] * w1r;
+        const CASFFTLane s1r = re[k2] * w2r - im[k2] * w2i, s1i = re[k2] * w2i + im[k2] * w2r;
+        const CASFFTLane s2r = re[k3] * w3r - im[k3] * w3i, s2i = re[k3] * w3i + im[k3] * w3r;
+        const CASFFTLane s5r = re[k] - s1r, s5i = im[k] - s1i;
+        const CASFFTLane ar = re[k] + s1r, ai = im[k] + s1i;
+        const CASFFTLane s3r = s0r + s2r, s3i = s0i + s2i;
+        const CASFFTLane s4r = s0r - s2r, s4i = s0i - s2i;
+        re[k] = ar + s3r;
+        im[k] = ai + s3i;
+        re[k2] = ar - s3r;
+        im[k2] = ai - s3i;
+        re[k1] = s5r + s4i;
+        im[k1] = s5i - s4r;
+        re[k3] = s5r - s4i;
+        im[k3] = s5i + s4r;
+    }
+}
+
+static void CASFFTButterfly5(CASFFTLane* re, CASFFTLane* im, size_t fstride, const CASFFTComplex* twiddles, size_t m)
+{
+    const float yar = twiddles[fstride * m].real(), yai = twiddles[fstride * m].imag(); // exp(-2 pi i / 5)
+    const float ybr = twiddles[2 * fstride * m].real(), ybi = twiddles[2 * fstride * m].imag(); // and its square
+    for (size_t k = 0; k < m; ++k){
+        const float w1r = twiddles[k * fstride].real(), w1i = twiddles[k * fstride].imag();
+        const float w2r = twiddles[2 * k * fstride].real(), w2i = twiddles[2 * k * fstride].imag();
+        const float w3r = twiddles[3 * k * fstride].real(), w3i = twiddles[3 * k * fstride].imag();
+        const float w4r = twiddles[4 * k * fstride].real(), w4i = twiddles[4 * k * fstride].imag();
+        const size_t k1 = k + m, k2 = k + 2 * m, k3 = k + 3 * m, k4 = k + 4 * m;
+        const CASFFTLane s1r = re[k1] * w1r - im[k1] * w1i, s1i = re[k1] * w1i + im[k1] * w1r;
+        const CASFFTLane s2r = re[k2] * w2r - im[k2] * w2i, s2i = re[k2] * w2i + im[k2] * w2r;
+        const CASFFTLane s3r = re[k3] * w3r - im[k3] * w3i, s3i = re[k3] * w3i + im[k3] * w3r;
+        const CASFFTLane s4r = re[k4] * w4r - im[k4] * w4i, s4i = re[k4] * w4i + im[k4] * w4r;
+        const CASFFTLane s7r = s1r + s4r, s7i = s1i + s4i;
+        const CASFFTLane s10r = s1r - s4r, s10i = s1i - s4i;
+        const CASFFTLane s8r = s2r + s3r, s8i = s2i + s3i;
+        const CASFFTLane s9r = s2r - s3r, s9i = s2i - s3i;
+        const CASFFTLane s0r = re[k], s0i = im[k];
+        const CASFFTLane s5r = s0r + s7r * yar + s8r * ybr, s5i = s0i + s7i * yar + s8i * ybr;
+        const CASFFTLane s6r = s10i * yai + s9i * ybi, s6i = -s10r * yai - s9r * ybi;
+        const CASFFTLane s11r = s0r + s7r * ybr + s8r * yar, s11i = s0i + s7i * ybr + s8i * yar;
+        const CASFFTLane s12r = s9i * yai - s10i * ybi, s12i = s10r * ybi - s9r * yai;
+        re[k] = s0r + s7r + s8r;
+        im[k] = s0i + s7i + s8i;
+        re[k1] = s5r - s6r;
+        im[k1] = s5i - s6i;
+        re[k4] = s5r + s6r;
+        im[k4] = s5i + s6i;
+        re[k2] = s11r + s12r;
+        im[k2] = s11i + s12i;
+        re[k3] = s11r - s12r;
+        im[k3] = s11i - s12i;
+    }
+}
+
+static void CASFFTWork(CASFFTLane* outRe, CASFFTLane* outIm, const CASFFTLane* inRe, const CASFFTLane* inIm, size_t fstride, const size_t* factors, const CASFFTFactors& plan)
+{
+    const size_t p = factors[0], m = factors[1];
+    if (m == 1){
+        for (size_t q = 0; q < p; ++q){
+            outRe[q] = inRe[q * fstride];
+            outIm[q] = inIm[q * fstride];
+        }
+    }
+    else {
+        for (size_t q = 0; q < p; ++q){
+            CASFFTWork(outRe + q * m, outIm + q * m, inRe + q * fstride, inIm + q * fstride, fstride * p, factors + 2, plan);
+        }
+    }
+    
+    const CASFFTComplex* twiddles = plan.twiddles.data();
+    switch (p) {
+        case 2:
+            CASFFTButterfly2(outRe, outIm, fstride, twiddles, m);
+            break;
+        case 3:
+            CASFFTButterfly3(outRe, outIm, fstride, twiddles, m);
+            break;
+        case 4:
+            CASFFTButterfly4(outRe, outIm, fstride, twiddles, m);
+            break;
+        default:
+            CASFFTButterfly5(outRe, outIm, fstride, twiddles, m);
+            break;
+    }
+}
+
+// CAS_FFT_LANES sequences of one length laid out as for the butterflies, with room for the input and the output
+struct CASFFTLanes {
+    std::vector<float> buffer;
+    float *inRe, *inIm, *outRe, *outIm;
+    explicit CASFFTLanes(size_t length) : buffer(4 * length * CAS_FFT_LANES) {
+        inRe = buffer.data();
+        inIm = inRe + length * CAS_FFT_LANES;
+        outRe = inIm + length * CAS_FFT_LANES;
+        outIm = outRe + length * CAS_FFT_LANES;
+    }
+};
+
+// forward transforms of the lanes' input into their output. inverses go through here too as conj(fft(conj(x)))
+static void CASFFTTransform(const CASFFTFactors& plan, CASFFTLanes& lanes)
+{
+    if (plan.length == 1){
+        std::copy(lanes.inRe, lanes.inRe + CAS_FFT_LANES, lanes.outRe);
+        std::copy(lanes.inIm, lanes.inIm + CAS_FFT_LANES, lanes.outIm);
+    }
+    else {
+        CASFFTWork((CASFFTLane*)lanes.outRe, (CASFFTLane*)lanes.outIm, (const CASFFTLane*)lanes.inRe, (const CASFFTLane*)lanes.inIm, 1, plan.factors.data(), plan);
+    }
+}
+
+const CASFFTPlan* CASFFTPlanForSize(size_t width, size_t height)
+{
+    if (!width || !height || width % 2){
+        return NULL;
+    }
+    
+    static std::mutex lock;
+    static std::map<std::pair<size_t,size_t>,const CASFFTPlan*> plans;
+    
+    std::lock_guard<std::mutex> guard(lock);
+    
+    const std::pair<size_t,size_t> key(width, height);
+    std::map<std::pair<size_t,size_t>,const CASFFTPlan*>::const_iterator existing = plans.find(key);
+    if (existing != plans.end()){
+        return existing->second;
+    }
+    
+    CASFFTPlan* plan = new CASFFTPlan;
+    plan->width = width;
+    plan->height = height;
+    plan->spectrumWidth = width / 2 + 1;
+    if (!CASFFTMakeFactors(width / 2, plan->rows) || !CASFFTMakeFactors(height, plan->columns)){
+        delete plan;
+        return NULL;
+    }
+    plan->split.resize(plan->spectrumWidth);
+    for (size_t k = 0; k < plan->spectrumWidth; ++k){
+        const double phase = -2 * M_PI * k / width;
+        plan->split[k] = CASFFTComplex(cos(phase), sin(phase));
+    }
+    plans[key] = plan;
+    
+    return plan;
+}
+
+struct CASFFTPass {
+    const CASFFTPlan* plan;
+    const float* in;
+    CASFFTComplex* spectrum;
+    float* out;
+    bool inverse;
+};
+
+// each row of real samples is transformed as a complex sequence of half the length, pairs of samples
+// packed into one value, and the transforms of the even and odd samples separated out afterwards
+static void CASFFTRowsForward(void* context, size_t group)
+{
+    const CASFFTPass& pass = *(const CASFFTPass*)context;
+    const CASFFTPlan& plan = *pass.plan;
+    const size_t half = plan.rows.length;
+    const size_t y0 = group * CAS_FFT_LANES;
+    const size_t rows = std::min<size_t>(CAS_FFT_LANES, plan.height - y0);
+    
+    CASFFTLanes lanes(half);
+    for (size_t c = 0; c < rows; ++c){
+        const float* row = pass.in + (y0 + c) * plan.width;
+        for (size_t k = 0; k < half; ++k){
+            lanes.inRe[k * CAS_FFT_LANES + c] = row[2 * k];
+            lanes.inIm[k * CAS_FFT_LANES + c] = row[2 * k + 1];
+        }
+    }
+    
+    CASFFTTransform(plan.rows, lanes);
+    
+    for (size_t c = 0; c < rows; ++c){
+        CASFFTComplex* spectrum = pass.spectrum + (y0 + c) * plan.spectrumWidth;
+        for (size_t k = 0; k <= half; ++k){
+            const size_t i = (k == half ? 0 : k) * CAS_FFT_LANES + c;
+            const size_t j = (k == 0 ? 0 : half - k) * CAS_FFT_LANES + c;
+            const CASFFTComplex z(lanes.outRe[i], lanes.outIm[i]);
+            const CASFFTComplex mirror(lanes.outRe[j], -lanes.outIm[j]);
+            const CASFFTComplex even = 0.5f * (z + mirror);
+            const CASFFTComplex difference = z - mirror;
+            const CASFFTComplex odd(0.5f * difference.imag(), -0.5f * difference.real()); // difference / 2i
+            spectrum[k] = even + CASFFTMultiply(plan.split[k], odd);
+        }
+    }
+}
+
+// the reverse of CASFFTRowsForward, rebuilding the packed transform of each row from its half spectrum
+static void CASFFTRowsInverse(void* context, size_t group)
+{
+    const CASFFTPass& pass = *(const CASFFTPass*)context;
+    const CASFFTPlan& plan = *pass.plan;
+    const size_t half = plan.rows.length;
+    const size_t y0 = group * CAS_FFT_LANES;
+    const size_t rows = std::min<size_t>(CAS_FFT_LANES, plan.height - y0);
+    const float scale = 1.0 / ((double)plan.width * plan.height);
+    
+    CASFFTLanes lanes(half);
+    for (size_t c = 0; c < rows; ++c){
+        const CASFFTComplex* spectrum = pass.spectrum + (y0 + c) * plan.spectrumWidth;
+        for (size_t k = 0; k < half; ++k){
+            const CASFFTComplex a = spectrum[k];
+            const CASFFTComplex b = std::conj(spectrum[half - k]);
+            const CASFFTComplex even = a + b;
+            const CASFFTComplex odd = CASFFTMultiplyConjugate(plan.split[k], a - b);
+            lanes.inRe[k * CAS_FFT_LANES + c] = even.real() - odd.imag(); // conj(even + i odd)
+            lanes.inIm[k * CAS_FFT_LANES + c] = -(even.imag() + odd.real());
+        }
+    }
+    
+    CASFFTTransform(plan.rows, lanes);
+    
+    for (size_t c = 0; c < rows; ++c){
+        float* row = pass.out + (y0 + c) * plan.width;
+        for (size_t k = 0; k < half; ++k){
+            row[2 * k] = lanes.outRe[k * CAS_FFT_LANES + c] * scale;
+            row[2 * k + 1] = -lanes.outIm[k * CAS_FFT_LANES + c] * scale;
+        }
+    }
+}
+
+// transforms a group of columns in place in the spectrum
+static void CASFFTColumns(void* context, size_t group)
+{
+    const CASFFTPass& pass = *(const CASFFTPass*)context;
+    const CASFFTPlan& plan = *pass.plan;
+    const size_t height = plan.height;
+    const size_t x0 = group * CAS_FFT_LANES;
+    const size_t columns = std::min<size_t>(CAS_FFT_LANES, plan.spectrumWidth - x0);
+    const float sign = pass.inverse ? -1 : 1;
+    
+    CASFFTLanes lanes(height);
+    for (size_t y = 0; y < height; ++y){
+        const CASFFTComplex* row = pass.spectrum + y * plan.spectrumWidth + x0;
+        for (size_t c = 0; c < columns; ++c){
+            lanes.inRe[y * CAS_FFT_LANES + c] = row[c].real();
+            lanes.inIm[y * CAS_FFT_LANES + c] = sign * row[c].imag();
+        }
+    }
+    
+    CASFFTTransform(plan.columns, lanes);
+    
+    for (size_t y = 0; y < height; ++y){
+        CASFFTComplex* row = pass.spectrum + y * plan.spectrumWidth + x0;
+        for (size_t c = 0; c < columns; ++c){
+            row[c] = CASFFTComplex(lanes.outRe[y * CAS_FFT_LANES + c], sign * lanes.outIm[y * CAS_FFT_LANES + c]);
+        }
+    }
+}
+
+static void CASFFTApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+bool CASFFTForward(const CASFFTPlan* plan, const float* in, CASFFTComplex* spectrum, CASFFTApply apply)
+{
+    if (!plan || !in || !spectrum){
+        return false;
+    }
+    if (!apply){
+        apply = CASFFTApplyInOrder;
+    }
+    
+    CASFFTPass pass = { plan, in, spectrum, NULL, false };
+    apply((plan->height + CAS_FFT_LANES - 1) / CAS_FFT_LANES, &pass, CASFFTRowsForward);
+    apply((plan->spectrumWidth + CAS_FFT_LANES - 1) / CAS_FFT_LANES, &pass, CASFFTColumns);
+    
+    return true;
+}
+
+bool CASFFTInverse(const CASFFTPlan* plan, CASFFTComplex* spectrum, float* out, CASFFTApply apply)
+{
+    if (!plan || !spectrum || !out){
+        return false;
+    }
+    if (!apply){
+        apply = CASFFTApplyInOrder;
+    }
+    
+    CASFFTPass pass = { plan, NULL, spectrum, out, true };
+    apply((plan->spectrumWidth + CAS_FFT_LANES - 1) / CAS_FFT_LANES, &pass, CASFFTColumns);
+    apply((plan->height + CAS_FFT_LANES - 1) / CAS_FFT_LANES, &pass, CASFFTRowsInverse);
+    
+    return true;
+}
+
+// a = a * b, a = conj(b) * a, or the phase of conj(b) * a
+struct CASFFTMultiplyPass {
+    CASFFTComplex* a;
+    const CASFFTComplex* b;
+    size_t count;
+    bool conjugate;
+    bool phase;
+};
+
+static void CASFFTMultiplyChunk(void* context, size_t chunk)
+{
+    const CASFFTMultiplyPass& pass = *(const CASFFTMultiplyPass*)context;
+    const size_t start = chunk * CAS_FFT_CHUNK;
+    const size_t end = std::min(pass.count, start + CAS_FFT_CHUNK);
+    
+    if (!pass.conjugate){
+        for (size_t i = start; i < end; ++i){
+            pass.a[i] = CASFFTMultiply(pass.a[i], pass.b[i]);
+        }
+        return;
+    }
+    for (size_t i = start; i < end; ++i){
+        pass.a[i] = CASFFTMultiplyConjugate(pass.b[i], pass.a[i]);
+    }
+    if (pass.phase){
+        for (size_t i = start; i < end; ++i){
+            const float magnitude = std::abs(pass.a[i]);
+            pass.a[i] = (magnitude > 0) ? pass.a[i] / magnitude : CASFFTComplex(0, 0);
+        }
+    }
+}
+
+static void CASFFTMultiplySpectra(CASFFTComplex* a, const CASFFTComplex* b, size_t count, bool conjugate, bool phase, CASFFTApply apply)
+{
+    CASFFTMultiplyPass pass = { a, b, count, conjugate, phase };
+    apply((count + CAS_FFT_CHUNK - 1) / CAS_FFT_CHUNK, &pass, CASFFTMultiplyChunk);
+}
+
+// copies the frame into the top left of a padded one. the first `right` columns past the frame repeat its last column and
+// the rest its first, as they wrap round to stand for negative coordinates, and the same for rows
+static void CASFFTPad(const float* in, size_t width, size_t height, size_t right, size_t bottom, float* padded, size_t paddedWidth, size_t paddedHeight)
+{
+    for (size_t y = 0; y < paddedHeight; ++y){
+        const size_t sourceRow = (y < height) ? y : ((y < height + bottom) ? height - 1 : 0);
+        const float* source = in + sourceRow * width;
+        float* row = padded + y * paddedWidth;
+        std::copy(source, source + width, row);
+        std::fill(row + width, row + std::min(paddedWidth, width + right), source[width - 1]);
+        std::fill(row + std::min(paddedWidth, width + right), row + paddedWidth, source[0]);
+    }
+}
+
+// zeros the padded frame and puts the kernel in it with its centre on the origin, wrapping round the edges
+static void CASFFTPlaceKernel(const float* kernel, size_t kernelWidth, size_t kernelHeight, float scale, float* padded, size_t paddedWidth, size_t paddedHeight)
+{
+    std::fill(padded, padded + paddedWidth * paddedHeight, 0.0f);
+    const size_t cx = kernelWidth / 2, cy = kernelHeight / 2;
+    for (size_t j = 0; j < kernelHeight; ++j){
+        const size_t y = (j + paddedHeight - cy) % paddedHeight;
+        for (size_t i = 0; i < kernelWidth; ++i){
+            const size_t x = (i + paddedWidth - cx) % paddedWidth;
+            padded[y * paddedWidth + x] = kernel[j * kernelWidth + i] * scale;
+        }
+    }
+}
+
+static void CASFFTCrop(const float* padded, size_t paddedWidth, float* out, size_t width, size_t height)
+{
+    for (size_t y = 0; y < height; ++y){
+        std::copy(padded + y * paddedWidth, padded + y * paddedWidth + width, out + y * width);
+    }
+}
+
+bool CASFFTConvolve(const float* in, float* out, size_t width, size_t height, const float* kernel, size_t kernelWidth, size_t kernelHeight, CASFFTApply apply)
+{
+    if (!in || !out || !width || !height || !kernel || !kernelWidth || !kernelHeight){
+        return false;
+    }
+    if (!apply){
+        apply = CASFFTApplyInOrder;
+    }
+    
+    const CASFFTPlan* plan = CASFFTPlanForSize(CASFFTGoodSize(width + kernelWidth - 1), CASFFTGoodSize(height + kernelHeight - 1));
+    if (!plan){
+        return false;
+    }
+    const size_t paddedCount = plan->width * plan->height;
+    const size_t spectrumCount = plan->spectrumWidth * plan->height;
+    
+    std::vector<float> padded(paddedCount);
+    std::vector<CASFFTComplex> spectrum(spectrumCount), kernelSpectrum(spectrumCount);
+    
+    CASFFTPlaceKernel(kernel, kernelWidth, kernelHeight, 1, padded.data(), plan->width, plan->height);
+    CASFFTForward(plan, padded.data(), kernelSpectrum.data(), apply);
+    
+    CASFFTPad(in, width, height, kernelWidth / 2, kernelHeight / 2, padded.data(), plan->width, plan->height);
+    CASFFTForward(plan, padded.data(), spectrum.data(), apply);
+    
+    CASFFTMultiplySpectra(spectrum.data(), kernelSpectrum.data(), spectrumCount, false, false, apply);
+    CASFFTInverse(plan, spectrum.data(), padded.data(), apply);
+    CASFFTCrop(padded.data(), plan->width, out, width, height);
+    
+    return true;
+}
+
+// copies the frame into the top left of a zero padded one with its mean taken off
+static void CASFFTCentre(const float* in, size_t width, size_t height, float* padded, size_t paddedWidth, size_t paddedHeight)
+{
+    double total = 0;
+    for (size_t i = 0; i < width * height; ++i){
+        total += in[i];
+    }
+    const float mean = total / (width * height);
+    std::fill(padded, padded + paddedWidth * paddedHeight, 0.0f);
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            padded[y * paddedWidth + x] = in[y * width + x] - mean;
+        }
+    }
+}
+
+bool CASFFTCrossCorrelate(const float* a, const float* b, float* out, size_t width, size_t height, CASFFTApply apply)
+{
+    const CASFFTPlan* plan = CASFFTPlanForSize(width, height);
+    if (!plan || !a || !b || !out){
+        return false;
+    }
+    if (!apply){
+        apply = CASFFTApplyInOrder;
+    }
+    
+    const size_t spectrumCount = plan->spectrumWidth * height;
+    std::vector<float> centred(width * height);
+    std::vector<CASFFTComplex> spectrumA(spectrumCount), spectrumB(spectrumCount);
+    
+    CASFFTCentre(a, width, height, centred.data(), width, height);
+    CASFFTForward(plan, centred.data(), spectrumA.data(), apply);
+    CASFFTCentre(b, width, height, centred.data(), width, height);
+    CASFFTForward(plan, centred.data(), spectrumB.data(), apply);
+    
+    CASFFTMultiplySpectra(spectrumB.data(), spectrumA.data(), spectrumCount, true, false, apply);
+    
+    return CASFFTInverse(plan, spectrumB.data(), out, apply);
+}
+
+// tapers the outer eighth of each side down to zero so the frame edges don't correlate with each other
+static void CASFFTTaper(float* padded, size_t paddedWidth, size_t width, size_t height)
+{
+    std::vector<float> wx(width, 1.0f), wy(height, 1.0f);
+    const size_t tx = width / 8, ty = height / 8;
+    for (size_t i = 0; i < tx; ++i){
+        wx[i] = wx[width - 1 - i] = 0.5f - 0.5f * cosf(M_PI * (i + 0.5f) / tx);
+    }
+    for (size_t i = 0; i < ty; ++i){
+        wy[i] = wy[height - 1 - i] = 0.5f - 0.5f * cosf(M_PI * (i + 0.5f) / ty);
+    }
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            padded[y * paddedWidth + x] *= wx[x] * wy[y];
+        }
+    }
+}
+
+// the offset of the top of a parabola through three equally spaced values from the middle one
+static float CASFFTParabolaPeak(float before, float middle, float after)
+{
+    const float curvature = before - 2 * middle + after;
+    return (curvature < 0) ? 0.5f * (before - after) / curvature : 0;
+}
+
+bool CASFFTRegister(const float* reference, const float* image, size_t width, size_t height, float& dx, float& dy, CASFFTApply apply)
+{
+    if (!reference || !image || !width || !height){
+        return false;
+    }
+    if (!apply){
+        apply = CASFFTApplyInOrder;
+    }
+    
+    const CASFFTPlan* plan = CASFFTPlanForSize(CASFFTGoodSize(width), CASFFTGoodSize(height));
+    if (!plan){
+        return false;
+    }
+    const size_t pw = plan->width, ph = plan->height;
+    const size_t spectrumCount = plan->spectrumWidth * ph;
+    
+    std::vector<float> padded(pw * ph);
+    std::vector<CASFFTComplex> spectrumReference(spectrumCount), spectrumImage(spectrumCount);
+    
+    CASFFTCentre(reference, width, height, padded.data(), pw, ph);
+    CASFFTTaper(padded.data(), pw, width, height);
+    CASFFTForward(plan, padded.data(), spectrumReference.data(), apply);
+    CASFFTCentre(image, width, height, padded.data(), pw, ph);
+    CASFFTTaper(padded.data(), pw, width, height);
+    CASFFTForward(plan, padded.data(), spectrumImage.data(), apply);
+    
+    CASFFTMultiplySpectra(spectrumImage.data(), spectrumReference.data(), spectrumCount, true, true, apply);
+    CASFFTInverse(plan, spectrumImage.data(), padded.data(), apply);
+    
+    const size_t peak = std::max_element(padded.begin(), padded.end()) - padded.begin();
+    const size_t px = peak % pw, py = peak / pw;
+    const float* row = padded.data() + py * pw;
+    const float x = px + CASFFTParabolaPeak(row[(px + pw - 1) % pw], row[px], row[(px + 1) % pw]);
+    const float y = py + CASFFTParabolaPeak(padded[((py + ph - 1) % ph) * pw + px], row[px], padded[((py + 1) % ph) * pw + px]);
+    dx = (x > pw / 2) ? x - pw : x;
+    dy = (y > ph / 2) ? y - ph : y;
+    
+    return true;
+}
+
+bool CASFFTMeasurePSF(const float* in, size_t width, size_t height, float x, float y, size_t radius, float* psf)
+{
+    const ptrdiff_t cx = lroundf(x), cy = lroundf(y), r = radius;
+    if (!in || !psf || cx < r || cy < r || cx + r >= (ptrdiff_t)width || cy + r >= (ptrdiff_t)height){
+        return false;
+    }
+    
+    const size_t size = 2 * radius + 1;
+    const float* origin = in + (cy - r) * width + (cx - r);
+    
+    std::vector<float> border;
+    for (size_t j = 0; j < size; ++j){
+        for (size_t i = 0; i < size; ++i){
+            if (i == 0 || j == 0 || i == size - 1 || j == size - 1){
+                border.push_back(origin[j * width + i]);
+            }
+        }
+    }
+    std::nth_element(border.begin(), border.begin() + border.size() / 2, border.end());
+    const float sky = border[border.size() / 2];
+    
+    double total = 0;
+    for (size_t j = 0; j < size; ++j){
+        for (size_t i = 0; i < size; ++i){
+            total += psf[j * size + i] = std::max(0.0f, origin[j * width + i] - sky);
+        }
+    }
+    if (total <= 0){
+        return false;
+    }
+    for (size_t i = 0; i < size * size; ++i){
+        psf[i] /= total;
+    }
+    
+    return true;
+}
+
+// blurred = observed / blurred, or estimate *= max(0, blurred) for the update
+struct CASFFTLucyPass {
+    const float* observed;
+    float* blurred;
+    float* estimate;
+    size_t count;
+    bool update;
+};
+
+static void CASFFTLucyChunk(void* context, size_t chunk)
+{
+    const CASFFTLucyPass& pass = *(const CASFFTLucyPass*)context;
+    const size_t start = chunk * CAS_FFT_CHUNK;
+    const size_t end = std::min(pass.count, start + CAS_FFT_CHUNK);
+    
+    if (pass.update){
+        for (size_t i = start; i < end; ++i){
+            pass.estimate[i] *= std::max(0.0f, pass.blurred[i]);
+        }
+    }
+    else {
+        for (size_t i = start; i < end; ++i){
+            pass.blurred[i] = pass.observed[i] / std::max(CAS_FFT_RL_EPSILON, pass.blurred[i]);
+        }
+    }
+}
+
+bool CASFFTRichardsonLucy(const float* in, float* out, size_t width, size_t height, const float* psf, size_t psfWidth, size_t psfHeight, int iterations, CASFFTApply apply)
+{
+    if (!in || !out || !width || !height || !psf || !psfWidth || !psfHeight || iterations < 0){
+        return false;
+    }
+    if (!apply){
+        apply = CASFFTApplyInOrder;
+    }
+    
+    double total = 0;
+    for (size_t i = 0; i < psfWidth * psfHeight; ++i){
+        total += psf[i];
+    }
+    if (total <= 0){
+        return false;
+    }
+    
+    const CASFFTPlan* plan = CASFFTPlanForSize(CASFFTGoodSize(width + psfWidth - 1), CASFFTGoodSize(height + psfHeight - 1));
+    if (!plan){
+        return false;
+    }
+    const size_t paddedCount = plan->width * plan->height;
+    const size_t spectrumCount = plan->spectrumWidth * plan->height;
+    
+    std::vector<float> observed(paddedCount), estimate(paddedCount), blurred(paddedCount);
+    std::vector<CASFFTComplex> spectrum(spectrumCount), psfSpectrum(spectrumCount);
+    
+    CASFFTPlaceKernel(psf, psfWidth, psfHeight, 1 / total, blurred.data(), plan->width, plan->height);
+    CASFFTForward(plan, blurred.data(), psfSpectrum.data(), apply);
+    
+    // start from the observed frame, kept just above 0 so every pixel can still change
+    CASFFTPad(in, width, height, psfWidth / 2, psfHeight / 2, observed.data(), plan->width, plan->height);
+    for (size_t i = 0; i < paddedCount; ++i){
+        observed[i] = std::max(0.0f, observed[i]);
+        estimate[i] = std::max(CAS_FFT_RL_EPSILON, observed[i]);
+    }
+    
+    CASFFTLucyPass ratio = { observed.data(), blurred.data(), estimate.data(), paddedCount, false };
+    CASFFTLucyPass update = ratio;
+    update.update = true;
+    const size_t chunks = (paddedCount + CAS_FFT_CHUNK - 1) / CAS_FFT_CHUNK;
+    
+    for (int i = 0; i < iterations; ++i){
+        
+        // ratio of the observed frame to the current estimate blurred by the psf
+        CASFFTForward(plan, estimate.data(), spectrum.data(), apply);
+        CASFFTMultiplySpectra(spectrum.data(), psfSpectrum.data(), spectrumCount, false, false, apply);
+        CASFFTInverse(plan, spectrum.data(), blurred.data(), apply);
+        apply(chunks, &ratio, CASFFTLucyChunk);
+        
+        // correlated with the psf, the convolution with it mirrored, to give the correction
+        CASFFTForward(plan, blurred.data(), spectrum.data(), apply);
+        CASFFTMultiplySpectra(spectrum.data(), psfSpectrum.data(), spectrumCount, true, false, apply);
+        CASFFTInverse(plan, spectrum.data(), blurred.data(), apply);
+        apply(chunks, &update, CASFFTLucyChunk);
+    }
+    
+    CASFFTCrop(estimate.data(), plan->width, out, width, height);
+    
+    return true;
+}
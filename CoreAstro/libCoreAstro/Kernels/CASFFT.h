@@ -0,0 +1,94 @@
+//
+//  CASFFT.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Real to complex 2-D FFTs for frequency domain work on whole frames, with convolution, cross
+//  correlation and Richardson-Lucy deconvolution built on top. Transforms are mixed radix 2, 3 and 5
+//  so frames only need padding to the next size with those factors rather than the next power of two.
+//  Rows are transformed as complex sequences of half the length, then the columns, each in groups
+//  gathered into interleaved buffers, and both passes are spread over the apply function. Plans are
+//  cached by size.
+
+#ifndef __CASFFT_h__
+#define __CASFFT_h__
+
+#include <stddef.h>
+#include <complex>
+#include <vector>
+
+// rows or columns transformed together, interleaved so the butterflies vectorise across them. four fills the 128-bit
+// registers of SSE2 and NEON, wider vectors get split up by the compiler and run slower than scalar code
+#define CAS_FFT_LANES 4
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order on the calling thread
+typedef void (*CASFFTApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+typedef std::complex<float> CASFFTComplex;
+
+// the factors and twiddles of a complex transform of one length
+struct CASFFTFactors {
+    size_t length;
+    std::vector<size_t> factors; // radix and remaining length pairs, outermost first
+    std::vector<CASFFTComplex> twiddles; // exp(-2 pi i k / length)
+};
+
+struct CASFFTPlan {
+    size_t width, height;
+    size_t spectrumWidth; // width / 2 + 1, the rest of each row is the conjugate of this half
+    CASFFTFactors rows; // width / 2 long
+    CASFFTFactors columns;
+    std::vector<CASFFTComplex> split; // exp(-2 pi i k / width) for separating the packed rows
+};
+
+// the smallest even size at least n with no factors other than 2, 3 and 5
+size_t CASFFTGoodSize(size_t n);
+
+// the plan for frames of this size, or NULL unless the width is even and neither has factors other than 2, 3 and 5.
+// plans are cached and live until exit
+const CASFFTPlan* CASFFTPlanForSize(size_t width, size_t height);
+
+// spectrum = the transform of the width x height frame, spectrumWidth x height complex values
+bool CASFFTForward(const CASFFTPlan* plan, const float* in, CASFFTComplex* spectrum, CASFFTApply apply = NULL);
+
+// out = the inverse transform of spectrum, scaled so it round trips. spectrum is used as scratch and overwritten
+bool CASFFTInverse(const CASFFTPlan* plan, CASFFTComplex* spectrum, float* out, CASFFTApply apply = NULL);
+
+// out = in convolved with a kernelWidth x kernelHeight kernel centred on (kernelWidth / 2, kernelHeight / 2), any frame
+// size. edges are extended by repeating the outermost pixels as in CASGaussian, out may be in
+bool CASFFTConvolve(const float* in, float* out, size_t width, size_t height, const float* kernel, size_t kernelWidth, size_t kernelHeight, CASFFTApply apply = NULL);
+
+// out[dy * width + dx] = sum of a(x,y) b(x + dx,y + dy) with the means removed, wrapping round at the edges. the size must have a plan
+bool CASFFTCrossCorrelate(const float* a, const float* b, float* out, size_t width, size_t height, CASFFTApply apply = NULL);
+
+// the translation taking reference onto image to a fraction of a pixel from the peak of their phase correlation, any frame size
+bool CASFFTRegister(const float* reference, const float* image, size_t width, size_t height, float& dx, float& dy, CASFFTApply apply = NULL);
+
+// psf = the (2 * radius + 1) squared cut out centred on (x,y) with the sky, the median of its border, taken off and
+// scaled to a total of 1. false if it's not all in the frame or there's no flux above the sky
+bool CASFFTMeasurePSF(const float* in, size_t width, size_t height, float x, float y, size_t radius, float* psf);
+
+// out = in deconvolved by the psf, which is normalised first, with the given number of Richardson-Lucy iterations.
+// negative pixels are treated as 0, edges are extended as for CASFFTConvolve and out may be in
+bool CASFFTRichardsonLucy(const float* in, float* out, size_t width, size_t height, const float* psf, size_t psfWidth, size_t psfHeight, int iterations, CASFFTApply apply = NULL);
+
+#endif
@@ -0,0 +1,291 @@
+//
+//  CASFramePool.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Size classed free lists behind one lock, allocations are a handful per frame so contention isn't a concern.
+
+
+#include "CASFramePool.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+
+// sits in front of every buffer handed out so it can find its way back to its class
+struct CASFramePoolHeader {
+    uint32_t magic;
+    uint32_t pooled;
+    size_t capacity;
+};
+
+const uint32_t kCASFramePoolMagic = 0x43415346; // 'CASF'
+const size_t kCASFramePoolHeaderSize = CAS_FRAME_POOL_ALIGNMENT;
+
+static_assert(sizeof(CASFramePoolHeader) <= kCASFramePoolHeaderSize, "frame pool header doesn't fit in front of the buffer");
+
+CASFramePoolHeader* CASFramePoolHeaderFor(const void* buffer)
+{
+    CASFramePoolHeader* header = (CASFramePoolHeader*)((char*)buffer - kCASFramePoolHeaderSize);
+    return (header->magic == kCASFramePoolMagic) ? header : NULL;
+}
+
+// round up to the next of CAS_FRAME_POOL_CLASSES_PER_DOUBLING steps between powers of two
+size_t CASFramePoolClassSize(size_t size)
+{
+    if (size < CAS_FRAME_POOL_MIN_SIZE){
+        return (size + 15) & ~size_t(15);
+    }
+    size_t octave = 1;
+    while (octave <= size / 2){
+        octave *= 2;
+    }
+    const size_t step = octave / CAS_FRAME_POOL_CLASSES_PER_DOUBLING;
+    return (size + step - 1) / step * step;
+}
+
+size_t CASFramePoolDefaultLimit()
+{
+    const char* env = getenv("CAS_FRAME_POOL_LIMIT_MB");
+    if (env && *env){
+        return size_t(strtoull(env, NULL, 10)) * 1024 * 1024;
+    }
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && pageSize > 0){
+        return size_t(pages) * size_t(pageSize) / 2;
+    }
+    return 0;
+}
+
+class CASFramePool {
+public:
+    static CASFramePool& shared() {
+        static CASFramePool* pool = new CASFramePool(); // never deleted, buffers can be freed during static destruction
+        return *pool;
+    }
+    
+    void* allocate(size_t size) {
+        
+        const size_t capacity = CASFramePoolClassSize(std::max<size_t>(size, 1));
+        const bool pooled = capacity >= CAS_FRAME_POOL_MIN_SIZE;
+        std::vector<void*> evicted;
+        
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            
+            ++statistics.allocations;
+            
+            if (pooled){
+                std::map<size_t,std::vector<void*> >::iterator cached = cache.find(capacity);
+                if (cached != cache.end() && !cached->second.empty()){
+                    void* buffer = cached->second.back();
+                    cached->second.pop_back();
+                    statistics.bytesCached -= capacity;
+                    statistics.bytesInUse += capacity;
+                    ++statistics.reuses;
+                    updateHighWater();
+                    return buffer;
+                }
+            }
+            
+            // make room by dropping cached buffers of other sizes, biggest first as they free up the most in one go
+            while (statistics.limit && statistics.bytesInUse + statistics.bytesCached + capacity > statistics.limit && statistics.bytesCached){
+                std::map<size_t,std::vector<void*> >::reverse_iterator biggest = cache.rbegin();
+                while (biggest->second.empty()){
+                    ++biggest;
+                }
+                evicted.push_back(biggest->second.back());
+                biggest->second.pop_back();
+                statistics.bytesCached -= biggest->first;
+            }
+            
+            if (statistics.limit && statistics.bytesInUse + capacity > statistics.limit){
+                ++statistics.failures;
+                release(evicted);
+                return NULL;
+            }
+            
+            // count it now so racing allocations can't both squeeze under the limit
+            statistics.bytesInUse += capacity;
+            updateHighWater();
+        }
+        
+        release(evicted);
+        
+        void* memory = NULL;
+        if (posix_memalign(&memory, CAS_FRAME_POOL_ALIGNMENT, kCASFramePoolHeaderSize + capacity)){
+            std::lock_guard<std::mutex> guard(lock);
+            statistics.bytesInUse -= capacity;
+            ++statistics.failures;
+            return NULL;
+        }
+        
+        CASFramePoolHeader* header = (CASFramePoolHeader*)memory;
+        header->magic = kCASFramePoolMagic;
+        header->pooled = pooled;
+        header->capacity = capacity;
+        
+        return (char*)memory + kCASFramePoolHeaderSize;
+    }
+    
+    void recycle(void* buffer) {
+        
+        CASFramePoolHeader* header = CASFramePoolHeaderFor(buffer);
+        if (!header){
+            abort(); // not one of ours or already freed, carrying on would corrupt the accounting or the heap
+        }
+        
+        const size_t capacity = header->capacity;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            statistics.bytesInUse -= capacity;
+            if (header->pooled){
+                std::vector<void*>& cached = cache[capacity];
+                const bool underLimit = !statistics.limit || statistics.bytesInUse + statistics.bytesCached + capacity <= statistics.limit;
+                if (cached.size() < CAS_FRAME_POOL_CACHED_PER_CLASS && underLimit){
+                    cached.push_back(buffer);
+                    statistics.bytesCached += capacity;
+                    updateHighWater();
+                    return;
+                }
+            }
+        }
+        
+        header->magic = 0;
+        ::free(header);
+    }
+    
+    void setLimit(size_t limit) {
+        std::vector<void*> evicted;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            statistics.limit = limit;
+            while (limit && statistics.bytesCached && statistics.bytesInUse + statistics.bytesCached > limit){
+                takeAllCached(evicted, true);
+            }
+        }
+        release(evicted);
+    }
+    
+    void trim() {
+        std::vector<void*> evicted;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            takeAllCached(evicted, false);
+        }
+        release(evicted);
+    }
+    
+    CASFramePoolStatistics getStatistics() {
+        std::lock_guard<std::mutex> guard(lock);
+        return statistics;
+    }
+    
+    void resetStatistics() {
+        std::lock_guard<std::mutex> guard(lock);
+        statistics.highWaterInUse = statistics.bytesInUse;
+        statistics.highWaterTotal = statistics.bytesInUse + statistics.bytesCached;
+        statistics.allocations = statistics.reuses = statistics.failures = 0;
+    }
+    
+private:
+    std::mutex lock;
+    std::map<size_t,std::vector<void*> > cache;
+    CASFramePoolStatistics statistics;
+    
+    CASFramePool() {
+        statistics = CASFramePoolStatistics();
+        statistics.limit = CASFramePoolDefaultLimit();
+    }
+    
+    void updateHighWater() {
+        statistics.highWaterInUse = std::max(statistics.highWaterInUse, statistics.bytesInUse);
+        statistics.highWaterTotal = std::max(statistics.highWaterTotal, statistics.bytesInUse + statistics.bytesCached);
+    }
+    
+    // takes either one buffer, the biggest, or all of them
+    void takeAllCached(std::vector<void*>& evicted, bool justOne) {
+        for (std::map<size_t,std::vector<void*> >::reverse_iterator it = cache.rbegin(); it != cache.rend(); ++it){
+            while (!it->second.empty()){
+                evicted.push_back(it->second.back());
+                it->second.pop_back();
+                statistics.bytesCached -= it->first;
+                if (justOne){
+                    return;
+                }
+            }
+        }
+    }
+    
+    static void release(const std::vector<void*>& buffers) {
+        for (size_t i = 0; i < buffers.size(); ++i){
+            CASFramePoolHeader* header = CASFramePoolHeaderFor(buffers[i]);
+            header->magic = 0;
+            ::free(header);
+        }
+    }
+};
+
+}
+
+void* CASFramePoolAllocate(size_t size)
+{
+    return CASFramePool::shared().allocate(size);
+}
+
+void CASFramePoolFree(void* buffer)
+{
+    if (buffer){
+        CASFramePool::shared().recycle(buffer);
+    }
+}
+
+size_t CASFramePoolCapacity(const void* buffer)
+{
+    const CASFramePoolHeader* header = buffer ? CASFramePoolHeaderFor(buffer) : NULL;
+    return header ? header->capacity : 0;
+}
+
+void CASFramePoolSetLimit(size_t limit)
+{
+    CASFramePool::shared().setLimit(limit);
+}
+
+void CASFramePoolTrim(void)
+{
+    CASFramePool::shared().trim();
+}
+
+CASFramePoolStatistics CASFramePoolGetStatistics(void)
+{
+    return CASFramePool::shared().getStatistics();
+}
+
+void CASFramePoolResetStatistics(void)
+{
+    CASFramePool::shared().resetStatistics();
+}
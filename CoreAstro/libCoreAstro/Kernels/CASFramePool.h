@@ -0,0 +1,89 @@
+//
+//  CASFramePool.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Recycling pool for frame sized buffers. Continuous capture and guiding go through the same few
+//  frame sizes over and over so freed buffers are kept by size class and handed straight back out
+//  rather than going through malloc, and the page faults of fresh memory, every frame. Everything
+//  the pool hands out counts against a hard limit. Plain C so the Objective-C side can call it.
+
+#ifndef __CASFramePool_h__
+#define __CASFramePool_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// smaller buffers aren't worth keeping and come straight from malloc, although they still count against the limit
+#define CAS_FRAME_POOL_MIN_SIZE (256*1024)
+
+// size classes per doubling of size, so a buffer is at most 1/8 bigger than asked for
+#define CAS_FRAME_POOL_CLASSES_PER_DOUBLING 8
+
+// free buffers kept per size class, capture and processing rarely have more than a few frames of one size on the go
+#define CAS_FRAME_POOL_CACHED_PER_CLASS 4
+
+// alignment of the buffers handed out
+#define CAS_FRAME_POOL_ALIGNMENT 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    size_t limit;               // most bytes in use and cached at once, 0 for no limit
+    size_t bytesInUse;          // handed out and not yet freed, in size class bytes
+    size_t bytesCached;         // freed and kept for reuse
+    size_t highWaterInUse;      // most bytes in use at once
+    size_t highWaterTotal;      // most bytes in use and cached at once
+    uint64_t allocations;
+    uint64_t reuses;            // allocations that got a cached buffer
+    uint64_t failures;          // allocations refused because they'd have gone over the limit
+} CASFramePoolStatistics;
+
+// a buffer of at least size bytes, or NULL if there's not enough memory or it would take the pool over its limit.
+// cached buffers of other sizes are released first to make room if need be. contents are undefined
+void* CASFramePoolAllocate(size_t size);
+
+// returns a buffer to the pool, NULL is ignored
+void CASFramePoolFree(void* buffer);
+
+// bytes actually available in a buffer, at least what was asked for
+size_t CASFramePoolCapacity(const void* buffer);
+
+// the default limit is CAS_FRAME_POOL_LIMIT_MB megabytes if that's set, otherwise half the physical memory.
+// lowering it below what's in use doesn't free anything that's in use but refuses new allocations until there's room
+void CASFramePoolSetLimit(size_t limit);
+
+// releases all the cached buffers
+void CASFramePoolTrim(void);
+
+CASFramePoolStatistics CASFramePoolGetStatistics(void);
+
+// zeros the high water marks and counters, for tools and tests
+void CASFramePoolResetStatistics(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
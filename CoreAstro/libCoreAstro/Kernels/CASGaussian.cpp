@@ -0,0 +1,319 @@
+//
+//  CASGaussian.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASGaussian.h"
+#include <algorithm>
+#include <vector>
+#include <math.h>
+
+// rows filtered together by the horizontal recursive pass
+#define CAS_GAUSSIAN_RECURSIVE_ROWS 4
+
+struct CASGaussianPlan {
+    bool recursive;
+    int radius;
+    std::vector<float> weights; // 2 * radius + 1 taps of the sampled kernel
+    double c[4]; // recursive filter coefficients, the gain then the weights of the last three outputs
+    double m[9]; // maps the end of the causal pass onto the start of the anti-causal one, see CASGaussianBoundary
+};
+
+// out = a * out + b * in + c applied to each row after the horizontal pass while it's still in cache
+struct CASGaussianFinish {
+    const float* in;
+    float a, b, c;
+};
+
+struct CASGaussianPass {
+    const CASGaussianPlan* plan;
+    const float* in;
+    float* out;
+    size_t width, height;
+    size_t stripColumns;
+    const CASGaussianFinish* finish;
+};
+
+static void CASGaussianMakePlan(float sigma, CASGaussianPlan& plan)
+{
+    plan.recursive = (sigma > CAS_GAUSSIAN_MAX_DIRECT_SIGMA);
+    if (!plan.recursive){
+        plan.radius = (sigma > 0) ? (int)ceilf(3 * sigma) : 0;
+        plan.weights.resize(2 * plan.radius + 1);
+        double total = 0;
+        for (int i = -plan.radius; i <= plan.radius; ++i){
+            const double w = plan.radius ? exp(-(i * i) / (2.0 * sigma * sigma)) : 1;
+            plan.weights[i + plan.radius] = w;
+            total += w;
+        }
+        for (size_t i = 0; i < plan.weights.size(); ++i){
+            plan.weights[i] /= total;
+        }
+    }
+    else {
+        // Young and van Vliet's fit for sigma >= 2.5
+        const double q = 0.98711 * sigma - 0.96330;
+        const double q2 = q * q, q3 = q2 * q;
+        const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+        const double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+        const double b2 = -(1.4281 * q2 + 1.26661 * q3);
+        const double b3 = 0.422205 * q3;
+        plan.radius = 0;
+        plan.c[1] = b1 / b0;
+        plan.c[2] = b2 / b0;
+        plan.c[3] = b3 / b0;
+        plan.c[0] = 1 - (plan.c[1] + plan.c[2] + plan.c[3]); // exactly unity gain so flat areas stay flat
+        
+        // Triggs and Sdika, "Boundary Conditions for Young-van Vliet Recursive Filtering", scaled for the normalised
+        // form of the filter used here so the edges behave as if the last input value carried on forever
+        const double a1 = plan.c[1], a2 = plan.c[2], a3 = plan.c[3];
+        const double scale = plan.c[0] / ((1 + a1 - a2 + a3) * (1 - a1 - a2 - a3) * (1 + a2 + (a1 - a3) * a3));
+        plan.m[0] = scale * (-a3 * a1 + 1 - a3 * a3 - a2);
+        plan.m[1] = scale * (a3 + a1) * (a2 + a3 * a1);
+        plan.m[2] = scale * a3 * (a1 + a3 * a2);
+        plan.m[3] = scale * (a1 + a3 * a2);
+        plan.m[4] = -scale * (a2 - 1) * (a2 + a3 * a1);
+        plan.m[5] = -scale * a3 * (a3 * a1 + a3 * a3 + a2 - 1);
+        plan.m[6] = scale * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
+        plan.m[7] = scale * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3);
+        plan.m[8] = scale * a3 * (a1 + a3 * a2);
+    }
+}
+
+// the first three outputs of the anti-causal pass given the last three of the causal pass, most recent
+// first, and the last input value. short runs repeat the initial causal state so still come out right
+static inline void CASGaussianBoundary(const CASGaussianPlan& plan, const double* causal, double last, double* anticausal)
+{
+    const double d0 = causal[0] - last, d1 = causal[1] - last, d2 = causal[2] - last;
+    anticausal[0] = last + plan.m[0] * d0 + plan.m[1] * d1 + plan.m[2] * d2;
+    anticausal[1] = last + plan.m[3] * d0 + plan.m[4] * d1 + plan.m[5] * d2;
+    anticausal[2] = last + plan.m[6] * d0 + plan.m[7] * d1 + plan.m[8] * d2;
+}
+
+static size_t CASGaussianStripColumns(const CASGaussianPlan& plan, size_t width, size_t height)
+{
+    // the sampled kernel needs its window of rows in cache, the recursive filter the whole strip for the backward pass.
+    // narrower than 64 columns and the per row kernel calls cost more than the cache misses they save
+    const size_t rows = plan.recursive ? height : 2 * plan.radius + 1;
+    size_t columns = CAS_GAUSSIAN_WORKING_SET / (rows * sizeof(float));
+    columns = std::max<size_t>(64, std::min<size_t>(1024, columns & ~(size_t)15));
+    return std::min(columns, width);
+}
+
+static void CASGaussianVerticalStrip(void* context, size_t strip)
+{
+    const CASGaussianPass& pass = *(const CASGaussianPass*)context;
+    const CASGaussianPlan& plan = *pass.plan;
+    const CASKernelTable& kernels = CASKernels();
+    const size_t width = pass.width, height = pass.height;
+    const size_t x0 = strip * pass.stripColumns;
+    const size_t columns = std::min(pass.stripColumns, width - x0);
+    const float* in = pass.in + x0;
+    float* out = pass.out + x0;
+    
+    if (!plan.recursive){
+        const int radius = plan.radius;
+        std::vector<const float*> rows(2 * radius + 1);
+        for (size_t y = 0; y < height; ++y){
+            for (int k = -radius; k <= radius; ++k){
+                const size_t yy = std::min<ptrdiff_t>(height - 1, std::max<ptrdiff_t>(0, (ptrdiff_t)y + k));
+                rows[k + radius] = in + yy * width;
+            }
+            kernels.convolve(out + y * width, rows.data(), plan.weights.data(), rows.size(), columns);
+        }
+        return;
+    }
+    
+    // the last three outputs are kept in double precision as the recursion amplifies rounding errors by up to
+    // 1 / c[0], which gets into the 100,000s for large sigmas. the fourth buffer receives the next output
+    std::vector<double> buffers(4 * columns);
+    double* state[4] = { buffers.data(), buffers.data() + columns, buffers.data() + 2 * columns, buffers.data() + 3 * columns };
+    
+    // causal pass down the strip, starting as if the first row extended upwards forever
+    for (int k = 0; k < 3; ++k){
+        std::copy(in, in + columns, state[k]);
+    }
+    for (size_t y = 0; y < height; ++y){
+        kernels.recursiveStep(out + y * width, state[3], in + y * width, state, plan.c, columns);
+        std::rotate(state, state + 3, state + 4);
+    }
+    
+    // then anti-causal back up it in place, starting from the boundary values for the last row
+    const float* last = in + (height - 1) * width;
+    for (size_t x = 0; x < columns; ++x){
+        const double causal[3] = { state[0][x], state[1][x], state[2][x] };
+        double anticausal[3];
+        CASGaussianBoundary(plan, causal, last[x], anticausal);
+        out[(height - 1) * width + x] = state[0][x] = anticausal[0];
+        state[1][x] = anticausal[1];
+        state[2][x] = anticausal[2];
+    }
+    for (size_t y = height - 1; y-- > 0;){
+        float* row = out + y * width;
+        kernels.recursiveStep(row, state[3], row, state, plan.c, columns);
+        std::rotate(state, state + 3, state + 4);
+    }
+}
+
+// filters a group of rows in place along their length, the rows are interleaved so their recursions
+// overlap rather than each waiting on the latency of the last step. steps are worked out as in the
+// recursiveStep kernel
+template <int N>
+static void CASGaussianRecursiveRows(float* const* rows, size_t width, const CASGaussianPlan& plan)
+{
+    const double c0 = plan.c[0], c2 = plan.c[2], c3 = plan.c[3];
+    double p1[N], p2[N], p3[N], last[N];
+    for (int r = 0; r < N; ++r){
+        p1[r] = p2[r] = p3[r] = rows[r][0];
+        last[r] = rows[r][width - 1];
+    }
+    for (size_t x = 0; x < width; ++x){
+        for (int r = 0; r < N; ++r){
+            const double v = p1[r] + (c0 * (rows[r][x] - p1[r]) + (c2 * (p2[r] - p1[r]) + c3 * (p3[r] - p1[r])));
+            p3[r] = p2[r];
+            p2[r] = p1[r];
+            p1[r] = v;
+            rows[r][x] = v;
+        }
+    }
+    for (int r = 0; r < N; ++r){
+        const double causal[3] = { p1[r], p2[r], p3[r] };
+        double anticausal[3];
+        CASGaussianBoundary(plan, causal, last[r], anticausal);
+        rows[r][width - 1] = p1[r] = anticausal[0];
+        p2[r] = anticausal[1];
+        p3[r] = anticausal[2];
+    }
+    for (size_t x = width - 1; x-- > 0;){
+        for (int r = 0; r < N; ++r){
+            const double v = p1[r] + (c0 * (rows[r][x] - p1[r]) + (c2 * (p2[r] - p1[r]) + c3 * (p3[r] - p1[r])));
+            p3[r] = p2[r];
+            p2[r] = p1[r];
+            p1[r] = v;
+            rows[r][x] = v;
+        }
+    }
+}
+
+static void CASGaussianHorizontalTile(void* context, size_t tile)
+{
+    const CASGaussianPass& pass = *(const CASGaussianPass*)context;
+    const CASGaussianPlan& plan = *pass.plan;
+    const CASKernelTable& kernels = CASKernels();
+    const size_t width = pass.width;
+    const size_t startRow = tile * CAS_GAUSSIAN_TILE_ROWS;
+    const size_t endRow = std::min(pass.height, startRow + CAS_GAUSSIAN_TILE_ROWS);
+    
+    const int radius = plan.radius;
+    std::vector<float> padded(plan.recursive ? 0 : width + 2 * radius);
+    std::vector<const float*> taps(plan.recursive ? 0 : 2 * radius + 1);
+    for (size_t k = 0; k < taps.size(); ++k){
+        taps[k] = padded.data() + k;
+    }
+    
+    if (plan.recursive){
+        size_t y = startRow;
+        for (; y + CAS_GAUSSIAN_RECURSIVE_ROWS <= endRow; y += CAS_GAUSSIAN_RECURSIVE_ROWS){
+            float* rows[CAS_GAUSSIAN_RECURSIVE_ROWS];
+            for (int r = 0; r < CAS_GAUSSIAN_RECURSIVE_ROWS; ++r){
+                rows[r] = pass.out + (y + r) * width;
+            }
+            CASGaussianRecursiveRows<CAS_GAUSSIAN_RECURSIVE_ROWS>(rows, width, plan);
+        }
+        for (; y < endRow; ++y){
+            float* row = pass.out + y * width;
+            CASGaussianRecursiveRows<1>(&row, width, plan);
+        }
+    }
+    
+    for (size_t y = startRow; y < endRow; ++y){
+        
+        float* row = pass.out + y * width;
+        if (!plan.recursive && radius > 0){
+            std::fill(padded.begin(), padded.begin() + radius, row[0]);
+            std::copy(row, row + width, padded.begin() + radius);
+            std::fill(padded.end() - radius, padded.end(), row[width - 1]);
+            kernels.convolve(row, taps.data(), plan.weights.data(), taps.size(), width);
+        }
+        
+        if (pass.finish){
+            const CASGaussianFinish& finish = *pass.finish;
+            kernels.weightedSum(row, finish.a, finish.in + y * width, finish.b, finish.c, width);
+        }
+    }
+}
+
+static void CASGaussianApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+static bool CASGaussianRun(const float* in, float* out, size_t width, size_t height, float sigma, const CASGaussianFinish* finish, CASGaussianApply apply)
+{
+    if (!in || !out || !width || !height || sigma < 0){
+        return false;
+    }
+    if (!apply){
+        apply = CASGaussianApplyInOrder;
+    }
+    
+    CASGaussianPlan plan;
+    CASGaussianMakePlan(sigma, plan);
+    
+    CASGaussianPass pass = { &plan, in, out, width, height, CASGaussianStripColumns(plan, width, height), finish };
+    apply((width + pass.stripColumns - 1) / pass.stripColumns, &pass, CASGaussianVerticalStrip);
+    apply((height + CAS_GAUSSIAN_TILE_ROWS - 1) / CAS_GAUSSIAN_TILE_ROWS, &pass, CASGaussianHorizontalTile);
+    
+    return true;
+}
+
+bool CASGaussianBlur(const float* in, float* out, size_t width, size_t height, float sigma, CASGaussianApply apply)
+{
+    return CASGaussianRun(in, out, width, height, sigma, NULL, apply);
+}
+
+bool CASGaussianUnsharpMask(const float* in, float* out, size_t width, size_t height, float sigma, float amount, CASGaussianApply apply)
+{
+    const CASGaussianFinish finish = { in, -amount, 1 + amount, 0 };
+    return CASGaussianRun(in, out, width, height, sigma, &finish, apply);
+}
+
+bool CASGaussianDifference(const float* in, float* out, size_t width, size_t height, float sigma1, float sigma2, CASGaussianApply apply)
+{
+    if (!in || !out){
+        return false;
+    }
+    std::vector<float> wide(width * height);
+    if (!CASGaussianRun(in, wide.data(), width, height, sigma2, NULL, apply)){
+        return false;
+    }
+    const CASGaussianFinish finish = { wide.data(), 1, -1, 0 };
+    return CASGaussianRun(in, out, width, height, sigma1, &finish, apply);
+}
+
+bool CASGaussianSubtractBackground(const float* in, float* out, size_t width, size_t height, float sigma, float pedestal, CASGaussianApply apply)
+{
+    const CASGaussianFinish finish = { in, -1, 1, pedestal };
+    return CASGaussianRun(in, out, width, height, sigma, &finish, apply);
+}
@@ -0,0 +1,62 @@
+//
+//  CASGaussian.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Separable Gaussian blur for any sigma, with the unsharp mask, difference of Gaussians and
+//  background subtraction built on top of it. Small sigmas use the sampled kernel directly and
+//  larger ones the third order recursive filter from Young and van Vliet, "Recursive implementation
+//  of the Gaussian filter", so the cost per pixel doesn't grow with sigma. The vertical pass runs
+//  down strips of columns sized to stay in L2, the horizontal pass then runs along tiles of rows in
+//  place. Frame edges are extended by repeating the outermost row or column.
+
+#ifndef __CASGaussian_h__
+#define __CASGaussian_h__
+
+#include "CASKernels.h"
+
+// largest sigma that's filtered with the sampled kernel, which is 2 * ceil(3 * sigma) + 1 taps wide. the recursive
+// filter is cheaper above this and its coefficients are only fitted from here up
+#define CAS_GAUSSIAN_MAX_DIRECT_SIGMA 2.5f
+
+// rows per unit of work in the horizontal pass
+#define CAS_GAUSSIAN_TILE_ROWS 64
+
+// bytes of rows each vertical strip should touch at once, strips are sized to keep this in L2
+#define CAS_GAUSSIAN_WORKING_SET (256*1024)
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order on the calling thread
+typedef void (*CASGaussianApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+// out = in blurred with a Gaussian of the given sigma in pixels, a sigma of 0 copies. out must not overlap in
+bool CASGaussianBlur(const float* in, float* out, size_t width, size_t height, float sigma, CASGaussianApply apply = NULL);
+
+// out = in + amount * (in - blur(in))
+bool CASGaussianUnsharpMask(const float* in, float* out, size_t width, size_t height, float sigma, float amount, CASGaussianApply apply = NULL);
+
+// out = blur(in, sigma1) - blur(in, sigma2), keeping detail between the two scales
+bool CASGaussianDifference(const float* in, float* out, size_t width, size_t height, float sigma1, float sigma2, CASGaussianApply apply = NULL);
+
+// out = in - blur(in) + pedestal, removing gradients larger than sigma while keeping the sky at the pedestal level
+bool CASGaussianSubtractBackground(const float* in, float* out, size_t width, size_t height, float sigma, float pedestal, CASGaussianApply apply = NULL);
+
+#endif
@@ -0,0 +1,137 @@
+//
+//  CASHistogram.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASHistogram.h"
+#include <algorithm>
+#include <vector>
+
+static size_t CASHistogramChunkCount(size_t pixelCount, size_t channelCount)
+{
+    const size_t chunks = (pixelCount + CAS_HISTOGRAM_CHUNK_PIXELS - 1) / CAS_HISTOGRAM_CHUNK_PIXELS;
+    const size_t maxChunks = std::max<size_t>(1, CAS_HISTOGRAM_MAX_CHUNKS / channelCount);
+    return std::max<size_t>(1, std::min(maxChunks, chunks));
+}
+
+static void CASHistogramApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+struct CASHistogramU16Sampler {
+    typedef uint16_t Sample;
+    static inline uint32_t bin(uint16_t v) { return v; }
+};
+
+struct CASHistogramFloatSampler {
+    typedef float Sample;
+    static inline uint32_t bin(float v) { return (uint32_t)(std::min(1.0f, std::max(0.0f, v)) * 65535.0f + 0.5f); }
+};
+
+template <typename Sampler>
+struct CASHistogramPass {
+    const typename Sampler::Sample* pixels;
+    size_t pixelCount, stride, channelCount, chunkCount;
+    uint32_t* histograms;
+    
+    static void chunk(void* context, size_t chunk) {
+        const CASHistogramPass& pass = *(const CASHistogramPass*)context;
+        const size_t start = (pass.pixelCount * chunk) / pass.chunkCount;
+        const size_t end = (pass.pixelCount * (chunk + 1)) / pass.chunkCount;
+        const size_t stride = pass.stride;
+        const typename Sampler::Sample* pixels = pass.pixels;
+        uint32_t* histogram = pass.histograms + chunk * pass.channelCount * CAS_HISTOGRAM_BINS;
+        if (pass.channelCount == 1){
+            for (size_t i = start; i < end; ++i){
+                ++histogram[Sampler::bin(pixels[i * stride])];
+            }
+        }
+        else {
+            // all the channels in the same pass over the pixels
+            for (size_t i = start; i < end; ++i){
+                const typename Sampler::Sample* p = pixels + i * stride;
+                for (size_t c = 0; c < pass.channelCount; ++c){
+                    ++histogram[c * CAS_HISTOGRAM_BINS + Sampler::bin(p[c])];
+                }
+            }
+        }
+    }
+};
+
+template <typename Sampler>
+static bool CASHistogramComputeT(const typename Sampler::Sample* pixels, size_t pixelCount, size_t stride, size_t channelCount, uint32_t* histogram, CASHistogramApply apply)
+{
+    if (!pixels || !histogram || !channelCount || stride < channelCount){
+        return false;
+    }
+    if (!apply){
+        apply = CASHistogramApplyInOrder;
+    }
+    
+    const size_t size = channelCount * CAS_HISTOGRAM_BINS;
+    const size_t chunkCount = CASHistogramChunkCount(pixelCount, channelCount);
+    std::fill(histogram, histogram + size, 0);
+    
+    // a single chunk can go straight into the output
+    if (chunkCount == 1){
+        CASHistogramPass<Sampler> pass = { pixels, pixelCount, stride, channelCount, 1, histogram };
+        CASHistogramPass<Sampler>::chunk(&pass, 0);
+        return true;
+    }
+    
+    std::vector<uint32_t> histograms(chunkCount * size);
+    CASHistogramPass<Sampler> pass = { pixels, pixelCount, stride, channelCount, chunkCount, histograms.data() };
+    apply(chunkCount, &pass, CASHistogramPass<Sampler>::chunk);
+    
+    for (size_t c = 0; c < chunkCount; ++c){
+        const uint32_t* sub = histograms.data() + c * size;
+        for (size_t b = 0; b < size; ++b){
+            histogram[b] += sub[b];
+        }
+    }
+    return true;
+}
+
+bool CASHistogramCompute(const uint16_t* pixels, size_t pixelCount, size_t stride, size_t channelCount, uint32_t* histogram, CASHistogramApply apply)
+{
+    return CASHistogramComputeT<CASHistogramU16Sampler>(pixels, pixelCount, stride, channelCount, histogram, apply);
+}
+
+bool CASHistogramCompute(const float* pixels, size_t pixelCount, size_t stride, size_t channelCount, uint32_t* histogram, CASHistogramApply apply)
+{
+    return CASHistogramComputeT<CASHistogramFloatSampler>(pixels, pixelCount, stride, channelCount, histogram, apply);
+}
+
+void CASHistogramReduce(const uint32_t* histogram, uint32_t* out, size_t binCount)
+{
+    const size_t run = CAS_HISTOGRAM_BINS / binCount;
+    for (size_t b = 0; b < binCount; ++b){
+        uint32_t total = 0;
+        for (size_t i = 0; i < run; ++i){
+            total += histogram[b * run + i];
+        }
+        out[b] = total;
+    }
+}
@@ -0,0 +1,55 @@
+//
+//  CASHistogram.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Full resolution 65536 bin histograms of 16-bit samples, one per channel for colour frames.
+//  Each chunk of the frame is binned into its own sub-histogram so threads never share a
+//  counter, the sub-histograms are then added together in a fixed order.
+
+#ifndef __CASHistogram_h__
+#define __CASHistogram_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAS_HISTOGRAM_BINS 65536
+
+// pixels per chunk, and the most sub-histograms to have at once across all the channels
+#define CAS_HISTOGRAM_CHUNK_PIXELS (1024*1024)
+#define CAS_HISTOGRAM_MAX_CHUNKS 16
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order
+// on the calling thread. chunks are always merged in index order so the results don't depend on this
+typedef void (*CASHistogramApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+// bins the first channelCount of every stride samples, so 1 and 1 for mono frames and 3 and 4 for RGBA.
+// histogram holds channelCount consecutive arrays of CAS_HISTOGRAM_BINS counts
+bool CASHistogramCompute(const uint16_t* pixels, size_t pixelCount, size_t stride, size_t channelCount, uint32_t* histogram, CASHistogramApply apply = NULL);
+
+// 0-1 floats are binned as the 16-bit samples they came from, anything outside is clamped and NaNs count as 0
+bool CASHistogramCompute(const float* pixels, size_t pixelCount, size_t stride, size_t channelCount, uint32_t* histogram, CASHistogramApply apply = NULL);
+
+// adds up runs of CAS_HISTOGRAM_BINS / binCount bins for display, binCount must be a power of 2
+void CASHistogramReduce(const uint32_t* histogram, uint32_t* out, size_t binCount);
+
+#endif
@@ -0,0 +1,124 @@
+//
+//  CASKernels.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Picks the kernel table for the host CPU.
+
+#include "CASKernelsPrivate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static bool CASHostSupportsISA(CASKernelISA isa)
+{
+    switch (isa) {
+        case kCASKernelISAScalar:
+            return true;
+#if CAS_KERNELS_X86
+        case kCASKernelISASSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case kCASKernelISAAVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+#if CAS_KERNELS_NEON
+        case kCASKernelISANEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* CASKernelISAName(CASKernelISA isa)
+{
+    switch (isa) {
+        case kCASKernelISAScalar:
+            return "scalar";
+        case kCASKernelISASSE2:
+            return "sse2";
+        case kCASKernelISAAVX2:
+            return "avx2";
+        case kCASKernelISANEON:
+            return "neon";
+        default:
+            return "unknown";
+    }
+}
+
+const CASKernelTable* CASKernelsForISA(CASKernelISA isa)
+{
+    const CASKernelTable* table = NULL;
+    
+    switch (isa) {
+        case kCASKernelISAScalar:
+            table = CASKernelsScalar();
+            break;
+        case kCASKernelISASSE2:
+            table = CASKernelsSSE2();
+            break;
+        case kCASKernelISAAVX2:
+            table = CASKernelsAVX2();
+            break;
+        case kCASKernelISANEON:
+            table = CASKernelsNEON();
+            break;
+        default:
+            break;
+    }
+    
+    return (table && CASHostSupportsISA(isa)) ? table : NULL;
+}
+
+static const CASKernelTable* CASSelectKernels()
+{
+    const char* override = getenv("CAS_KERNEL_ISA");
+    if (override && *override){
+        for (int isa = 0; isa < kCASKernelISACount; ++isa){
+            if (!strcmp(override, CASKernelISAName((CASKernelISA)isa))){
+                const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+                if (table){
+                    return table;
+                }
+            }
+        }
+        fprintf(stderr, "CAS_KERNEL_ISA=%s isn't available on this host, ignoring\n", override);
+    }
+    
+    const CASKernelISA preferred[] = { kCASKernelISAAVX2, kCASKernelISANEON, kCASKernelISASSE2 };
+    for (size_t i = 0; i < sizeof(preferred)/sizeof(preferred[0]); ++i){
+        const CASKernelTable* table = CASKernelsForISA(preferred[i]);
+        if (table){
+            return table;
+        }
+    }
+    
+    return CASKernelsScalar();
+}
+
+const CASKernelTable& CASKernels()
+{
+    static const CASKernelTable* table = CASSelectKernels();
+    return *table;
+}
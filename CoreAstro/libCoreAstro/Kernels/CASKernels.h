@@ -0,0 +1,115 @@
+//
+//  CASKernels.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Portable per-pixel kernels used by CASImageProcessor. Every kernel has a scalar
+//  reference implementation plus SSE2, AVX2 and NEON versions; the fastest one the
+//  host supports is picked at runtime. This code has no Cocoa dependencies so that
+//  it can be built and benchmarked off the Mac, see the Makefile in this directory.
+
+#ifndef __CASKernels_h__
+#define __CASKernels_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    kCASKernelISAScalar = 0,
+    kCASKernelISASSE2,
+    kCASKernelISAAVX2,
+    kCASKernelISANEON,
+    kCASKernelISACount
+} CASKernelISA;
+
+// counts are in floats unless noted otherwise, pointers need no particular alignment
+
+struct CASKernelTable {
+    
+    CASKernelISA isa;
+    const char* name;
+    
+    // p = 1 - p
+    void (*invert)(float* pixels, size_t count);
+    
+    // sum of all values, accumulated in double precision
+    double (*sum)(const float* pixels, size_t count);
+    
+    // p = p * mean / flat, pixels with a zero flat value are left untouched
+    void (*divideFlat)(float* pixels, const float* flat, float mean, size_t count);
+    
+    // out = mean of planes[0..planeCount-1], each plane having count values
+    void (*average)(const float* const* planes, size_t planeCount, float* out, size_t count);
+    
+    // out = min(1, 0.2126r + 0.7152g + 0.0722b), count is in rgba pixels
+    void (*luminance)(const float* rgba, float* out, size_t count);
+    
+    // single pass calibration, out = (light - offset) * flatMean / (flat - flatOffset)
+    // any of offset, flat and flatOffset may be NULL, pixels with a zero flat value are only offset corrected
+    void (*calibrate)(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count);
+    
+    // out[i] = median of the 3x3 or 5x5 window rows[0..n-1][i..i+n-1], so each row pointer is the
+    // left hand edge of the window for the first output pixel. count is in output pixels
+    void (*median3x3)(const float* const* rows, float* out, size_t count);
+    void (*median5x5)(const float* const* rows, float* out, size_t count);
+    void (*median3x3U16)(const uint16_t* const* rows, uint16_t* out, size_t count);
+    void (*median5x5U16)(const uint16_t* const* rows, uint16_t* out, size_t count);
+    
+    // histogram[i] += add[i] - remove[i], sliding a window histogram across per-column byte counts. remove may be NULL
+    void (*histogramSlide)(uint16_t* histogram, const uint8_t* add, const uint8_t* remove, size_t count);
+    
+    // applies a sorting network down the columns of a block of rows, stride floats apart. comparators holds
+    // comparatorCount pairs of row indices, after each pair the lower value of every column is in the first row
+    void (*sortColumns)(float* rows, size_t stride, const uint16_t* comparators, size_t comparatorCount, size_t count);
+    
+    // out = a * out + b * in + c
+    void (*weightedSum)(float* out, float a, const float* in, float b, float c, size_t count);
+    
+    // out[i] = sum of weights[k] * rows[k][i] for k in [0,rowCount), out may be the same buffer as any of the rows
+    void (*convolve)(float* out, const float* const* rows, const float* weights, size_t rowCount, size_t count);
+    
+    // one step of a third order recursive filter, out = c[0] * in + c[1] * previous[0] + c[2] * previous[1] + c[3] * previous[2]
+    // where previous holds the last three outputs, most recent first. the outputs are fed back in double precision through
+    // state, out gets the same value as a float. the coefficients must add up to 1, which lets this be worked out from
+    // differences to previous[0]. out may be the same buffer as in
+    void (*recursiveStep)(float* out, double* state, const float* in, const double* const* previous, const double* c, size_t count);
+    
+    // out = in / divisor, widening 16-bit samples to floats the same way exposures expand them to 0-1 with a divisor of 65535
+    void (*widenU16)(const uint16_t* in, float divisor, float* out, size_t count);
+    
+    // out[i] = rounded mean of the 2x2 block at column 2i of row0 and row1, halving the size of 16-bit samples. count is in
+    // output samples so the rows are 2 * count long
+    void (*halveU16)(const uint16_t* row0, const uint16_t* row1, uint16_t* out, size_t count);
+    
+    // the same for floats, ((row0 pair) + (row1 pair)) / 4, of 1 or 4 interleaved channels. count is in output pixels
+    void (*halveFloat)(const float* row0, const float* row1, float* out, size_t count, size_t channelCount);
+};
+
+// the table for the best ISA the host supports, can be overridden by setting CAS_KERNEL_ISA to scalar, sse2, avx2 or neon
+const CASKernelTable& CASKernels();
+
+// a specific table, or NULL if it isn't compiled in or the host can't run it
+const CASKernelTable* CASKernelsForISA(CASKernelISA isa);
+
+const char* CASKernelISAName(CASKernelISA isa);
+
+#endif
@@ -0,0 +1,422 @@
+//
+//  CASKernelsAVX2.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  AVX2 kernels, 8 floats at a time. Compiled with per-function target attributes so
+//  the rest of the library stays runnable on hosts without AVX2.
+
+#include "CASKernelsPrivate.h"
+
+#if CAS_KERNELS_X86
+
+#include <immintrin.h>
+#include <algorithm>
+
+#define CAS_AVX2 CAS_KERNELS_TARGET("avx2")
+
+CAS_AVX2 static void CASInvertAVX2(float* pixels, size_t count)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        _mm256_storeu_ps(pixels + i, _mm256_sub_ps(one, _mm256_loadu_ps(pixels + i)));
+    }
+    for (; i < count; ++i){
+        pixels[i] = 1.0f - pixels[i];
+    }
+}
+
+CAS_AVX2 static double CASSumAVX2(const float* pixels, size_t count)
+{
+    __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        const __m256 v = _mm256_loadu_ps(pixels + i);
+        lo = _mm256_add_pd(lo, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+        hi = _mm256_add_pd(hi, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(lo, hi));
+    double total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < count; ++i){
+        total += pixels[i];
+    }
+    return total;
+}
+
+CAS_AVX2 static void CASDivideFlatAVX2(float* pixels, const float* flat, float mean, size_t count)
+{
+    const __m256 m = _mm256_set1_ps(mean);
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        const __m256 p = _mm256_loadu_ps(pixels + i);
+        const __m256 f = _mm256_loadu_ps(flat + i);
+        const __m256 corrected = _mm256_div_ps(_mm256_mul_ps(p, m), f);
+        const __m256 valid = _mm256_cmp_ps(f, zero, _CMP_NEQ_UQ);
+        _mm256_storeu_ps(pixels + i, _mm256_blendv_ps(p, corrected, valid));
+    }
+    for (; i < count; ++i){
+        if (flat[i] != 0){
+            pixels[i] = (pixels[i] * mean) / flat[i];
+        }
+    }
+}
+
+CAS_AVX2 static void CASAverageAVX2(const float* const* planes, size_t planeCount, float* out, size_t count)
+{
+    if (!planeCount){
+        std::fill(out, out + count, 0.0f);
+        return;
+    }
+    
+    const float fcount = planeCount;
+    const __m256 divisor = _mm256_set1_ps(fcount);
+    for (size_t block = 0; block < count; block += CAS_KERNELS_AVERAGE_BLOCK){
+        
+        const size_t end = std::min(count, block + CAS_KERNELS_AVERAGE_BLOCK);
+        std::copy(planes[0] + block, planes[0] + end, out + block);
+        for (size_t j = 1; j < planeCount; ++j){
+            const float* plane = planes[j];
+            size_t i = block;
+            for (; i + 8 <= end; i += 8){
+                _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_loadu_ps(plane + i)));
+            }
+            for (; i < end; ++i){
+                out[i] += plane[i];
+            }
+        }
+        size_t i = block;
+        for (; i + 8 <= end; i += 8){
+            _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_loadu_ps(out + i), divisor));
+        }
+        for (; i < end; ++i){
+            out[i] /= fcount;
+        }
+    }
+}
+
+CAS_AVX2 static void CASLuminanceAVX2(const float* rgba, float* out, size_t count)
+{
+    const __m256 wr = _mm256_set1_ps(CAS_LUMINANCE_R);
+    const __m256 wg = _mm256_set1_ps(CAS_LUMINANCE_G);
+    const __m256 wb = _mm256_set1_ps(CAS_LUMINANCE_B);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    
+    // the in-lane transpose leaves the pixels in 0,2,4,6,1,3,5,7 order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, rgba += 32){
+        const __m256 p01 = _mm256_loadu_ps(rgba);
+        const __m256 p23 = _mm256_loadu_ps(rgba + 8);
+        const __m256 p45 = _mm256_loadu_ps(rgba + 16);
+        const __m256 p67 = _mm256_loadu_ps(rgba + 24);
+        const __m256 rg0 = _mm256_unpacklo_ps(p01, p23);
+        const __m256 ba0 = _mm256_unpackhi_ps(p01, p23);
+        const __m256 rg1 = _mm256_unpacklo_ps(p45, p67);
+        const __m256 ba1 = _mm256_unpackhi_ps(p45, p67);
+        const __m256 r = _mm256_shuffle_ps(rg0, rg1, 0x44);
+        const __m256 g = _mm256_shuffle_ps(rg0, rg1, 0xEE);
+        const __m256 b = _mm256_shuffle_ps(ba0, ba1, 0x44);
+        const __m256 l = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wr, r), _mm256_mul_ps(wg, g)), _mm256_mul_ps(wb, b));
+        _mm256_storeu_ps(out + i, _mm256_permutevar8x32_ps(_mm256_min_ps(l, one), order));
+    }
+    for (; i < count; ++i, rgba += 4){
+        const float l = (CAS_LUMINANCE_R * rgba[0]) + (CAS_LUMINANCE_G * rgba[1]) + (CAS_LUMINANCE_B * rgba[2]);
+        out[i] = std::min(1.0f, l);
+    }
+}
+
+template <bool hasOffset, bool hasFlat, bool hasFlatOffset>
+CAS_AVX2 static void CASCalibrateAVX2T(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count)
+{
+    const __m256 m = _mm256_set1_ps(flatMean);
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m256 v = _mm256_loadu_ps(light + i);
+        if (hasOffset){
+            v = _mm256_sub_ps(v, _mm256_loadu_ps(offset + i));
+        }
+        if (hasFlat){
+            __m256 f = _mm256_loadu_ps(flat + i);
+            if (hasFlatOffset){
+                f = _mm256_sub_ps(f, _mm256_loadu_ps(flatOffset + i));
+            }
+            const __m256 corrected = _mm256_div_ps(_mm256_mul_ps(v, m), f);
+            v = _mm256_blendv_ps(v, corrected, _mm256_cmp_ps(f, zero, _CMP_NEQ_UQ));
+        }
+        _mm256_storeu_ps(out + i, v);
+    }
+    for (; i < count; ++i){
+        out[i] = CASCalibratePixel<hasOffset,hasFlat,hasFlatOffset>(light, offset, flat, flatOffset, flatMean, i);
+    }
+}
+
+static void CASCalibrateAVX2(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count)
+{
+    CAS_KERNELS_CALIBRATE_DISPATCH(CASCalibrateAVX2T);
+}
+
+struct CASMedianFloatAVX2 {
+    typedef float Pixel;
+    typedef __m256 Vector;
+    enum { width = 8 };
+    CAS_AVX2 static inline Vector load(const float* p) { return _mm256_loadu_ps(p); }
+    CAS_AVX2 static inline void store(float* p, Vector v) { _mm256_storeu_ps(p, v); }
+    CAS_AVX2 static inline Vector lo(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+    CAS_AVX2 static inline Vector hi(Vector a, Vector b) { return _mm256_max_ps(a, b); }
+};
+
+struct CASMedianU16AVX2 {
+    typedef uint16_t Pixel;
+    typedef __m256i Vector;
+    enum { width = 16 };
+    CAS_AVX2 static inline Vector load(const uint16_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+    CAS_AVX2 static inline void store(uint16_t* p, Vector v) { _mm256_storeu_si256((__m256i*)p, v); }
+    CAS_AVX2 static inline Vector lo(Vector a, Vector b) { return _mm256_min_epu16(a, b); }
+    CAS_AVX2 static inline Vector hi(Vector a, Vector b) { return _mm256_max_epu16(a, b); }
+};
+
+template <int diameter, typename Ops>
+CAS_AVX2 static void CASMedianAVX2T(const typename Ops::Pixel* const* rows, typename Ops::Pixel* out, size_t count)
+{
+    typename Ops::Vector p[25];
+    size_t i = 0;
+    for (; i + Ops::width <= count; i += Ops::width){
+        for (int y = 0; y < diameter; ++y){
+            for (int x = 0; x < diameter; ++x){
+                p[y * diameter + x] = Ops::load(rows[y] + i + x);
+            }
+        }
+        if (diameter == 3){
+            CAS_MEDIAN_NETWORK_3X3(CAS_MEDIAN_SORT)
+            Ops::store(out + i, p[4]);
+        }
+        else {
+            CAS_MEDIAN_NETWORK_5X5(CAS_MEDIAN_SORT)
+            Ops::store(out + i, p[12]);
+        }
+    }
+    for (; i < count; ++i){
+        out[i] = CASMedianPixel<diameter>(rows, i);
+    }
+}
+
+CAS_AVX2 static void CASHistogramSlideAVX2(uint16_t* histogram, const uint8_t* add, const uint8_t* remove, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16){
+        __m256i delta = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(add + i)));
+        if (remove){
+            delta = _mm256_sub_epi16(delta, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(remove + i))));
+        }
+        __m256i* h = (__m256i*)(histogram + i);
+        _mm256_storeu_si256(h, _mm256_add_epi16(_mm256_loadu_si256(h), delta));
+    }
+    for (; i < count; ++i){
+        histogram[i] += add[i] - (remove ? remove[i] : 0);
+    }
+}
+
+CAS_AVX2 static void CASSortColumnsAVX2(float* rows, size_t stride, const uint16_t* comparators, size_t comparatorCount, size_t count)
+{
+    // a column of 8 at a time through the whole network so that it stays in L1
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        float* column = rows + i;
+        for (size_t c = 0; c < comparatorCount; ++c){
+            float* a = column + comparators[2 * c] * stride;
+            float* b = column + comparators[2 * c + 1] * stride;
+            const __m256 va = _mm256_loadu_ps(a);
+            const __m256 vb = _mm256_loadu_ps(b);
+            _mm256_storeu_ps(a, _mm256_min_ps(va, vb));
+            _mm256_storeu_ps(b, _mm256_max_ps(va, vb));
+        }
+    }
+    for (; i < count; ++i){
+        float* column = rows + i;
+        for (size_t c = 0; c < comparatorCount; ++c){
+            float* a = column + comparators[2 * c] * stride;
+            float* b = column + comparators[2 * c + 1] * stride;
+            const float lo = std::min(*a, *b);
+            *b = std::max(*a, *b);
+            *a = lo;
+        }
+    }
+}
+
+CAS_AVX2 static void CASWeightedSumAVX2(float* out, float a, const float* in, float b, float c, size_t count)
+{
+    const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), vc = _mm256_set1_ps(c);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(va, _mm256_loadu_ps(out + i)), _mm256_mul_ps(vb, _mm256_loadu_ps(in + i))), vc));
+    }
+    for (; i < count; ++i){
+        out[i] = a * out[i] + b * in[i] + c;
+    }
+}
+
+CAS_AVX2 static void CASConvolveAVX2(float* out, const float* const* rows, const float* weights, size_t rowCount, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(rows[0] + i));
+        for (size_t k = 1; k < rowCount; ++k){
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+        }
+        _mm256_storeu_ps(out + i, sum);
+    }
+    for (; i < count; ++i){
+        float sum = weights[0] * rows[0][i];
+        for (size_t k = 1; k < rowCount; ++k){
+            sum += weights[k] * rows[k][i];
+        }
+        out[i] = sum;
+    }
+}
+
+CAS_AVX2 static void CASRecursiveStepAVX2(float* out, double* state, const float* in, const double* const* previous, const double* c, size_t count)
+{
+    const double* p1 = previous[0];
+    const double* p2 = previous[1];
+    const double* p3 = previous[2];
+    const __m256d c0 = _mm256_set1_pd(c[0]), c2 = _mm256_set1_pd(c[2]), c3 = _mm256_set1_pd(c[3]);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        const __m256d d = _mm256_loadu_pd(p1 + i);
+        const __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(in + i));
+        const __m256d older = _mm256_add_pd(_mm256_mul_pd(c2, _mm256_sub_pd(_mm256_loadu_pd(p2 + i), d)), _mm256_mul_pd(c3, _mm256_sub_pd(_mm256_loadu_pd(p3 + i), d)));
+        const __m256d v = _mm256_add_pd(d, _mm256_add_pd(_mm256_mul_pd(c0, _mm256_sub_pd(x, d)), older));
+        _mm256_storeu_pd(state + i, v);
+        _mm_storeu_ps(out + i, _mm256_cvtpd_ps(v));
+    }
+    for (; i < count; ++i){
+        const double d = p1[i];
+        const double v = d + (c[0] * (in[i] - d) + (c[2] * (p2[i] - d) + c[3] * (p3[i] - d)));
+        state[i] = v;
+        out[i] = v;
+    }
+}
+
+CAS_AVX2 static void CASWidenU16AVX2(const uint16_t* in, float divisor, float* out, size_t count)
+{
+    const __m256 vd = _mm256_set1_ps(divisor);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        const __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), vd));
+    }
+    for (; i < count; ++i){
+        out[i] = in[i] / divisor;
+    }
+}
+
+CAS_AVX2 static void CASHalveU16AVX2(const uint16_t* row0, const uint16_t* row1, uint16_t* out, size_t count)
+{
+    const __m256i mask = _mm256_set1_epi32(0xffff), two = _mm256_set1_epi32(2);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16){
+        __m256i sums[2];
+        for (int h = 0; h < 2; ++h){
+            const __m256i a = _mm256_loadu_si256((const __m256i*)(row0 + 2 * i + 16 * h));
+            const __m256i b = _mm256_loadu_si256((const __m256i*)(row1 + 2 * i + 16 * h));
+            const __m256i pairs = _mm256_add_epi32(_mm256_add_epi32(_mm256_and_si256(a, mask), _mm256_srli_epi32(a, 16)), _mm256_add_epi32(_mm256_and_si256(b, mask), _mm256_srli_epi32(b, 16)));
+            sums[h] = _mm256_srli_epi32(_mm256_add_epi32(pairs, two), 2);
+        }
+        // the pack works within 128-bit lanes so the middle quarters need swapping back
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(sums[0], sums[1]), _MM_SHUFFLE(3,1,2,0)));
+    }
+    for (; i < count; ++i){
+        out[i] = CASHalveU16Sample(row0, row1, i);
+    }
+}
+
+CAS_AVX2 static void CASHalveFloatAVX2(const float* row0, const float* row1, float* out, size_t count, size_t channelCount)
+{
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    size_t i = 0;
+    if (channelCount == 4){
+        for (; i + 2 <= count; i += 2){
+            const __m256 a0 = _mm256_loadu_ps(row0 + 8 * i), a1 = _mm256_loadu_ps(row0 + 8 * i + 8);
+            const __m256 b0 = _mm256_loadu_ps(row1 + 8 * i), b1 = _mm256_loadu_ps(row1 + 8 * i + 8);
+            const __m256 a = _mm256_add_ps(_mm256_permute2f128_ps(a0, a1, 0x20), _mm256_permute2f128_ps(a0, a1, 0x31));
+            const __m256 b = _mm256_add_ps(_mm256_permute2f128_ps(b0, b1, 0x20), _mm256_permute2f128_ps(b0, b1, 0x31));
+            _mm256_storeu_ps(out + 4 * i, _mm256_mul_ps(_mm256_add_ps(a, b), quarter));
+        }
+        for (i *= 4; i < count * 4; ++i){
+            out[i] = CASHalveFloatSample(row0, row1, i, 4);
+        }
+        return;
+    }
+    for (; i + 8 <= count; i += 8){
+        const __m256 a0 = _mm256_loadu_ps(row0 + 2 * i), a1 = _mm256_loadu_ps(row0 + 2 * i + 8);
+        const __m256 b0 = _mm256_loadu_ps(row1 + 2 * i), b1 = _mm256_loadu_ps(row1 + 2 * i + 8);
+        const __m256 a = _mm256_add_ps(_mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(2,0,2,0)), _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(3,1,3,1)));
+        const __m256 b = _mm256_add_ps(_mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(2,0,2,0)), _mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(3,1,3,1)));
+        // the shuffles work within 128-bit lanes too
+        const __m256 sum = _mm256_mul_ps(_mm256_add_ps(a, b), quarter);
+        _mm256_storeu_ps(out + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3,1,2,0))));
+    }
+    for (; i < count; ++i){
+        out[i] = CASHalveFloatSample(row0, row1, i, 1);
+    }
+}
+
+const CASKernelTable* CASKernelsAVX2()
+{
+    static const CASKernelTable table = {
+        kCASKernelISAAVX2,
+        "avx2",
+        CASInvertAVX2,
+        CASSumAVX2,
+        CASDivideFlatAVX2,
+        CASAverageAVX2,
+        CASLuminanceAVX2,
+        CASCalibrateAVX2,
+        CASMedianAVX2T<3,CASMedianFloatAVX2>,
+        CASMedianAVX2T<5,CASMedianFloatAVX2>,
+        CASMedianAVX2T<3,CASMedianU16AVX2>,
+        CASMedianAVX2T<5,CASMedianU16AVX2>,
+        CASHistogramSlideAVX2,
+        CASSortColumnsAVX2,
+        CASWeightedSumAVX2,
+        CASConvolveAVX2,
+        CASRecursiveStepAVX2,
+        CASWidenU16AVX2,
+        CASHalveU16AVX2,
+        CASHalveFloatAVX2
+    };
+    return &table;
+}
+
+#else
+
+const CASKernelTable* CASKernelsAVX2()
+{
+    return NULL;
+}
+
+#endif
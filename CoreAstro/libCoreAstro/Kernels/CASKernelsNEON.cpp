@@ -0,0 +1,416 @@
+//
+//  CASKernelsNEON.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  NEON kernels for ARM hosts, 4 floats at a time.
+
+#include "CASKernelsPrivate.h"
+
+#if CAS_KERNELS_NEON
+
+#include <arm_neon.h>
+#include <algorithm>
+
+// partial sums are kept in single precision for this many values before being added to the double total
+#define CAS_NEON_SUM_BLOCK 4096
+
+static void CASInvertNEON(float* pixels, size_t count)
+{
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        vst1q_f32(pixels + i, vsubq_f32(one, vld1q_f32(pixels + i)));
+    }
+    for (; i < count; ++i){
+        pixels[i] = 1.0f - pixels[i];
+    }
+}
+
+static double CASSumNEON(const float* pixels, size_t count)
+{
+    double total = 0;
+    size_t i = 0;
+    while (i + 4 <= count){
+        const size_t end = std::min(count, i + CAS_NEON_SUM_BLOCK);
+        float32x4_t acc = vdupq_n_f32(0);
+        for (; i + 4 <= end; i += 4){
+            acc = vaddq_f32(acc, vld1q_f32(pixels + i));
+        }
+        float lanes[4];
+        vst1q_f32(lanes, acc);
+        total += (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    for (; i < count; ++i){
+        total += pixels[i];
+    }
+    return total;
+}
+
+static void CASDivideFlatNEON(float* pixels, const float* flat, float mean, size_t count)
+{
+    const float32x4_t m = vdupq_n_f32(mean);
+    const float32x4_t zero = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        const float32x4_t p = vld1q_f32(pixels + i);
+        const float32x4_t f = vld1q_f32(flat + i);
+#if defined(__aarch64__)
+        const float32x4_t corrected = vdivq_f32(vmulq_f32(p, m), f);
+#else
+        // no vector divide on armv7, refine the reciprocal estimate twice
+        float32x4_t r = vrecpeq_f32(f);
+        r = vmulq_f32(vrecpsq_f32(f, r), r);
+        r = vmulq_f32(vrecpsq_f32(f, r), r);
+        const float32x4_t corrected = vmulq_f32(vmulq_f32(p, m), r);
+#endif
+        const uint32x4_t zeros = vceqq_f32(f, zero);
+        vst1q_f32(pixels + i, vbslq_f32(zeros, p, corrected));
+    }
+    for (; i < count; ++i){
+        if (flat[i] != 0){
+            pixels[i] = (pixels[i] * mean) / flat[i];
+        }
+    }
+}
+
+static void CASAverageNEON(const float* const* planes, size_t planeCount, float* out, size_t count)
+{
+    if (!planeCount){
+        std::fill(out, out + count, 0.0f);
+        return;
+    }
+    
+    const float fcount = planeCount;
+    const float32x4_t scale = vdupq_n_f32(1.0f / fcount);
+    for (size_t block = 0; block < count; block += CAS_KERNELS_AVERAGE_BLOCK){
+        
+        const size_t end = std::min(count, block + CAS_KERNELS_AVERAGE_BLOCK);
+        std::copy(planes[0] + block, planes[0] + end, out + block);
+        for (size_t j = 1; j < planeCount; ++j){
+            const float* plane = planes[j];
+            size_t i = block;
+            for (; i + 4 <= end; i += 4){
+                vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), vld1q_f32(plane + i)));
+            }
+            for (; i < end; ++i){
+                out[i] += plane[i];
+            }
+        }
+        size_t i = block;
+        for (; i + 4 <= end; i += 4){
+            vst1q_f32(out + i, vmulq_f32(vld1q_f32(out + i), scale));
+        }
+        for (; i < end; ++i){
+            out[i] /= fcount;
+        }
+    }
+}
+
+static void CASLuminanceNEON(const float* rgba, float* out, size_t count)
+{
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, rgba += 16){
+        const float32x4x4_t p = vld4q_f32(rgba);
+        float32x4_t l = vmulq_n_f32(p.val[0], CAS_LUMINANCE_R);
+        l = vmlaq_n_f32(l, p.val[1], CAS_LUMINANCE_G);
+        l = vmlaq_n_f32(l, p.val[2], CAS_LUMINANCE_B);
+        vst1q_f32(out + i, vminq_f32(l, one));
+    }
+    for (; i < count; ++i, rgba += 4){
+        const float l = (CAS_LUMINANCE_R * rgba[0]) + (CAS_LUMINANCE_G * rgba[1]) + (CAS_LUMINANCE_B * rgba[2]);
+        out[i] = std::min(1.0f, l);
+    }
+}
+
+template <bool hasOffset, bool hasFlat, bool hasFlatOffset>
+static void CASCalibrateNEONT(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count)
+{
+    const float32x4_t m = vdupq_n_f32(flatMean);
+    const float32x4_t zero = vdupq_n_f32(0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        float32x4_t v = vld1q_f32(light + i);
+        if (hasOffset){
+            v = vsubq_f32(v, vld1q_f32(offset + i));
+        }
+        if (hasFlat){
+            float32x4_t f = vld1q_f32(flat + i);
+            if (hasFlatOffset){
+                f = vsubq_f32(f, vld1q_f32(flatOffset + i));
+            }
+#if defined(__aarch64__)
+            const float32x4_t corrected = vdivq_f32(vmulq_f32(v, m), f);
+#else
+            float32x4_t r = vrecpeq_f32(f);
+            r = vmulq_f32(vrecpsq_f32(f, r), r);
+            r = vmulq_f32(vrecpsq_f32(f, r), r);
+            const float32x4_t corrected = vmulq_f32(vmulq_f32(v, m), r);
+#endif
+            v = vbslq_f32(vceqq_f32(f, zero), v, corrected);
+        }
+        vst1q_f32(out + i, v);
+    }
+    for (; i < count; ++i){
+        out[i] = CASCalibratePixel<hasOffset,hasFlat,hasFlatOffset>(light, offset, flat, flatOffset, flatMean, i);
+    }
+}
+
+static void CASCalibrateNEON(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count)
+{
+    CAS_KERNELS_CALIBRATE_DISPATCH(CASCalibrateNEONT);
+}
+
+struct CASMedianFloatNEON {
+    typedef float Pixel;
+    typedef float32x4_t Vector;
+    enum { width = 4 };
+    static inline Vector load(const float* p) { return vld1q_f32(p); }
+    static inline void store(float* p, Vector v) { vst1q_f32(p, v); }
+    static inline Vector lo(Vector a, Vector b) { return vminq_f32(a, b); }
+    static inline Vector hi(Vector a, Vector b) { return vmaxq_f32(a, b); }
+};
+
+struct CASMedianU16NEON {
+    typedef uint16_t Pixel;
+    typedef uint16x8_t Vector;
+    enum { width = 8 };
+    static inline Vector load(const uint16_t* p) { return vld1q_u16(p); }
+    static inline void store(uint16_t* p, Vector v) { vst1q_u16(p, v); }
+    static inline Vector lo(Vector a, Vector b) { return vminq_u16(a, b); }
+    static inline Vector hi(Vector a, Vector b) { return vmaxq_u16(a, b); }
+};
+
+template <int diameter, typename Ops>
+static void CASMedianNEONT(const typename Ops::Pixel* const* rows, typename Ops::Pixel* out, size_t count)
+{
+    typename Ops::Vector p[25];
+    size_t i = 0;
+    for (; i + Ops::width <= count; i += Ops::width){
+        for (int y = 0; y < diameter; ++y){
+            for (int x = 0; x < diameter; ++x){
+                p[y * diameter + x] = Ops::load(rows[y] + i + x);
+            }
+        }
+        if (diameter == 3){
+            CAS_MEDIAN_NETWORK_3X3(CAS_MEDIAN_SORT)
+            Ops::store(out + i, p[4]);
+        }
+        else {
+            CAS_MEDIAN_NETWORK_5X5(CAS_MEDIAN_SORT)
+            Ops::store(out + i, p[12]);
+        }
+    }
+    for (; i < count; ++i){
+        out[i] = CASMedianPixel<diameter>(rows, i);
+    }
+}
+
+static void CASHistogramSlideNEON(uint16_t* histogram, const uint8_t* add, const uint8_t* remove, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        uint16x8_t h = vaddw_u8(vld1q_u16(histogram + i), vld1_u8(add + i));
+        if (remove){
+            h = vsubw_u8(h, vld1_u8(remove + i));
+        }
+        vst1q_u16(histogram + i, h);
+    }
+    for (; i < count; ++i){
+        histogram[i] += add[i] - (remove ? remove[i] : 0);
+    }
+}
+
+static void CASSortColumnsNEON(float* rows, size_t stride, const uint16_t* comparators, size_t comparatorCount, size_t count)
+{
+    // a column of 4 at a time through the whole network so that it stays in L1
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        float* column = rows + i;
+        for (size_t c = 0; c < comparatorCount; ++c){
+            float* a = column + comparators[2 * c] * stride;
+            float* b = column + comparators[2 * c + 1] * stride;
+            const float32x4_t va = vld1q_f32(a);
+            const float32x4_t vb = vld1q_f32(b);
+            vst1q_f32(a, vminq_f32(va, vb));
+            vst1q_f32(b, vmaxq_f32(va, vb));
+        }
+    }
+    for (; i < count; ++i){
+        float* column = rows + i;
+        for (size_t c = 0; c < comparatorCount; ++c){
+            float* a = column + comparators[2 * c] * stride;
+            float* b = column + comparators[2 * c + 1] * stride;
+            const float lo = std::min(*a, *b);
+            *b = std::max(*a, *b);
+            *a = lo;
+        }
+    }
+}
+
+static void CASWeightedSumNEON(float* out, float a, const float* in, float b, float c, size_t count)
+{
+    const float32x4_t va = vdupq_n_f32(a), vb = vdupq_n_f32(b), vc = vdupq_n_f32(c);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        vst1q_f32(out + i, vaddq_f32(vaddq_f32(vmulq_f32(va, vld1q_f32(out + i)), vmulq_f32(vb, vld1q_f32(in + i))), vc));
+    }
+    for (; i < count; ++i){
+        out[i] = a * out[i] + b * in[i] + c;
+    }
+}
+
+static void CASConvolveNEON(float* out, const float* const* rows, const float* weights, size_t rowCount, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        float32x4_t sum = vmulq_f32(vdupq_n_f32(weights[0]), vld1q_f32(rows[0] + i));
+        for (size_t k = 1; k < rowCount; ++k){
+            sum = vaddq_f32(sum, vmulq_f32(vdupq_n_f32(weights[k]), vld1q_f32(rows[k] + i)));
+        }
+        vst1q_f32(out + i, sum);
+    }
+    for (; i < count; ++i){
+        float sum = weights[0] * rows[0][i];
+        for (size_t k = 1; k < rowCount; ++k){
+            sum += weights[k] * rows[k][i];
+        }
+        out[i] = sum;
+    }
+}
+
+static void CASRecursiveStepNEON(float* out, double* state, const float* in, const double* const* previous, const double* c, size_t count)
+{
+    const double* p1 = previous[0];
+    const double* p2 = previous[1];
+    const double* p3 = previous[2];
+    size_t i = 0;
+#if defined(__aarch64__)
+    const float64x2_t c0 = vdupq_n_f64(c[0]), c2 = vdupq_n_f64(c[2]), c3 = vdupq_n_f64(c[3]);
+    for (; i + 2 <= count; i += 2){
+        const float64x2_t d = vld1q_f64(p1 + i);
+        const float64x2_t x = vcvt_f64_f32(vld1_f32(in + i));
+        const float64x2_t older = vaddq_f64(vmulq_f64(c2, vsubq_f64(vld1q_f64(p2 + i), d)), vmulq_f64(c3, vsubq_f64(vld1q_f64(p3 + i), d)));
+        const float64x2_t v = vaddq_f64(d, vaddq_f64(vmulq_f64(c0, vsubq_f64(x, d)), older));
+        vst1q_f64(state + i, v);
+        vst1_f32(out + i, vcvt_f32_f64(v));
+    }
+#endif
+    // no double precision vectors on armv7
+    for (; i < count; ++i){
+        const double d = p1[i];
+        const double v = d + (c[0] * (in[i] - d) + (c[2] * (p2[i] - d) + c[3] * (p3[i] - d)));
+        state[i] = v;
+        out[i] = v;
+    }
+}
+
+static void CASWidenU16NEON(const uint16_t* in, float divisor, float* out, size_t count)
+{
+    size_t i = 0;
+#if defined(__aarch64__)
+    const float32x4_t vd = vdupq_n_f32(divisor);
+    for (; i + 8 <= count; i += 8){
+        const uint16x8_t v = vld1q_u16(in + i);
+        vst1q_f32(out + i, vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), vd));
+        vst1q_f32(out + i + 4, vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), vd));
+    }
+#endif
+    // armv7 only has a reciprocal estimate, which wouldn't match the other versions
+    for (; i < count; ++i){
+        out[i] = in[i] / divisor;
+    }
+}
+
+static void CASHalveU16NEON(const uint16_t* row0, const uint16_t* row1, uint16_t* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        const uint16x8x2_t a = vld2q_u16(row0 + 2 * i);
+        const uint16x8x2_t b = vld2q_u16(row1 + 2 * i);
+        const uint32x4_t lo = vaddq_u32(vaddl_u16(vget_low_u16(a.val[0]), vget_low_u16(a.val[1])), vaddl_u16(vget_low_u16(b.val[0]), vget_low_u16(b.val[1])));
+        const uint32x4_t hi = vaddq_u32(vaddl_u16(vget_high_u16(a.val[0]), vget_high_u16(a.val[1])), vaddl_u16(vget_high_u16(b.val[0]), vget_high_u16(b.val[1])));
+        vst1q_u16(out + i, vcombine_u16(vrshrn_n_u32(lo, 2), vrshrn_n_u32(hi, 2)));
+    }
+    for (; i < count; ++i){
+        out[i] = CASHalveU16Sample(row0, row1, i);
+    }
+}
+
+static void CASHalveFloatNEON(const float* row0, const float* row1, float* out, size_t count, size_t channelCount)
+{
+    const float32x4_t quarter = vdupq_n_f32(0.25f);
+    size_t i = 0;
+    if (channelCount == 4){
+        for (; i < count; ++i){
+            const float32x4_t a = vaddq_f32(vld1q_f32(row0 + 8 * i), vld1q_f32(row0 + 8 * i + 4));
+            const float32x4_t b = vaddq_f32(vld1q_f32(row1 + 8 * i), vld1q_f32(row1 + 8 * i + 4));
+            vst1q_f32(out + 4 * i, vmulq_f32(vaddq_f32(a, b), quarter));
+        }
+        return;
+    }
+    for (; i + 4 <= count; i += 4){
+        const float32x4x2_t a = vld2q_f32(row0 + 2 * i);
+        const float32x4x2_t b = vld2q_f32(row1 + 2 * i);
+        vst1q_f32(out + i, vmulq_f32(vaddq_f32(vaddq_f32(a.val[0], a.val[1]), vaddq_f32(b.val[0], b.val[1])), quarter));
+    }
+    for (; i < count; ++i){
+        out[i] = CASHalveFloatSample(row0, row1, i, 1);
+    }
+}
+
+const CASKernelTable* CASKernelsNEON()
+{
+    static const CASKernelTable table = {
+        kCASKernelISANEON,
+        "neon",
+        CASInvertNEON,
+        CASSumNEON,
+        CASDivideFlatNEON,
+        CASAverageNEON,
+        CASLuminanceNEON,
+        CASCalibrateNEON,
+        CASMedianNEONT<3,CASMedianFloatNEON>,
+        CASMedianNEONT<5,CASMedianFloatNEON>,
+        CASMedianNEONT<3,CASMedianU16NEON>,
+        CASMedianNEONT<5,CASMedianU16NEON>,
+        CASHistogramSlideNEON,
+        CASSortColumnsNEON,
+        CASWeightedSumNEON,
+        CASConvolveNEON,
+        CASRecursiveStepNEON,
+        CASWidenU16NEON,
+        CASHalveU16NEON,
+        CASHalveFloatNEON
+    };
+    return &table;
+}
+
+#else
+
+const CASKernelTable* CASKernelsNEON()
+{
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,162 @@
+//
+//  CASKernelsPrivate.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Shared between the per-ISA kernel translation units, not part of the public interface.
+
+#ifndef __CASKernelsPrivate_h__
+#define __CASKernelsPrivate_h__
+
+#include "CASKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CAS_KERNELS_X86 1
+#define CAS_KERNELS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CAS_KERNELS_X86 0
+#define CAS_KERNELS_TARGET(isa)
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CAS_KERNELS_NEON 1
+#else
+#define CAS_KERNELS_NEON 0
+#endif
+
+// luminance weights, Rec. 709
+#define CAS_LUMINANCE_R 0.2126f
+#define CAS_LUMINANCE_G 0.7152f
+#define CAS_LUMINANCE_B 0.0722f
+
+// number of pixels averaged at a time so that the running total stays in L1
+#define CAS_KERNELS_AVERAGE_BLOCK 1024
+
+// calls the calibration kernel template instantiated for whichever optional master frames are present
+#define CAS_KERNELS_CALIBRATE_DISPATCH(kernel) \
+    do { \
+        if (!flat){ \
+            if (offset) kernel<true,false,false>(light, offset, flat, flatOffset, flatMean, out, count); \
+            else kernel<false,false,false>(light, offset, flat, flatOffset, flatMean, out, count); \
+        } \
+        else if (offset){ \
+            if (flatOffset) kernel<true,true,true>(light, offset, flat, flatOffset, flatMean, out, count); \
+            else kernel<true,true,false>(light, offset, flat, flatOffset, flatMean, out, count); \
+        } \
+        else { \
+            if (flatOffset) kernel<false,true,true>(light, offset, flat, flatOffset, flatMean, out, count); \
+            else kernel<false,true,false>(light, offset, flat, flatOffset, flatMean, out, count); \
+        } \
+    } while (0)
+
+// scalar calibration of a single pixel, shared by the tails of the vector loops
+template <bool hasOffset, bool hasFlat, bool hasFlatOffset>
+static inline float CASCalibratePixel(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, size_t i)
+{
+    float value = light[i];
+    if (hasOffset){
+        value -= offset[i];
+    }
+    if (hasFlat){
+        float f = flat[i];
+        if (hasFlatOffset){
+            f -= flatOffset[i];
+        }
+        if (f != 0){
+            value = (value * flatMean) / f;
+        }
+    }
+    return value;
+}
+
+// one output sample of the 2x2 halving kernels, shared by the tails of the vector loops so they all round the same way
+static inline uint16_t CASHalveU16Sample(const uint16_t* row0, const uint16_t* row1, size_t i)
+{
+    return (uint16_t)((row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1] + 2) >> 2);
+}
+
+// i counts output floats, so is the channel of pixel i / channelCount
+static inline float CASHalveFloatSample(const float* row0, const float* row1, size_t i, size_t channelCount)
+{
+    const size_t a = (i / channelCount) * 2 * channelCount + i % channelCount, b = a + channelCount;
+    return ((row0[a] + row0[b]) + (row1[a] + row1[b])) * 0.25f;
+}
+
+// median selection networks, Paeth's for 3x3 and Devillard's for 5x5. these are macros rather than
+// templates so that they expand inside the target-specific kernel functions, which lets the compiler
+// inline the vector min/max. SORT(a,b) must leave the lower of p[a],p[b] in p[a] and the higher in p[b]
+#define CAS_MEDIAN_NETWORK_3X3(SORT) \
+    SORT(1,2) SORT(4,5) SORT(7,8) SORT(0,1) SORT(3,4) SORT(6,7) SORT(1,2) SORT(4,5) SORT(7,8) \
+    SORT(0,3) SORT(5,8) SORT(4,7) SORT(3,6) SORT(1,4) SORT(2,5) SORT(4,7) SORT(4,2) SORT(6,4) \
+    SORT(4,2)
+
+#define CAS_MEDIAN_NETWORK_5X5(SORT) \
+    SORT(0,1) SORT(3,4) SORT(2,4) SORT(2,3) SORT(6,7) SORT(5,7) SORT(5,6) SORT(9,10) SORT(8,10) \
+    SORT(8,9) SORT(12,13) SORT(11,13) SORT(11,12) SORT(15,16) SORT(14,16) SORT(14,15) SORT(18,19) \
+    SORT(17,19) SORT(17,18) SORT(21,22) SORT(20,22) SORT(20,21) SORT(23,24) SORT(2,5) SORT(3,6) \
+    SORT(0,6) SORT(0,3) SORT(4,7) SORT(1,7) SORT(1,4) SORT(11,14) SORT(8,14) SORT(8,11) SORT(12,15) \
+    SORT(9,15) SORT(9,12) SORT(13,16) SORT(10,16) SORT(10,13) SORT(20,23) SORT(17,23) SORT(17,20) \
+    SORT(21,24) SORT(18,24) SORT(18,21) SORT(19,22) SORT(8,17) SORT(9,18) SORT(0,18) SORT(0,9) \
+    SORT(10,19) SORT(1,19) SORT(1,10) SORT(11,20) SORT(2,20) SORT(2,11) SORT(12,21) SORT(3,21) \
+    SORT(3,12) SORT(13,22) SORT(4,22) SORT(4,13) SORT(14,23) SORT(5,23) SORT(5,14) SORT(15,24) \
+    SORT(6,24) SORT(6,15) SORT(7,16) SORT(7,19) SORT(13,21) SORT(15,23) SORT(7,13) SORT(7,15) \
+    SORT(1,9) SORT(3,11) SORT(5,17) SORT(11,17) SORT(9,17) SORT(4,10) SORT(6,12) SORT(7,14) \
+    SORT(4,6) SORT(4,7) SORT(12,14) SORT(10,14) SORT(6,7) SORT(10,12) SORT(6,10) SORT(6,17) \
+    SORT(12,17) SORT(7,17) SORT(7,10) SORT(12,18) SORT(7,12) SORT(10,18) SORT(12,20) SORT(10,20) \
+    SORT(10,12)
+
+// compare-exchange for the networks above, expects the window in an array p of Ops::Vector
+#define CAS_MEDIAN_SORT(a,b) { const typename Ops::Vector lo = Ops::lo(p[a],p[b]); p[b] = Ops::hi(p[a],p[b]); p[a] = lo; }
+
+template <typename T>
+struct CASMedianScalarOps {
+    typedef T Vector;
+    static inline T lo(T a, T b) { return b < a ? b : a; }
+    static inline T hi(T a, T b) { return b < a ? a : b; }
+};
+
+// scalar median of the window at column i, shared by the tails of the vector loops
+template <int diameter, typename T>
+static inline T CASMedianPixel(const T* const* rows, size_t i)
+{
+    typedef CASMedianScalarOps<T> Ops;
+    T p[25];
+    for (int y = 0; y < diameter; ++y){
+        for (int x = 0; x < diameter; ++x){
+            p[y * diameter + x] = rows[y][i + x];
+        }
+    }
+    if (diameter == 3){
+        CAS_MEDIAN_NETWORK_3X3(CAS_MEDIAN_SORT)
+        return p[4];
+    }
+    CAS_MEDIAN_NETWORK_5X5(CAS_MEDIAN_SORT)
+    return p[12];
+}
+
+// each returns NULL if the ISA isn't available in this build
+const CASKernelTable* CASKernelsScalar();
+const CASKernelTable* CASKernelsSSE2();
+const CASKernelTable* CASKernelsAVX2();
+const CASKernelTable* CASKernelsNEON();
+
+#endif
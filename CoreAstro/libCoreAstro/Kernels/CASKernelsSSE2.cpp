@@ -0,0 +1,415 @@
+//
+//  CASKernelsSSE2.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  SSE2 kernels, 4 floats at a time. SSE2 is part of the x86_64 baseline so these
+//  are always available on Intel Macs.
+
+#include "CASKernelsPrivate.h"
+
+#if CAS_KERNELS_X86
+
+#include <emmintrin.h>
+#include <algorithm>
+
+#define CAS_SSE2 CAS_KERNELS_TARGET("sse2")
+
+CAS_SSE2 static void CASInvertSSE2(float* pixels, size_t count)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        _mm_storeu_ps(pixels + i, _mm_sub_ps(one, _mm_loadu_ps(pixels + i)));
+    }
+    for (; i < count; ++i){
+        pixels[i] = 1.0f - pixels[i];
+    }
+}
+
+CAS_SSE2 static double CASSumSSE2(const float* pixels, size_t count)
+{
+    __m128d lo = _mm_setzero_pd(), hi = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        const __m128 v = _mm_loadu_ps(pixels + i);
+        lo = _mm_add_pd(lo, _mm_cvtps_pd(v));
+        hi = _mm_add_pd(hi, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(lo, hi));
+    double total = lanes[0] + lanes[1];
+    for (; i < count; ++i){
+        total += pixels[i];
+    }
+    return total;
+}
+
+CAS_SSE2 static void CASDivideFlatSSE2(float* pixels, const float* flat, float mean, size_t count)
+{
+    const __m128 m = _mm_set1_ps(mean);
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        const __m128 p = _mm_loadu_ps(pixels + i);
+        const __m128 f = _mm_loadu_ps(flat + i);
+        const __m128 corrected = _mm_div_ps(_mm_mul_ps(p, m), f);
+        const __m128 valid = _mm_cmpneq_ps(f, zero);
+        _mm_storeu_ps(pixels + i, _mm_or_ps(_mm_and_ps(valid, corrected), _mm_andnot_ps(valid, p)));
+    }
+    for (; i < count; ++i){
+        if (flat[i] != 0){
+            pixels[i] = (pixels[i] * mean) / flat[i];
+        }
+    }
+}
+
+CAS_SSE2 static void CASAverageSSE2(const float* const* planes, size_t planeCount, float* out, size_t count)
+{
+    if (!planeCount){
+        std::fill(out, out + count, 0.0f);
+        return;
+    }
+    
+    const float fcount = planeCount;
+    const __m128 divisor = _mm_set1_ps(fcount);
+    for (size_t block = 0; block < count; block += CAS_KERNELS_AVERAGE_BLOCK){
+        
+        const size_t end = std::min(count, block + CAS_KERNELS_AVERAGE_BLOCK);
+        std::copy(planes[0] + block, planes[0] + end, out + block);
+        for (size_t j = 1; j < planeCount; ++j){
+            const float* plane = planes[j];
+            size_t i = block;
+            for (; i + 4 <= end; i += 4){
+                _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_loadu_ps(plane + i)));
+            }
+            for (; i < end; ++i){
+                out[i] += plane[i];
+            }
+        }
+        size_t i = block;
+        for (; i + 4 <= end; i += 4){
+            _mm_storeu_ps(out + i, _mm_div_ps(_mm_loadu_ps(out + i), divisor));
+        }
+        for (; i < end; ++i){
+            out[i] /= fcount;
+        }
+    }
+}
+
+CAS_SSE2 static void CASLuminanceSSE2(const float* rgba, float* out, size_t count)
+{
+    const __m128 wr = _mm_set1_ps(CAS_LUMINANCE_R);
+    const __m128 wg = _mm_set1_ps(CAS_LUMINANCE_G);
+    const __m128 wb = _mm_set1_ps(CAS_LUMINANCE_B);
+    const __m128 one = _mm_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, rgba += 16){
+        __m128 r = _mm_loadu_ps(rgba);
+        __m128 g = _mm_loadu_ps(rgba + 4);
+        __m128 b = _mm_loadu_ps(rgba + 8);
+        __m128 a = _mm_loadu_ps(rgba + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        const __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wr, r), _mm_mul_ps(wg, g)), _mm_mul_ps(wb, b));
+        _mm_storeu_ps(out + i, _mm_min_ps(l, one));
+    }
+    for (; i < count; ++i, rgba += 4){
+        const float l = (CAS_LUMINANCE_R * rgba[0]) + (CAS_LUMINANCE_G * rgba[1]) + (CAS_LUMINANCE_B * rgba[2]);
+        out[i] = std::min(1.0f, l);
+    }
+}
+
+template <bool hasOffset, bool hasFlat, bool hasFlatOffset>
+CAS_SSE2 static void CASCalibrateSSE2T(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count)
+{
+    const __m128 m = _mm_set1_ps(flatMean);
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128 v = _mm_loadu_ps(light + i);
+        if (hasOffset){
+            v = _mm_sub_ps(v, _mm_loadu_ps(offset + i));
+        }
+        if (hasFlat){
+            __m128 f = _mm_loadu_ps(flat + i);
+            if (hasFlatOffset){
+                f = _mm_sub_ps(f, _mm_loadu_ps(flatOffset + i));
+            }
+            const __m128 corrected = _mm_div_ps(_mm_mul_ps(v, m), f);
+            const __m128 valid = _mm_cmpneq_ps(f, zero);
+            v = _mm_or_ps(_mm_and_ps(valid, corrected), _mm_andnot_ps(valid, v));
+        }
+        _mm_storeu_ps(out + i, v);
+    }
+    for (; i < count; ++i){
+        out[i] = CASCalibratePixel<hasOffset,hasFlat,hasFlatOffset>(light, offset, flat, flatOffset, flatMean, i);
+    }
+}
+
+static void CASCalibrateSSE2(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count)
+{
+    CAS_KERNELS_CALIBRATE_DISPATCH(CASCalibrateSSE2T);
+}
+
+struct CASMedianFloatSSE2 {
+    typedef float Pixel;
+    typedef __m128 Vector;
+    enum { width = 4 };
+    CAS_SSE2 static inline Vector load(const float* p) { return _mm_loadu_ps(p); }
+    CAS_SSE2 static inline void store(float* p, Vector v) { _mm_storeu_ps(p, v); }
+    CAS_SSE2 static inline Vector lo(Vector a, Vector b) { return _mm_min_ps(a, b); }
+    CAS_SSE2 static inline Vector hi(Vector a, Vector b) { return _mm_max_ps(a, b); }
+};
+
+// SSE2 only has signed 16-bit min/max so flip the sign bit on the way in and out
+struct CASMedianU16SSE2 {
+    typedef uint16_t Pixel;
+    typedef __m128i Vector;
+    enum { width = 8 };
+    CAS_SSE2 static inline Vector load(const uint16_t* p) { return _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi16((short)0x8000)); }
+    CAS_SSE2 static inline void store(uint16_t* p, Vector v) { _mm_storeu_si128((__m128i*)p, _mm_xor_si128(v, _mm_set1_epi16((short)0x8000))); }
+    CAS_SSE2 static inline Vector lo(Vector a, Vector b) { return _mm_min_epi16(a, b); }
+    CAS_SSE2 static inline Vector hi(Vector a, Vector b) { return _mm_max_epi16(a, b); }
+};
+
+template <int diameter, typename Ops>
+CAS_SSE2 static void CASMedianSSE2T(const typename Ops::Pixel* const* rows, typename Ops::Pixel* out, size_t count)
+{
+    typename Ops::Vector p[25];
+    size_t i = 0;
+    for (; i + Ops::width <= count; i += Ops::width){
+        for (int y = 0; y < diameter; ++y){
+            for (int x = 0; x < diameter; ++x){
+                p[y * diameter + x] = Ops::load(rows[y] + i + x);
+            }
+        }
+        if (diameter == 3){
+            CAS_MEDIAN_NETWORK_3X3(CAS_MEDIAN_SORT)
+            Ops::store(out + i, p[4]);
+        }
+        else {
+            CAS_MEDIAN_NETWORK_5X5(CAS_MEDIAN_SORT)
+            Ops::store(out + i, p[12]);
+        }
+    }
+    for (; i < count; ++i){
+        out[i] = CASMedianPixel<diameter>(rows, i);
+    }
+}
+
+CAS_SSE2 static void CASHistogramSlideSSE2(uint16_t* histogram, const uint8_t* add, const uint8_t* remove, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16){
+        const __m128i a = _mm_loadu_si128((const __m128i*)(add + i));
+        __m128i lo = _mm_unpacklo_epi8(a, zero);
+        __m128i hi = _mm_unpackhi_epi8(a, zero);
+        if (remove){
+            const __m128i r = _mm_loadu_si128((const __m128i*)(remove + i));
+            lo = _mm_sub_epi16(lo, _mm_unpacklo_epi8(r, zero));
+            hi = _mm_sub_epi16(hi, _mm_unpackhi_epi8(r, zero));
+        }
+        __m128i* h = (__m128i*)(histogram + i);
+        _mm_storeu_si128(h, _mm_add_epi16(_mm_loadu_si128(h), lo));
+        _mm_storeu_si128(h + 1, _mm_add_epi16(_mm_loadu_si128(h + 1), hi));
+    }
+    for (; i < count; ++i){
+        histogram[i] += add[i] - (remove ? remove[i] : 0);
+    }
+}
+
+CAS_SSE2 static void CASSortColumnsSSE2(float* rows, size_t stride, const uint16_t* comparators, size_t comparatorCount, size_t count)
+{
+    // a column of 4 at a time through the whole network so that it stays in L1
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        float* column = rows + i;
+        for (size_t c = 0; c < comparatorCount; ++c){
+            float* a = column + comparators[2 * c] * stride;
+            float* b = column + comparators[2 * c + 1] * stride;
+            const __m128 va = _mm_loadu_ps(a);
+            const __m128 vb = _mm_loadu_ps(b);
+            _mm_storeu_ps(a, _mm_min_ps(va, vb));
+            _mm_storeu_ps(b, _mm_max_ps(va, vb));
+        }
+    }
+    for (; i < count; ++i){
+        float* column = rows + i;
+        for (size_t c = 0; c < comparatorCount; ++c){
+            float* a = column + comparators[2 * c] * stride;
+            float* b = column + comparators[2 * c + 1] * stride;
+            const float lo = std::min(*a, *b);
+            *b = std::max(*a, *b);
+            *a = lo;
+        }
+    }
+}
+
+CAS_SSE2 static void CASWeightedSumSSE2(float* out, float a, const float* in, float b, float c, size_t count)
+{
+    const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vc = _mm_set1_ps(c);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(va, _mm_loadu_ps(out + i)), _mm_mul_ps(vb, _mm_loadu_ps(in + i))), vc));
+    }
+    for (; i < count; ++i){
+        out[i] = a * out[i] + b * in[i] + c;
+    }
+}
+
+CAS_SSE2 static void CASConvolveSSE2(float* out, const float* const* rows, const float* weights, size_t rowCount, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(rows[0] + i));
+        for (size_t k = 1; k < rowCount; ++k){
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+    for (; i < count; ++i){
+        float sum = weights[0] * rows[0][i];
+        for (size_t k = 1; k < rowCount; ++k){
+            sum += weights[k] * rows[k][i];
+        }
+        out[i] = sum;
+    }
+}
+
+CAS_SSE2 static void CASRecursiveStepSSE2(float* out, double* state, const float* in, const double* const* previous, const double* c, size_t count)
+{
+    const double* p1 = previous[0];
+    const double* p2 = previous[1];
+    const double* p3 = previous[2];
+    const __m128d c0 = _mm_set1_pd(c[0]), c2 = _mm_set1_pd(c[2]), c3 = _mm_set1_pd(c[3]);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2){
+        const __m128d d = _mm_loadu_pd(p1 + i);
+        const __m128d x = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)(in + i))));
+        const __m128d older = _mm_add_pd(_mm_mul_pd(c2, _mm_sub_pd(_mm_loadu_pd(p2 + i), d)), _mm_mul_pd(c3, _mm_sub_pd(_mm_loadu_pd(p3 + i), d)));
+        const __m128d v = _mm_add_pd(d, _mm_add_pd(_mm_mul_pd(c0, _mm_sub_pd(x, d)), older));
+        _mm_storeu_pd(state + i, v);
+        _mm_storel_epi64((__m128i*)(out + i), _mm_castps_si128(_mm_cvtpd_ps(v)));
+    }
+    for (; i < count; ++i){
+        const double d = p1[i];
+        const double v = d + (c[0] * (in[i] - d) + (c[2] * (p2[i] - d) + c[3] * (p3[i] - d)));
+        state[i] = v;
+        out[i] = v;
+    }
+}
+
+CAS_SSE2 static void CASWidenU16SSE2(const uint16_t* in, float divisor, float* out, size_t count)
+{
+    const __m128 vd = _mm_set1_ps(divisor);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        const __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm_storeu_ps(out + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), vd));
+        _mm_storeu_ps(out + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), vd));
+    }
+    for (; i < count; ++i){
+        out[i] = in[i] / divisor;
+    }
+}
+
+CAS_SSE2 static void CASHalveU16SSE2(const uint16_t* row0, const uint16_t* row1, uint16_t* out, size_t count)
+{
+    // pairs are added as 32-bit lanes, then biased into signed range to pack back down as SSE2 has no unsigned 32-bit pack
+    const __m128i mask = _mm_set1_epi32(0xffff), two = _mm_set1_epi32(2), bias = _mm_set1_epi32(32768), unbias = _mm_set1_epi16((short)0x8000);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m128i sums[2];
+        for (int h = 0; h < 2; ++h){
+            const __m128i a = _mm_loadu_si128((const __m128i*)(row0 + 2 * i + 8 * h));
+            const __m128i b = _mm_loadu_si128((const __m128i*)(row1 + 2 * i + 8 * h));
+            const __m128i pairs = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(a, mask), _mm_srli_epi32(a, 16)), _mm_add_epi32(_mm_and_si128(b, mask), _mm_srli_epi32(b, 16)));
+            sums[h] = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(pairs, two), 2), bias);
+        }
+        _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(_mm_packs_epi32(sums[0], sums[1]), unbias));
+    }
+    for (; i < count; ++i){
+        out[i] = CASHalveU16Sample(row0, row1, i);
+    }
+}
+
+CAS_SSE2 static void CASHalveFloatSSE2(const float* row0, const float* row1, float* out, size_t count, size_t channelCount)
+{
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    size_t i = 0;
+    if (channelCount == 4){
+        for (; i < count; ++i){
+            const __m128 a = _mm_add_ps(_mm_loadu_ps(row0 + 8 * i), _mm_loadu_ps(row0 + 8 * i + 4));
+            const __m128 b = _mm_add_ps(_mm_loadu_ps(row1 + 8 * i), _mm_loadu_ps(row1 + 8 * i + 4));
+            _mm_storeu_ps(out + 4 * i, _mm_mul_ps(_mm_add_ps(a, b), quarter));
+        }
+        return;
+    }
+    for (; i + 4 <= count; i += 4){
+        const __m128 a0 = _mm_loadu_ps(row0 + 2 * i), a1 = _mm_loadu_ps(row0 + 2 * i + 4);
+        const __m128 b0 = _mm_loadu_ps(row1 + 2 * i), b1 = _mm_loadu_ps(row1 + 2 * i + 4);
+        const __m128 a = _mm_add_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2,0,2,0)), _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3,1,3,1)));
+        const __m128 b = _mm_add_ps(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2,0,2,0)), _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3,1,3,1)));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(a, b), quarter));
+    }
+    for (; i < count; ++i){
+        out[i] = CASHalveFloatSample(row0, row1, i, 1);
+    }
+}
+
+const CASKernelTable* CASKernelsSSE2()
+{
+    static const CASKernelTable table = {
+        kCASKernelISASSE2,
+        "sse2",
+        CASInvertSSE2,
+        CASSumSSE2,
+        CASDivideFlatSSE2,
+        CASAverageSSE2,
+        CASLuminanceSSE2,
+        CASCalibrateSSE2,
+        CASMedianSSE2T<3,CASMedianFloatSSE2>,
+        CASMedianSSE2T<5,CASMedianFloatSSE2>,
+        CASMedianSSE2T<3,CASMedianU16SSE2>,
+        CASMedianSSE2T<5,CASMedianU16SSE2>,
+        CASHistogramSlideSSE2,
+        CASSortColumnsSSE2,
+        CASWeightedSumSSE2,
+        CASConvolveSSE2,
+        CASRecursiveStepSSE2,
+        CASWidenU16SSE2,
+        CASHalveU16SSE2,
+        CASHalveFloatSSE2
+    };
+    return &table;
+}
+
+#else
+
+const CASKernelTable* CASKernelsSSE2()
+{
+    return NULL;
+}
+
+#endif
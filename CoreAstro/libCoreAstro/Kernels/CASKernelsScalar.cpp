@@ -0,0 +1,214 @@
+//
+//  CASKernelsScalar.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Plain C++ reference versions of the kernels, used for verifying the SIMD versions
+//  and as the fallback on hosts without any of them.
+
+#include "CASKernelsPrivate.h"
+#include <algorithm>
+
+static void CASInvertScalar(float* pixels, size_t count)
+{
+    for (size_t i = 0; i < count; ++i){
+        pixels[i] = 1.0f - pixels[i];
+    }
+}
+
+static double CASSumScalar(const float* pixels, size_t count)
+{
+    double total = 0;
+    for (size_t i = 0; i < count; ++i){
+        total += pixels[i];
+    }
+    return total;
+}
+
+static void CASDivideFlatScalar(float* pixels, const float* flat, float mean, size_t count)
+{
+    for (size_t i = 0; i < count; ++i){
+        const float f = flat[i];
+        if (f != 0){
+            pixels[i] = (pixels[i] * mean) / f;
+        }
+    }
+}
+
+static void CASAverageScalar(const float* const* planes, size_t planeCount, float* out, size_t count)
+{
+    if (!planeCount){
+        std::fill(out, out + count, 0.0f);
+        return;
+    }
+    
+    const float fcount = planeCount;
+    for (size_t block = 0; block < count; block += CAS_KERNELS_AVERAGE_BLOCK){
+        
+        const size_t end = std::min(count, block + CAS_KERNELS_AVERAGE_BLOCK);
+        std::copy(planes[0] + block, planes[0] + end, out + block);
+        for (size_t j = 1; j < planeCount; ++j){
+            const float* plane = planes[j];
+            for (size_t i = block; i < end; ++i){
+                out[i] += plane[i];
+            }
+        }
+        for (size_t i = block; i < end; ++i){
+            out[i] /= fcount;
+        }
+    }
+}
+
+static void CASLuminanceScalar(const float* rgba, float* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i, rgba += 4){
+        const float l = (CAS_LUMINANCE_R * rgba[0]) + (CAS_LUMINANCE_G * rgba[1]) + (CAS_LUMINANCE_B * rgba[2]);
+        out[i] = std::min(1.0f, l);
+    }
+}
+
+template <bool hasOffset, bool hasFlat, bool hasFlatOffset>
+static void CASCalibrateScalarT(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i){
+        out[i] = CASCalibratePixel<hasOffset,hasFlat,hasFlatOffset>(light, offset, flat, flatOffset, flatMean, i);
+    }
+}
+
+static void CASCalibrateScalar(const float* light, const float* offset, const float* flat, const float* flatOffset, float flatMean, float* out, size_t count)
+{
+    CAS_KERNELS_CALIBRATE_DISPATCH(CASCalibrateScalarT);
+}
+
+template <int diameter, typename T>
+static void CASMedianScalarT(const T* const* rows, T* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i){
+        out[i] = CASMedianPixel<diameter>(rows, i);
+    }
+}
+
+static void CASHistogramSlideScalar(uint16_t* histogram, const uint8_t* add, const uint8_t* remove, size_t count)
+{
+    if (remove){
+        for (size_t i = 0; i < count; ++i){
+            histogram[i] += add[i] - remove[i];
+        }
+    }
+    else {
+        for (size_t i = 0; i < count; ++i){
+            histogram[i] += add[i];
+        }
+    }
+}
+
+static void CASSortColumnsScalar(float* rows, size_t stride, const uint16_t* comparators, size_t comparatorCount, size_t count)
+{
+    for (size_t c = 0; c < comparatorCount; ++c){
+        float* a = rows + comparators[2 * c] * stride;
+        float* b = rows + comparators[2 * c + 1] * stride;
+        for (size_t i = 0; i < count; ++i){
+            const float lo = std::min(a[i], b[i]);
+            b[i] = std::max(a[i], b[i]);
+            a[i] = lo;
+        }
+    }
+}
+
+static void CASWeightedSumScalar(float* out, float a, const float* in, float b, float c, size_t count)
+{
+    for (size_t i = 0; i < count; ++i){
+        out[i] = a * out[i] + b * in[i] + c;
+    }
+}
+
+static void CASConvolveScalar(float* out, const float* const* rows, const float* weights, size_t rowCount, size_t count)
+{
+    for (size_t i = 0; i < count; ++i){
+        float sum = weights[0] * rows[0][i];
+        for (size_t k = 1; k < rowCount; ++k){
+            sum += weights[k] * rows[k][i];
+        }
+        out[i] = sum;
+    }
+}
+
+static void CASRecursiveStepScalar(float* out, double* state, const float* in, const double* const* previous, const double* c, size_t count)
+{
+    const double* p1 = previous[0];
+    const double* p2 = previous[1];
+    const double* p3 = previous[2];
+    for (size_t i = 0; i < count; ++i){
+        const double d = p1[i];
+        const double v = d + (c[0] * (in[i] - d) + (c[2] * (p2[i] - d) + c[3] * (p3[i] - d)));
+        state[i] = v;
+        out[i] = v;
+    }
+}
+
+static void CASWidenU16Scalar(const uint16_t* in, float divisor, float* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i){
+        out[i] = in[i] / divisor;
+    }
+}
+
+static void CASHalveU16Scalar(const uint16_t* row0, const uint16_t* row1, uint16_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i){
+        out[i] = CASHalveU16Sample(row0, row1, i);
+    }
+}
+
+static void CASHalveFloatScalar(const float* row0, const float* row1, float* out, size_t count, size_t channelCount)
+{
+    for (size_t i = 0; i < count * channelCount; ++i){
+        out[i] = CASHalveFloatSample(row0, row1, i, channelCount);
+    }
+}
+
+const CASKernelTable* CASKernelsScalar()
+{
+    static const CASKernelTable table = {
+        kCASKernelISAScalar,
+        "scalar",
+        CASInvertScalar,
+        CASSumScalar,
+        CASDivideFlatScalar,
+        CASAverageScalar,
+        CASLuminanceScalar,
+        CASCalibrateScalar,
+        CASMedianScalarT<3,float>,
+        CASMedianScalarT<5,float>,
+        CASMedianScalarT<3,uint16_t>,
+        CASMedianScalarT<5,uint16_t>,
+        CASHistogramSlideScalar,
+        CASSortColumnsScalar,
+        CASWeightedSumScalar,
+        CASConvolveScalar,
+        CASRecursiveStepScalar,
+        CASWidenU16Scalar,
+        CASHalveU16Scalar,
+        CASHalveFloatScalar
+    };
+    return &table;
+}
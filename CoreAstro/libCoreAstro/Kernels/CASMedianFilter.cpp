@@ -0,0 +1,263 @@
+//
+//  CASMedianFilter.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASMedianFilter.h"
+#include <algorithm>
+#include <vector>
+#include <assert.h>
+#include <string.h>
+
+static inline size_t CASMedianClamp(ptrdiff_t i, size_t count)
+{
+    return i < 0 ? 0 : (i >= (ptrdiff_t)count ? count - 1 : i);
+}
+
+static inline uint16_t CASMedianKey(uint16_t value)
+{
+    return value;
+}
+
+static inline uint16_t CASMedianKey(float value)
+{
+    return value <= 0 ? 0 : (value >= 1 ? 65535 : (uint16_t)(value * 65535.0f + 0.5f));
+}
+
+static inline void CASMedianFromKey(uint16_t key, uint16_t* value)
+{
+    *value = key;
+}
+
+static inline void CASMedianFromKey(uint16_t key, float* value)
+{
+    *value = key / 65535.0f;
+}
+
+static void CASMedianKernel(int diameter, const float* const* rows, float* out, size_t count)
+{
+    (diameter == 3 ? CASKernels().median3x3 : CASKernels().median5x5)(rows, out, count);
+}
+
+static void CASMedianKernel(int diameter, const uint16_t* const* rows, uint16_t* out, size_t count)
+{
+    (diameter == 3 ? CASKernels().median3x3U16 : CASKernels().median5x5U16)(rows, out, count);
+}
+
+// 3x3 and 5x5, the interior of each row goes through the network kernels and the few
+// columns at either end where the window hangs off the frame are gathered by hand
+template <typename T>
+static void CASMedianFilterNetwork(const T* in, T* out, size_t width, size_t height, int radius, size_t startRow, size_t rowCount)
+{
+    const int diameter = 2 * radius + 1;
+    const size_t interior = width > (size_t)(2 * radius) ? width - 2 * radius : 0;
+    
+    const T* rows[5];
+    T window[25];
+    
+    for (size_t y = startRow; y < startRow + rowCount; ++y){
+        
+        for (int dy = 0; dy < diameter; ++dy){
+            rows[dy] = in + CASMedianClamp((ptrdiff_t)y + dy - radius, height) * width;
+        }
+        
+        T* output = out + y * width;
+        if (interior){
+            CASMedianKernel(diameter, rows, output + radius, interior);
+        }
+        
+        for (size_t x = 0; x < width; ++x){
+            if (interior && x == (size_t)radius){
+                x += interior - 1;
+                continue;
+            }
+            int i = 0;
+            for (int dy = 0; dy < diameter; ++dy){
+                for (int dx = -radius; dx <= radius; ++dx){
+                    window[i++] = rows[dy][CASMedianClamp((ptrdiff_t)x + dx, width)];
+                }
+            }
+            std::nth_element(window, window + i/2, window + i);
+            output[x] = window[i/2];
+        }
+    }
+}
+
+// larger windows. the frame is processed in vertical strips, each with a pair of coarse (high byte) and fine
+// (low byte) histograms per column that slide down a row at a time. the window's coarse histogram slides across
+// the columns and locates the median's high byte, after which only the one fine histogram for that coarse bin is
+// needed; those are brought up to date lazily so that the cost per pixel doesn't depend on the radius
+// the fine column histograms are grouped by coarse bin so that the ones the window needs are next to each other
+static inline size_t CASMedianFineIndex(uint16_t key, size_t column, size_t columnCount)
+{
+    return ((key >> 8) * columnCount + column) * 256 + (key & 0xff);
+}
+
+// index of the bin holding the sample of the given rank, total is the count below the histogram on entry
+// and below the returned bin on exit. no window holds more than 65025 samples so sums of any number of
+// bins fit in 16 bits, which lets the search skip 16 bins at a time adding them up four to a 64-bit word
+static inline int CASMedianFindBin(const uint16_t* histogram, uint32_t rank, uint32_t& total)
+{
+    int bin = 0;
+    for (; bin < 256 - 16; bin += 16){
+        uint64_t words[4];
+        memcpy(words, histogram + bin, sizeof(words));
+        uint64_t lanes = words[0] + words[1] + words[2] + words[3];
+        lanes += lanes >> 32;
+        lanes += lanes >> 16;
+        const uint32_t block = (uint32_t)(lanes & 0xffff);
+        if (total + block > rank){
+            break;
+        }
+        total += block;
+    }
+    while (total + histogram[bin] <= rank){
+        total += histogram[bin++];
+    }
+    return bin;
+}
+
+template <typename T>
+static void CASMedianFilterHistogram(const T* in, T* out, size_t width, size_t height, int radius, size_t startRow, size_t rowCount)
+{
+    void (*slide)(uint16_t*, const uint8_t*, const uint8_t*, size_t) = CASKernels().histogramSlide;
+    const size_t diameter = 2 * radius + 1;
+    const uint32_t rank = (diameter * diameter) / 2;
+    const size_t stripColumns = std::min<size_t>(CAS_MEDIAN_FILTER_STRIP_COLUMNS, width);
+    const size_t columnCount = stripColumns + 2 * radius;
+    
+    std::vector<uint8_t> columnCoarse(columnCount * 256);
+    std::vector<uint8_t> columnFine(columnCount * 65536);
+    std::vector<size_t> columnX(columnCount);
+    
+    uint16_t coarse[256];
+    std::vector<uint16_t> fine(65536);
+    ptrdiff_t fineStart[256]; // column each coarse bin's fine histogram was last valid for, -1 if it isn't
+    
+    for (size_t x0 = 0; x0 < width; x0 += stripColumns){
+        
+        const size_t outputColumns = std::min(stripColumns, width - x0);
+        const size_t columns = outputColumns + 2 * radius;
+        for (size_t c = 0; c < columns; ++c){
+            columnX[c] = CASMedianClamp((ptrdiff_t)(x0 + c) - radius, width);
+        }
+        
+        // column histograms for the window around the first row
+        for (ptrdiff_t dy = -radius; dy <= radius; ++dy){
+            const T* row = in + CASMedianClamp((ptrdiff_t)startRow + dy, height) * width;
+            for (size_t c = 0; c < columns; ++c){
+                const uint16_t key = CASMedianKey(row[columnX[c]]);
+                ++columnCoarse[c * 256 + (key >> 8)];
+                ++columnFine[CASMedianFineIndex(key, c, columnCount)];
+            }
+        }
+        
+        for (size_t y = startRow; y < startRow + rowCount; ++y){
+            
+            if (y > startRow){
+                const T* removed = in + CASMedianClamp((ptrdiff_t)y - radius - 1, height) * width;
+                const T* added = in + CASMedianClamp((ptrdiff_t)y + radius, height) * width;
+                for (size_t c = 0; c < columns; ++c){
+                    const uint16_t r = CASMedianKey(removed[columnX[c]]);
+                    const uint16_t a = CASMedianKey(added[columnX[c]]);
+                    --columnCoarse[c * 256 + (r >> 8)];
+                    --columnFine[CASMedianFineIndex(r, c, columnCount)];
+                    ++columnCoarse[c * 256 + (a >> 8)];
+                    ++columnFine[CASMedianFineIndex(a, c, columnCount)];
+                }
+            }
+            
+            std::fill(coarse, coarse + 256, 0);
+            std::fill(fineStart, fineStart + 256, -1);
+            for (size_t c = 0; c < diameter - 1; ++c){
+                slide(coarse, &columnCoarse[c * 256], NULL, 256);
+            }
+            
+            T* output = out + y * width + x0;
+            for (size_t x = 0; x < outputColumns; ++x){
+                
+                slide(coarse, &columnCoarse[(x + diameter - 1) * 256], x ? &columnCoarse[(x - 1) * 256] : NULL, 256);
+                
+                uint32_t total = 0;
+                const int bin = CASMedianFindBin(coarse, rank, total);
+                
+                uint16_t* f = &fine[bin * 256];
+                const ptrdiff_t start = fineStart[bin];
+                if (start < 0 || (ptrdiff_t)x - start >= (ptrdiff_t)diameter){
+                    std::fill(f, f + 256, 0);
+                    for (size_t c = x; c < x + diameter; ++c){
+                        slide(f, &columnFine[CASMedianFineIndex(bin << 8, c, columnCount)], NULL, 256);
+                    }
+                }
+                else {
+                    for (size_t c = start; c < x; ++c){
+                        slide(f, &columnFine[CASMedianFineIndex(bin << 8, c + diameter, columnCount)], &columnFine[CASMedianFineIndex(bin << 8, c, columnCount)], 256);
+                    }
+                }
+                fineStart[bin] = x;
+                
+                CASMedianFromKey((bin << 8) | CASMedianFindBin(f, rank, total), output + x);
+            }
+        }
+        
+        // take the last window back out so the column histograms are empty for the next strip
+        const size_t lastRow = startRow + rowCount - 1;
+        for (ptrdiff_t dy = -radius; dy <= radius; ++dy){
+            const T* row = in + CASMedianClamp((ptrdiff_t)lastRow + dy, height) * width;
+            for (size_t c = 0; c < columns; ++c){
+                const uint16_t key = CASMedianKey(row[columnX[c]]);
+                --columnCoarse[c * 256 + (key >> 8)];
+                --columnFine[CASMedianFineIndex(key, c, columnCount)];
+            }
+        }
+    }
+}
+
+template <typename T>
+static void CASMedianFilterRowsT(const T* in, T* out, size_t width, size_t height, int radius, size_t startRow, size_t rowCount)
+{
+    assert(radius >= 0 && radius <= CAS_MEDIAN_FILTER_MAX_RADIUS);
+    assert(startRow + rowCount <= height);
+    
+    if (!width || !rowCount){
+        return;
+    }
+    if (radius == 0){
+        std::copy(in + startRow * width, in + (startRow + rowCount) * width, out + startRow * width);
+    }
+    else if (radius <= 2){
+        CASMedianFilterNetwork(in, out, width, height, radius, startRow, rowCount);
+    }
+    else {
+        CASMedianFilterHistogram(in, out, width, height, radius, startRow, rowCount);
+    }
+}
+
+void CASMedianFilterRows(const float* in, float* out, size_t width, size_t height, int radius, size_t startRow, size_t rowCount)
+{
+    CASMedianFilterRowsT(in, out, width, height, radius, startRow, rowCount);
+}
+
+void CASMedianFilterRows(const uint16_t* in, uint16_t* out, size_t width, size_t height, int radius, size_t startRow, size_t rowCount)
+{
+    CASMedianFilterRowsT(in, out, width, height, radius, startRow, rowCount);
+}
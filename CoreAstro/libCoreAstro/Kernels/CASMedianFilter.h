@@ -0,0 +1,56 @@
+//
+//  CASMedianFilter.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Median filter for arbitrary radii. 3x3 and 5x5 windows go through the sorting network
+//  kernels, anything larger uses the constant time histogram algorithm from Perreault and
+//  Hebert, "Median Filtering in Constant Time", split into coarse and fine 8-bit levels so
+//  that 16-bit samples can be histogrammed directly. Frame edges are extended by repeating
+//  the outermost row or column.
+
+#ifndef __CASMedianFilter_h__
+#define __CASMedianFilter_h__
+
+#include "CASKernels.h"
+
+// column histograms are counted in bytes so a window can be at most 255 pixels across
+#define CAS_MEDIAN_FILTER_MAX_RADIUS 127
+
+// rows per unit of work, each tile can be filtered independently on its own thread
+#define CAS_MEDIAN_FILTER_TILE_ROWS 64
+
+// output columns per histogram strip, bounds the column histograms to (strip + 2 * radius) * 64k bytes
+#define CAS_MEDIAN_FILTER_STRIP_COLUMNS 64
+
+// filters rows [startRow,startRow+rowCount) of in into the same rows of out, radius must be 0...CAS_MEDIAN_FILTER_MAX_RADIUS.
+// the float version expects values in the 0-1 range that exposures use; for radii over 2 the window is ranked at 16-bit
+// precision so the result is the median quantised to 1/65535. out must not overlap in
+void CASMedianFilterRows(const float* in, float* out, size_t width, size_t height, int radius, size_t startRow, size_t rowCount);
+void CASMedianFilterRows(const uint16_t* in, uint16_t* out, size_t width, size_t height, int radius, size_t startRow, size_t rowCount);
+
+inline size_t CASMedianFilterTileCount(size_t height)
+{
+    return (height + CAS_MEDIAN_FILTER_TILE_ROWS - 1) / CAS_MEDIAN_FILTER_TILE_ROWS;
+}
+
+#endif
@@ -0,0 +1,751 @@
+//
+//  CASOpGraph.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#include "CASOpGraph.h"
+#include "CASKernels.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+// a region's worth of samples part way through the chain, rows of width * channelCount floats stride floats apart
+struct CASOpTile {
+    CASOpRegion region;
+    size_t channelCount;
+    size_t stride;
+    float* pixels;
+};
+
+// the buffers one tile is worked out in, the second is for stages that can't work in place
+struct CASOpScratch {
+    std::vector<float> buffer, spare, row;
+    std::vector<CASOpRegion> regions;
+};
+
+void CASOpApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+// stages that work on each pixel on its own and so can be run one after another along a row
+bool CASOpIsPerPixel(CASOpKind kind)
+{
+    return kind == kCASOpCalibrate || kind == kCASOpStretch || kind == kCASOpInvert || kind == kCASOpLuminance;
+}
+
+// stages that do the same to every sample whatever its position or channel and can be folded into a lookup table,
+// along with flips which only move samples around and can be left to whoever writes the output
+bool CASOpIsPerSample(CASOpKind kind)
+{
+    return kind == kCASOpStretch || kind == kCASOpInvert || kind == kCASOpFlip;
+}
+
+CASOpRegion CASOpFlipRegion(const CASOpRegion& r, bool horizontal, bool vertical, size_t width, size_t height)
+{
+    CASOpRegion flipped = r;
+    if (horizontal){
+        flipped.x = width - r.x - r.width;
+    }
+    if (vertical){
+        flipped.y = height - r.y - r.height;
+    }
+    return flipped;
+}
+
+// the part of an op's input it needs to produce the region of its output
+CASOpRegion CASOpInputRegion(const CASOp& op, const CASOpRegion& r, size_t width, size_t height)
+{
+    switch (op.kind) {
+        case kCASOpDebayer: {
+            const size_t margin = CAS_DEBAYER_BILINEAR_MARGIN;
+            const size_t x = (r.x > margin) ? r.x - margin : 0;
+            const size_t y = (r.y > margin) ? r.y - margin : 0;
+            const CASOpRegion input = { x, y, std::min(width, r.x + r.width + margin) - x, std::min(height, r.y + r.height + margin) - y };
+            return input;
+        }
+        case kCASOpFlip:
+            return CASOpFlipRegion(r, op.flipHorizontal, op.flipVertical, width, height);
+        default:
+            return r;
+    }
+}
+
+void CASOpStretchRow(const CASDisplayStretch& stretch, float* p, size_t count, size_t channelCount)
+{
+    // as CASDisplayStretchBuildTable but straight on the values
+    const float lower = std::max(0.0f, stretch.lower);
+    const float upper = std::max(stretch.lower, stretch.upper);
+    const float scale = (upper > lower) ? 1.0f / (upper - lower) : 0;
+    const float m = stretch.midtone;
+    const bool mtf = (m > 0 && m < 1 && m != 0.5f);
+    const bool gamma = (stretch.gamma > 0 && stretch.gamma != 1);
+    
+    for (size_t i = 0; i < count; ++i){
+        if (channelCount == 4 && (i & 3) == 3){
+            continue;
+        }
+        float x = p[i];
+        if (!(x > lower)){ // NaNs too
+            x = 0;
+        }
+        else if (x >= upper){
+            x = 1;
+        }
+        else {
+            x = (x - lower) * scale;
+            if (mtf){
+                x = ((m - 1) * x) / (((2 * m - 1) * x) - m);
+            }
+            if (gamma){
+                x = powf(x, stretch.gamma);
+            }
+        }
+        p[i] = x;
+    }
+}
+
+void CASOpInvertRow(float* p, size_t count, size_t channelCount)
+{
+    if (channelCount == 1){
+        CASKernels().invert(p, count);
+    }
+    else {
+        for (size_t i = 0; i < count; i += 4){
+            p[i] = 1.0f - p[i];
+            p[i + 1] = 1.0f - p[i + 1];
+            p[i + 2] = 1.0f - p[i + 2];
+        }
+    }
+}
+
+// runs the per pixel ops [begin,end) along each row of the tile in turn so each row is read and written once for
+// the lot. luminance packs each row down to a quarter of its width, which moving forwards never overwrites a
+// row that's still to be read
+void CASOpRunPerPixel(const CASOpGraph& graph, size_t begin, size_t end, CASOpTile& tile, std::vector<float>& scratch)
+{
+    const CASOpRegion& r = tile.region;
+    size_t channelCount = tile.channelCount, stride = tile.stride;
+    
+    for (size_t y = 0; y < r.height; ++y){
+        
+        float* p = tile.pixels + y * tile.stride;
+        channelCount = tile.channelCount;
+        stride = tile.stride;
+        
+        for (size_t i = begin; i < end; ++i){
+            const CASOp& op = graph.ops[i];
+            switch (op.kind) {
+                case kCASOpCalibrate: {
+                    const size_t start = (r.y + y) * graph.width() + r.x;
+                    const CASCalibrationMasters masters = {
+                        op.masters.bias ? op.masters.bias + start : NULL,
+                        op.masters.dark ? op.masters.dark + start : NULL,
+                        op.masters.flat ? op.masters.flat + start : NULL,
+                        r.width
+                    };
+                    CASCalibrateRange(p, masters, op.statistics, p, 0, r.width);
+                    break;
+                }
+                case kCASOpStretch:
+                    CASOpStretchRow(op.stretch, p, r.width * channelCount, channelCount);
+                    break;
+                case kCASOpInvert:
+                    CASOpInvertRow(p, r.width * channelCount, channelCount);
+                    break;
+                case kCASOpLuminance:
+                    scratch.resize(r.width);
+                    CASKernels().luminance(p, scratch.data(), r.width);
+                    channelCount = 1;
+                    stride = r.width;
+                    p = tile.pixels + y * stride;
+                    memcpy(p, scratch.data(), r.width * sizeof(float));
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    
+    tile.channelCount = channelCount;
+    tile.stride = stride;
+}
+
+void CASOpFlipTile(CASOpTile& tile, bool horizontal, bool vertical)
+{
+    const CASOpRegion& r = tile.region;
+    const size_t c = tile.channelCount;
+    if (vertical){
+        for (size_t y = 0; y < r.height / 2; ++y){
+            float* a = tile.pixels + y * tile.stride;
+            std::swap_ranges(a, a + r.width * c, tile.pixels + (r.height - 1 - y) * tile.stride);
+        }
+    }
+    if (horizontal){
+        for (size_t y = 0; y < r.height; ++y){
+            float* p = tile.pixels + y * tile.stride;
+            for (size_t a = 0, b = r.width - 1; a < b; ++a, --b){
+                std::swap_ranges(p + a * c, p + (a + 1) * c, p + b * c);
+            }
+        }
+    }
+}
+
+// works out ops [0,count) for the region of their output, leaving the result in tile
+bool CASOpRun(const CASOpGraph& graph, size_t count, const CASOpRegion& region, CASOpScratch& scratch, CASOpTile& tile)
+{
+    const size_t width = graph.width(), height = graph.height();
+    
+    // walk back up the chain to find what each stage needs of the one before
+    std::vector<CASOpRegion>& regions = scratch.regions;
+    regions.resize(count + 1);
+    regions[count] = region;
+    for (size_t i = count; i-- > 0;){
+        regions[i] = CASOpInputRegion(graph.ops[i], regions[i + 1], width, height);
+    }
+    
+    const CASOpRegion& first = regions[0];
+    const size_t sourceChannelCount = (graph.source.format == kCASPixelFormatRGBAFloat) ? 4 : 1;
+    scratch.buffer.resize(first.width * first.height * sourceChannelCount);
+    if (!CASPixelsToFloat(CASPixelsRegion(graph.source, first.x, first.y, first.width, first.height), scratch.buffer.data(), first.width * sourceChannelCount)){
+        return false;
+    }
+    tile.region = first;
+    tile.channelCount = sourceChannelCount;
+    tile.stride = first.width * sourceChannelCount;
+    tile.pixels = scratch.buffer.data();
+    
+    for (size_t i = 0; i < count;){
+        const CASOp& op = graph.ops[i];
+        if (CASOpIsPerPixel(op.kind)){
+            size_t end = i + 1;
+            while (end < count && CASOpIsPerPixel(graph.ops[end].kind)){
+                ++end;
+            }
+            CASOpRunPerPixel(graph, i, end, tile, scratch.row);
+            i = end;
+            continue;
+        }
+        const CASOpRegion& output = regions[i + 1];
+        if (op.kind == kCASOpDebayer){
+            scratch.spare.resize(output.width * output.height * 4);
+            if (!CASDebayerBilinear(tile.pixels, tile.stride, tile.region.x, tile.region.y, width, height, op.pattern, output.x, output.y, output.width, output.height, scratch.spare.data(), output.width * 4)){
+                return false;
+            }
+            scratch.buffer.swap(scratch.spare);
+            tile.channelCount = 4;
+            tile.stride = output.width * 4;
+            tile.pixels = scratch.buffer.data();
+        }
+        else if (op.kind == kCASOpFlip){
+            CASOpFlipTile(tile, op.flipHorizontal, op.flipVertical);
+        }
+        tile.region = output;
+        ++i;
+    }
+    
+    return true;
+}
+
+size_t CASOpTileCount(const CASOpGraph& graph)
+{
+    const size_t across = (graph.width() + CAS_OP_GRAPH_TILE_SIZE - 1) / CAS_OP_GRAPH_TILE_SIZE;
+    const size_t down = (graph.height() + CAS_OP_GRAPH_TILE_SIZE - 1) / CAS_OP_GRAPH_TILE_SIZE;
+    return across * down;
+}
+
+CASOpRegion CASOpTileRegion(const CASOpGraph& graph, size_t index)
+{
+    const size_t across = (graph.width() + CAS_OP_GRAPH_TILE_SIZE - 1) / CAS_OP_GRAPH_TILE_SIZE;
+    const size_t x = (index % across) * CAS_OP_GRAPH_TILE_SIZE;
+    const size_t y = (index / across) * CAS_OP_GRAPH_TILE_SIZE;
+    const CASOpRegion region = { x, y, std::min<size_t>(CAS_OP_GRAPH_TILE_SIZE, graph.width() - x), std::min<size_t>(CAS_OP_GRAPH_TILE_SIZE, graph.height() - y) };
+    return region;
+}
+
+struct CASOpEvaluation {
+    const CASOpGraph* graph;
+    float* out;
+    size_t outStride;
+    bool failed;
+    
+    static void tile(void* context, size_t index) {
+        CASOpEvaluation& evaluation = *(CASOpEvaluation*)context;
+        const CASOpGraph& graph = *evaluation.graph;
+        const CASOpRegion region = CASOpTileRegion(graph, index);
+        CASOpScratch scratch;
+        CASOpTile tile;
+        if (!CASOpRun(graph, graph.ops.size(), region, scratch, tile)){
+            evaluation.failed = true;
+            return;
+        }
+        for (size_t y = 0; y < region.height; ++y){
+            memcpy(evaluation.out + (region.y + y) * evaluation.outStride + region.x * tile.channelCount, tile.pixels + y * tile.stride, region.width * tile.channelCount * sizeof(float));
+        }
+    }
+};
+
+CASOpRegion CASOpIntersectRegion(const CASOpRegion& a, const CASOpRegion& b)
+{
+    const size_t x = std::max(a.x, b.x), y = std::max(a.y, b.y);
+    const size_t right = std::min(a.x + a.width, b.x + b.width), bottom = std::min(a.y + a.height, b.y + b.height);
+    const CASOpRegion region = { x, y, (right > x) ? right - x : 0, (bottom > y) ? bottom - y : 0 };
+    return region;
+}
+
+void CASOpAppendKey(std::string& key, const void* p, size_t size)
+{
+    key.append((const char*)p, size);
+}
+
+template <typename T>
+void CASOpAppendKey(std::string& key, const T& value)
+{
+    CASOpAppendKey(key, &value, sizeof(value));
+}
+
+// everything about the graph and format that changes the rendered output, apart from the samples themselves
+std::string CASOpRenderKey(const CASOpGraph& graph, CASOpDisplayFormat format)
+{
+    std::string key;
+    CASOpAppendKey(key, format);
+    CASOpAppendKey(key, graph.source.format);
+    CASOpAppendKey(key, graph.source.data);
+    CASOpAppendKey(key, graph.source.width);
+    CASOpAppendKey(key, graph.source.height);
+    CASOpAppendKey(key, graph.source.stride);
+    for (size_t i = 0; i < graph.ops.size(); ++i){
+        const CASOp& op = graph.ops[i];
+        CASOpAppendKey(key, op.kind);
+        switch (op.kind) {
+            case kCASOpCalibrate:
+                CASOpAppendKey(key, op.masters.bias);
+                CASOpAppendKey(key, op.masters.dark);
+                CASOpAppendKey(key, op.masters.flat);
+                CASOpAppendKey(key, op.statistics.flatMean);
+                break;
+            case kCASOpDebayer:
+                CASOpAppendKey(key, op.pattern);
+                break;
+            case kCASOpStretch:
+                CASOpAppendKey(key, op.stretch.lower);
+                CASOpAppendKey(key, op.stretch.upper);
+                CASOpAppendKey(key, op.stretch.midtone);
+                CASOpAppendKey(key, op.stretch.gamma);
+                break;
+            case kCASOpFlip:
+                CASOpAppendKey(key, op.flipHorizontal);
+                CASOpAppendKey(key, op.flipVertical);
+                break;
+            default:
+                break;
+        }
+    }
+    return key;
+}
+
+struct CASOpRendering {
+    const CASOpGraph* graph;
+    size_t count;                   // ops worked out per tile, the rest are in the table
+    bool flipHorizontal, flipVertical;
+    bool raw;                       // nothing to work out per tile and 16-bit samples to look up directly
+    const uint8_t* table;
+    CASOpDisplayFormat format;
+    CASOpRegion region;             // of the output that's wanted, out points at its top left
+    uint8_t* out;
+    size_t bytesPerRow;
+    CASOpTileCache* cache;
+    uint64_t generation;
+    size_t firstTile, tilesAcross, regionTilesAcross; // the tiles under the region
+    bool failed;
+    
+    size_t bytesPerPixel() const { return (format == kCASOpDisplayGray8) ? 1 : 4; }
+    
+    static inline uint16_t quantise(float v) { return (uint16_t)(std::min(1.0f, std::max(0.0f, v)) * 65535.0f + 0.5f); }
+    static inline uint16_t quantise(uint16_t v) { return v; }
+    
+    template <typename T>
+    void write(const CASOpRegion& r, const T* pixels, size_t stride, size_t channelCount, uint8_t* dst, size_t dstBytesPerRow) const {
+        for (size_t y = 0; y < r.height; ++y){
+            const T* p = pixels + (flipVertical ? r.height - 1 - y : y) * stride;
+            uint8_t* o = dst + y * dstBytesPerRow;
+            for (size_t x = 0; x < r.width; ++x){
+                const T* s = p + (flipHorizontal ? r.width - 1 - x : x) * channelCount;
+                if (format == kCASOpDisplayGray8){
+                    *o++ = table[quantise(s[0])];
+                    continue;
+                }
+                const uint8_t red = table[quantise(s[0])];
+                const uint8_t g = (channelCount == 1) ? red : table[quantise(s[1])];
+                const uint8_t b = (channelCount == 1) ? red : table[quantise(s[2])];
+                o[0] = (format == kCASOpDisplayBGRA8) ? b : red;
+                o[1] = g;
+                o[2] = (format == kCASOpDisplayBGRA8) ? red : b;
+                o[3] = 255;
+                o += 4;
+            }
+        }
+    }
+    
+    // renders r of the output into dst, which points at its top left
+    bool render(const CASOpRegion& r, uint8_t* dst, size_t dstBytesPerRow) const {
+        
+        // the flips folded out of the chain are done when writing so work out the region they'd have read
+        const CASOpGraph& graph = *this->graph;
+        const CASOpRegion source = CASOpFlipRegion(r, flipHorizontal, flipVertical, graph.width(), graph.height());
+        if (raw){
+            const CASPixels pixels = CASPixelsRegion(graph.source, source.x, source.y, source.width, source.height);
+            write(r, (const uint16_t*)pixels.data, pixels.stride, 1, dst, dstBytesPerRow);
+            return true;
+        }
+        CASOpScratch scratch;
+        CASOpTile tile;
+        if (!CASOpRun(graph, count, source, scratch, tile)){
+            return false;
+        }
+        write(r, (const float*)tile.pixels, tile.stride, tile.channelCount, dst, dstBytesPerRow);
+        return true;
+    }
+    
+    static void tile(void* context, size_t index) {
+        CASOpRendering& rendering = *(CASOpRendering*)context;
+        const size_t tileIndex = rendering.firstTile + (index / rendering.regionTilesAcross) * rendering.tilesAcross + index % rendering.regionTilesAcross;
+        const CASOpRegion tileRegion = CASOpTileRegion(*rendering.graph, tileIndex);
+        const CASOpRegion visible = CASOpIntersectRegion(tileRegion, rendering.region);
+        const size_t bytesPerPixel = rendering.bytesPerPixel();
+        uint8_t* dst = rendering.out + (visible.y - rendering.region.y) * rendering.bytesPerRow + (visible.x - rendering.region.x) * bytesPerPixel;
+        
+        if (!rendering.cache){
+            if (!rendering.render(visible, dst, rendering.bytesPerRow)){
+                rendering.failed = true;
+            }
+            return;
+        }
+        
+        // render the whole tile for the cache then copy out the part that's wanted
+        CASOpTileCache::Tile cached = rendering.cache->find(rendering.generation, tileIndex);
+        if (!cached){
+            std::shared_ptr<std::vector<uint8_t> > pixels = std::make_shared<std::vector<uint8_t> >(tileRegion.width * tileRegion.height * bytesPerPixel);
+            if (!rendering.render(tileRegion, pixels->data(), tileRegion.width * bytesPerPixel)){
+                rendering.failed = true;
+                return;
+            }
+            rendering.cache->insert(rendering.generation, tileIndex, pixels);
+            cached = pixels;
+        }
+        const size_t tileBytesPerRow = tileRegion.width * bytesPerPixel;
+        const uint8_t* src = cached->data() + (visible.y - tileRegion.y) * tileBytesPerRow + (visible.x - tileRegion.x) * bytesPerPixel;
+        for (size_t y = 0; y < visible.height; ++y){
+            memcpy(dst + y * rendering.bytesPerRow, src + y * tileBytesPerRow, visible.width * bytesPerPixel);
+        }
+    }
+};
+
+}
+
+size_t CASOpGraph::channelCount() const
+{
+    size_t channelCount = (source.format == kCASPixelFormatRGBAFloat) ? 4 : 1;
+    for (size_t i = 0; i < ops.size(); ++i){
+        if (ops[i].kind == kCASOpDebayer){
+            channelCount = 4;
+        }
+        else if (ops[i].kind == kCASOpLuminance){
+            channelCount = 1;
+        }
+    }
+    return channelCount;
+}
+
+bool CASOpGraph::calibrate(const CASCalibrationMasters& masters, const CASCalibrationStatistics& statistics)
+{
+    if (channelCount() != 1 || masters.count != width() * height()){
+        return false;
+    }
+    CASOp op = CASOp();
+    op.kind = kCASOpCalibrate;
+    op.masters = masters;
+    op.statistics = statistics;
+    ops.push_back(op);
+    return true;
+}
+
+bool CASOpGraph::debayer(CASBayerPattern pattern)
+{
+    if (channelCount() != 1){
+        return false;
+    }
+    CASOp op = CASOp();
+    op.kind = kCASOpDebayer;
+    op.pattern = pattern;
+    ops.push_back(op);
+    return true;
+}
+
+bool CASOpGraph::stretch(const CASDisplayStretch& stretch)
+{
+    CASOp op = CASOp();
+    op.kind = kCASOpStretch;
+    op.stretch = stretch;
+    ops.push_back(op);
+    return true;
+}
+
+bool CASOpGraph::invert()
+{
+    CASOp op = CASOp();
+    op.kind = kCASOpInvert;
+    ops.push_back(op);
+    return true;
+}
+
+bool CASOpGraph::luminance()
+{
+    if (channelCount() != 4){
+        return false;
+    }
+    CASOp op = CASOp();
+    op.kind = kCASOpLuminance;
+    ops.push_back(op);
+    return true;
+}
+
+bool CASOpGraph::flip(bool horizontal, bool vertical)
+{
+    if (horizontal || vertical){
+        CASOp op = CASOp();
+        op.kind = kCASOpFlip;
+        op.flipHorizontal = horizontal;
+        op.flipVertical = vertical;
+        ops.push_back(op);
+    }
+    return true;
+}
+
+bool CASOpGraphEvaluate(const CASOpGraph& graph, float* out, size_t outStride, CASOpGraphApply apply)
+{
+    if (CASPixelsIsEmpty(graph.source) || !out || outStride < graph.width() * graph.channelCount()){
+        return false;
+    }
+    if (!apply){
+        apply = CASOpApplyInOrder;
+    }
+    
+    CASOpEvaluation evaluation = { &graph, out, outStride, false };
+    apply(CASOpTileCount(graph), &evaluation, CASOpEvaluation::tile);
+    return !evaluation.failed;
+}
+
+bool CASOpGraphRender(const CASOpGraph& graph, CASOpDisplayFormat format, uint8_t* out, size_t bytesPerRow, CASOpGraphApply apply)
+{
+    const CASOpRegion region = { 0, 0, graph.width(), graph.height() };
+    return CASOpGraphRenderRegion(graph, format, region, out, bytesPerRow, NULL, apply);
+}
+
+bool CASOpGraphRenderRegion(const CASOpGraph& graph, CASOpDisplayFormat format, const CASOpRegion& region, uint8_t* out, size_t bytesPerRow, CASOpTileCache* cache, CASOpGraphApply apply)
+{
+    const size_t channelCount = graph.channelCount();
+    if (CASPixelsIsEmpty(graph.source) || !out || (format == kCASOpDisplayGray8 && channelCount != 1)){
+        return false;
+    }
+    if (!region.width || !region.height || region.x + region.width > graph.width() || region.y + region.height > graph.height()){
+        return false;
+    }
+    if (bytesPerRow < region.width * (format == kCASOpDisplayGray8 ? 1 : 4)){
+        return false;
+    }
+    if (!apply){
+        apply = CASOpApplyInOrder;
+    }
+    
+    // the per sample stages at the end go into the table, which maps 16-bit quantised samples to 8-bit
+    size_t count = graph.ops.size();
+    while (count > 0 && CASOpIsPerSample(graph.ops[count - 1].kind)){
+        --count;
+    }
+    bool flipHorizontal = false, flipVertical = false;
+    std::vector<float> values(CAS_DISPLAY_STRETCH_TABLE_SIZE);
+    for (size_t i = 0; i < values.size(); ++i){
+        values[i] = i / (float)CAS_PIXEL_UINT16_MAX;
+    }
+    for (size_t i = count; i < graph.ops.size(); ++i){
+        const CASOp& op = graph.ops[i];
+        switch (op.kind) {
+            case kCASOpStretch:
+                CASOpStretchRow(op.stretch, values.data(), values.size(), 1);
+                break;
+            case kCASOpInvert:
+                CASOpInvertRow(values.data(), values.size(), 1);
+                break;
+            case kCASOpFlip:
+                flipHorizontal ^= op.flipHorizontal;
+                flipVertical ^= op.flipVertical;
+                break;
+            default:
+                break;
+        }
+    }
+    std::vector<uint8_t> table(CAS_DISPLAY_STRETCH_TABLE_SIZE);
+    for (size_t i = 0; i < table.size(); ++i){
+        table[i] = (uint8_t)(std::min(1.0f, std::max(0.0f, values[i])) * 255.0f + 0.5f);
+    }
+    
+    const uint64_t generation = cache ? cache->prepare(CASOpRenderKey(graph, format)) : 0;
+    
+    // just the tiles the region covers
+    const size_t tilesAcross = (graph.width() + CAS_OP_GRAPH_TILE_SIZE - 1) / CAS_OP_GRAPH_TILE_SIZE;
+    const size_t left = region.x / CAS_OP_GRAPH_TILE_SIZE, top = region.y / CAS_OP_GRAPH_TILE_SIZE;
+    const size_t right = (region.x + region.width - 1) / CAS_OP_GRAPH_TILE_SIZE, bottom = (region.y + region.height - 1) / CAS_OP_GRAPH_TILE_SIZE;
+    
+    const bool raw = (!count && graph.source.format == kCASPixelFormatUInt16);
+    CASOpRendering rendering = {
+        &graph, count, flipHorizontal, flipVertical, raw, table.data(), format,
+        region, out, bytesPerRow, cache, generation,
+        top * tilesAcross + left, tilesAcross, right - left + 1,
+        false
+    };
+    apply((right - left + 1) * (bottom - top + 1), &rendering, CASOpRendering::tile);
+    return !rendering.failed;
+}
+
+CASOpTileCache::CASOpTileCache(size_t limit) : limit(limit), bytes(0), hitCount(0), missCount(0), clock(0), generation(0)
+{
+}
+
+void CASOpTileCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    tiles.clear();
+    keys.clear();
+    bytes = 0;
+}
+
+size_t CASOpTileCache::bytesCached() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+size_t CASOpTileCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+}
+
+size_t CASOpTileCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return missCount;
+}
+
+uint64_t CASOpTileCache::prepare(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < keys.size(); ++i){
+        if (keys[i].key == key){
+            keys[i].lastUse = ++clock;
+            return keys[i].generation;
+        }
+    }
+    
+    // drop the graph rendered least recently along with its tiles to make room
+    if (keys.size() >= CAS_OP_TILE_CACHE_KEYS){
+        std::vector<Key>::iterator oldest = keys.begin();
+        for (std::vector<Key>::iterator i = keys.begin(); i != keys.end(); ++i){
+            if (i->lastUse < oldest->lastUse){
+                oldest = i;
+            }
+        }
+        Tiles::iterator entry = tiles.lower_bound(std::make_pair(oldest->generation, (size_t)0));
+        while (entry != tiles.end() && entry->first.first == oldest->generation){
+            erase(entry++);
+        }
+        keys.erase(oldest);
+    }
+    
+    const Key added = { key, ++generation, ++clock };
+    keys.push_back(added);
+    return added.generation;
+}
+
+CASOpTileCache::Tile CASOpTileCache::find(uint64_t tileGeneration, size_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isLive(tileGeneration)){
+        return Tile();
+    }
+    Tiles::iterator entry = tiles.find(std::make_pair(tileGeneration, index));
+    if (entry == tiles.end()){
+        ++missCount;
+        return Tile();
+    }
+    ++hitCount;
+    entry->second.lastUse = ++clock;
+    return entry->second.tile;
+}
+
+void CASOpTileCache::insert(uint64_t tileGeneration, size_t index, const Tile& tile)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isLive(tileGeneration)){
+        return;
+    }
+    Entry& entry = tiles[std::make_pair(tileGeneration, index)];
+    if (entry.tile){
+        bytes -= entry.tile->size();
+    }
+    entry.tile = tile;
+    entry.lastUse = ++clock;
+    bytes += tile->size();
+    
+    // tiles still being copied from are kept alive by whoever's copying them
+    while (bytes > limit && tiles.size() > 1){
+        Tiles::iterator oldest = tiles.begin();
+        for (Tiles::iterator i = tiles.begin(); i != tiles.end(); ++i){
+            if (i->second.lastUse < oldest->second.lastUse){
+                oldest = i;
+            }
+        }
+        erase(oldest);
+    }
+}
+
+bool CASOpTileCache::isLive(uint64_t tileGeneration) const
+{
+    for (size_t i = 0; i < keys.size(); ++i){
+        if (keys[i].generation == tileGeneration){
+            return true;
+        }
+    }
+    return false;
+}
+
+void CASOpTileCache::erase(Tiles::iterator entry)
+{
+    bytes -= entry->second.tile->size();
+    tiles.erase(entry);
+}
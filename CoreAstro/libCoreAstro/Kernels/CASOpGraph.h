@@ -0,0 +1,164 @@
+//
+//  CASOpGraph.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  A chain of operations recorded against a frame and only run when its output is asked for. The output is
+//  worked out a tile at a time, each tile pulling just the part of the frame it needs through every stage, so
+//  no stage ever produces a whole intermediate frame. Runs of per pixel stages are applied a row at a time
+//  while the row is in cache and when the output is for display the per sample stages at the end are folded
+//  into the 8-bit lookup table along with the quantisation. Display output can be asked for just part of the
+//  frame, only the tiles under it are worked out, and kept in a tile cache so they don't have to be again.
+
+
+#ifndef __CASOpGraph_h__
+#define __CASOpGraph_h__
+
+#include "CASPixelView.h"
+#include "CASCalibration.h"
+#include "CASDebayer.h"
+#include "CASDisplayStretch.h"
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+
+// output tiles are this many pixels square
+#define CAS_OP_GRAPH_TILE_SIZE 128
+
+// default size in bytes of the rendered tiles a tile cache keeps
+#define CAS_OP_TILE_CACHE_LIMIT (64*1024*1024)
+
+// graphs a tile cache holds tiles for at once, enough for a few zoom levels of a pyramid
+#define CAS_OP_TILE_CACHE_KEYS 16
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order on the calling thread
+typedef void (*CASOpGraphApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+// a rectangle of the output, in pixels from the top left
+struct CASOpRegion {
+    size_t x, y, width, height;
+};
+
+enum CASOpKind {
+    kCASOpCalibrate,
+    kCASOpDebayer,
+    kCASOpStretch,
+    kCASOpInvert,
+    kCASOpLuminance,
+    kCASOpFlip
+};
+
+struct CASOp {
+    CASOpKind kind;
+    CASCalibrationMasters masters;          // calibrate
+    CASCalibrationStatistics statistics;
+    CASBayerPattern pattern;                // debayer
+    CASDisplayStretch stretch;              // stretch, in 0-1 sample values
+    bool flipHorizontal, flipVertical;      // flip
+};
+
+enum CASOpDisplayFormat {
+    kCASOpDisplayGray8,
+    kCASOpDisplayRGBA8,
+    kCASOpDisplayBGRA8                      // as CoreVideo's 32BGRA
+};
+
+struct CASOpGraph {
+    CASPixels source;
+    std::vector<CASOp> ops;
+    
+    explicit CASOpGraph(const CASPixels& source) : source(source) {}
+    
+    // each records its operation after the ones already there and returns false, leaving the graph as it was,
+    // if it can't take the output so far. calibration and debayering need mono frames, the masters are frame sized
+    bool calibrate(const CASCalibrationMasters& masters, const CASCalibrationStatistics& statistics);
+    bool debayer(CASBayerPattern pattern);
+    bool stretch(const CASDisplayStretch& stretch);
+    bool invert();
+    bool luminance();
+    bool flip(bool horizontal, bool vertical);
+    
+    // of the output, which is the same size as the source
+    size_t width() const { return source.width; }
+    size_t height() const { return source.height; }
+    size_t channelCount() const;
+};
+
+// 0-1 float output, rows of width * channel count floats outStride floats apart
+bool CASOpGraphEvaluate(const CASOpGraph& graph, float* out, size_t outStride, CASOpGraphApply apply = NULL);
+
+// 8-bit output for display, bytesPerRow apart. mono output can go to any of the formats, colour output can't go to gray
+bool CASOpGraphRender(const CASOpGraph& graph, CASOpDisplayFormat format, uint8_t* out, size_t bytesPerRow, CASOpGraphApply apply = NULL);
+
+// rendered tiles kept between calls to CASOpGraphRenderRegion so panning around a frame only works out the ones
+// newly in view, least recently used go first once over the limit. tiles of up to CAS_OP_TILE_CACHE_KEYS graphs
+// and formats are kept side by side, the least recently rendered going once there are more, but the cache can't
+// tell that the samples at the same address have changed, so call clear() if they might have. safe to use from
+// several threads
+class CASOpTileCache {
+public:
+    typedef std::shared_ptr<const std::vector<uint8_t> > Tile;
+    
+    explicit CASOpTileCache(size_t limit = CAS_OP_TILE_CACHE_LIMIT);
+    
+    void clear();
+    size_t bytesCached() const;
+    size_t hits() const;
+    size_t misses() const;
+    
+    // for CASOpGraphRenderRegion, key describes the graph and format of the tiles it's about to ask for. finds and
+    // inserts pass the generation prepare returned for it, they're ignored once that key's been dropped or cleared
+    uint64_t prepare(const std::string& key);
+    Tile find(uint64_t generation, size_t index);
+    void insert(uint64_t generation, size_t index, const Tile& tile);
+    
+private:
+    CASOpTileCache(const CASOpTileCache&);
+    CASOpTileCache& operator=(const CASOpTileCache&);
+    
+    struct Entry {
+        Tile tile;
+        uint64_t lastUse;
+    };
+    struct Key {
+        std::string key;
+        uint64_t generation, lastUse;
+    };
+    typedef std::map<std::pair<uint64_t, size_t>, Entry> Tiles;
+    
+    bool isLive(uint64_t generation) const;
+    void erase(Tiles::iterator entry);
+    
+    mutable std::mutex mutex;
+    std::vector<Key> keys;
+    Tiles tiles;
+    size_t limit, bytes, hitCount, missCount;
+    uint64_t clock, generation;
+};
+
+// as CASOpGraphRender but just the region of the output, written to out from its top left. with a cache whole tiles
+// are rendered and kept, without one only the region is worked out
+bool CASOpGraphRenderRegion(const CASOpGraph& graph, CASOpDisplayFormat format, const CASOpRegion& region, uint8_t* out, size_t bytesPerRow, CASOpTileCache* cache = NULL, CASOpGraphApply apply = NULL);
+
+#endif
@@ -0,0 +1,263 @@
+//
+//  CASParallel.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASParallel.h"
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include <stdlib.h>
+
+namespace {
+
+// one thread's share of a loop, the owner takes pieces off the front and thieves take the back half
+struct CASParallelShare {
+    std::mutex lock;
+    size_t begin, end;
+    char padding[64]; // keeps each share's lock on its own cache line
+    
+    bool take(size_t grain, size_t& b, size_t& e) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (begin == end){
+            return false;
+        }
+        b = begin;
+        e = begin = std::min(end, begin + grain);
+        return true;
+    }
+    
+    bool steal(size_t grain, size_t& b, size_t& e) {
+        std::lock_guard<std::mutex> guard(lock);
+        // leave the last piece to the owner who's about to take it anyway
+        if (end - begin <= grain){
+            return false;
+        }
+        b = begin + (end - begin) / 2;
+        e = end;
+        end = b;
+        return true;
+    }
+    
+    void reset(size_t b, size_t e) {
+        std::lock_guard<std::mutex> guard(lock);
+        begin = b;
+        end = e;
+    }
+};
+
+struct CASParallelJob {
+    size_t grain;
+    void* context;
+    CASParallelWork work;
+    std::vector<CASParallelShare> shares;
+    std::atomic<size_t> active;
+    
+    CASParallelJob(size_t threadCount) : shares(threadCount), active(0) {}
+    
+    void run(size_t index) {
+        const size_t threadCount = shares.size();
+        CASParallelShare& share = shares[index];
+        size_t b, e;
+        for (;;){
+            while (share.take(grain, b, e)){
+                work(context, b, e);
+            }
+            bool stole = false;
+            for (size_t i = 1; i < threadCount && !stole; ++i){
+                stole = shares[(index + i) % threadCount].steal(grain, b, e);
+            }
+            if (!stole){
+                break;
+            }
+            share.reset(b, e);
+        }
+    }
+};
+
+thread_local bool tInsideLoop = false;
+
+class CASParallelPool {
+public:
+    // never destroyed so the workers can't outlive it at exit
+    static CASParallelPool& shared() {
+        static CASParallelPool* pool = new CASParallelPool(defaultThreadCount());
+        return *pool;
+    }
+    
+    static std::atomic<bool>& started() {
+        static std::atomic<bool> started(false);
+        return started;
+    }
+    
+    static std::atomic<size_t>& requestedThreadCount() {
+        static std::atomic<size_t> count(0);
+        return count;
+    }
+    
+    size_t threadCount() const { return _workerCount + 1; }
+    
+    void run(size_t count, size_t grain, void* context, CASParallelWork work) {
+        
+        std::unique_lock<std::mutex> busy(_busy, std::try_to_lock);
+        if (!busy.owns_lock() || tInsideLoop || !_workerCount || count <= grain){
+            for (size_t b = 0; b < count; b += grain){
+                work(context, b, std::min(count, b + grain));
+            }
+            return;
+        }
+        
+        const size_t threadCount = this->threadCount();
+        CASParallelJob job(threadCount);
+        job.grain = grain;
+        job.context = context;
+        job.work = work;
+        job.active = _workerCount;
+        for (size_t i = 0; i < threadCount; ++i){
+            job.shares[i].begin = (count * i) / threadCount;
+            job.shares[i].end = (count * (i + 1)) / threadCount;
+        }
+        
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _job = &job;
+            ++_generation;
+        }
+        _wake.notify_all();
+        
+        tInsideLoop = true;
+        job.run(0);
+        tInsideLoop = false;
+        
+        // every worker has to have finished with the job before it goes out of scope
+        std::unique_lock<std::mutex> guard(_lock);
+        _done.wait(guard, [&]{ return job.active == 0; });
+        _job = NULL;
+    }
+    
+private:
+    size_t _workerCount;
+    std::mutex _busy, _lock;
+    std::condition_variable _wake, _done;
+    CASParallelJob* _job;
+    size_t _generation;
+    
+    static size_t defaultThreadCount() {
+        const size_t requested = requestedThreadCount();
+        if (requested){
+            return requested;
+        }
+        const char* env = getenv("CAS_PARALLEL_THREADS");
+        if (env && atoi(env) > 0){
+            return atoi(env);
+        }
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    CASParallelPool(size_t threadCount) : _workerCount(threadCount - 1), _job(NULL), _generation(0) {
+        started() = true;
+        for (size_t i = 1; i < threadCount; ++i){
+            std::thread(&CASParallelPool::worker, this, i).detach();
+        }
+    }
+    
+    void worker(size_t index) {
+        tInsideLoop = true;
+        size_t generation = 0;
+        for (;;){
+            CASParallelJob* job;
+            {
+                std::unique_lock<std::mutex> guard(_lock);
+                _wake.wait(guard, [&]{ return _generation != generation; });
+                generation = _generation;
+                job = _job;
+            }
+            job->run(index);
+            if (--job->active == 0){
+                std::lock_guard<std::mutex> guard(_lock);
+                _done.notify_all();
+            }
+        }
+    }
+};
+
+}
+
+size_t CASParallelThreadCount()
+{
+    return CASParallelPool::shared().threadCount();
+}
+
+bool CASParallelSetThreadCount(size_t threadCount)
+{
+    if (!threadCount || CASParallelPool::started()){
+        return false;
+    }
+    CASParallelPool::requestedThreadCount() = threadCount;
+    return CASParallelPool::shared().threadCount() == threadCount;
+}
+
+static size_t CASParallelGrain(size_t count, size_t grain)
+{
+    if (grain){
+        return grain;
+    }
+    const size_t pieces = CASParallelThreadCount() * CAS_PARALLEL_PIECES_PER_THREAD;
+    return std::max<size_t>(1, (count + pieces - 1) / pieces);
+}
+
+void CASParallelForRange(size_t count, size_t grain, void* context, CASParallelWork work)
+{
+    if (count){
+        CASParallelPool::shared().run(count, CASParallelGrain(count, grain), context, work);
+    }
+}
+
+struct CASParallelApplyContext {
+    void* context;
+    void (*work)(void* context, size_t index);
+    
+    static void range(void* context, size_t begin, size_t end) {
+        const CASParallelApplyContext& apply = *(const CASParallelApplyContext*)context;
+        for (size_t i = begin; i < end; ++i){
+            apply.work(apply.context, i);
+        }
+    }
+};
+
+void CASParallelApply(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    // the engines' units of work are already sized for a thread so they're handed out one at a time
+    CASParallelApplyContext apply = { context, work };
+    CASParallelForRange(count, 1, &apply, CASParallelApplyContext::range);
+}
+
+size_t CASParallelReduceGrain(size_t count, size_t grain, CASParallelReduceMode mode)
+{
+    if (grain){
+        return grain;
+    }
+    if (mode == kCASParallelReduceDeterministic){
+        return std::max<size_t>(1, (count + CAS_PARALLEL_REDUCE_CHUNKS - 1) / CAS_PARALLEL_REDUCE_CHUNKS);
+    }
+    return CASParallelGrain(count, 0);
+}
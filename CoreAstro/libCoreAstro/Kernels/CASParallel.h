@@ -0,0 +1,111 @@
+//
+//  CASParallel.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Parallel loops over a fixed pool of worker threads. Each thread starts with an equal share of the
+//  range and takes grain sized pieces off the front of it, threads that run out steal the back half of
+//  whatever another thread has left, so uneven work and uneven cores still finish together. Reductions
+//  can be made deterministic, where the partial results don't depend on the number of threads or on
+//  which thread ran what and are always combined in the same order.
+
+#ifndef __CASParallel_h__
+#define __CASParallel_h__
+
+#include <stddef.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+// pieces each thread's share is split into when the grain is picked automatically
+#define CAS_PARALLEL_PIECES_PER_THREAD 8
+
+// most chunks a deterministic reduction is split into when the grain is picked automatically
+#define CAS_PARALLEL_REDUCE_CHUNKS 256
+
+typedef void (*CASParallelWork)(void* context, size_t begin, size_t end);
+
+typedef enum {
+    kCASParallelReduceDeterministic,    // fixed chunks combined in order, so floating point results are reproducible
+    kCASParallelReduceUnordered         // chunks sized for the pool and combined as they finish
+} CASParallelReduceMode;
+
+// threads that run loops including the calling one, from CAS_PARALLEL_THREADS or the number of cores
+size_t CASParallelThreadCount();
+
+// sets the size of the pool, for tools and tests. only works before the first parallel call
+bool CASParallelSetThreadCount(size_t threadCount);
+
+// runs work(context,begin,end) over ranges covering [0,count) exactly once and returns when they're all done. ranges are
+// at most grain long, a grain of 0 picks one from the count and the pool size. calls from inside a loop, or made while
+// another thread is using the pool, run on the calling thread
+void CASParallelForRange(size_t count, size_t grain, void* context, CASParallelWork work);
+
+// work(context,index) for every index in [0,count), the same signature as the engines' apply callbacks
+void CASParallelApply(size_t count, void* context, void (*work)(void* context, size_t index));
+
+// body(begin,end) for ranges covering [0,count)
+template <typename Body>
+void CASParallelFor(size_t count, size_t grain, const Body& body)
+{
+    struct Trampoline {
+        static void work(void* context, size_t begin, size_t end) {
+            (*(const Body*)context)(begin, end);
+        }
+    };
+    CASParallelForRange(count, grain, (void*)&body, Trampoline::work);
+}
+
+// deterministic reductions use the same grain whatever the pool size, CAS_PARALLEL_REDUCE_CHUNKS at most
+size_t CASParallelReduceGrain(size_t count, size_t grain, CASParallelReduceMode mode);
+
+// combine(...combine(combine(identity, map(r0)), map(r1))...) over ranges r covering [0,count), map(begin,end) returns a T
+template <typename T, typename Map, typename Combine>
+T CASParallelReduce(size_t count, size_t grain, const T& identity, const Map& map, const Combine& combine, CASParallelReduceMode mode = kCASParallelReduceDeterministic)
+{
+    grain = CASParallelReduceGrain(count, grain, mode);
+    const size_t chunkCount = count ? (count + grain - 1) / grain : 0;
+    if (mode == kCASParallelReduceDeterministic){
+        std::vector<T> partials(chunkCount, identity);
+        CASParallelFor(chunkCount, 1, [&](size_t begin, size_t end){
+            for (size_t c = begin; c < end; ++c){
+                partials[c] = map(c * grain, std::min(count, (c + 1) * grain));
+            }
+        });
+        T result = identity;
+        for (size_t c = 0; c < chunkCount; ++c){
+            result = combine(result, partials[c]);
+        }
+        return result;
+    }
+    
+    std::mutex lock;
+    T result = identity;
+    CASParallelFor(count, grain, [&](size_t begin, size_t end){
+        const T partial = map(begin, end);
+        std::lock_guard<std::mutex> guard(lock);
+        result = combine(result, partial);
+    });
+    return result;
+}
+
+#endif
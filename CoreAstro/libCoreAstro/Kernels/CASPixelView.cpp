@@ -0,0 +1,61 @@
+//
+//  CASPixelView.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASPixelView.h"
+#include "CASKernels.h"
+#include <string.h>
+
+bool CASPixelsToFloat(const CASPixels& pixels, float* out, size_t outStride)
+{
+    if (CASPixelsIsEmpty(pixels) || !out){
+        return false;
+    }
+    
+    switch (pixels.format) {
+        case kCASPixelFormatUInt16: {
+            const CASPixelView<const uint16_t> view = CASPixelsView<uint16_t>(pixels);
+            const CASKernelTable& kernels = CASKernels();
+            if (view.contiguous() && outStride == view.width){
+                kernels.widenU16(view.pixels, CAS_PIXEL_UINT16_MAX, out, view.width * view.height);
+            }
+            else {
+                for (size_t y = 0; y < view.height; ++y){
+                    kernels.widenU16(view.row(y), CAS_PIXEL_UINT16_MAX, out + y * outStride, view.width);
+                }
+            }
+            return true;
+        }
+        case kCASPixelFormatFloat:
+        case kCASPixelFormatRGBAFloat: {
+            const size_t channelCount = (pixels.format == kCASPixelFormatFloat) ? 1 : 4;
+            const float* in = (const float*)pixels.data;
+            for (size_t y = 0; y < pixels.height; ++y){
+                memcpy(out + y * outStride, in + y * pixels.stride * channelCount, pixels.width * channelCount * sizeof(float));
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,191 @@
+//
+//  CASPixelView.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Typed views onto frames of 16-bit, float or RGBA float samples with a row stride, so kernels can be
+//  written once as templates and run on whatever the camera or the last processing step produced
+//  rather than everything first being expanded to floats. The C part is for handing frames around
+//  from Objective-C, the views themselves are C++.
+
+#ifndef __CASPixelView_h__
+#define __CASPixelView_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 16-bit samples map to 0-1 floats by dividing by this, as exposures do
+#define CAS_PIXEL_UINT16_MAX 65535
+
+typedef enum {
+    kCASPixelFormatNone = 0,
+    kCASPixelFormatUInt16,
+    kCASPixelFormatFloat,
+    kCASPixelFormatRGBAFloat
+} CASPixelFormat;
+
+// a borrowed frame, stride is the distance between the start of each row in pixels of the format
+typedef struct {
+    CASPixelFormat format;
+    const void* data;
+    size_t width, height, stride;
+} CASPixels;
+
+static inline CASPixels CASPixelsMake(CASPixelFormat format, const void* data, size_t width, size_t height, size_t stride)
+{
+    CASPixels pixels = { format, data, width, height, stride };
+    return pixels;
+}
+
+static inline size_t CASPixelFormatSize(CASPixelFormat format)
+{
+    switch (format) {
+        case kCASPixelFormatUInt16:
+            return sizeof(uint16_t);
+        case kCASPixelFormatFloat:
+            return sizeof(float);
+        case kCASPixelFormatRGBAFloat:
+            return 4 * sizeof(float);
+        default:
+            return 0;
+    }
+}
+
+static inline int CASPixelsIsEmpty(CASPixels pixels)
+{
+    return pixels.format == kCASPixelFormatNone || !pixels.data || !pixels.width || !pixels.height || pixels.stride < pixels.width;
+}
+
+#ifdef __cplusplus
+
+struct CASPixelRGBA {
+    float r, g, b, a;
+};
+
+// the format and channel count of a sample type along with how to get a 0-1 float from it, luminance for RGBA
+template <typename T> struct CASPixelTraits;
+
+template <> struct CASPixelTraits<uint16_t> {
+    static const CASPixelFormat format = kCASPixelFormatUInt16;
+    static const size_t channelCount = 1;
+    static float toFloat(uint16_t value) { return value / (float)CAS_PIXEL_UINT16_MAX; }
+};
+
+template <> struct CASPixelTraits<float> {
+    static const CASPixelFormat format = kCASPixelFormatFloat;
+    static const size_t channelCount = 1;
+    static float toFloat(float value) { return value; }
+};
+
+template <> struct CASPixelTraits<CASPixelRGBA> {
+    static const CASPixelFormat format = kCASPixelFormatRGBAFloat;
+    static const size_t channelCount = 4;
+    static float toFloat(const CASPixelRGBA& value) {
+        const float l = 0.2126f * value.r + 0.7152f * value.g + 0.0722f * value.b; // as the luminance kernel
+        return l < 1.0f ? l : 1.0f;
+    }
+};
+
+template <typename T> struct CASPixelTraits<const T> : CASPixelTraits<T> {};
+
+// T is the sample type, const for read only views. no bounds checking beyond region() clipping its rectangle
+template <typename T>
+struct CASPixelView {
+    
+    T* pixels;
+    size_t width, height, stride;
+    
+    CASPixelView() : pixels(NULL), width(0), height(0), stride(0) {}
+    CASPixelView(T* pixels_, size_t width_, size_t height_, size_t stride_ = 0) : pixels(pixels_), width(width_), height(height_), stride(stride_ ? stride_ : width_) {}
+    
+    // read only view of a writable one
+    operator CASPixelView<const T>() const { return CASPixelView<const T>(pixels, width, height, stride); }
+    
+    bool empty() const { return !pixels || !width || !height; }
+    bool contiguous() const { return stride == width; }
+    
+    T* row(size_t y) const { return pixels + y * stride; }
+    T& at(size_t x, size_t y) const { return pixels[y * stride + x]; }
+    float value(size_t x, size_t y) const { return CASPixelTraits<T>::toFloat(at(x, y)); }
+    
+    // the part of the view inside the rectangle, shares the samples and stride
+    CASPixelView region(size_t x, size_t y, size_t w, size_t h) const {
+        if (x >= width || y >= height){
+            return CASPixelView();
+        }
+        return CASPixelView(row(y) + x, w < width - x ? w : width - x, h < height - y ? h : height - y, stride);
+    }
+};
+
+// typed view of a frame, empty if it holds some other format
+template <typename T>
+CASPixelView<const T> CASPixelsView(const CASPixels& pixels)
+{
+    if (CASPixelsIsEmpty(pixels) || pixels.format != CASPixelTraits<T>::format){
+        return CASPixelView<const T>();
+    }
+    return CASPixelView<const T>((const T*)pixels.data, pixels.width, pixels.height, pixels.stride);
+}
+
+template <typename T>
+CASPixels CASPixelsFromView(const CASPixelView<T>& view)
+{
+    return CASPixelsMake(CASPixelTraits<T>::format, view.pixels, view.width, view.height, view.stride);
+}
+
+// the part of a frame inside the rectangle, clipped to it as for CASPixelView::region
+inline CASPixels CASPixelsRegion(const CASPixels& pixels, size_t x, size_t y, size_t w, size_t h)
+{
+    if (CASPixelsIsEmpty(pixels) || x >= pixels.width || y >= pixels.height){
+        return CASPixelsMake(kCASPixelFormatNone, NULL, 0, 0, 0);
+    }
+    const uint8_t* data = (const uint8_t*)pixels.data + (y * pixels.stride + x) * CASPixelFormatSize(pixels.format);
+    return CASPixelsMake(pixels.format, data, w < pixels.width - x ? w : pixels.width - x, h < pixels.height - y ? h : pixels.height - y, pixels.stride);
+}
+
+// calls f(view) with the typed read only view of the frame so that f, usually a functor with a templated call
+// operator, gets instantiated once per sample type. false if the frame's empty
+template <typename F>
+bool CASPixelsDispatch(const CASPixels& pixels, F& f)
+{
+    switch (CASPixelsIsEmpty(pixels) ? kCASPixelFormatNone : pixels.format) {
+        case kCASPixelFormatUInt16:
+            f(CASPixelsView<uint16_t>(pixels));
+            return true;
+        case kCASPixelFormatFloat:
+            f(CASPixelsView<float>(pixels));
+            return true;
+        case kCASPixelFormatRGBAFloat:
+            f(CASPixelsView<CASPixelRGBA>(pixels));
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 0-1 floats for the ones that really need them, rows of width * channel count floats outStride floats apart.
+// 16-bit samples are widened as exposures do and floats are copied, false if the frame's empty
+bool CASPixelsToFloat(const CASPixels& pixels, float* out, size_t outStride);
+
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+//
+//  CASPyramid.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASPyramid.h"
+#include "CASKernels.h"
+#include <algorithm>
+
+// output rows halved per piece of work
+#define CAS_PYRAMID_BAND 32
+
+namespace {
+
+struct CASPyramidHalving {
+    CASPixels in;
+    void* out;
+    size_t outStride, outWidth, outHeight;
+    
+    template <typename T>
+    void band(size_t index, size_t channelCount) const {
+        const CASKernelTable& kernels = CASKernels();
+        const size_t end = std::min(outHeight, (index + 1) * CAS_PYRAMID_BAND);
+        const size_t pairs = in.width / 2;
+        for (size_t y = index * CAS_PYRAMID_BAND; y < end; ++y){
+            const T* row0 = (const T*)in.data + 2 * y * in.stride * channelCount;
+            const T* row1 = (2 * y + 1 < in.height) ? row0 + in.stride * channelCount : row0;
+            T* o = (T*)out + y * outStride * channelCount;
+            halve(kernels, row0, row1, o, pairs, channelCount);
+            if (in.width & 1){
+                // the last column is averaged with itself
+                const T* last0 = row0 + (in.width - 1) * channelCount;
+                const T* last1 = row1 + (in.width - 1) * channelCount;
+                for (size_t c = 0; c < channelCount; ++c){
+                    const T column0[2] = { last0[c], last0[c] }, column1[2] = { last1[c], last1[c] };
+                    halve(kernels, column0, column1, o + pairs * channelCount + c, 1, 1);
+                }
+            }
+        }
+    }
+    
+    static void halve(const CASKernelTable& kernels, const uint16_t* row0, const uint16_t* row1, uint16_t* out, size_t count, size_t) {
+        kernels.halveU16(row0, row1, out, count);
+    }
+    
+    static void halve(const CASKernelTable& kernels, const float* row0, const float* row1, float* out, size_t count, size_t channelCount) {
+        kernels.halveFloat(row0, row1, out, count, channelCount);
+    }
+    
+    static void work(void* context, size_t index) {
+        const CASPyramidHalving& halving = *(const CASPyramidHalving*)context;
+        switch (halving.in.format) {
+            case kCASPixelFormatUInt16:
+                halving.band<uint16_t>(index, 1);
+                break;
+            case kCASPixelFormatFloat:
+                halving.band<float>(index, 1);
+                break;
+            case kCASPixelFormatRGBAFloat:
+                halving.band<float>(index, 4);
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+void CASPyramidApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+}
+
+size_t CASPyramidLevelCount(size_t width, size_t height)
+{
+    size_t count = 0;
+    while (width > CAS_PYRAMID_SMALLEST_SIZE || height > CAS_PYRAMID_SMALLEST_SIZE){
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        ++count;
+    }
+    return count;
+}
+
+void CASPyramidLevelSize(size_t width, size_t height, size_t level, size_t* levelWidth, size_t* levelHeight)
+{
+    for (size_t i = 0; i < level; ++i){
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    *levelWidth = width;
+    *levelHeight = height;
+}
+
+size_t CASPyramidSize(CASPixelFormat format, size_t width, size_t height)
+{
+    size_t size = 0;
+    const size_t count = CASPyramidLevelCount(width, height);
+    for (size_t level = 1; level <= count; ++level){
+        size_t w, h;
+        CASPyramidLevelSize(width, height, level, &w, &h);
+        size += w * h * CASPixelFormatSize(format);
+    }
+    return size;
+}
+
+CASPixels CASPyramidLevel(CASPixelFormat format, const void* pyramid, size_t width, size_t height, size_t level)
+{
+    if (!pyramid || !level || level > CASPyramidLevelCount(width, height) || !CASPixelFormatSize(format)){
+        return CASPixelsMake(kCASPixelFormatNone, NULL, 0, 0, 0);
+    }
+    const uint8_t* p = (const uint8_t*)pyramid;
+    size_t w, h;
+    for (size_t i = 1; i < level; ++i){
+        CASPyramidLevelSize(width, height, i, &w, &h);
+        p += w * h * CASPixelFormatSize(format);
+    }
+    CASPyramidLevelSize(width, height, level, &w, &h);
+    return CASPixelsMake(format, p, w, h, w);
+}
+
+bool CASPyramidHalve(const CASPixels& in, void* out, size_t outStride, CASPyramidApply apply)
+{
+    if (CASPixelsIsEmpty(in) || !out){
+        return false;
+    }
+    CASPyramidHalving halving = { in, out, outStride, (in.width + 1) / 2, (in.height + 1) / 2 };
+    if (outStride < halving.outWidth){
+        return false;
+    }
+    if (!apply){
+        apply = CASPyramidApplyInOrder;
+    }
+    apply((halving.outHeight + CAS_PYRAMID_BAND - 1) / CAS_PYRAMID_BAND, &halving, CASPyramidHalving::work);
+    return true;
+}
+
+bool CASPyramidBuild(const CASPixels& frame, void* pyramid, CASPyramidApply apply)
+{
+    if (CASPixelsIsEmpty(frame) || !pyramid){
+        return false;
+    }
+    CASPixels in = frame;
+    const size_t count = CASPyramidLevelCount(frame.width, frame.height);
+    for (size_t level = 1; level <= count; ++level){
+        const CASPixels out = CASPyramidLevel(frame.format, pyramid, frame.width, frame.height, level);
+        if (!CASPyramidHalve(in, (void*)out.data, out.stride, apply)){
+            return false;
+        }
+        in = out;
+    }
+    return true;
+}
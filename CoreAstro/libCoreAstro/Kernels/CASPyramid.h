@@ -0,0 +1,59 @@
+//
+//  CASPyramid.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Mip pyramids of frames, each level a 2x2 box filtered half of the one before, so that thumbnails and
+//  zoomed out views can be drawn from a level near the size they need rather than the full frame. Odd
+//  sized levels round up, the last row or column being averaged with itself.
+
+
+#ifndef __CASPyramid_h__
+#define __CASPyramid_h__
+
+#include "CASPixelView.h"
+
+// levels stop once neither side is bigger than this
+#define CAS_PYRAMID_SMALLEST_SIZE 64
+
+// runs work(context,index) for every index in [0,count), possibly in parallel. NULL runs them in order on the calling thread
+typedef void (*CASPyramidApply)(size_t count, void* context, void (*work)(void* context, size_t index));
+
+// levels below the frame itself, 0 if it's already no bigger than CAS_PYRAMID_SMALLEST_SIZE
+size_t CASPyramidLevelCount(size_t width, size_t height);
+
+// size of a level, level 0 being the frame
+void CASPyramidLevelSize(size_t width, size_t height, size_t level, size_t* levelWidth, size_t* levelHeight);
+
+// bytes needed for all the levels below the frame packed one after another, level 1 first, rows unpadded
+size_t CASPyramidSize(CASPixelFormat format, size_t width, size_t height);
+
+// a level of a pyramid built by CASPyramidBuild from a frame of the given format and size, empty if there's no such level
+CASPixels CASPyramidLevel(CASPixelFormat format, const void* pyramid, size_t width, size_t height, size_t level);
+
+// halves in into out, in the same format, ceil(width/2) x ceil(height/2) pixels outStride pixels a row
+bool CASPyramidHalve(const CASPixels& in, void* out, size_t outStride, CASPyramidApply apply = NULL);
+
+// builds every level below the frame into pyramid, which must be CASPyramidSize bytes
+bool CASPyramidBuild(const CASPixels& frame, void* pyramid, CASPyramidApply apply = NULL);
+
+#endif
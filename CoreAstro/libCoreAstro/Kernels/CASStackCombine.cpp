@@ -0,0 +1,368 @@
+//
+//  CASStackCombine.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASStackCombine.h"
+#include <algorithm>
+#include <vector>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+CASStackCombineParameters CASStackCombineDefaultParameters(CASStackCombineMode mode)
+{
+    CASStackCombineParameters parameters;
+    parameters.mode = mode;
+    parameters.kappaLow = 3;
+    parameters.kappaHigh = 3;
+    parameters.iterations = 5;
+    parameters.memoryLimit = CAS_STACK_DEFAULT_MEMORY_LIMIT;
+    return parameters;
+}
+
+size_t CASStackStripRows(size_t width, size_t height, size_t frameCount, size_t memoryLimit)
+{
+    if (!memoryLimit){
+        memoryLimit = CAS_STACK_DEFAULT_MEMORY_LIMIT;
+    }
+    const size_t rowBytes = std::max<size_t>(1, width * frameCount * sizeof(float));
+    return std::max<size_t>(1, std::min(height, memoryLimit / rowBytes));
+}
+
+static void CASStackConvert(const uint16_t* samples, float* strip, size_t count)
+{
+    const float scale = 1.0f / 65535.0f;
+    for (size_t i = 0; i < count; ++i){
+        strip[i] = samples[i] * scale;
+    }
+}
+
+bool CASStackReadStrip(const CASStackFrame& frame, size_t width, size_t startRow, size_t rowCount, float* strip)
+{
+    const size_t count = width * rowCount;
+    const size_t first = width * startRow;
+    
+    if (frame.pixels){
+        if (frame.format == kCASStackSampleUInt16){
+            CASStackConvert((const uint16_t*)frame.pixels + first, strip, count);
+        }
+        else {
+            std::copy((const float*)frame.pixels + first, (const float*)frame.pixels + first + count, strip);
+        }
+        return true;
+    }
+    
+    if (!frame.path){
+        return false;
+    }
+    const int fd = open(frame.path, O_RDONLY);
+    if (fd == -1){
+        return false;
+    }
+    
+    // 16-bit samples are read into the back half of the strip and then expanded forwards in place
+    const size_t sampleSize = (frame.format == kCASStackSampleUInt16) ? sizeof(uint16_t) : sizeof(float);
+    char* buffer = (char*)strip;
+    if (frame.format == kCASStackSampleUInt16){
+        buffer += count * (sizeof(float) - sizeof(uint16_t));
+    }
+    
+    size_t remaining = count * sampleSize;
+    off_t position = frame.offset + first * sampleSize;
+    char* p = buffer;
+    while (remaining){
+        const ssize_t bytes = pread(fd, p, remaining, position);
+        if (bytes <= 0){
+            break;
+        }
+        p += bytes;
+        position += bytes;
+        remaining -= bytes;
+    }
+    close(fd);
+    
+    if (remaining){
+        return false;
+    }
+    if (frame.format == kCASStackSampleUInt16){
+        CASStackConvert((const uint16_t*)buffer, strip, count);
+    }
+    return true;
+}
+
+// Batcher's odd-even merge sort, pruned to n inputs
+static void CASStackSortingNetwork(size_t n, std::vector<uint16_t>& comparators)
+{
+    comparators.clear();
+    for (size_t p = 1; p < n; p <<= 1){
+        for (size_t k = p; k >= 1; k >>= 1){
+            for (size_t j = k % p; j + k < n; j += 2 * k){
+                for (size_t i = 0; i < std::min(k, n - j - k); ++i){
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p)){
+                        comparators.push_back(i + j);
+                        comparators.push_back(i + j + k);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static inline float CASStackSortedMedian(const float* s, size_t n)
+{
+    return (n & 1) ? s[n / 2] : 0.5f * (s[n / 2 - 1] + s[n / 2]);
+}
+
+static inline void CASStackMeanSigma(const float* s, size_t n, double& mean, double& sigma)
+{
+    double sum = 0, sumSq = 0;
+    for (size_t i = 0; i < n; ++i){
+        sum += s[i];
+        sumSq += (double)s[i] * s[i];
+    }
+    mean = sum / n;
+    sigma = sqrt(std::max(0.0, sumSq / n - mean * mean));
+}
+
+static inline float CASStackMean(const float* s, size_t n)
+{
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i){
+        sum += s[i];
+    }
+    return sum / n;
+}
+
+// narrows [lo,hi) of the sorted samples to those within [low,high], returns false if nothing changed
+static inline bool CASStackClip(const float* s, size_t& lo, size_t& hi, double low, double high)
+{
+    size_t newLo = lo, newHi = hi;
+    while (newLo < newHi && s[newLo] < low){
+        ++newLo;
+    }
+    while (newHi > newLo && s[newHi - 1] > high){
+        --newHi;
+    }
+    if (newHi == newLo || (newLo == lo && newHi == hi)){
+        return false;
+    }
+    lo = newLo;
+    hi = newHi;
+    return true;
+}
+
+static float CASStackKappaSigma(const float* s, size_t n, const CASStackCombineParameters& parameters)
+{
+    size_t lo = 0, hi = n;
+    for (int i = 0; i < parameters.iterations && hi - lo > 2; ++i){
+        double mean, sigma;
+        CASStackMeanSigma(s + lo, hi - lo, mean, sigma);
+        const double median = CASStackSortedMedian(s + lo, hi - lo);
+        if (!CASStackClip(s, lo, hi, median - parameters.kappaLow * sigma, median + parameters.kappaHigh * sigma)){
+            break;
+        }
+    }
+    return CASStackMean(s + lo, hi - lo);
+}
+
+// Huber's winsorization, sigma is re-estimated from the samples clamped to 1.5 sigma either side of the median
+// until it settles and the 1.134 factor corrects for the clamping when the samples are normally distributed
+static float CASStackWinsorizedSigma(const float* s, size_t n, const CASStackCombineParameters& parameters)
+{
+    size_t lo = 0, hi = n;
+    for (int i = 0; i < parameters.iterations && hi - lo > 2; ++i){
+        const float* r = s + lo;
+        const size_t m = hi - lo;
+        const double median = CASStackSortedMedian(r, m);
+        double mean, sigma;
+        CASStackMeanSigma(r, m, mean, sigma);
+        for (int w = 0; w < 10 && sigma > 0; ++w){
+            const double low = median - 1.5 * sigma, high = median + 1.5 * sigma;
+            double sum = 0, sumSq = 0;
+            for (size_t j = 0; j < m; ++j){
+                const double v = std::min(high, std::max(low, (double)r[j]));
+                sum += v;
+                sumSq += v * v;
+            }
+            const double wmean = sum / m;
+            const double wsigma = 1.134 * sqrt(std::max(0.0, sumSq / m - wmean * wmean));
+            const bool settled = fabs(wsigma - sigma) <= 0.0005 * sigma;
+            sigma = wsigma;
+            if (settled){
+                break;
+            }
+        }
+        if (!CASStackClip(s, lo, hi, median - parameters.kappaLow * sigma, median + parameters.kappaHigh * sigma)){
+            break;
+        }
+    }
+    return CASStackMean(s + lo, hi - lo);
+}
+
+// fits a line to the sorted samples against their rank and rejects the ends that stray too far from it
+static float CASStackLinearFit(const float* s, size_t n, const CASStackCombineParameters& parameters)
+{
+    size_t lo = 0, hi = n;
+    for (int i = 0; i < parameters.iterations && hi - lo > 3; ++i){
+        const float* r = s + lo;
+        const size_t m = hi - lo;
+        double sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (size_t j = 0; j < m; ++j){
+            sx += j;
+            sy += r[j];
+            sxx += (double)j * j;
+            sxy += j * (double)r[j];
+        }
+        const double slope = (m * sxy - sx * sy) / (m * sxx - sx * sx);
+        const double intercept = (sy - slope * sx) / m;
+        double deviation = 0;
+        for (size_t j = 0; j < m; ++j){
+            deviation += fabs(r[j] - (intercept + slope * j));
+        }
+        deviation /= m;
+        
+        size_t newLo = 0, newHi = m;
+        while (newLo < newHi && r[newLo] - (intercept + slope * newLo) < -parameters.kappaLow * deviation){
+            ++newLo;
+        }
+        while (newHi > newLo && r[newHi - 1] - (intercept + slope * (newHi - 1)) > parameters.kappaHigh * deviation){
+            --newHi;
+        }
+        if (newHi == newLo || (newLo == 0 && newHi == m)){
+            break;
+        }
+        hi = lo + newHi;
+        lo += newLo;
+    }
+    return CASStackMean(s + lo, hi - lo);
+}
+
+void CASStackCombineRange(const float* strip, size_t frameCount, size_t stripPixels, const CASStackCombineParameters& parameters, float* out, size_t start, size_t count)
+{
+    if (!frameCount){
+        std::fill(out + start, out + start + count, 0.0f);
+        return;
+    }
+    
+    const CASKernelTable& kernels = CASKernels();
+    
+    if (parameters.mode == kCASStackCombineAverage){
+        std::vector<const float*> planes(frameCount);
+        for (size_t f = 0; f < frameCount; ++f){
+            planes[f] = strip + f * stripPixels + start;
+        }
+        kernels.average(planes.data(), frameCount, out + start, count);
+        return;
+    }
+    
+    const bool network = (frameCount <= CAS_STACK_NETWORK_MAX_FRAMES);
+    std::vector<uint16_t> comparators;
+    if (network){
+        CASStackSortingNetwork(frameCount, comparators);
+    }
+    
+    // each block's samples are copied out of the strip into a scratch buffer small enough to stay in cache. the planes
+    // in the strip are usually a multiple of 4KB apart which would have every sample of a pixel competing for the same
+    // cache set, so the scratch planes are padded by a cache line each
+    const size_t stride = CAS_STACK_COMBINE_BLOCK + 16;
+    std::vector<float> scratch(frameCount * stride);
+    std::vector<float> samples(frameCount);
+    
+    for (size_t block = start; block < start + count; block += CAS_STACK_COMBINE_BLOCK){
+        
+        const size_t blockCount = std::min<size_t>(CAS_STACK_COMBINE_BLOCK, start + count - block);
+        for (size_t f = 0; f < frameCount; ++f){
+            const float* plane = strip + f * stripPixels + block;
+            std::copy(plane, plane + blockCount, scratch.data() + f * stride);
+        }
+        
+        if (network){
+            kernels.sortColumns(scratch.data(), stride, comparators.data(), comparators.size() / 2, blockCount);
+            
+            // the median can be read straight out of the sorted planes
+            if (parameters.mode == kCASStackCombineMedian){
+                const float* a = scratch.data() + ((frameCount - 1) / 2) * stride;
+                const float* b = scratch.data() + (frameCount / 2) * stride;
+                for (size_t i = 0; i < blockCount; ++i){
+                    out[block + i] = 0.5f * (a[i] + b[i]);
+                }
+                continue;
+            }
+        }
+        
+        for (size_t i = 0; i < blockCount; ++i){
+            
+            float* s = samples.data();
+            for (size_t f = 0; f < frameCount; ++f){
+                s[f] = scratch[f * stride + i];
+            }
+            
+            if (!network){
+                if (parameters.mode == kCASStackCombineMedian){
+                    const size_t n = frameCount;
+                    std::nth_element(s, s + n / 2, s + n);
+                    float median = s[n / 2];
+                    if (!(n & 1)){
+                        median = 0.5f * (*std::max_element(s, s + n / 2) + median);
+                    }
+                    out[block + i] = median;
+                    continue;
+                }
+                std::sort(s, s + frameCount);
+            }
+            
+            switch (parameters.mode) {
+                case kCASStackCombineKappaSigma:
+                    out[block + i] = CASStackKappaSigma(s, frameCount, parameters);
+                    break;
+                case kCASStackCombineWinsorizedSigma:
+                    out[block + i] = CASStackWinsorizedSigma(s, frameCount, parameters);
+                    break;
+                case kCASStackCombineLinearFit:
+                    out[block + i] = CASStackLinearFit(s, frameCount, parameters);
+                    break;
+                default:
+                    out[block + i] = CASStackSortedMedian(s, frameCount);
+                    break;
+            }
+        }
+    }
+}
+
+bool CASStackCombine(const CASStackFrame* frames, size_t frameCount, size_t width, size_t height, const CASStackCombineParameters& parameters, float* out)
+{
+    const size_t stripRows = CASStackStripRows(width, height, frameCount, parameters.memoryLimit);
+    std::vector<float> strip(stripRows * width * std::max<size_t>(1, frameCount));
+    
+    for (size_t row = 0; row < height; row += stripRows){
+        const size_t rowCount = std::min(stripRows, height - row);
+        const size_t stripPixels = rowCount * width;
+        for (size_t f = 0; f < frameCount; ++f){
+            if (!CASStackReadStrip(frames[f], width, row, rowCount, strip.data() + f * stripPixels)){
+                return false;
+            }
+        }
+        CASStackCombineRange(strip.data(), frameCount, stripPixels, parameters, out + row * width, 0, stripPixels);
+    }
+    return true;
+}
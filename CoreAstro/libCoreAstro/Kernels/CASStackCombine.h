@@ -0,0 +1,89 @@
+//
+//  CASStackCombine.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Combines a stack of frames into one, a horizontal strip at a time so that memory use is bounded
+//  no matter how many frames there are or how big they are. Frames can be in memory or read a strip
+//  at a time straight from their raw sample files. Each pixel's samples are sorted with a SIMD sorting
+//  network across a block of pixels at once, which makes the median and the clipping estimators cheap.
+
+#ifndef __CASStackCombine_h__
+#define __CASStackCombine_h__
+
+#include "CASKernels.h"
+
+// bytes of frame strips held in memory at once unless the caller asks otherwise
+#define CAS_STACK_DEFAULT_MEMORY_LIMIT (256*1024*1024)
+
+// pixels combined at a time, with 100 frames the samples for a block are around 100KB
+#define CAS_STACK_COMBINE_BLOCK 256
+
+// stacks deeper than this are sorted one pixel at a time rather than with the network. the network does
+// n log^2 n comparisons but eight pixels at a time with no branches, at 256 frames it's still 5x faster
+#define CAS_STACK_NETWORK_MAX_FRAMES 1024
+
+typedef enum {
+    kCASStackCombineAverage = 0,
+    kCASStackCombineMedian,
+    kCASStackCombineKappaSigma,         // iteratively reject samples more than kappa sigma from the median
+    kCASStackCombineWinsorizedSigma,    // as above but sigma is estimated from winsorized samples so it isn't inflated by the outliers
+    kCASStackCombineLinearFit           // reject samples too far from a line fitted to the sorted samples, better for large stacks
+} CASStackCombineMode;
+
+struct CASStackCombineParameters {
+    CASStackCombineMode mode;
+    float kappaLow;         // clipping thresholds, in sigma (or mean deviations from the fit for linear fit)
+    float kappaHigh;
+    int iterations;         // maximum number of clipping passes
+    size_t memoryLimit;     // bytes of strips to hold at once, 0 for CAS_STACK_DEFAULT_MEMORY_LIMIT
+};
+
+// kappa 3, 5 iterations, default memory limit
+CASStackCombineParameters CASStackCombineDefaultParameters(CASStackCombineMode mode);
+
+typedef enum {
+    kCASStackSampleUInt16,  // scaled to 0-1 as exposures do
+    kCASStackSampleFloat
+} CASStackSampleFormat;
+
+struct CASStackFrame {
+    CASStackSampleFormat format;
+    const void* pixels;     // samples in memory, or NULL to read them from path
+    const char* path;       // uncompressed file of samples in native byte order
+    size_t offset;          // bytes before the first sample in path
+};
+
+// rows per strip so that a strip of every frame fits in the memory limit, always at least one
+size_t CASStackStripRows(size_t width, size_t height, size_t frameCount, size_t memoryLimit);
+
+// reads rows [startRow,startRow+rowCount) of a frame into strip as floats, false if the file can't be read
+bool CASStackReadStrip(const CASStackFrame& frame, size_t width, size_t startRow, size_t rowCount, float* strip);
+
+// strip holds frameCount planes of stripPixels samples each as read above. combines pixels [start,start+count)
+// into out[start,start+count), ranges can be combined in parallel
+void CASStackCombineRange(const float* strip, size_t frameCount, size_t stripPixels, const CASStackCombineParameters& parameters, float* out, size_t start, size_t count);
+
+// single threaded version of the whole process, false if any of the frames can't be read
+bool CASStackCombine(const CASStackFrame* frames, size_t frameCount, size_t width, size_t height, const CASStackCombineParameters& parameters, float* out);
+
+#endif
@@ -0,0 +1,402 @@
+//
+//  CASStatistics.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASStatistics.h"
+#include "CASKernelsPrivate.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+// moments of a chunk, merged pairwise with Chan's update so that big frames don't lose precision
+struct CASStatisticsMoments {
+    size_t count;
+    double mean, m2;
+    float minimum, maximum;
+};
+
+static void CASStatisticsMerge(CASStatisticsMoments& a, const CASStatisticsMoments& b)
+{
+    if (!b.count){
+        return;
+    }
+    if (!a.count){
+        a = b;
+        return;
+    }
+    const double n = (double)a.count + b.count;
+    const double delta = b.mean - a.mean;
+    a.mean += delta * b.count / n;
+    a.m2 += b.m2 + delta * delta * ((double)a.count * b.count / n);
+    a.count += b.count;
+    a.minimum = std::min(a.minimum, b.minimum);
+    a.maximum = std::max(a.maximum, b.maximum);
+}
+
+static size_t CASStatisticsChunkCount(size_t count)
+{
+    const size_t chunks = (count + CAS_STATISTICS_CHUNK_PIXELS - 1) / CAS_STATISTICS_CHUNK_PIXELS;
+    return std::max<size_t>(1, std::min<size_t>(CAS_STATISTICS_MAX_CHUNKS, chunks));
+}
+
+static void CASStatisticsChunkRange(size_t count, size_t chunkCount, size_t chunk, size_t& start, size_t& end)
+{
+    start = (count * chunk) / chunkCount;
+    end = (count * (chunk + 1)) / chunkCount;
+}
+
+static void CASStatisticsApplyInOrder(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = 0; i < count; ++i){
+        work(context, i);
+    }
+}
+
+// adds the per chunk histograms into the first one and hands it over to the statistics
+static void CASStatisticsMergeHistograms(std::vector<uint32_t>& histograms, size_t chunkCount, CASStatistics& statistics)
+{
+    uint32_t* total = histograms.data();
+    for (size_t c = 1; c < chunkCount; ++c){
+        const uint32_t* histogram = total + c * CAS_STATISTICS_BINS;
+        for (size_t b = 0; b < CAS_STATISTICS_BINS; ++b){
+            total[b] += histogram[b];
+        }
+    }
+    histograms.resize(CAS_STATISTICS_BINS);
+    statistics.histogram.swap(histograms);
+}
+
+static size_t CASStatisticsBinAtRank(const CASStatistics& statistics, size_t rank, size_t& before)
+{
+    before = 0;
+    for (size_t b = 0; b < CAS_STATISTICS_BINS; ++b){
+        const size_t n = statistics.histogram[b];
+        if (before + n > rank){
+            return b;
+        }
+        before += n;
+    }
+    return CAS_STATISTICS_BINS - 1;
+}
+
+static float CASStatisticsValueAtRank(const CASStatistics& statistics, size_t rank)
+{
+    size_t before;
+    const size_t b = CASStatisticsBinAtRank(statistics, rank, before);
+    if (statistics.exact){
+        return statistics.histogramLower + b * statistics.histogramBinWidth;
+    }
+    // spread the samples evenly across the bin
+    const double position = b + (rank - before + 0.5) / statistics.histogram[b];
+    const float value = statistics.histogramLower + position * statistics.histogramBinWidth;
+    return std::max(statistics.minimum, std::min(statistics.maximum, value));
+}
+
+static float CASStatisticsDeviationAtRank(const CASStatistics& statistics, size_t rank)
+{
+    const float lower = statistics.histogramLower, width = statistics.histogramBinWidth;
+    if (width <= 0){
+        return 0;
+    }
+    
+    // bins below the median walking down and bins above it walking up both have increasing deviations, so merge the two
+    const double half = statistics.exact ? 0 : 0.5;
+    const double split = ceil((statistics.median - lower) / width - half);
+    long up = (long)std::max(0.0, std::min<double>(CAS_STATISTICS_BINS, split));
+    long down = up - 1;
+    size_t before = 0;
+    while (up < CAS_STATISTICS_BINS || down >= 0){
+        const double upDeviation = (up < CAS_STATISTICS_BINS) ? lower + (up + half) * width - statistics.median : std::numeric_limits<double>::infinity();
+        const double downDeviation = (down >= 0) ? statistics.median - (lower + (down + half) * width) : std::numeric_limits<double>::infinity();
+        const bool useUp = (upDeviation <= downDeviation);
+        before += statistics.histogram[useUp ? up : down];
+        if (before > rank){
+            return std::max(0.0, useUp ? upDeviation : downDeviation);
+        }
+        if (useUp){
+            ++up;
+        }
+        else {
+            --down;
+        }
+    }
+    return 0;
+}
+
+static void CASStatisticsFinish(CASStatistics& statistics)
+{
+    const size_t low = (statistics.count - 1) / 2, high = statistics.count / 2;
+    if (statistics.exact){
+        statistics.median = 0.5 * ((double)CASStatisticsValueAtRank(statistics, low) + CASStatisticsValueAtRank(statistics, high));
+    }
+    statistics.medianDeviation = 0.5 * ((double)CASStatisticsDeviationAtRank(statistics, low) + CASStatisticsDeviationAtRank(statistics, high));
+}
+
+bool CASStatisticsCompute(const uint16_t* pixels, size_t count, float scale, CASStatistics& statistics, CASStatisticsApply apply)
+{
+    statistics = CASStatistics();
+    if (!pixels || !count){
+        return false;
+    }
+    
+    std::vector<uint32_t> histogram(CAS_STATISTICS_BINS);
+    CASHistogramCompute(pixels, count, 1, 1, histogram.data(), apply);
+    return CASStatisticsFromHistogram(histogram.data(), scale, statistics);
+}
+
+bool CASStatisticsFromHistogram(const uint32_t* histogram, float scale, CASStatistics& statistics)
+{
+    statistics = CASStatistics();
+    
+    // the moments are exact in integers, there are few enough bins that this is nothing next to binning the frame
+    size_t count = 0;
+    uint64_t sum = 0, sumSquares = 0;
+    for (uint64_t b = 0; b < CAS_STATISTICS_BINS; ++b){
+        const uint64_t n = histogram[b];
+        count += n;
+        sum += n * b;
+        sumSquares += n * b * b;
+    }
+    if (!count){
+        return false;
+    }
+    
+    statistics.histogram.assign(histogram, histogram + CAS_STATISTICS_BINS);
+    statistics.count = count;
+    statistics.exact = true;
+    statistics.histogramLower = 0;
+    statistics.histogramBinWidth = scale;
+    
+    size_t minimum = 0, maximum = CAS_STATISTICS_BINS - 1;
+    while (!histogram[minimum]){
+        ++minimum;
+    }
+    while (!histogram[maximum]){
+        --maximum;
+    }
+    statistics.minimum = minimum * scale;
+    statistics.maximum = maximum * scale;
+    
+    const double mean = (double)sum / count;
+    const double variance = std::max(0.0, (double)sumSquares / count - mean * mean);
+    statistics.mean = mean * scale;
+    statistics.standardDeviation = sqrt(variance) * scale;
+    
+    CASStatisticsFinish(statistics);
+    
+    return true;
+}
+
+// the bin index is worked out the same way for binning and gathering so the two always agree
+struct CASStatisticsFloatBinner {
+    float lower, scale;
+    inline size_t bin(float v) const {
+        return std::min<size_t>(CAS_STATISTICS_BINS - 1, (size_t)((v - lower) * scale));
+    }
+};
+
+// where the float pass gets sample i from, plain floats or the luminance of RGBA worked out as it goes
+struct CASStatisticsFloatSamples {
+    static inline float sample(const float* pixels, size_t i) {
+        return pixels[i];
+    }
+};
+
+struct CASStatisticsLuminanceSamples {
+    static inline float sample(const float* rgba, size_t i) {
+        const float* p = rgba + 4 * i;
+        return std::min(1.0f, (CAS_LUMINANCE_R * p[0]) + (CAS_LUMINANCE_G * p[1]) + (CAS_LUMINANCE_B * p[2]));
+    }
+};
+
+struct CASStatisticsFloatPass {
+    const float* pixels;
+    size_t count, chunkCount;
+    CASStatisticsMoments* moments;
+    uint32_t* histograms;
+    CASStatisticsFloatBinner binner;
+    size_t lowBin, highBin;
+    std::vector<float>* gathered;
+};
+
+template <typename Samples>
+static void CASStatisticsFloatMomentsChunk(void* context, size_t chunk)
+{
+    const CASStatisticsFloatPass& pass = *(const CASStatisticsFloatPass*)context;
+    size_t start, end;
+    CASStatisticsChunkRange(pass.count, pass.chunkCount, chunk, start, end);
+    
+    // sums are taken about the chunk's first sample to avoid cancellation when the variance is small next to the mean
+    size_t n = 0;
+    double shift = 0, sum = 0, sumSquares = 0;
+    float minimum = std::numeric_limits<float>::infinity(), maximum = -minimum;
+    const float* pixels = pass.pixels;
+    for (size_t i = start; i < end; ++i){
+        const float v = Samples::sample(pixels, i);
+        if (!isfinite(v)){
+            continue;
+        }
+        if (!n){
+            shift = v;
+        }
+        const double d = v - shift;
+        sum += d;
+        sumSquares += d * d;
+        minimum = std::min(minimum, v);
+        maximum = std::max(maximum, v);
+        ++n;
+    }
+    
+    CASStatisticsMoments& moments = pass.moments[chunk];
+    moments.count = n;
+    moments.mean = n ? shift + sum / n : 0;
+    moments.m2 = n ? std::max(0.0, sumSquares - sum * sum / n) : 0;
+    moments.minimum = minimum;
+    moments.maximum = maximum;
+}
+
+template <typename Samples>
+static void CASStatisticsFloatHistogramChunk(void* context, size_t chunk)
+{
+    const CASStatisticsFloatPass& pass = *(const CASStatisticsFloatPass*)context;
+    size_t start, end;
+    CASStatisticsChunkRange(pass.count, pass.chunkCount, chunk, start, end);
+    
+    const float* pixels = pass.pixels;
+    const CASStatisticsFloatBinner binner = pass.binner;
+    uint32_t* histogram = pass.histograms + chunk * CAS_STATISTICS_BINS;
+    for (size_t i = start; i < end; ++i){
+        const float v = Samples::sample(pixels, i);
+        if (isfinite(v)){
+            ++histogram[binner.bin(v)];
+        }
+    }
+}
+
+template <typename Samples>
+static void CASStatisticsFloatGatherChunk(void* context, size_t chunk)
+{
+    const CASStatisticsFloatPass& pass = *(const CASStatisticsFloatPass*)context;
+    size_t start, end;
+    CASStatisticsChunkRange(pass.count, pass.chunkCount, chunk, start, end);
+    
+    const float* pixels = pass.pixels;
+    const CASStatisticsFloatBinner binner = pass.binner;
+    const size_t lowBin = pass.lowBin, binSpan = pass.highBin - pass.lowBin;
+    std::vector<float> gathered;
+    for (size_t i = start; i < end; ++i){
+        const float v = Samples::sample(pixels, i);
+        if (isfinite(v)){
+            // one unsigned comparison so there's a single, rarely taken, branch
+            if (binner.bin(v) - lowBin <= binSpan){
+                gathered.push_back(v);
+            }
+        }
+    }
+    pass.gathered[chunk].swap(gathered);
+}
+
+template <typename Samples>
+static bool CASStatisticsComputeFloat(const float* pixels, size_t count, CASStatistics& statistics, CASStatisticsApply apply)
+{
+    statistics = CASStatistics();
+    if (!pixels || !count){
+        return false;
+    }
+    if (!apply){
+        apply = CASStatisticsApplyInOrder;
+    }
+    
+    const size_t chunkCount = CASStatisticsChunkCount(count);
+    std::vector<CASStatisticsMoments> moments(chunkCount);
+    CASStatisticsFloatPass pass = { pixels, count, chunkCount, moments.data(), NULL, { 0, 0 }, 0, 0, NULL };
+    apply(chunkCount, &pass, CASStatisticsFloatMomentsChunk<Samples>);
+    
+    CASStatisticsMoments total = moments[0];
+    for (size_t c = 1; c < chunkCount; ++c){
+        CASStatisticsMerge(total, moments[c]);
+    }
+    if (!total.count){
+        return false;
+    }
+    
+    statistics.count = total.count;
+    statistics.minimum = total.minimum;
+    statistics.maximum = total.maximum;
+    statistics.mean = total.mean;
+    statistics.standardDeviation = sqrt(total.m2 / total.count);
+    statistics.exact = false;
+    statistics.histogramLower = total.minimum;
+    statistics.histogramBinWidth = (total.maximum - total.minimum) / CAS_STATISTICS_BINS;
+    
+    std::vector<uint32_t> histograms(chunkCount * CAS_STATISTICS_BINS);
+    pass.histograms = histograms.data();
+    pass.binner.lower = total.minimum;
+    pass.binner.scale = (total.maximum > total.minimum) ? CAS_STATISTICS_BINS / (total.maximum - total.minimum) : 0;
+    apply(chunkCount, &pass, CASStatisticsFloatHistogramChunk<Samples>);
+    CASStatisticsMergeHistograms(histograms, chunkCount, statistics);
+    
+    // the histogram narrows the median down to a bin or two, gather the samples in them to get it exactly
+    const size_t low = (statistics.count - 1) / 2, high = statistics.count / 2;
+    size_t before, ignored;
+    pass.lowBin = CASStatisticsBinAtRank(statistics, low, before);
+    pass.highBin = CASStatisticsBinAtRank(statistics, high, ignored);
+    std::vector<std::vector<float> > gathered(chunkCount);
+    pass.gathered = gathered.data();
+    apply(chunkCount, &pass, CASStatisticsFloatGatherChunk<Samples>);
+    
+    std::vector<float> candidates;
+    for (size_t c = 0; c < chunkCount; ++c){
+        candidates.insert(candidates.end(), gathered[c].begin(), gathered[c].end());
+    }
+    std::vector<float>::iterator lowValue = candidates.begin() + (low - before);
+    std::nth_element(candidates.begin(), lowValue, candidates.end());
+    const float highValue = (high == low) ? *lowValue : *std::min_element(lowValue + 1, candidates.end());
+    statistics.median = 0.5 * ((double)*lowValue + highValue);
+    
+    CASStatisticsFinish(statistics);
+    
+    return true;
+}
+
+bool CASStatisticsCompute(const float* pixels, size_t count, CASStatistics& statistics, CASStatisticsApply apply)
+{
+    return CASStatisticsComputeFloat<CASStatisticsFloatSamples>(pixels, count, statistics, apply);
+}
+
+bool CASStatisticsComputeLuminance(const float* rgba, size_t count, CASStatistics& statistics, CASStatisticsApply apply)
+{
+    return CASStatisticsComputeFloat<CASStatisticsLuminanceSamples>(rgba, count, statistics, apply);
+}
+
+float CASStatisticsPercentile(const CASStatistics& statistics, double fraction)
+{
+    if (!statistics.count){
+        return 0;
+    }
+    const double rank = std::max(0.0, std::min(1.0, fraction)) * (statistics.count - 1);
+    const size_t low = (size_t)rank, high = std::min(low + 1, statistics.count - 1);
+    const float lowValue = CASStatisticsValueAtRank(statistics, low);
+    const float highValue = (high == low) ? lowValue : CASStatisticsValueAtRank(statistics, high);
+    return lowValue + (highValue - lowValue) * (rank - low);
+}
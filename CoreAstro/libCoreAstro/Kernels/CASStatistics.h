@@ -0,0 +1,72 @@
+//
+//  CASStatistics.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Exposure statistics in a single parallel pass. 16-bit samples are binned into an exact
+//  65536 bin histogram and everything else is worked out from that, so the median, MAD and
+//  any percentile come without sorting or copying the frame.
+
+#ifndef __CASStatistics_h__
+#define __CASStatistics_h__
+
+#include "CASHistogram.h"
+#include <vector>
+
+#define CAS_STATISTICS_BINS CAS_HISTOGRAM_BINS
+
+// pixels per chunk, each chunk has its own histogram so cap the number of them as well
+#define CAS_STATISTICS_CHUNK_PIXELS (1024*1024)
+#define CAS_STATISTICS_MAX_CHUNKS 16
+
+// as for histograms
+typedef CASHistogramApply CASStatisticsApply;
+
+struct CASStatistics {
+    size_t count;
+    float minimum, maximum;
+    double mean, standardDeviation;
+    float median;               // average of the middle two samples when the count is even
+    float medianDeviation;      // median absolute deviation from the median, unscaled
+    float histogramLower;       // bin i covers [lower + i * binWidth, lower + (i + 1) * binWidth)
+    float histogramBinWidth;
+    bool exact;                 // each bin holds exactly one sample value so percentiles are exact
+    std::vector<uint32_t> histogram;
+};
+
+// samples are scaled by scale as exposures scale them to 0-1. everything is exact and takes a single pass
+bool CASStatisticsCompute(const uint16_t* pixels, size_t count, float scale, CASStatistics& statistics, CASStatisticsApply apply = NULL);
+
+// the same from a histogram of 16-bit samples that's already been computed, without going back to the pixels
+bool CASStatisticsFromHistogram(const uint32_t* histogram, float scale, CASStatistics& statistics);
+
+// NaNs are ignored. one pass for the moments and range and one to bin into the range. the median is exact,
+// the median deviation and percentiles are to within a bin width, (maximum - minimum) / 65536
+bool CASStatisticsCompute(const float* pixels, size_t count, CASStatistics& statistics, CASStatisticsApply apply = NULL);
+
+// the same for the luminance of count RGBA pixels, worked out chunk by chunk rather than into a whole frame first
+bool CASStatisticsComputeLuminance(const float* rgba, size_t count, CASStatistics& statistics, CASStatisticsApply apply = NULL);
+
+// value below which fraction of the samples lie, interpolating between neighbouring ranks
+float CASStatisticsPercentile(const CASStatistics& statistics, double fraction);
+
+#endif
@@ -0,0 +1,111 @@
+//
+//  CASThumbnail.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASThumbnail.h"
+#include "CASDisplayStretch.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// sums the frame's pixels under each thumbnail pixel into 0-1 averages, the boxes take whole frame pixels
+// so they're uneven by a pixel when the sizes don't divide
+template <typename T>
+void CASThumbnailAverage(const CASPixels& frame, size_t channelCount, float scale, size_t width, size_t height, float* out)
+{
+    std::vector<size_t> columns(width + 1);
+    for (size_t x = 0; x <= width; ++x){
+        columns[x] = x * frame.width / width;
+    }
+    
+    std::vector<double> sums(width * channelCount);
+    for (size_t y = 0; y < height; ++y){
+        
+        const size_t top = y * frame.height / height;
+        const size_t bottom = std::max(top + 1, (y + 1) * frame.height / height);
+        std::fill(sums.begin(), sums.end(), 0.0);
+        for (size_t row = top; row < bottom; ++row){
+            const T* pixels = (const T*)frame.data + row * frame.stride * channelCount;
+            for (size_t x = 0; x < width; ++x){
+                const size_t right = std::max(columns[x] + 1, columns[x + 1]);
+                for (size_t i = columns[x]; i < right; ++i){
+                    for (size_t c = 0; c < channelCount; ++c){
+                        sums[x * channelCount + c] += pixels[i * channelCount + c];
+                    }
+                }
+            }
+        }
+        
+        float* o = out + y * width * channelCount;
+        for (size_t x = 0; x < width; ++x){
+            const size_t right = std::max(columns[x] + 1, columns[x + 1]);
+            const double count = (double)(bottom - top) * (right - columns[x]);
+            for (size_t c = 0; c < channelCount; ++c){
+                o[x * channelCount + c] = (float)(sums[x * channelCount + c] / count) * scale;
+            }
+        }
+    }
+}
+
+}
+
+bool CASThumbnailRender(const CASPixels& frame, size_t width, size_t height, uint8_t* out, size_t bytesPerRow)
+{
+    if (CASPixelsIsEmpty(frame) || !width || !height || !out){
+        return false;
+    }
+    
+    const size_t channelCount = (frame.format == kCASPixelFormatRGBAFloat) ? 4 : 1;
+    if (bytesPerRow < width * channelCount){
+        return false;
+    }
+    
+    std::vector<float> averages(width * height * channelCount);
+    switch (frame.format) {
+        case kCASPixelFormatUInt16:
+            CASThumbnailAverage<uint16_t>(frame, 1, 1.0f / CAS_PIXEL_UINT16_MAX, width, height, averages.data());
+            break;
+        case kCASPixelFormatFloat:
+            CASThumbnailAverage<float>(frame, 1, 1.0f, width, height, averages.data());
+            break;
+        case kCASPixelFormatRGBAFloat:
+            CASThumbnailAverage<float>(frame, 4, 1.0f, width, height, averages.data());
+            break;
+        default:
+            return false;
+    }
+    
+    // through the same table the display uses, linear over the full range
+    std::vector<uint8_t> table(CAS_DISPLAY_STRETCH_TABLE_SIZE);
+    CASDisplayStretchBuildTable(CASDisplayStretchMake(0, 1), CAS_PIXEL_UINT16_MAX, table.data());
+    return CASDisplayStretchApplyTable(averages.data(), width, height, channelCount, table.data(), out, bytesPerRow);
+}
+
+size_t CASThumbnailHeight(size_t frameWidth, size_t frameHeight, size_t width)
+{
+    if (!frameWidth){
+        return 0;
+    }
+    return std::max<size_t>(1, (frameHeight * width + frameWidth / 2) / frameWidth);
+}
@@ -0,0 +1,42 @@
+//
+//  CASThumbnail.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Thumbnails of frames for the library, each output pixel the average of the pixels under it and
+//  mapped linearly to 8-bit, small enough to run on a background queue without holding up capture.
+//  Best given the smallest pyramid level at least the size wanted rather than the whole frame.
+
+
+#ifndef __CASThumbnail_h__
+#define __CASThumbnail_h__
+
+#include "CASPixelView.h"
+
+// the width x height thumbnail of frame into rows bytesPerRow apart, one byte a pixel for mono frames and opaque
+// RGBA for colour ones. 0-1 floats, or 0-65535 16-bit samples, span the 8-bit range and anything outside is clamped
+bool CASThumbnailRender(const CASPixels& frame, size_t width, size_t height, uint8_t* out, size_t bytesPerRow);
+
+// the height of a thumbnail width wide keeping the frame's aspect ratio, at least 1
+size_t CASThumbnailHeight(size_t frameWidth, size_t frameHeight, size_t width);
+
+#endif
@@ -0,0 +1,55 @@
+//
+//  CASBackgroundBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Estimating the background mesh of a frame and subtracting it, against the Gaussian background subtraction.
+
+
+#include "CASTestSupport.h"
+#include "CASBackground.h"
+#include "CASGaussian.h"
+#include "CASParallel.h"
+
+CAS_BENCH(Background)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> shorts(ctx.pixelCount());
+    std::vector<float> floats(ctx.pixelCount()), out(ctx.pixelCount());
+    for (size_t i = 0; i < shorts.size(); ++i){
+        shorts[i] = 2000 + (random.next() % 200);
+        floats[i] = shorts[i] / 65535.0f;
+    }
+    
+    CASBackground background;
+    ctx.measure("estimate 16-bit", shorts.size() * sizeof(uint16_t), [&]{
+        CASBackgroundEstimate(CASPixelsMake(kCASPixelFormatUInt16, shorts.data(), ctx.width, ctx.height, ctx.width), CASBackgroundDefaultParameters(), background, CASParallelApply);
+    });
+    
+    ctx.measure("subtract", 2.0 * floats.size() * sizeof(float), [&]{
+        CASBackgroundSubtract(background, floats.data(), out.data(), ctx.width, 0, CASParallelApply);
+    });
+    
+    ctx.measure("gaussian sigma 64", 2.0 * floats.size() * sizeof(float), [&]{
+        CASGaussianSubtractBackground(floats.data(), out.data(), ctx.width, ctx.height, 64, 0, CASParallelApply);
+    });
+}
@@ -0,0 +1,144 @@
+//
+//  CASBackgroundTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+#include "CASTestSupport.h"
+#include "CASBackground.h"
+#include "CASParallel.h"
+#include <algorithm>
+
+// a sloping sky with uniform noise of rms 0.01 / sqrt(3) and a scattering of bright stars
+static std::vector<float> CASBackgroundTestFrame(size_t width, size_t height)
+{
+    CASTestRandom random;
+    std::vector<float> frame(width * height);
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            frame[x + y * width] = 0.1f + 0.00005f * x + 0.00003f * y + (random.unit() - 0.5f) * 0.02f;
+        }
+    }
+    for (int star = 0; star < 40; ++star){
+        const size_t sx = 2 + random.next() % (width - 4), sy = 2 + random.next() % (height - 4);
+        for (size_t y = sy - 2; y <= sy + 2; ++y){
+            for (size_t x = sx - 2; x <= sx + 2; ++x){
+                frame[x + y * width] = 1.0f;
+            }
+        }
+    }
+    return frame;
+}
+
+CAS_TEST(BackgroundGradient)
+{
+    const size_t width = 320, height = 256;
+    const std::vector<float> frame = CASBackgroundTestFrame(width, height);
+    
+    CASBackground background;
+    CAS_CHECK(CASBackgroundEstimate(CASPixelsMake(kCASPixelFormatFloat, frame.data(), width, height, width), CASBackgroundDefaultParameters(), background));
+    CAS_CHECK(background.meshWidth == 5 && background.meshHeight == 4);
+    
+    // the splines follow a straight slope exactly between the outer cell centres
+    for (float y = 32; y <= 224; y += 24){
+        for (float x = 32; x <= 288; x += 32){
+            CAS_CHECK(fabs(CASBackgroundLevelAt(background, x, y) - (0.1f + 0.00005f * x + 0.00003f * y)) < 0.001f); // a sixth of the noise
+            CAS_CHECK_CLOSE(CASBackgroundRMSAt(background, x, y), 0.01f / sqrtf(3), 0.1f);
+        }
+    }
+    CAS_CHECK_CLOSE(background.globalRMS, 0.01f / sqrtf(3), 0.1f);
+    
+    // rows agree with single points
+    std::vector<float> level(width), rms(width);
+    CASBackgroundRow(background, 100, level.data(), rms.data());
+    for (size_t x = 0; x < width; x += 7){
+        CAS_CHECK_CLOSE(level[x], CASBackgroundLevelAt(background, x, 100), 1e-5);
+        CAS_CHECK_CLOSE(rms[x], CASBackgroundRMSAt(background, x, 100), 1e-5);
+    }
+}
+
+CAS_TEST(BackgroundSubtract)
+{
+    const size_t width = 300, height = 200;
+    const std::vector<float> frame = CASBackgroundTestFrame(width, height);
+    
+    CASBackground background;
+    CAS_CHECK(CASBackgroundEstimate(CASPixelsMake(kCASPixelFormatFloat, frame.data(), width, height, width), CASBackgroundDefaultParameters(), background, CASParallelApply));
+    
+    std::vector<float> out(frame);
+    CAS_CHECK(CASBackgroundSubtract(background, out.data(), out.data(), width, 0.2f, CASParallelApply));
+    
+    // what's left is flat sky at the pedestal from one corner to the other
+    const size_t corners[][2] = { { 0, 0 }, { width - 40, 0 }, { 0, height - 40 }, { width - 40, height - 40 } };
+    for (size_t c = 0; c < 4; ++c){
+        std::vector<float> samples;
+        for (size_t y = corners[c][1]; y < corners[c][1] + 40; ++y){
+            for (size_t x = corners[c][0]; x < corners[c][0] + 40; ++x){
+                if (frame[x + y * width] < 1.0f){
+                    samples.push_back(out[x + y * width]);
+                }
+            }
+        }
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        CAS_CHECK(fabs(samples[samples.size() / 2] - 0.2f) < 0.001f);
+    }
+    
+    // 16-bit samples come out the same as floats of them
+    std::vector<uint16_t> shorts(frame.size());
+    std::vector<float> quantised(frame.size());
+    for (size_t i = 0; i < frame.size(); ++i){
+        shorts[i] = (uint16_t)(frame[i] * CAS_PIXEL_UINT16_MAX + 0.5f);
+        quantised[i] = shorts[i] / (float)CAS_PIXEL_UINT16_MAX;
+    }
+    CASBackground a, b;
+    CAS_CHECK(CASBackgroundEstimate(CASPixelsMake(kCASPixelFormatUInt16, shorts.data(), width, height, width), CASBackgroundDefaultParameters(), a));
+    CAS_CHECK(CASBackgroundEstimate(CASPixelsMake(kCASPixelFormatFloat, quantised.data(), width, height, width), CASBackgroundDefaultParameters(), b));
+    for (size_t i = 0; i < a.level.size(); ++i){
+        CAS_CHECK_CLOSE(a.level[i], b.level[i], 1e-5);
+    }
+}
+
+CAS_TEST(BackgroundCrowdedCell)
+{
+    // one cell entirely covered by a galaxy takes its level from the sky around it rather than the galaxy
+    const size_t width = 192, height = 192;
+    std::vector<float> frame(width * height);
+    CASTestRandom random;
+    for (size_t i = 0; i < frame.size(); ++i){
+        frame[i] = 0.05f + random.unit() * 0.01f;
+    }
+    for (size_t y = 64; y < 128; ++y){
+        for (size_t x = 64; x < 128; ++x){
+            frame[x + y * width] = 0.5f + random.unit() * 0.3f;
+        }
+    }
+    
+    CASBackgroundParameters parameters = CASBackgroundDefaultParameters();
+    parameters.filterSize = 1;
+    CASBackground background;
+    CAS_CHECK(CASBackgroundEstimate(CASPixelsMake(kCASPixelFormatFloat, frame.data(), width, height, width), parameters, background));
+    CAS_CHECK(background.level[4] > 0.3f); // without the filter the galaxy's cell is its own level
+    
+    CAS_CHECK(CASBackgroundEstimate(CASPixelsMake(kCASPixelFormatFloat, frame.data(), width, height, width), CASBackgroundDefaultParameters(), background));
+    CAS_CHECK(fabs(background.level[4] - 0.055f) < 0.002f);
+    CAS_CHECK(fabs(background.globalLevel - 0.055f) < 0.002f);
+    
+    CAS_CHECK(!CASBackgroundEstimate(CASPixelsMake(kCASPixelFormatRGBAFloat, frame.data(), 48, 48, 48), CASBackgroundDefaultParameters(), background));
+}
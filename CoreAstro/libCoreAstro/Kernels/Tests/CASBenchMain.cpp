@@ -0,0 +1,95 @@
+//
+//  CASBenchMain.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Runs the registered benchmarks over a range of frame sizes.
+//
+//  usage: CASKernelsBench [-s megapixels,...] [-i iterations] [name-filter]
+//
+//  The default sizes run from a 1 MP guide camera up to a 60 MP full frame sensor.
+
+#include "CASTestSupport.h"
+#include <stdlib.h>
+#include <string.h>
+
+static std::vector<double> CASParseSizes(const char* arg)
+{
+    std::vector<double> sizes;
+    const char* p = arg;
+    while (*p){
+        char* end = NULL;
+        const double mp = strtod(p, &end);
+        if (end == p){
+            break;
+        }
+        if (mp > 0){
+            sizes.push_back(mp);
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return sizes;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<double> sizes = CASParseSizes("1,4,16,36,60");
+    int iterations = 5;
+    const char* filter = NULL;
+    
+    for (int i = 1; i < argc; ++i){
+        if (!strcmp(argv[i], "-s") && i + 1 < argc){
+            sizes = CASParseSizes(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc){
+            iterations = atoi(argv[++i]);
+        }
+        else {
+            filter = argv[i];
+        }
+    }
+    if (iterations < 1){
+        iterations = 1;
+    }
+    
+    const std::vector<CASBench>& benches = CASBenchRegistry();
+    for (size_t s = 0; s < sizes.size(); ++s){
+        
+        // 3:2 frames, the common sensor aspect ratio
+        CASBenchContext ctx;
+        ctx.megapixels = sizes[s];
+        ctx.width = (size_t)(sqrt(sizes[s] * 1e6 * 1.5) + 0.5);
+        ctx.height = (size_t)(sizes[s] * 1e6 / ctx.width + 0.5);
+        ctx.iterations = iterations;
+        
+        printf("%zux%zu\n", ctx.width, ctx.height);
+        for (size_t i = 0; i < benches.size(); ++i){
+            if (filter && !strstr(benches[i].name, filter)){
+                continue;
+            }
+            printf(" %s\n", benches[i].name);
+            benches[i].fn(ctx);
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,129 @@
+//
+//  CASCLAHETests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+#include "CASTestSupport.h"
+#include "CASCLAHE.h"
+#include "CASParallel.h"
+#include <algorithm>
+
+CAS_TEST(CLAHEUniformIsUnchanged)
+{
+    // evenly spread samples already have a straight cumulative histogram so there's nothing to equalise
+    const size_t width = 256, height = 192;
+    CASTestRandom random;
+    std::vector<float> frame(width * height), out(width * height);
+    CASTestFill(frame, random);
+    
+    CASCLAHEParameters parameters = CASCLAHEDefaultParameters();
+    parameters.clipLimit = 0;
+    CAS_CHECK(CASCLAHE(CASPixelsMake(kCASPixelFormatFloat, frame.data(), width, height, width), parameters, out.data(), width));
+    
+    float worst = 0;
+    for (size_t i = 0; i < frame.size(); ++i){
+        worst = std::max(worst, fabsf(out[i] - frame[i]));
+    }
+    CAS_CHECK(worst < 0.05f);
+}
+
+CAS_TEST(CLAHEStretchesAndClips)
+{
+    // faint sky in a narrow band stretches across the whole range without clipping and hardly at all when every bin is
+    // clipped to its mean count
+    const size_t width = 512, height = 384;
+    CASTestRandom random;
+    std::vector<uint16_t> frame(width * height);
+    for (size_t i = 0; i < frame.size(); ++i){
+        frame[i] = 6000 + random.next() % 800;
+    }
+    const CASPixels pixels = CASPixelsMake(kCASPixelFormatUInt16, frame.data(), width, height, width);
+    
+    std::vector<float> out(width * height);
+    CASCLAHEParameters parameters = CASCLAHEDefaultParameters();
+    parameters.clipLimit = 0;
+    CAS_CHECK(CASCLAHE(pixels, parameters, out.data(), width));
+    CAS_CHECK(*std::min_element(out.begin(), out.end()) < 0.05f);
+    CAS_CHECK(*std::max_element(out.begin(), out.end()) > 0.95f);
+    
+    parameters.clipLimit = 1;
+    CAS_CHECK(CASCLAHE(pixels, parameters, out.data(), width));
+    CAS_CHECK(*std::max_element(out.begin(), out.end()) - *std::min_element(out.begin(), out.end()) < 0.05f);
+    
+    // the default limit lands in between
+    CAS_CHECK(CASCLAHE(pixels, CASCLAHEDefaultParameters(), out.data(), width));
+    const float spread = *std::max_element(out.begin(), out.end()) - *std::min_element(out.begin(), out.end());
+    CAS_CHECK(spread > 0.05f && spread < 0.95f);
+}
+
+CAS_TEST(CLAHESmoothAcrossTiles)
+{
+    // a gentle gradient with a dark half and a bright half. each pixel blends the neighbouring tiles so the output
+    // has no steps at the tile edges and still rises along the gradient
+    const size_t width = 333, height = 211;
+    std::vector<float> frame(width * height), out(width * height);
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            frame[x + y * width] = (x < width / 2 ? 0.1f : 0.6f) + 0.0003f * x + 0.0002f * y;
+        }
+    }
+    CAS_CHECK(CASCLAHE(CASPixelsMake(kCASPixelFormatFloat, frame.data(), width, height, width), CASCLAHEDefaultParameters(), out.data(), width));
+    
+    float step = 0;
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 1; x < width; ++x){
+            if (x != width / 2){
+                step = std::max(step, fabsf(out[x + y * width] - out[x - 1 + y * width]));
+            }
+        }
+    }
+    CAS_CHECK(step < 0.02f);
+    CAS_CHECK(out[10 + 100 * width] < out[150 + 100 * width]);
+    CAS_CHECK(out[200 + 100 * width] < out[320 + 100 * width]);
+}
+
+CAS_TEST(CLAHEFormatsAndParallel)
+{
+    // 16-bit and the same samples as floats map the same, in order or in parallel, into a strided output
+    const size_t width = 301, height = 157, outStride = 320;
+    CASTestRandom random;
+    std::vector<uint16_t> shorts(width * height);
+    std::vector<float> floats(width * height);
+    for (size_t i = 0; i < shorts.size(); ++i){
+        shorts[i] = 1000 + random.next() % 20000;
+        floats[i] = shorts[i] / (float)CAS_PIXEL_UINT16_MAX;
+    }
+    
+    std::vector<float> a(outStride * height), b(outStride * height, -1);
+    CAS_CHECK(CASCLAHE(CASPixelsMake(kCASPixelFormatUInt16, shorts.data(), width, height, width), CASCLAHEDefaultParameters(), a.data(), outStride));
+    CAS_CHECK(CASCLAHE(CASPixelsMake(kCASPixelFormatFloat, floats.data(), width, height, width), CASCLAHEDefaultParameters(), b.data(), outStride, CASParallelApply));
+    
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            CAS_CHECK(fabsf(a[x + y * outStride] - b[x + y * outStride]) < 1e-4f);
+        }
+        CAS_CHECK(b[width + y * outStride] == -1);
+    }
+    
+    std::vector<float> rgba(width * height * 4);
+    CAS_CHECK(!CASCLAHE(CASPixelsMake(kCASPixelFormatRGBAFloat, rgba.data(), width, height, width), CASCLAHEDefaultParameters(), a.data(), outStride));
+    CAS_CHECK(!CASCLAHE(CASPixelsMake(kCASPixelFormatFloat, floats.data(), width, height, width), CASCLAHEDefaultParameters(), a.data(), width - 1));
+}
@@ -0,0 +1,87 @@
+//
+//  CASCalibrationBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Compares the fused calibration with the separate subtract, flat mean and divide passes it replaces,
+//  and calibrating 16-bit lights tile by tile with expanding them to floats first.
+
+#include "CASTestSupport.h"
+#include "CASCalibration.h"
+#include <algorithm>
+#include <string.h>
+
+CAS_BENCH(Calibration)
+{
+    const size_t count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<float> light(count), bias(count), dark(count), flat(count), out(count);
+    CASTestFill(light, random);
+    CASTestFill(bias, random);
+    CASTestFill(dark, random);
+    CASTestFill(flat, random);
+    
+    const CASKernelTable& kernels = CASKernels();
+    
+    ctx.measure("separate passes", 9.0 * count * sizeof(float), [&]{
+        std::vector<float> working(light);
+        for (size_t i = 0; i < count; ++i){
+            working[i] -= dark[i];
+        }
+        std::vector<float> flatWorking(flat);
+        for (size_t i = 0; i < count; ++i){
+            flatWorking[i] -= bias[i];
+        }
+        const float mean = kernels.sum(flatWorking.data(), count) / count;
+        kernels.divideFlat(working.data(), flatWorking.data(), mean, count);
+        memcpy(out.data(), working.data(), count * sizeof(float));
+    });
+    
+    const CASCalibrationMasters masters = { bias.data(), dark.data(), flat.data(), count };
+    const CASCalibrationStatistics statistics = CASCalibrationStatisticsForMasters(masters);
+    ctx.measure("fused", 5.0 * count * sizeof(float), [&]{
+        for (size_t t = 0; t < CASCalibrationTileCount(count); ++t){
+            const size_t start = t * CAS_CALIBRATION_TILE_PIXELS;
+            CASCalibrateRange(light.data(), masters, statistics, out.data(), start, std::min<size_t>(CAS_CALIBRATION_TILE_PIXELS, count - start));
+        }
+    });
+    
+    // a 16-bit light either expanded to floats up front as the exposure used to, or widened a tile at a time
+    std::vector<uint16_t> samples(count);
+    for (size_t i = 0; i < count; ++i){
+        samples[i] = random.sample();
+    }
+    ctx.measure("16-bit widened first", (sizeof(uint16_t) + 6.0 * sizeof(float)) * count, [&]{
+        std::vector<float> widened(count);
+        kernels.widenU16(samples.data(), 65535, widened.data(), count);
+        for (size_t t = 0; t < CASCalibrationTileCount(count); ++t){
+            const size_t start = t * CAS_CALIBRATION_TILE_PIXELS;
+            CASCalibrateRange(widened.data(), masters, statistics, out.data(), start, std::min<size_t>(CAS_CALIBRATION_TILE_PIXELS, count - start));
+        }
+    });
+    ctx.measure("16-bit per tile", (sizeof(uint16_t) + 4.0 * sizeof(float)) * count, [&]{
+        for (size_t t = 0; t < CASCalibrationTileCount(count); ++t){
+            const size_t start = t * CAS_CALIBRATION_TILE_PIXELS;
+            CASCalibrateRange(samples.data(), masters, statistics, out.data(), start, std::min<size_t>(CAS_CALIBRATION_TILE_PIXELS, count - start));
+        }
+    });
+}
@@ -0,0 +1,156 @@
+//
+//  CASCalibrationTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASCalibration.h"
+#include <algorithm>
+
+static const size_t kCASCalibrationTestLengths[] = { 1, 3, 8, 13, 1024, 1029 };
+
+CAS_TEST(KernelsCalibrate)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(kCASCalibrationTestLengths)/sizeof(kCASCalibrationTestLengths[0]); ++l){
+        const size_t count = kCASCalibrationTestLengths[l];
+        std::vector<float> light(count), offset(count), flat(count), flatOffset(count);
+        CASTestFill(light, random);
+        CASTestFill(offset, random);
+        CASTestFill(flat, random);
+        CASTestFill(flatOffset, random);
+        flat[0] = flatOffset[0];
+        for (int mask = 0; mask < 8; ++mask){
+            const float* o = (mask & 1) ? offset.data() : NULL;
+            const float* f = (mask & 2) ? flat.data() : NULL;
+            const float* fo = (mask & 4) ? flatOffset.data() : NULL;
+            std::vector<float> expected(count);
+            scalar->calibrate(light.data(), o, f, fo, 0.5f, expected.data(), count);
+            for (size_t i = 0; i < count; ++i){
+                float v = light[i] - (o ? o[i] : 0);
+                if (f){
+                    const float d = f[i] - (fo ? fo[i] : 0);
+                    if (d != 0){
+                        v = v * 0.5f / d;
+                    }
+                }
+                CAS_CHECK_CLOSE(expected[i], v, 1e-6);
+            }
+            for (int isa = kCASKernelISAScalar + 1; isa < kCASKernelISACount; ++isa){
+                const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+                if (table){
+                    std::vector<float> actual(count);
+                    table->calibrate(light.data(), o, f, fo, 0.5f, actual.data(), count);
+                    for (size_t i = 0; i < count; ++i){
+                        CAS_CHECK_CLOSE(actual[i], expected[i], 1e-6);
+                    }
+                }
+            }
+        }
+    }
+}
+
+CAS_TEST(CalibrationMatchesSeparatePasses)
+{
+    const size_t count = 3 * CAS_CALIBRATION_TILE_PIXELS + 17;
+    CASTestRandom random;
+    std::vector<float> light(count), bias(count), dark(count), flat(count);
+    CASTestFill(light, random);
+    CASTestFill(bias, random);
+    CASTestFill(dark, random);
+    CASTestFill(flat, random);
+    for (size_t i = 0; i < count; ++i){
+        bias[i] *= 0.1f;
+        dark[i] = bias[i] + dark[i] * 0.05f;
+        flat[i] = bias[i] + 0.4f + flat[i] * 0.2f;
+    }
+    
+    for (int mask = 0; mask < 8; ++mask){
+        
+        CASCalibrationMasters masters = { (mask & 1) ? bias.data() : NULL, (mask & 2) ? dark.data() : NULL, (mask & 4) ? flat.data() : NULL, count };
+        
+        // the frame as the tiles would do it, summing the per-tile flat totals
+        CASCalibrationStatistics statistics = { 0 };
+        for (size_t t = 0; t < CASCalibrationTileCount(count); ++t){
+            const size_t start = t * CAS_CALIBRATION_TILE_PIXELS;
+            statistics.flatMean += CASCalibrationFlatTotal(masters, start, std::min<size_t>(CAS_CALIBRATION_TILE_PIXELS, count - start));
+        }
+        statistics.flatMean /= count;
+        CAS_CHECK_CLOSE(statistics.flatMean, CASCalibrationStatisticsForMasters(masters).flatMean, 1e-9);
+        
+        std::vector<float> actual(count);
+        for (size_t t = 0; t < CASCalibrationTileCount(count); ++t){
+            const size_t start = t * CAS_CALIBRATION_TILE_PIXELS;
+            CASCalibrateRange(light.data(), masters, statistics, actual.data(), start, std::min<size_t>(CAS_CALIBRATION_TILE_PIXELS, count - start));
+        }
+        
+        // light - (dark or bias), flat - (bias or dark), then normalise and divide
+        const float* lightOffset = masters.dark ? masters.dark : masters.bias;
+        const float* flatOffset = masters.bias ? masters.bias : masters.dark;
+        double flatTotal = 0;
+        std::vector<double> flatCorrected(count);
+        if (masters.flat){
+            for (size_t i = 0; i < count; ++i){
+                flatCorrected[i] = (double)flat[i] - (flatOffset ? flatOffset[i] : 0);
+                flatTotal += flatCorrected[i];
+            }
+        }
+        const double flatMean = flatTotal / count;
+        for (size_t i = 0; i < count; ++i){
+            double v = (double)light[i] - (lightOffset ? lightOffset[i] : 0);
+            if (masters.flat){
+                v /= flatCorrected[i] / flatMean;
+            }
+            CAS_CHECK_CLOSE(actual[i], v, 1e-5);
+        }
+    }
+}
+
+CAS_TEST(CalibrationFromUInt16MatchesFloat)
+{
+    const size_t count = 2 * CAS_CALIBRATION_TILE_PIXELS + 5;
+    CASTestRandom random;
+    std::vector<uint16_t> samples(count);
+    std::vector<float> light(count), bias(count), flat(count);
+    for (size_t i = 0; i < count; ++i){
+        samples[i] = random.sample();
+        light[i] = samples[i] / 65535.0f;
+    }
+    CASTestFill(bias, random);
+    CASTestFill(flat, random);
+    for (size_t i = 0; i < count; ++i){
+        bias[i] *= 0.1f;
+        flat[i] = bias[i] + 0.4f + flat[i] * 0.2f;
+    }
+    
+    const CASCalibrationMasters masters = { bias.data(), NULL, flat.data(), count };
+    const CASCalibrationStatistics statistics = CASCalibrationStatisticsForMasters(masters);
+    std::vector<float> expected(count), actual(count);
+    for (size_t t = 0; t < CASCalibrationTileCount(count); ++t){
+        const size_t start = t * CAS_CALIBRATION_TILE_PIXELS;
+        const size_t tileCount = std::min<size_t>(CAS_CALIBRATION_TILE_PIXELS, count - start);
+        CASCalibrateRange(light.data(), masters, statistics, expected.data(), start, tileCount);
+        CASCalibrateRange(samples.data(), masters, statistics, actual.data(), start, tileCount);
+    }
+    CAS_CHECK(actual == expected);
+}
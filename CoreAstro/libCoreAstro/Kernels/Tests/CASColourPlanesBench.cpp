@@ -0,0 +1,59 @@
+//
+//  CASColourPlanesBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Colour frames to and from compact planes, against copying the RGBA floats they replace.
+
+
+#include "CASTestSupport.h"
+#include "CASColourPlanes.h"
+#include <algorithm>
+
+CAS_BENCH(ColourPlanes)
+{
+    const size_t count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<float> rgba(count * 4), copy(count * 4);
+    CASTestFill(rgba, random);
+    std::vector<uint16_t> planes(count * 3);
+    
+    ctx.measure("copy RGBA", count * 32, [&]{
+        std::copy(rgba.begin(), rgba.end(), copy.begin());
+    });
+    
+    ctx.measure("RGBA to 16-bit planes", count * 22, [&]{
+        CASColourPlanesFromRGBA(rgba.data(), count, kCASColourPlanesUInt16, planes.data());
+    });
+    
+    ctx.measure("16-bit planes to RGBA", count * 22, [&]{
+        CASColourPlanesToRGBA(planes.data(), count, kCASColourPlanesUInt16, copy.data());
+    });
+    
+    ctx.measure("RGBA to half planes", count * 22, [&]{
+        CASColourPlanesFromRGBA(rgba.data(), count, kCASColourPlanesHalf, planes.data());
+    });
+    
+    ctx.measure("half planes to RGBA", count * 22, [&]{
+        CASColourPlanesToRGBA(planes.data(), count, kCASColourPlanesHalf, copy.data());
+    });
+}
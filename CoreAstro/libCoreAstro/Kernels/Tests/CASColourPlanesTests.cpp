@@ -0,0 +1,115 @@
+//
+//  CASColourPlanesTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#include "CASTestSupport.h"
+#include "CASColourPlanes.h"
+#include <math.h>
+
+CAS_TEST(ColourPlanesHalf)
+{
+    CAS_CHECK(CASHalfFromFloat(0) == 0x0000);
+    CAS_CHECK(CASHalfFromFloat(-0.0f) == 0x8000);
+    CAS_CHECK(CASHalfFromFloat(1) == 0x3c00);
+    CAS_CHECK(CASHalfFromFloat(0.5f) == 0x3800);
+    CAS_CHECK(CASHalfFromFloat(-2) == 0xc000);
+    CAS_CHECK(CASHalfFromFloat(65504) == 0x7bff);
+    CAS_CHECK(CASHalfFromFloat(65520) == 0x7c00);
+    CAS_CHECK(CASHalfFromFloat(ldexpf(1, -24)) == 0x0001);
+    CAS_CHECK(CASHalfFromFloat(ldexpf(1, -26)) == 0x0000);
+    CAS_CHECK(CASHalfFromFloat(INFINITY) == 0x7c00);
+    CAS_CHECK((CASHalfFromFloat(NAN) & 0x7c00) == 0x7c00 && (CASHalfFromFloat(NAN) & 0x3ff));
+    
+    // ties go to the even mantissa, either side of them to the nearest
+    CAS_CHECK(CASHalfFromFloat(1 + ldexpf(1, -11)) == 0x3c00);
+    CAS_CHECK(CASHalfFromFloat(1 + 3 * ldexpf(1, -11)) == 0x3c02);
+    CAS_CHECK(CASHalfFromFloat(1 + ldexpf(1, -11) + ldexpf(1, -20)) == 0x3c01);
+    
+    // every half that isn't a NaN comes back exactly
+    for (uint32_t h = 0; h < 0x10000; ++h){
+        if ((h & 0x7c00) == 0x7c00 && (h & 0x3ff)){
+            CAS_CHECK(isnan(CASFloatFromHalf((uint16_t)h)));
+            continue;
+        }
+        CAS_CHECK(CASHalfFromFloat(CASFloatFromHalf((uint16_t)h)) == h);
+    }
+    CAS_CHECK(CASFloatFromHalf(0x0001) == ldexpf(1, -24));
+    CAS_CHECK(CASFloatFromHalf(0x7bff) == 65504);
+}
+
+CAS_TEST(ColourPlanesRoundTrip)
+{
+    // 16-bit planes come back to within half a step, halves to within their precision, both with an alpha of 1. the
+    // frame's a few chunks long so it's converted in parallel
+    const size_t count = 2 * CAS_COLOUR_PLANES_CHUNK_PIXELS + 1234;
+    CASTestRandom random;
+    std::vector<float> rgba(count * 4);
+    CASTestFill(rgba, random);
+    
+    const CASColourPlanesFormat formats[] = { kCASColourPlanesUInt16, kCASColourPlanesHalf };
+    for (size_t f = 0; f < 2; ++f){
+        std::vector<uint16_t> planes(CASColourPlanesLength(formats[f], count) / sizeof(uint16_t));
+        std::vector<float> back(count * 4);
+        CAS_CHECK(CASColourPlanesFromRGBA(rgba.data(), count, formats[f], planes.data()));
+        CAS_CHECK(CASColourPlanesToRGBA(planes.data(), count, formats[f], back.data()));
+        
+        const double tolerance = (formats[f] == kCASColourPlanesUInt16) ? 0.5 / 65535 : ldexp(1, -12);
+        for (size_t i = 0; i < count; ++i){
+            for (size_t c = 0; c < 3; ++c){
+                CAS_CHECK_CLOSE(back[i * 4 + c], rgba[i * 4 + c], tolerance + 1e-7);
+            }
+            CAS_CHECK(back[i * 4 + 3] == 1);
+        }
+        
+        // a plane at a time matches the interleaved conversion
+        for (size_t c = 0; c < 3; ++c){
+            std::vector<float> plane(count);
+            CAS_CHECK(CASColourPlaneToFloat(planes.data(), count, formats[f], c, plane.data()));
+            for (size_t i = 0; i < count; ++i){
+                CAS_CHECK(plane[i] == back[i * 4 + c]);
+            }
+            std::vector<uint16_t> replanes(planes.size());
+            CAS_CHECK(CASColourPlaneFromFloat(plane.data(), count, formats[f], c, replanes.data()));
+            CAS_CHECK(std::equal(replanes.begin() + c * count, replanes.begin() + (c + 1) * count, planes.begin() + c * count));
+        }
+        
+        // and so does a strip from the middle, which mustn't run past the end
+        const size_t start = CAS_COLOUR_PLANES_CHUNK_PIXELS - 17, length = CAS_COLOUR_PLANES_CHUNK_PIXELS + 100;
+        std::vector<float> strip(length * 4);
+        CAS_CHECK(CASColourPlanesRangeToRGBA(planes.data(), count, formats[f], start, length, strip.data()));
+        CAS_CHECK(std::equal(strip.begin(), strip.end(), back.begin() + start * 4));
+        CAS_CHECK(!CASColourPlanesRangeToRGBA(planes.data(), count, formats[f], count - 10, 11, strip.data()));
+    }
+    
+    // 16-bit clamps, halves keep what they can
+    const float outside[4] = { -0.5f, 2, 0.25f, 1 };
+    uint16_t planes[3];
+    float back[4];
+    CAS_CHECK(CASColourPlanesFromRGBA(outside, 1, kCASColourPlanesUInt16, planes));
+    CAS_CHECK(planes[0] == 0 && planes[1] == 65535);
+    CAS_CHECK(CASColourPlanesFromRGBA(outside, 1, kCASColourPlanesHalf, planes));
+    CAS_CHECK(CASColourPlanesToRGBA(planes, 1, kCASColourPlanesHalf, back));
+    CAS_CHECK(back[0] == -0.5f && back[1] == 2 && back[2] == 0.25f);
+    CAS_CHECK(!CASColourPlaneToFloat(planes, 1, kCASColourPlanesHalf, 3, back));
+}
@@ -0,0 +1,161 @@
+//
+//  CASDebayerBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Bilinear debayering of a full frame to RGBA, against the per pixel clipped loop the preview used to run.
+
+
+#include "CASTestSupport.h"
+#include "CASDebayer.h"
+#include "CASParallel.h"
+#include <algorithm>
+
+// RGGB the way CASImageDebayer did it, every read clamped to the frame and the mode tested for each 2x2 cell. the mode
+// was a property read each time so it's volatile here to stop it being hoisted out of the loop
+static void CASDebayerBenchClipped(const float* in, size_t width, size_t height, const volatile int& mode, float* out)
+{
+    #define clip(v,lim) ((ptrdiff_t)(v) < 0 ? 0 : (v) >= (lim) ? (lim) - 1 : (v))
+    #define source(x,y) in[clip(x,width) + clip(y,height) * width]
+    #define destination(x,y) (out + (clip(x,width) + clip(y,height) * width) * 4)
+    for (size_t y = 0; y < height; y += 2){
+        for (size_t x = 0; x < width; x += 2){
+            for (int m = 0; m < 4; ++m){
+                if (mode == m){
+                    float* o = destination(x,y);
+                    o[0] = source(x,y);
+                    o[1] = (source(x-1,y) + source(x,y-1) + source(x,y+1) + source(x+1,y))/4;
+                    o[2] = (source(x-1,y-1) + source(x+1,y-1) + source(x+1,y+1) + source(x-1,y+1))/4;
+                    o[3] = 1;
+                    o = destination(x+1,y+1);
+                    o[0] = (source(x,y) + source(x+2,y) + source(x,y+2) + source(x+2,y+2))/4;
+                    o[1] = (source(x,y+1) + source(x+1,y) + source(x+1,y+2) + source(x+2,y+1))/4;
+                    o[2] = source(x+1,y+1);
+                    o[3] = 1;
+                    o = destination(x+1,y);
+                    o[0] = (source(x,y) + source(x+2,y))/2;
+                    o[1] = source(x+1,y);
+                    o[2] = (source(x+1,y-1) + source(x+1,y+1))/2;
+                    o[3] = 1;
+                    o = destination(x,y+1);
+                    o[0] = (source(x,y) + source(x,y+2))/2;
+                    o[1] = source(x,y+1);
+                    o[2] = (source(x-1,y+1) + source(x+1,y+1))/2;
+                    o[3] = 1;
+                }
+            }
+        }
+    }
+    #undef clip
+    #undef source
+    #undef destination
+}
+
+CAS_BENCH(Debayer)
+{
+    const size_t width = ctx.width, height = ctx.height, count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<float> raw(count), rgba(count * 4);
+    CASTestFill(raw, random);
+    
+    volatile int mode = 0;
+    ctx.measure("clipped per pixel", count * 5 * sizeof(float), [&]{
+        CASDebayerBenchClipped(raw.data(), width, height, mode, rgba.data());
+    });
+    
+    ctx.measure("bilinear", count * 5 * sizeof(float), [&]{
+        CASDebayerBilinear(raw.data(), width, 0, 0, width, height, kCASBayerRGGB, 0, 0, width, height, rgba.data(), width * 4);
+    });
+    
+    ctx.measure("bilinear balanced", count * 5 * sizeof(float), [&]{
+        CASDebayerBilinearBalanced(raw.data(), width, 0, 0, width, height, kCASBayerRGGB, 0, 0, width, height, 1.2f, 1, 0.8f, rgba.data(), width * 4);
+    });
+    
+    ctx.measure("bilinear balanced parallel", count * 5 * sizeof(float), [&]{
+        CASParallelFor(height, 0, [&](size_t begin, size_t end){
+            CASDebayerBilinearBalanced(raw.data(), width, 0, 0, width, height, kCASBayerRGGB, 0, begin, width, end - begin, 1.2f, 1, 0.8f, &rgba[begin * width * 4], width * 4);
+        });
+    });
+    
+    ctx.measure("VNG parallel", count * 5 * sizeof(float), [&]{
+        CASDebayerFrame(raw.data(), width, width, height, kCASBayerRGGB, kCASDebayerVNG, 1, 1, 1, rgba.data(), width * 4, CASParallelApply);
+    });
+    
+    ctx.measure("AHD parallel", count * 5 * sizeof(float), [&]{
+        CASDebayerFrame(raw.data(), width, width, height, kCASBayerRGGB, kCASDebayerAHD, 1, 1, 1, rgba.data(), width * 4, CASParallelApply);
+    });
+}
+
+CAS_BENCH(DebayerSuperpixel)
+{
+    // reads the raw 16-bit frame once and writes a quarter as many pixels, so a copy of the raw frame is the yardstick
+    const size_t width = ctx.width, height = ctx.height, count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<uint16_t> raw(count), copy(count);
+    CASTestFill(raw, random);
+    std::vector<float> out((width / 2) * (height / 2) * 4);
+    const CASPixels samples = CASPixelsMake(kCASPixelFormatUInt16, raw.data(), width, height, width);
+    
+    ctx.measure("memcpy raw", count * 2 * sizeof(uint16_t), [&]{
+        std::copy(raw.begin(), raw.end(), copy.begin());
+    });
+    
+    ctx.measure("superpixel luminance", count * sizeof(uint16_t) + count * sizeof(float) / 4, [&]{
+        CASDebayerSuperpixel(samples, kCASBayerRGGB, true, out.data(), width / 2);
+    });
+    
+    ctx.measure("superpixel luminance parallel", count * sizeof(uint16_t) + count * sizeof(float) / 4, [&]{
+        CASDebayerSuperpixel(samples, kCASBayerRGGB, true, out.data(), width / 2, CASParallelApply);
+    });
+    
+    ctx.measure("superpixel RGBA", count * sizeof(uint16_t) + count * sizeof(float), [&]{
+        CASDebayerSuperpixel(samples, kCASBayerRGGB, false, out.data(), (width / 2) * 4);
+    });
+}
+
+CAS_BENCH(DebayerLuminance)
+{
+    // the search area the stacker uses, the middle 60% of the frame, as RGBA cut down to luminance and then directly
+    const size_t width = ctx.width, height = ctx.height, count = ctx.pixelCount();
+    const size_t x = width / 5, y = height / 5, w = width - 2 * x, h = height - 2 * y;
+    CASTestRandom random;
+    std::vector<uint16_t> raw(count);
+    CASTestFill(raw, random);
+    std::vector<float> widened(count), rgba(count * 4), luminance(w * h);
+    const CASPixels samples = CASPixelsMake(kCASPixelFormatUInt16, raw.data(), width, height, width);
+    
+    ctx.measure("RGBA frame then luminance", count * 6 * sizeof(float), [&]{
+        CASPixelsToFloat(samples, widened.data(), width);
+        CASDebayerFrame(widened.data(), width, width, height, kCASBayerRGGB, kCASDebayerBilinear, 1, 1, 1, rgba.data(), width * 4, CASParallelApply);
+        for (size_t j = 0; j < h; ++j){
+            const float* p = &rgba[((y + j) * width + x) * 4];
+            float* l = &luminance[j * w];
+            for (size_t i = 0; i < w; ++i, p += 4){
+                l[i] = 0.2126f * p[0] + 0.7152f * p[1] + 0.0722f * p[2];
+            }
+        }
+    });
+    
+    ctx.measure("luminance of search area", w * h * (sizeof(uint16_t) + sizeof(float)), [&]{
+        CASDebayerLuminance(samples, kCASBayerRGGB, x, y, w, h, luminance.data(), w, CASParallelApply);
+    });
+}
@@ -0,0 +1,330 @@
+//
+//  CASDebayerTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#include "CASTestSupport.h"
+#include "CASDebayer.h"
+#include "CASParallel.h"
+
+// a mosaic of a flat colour, which interpolates back to that colour everywhere, edges included
+static std::vector<float> CASDebayerTestMosaic(size_t width, size_t height, CASBayerPattern pattern, const float rgb[3])
+{
+    const size_t rx = (pattern == kCASBayerGRBG || pattern == kCASBayerBGGR);
+    const size_t ry = (pattern == kCASBayerGBRG || pattern == kCASBayerBGGR);
+    std::vector<float> mosaic(width * height);
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            const bool redRow = (y & 1) == ry, redColumn = (x & 1) == rx;
+            mosaic[y * width + x] = (redRow && redColumn) ? rgb[0] : (!redRow && !redColumn) ? rgb[2] : rgb[1];
+        }
+    }
+    return mosaic;
+}
+
+CAS_TEST(DebayerBilinearFlatColour)
+{
+    const float rgb[3] = { 0.8f, 0.5f, 0.2f };
+    const size_t width = 9, height = 6;
+    const CASBayerPattern patterns[] = { kCASBayerRGGB, kCASBayerGRBG, kCASBayerBGGR, kCASBayerGBRG };
+    for (size_t p = 0; p < 4; ++p){
+        const std::vector<float> mosaic = CASDebayerTestMosaic(width, height, patterns[p], rgb);
+        std::vector<float> out(width * height * 4);
+        CAS_CHECK(CASDebayerBilinear(mosaic.data(), width, 0, 0, width, height, patterns[p], 0, 0, width, height, out.data(), width * 4));
+        for (size_t i = 0; i < width * height; ++i){
+            CAS_CHECK_CLOSE(out[i * 4], rgb[0], 1e-6);
+            CAS_CHECK_CLOSE(out[i * 4 + 1], rgb[1], 1e-6);
+            CAS_CHECK_CLOSE(out[i * 4 + 2], rgb[2], 1e-6);
+            CAS_CHECK(out[i * 4 + 3] == 1);
+        }
+    }
+}
+
+CAS_TEST(DebayerBilinearInterpolates)
+{
+    // RGGB over a ramp, which bilinear interpolation reproduces exactly away from the edges
+    const size_t width = 6, height = 6;
+    std::vector<float> mosaic(width * height);
+    for (size_t i = 0; i < mosaic.size(); ++i){
+        mosaic[i] = i;
+    }
+    std::vector<float> out(width * height * 4);
+    CAS_CHECK(CASDebayerBilinear(mosaic.data(), width, 0, 0, width, height, kCASBayerRGGB, 0, 0, width, height, out.data(), width * 4));
+    
+    const float* red = &out[(2 * width + 2) * 4]; // red site at 2,2
+    CAS_CHECK(red[0] == 14 && red[1] == 14 && red[2] == 14);
+    const float* greenOnRed = &out[(2 * width + 3) * 4];
+    CAS_CHECK(greenOnRed[0] == (14 + 16) / 2.0f && greenOnRed[1] == 15 && greenOnRed[2] == (9 + 21) / 2.0f);
+    const float* greenOnBlue = &out[(3 * width + 2) * 4];
+    CAS_CHECK(greenOnBlue[0] == (14 + 26) / 2.0f && greenOnBlue[1] == 20 && greenOnBlue[2] == (19 + 21) / 2.0f);
+    
+    // the top left corner reflects onto 1,1 for blue
+    CAS_CHECK(out[2] == mosaic[width + 1]);
+}
+
+CAS_TEST(DebayerBilinearRegion)
+{
+    const size_t width = 37, height = 23;
+    CASTestRandom random;
+    std::vector<float> mosaic(width * height);
+    CASTestFill(mosaic, random);
+    std::vector<float> full(width * height * 4);
+    CAS_CHECK(CASDebayerBilinear(mosaic.data(), width, 0, 0, width, height, kCASBayerGBRG, 0, 0, width, height, full.data(), width * 4));
+    
+    // regions on the edges and in the middle, with just the margin around them to read from
+    const size_t regions[][4] = { { 0, 0, 5, 4 }, { 11, 7, 10, 9 }, { 30, 18, 7, 5 }, { 3, 0, 1, 23 } };
+    for (size_t r = 0; r < 4; ++r){
+        const size_t x = regions[r][0], y = regions[r][1], w = regions[r][2], h = regions[r][3];
+        const size_t inX = x ? x - 1 : 0, inY = y ? y - 1 : 0;
+        const size_t inW = std::min(width, x + w + 1) - inX, inH = std::min(height, y + h + 1) - inY;
+        std::vector<float> in(inW * inH);
+        for (size_t j = 0; j < inH; ++j){
+            std::copy(&mosaic[(inY + j) * width + inX], &mosaic[(inY + j) * width + inX] + inW, &in[j * inW]);
+        }
+        std::vector<float> out(w * h * 4);
+        CAS_CHECK(CASDebayerBilinear(in.data(), inW, inX, inY, width, height, kCASBayerGBRG, x, y, w, h, out.data(), w * 4));
+        for (size_t j = 0; j < h; ++j){
+            for (size_t i = 0; i < w * 4; ++i){
+                CAS_CHECK(out[j * w * 4 + i] == full[((y + j) * width + x) * 4 + i]);
+            }
+        }
+    }
+    
+    CAS_CHECK(!CASDebayerBilinear(mosaic.data(), width, 1, 0, width, height, kCASBayerRGGB, 0, 0, 4, 4, full.data(), width * 4));
+}
+
+CAS_TEST(DebayerBilinearReferenceAndBalance)
+{
+    // every pattern over odd sized frames against a pixel by pixel version with every neighbour reflected, which checks
+    // the interior path and the edges agree, then the balanced version against scaling and clamping that
+    const size_t width = 13, height = 9;
+    CASTestRandom random;
+    std::vector<float> mosaic(width * height);
+    CASTestFill(mosaic, random);
+    const CASBayerPattern patterns[] = { kCASBayerRGGB, kCASBayerGRBG, kCASBayerBGGR, kCASBayerGBRG };
+    for (size_t p = 0; p < 4; ++p){
+        
+        std::vector<float> out(width * height * 4), balanced(width * height * 4);
+        CAS_CHECK(CASDebayerBilinear(mosaic.data(), width, 0, 0, width, height, patterns[p], 0, 0, width, height, out.data(), width * 4));
+        CAS_CHECK(CASDebayerBilinearBalanced(mosaic.data(), width, 0, 0, width, height, patterns[p], 0, 0, width, height, 1.5f, 1, 0.5f, balanced.data(), width * 4));
+        
+        const size_t rx = (patterns[p] == kCASBayerGRBG || patterns[p] == kCASBayerBGGR);
+        const size_t ry = (patterns[p] == kCASBayerGBRG || patterns[p] == kCASBayerBGGR);
+        for (size_t y = 0; y < height; ++y){
+            const size_t up = y ? y - 1 : 1, down = y + 1 < height ? y + 1 : height - 2;
+            for (size_t x = 0; x < width; ++x){
+                const size_t left = x ? x - 1 : 1, right = x + 1 < width ? x + 1 : width - 2;
+                #define m(i,j) mosaic[(j) * width + (i)]
+                const float horizontal = (m(left,y) + m(right,y)) * 0.5f, vertical = (m(x,up) + m(x,down)) * 0.5f;
+                const float cross = (horizontal + vertical) * 0.5f, diagonal = (m(left,up) + m(right,up) + m(left,down) + m(right,down)) * 0.25f;
+                const bool redRow = (y & 1) == ry, redColumn = (x & 1) == rx;
+                float rgb[3];
+                if (redRow && redColumn){
+                    rgb[0] = m(x,y), rgb[1] = cross, rgb[2] = diagonal;
+                }
+                else if (!redRow && !redColumn){
+                    rgb[0] = diagonal, rgb[1] = cross, rgb[2] = m(x,y);
+                }
+                else {
+                    rgb[0] = redRow ? horizontal : vertical, rgb[1] = m(x,y), rgb[2] = redRow ? vertical : horizontal;
+                }
+                #undef m
+                const float* o = &out[(y * width + x) * 4];
+                const float* b = &balanced[(y * width + x) * 4];
+                CAS_CHECK(o[0] == rgb[0] && o[1] == rgb[1] && o[2] == rgb[2] && o[3] == 1);
+                CAS_CHECK(b[0] == std::min(rgb[0] * 1.5f, 1.0f) && b[1] == rgb[1] && b[2] == rgb[2] * 0.5f && b[3] == 1);
+            }
+        }
+    }
+}
+
+CAS_TEST(DebayerFrameFlatColour)
+{
+    // several tiles each way with partial ones on the right and bottom, every pattern and algorithm gives the colour
+    // back everywhere, scaled and clamped
+    const float rgb[3] = { 0.8f, 0.5f, 0.2f };
+    const size_t width = 2 * CAS_DEBAYER_TILE_SIZE + 45, height = CAS_DEBAYER_TILE_SIZE + 13;
+    const CASBayerPattern patterns[] = { kCASBayerRGGB, kCASBayerGRBG, kCASBayerBGGR, kCASBayerGBRG };
+    const CASDebayerAlgorithm algorithms[] = { kCASDebayerBilinear, kCASDebayerVNG, kCASDebayerAHD };
+    for (size_t p = 0; p < 4; ++p){
+        const std::vector<float> mosaic = CASDebayerTestMosaic(width, height, patterns[p], rgb);
+        for (size_t a = 0; a < 3; ++a){
+            std::vector<float> out(width * height * 4);
+            CAS_CHECK(CASDebayerFrame(mosaic.data(), width, width, height, patterns[p], algorithms[a], 1.5f, 1, 0.5f, out.data(), width * 4));
+            for (size_t i = 0; i < width * height; ++i){
+                CAS_CHECK(out[i * 4] == 1);
+                CAS_CHECK_CLOSE(out[i * 4 + 1], rgb[1], 1e-5);
+                CAS_CHECK_CLOSE(out[i * 4 + 2], rgb[2] * 0.5f, 1e-5);
+                CAS_CHECK(out[i * 4 + 3] == 1);
+            }
+        }
+    }
+}
+
+CAS_TEST(DebayerFrameEdges)
+{
+    // a grey scene of bright stripes and a diagonal edge, where bilinear leaves colour fringes and zippers along every
+    // edge. VNG and AHD should leave much less false colour and be closer to the scene overall
+    const size_t width = 160, height = 144;
+    std::vector<float> scene(width * height), mosaic(width * height);
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            const bool stripe = (x / 5) % 3 == 0 && y < height / 2;
+            const bool diagonal = y >= height / 2 && x * 2 > y + x / 3 + 40;
+            scene[y * width + x] = (stripe || diagonal) ? 0.8f : 0.1f;
+        }
+    }
+    const float grey[3] = { 1, 1, 1 };
+    const std::vector<float> pattern = CASDebayerTestMosaic(width, height, kCASBayerGRBG, grey);
+    for (size_t i = 0; i < mosaic.size(); ++i){
+        mosaic[i] = scene[i] * pattern[i];
+    }
+    
+    double falseColour[3] = { 0 }, error[3] = { 0 };
+    const CASDebayerAlgorithm algorithms[] = { kCASDebayerBilinear, kCASDebayerVNG, kCASDebayerAHD };
+    for (size_t a = 0; a < 3; ++a){
+        std::vector<float> out(width * height * 4);
+        CAS_CHECK(CASDebayerFrame(mosaic.data(), width, width, height, kCASBayerGRBG, algorithms[a], 1, 1, 1, out.data(), width * 4));
+        for (size_t i = 0; i < width * height; ++i){
+            const float* o = &out[i * 4];
+            falseColour[a] += fabsf(o[0] - o[1]) + fabsf(o[2] - o[1]);
+            error[a] += fabsf(o[0] - scene[i]) + fabsf(o[1] - scene[i]) + fabsf(o[2] - scene[i]);
+        }
+    }
+    CAS_CHECK(falseColour[1] < 0.5 * falseColour[0] && falseColour[2] < 0.1 * falseColour[0]);
+    CAS_CHECK(error[1] < 0.5 * error[0] && error[2] < 0.1 * error[0]);
+}
+
+CAS_TEST(DebayerFrameParallel)
+{
+    // tiles are independent so running them in parallel changes nothing, and bilinear whole frames match the region version
+    const size_t width = 3 * CAS_DEBAYER_TILE_SIZE + 7, height = 2 * CAS_DEBAYER_TILE_SIZE + 31, inStride = width + 3;
+    CASTestRandom random;
+    std::vector<float> mosaic(inStride * height);
+    CASTestFill(mosaic, random);
+    const CASDebayerAlgorithm algorithms[] = { kCASDebayerBilinear, kCASDebayerVNG, kCASDebayerAHD };
+    for (size_t a = 0; a < 3; ++a){
+        std::vector<float> inOrder(width * height * 4), parallel(width * height * 4);
+        CAS_CHECK(CASDebayerFrame(mosaic.data(), inStride, width, height, kCASBayerBGGR, algorithms[a], 1, 1, 1, inOrder.data(), width * 4));
+        CAS_CHECK(CASDebayerFrame(mosaic.data(), inStride, width, height, kCASBayerBGGR, algorithms[a], 1, 1, 1, parallel.data(), width * 4, CASParallelApply));
+        CAS_CHECK(inOrder == parallel);
+        if (algorithms[a] == kCASDebayerBilinear){
+            std::vector<float> region(width * height * 4);
+            CAS_CHECK(CASDebayerBilinearBalanced(mosaic.data(), inStride, 0, 0, width, height, kCASBayerBGGR, 0, 0, width, height, 1, 1, 1, region.data(), width * 4));
+            CAS_CHECK(inOrder == region);
+        }
+    }
+    
+    CAS_CHECK(!CASDebayerFrame(mosaic.data(), inStride, 1, height, kCASBayerBGGR, kCASDebayerVNG, 1, 1, 1, mosaic.data(), 4));
+}
+
+CAS_TEST(DebayerSuperpixelFlatColour)
+{
+    // a flat colour folds back to that colour and its luminance whatever the pattern, and the odd last row and column go
+    const float rgb[3] = { 0.8f, 0.5f, 0.2f };
+    const size_t width = 9, height = 7;
+    const CASBayerPattern patterns[] = { kCASBayerRGGB, kCASBayerGRBG, kCASBayerBGGR, kCASBayerGBRG };
+    for (size_t p = 0; p < 4; ++p){
+        const std::vector<float> mosaic = CASDebayerTestMosaic(width, height, patterns[p], rgb);
+        std::vector<float> rgba(4 * 3 * 4, -1), luminance(4 * 3, -1);
+        CAS_CHECK(CASDebayerSuperpixel(CASPixelsMake(kCASPixelFormatFloat, mosaic.data(), width, height, width), patterns[p], false, rgba.data(), 4 * 4));
+        CAS_CHECK(CASDebayerSuperpixel(CASPixelsMake(kCASPixelFormatFloat, mosaic.data(), width, height, width), patterns[p], true, luminance.data(), 4));
+        for (size_t i = 0; i < 4 * 3; ++i){
+            CAS_CHECK_CLOSE(rgba[i * 4], rgb[0], 1e-6);
+            CAS_CHECK_CLOSE(rgba[i * 4 + 1], rgb[1], 1e-6);
+            CAS_CHECK_CLOSE(rgba[i * 4 + 2], rgb[2], 1e-6);
+            CAS_CHECK(rgba[i * 4 + 3] == 1);
+            CAS_CHECK_CLOSE(luminance[i], 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2], 1e-6);
+        }
+    }
+    
+    float out[4];
+    CAS_CHECK(!CASDebayerSuperpixel(CASPixelsMake(kCASPixelFormatFloat, rgb, 1, 3, 1), kCASBayerRGGB, true, out, 1));
+    CAS_CHECK(!CASDebayerSuperpixel(CASPixelsMake(kCASPixelFormatRGBAFloat, rgb, 2, 2, 2), kCASBayerRGGB, true, out, 1));
+}
+
+CAS_TEST(DebayerSuperpixelFormatsAndParallel)
+{
+    // 16-bit frames scale as exposures do so they match the same samples as floats, and bands run in parallel change nothing
+    const size_t width = 2 * CAS_DEBAYER_TILE_SIZE + 13, height = 3 * CAS_DEBAYER_TILE_SIZE + 5, stride = width + 6;
+    const size_t ow = width / 2, oh = height / 2;
+    CASTestRandom random;
+    std::vector<uint16_t> raw(stride * height);
+    CASTestFill(raw, random);
+    std::vector<float> widened(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i){
+        widened[i] = raw[i] / (float)CAS_PIXEL_UINT16_MAX;
+    }
+    const CASPixels samples = CASPixelsMake(kCASPixelFormatUInt16, raw.data(), width, height, stride);
+    const CASPixels floats = CASPixelsMake(kCASPixelFormatFloat, widened.data(), width, height, stride);
+    
+    for (int luminance = 0; luminance < 2; ++luminance){
+        const size_t channels = luminance ? 1 : 4;
+        std::vector<float> inOrder(ow * oh * channels), parallel(ow * oh * channels), fromFloat(ow * oh * channels);
+        CAS_CHECK(CASDebayerSuperpixel(samples, kCASBayerGBRG, luminance, inOrder.data(), ow * channels));
+        CAS_CHECK(CASDebayerSuperpixel(samples, kCASBayerGBRG, luminance, parallel.data(), ow * channels, CASParallelApply));
+        CAS_CHECK(CASDebayerSuperpixel(floats, kCASBayerGBRG, luminance, fromFloat.data(), ow * channels));
+        CAS_CHECK(inOrder == parallel);
+        for (size_t i = 0; i < inOrder.size(); ++i){
+            CAS_CHECK_CLOSE(inOrder[i], fromFloat[i], 1e-5);
+        }
+        if (!luminance){
+            // GBRG has blue top right and red bottom left
+            const size_t x = ow - 1, y = oh - 1;
+            const float* o = &inOrder[(y * ow + x) * 4];
+            CAS_CHECK_CLOSE(o[0], widened[(y * 2 + 1) * stride + x * 2], 1e-6);
+            CAS_CHECK_CLOSE(o[1], (widened[y * 2 * stride + x * 2] + widened[(y * 2 + 1) * stride + x * 2 + 1]) * 0.5f, 1e-6);
+            CAS_CHECK_CLOSE(o[2], widened[y * 2 * stride + x * 2 + 1], 1e-6);
+        }
+    }
+}
+
+CAS_TEST(DebayerLuminanceRegion)
+{
+    // the same as debayering the region to RGBA and weighting it, edges of the frame included, from 16-bit samples
+    const size_t width = 3 * CAS_DEBAYER_TILE_SIZE + 9, height = CAS_DEBAYER_TILE_SIZE + 37, stride = width + 5;
+    CASTestRandom random;
+    std::vector<uint16_t> raw(stride * height);
+    CASTestFill(raw, random);
+    std::vector<float> widened(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i){
+        widened[i] = raw[i] / (float)CAS_PIXEL_UINT16_MAX;
+    }
+    const CASPixels samples = CASPixelsMake(kCASPixelFormatUInt16, raw.data(), width, height, stride);
+    
+    const size_t regions[][4] = { { 0, 0, width, height }, { 33, 17, 200, CAS_DEBAYER_TILE_SIZE + 11 }, { width - 50, height - 21, 50, 21 } };
+    for (size_t r = 0; r < 3; ++r){
+        const size_t x = regions[r][0], y = regions[r][1], w = regions[r][2], h = regions[r][3];
+        std::vector<float> rgba(w * h * 4), luminance(w * h), parallel(w * h);
+        CAS_CHECK(CASDebayerBilinear(widened.data(), stride, 0, 0, width, height, kCASBayerGRBG, x, y, w, h, rgba.data(), w * 4));
+        CAS_CHECK(CASDebayerLuminance(samples, kCASBayerGRBG, x, y, w, h, luminance.data(), w));
+        CAS_CHECK(CASDebayerLuminance(samples, kCASBayerGRBG, x, y, w, h, parallel.data(), w, CASParallelApply));
+        CAS_CHECK(luminance == parallel);
+        for (size_t i = 0; i < w * h; ++i){
+            CAS_CHECK_CLOSE(luminance[i], 0.2126f * rgba[i * 4] + 0.7152f * rgba[i * 4 + 1] + 0.0722f * rgba[i * 4 + 2], 1e-5);
+        }
+    }
+    
+    float out[4];
+    CAS_CHECK(!CASDebayerLuminance(samples, kCASBayerGRBG, width - 1, 0, 2, 2, out, 2));
+}
@@ -0,0 +1,57 @@
+//
+//  CASDefectMapBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Correcting a guide frame's defects from the defect map against median filtering the whole frame.
+
+
+#include "CASTestSupport.h"
+#include "CASDefectMap.h"
+#include "CASMedianFilter.h"
+
+CAS_BENCH(DefectMap)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> frame(ctx.pixelCount()), out(ctx.pixelCount());
+    for (size_t i = 0; i < frame.size(); ++i){
+        frame[i] = 2000 + (random.next() % 200);
+    }
+    
+    // a fairly poor sensor, one pixel in a thousand hot and a couple of bad columns
+    CASDefectMap map;
+    map.width = ctx.width;
+    map.height = ctx.height;
+    for (size_t i = random.next() % 1000; i < frame.size(); i += 500 + random.next() % 1000){
+        map.hot.push_back((uint32_t)i);
+    }
+    map.columns.push_back((uint32_t)(ctx.width / 3));
+    map.columns.push_back((uint32_t)(2 * ctx.width / 3));
+    
+    ctx.measure("defect map", (map.hot.size() * 5 + map.columns.size() * 3 * ctx.height) * sizeof(uint16_t), [&]{
+        CASDefectMapCorrect(map, frame.data(), ctx.width, ctx.height, ctx.width, 0, 0, 2);
+    });
+    
+    ctx.measure("3x3 median", 2.0 * frame.size() * sizeof(uint16_t), [&]{
+        CASMedianFilterRows(frame.data(), out.data(), ctx.width, ctx.height, 1, 0, ctx.height);
+    });
+}
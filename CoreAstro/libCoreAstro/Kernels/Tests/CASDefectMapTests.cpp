@@ -0,0 +1,140 @@
+//
+//  CASDefectMapTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+#include "CASTestSupport.h"
+#include "CASDefectMap.h"
+
+// a 64x48 dark with read noise, some hot pixels and a warm column and a vignetted flat with a few dead pixels
+static void CASDefectMapTestFrames(std::vector<uint16_t>& dark, std::vector<float>& flat)
+{
+    const size_t width = 64, height = 48;
+    CASTestRandom random;
+    dark.resize(width * height);
+    flat.resize(width * height);
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            dark[x + y * width] = 1000 + (random.next() % 40);
+            const float dx = (x - 32.0f) / 32.0f, dy = (y - 24.0f) / 24.0f;
+            flat[x + y * width] = (0.5f - 0.15f * (dx * dx + dy * dy)) + random.unit() * 0.01f;
+        }
+    }
+    dark[5 + 3 * width] = 20000;
+    dark[40 + 30 * width] = 65535;
+    dark[21 + 10 * width] = 65535; // in the bad column so not listed on its own
+    for (size_t y = 0; y < height; ++y){
+        dark[21 + y * width] += 300;
+    }
+    flat[7 + 44 * width] = 0.05f;
+    flat[63 + 0 * width] = 0.0f;
+}
+
+CAS_TEST(DefectMapBuild)
+{
+    std::vector<uint16_t> dark;
+    std::vector<float> flat;
+    CASDefectMapTestFrames(dark, flat);
+    
+    CASDefectMap map;
+    const CASPixels darkPixels = CASPixelsMake(kCASPixelFormatUInt16, dark.data(), 64, 48, 64);
+    const CASPixels flatPixels = CASPixelsMake(kCASPixelFormatFloat, flat.data(), 64, 48, 64);
+    CAS_CHECK(CASDefectMapBuild(darkPixels, flatPixels, CASDefectThresholdsDefault(), map));
+    CAS_CHECK(map.width == 64 && map.height == 48);
+    CAS_CHECK(map.hot.size() == 2 && map.hot[0] == 5 + 3 * 64 && map.hot[1] == 40 + 30 * 64);
+    CAS_CHECK(map.cold.size() == 2 && map.cold[0] == 63 && map.cold[1] == 7 + 44 * 64);
+    CAS_CHECK(map.columns.size() == 1 && map.columns[0] == 21);
+    CAS_CHECK(CASDefectMapIsDefect(map, 21, 0) && CASDefectMapIsDefect(map, 7, 44) && !CASDefectMapIsDefect(map, 8, 44));
+    
+    // either frame on its own
+    CAS_CHECK(CASDefectMapBuild(darkPixels, CASPixels(), CASDefectThresholdsDefault(), map));
+    CAS_CHECK(map.hot.size() == 2 && map.cold.empty() && map.columns.size() == 1);
+    CAS_CHECK(CASDefectMapBuild(CASPixels(), flatPixels, CASDefectThresholdsDefault(), map));
+    CAS_CHECK(map.hot.empty() && map.cold.size() == 2 && map.columns.empty());
+    
+    CAS_CHECK(!CASDefectMapBuild(CASPixels(), CASPixels(), CASDefectThresholdsDefault(), map));
+    CAS_CHECK(!CASDefectMapBuild(darkPixels, CASPixelsMake(kCASPixelFormatFloat, flat.data(), 32, 48, 64), CASDefectThresholdsDefault(), map));
+}
+
+CAS_TEST(DefectMapCorrect)
+{
+    CASDefectMap map;
+    map.width = 16;
+    map.height = 8;
+    map.hot.push_back(5 + 2 * 16);
+    map.hot.push_back(7 + 2 * 16); // a same colour neighbour of the one above, so not used for it
+    map.cold.push_back(0 + 7 * 16);
+    map.columns.push_back(10);
+    
+    std::vector<uint16_t> frame(16 * 8);
+    for (size_t i = 0; i < frame.size(); ++i){
+        frame[i] = (uint16_t)(100 + i);
+    }
+    frame[5 + 2 * 16] = 60000;
+    frame[7 + 2 * 16] = 60000;
+    frame[0 + 7 * 16] = 0;
+    
+    CAS_CHECK(CASDefectMapCorrect(map, frame.data(), 16, 8, 16, 0, 0, 2) == 3 + 8);
+    CAS_CHECK(frame[5 + 2 * 16] == (uint16_t)(100 + 3 + 2 * 16)); // median of left, above and below
+    CAS_CHECK(frame[7 + 2 * 16] == (uint16_t)(100 + 9 + 2 * 16)); // right, above and below
+    CAS_CHECK(frame[0 + 7 * 16] == (uint16_t)((100 + 2 + 7 * 16 + 100 + 0 + 5 * 16) / 2)); // average of right and above
+    for (size_t y = 0; y < 8; ++y){
+        CAS_CHECK(frame[10 + y * 16] == (uint16_t)(100 + 10 + y * 16));
+    }
+    
+    // a subframe only sees the defects inside it, at its own coordinates
+    std::vector<float> sub(6 * 4, 0.25f);
+    sub[1 + 1 * 6] = 1.0f; // sensor 5,2
+    sub[3 + 1 * 6] = 1.0f; // sensor 7,2
+    CAS_CHECK(CASDefectMapCorrect(map, sub.data(), 4, 3, 6, 4, 1, 1) == 2);
+    CAS_CHECK(sub[1 + 1 * 6] == 0.25f && sub[3 + 1 * 6] == 0.25f);
+    
+    CAS_CHECK(CASDefectMapCorrect(map, sub.data(), 6, 4, 6, 12, 0, 1) == 0); // runs off the sensor
+}
+
+CAS_TEST(DefectMapEncode)
+{
+    CASDefectMap map;
+    map.width = 4896;
+    map.height = 3264;
+    CASTestRandom random;
+    uint32_t i = 0;
+    for (int n = 0; n < 1000; ++n){
+        i += 1 + random.next() % 10000;
+        map.hot.push_back(i);
+    }
+    map.cold.push_back(12345);
+    map.columns.push_back(17);
+    map.columns.push_back(4000);
+    
+    std::vector<uint8_t> bytes;
+    CASDefectMapEncode(map, bytes);
+    CAS_CHECK(bytes.size() < 3 * map.hot.size());
+    
+    CASDefectMap decoded;
+    CAS_CHECK(CASDefectMapDecode(bytes.data(), bytes.size(), decoded));
+    CAS_CHECK(decoded.width == map.width && decoded.height == map.height);
+    CAS_CHECK(decoded.hot == map.hot && decoded.cold == map.cold && decoded.columns == map.columns);
+    
+    CAS_CHECK(!CASDefectMapDecode(bytes.data(), bytes.size() - 1, decoded));
+    bytes[0] ^= 1;
+    CAS_CHECK(!CASDefectMapDecode(bytes.data(), bytes.size(), decoded));
+}
@@ -0,0 +1,68 @@
+//
+//  CASDisplayStretchBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Stretching frames for display, through the float pixels and a float bitmap as the preview used to
+//  against the 16-bit samples straight through the table.
+
+#include "CASTestSupport.h"
+#include "CASDisplayStretch.h"
+#include <algorithm>
+
+CAS_BENCH(DisplayStretch)
+{
+    const size_t count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<uint16_t> shorts(count), rgba(count * 4);
+    std::vector<float> floats(count), floatRGBA(count * 4);
+    for (size_t i = 0; i < count; ++i){
+        shorts[i] = 2000 + (random.next() % 2000);
+    }
+    for (size_t i = 0; i < rgba.size(); ++i){
+        rgba[i] = shorts[i / 4];
+        floatRGBA[i] = rgba[i] / 65535.0f;
+    }
+    std::vector<uint8_t> table(CAS_DISPLAY_STRETCH_TABLE_SIZE), out(count * 4);
+    const CASDisplayStretch stretch = CASDisplayStretchMake(0.03f, 0.06f, 0.25f);
+    
+    ctx.measure("build table", CAS_DISPLAY_STRETCH_TABLE_SIZE, [&]{
+        CASDisplayStretchBuildTable(stretch, 65535, table.data());
+    });
+    
+    // converting to float and stretching them in place, the 8-bit conversion then happens when drawing
+    ctx.measure("float convert + rescale", count * (sizeof(uint16_t) + 2 * sizeof(float)), [&]{
+        for (size_t i = 0; i < count; ++i){
+            floats[i] = shorts[i] / 65535.0f;
+        }
+        CASDisplayStretchRescale(floats.data(), floats.data(), count, stretch.lower, stretch.upper, 1);
+    });
+    ctx.measure("uint16 to gray8", count * (sizeof(uint16_t) + 1), [&]{
+        CASDisplayStretchApplyTable(shorts.data(), ctx.width, ctx.height, 1, table.data(), out.data(), ctx.width);
+    });
+    ctx.measure("uint16 rgba to rgba8", count * 4 * (sizeof(uint16_t) + 1), [&]{
+        CASDisplayStretchApplyTable(rgba.data(), ctx.width, ctx.height, 4, table.data(), out.data(), ctx.width * 4);
+    });
+    ctx.measure("float rgba to rgba8", count * 4 * (sizeof(float) + 1), [&]{
+        CASDisplayStretchApplyTable(floatRGBA.data(), ctx.width, ctx.height, 4, table.data(), out.data(), ctx.width * 4);
+    });
+}
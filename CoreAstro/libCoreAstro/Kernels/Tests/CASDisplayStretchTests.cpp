@@ -0,0 +1,153 @@
+//
+//  CASDisplayStretchTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASDisplayStretch.h"
+#include <algorithm>
+
+static void CASDisplayStretchApplyBackwards(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = count; i-- > 0;){
+        work(context, i);
+    }
+}
+
+static double CASDisplayStretchReference(const CASDisplayStretch& stretch, double x)
+{
+    x = std::min(1.0, std::max(0.0, (x - stretch.lower) / (stretch.upper - stretch.lower)));
+    const double m = stretch.midtone;
+    x = ((m - 1) * x) / (((2 * m - 1) * x) - m);
+    return pow(x, (double)stretch.gamma);
+}
+
+CAS_TEST(DisplayStretchTable)
+{
+    std::vector<uint8_t> table(CAS_DISPLAY_STRETCH_TABLE_SIZE);
+    
+    // the full range linear stretch of 16-bit samples is just the top byte, rounded
+    CASDisplayStretchBuildTable(CASDisplayStretchMake(0, 1), 65535, table.data());
+    for (size_t i = 0; i < table.size(); ++i){
+        CAS_CHECK(table[i] == (uint8_t)(i * 255.0 / 65535.0 + 0.5));
+    }
+    
+    const CASDisplayStretch stretches[] = {
+        CASDisplayStretchMake(0.1f, 0.4f),
+        CASDisplayStretchMake(0.02f, 0.9f, 0.2f),
+        CASDisplayStretchMake(0.05f, 0.5f, 0.5f, 0.45f),
+        CASDisplayStretchMake(0.3f, 0.3f),
+    };
+    const float maxSampleValues[] = { 65535, 4095 };
+    for (size_t s = 0; s < sizeof(stretches)/sizeof(stretches[0]); ++s){
+        for (size_t m = 0; m < sizeof(maxSampleValues)/sizeof(maxSampleValues[0]); ++m){
+            
+            const CASDisplayStretch& stretch = stretches[s];
+            const float max = maxSampleValues[m];
+            CASDisplayStretchBuildTable(stretch, max, table.data());
+            for (size_t i = 0; i < table.size(); ++i){
+                const double x = i / (double)max;
+                if (x < stretch.lower){
+                    CAS_CHECK(table[i] == 0);
+                }
+                else if (x > stretch.upper){
+                    CAS_CHECK(table[i] == 255);
+                }
+                else if (stretch.upper > stretch.lower){
+                    CAS_CHECK(fabs(table[i] - 255 * CASDisplayStretchReference(stretch, x)) <= 0.5 + 1e-6);
+                }
+                CAS_CHECK(!i || table[i] >= table[i - 1]);
+            }
+        }
+    }
+}
+
+CAS_TEST(DisplayStretchApplyTable)
+{
+    const size_t width = 37, height = 2 * CAS_DISPLAY_STRETCH_TILE_ROWS + 5;
+    CASTestRandom random;
+    std::vector<uint8_t> table(CAS_DISPLAY_STRETCH_TABLE_SIZE);
+    CASDisplayStretchBuildTable(CASDisplayStretchMake(0.1f, 0.8f, 0.3f), 65535, table.data());
+    
+    for (size_t channelCount = 1; channelCount <= 4; channelCount += 3){
+        
+        std::vector<uint16_t> shorts(width * height * channelCount);
+        std::vector<float> floats(shorts.size());
+        CASTestFill(shorts, random);
+        for (size_t i = 0; i < shorts.size(); ++i){
+            floats[i] = shorts[i] / 65535.0f;
+        }
+        floats[0] = NAN;
+        floats[1] = -0.5f;
+        floats[2] = 7;
+        
+        // rows padded out past the pixels, which should be left alone
+        const size_t bytesPerRow = width * channelCount + 3;
+        std::vector<uint8_t> expected(bytesPerRow * height, 0xcd);
+        for (size_t y = 0; y < height; ++y){
+            for (size_t x = 0; x < width * channelCount; ++x){
+                const bool alpha = (channelCount == 4 && x % 4 == 3);
+                expected[y * bytesPerRow + x] = alpha ? 255 : table[shorts[y * width * channelCount + x]];
+            }
+        }
+        
+        std::vector<uint8_t> actual(expected.size(), 0xcd);
+        CAS_CHECK(CASDisplayStretchApplyTable(shorts.data(), width, height, channelCount, table.data(), actual.data(), bytesPerRow));
+        CAS_CHECK(actual == expected);
+        
+        std::fill(actual.begin(), actual.end(), 0xcd);
+        CAS_CHECK(CASDisplayStretchApplyTable(floats.data(), width, height, channelCount, table.data(), actual.data(), bytesPerRow, CASDisplayStretchApplyBackwards));
+        expected[0] = expected[1] = table[0];
+        expected[2] = table[65535];
+        CAS_CHECK(actual == expected);
+    }
+    
+    std::vector<uint16_t> pixels(width * height * 3);
+    std::vector<uint8_t> out(pixels.size());
+    CAS_CHECK(!CASDisplayStretchApplyTable((const uint16_t*)NULL, width, height, 1, table.data(), out.data(), width));
+    CAS_CHECK(!CASDisplayStretchApplyTable(pixels.data(), width, height, 3, table.data(), out.data(), width * 3));
+    CAS_CHECK(!CASDisplayStretchApplyTable(pixels.data(), width, height, 1, table.data(), out.data(), width - 1));
+}
+
+CAS_TEST(DisplayStretchRescale)
+{
+    const size_t count = 3 * 64 * 1024 + 11;
+    CASTestRandom random;
+    std::vector<float> in(count), out(count);
+    CASTestFill(in, random);
+    in[0] = 0.1f;
+    in[1] = 0.7f;
+    
+    CAS_CHECK(CASDisplayStretchRescale(in.data(), out.data(), count, 0.1f, 0.7f, 1, CASDisplayStretchApplyBackwards));
+    for (size_t i = 0; i < count; ++i){
+        const float p = in[i];
+        const float expected = (p < 0.1f) ? 0 : (p > 0.7f) ? 1 : (p - 0.1f) / 0.6f;
+        CAS_CHECK_CLOSE(out[i], expected, 1e-6);
+    }
+    CAS_CHECK(out[0] == 0 && out[1] == 1);
+    
+    // in place
+    CAS_CHECK(CASDisplayStretchRescale(in.data(), in.data(), count, 0.1f, 0.7f, 1));
+    CAS_CHECK(in == out);
+    
+    CAS_CHECK(!CASDisplayStretchRescale(in.data(), out.data(), count, 0.5f, 0.5f, 1));
+}
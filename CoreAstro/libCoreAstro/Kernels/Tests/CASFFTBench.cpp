@@ -0,0 +1,63 @@
+//
+//  CASFFTBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Forward and inverse transforms of a frame, and convolution and deconvolution with large kernels.
+//  -s 16.8 is a 4k x 4k sensor.
+
+#include "CASTestSupport.h"
+#include "CASFFT.h"
+#include "CASParallel.h"
+
+CAS_BENCH(FFT)
+{
+    const size_t count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<float> in(count), out(count);
+    CASTestFill(in, random);
+    
+    const CASFFTPlan* plan = CASFFTPlanForSize(CASFFTGoodSize(ctx.width), CASFFTGoodSize(ctx.height));
+    std::vector<float> padded(plan->width * plan->height);
+    std::vector<CASFFTComplex> spectrum(plan->spectrumWidth * plan->height);
+    ctx.measure("forward", padded.size() * sizeof(float) + spectrum.size() * sizeof(CASFFTComplex), [&]{
+        CASFFTForward(plan, padded.data(), spectrum.data(), CASParallelApply);
+    });
+    ctx.measure("inverse", padded.size() * sizeof(float) + spectrum.size() * sizeof(CASFFTComplex), [&]{
+        CASFFTInverse(plan, spectrum.data(), padded.data(), CASParallelApply);
+    });
+    
+    const size_t radius = 32, size = 2 * radius + 1;
+    std::vector<float> psf(size * size);
+    for (size_t j = 0; j < size; ++j){
+        for (size_t i = 0; i < size; ++i){
+            const float rx = (float)i - radius, ry = (float)j - radius;
+            psf[j * size + i] = expf(-(rx * rx + ry * ry) / (2 * 8.0f * 8.0f));
+        }
+    }
+    ctx.measure("convolve 65x65", count * 2 * sizeof(float), [&]{
+        CASFFTConvolve(in.data(), out.data(), ctx.width, ctx.height, psf.data(), size, size, CASParallelApply);
+    });
+    ctx.measure("richardson-lucy 65x65 x10", count * 2 * sizeof(float), [&]{
+        CASFFTRichardsonLucy(in.data(), out.data(), ctx.width, ctx.height, psf.data(), size, size, 10, CASParallelApply);
+    });
+}
@@ -0,0 +1,201 @@
+//
+//  CASFFTTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASFFT.h"
+#include "CASParallel.h"
+#include <algorithm>
+
+// straightforward transform in double precision
+static std::vector<CASFFTComplex> CASTestDFT(const std::vector<float>& in, size_t width, size_t height)
+{
+    const size_t spectrumWidth = width / 2 + 1;
+    std::vector<CASFFTComplex> out(spectrumWidth * height);
+    for (size_t v = 0; v < height; ++v){
+        for (size_t u = 0; u < spectrumWidth; ++u){
+            double re = 0, im = 0;
+            for (size_t y = 0; y < height; ++y){
+                for (size_t x = 0; x < width; ++x){
+                    const double phase = -2 * M_PI * ((double)u * x / width + (double)v * y / height);
+                    re += in[y * width + x] * cos(phase);
+                    im += in[y * width + x] * sin(phase);
+                }
+            }
+            out[v * spectrumWidth + u] = CASFFTComplex(re, im);
+        }
+    }
+    return out;
+}
+
+// a few gaussian stars on a flat sky
+static std::vector<float> CASTestStarField(size_t width, size_t height, float dx, float dy, float sigma)
+{
+    const float stars[][3] = { { 20, 14, 0.5f }, { 47, 30, 0.3f }, { 31, 50, 0.8f }, { 58, 9, 0.2f }, { 12, 41, 0.4f } };
+    std::vector<float> out(width * height, 0.05f);
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            for (size_t s = 0; s < sizeof(stars)/sizeof(stars[0]); ++s){
+                const float rx = x - (stars[s][0] + dx), ry = y - (stars[s][1] + dy);
+                out[y * width + x] += stars[s][2] * expf(-(rx * rx + ry * ry) / (2 * sigma * sigma));
+            }
+        }
+    }
+    return out;
+}
+
+CAS_TEST(FFTGoodSize)
+{
+    CAS_CHECK(CASFFTGoodSize(0) == 2);
+    CAS_CHECK(CASFFTGoodSize(7) == 8);
+    CAS_CHECK(CASFFTGoodSize(4096) == 4096);
+    CAS_CHECK(CASFFTGoodSize(4097) == 4320);
+    CAS_CHECK(CASFFTPlanForSize(30, 18) != NULL);
+    CAS_CHECK(CASFFTPlanForSize(30, 18) == CASFFTPlanForSize(30, 18));
+    CAS_CHECK(CASFFTPlanForSize(15, 18) == NULL);
+    CAS_CHECK(CASFFTPlanForSize(28, 18) == NULL);
+}
+
+CAS_TEST(FFTMatchesDFT)
+{
+    // every radix, and a row of one packed value
+    const size_t sizes[][2] = { { 24, 10 }, { 30, 9 }, { 40, 16 }, { 2, 5 }, { 16, 1 } };
+    CASTestRandom random;
+    for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s){
+        const size_t width = sizes[s][0], height = sizes[s][1];
+        const CASFFTPlan* plan = CASFFTPlanForSize(width, height);
+        CAS_CHECK(plan);
+        
+        std::vector<float> in(width * height), out(width * height);
+        CASTestFill(in, random);
+        std::vector<CASFFTComplex> spectrum(plan->spectrumWidth * height);
+        CAS_CHECK(CASFFTForward(plan, in.data(), spectrum.data()));
+        
+        const std::vector<CASFFTComplex> expected = CASTestDFT(in, width, height);
+        for (size_t i = 0; i < spectrum.size(); ++i){
+            CAS_CHECK(std::abs(spectrum[i] - expected[i]) < 1e-4 * width * height);
+        }
+        
+        CAS_CHECK(CASFFTInverse(plan, spectrum.data(), out.data()));
+        for (size_t i = 0; i < in.size(); ++i){
+            CAS_CHECK_CLOSE(out[i], in[i], 1e-5);
+        }
+    }
+}
+
+CAS_TEST(FFTConvolve)
+{
+    const size_t width = 37, height = 23, kernelWidth = 6, kernelHeight = 3;
+    CASTestRandom random;
+    std::vector<float> in(width * height), kernel(kernelWidth * kernelHeight), out(width * height);
+    CASTestFill(in, random);
+    CASTestFill(kernel, random);
+    
+    CAS_CHECK(CASFFTConvolve(in.data(), out.data(), width, height, kernel.data(), kernelWidth, kernelHeight, CASParallelApply));
+    
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            double sum = 0;
+            for (size_t j = 0; j < kernelHeight; ++j){
+                for (size_t i = 0; i < kernelWidth; ++i){
+                    const ptrdiff_t xx = std::min<ptrdiff_t>(width - 1, std::max<ptrdiff_t>(0, (ptrdiff_t)x + kernelWidth / 2 - i));
+                    const ptrdiff_t yy = std::min<ptrdiff_t>(height - 1, std::max<ptrdiff_t>(0, (ptrdiff_t)y + kernelHeight / 2 - j));
+                    sum += kernel[j * kernelWidth + i] * in[yy * width + xx];
+                }
+            }
+            CAS_CHECK_CLOSE(out[y * width + x], sum, 1e-4);
+        }
+    }
+    
+    // in place
+    CAS_CHECK(CASFFTConvolve(in.data(), in.data(), width, height, kernel.data(), kernelWidth, kernelHeight));
+    CAS_CHECK(in == out);
+}
+
+CAS_TEST(FFTCorrelateAndRegister)
+{
+    const size_t width = 72, height = 60;
+    const std::vector<float> reference = CASTestStarField(width, height, 0, 0, 1.5f);
+    
+    // whole pixel shifts wrap round exactly
+    const std::vector<float> shifted = CASTestStarField(width, height, 5, -3, 1.5f);
+    std::vector<float> correlation(width * height);
+    CAS_CHECK(CASFFTCrossCorrelate(reference.data(), shifted.data(), correlation.data(), width, height));
+    const size_t peak = std::max_element(correlation.begin(), correlation.end()) - correlation.begin();
+    CAS_CHECK(peak % width == 5);
+    CAS_CHECK(peak / width == height - 3);
+    
+    // and fractional ones on a size that needs padding
+    const std::vector<float> offset = CASTestStarField(width - 1, height - 1, 2.4f, -1.3f, 1.5f);
+    const std::vector<float> cropped = CASTestStarField(width - 1, height - 1, 0, 0, 1.5f);
+    float dx = 0, dy = 0;
+    CAS_CHECK(CASFFTRegister(cropped.data(), offset.data(), width - 1, height - 1, dx, dy));
+    CAS_CHECK(fabs(dx - 2.4f) < 0.25f);
+    CAS_CHECK(fabs(dy + 1.3f) < 0.25f);
+}
+
+CAS_TEST(FFTRichardsonLucy)
+{
+    const size_t width = 72, height = 60, radius = 6, size = 2 * radius + 1;
+    const std::vector<float> sharp = CASTestStarField(width, height, 0, 0, 0.7f);
+    
+    std::vector<float> psf(size * size);
+    for (size_t j = 0; j < size; ++j){
+        for (size_t i = 0; i < size; ++i){
+            const float rx = (float)i - radius, ry = (float)j - radius;
+            psf[j * size + i] = expf(-(rx * rx + ry * ry) / (2 * 2.0f * 2.0f));
+        }
+    }
+    double total = 0;
+    for (size_t i = 0; i < psf.size(); ++i){
+        total += psf[i];
+    }
+    for (size_t i = 0; i < psf.size(); ++i){
+        psf[i] /= total;
+    }
+    
+    std::vector<float> blurred(width * height), restored(width * height);
+    CAS_CHECK(CASFFTConvolve(sharp.data(), blurred.data(), width, height, psf.data(), size, size));
+    
+    // the psf measured from the isolated bright star matches the one used, once normalised
+    std::vector<float> measured(size * size);
+    CAS_CHECK(CASFFTMeasurePSF(blurred.data(), width, height, 31, 50, radius, measured.data()));
+    CAS_CHECK(!CASFFTMeasurePSF(blurred.data(), width, height, 3, 50, radius, measured.data()));
+    for (size_t i = 0; i < psf.size(); ++i){
+        CAS_CHECK(fabs(measured[i] - psf[i]) < 0.005f);
+    }
+    
+    CAS_CHECK(CASFFTRichardsonLucy(blurred.data(), restored.data(), width, height, psf.data(), size, size, 30, CASParallelApply));
+    
+    // the stars are brought back up towards their original peaks, keeping the flux and the sky
+    const float blurredPeak = blurred[50 * width + 31], restoredPeak = restored[50 * width + 31], sharpPeak = sharp[50 * width + 31];
+    CAS_CHECK(restoredPeak - 0.05f > 2 * (blurredPeak - 0.05f));
+    CAS_CHECK(restoredPeak < sharpPeak);
+    double blurredTotal = 0, restoredTotal = 0;
+    for (size_t i = 0; i < width * height; ++i){
+        blurredTotal += blurred[i];
+        restoredTotal += restored[i];
+    }
+    CAS_CHECK_CLOSE(restoredTotal, blurredTotal, 0.01);
+    CAS_CHECK_CLOSE(restored[2 * width + 70], 0.05f, 0.02);
+}
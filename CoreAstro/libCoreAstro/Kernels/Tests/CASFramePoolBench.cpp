@@ -0,0 +1,51 @@
+//
+//  CASFramePoolBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Getting a fresh frame buffer and writing it once, as a camera read does, from malloc and from the pool.
+
+
+#include "CASTestSupport.h"
+#include "CASFramePool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// called through a pointer so the compiler can't see that the buffers are never read and drop the lot
+static void* (*volatile sFramePoolFill)(void*, int, size_t) = memset;
+
+CAS_BENCH(FramePool)
+{
+    const size_t bytes = ctx.pixelCount() * sizeof(float);
+    
+    ctx.measure("malloc and fill", bytes, [&]{
+        void* buffer = malloc(bytes);
+        sFramePoolFill(buffer, 0, bytes);
+        free(buffer);
+    });
+    ctx.measure("pool and fill", bytes, [&]{
+        void* buffer = CASFramePoolAllocate(bytes);
+        sFramePoolFill(buffer, 0, bytes);
+        CASFramePoolFree(buffer);
+    });
+    CASFramePoolTrim();
+}
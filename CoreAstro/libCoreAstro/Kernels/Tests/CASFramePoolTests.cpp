@@ -0,0 +1,182 @@
+//
+//  CASFramePoolTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#include "CASTestSupport.h"
+#include "CASFramePool.h"
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static const size_t kFrame = 1392 * 1040 * sizeof(float);
+
+// each test starts from an empty cache and no limit so they don't depend on each other or the host's memory
+static void CASFramePoolTestReset(size_t limit = 0)
+{
+    CASFramePoolTrim();
+    CASFramePoolSetLimit(limit);
+    CASFramePoolResetStatistics();
+}
+
+CAS_TEST(FramePoolReusesFreedBuffers)
+{
+    CASFramePoolTestReset();
+    
+    void* first = CASFramePoolAllocate(kFrame);
+    CAS_CHECK(first != NULL);
+    CAS_CHECK(((uintptr_t)first % CAS_FRAME_POOL_ALIGNMENT) == 0);
+    memset(first, 0xff, kFrame);
+    CASFramePoolFree(first);
+    
+    // same size comes back as the same buffer, and so does anything else in its size class
+    void* second = CASFramePoolAllocate(kFrame);
+    CAS_CHECK(second == first);
+    CASFramePoolFree(second);
+    void* third = CASFramePoolAllocate(kFrame - 100);
+    CAS_CHECK(third == first);
+    CASFramePoolFree(third);
+    
+    const CASFramePoolStatistics stats = CASFramePoolGetStatistics();
+    CAS_CHECK(stats.allocations == 3 && stats.reuses == 2 && stats.failures == 0);
+    CAS_CHECK(stats.bytesInUse == 0);
+    CAS_CHECK(stats.bytesCached == CASFramePoolCapacity(first));
+    CAS_CHECK(stats.highWaterInUse == CASFramePoolCapacity(first));
+    
+    CASFramePoolTrim();
+    CAS_CHECK(CASFramePoolGetStatistics().bytesCached == 0);
+}
+
+CAS_TEST(FramePoolSizeClasses)
+{
+    CASFramePoolTestReset();
+    
+    const size_t sizes[] = { 1, 100, CAS_FRAME_POOL_MIN_SIZE - 1, CAS_FRAME_POOL_MIN_SIZE, CAS_FRAME_POOL_MIN_SIZE + 1, 3000000, kFrame, 4096 * 4096 * 4 + 3 };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i){
+        void* buffer = CASFramePoolAllocate(sizes[i]);
+        const size_t capacity = CASFramePoolCapacity(buffer);
+        CAS_CHECK(buffer != NULL);
+        CAS_CHECK(capacity >= sizes[i]);
+        if (sizes[i] >= CAS_FRAME_POOL_MIN_SIZE){
+            CAS_CHECK(capacity - sizes[i] <= sizes[i] / CAS_FRAME_POOL_CLASSES_PER_DOUBLING);
+        }
+        memset(buffer, 0, sizes[i]);
+        CASFramePoolFree(buffer);
+    }
+    
+    // small buffers aren't kept
+    CASFramePoolTrim();
+    void* small = CASFramePoolAllocate(1024);
+    CASFramePoolFree(small);
+    CAS_CHECK(CASFramePoolGetStatistics().bytesCached == 0);
+    
+    CAS_CHECK(CASFramePoolCapacity(NULL) == 0);
+    CASFramePoolFree(NULL);
+}
+
+CAS_TEST(FramePoolKeepsAFewPerClass)
+{
+    CASFramePoolTestReset();
+    
+    std::vector<void*> buffers;
+    for (int i = 0; i < CAS_FRAME_POOL_CACHED_PER_CLASS + 3; ++i){
+        buffers.push_back(CASFramePoolAllocate(kFrame));
+    }
+    const size_t capacity = CASFramePoolCapacity(buffers[0]);
+    for (size_t i = 0; i < buffers.size(); ++i){
+        CASFramePoolFree(buffers[i]);
+    }
+    
+    const CASFramePoolStatistics stats = CASFramePoolGetStatistics();
+    CAS_CHECK(stats.bytesCached == capacity * CAS_FRAME_POOL_CACHED_PER_CLASS);
+    CAS_CHECK(stats.highWaterInUse == capacity * buffers.size());
+    CASFramePoolTrim();
+}
+
+CAS_TEST(FramePoolEnforcesLimit)
+{
+    const size_t capacity = kFrame + kFrame / 8; // room for one frame and a bit, not two
+    CASFramePoolTestReset(capacity);
+    
+    void* first = CASFramePoolAllocate(kFrame);
+    CAS_CHECK(first != NULL);
+    CAS_CHECK(CASFramePoolAllocate(kFrame) == NULL);
+    CAS_CHECK(CASFramePoolGetStatistics().failures == 1);
+    
+    // a cached buffer of another size gets dropped to make room
+    CASFramePoolFree(first);
+    void* other = CASFramePoolAllocate(kFrame / 2);
+    CAS_CHECK(other != NULL);
+    CASFramePoolFree(other);
+    void* again = CASFramePoolAllocate(kFrame);
+    CAS_CHECK(again != NULL);
+    
+    const CASFramePoolStatistics stats = CASFramePoolGetStatistics();
+    CAS_CHECK(stats.bytesInUse + stats.bytesCached <= capacity);
+    CAS_CHECK(stats.highWaterTotal <= capacity);
+    CASFramePoolFree(again);
+    
+    // lowering the limit drops what's cached over it
+    CASFramePoolSetLimit(1024);
+    CAS_CHECK(CASFramePoolGetStatistics().bytesCached == 0);
+    CAS_CHECK(CASFramePoolAllocate(kFrame) == NULL);
+    
+    CASFramePoolTestReset();
+}
+
+CAS_TEST(FramePoolThreads)
+{
+    CASFramePoolTestReset();
+    
+    // checks can't throw out of a thread so count the problems and check them afterwards
+    std::atomic<int> problems(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t){
+        threads.push_back(std::thread([t,&problems](){
+            CASTestRandom random(t + 1);
+            for (int i = 0; i < 200; ++i){
+                const size_t size = CAS_FRAME_POOL_MIN_SIZE + random.next() % (4 * CAS_FRAME_POOL_MIN_SIZE);
+                unsigned char* buffer = (unsigned char*)CASFramePoolAllocate(size);
+                if (!buffer || CASFramePoolCapacity(buffer) < size){
+                    ++problems;
+                    continue;
+                }
+                buffer[0] = buffer[size - 1] = (unsigned char)t;
+                std::this_thread::yield();
+                if (buffer[0] != t || buffer[size - 1] != t){
+                    ++problems;
+                }
+                CASFramePoolFree(buffer);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t){
+        threads[t].join();
+    }
+    
+    const CASFramePoolStatistics stats = CASFramePoolGetStatistics();
+    CAS_CHECK(problems == 0);
+    CAS_CHECK(stats.bytesInUse == 0 && stats.allocations == 800);
+    CASFramePoolTrim();
+}
@@ -0,0 +1,48 @@
+//
+//  CASGaussianBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Gaussian blurs either side of the switch to the recursive filter, and the unsharp mask.
+
+#include "CASTestSupport.h"
+#include "CASGaussian.h"
+
+CAS_BENCH(Gaussian)
+{
+    const size_t count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<float> in(count), out(count);
+    CASTestFill(in, random);
+    
+    const float sigmas[] = { 1, CAS_GAUSSIAN_MAX_DIRECT_SIGMA, 10, 50 };
+    for (size_t s = 0; s < sizeof(sigmas)/sizeof(sigmas[0]); ++s){
+        char label[64];
+        snprintf(label, sizeof(label), "blur sigma %g", sigmas[s]);
+        ctx.measure(label, count * 2 * sizeof(float), [&]{
+            CASGaussianBlur(in.data(), out.data(), ctx.width, ctx.height, sigmas[s]);
+        });
+    }
+    ctx.measure("unsharp mask sigma 2", count * 2 * sizeof(float), [&]{
+        CASGaussianUnsharpMask(in.data(), out.data(), ctx.width, ctx.height, 2, 1);
+    });
+}
@@ -0,0 +1,245 @@
+//
+//  CASGaussianTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASGaussian.h"
+#include <algorithm>
+
+static void CASGaussianApplyBackwards(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = count; i-- > 0;){
+        work(context, i);
+    }
+}
+
+// straightforward separable convolution in double precision with a kernel out to 4 sigma
+static std::vector<float> CASTestGaussianReference(const std::vector<float>& in, size_t width, size_t height, double sigma)
+{
+    const int radius = (int)ceil(4 * sigma);
+    std::vector<double> weights(2 * radius + 1);
+    double total = 0;
+    for (int i = -radius; i <= radius; ++i){
+        total += weights[i + radius] = exp(-(i * i) / (2 * sigma * sigma));
+    }
+    std::vector<double> vertical(in.size());
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            double sum = 0;
+            for (int k = -radius; k <= radius; ++k){
+                const ptrdiff_t yy = std::min<ptrdiff_t>(height - 1, std::max<ptrdiff_t>(0, (ptrdiff_t)y + k));
+                sum += weights[k + radius] * in[yy * width + x];
+            }
+            vertical[y * width + x] = sum / total;
+        }
+    }
+    std::vector<float> out(in.size());
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            double sum = 0;
+            for (int k = -radius; k <= radius; ++k){
+                const ptrdiff_t xx = std::min<ptrdiff_t>(width - 1, std::max<ptrdiff_t>(0, (ptrdiff_t)x + k));
+                sum += weights[k + radius] * vertical[y * width + xx];
+            }
+            out[y * width + x] = sum / total;
+        }
+    }
+    return out;
+}
+
+static double CASTestMaxDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+    double max = 0;
+    for (size_t i = 0; i < a.size(); ++i){
+        max = std::max(max, fabs((double)a[i] - b[i]));
+    }
+    return max;
+}
+
+CAS_TEST(KernelsGaussianKernels)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const float weights[5] = { 0.25f, 1.5f, -0.9f, 0.15f, 0.5f };
+    CASTestRandom random;
+    for (size_t count = 0; count < 40; count += 3){
+        std::vector<float> in(count), out(count), rows(5 * count);
+        CASTestFill(in, random);
+        CASTestFill(out, random);
+        CASTestFill(rows, random);
+        const float* rowPointers[5];
+        for (size_t k = 0; k < 5; ++k){
+            rowPointers[k] = rows.data() + k * count;
+        }
+        
+        std::vector<float> expectedSum(out), expectedConvolve(count);
+        scalar->weightedSum(expectedSum.data(), -0.5f, in.data(), 1.5f, 0.125f, count);
+        scalar->convolve(expectedConvolve.data(), rowPointers, weights, 5, count);
+        for (size_t i = 0; i < count; ++i){
+            CAS_CHECK_CLOSE(expectedSum[i], -0.5 * out[i] + 1.5 * in[i] + 0.125, 1e-6);
+            double sum = 0;
+            for (size_t k = 0; k < 5; ++k){
+                sum += weights[k] * rowPointers[k][i];
+            }
+            CAS_CHECK_CLOSE(expectedConvolve[i], sum, 1e-5);
+        }
+        
+        for (int isa = kCASKernelISAScalar + 1; isa < kCASKernelISACount; ++isa){
+            const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+            if (table){
+                std::vector<float> sum(out), convolved(count);
+                table->weightedSum(sum.data(), -0.5f, in.data(), 1.5f, 0.125f, count);
+                table->convolve(convolved.data(), rowPointers, weights, 5, count);
+                CAS_CHECK(sum == expectedSum);
+                CAS_CHECK(convolved == expectedConvolve);
+                
+                // in place, as the recursive filter uses it
+                std::vector<float> inPlace(rows);
+                float* first = inPlace.data();
+                const float* inPlaceRows[5] = { first, rowPointers[1], rowPointers[2], rowPointers[3], rowPointers[4] };
+                table->convolve(first, inPlaceRows, weights, 5, count);
+                CAS_CHECK(std::equal(first, first + count, expectedConvolve.begin()));
+            }
+        }
+    }
+}
+
+CAS_TEST(KernelsRecursiveStep)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const double c[4] = { 0.01, 2.5, -2.1, 0.59 };
+    CASTestRandom random;
+    for (size_t count = 0; count < 40; count += 3){
+        std::vector<float> in(count);
+        CASTestFill(in, random);
+        std::vector<double> previous(3 * count);
+        for (size_t i = 0; i < previous.size(); ++i){
+            previous[i] = random.unit();
+        }
+        const double* previousRows[3] = { previous.data(), previous.data() + count, previous.data() + 2 * count };
+        
+        std::vector<float> expected(count);
+        std::vector<double> expectedState(count);
+        scalar->recursiveStep(expected.data(), expectedState.data(), in.data(), previousRows, c, count);
+        for (size_t i = 0; i < count; ++i){
+            const double v = c[0] * in[i] + c[1] * previousRows[0][i] + c[2] * previousRows[1][i] + c[3] * previousRows[2][i];
+            CAS_CHECK_CLOSE(expectedState[i], v, 1e-12);
+            CAS_CHECK(expected[i] == (float)expectedState[i]);
+        }
+        
+        for (int isa = kCASKernelISAScalar + 1; isa < kCASKernelISACount; ++isa){
+            const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+            if (table){
+                std::vector<float> actual(in);
+                std::vector<double> state(count);
+                table->recursiveStep(actual.data(), state.data(), actual.data(), previousRows, c, count);
+                CAS_CHECK(actual == expected);
+                CAS_CHECK(state == expectedState);
+            }
+        }
+    }
+}
+
+CAS_TEST(GaussianDirectMatchesReference)
+{
+    CASTestRandom random;
+    const size_t width = 37, height = 23;
+    std::vector<float> in(width * height), out(in.size());
+    CASTestFill(in, random);
+    
+    const float sigmas[] = { 0.5f, 1.2f, CAS_GAUSSIAN_MAX_DIRECT_SIGMA };
+    for (size_t s = 0; s < sizeof(sigmas)/sizeof(sigmas[0]); ++s){
+        CAS_CHECK(CASGaussianBlur(in.data(), out.data(), width, height, sigmas[s]));
+        // the sampled kernel stops at 3 sigma rather than 4
+        CAS_CHECK(CASTestMaxDifference(out, CASTestGaussianReference(in, width, height, sigmas[s])) < 2e-3);
+    }
+    
+    CAS_CHECK(CASGaussianBlur(in.data(), out.data(), width, height, 0));
+    CAS_CHECK(out == in);
+    CAS_CHECK(!CASGaussianBlur(in.data(), out.data(), width, height, -1));
+}
+
+CAS_TEST(GaussianRecursiveApproximatesReference)
+{
+    CASTestRandom random;
+    const size_t width = 211, height = 97;
+    std::vector<float> in(width * height), out(in.size());
+    CASTestFill(in, random);
+    
+    // a bright star on a gradient, as well as noise
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            in[y * width + x] = 0.1f * in[y * width + x] + 0.3f * x / width + ((x == 100 && y == 50) ? 1.0f : 0.0f);
+        }
+    }
+    
+    const float sigmas[] = { 3.5f, 8, 25 };
+    for (size_t s = 0; s < sizeof(sigmas)/sizeof(sigmas[0]); ++s){
+        CAS_CHECK(CASGaussianBlur(in.data(), out.data(), width, height, sigmas[s]));
+        const double error = CASTestMaxDifference(out, CASTestGaussianReference(in, width, height, sigmas[s]));
+        CAS_CHECK(error < 2e-3);
+    }
+    
+    // flat areas stay flat
+    std::vector<float> flat(in.size(), 0.25f);
+    CAS_CHECK(CASGaussianBlur(flat.data(), out.data(), width, height, 40));
+    CAS_CHECK(CASTestMaxDifference(out, flat) < 1e-5);
+}
+
+CAS_TEST(GaussianIgnoresChunkOrder)
+{
+    CASTestRandom random;
+    const size_t width = 3000, height = 150;
+    std::vector<float> in(width * height), forwards(in.size()), backwards(in.size());
+    CASTestFill(in, random);
+    const float sigmas[] = { 2, 10 };
+    for (size_t s = 0; s < sizeof(sigmas)/sizeof(sigmas[0]); ++s){
+        CAS_CHECK(CASGaussianBlur(in.data(), forwards.data(), width, height, sigmas[s]));
+        CAS_CHECK(CASGaussianBlur(in.data(), backwards.data(), width, height, sigmas[s], CASGaussianApplyBackwards));
+        CAS_CHECK(forwards == backwards);
+    }
+}
+
+CAS_TEST(GaussianDerivedFilters)
+{
+    CASTestRandom random;
+    const size_t width = 64, height = 48;
+    std::vector<float> in(width * height), blur(in.size()), blur2(in.size()), out(in.size());
+    CASTestFill(in, random);
+    
+    CAS_CHECK(CASGaussianBlur(in.data(), blur.data(), width, height, 2));
+    CAS_CHECK(CASGaussianUnsharpMask(in.data(), out.data(), width, height, 2, 0.7f));
+    for (size_t i = 0; i < in.size(); ++i){
+        CAS_CHECK_CLOSE(out[i], in[i] + 0.7 * (in[i] - blur[i]), 1e-5);
+    }
+    
+    CAS_CHECK(CASGaussianSubtractBackground(in.data(), out.data(), width, height, 2, 0.1f));
+    for (size_t i = 0; i < in.size(); ++i){
+        CAS_CHECK_CLOSE(out[i], in[i] - blur[i] + 0.1, 1e-5);
+    }
+    
+    CAS_CHECK(CASGaussianBlur(in.data(), blur2.data(), width, height, 6));
+    CAS_CHECK(CASGaussianDifference(in.data(), out.data(), width, height, 2, 6));
+    for (size_t i = 0; i < in.size(); ++i){
+        CAS_CHECK_CLOSE(out[i], blur[i] - blur2[i], 1e-5);
+    }
+}
@@ -0,0 +1,61 @@
+//
+//  CASHistogramBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Full resolution histograms of mono and colour frames against a naive single pass.
+
+#include "CASTestSupport.h"
+#include "CASHistogram.h"
+
+CAS_BENCH(Histogram)
+{
+    const size_t count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<uint16_t> shorts(count);
+    std::vector<float> floats(count), rgba(count * 4);
+    for (size_t i = 0; i < count; ++i){
+        shorts[i] = 2000 + (random.next() % 200);
+        floats[i] = shorts[i] / 65535.0f;
+    }
+    for (size_t i = 0; i < rgba.size(); ++i){
+        rgba[i] = floats[i / 4];
+    }
+    
+    // what histogram: did, 256 bins from the floats
+    std::vector<uint32_t> histogram(3 * CAS_HISTOGRAM_BINS);
+    ctx.measure("256 bin float", count * sizeof(float), [&]{
+        std::fill(histogram.begin(), histogram.begin() + 256, 0);
+        for (size_t i = 0; i < count; ++i){
+            ++histogram[std::min(255, (int)(floats[i] * 256))];
+        }
+    });
+    ctx.measure("65536 bin uint16", count * sizeof(uint16_t), [&]{
+        CASHistogramCompute(shorts.data(), count, 1, 1, histogram.data());
+    });
+    ctx.measure("65536 bin float", count * sizeof(float), [&]{
+        CASHistogramCompute(floats.data(), count, 1, 1, histogram.data());
+    });
+    ctx.measure("65536 bin rgba float", count * 4 * sizeof(float), [&]{
+        CASHistogramCompute(rgba.data(), count, 4, 3, histogram.data());
+    });
+}
@@ -0,0 +1,114 @@
+//
+//  CASHistogramTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASHistogram.h"
+#include "CASStatistics.h"
+
+static void CASHistogramApplyBackwards(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = count; i-- > 0;){
+        work(context, i);
+    }
+}
+
+CAS_TEST(HistogramU16MatchesCounting)
+{
+    const size_t counts[] = { 1, 1000, 3 * CAS_HISTOGRAM_CHUNK_PIXELS + 7 };
+    CASTestRandom random;
+    for (size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c){
+        
+        // mono and interleaved RGBA where the alpha isn't binned
+        const size_t pixelCount = counts[c];
+        for (size_t stride = 1; stride <= 4; stride += 3){
+            
+            const size_t channelCount = (stride == 1) ? 1 : 3;
+            std::vector<uint16_t> pixels(pixelCount * stride);
+            CASTestFill(pixels, random);
+            
+            std::vector<uint32_t> expected(channelCount * CAS_HISTOGRAM_BINS);
+            for (size_t i = 0; i < pixelCount; ++i){
+                for (size_t ch = 0; ch < channelCount; ++ch){
+                    ++expected[ch * CAS_HISTOGRAM_BINS + pixels[i * stride + ch]];
+                }
+            }
+            
+            std::vector<uint32_t> actual(expected.size(), 123);
+            CAS_CHECK(CASHistogramCompute(pixels.data(), pixelCount, stride, channelCount, actual.data()));
+            CAS_CHECK(actual == expected);
+            
+            std::vector<uint32_t> backwards(expected.size());
+            CAS_CHECK(CASHistogramCompute(pixels.data(), pixelCount, stride, channelCount, backwards.data(), CASHistogramApplyBackwards));
+            CAS_CHECK(backwards == expected);
+        }
+    }
+}
+
+CAS_TEST(HistogramFloatBinsAsSamples)
+{
+    CASTestRandom random;
+    const size_t pixelCount = 5000;
+    std::vector<uint16_t> samples(pixelCount * 4);
+    CASTestFill(samples, random);
+    std::vector<float> pixels(samples.size());
+    for (size_t i = 0; i < samples.size(); ++i){
+        pixels[i] = samples[i] / 65535.0f;
+    }
+    
+    std::vector<uint32_t> expected(3 * CAS_HISTOGRAM_BINS), actual(expected.size());
+    CASHistogramCompute(samples.data(), pixelCount, 4, 3, expected.data());
+    CASHistogramCompute(pixels.data(), pixelCount, 4, 3, actual.data());
+    CAS_CHECK(actual == expected);
+    
+    // out of range values are clamped and NaNs go in the bottom bin
+    const float odd[] = { -0.5f, 2.0f, NAN };
+    CASHistogramCompute(odd, 3, 1, 1, actual.data());
+    CAS_CHECK(actual[0] == 2 && actual[CAS_HISTOGRAM_BINS - 1] == 1);
+}
+
+CAS_TEST(HistogramReduce)
+{
+    std::vector<uint32_t> histogram(CAS_HISTOGRAM_BINS, 1);
+    histogram[CAS_HISTOGRAM_BINS - 1] = 10;
+    uint32_t reduced[256];
+    CASHistogramReduce(histogram.data(), reduced, 256);
+    CAS_CHECK(reduced[0] == 256 && reduced[254] == 256 && reduced[255] == 265);
+}
+
+CAS_TEST(StatisticsFromHistogram)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> pixels(10001);
+    CASTestFill(pixels, random);
+    std::vector<uint32_t> histogram(CAS_HISTOGRAM_BINS);
+    CASHistogramCompute(pixels.data(), pixels.size(), 1, 1, histogram.data());
+    
+    CASStatistics fromPixels, fromHistogram;
+    CAS_CHECK(CASStatisticsCompute(pixels.data(), pixels.size(), 1, fromPixels));
+    CAS_CHECK(CASStatisticsFromHistogram(histogram.data(), 1, fromHistogram));
+    CAS_CHECK(fromPixels.median == fromHistogram.median && fromPixels.mean == fromHistogram.mean && fromPixels.histogram == fromHistogram.histogram);
+    
+    std::fill(histogram.begin(), histogram.end(), 0);
+    CAS_CHECK(!CASStatisticsFromHistogram(histogram.data(), 1, fromHistogram));
+}
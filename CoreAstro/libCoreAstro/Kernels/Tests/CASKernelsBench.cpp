@@ -0,0 +1,150 @@
+//
+//  CASKernelsBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Times each kernel for every ISA the host supports.
+
+#include "CASTestSupport.h"
+#include "CASKernels.h"
+
+// number of frames combined by the average benchmark
+#define CAS_BENCH_AVERAGE_PLANES 4
+
+static std::vector<const CASKernelTable*> CASBenchTables()
+{
+    std::vector<const CASKernelTable*> tables;
+    for (int isa = 0; isa < kCASKernelISACount; ++isa){
+        const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+        if (table){
+            tables.push_back(table);
+        }
+    }
+    return tables;
+}
+
+CAS_BENCH(KernelsInvert)
+{
+    CASTestRandom random;
+    std::vector<float> pixels(ctx.pixelCount());
+    CASTestFill(pixels, random);
+    const std::vector<const CASKernelTable*> tables = CASBenchTables();
+    for (size_t t = 0; t < tables.size(); ++t){
+        ctx.measure(tables[t]->name, 2.0 * pixels.size() * sizeof(float), [&]{
+            tables[t]->invert(pixels.data(), pixels.size());
+        });
+    }
+}
+
+CAS_BENCH(KernelsSum)
+{
+    CASTestRandom random;
+    std::vector<float> pixels(ctx.pixelCount());
+    CASTestFill(pixels, random);
+    const std::vector<const CASKernelTable*> tables = CASBenchTables();
+    for (size_t t = 0; t < tables.size(); ++t){
+        volatile double sink = 0;
+        ctx.measure(tables[t]->name, pixels.size() * sizeof(float), [&]{
+            sink = tables[t]->sum(pixels.data(), pixels.size());
+        });
+        (void)sink;
+    }
+}
+
+CAS_BENCH(KernelsDivideFlat)
+{
+    CASTestRandom random;
+    std::vector<float> pixels(ctx.pixelCount()), flat(ctx.pixelCount());
+    CASTestFill(pixels, random);
+    CASTestFill(flat, random);
+    const std::vector<const CASKernelTable*> tables = CASBenchTables();
+    for (size_t t = 0; t < tables.size(); ++t){
+        ctx.measure(tables[t]->name, 3.0 * pixels.size() * sizeof(float), [&]{
+            tables[t]->divideFlat(pixels.data(), flat.data(), 1.0f, pixels.size());
+        });
+    }
+}
+
+CAS_BENCH(KernelsAverage)
+{
+    CASTestRandom random;
+    std::vector<std::vector<float> > storage(CAS_BENCH_AVERAGE_PLANES, std::vector<float>(ctx.pixelCount()));
+    std::vector<const float*> planes;
+    for (size_t j = 0; j < storage.size(); ++j){
+        CASTestFill(storage[j], random);
+        planes.push_back(storage[j].data());
+    }
+    std::vector<float> out(ctx.pixelCount());
+    const std::vector<const CASKernelTable*> tables = CASBenchTables();
+    for (size_t t = 0; t < tables.size(); ++t){
+        ctx.measure(tables[t]->name, (planes.size() + 1.0) * out.size() * sizeof(float), [&]{
+            tables[t]->average(planes.data(), planes.size(), out.data(), out.size());
+        });
+    }
+}
+
+CAS_BENCH(KernelsLuminance)
+{
+    CASTestRandom random;
+    std::vector<float> rgba(ctx.pixelCount() * 4), out(ctx.pixelCount());
+    CASTestFill(rgba, random);
+    const std::vector<const CASKernelTable*> tables = CASBenchTables();
+    for (size_t t = 0; t < tables.size(); ++t){
+        ctx.measure(tables[t]->name, 5.0 * out.size() * sizeof(float), [&]{
+            tables[t]->luminance(rgba.data(), out.data(), out.size());
+        });
+    }
+}
+
+CAS_BENCH(KernelsWidenU16)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> in(ctx.pixelCount());
+    std::vector<float> out(ctx.pixelCount());
+    for (size_t i = 0; i < in.size(); ++i){
+        in[i] = random.sample();
+    }
+    const std::vector<const CASKernelTable*> tables = CASBenchTables();
+    for (size_t t = 0; t < tables.size(); ++t){
+        ctx.measure(tables[t]->name, (sizeof(uint16_t) + sizeof(float)) * out.size(), [&]{
+            tables[t]->widenU16(in.data(), 65535, out.data(), out.size());
+        });
+    }
+}
+
+CAS_BENCH(KernelsHalveU16)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> in(ctx.pixelCount()), out(ctx.pixelCount() / 4);
+    for (size_t i = 0; i < in.size(); ++i){
+        in[i] = random.sample();
+    }
+    const size_t width = ctx.width & ~(size_t)1;
+    const std::vector<const CASKernelTable*> tables = CASBenchTables();
+    for (size_t t = 0; t < tables.size(); ++t){
+        ctx.measure(tables[t]->name, sizeof(uint16_t) * in.size(), [&]{
+            for (size_t y = 0; y + 1 < ctx.height; y += 2){
+                tables[t]->halveU16(&in[y * ctx.width], &in[(y + 1) * ctx.width], &out[(y / 2) * (width / 2)], width / 2);
+            }
+        });
+    }
+}
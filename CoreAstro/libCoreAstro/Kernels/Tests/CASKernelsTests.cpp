@@ -0,0 +1,247 @@
+//
+//  CASKernelsTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Checks every SIMD kernel table the host supports against the scalar reference.
+
+#include "CASTestSupport.h"
+#include "CASKernels.h"
+#include <algorithm>
+
+// lengths chosen to exercise the vector bodies, the scalar tails and the averaging block boundary
+static const size_t kCASTestLengths[] = { 0, 1, 3, 4, 7, 8, 15, 17, 31, 1023, 1024, 1025, 4099 };
+
+static std::vector<const CASKernelTable*> CASTestTables()
+{
+    std::vector<const CASKernelTable*> tables;
+    for (int isa = kCASKernelISAScalar + 1; isa < kCASKernelISACount; ++isa){
+        const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+        if (table){
+            tables.push_back(table);
+        }
+    }
+    return tables;
+}
+
+CAS_TEST(KernelsDefaultTable)
+{
+    const CASKernelTable& kernels = CASKernels();
+    CAS_CHECK(CASKernelsForISA(kernels.isa) == &kernels);
+    CAS_CHECK(CASKernelsForISA(kCASKernelISAScalar) != NULL);
+    printf("     using %s kernels\n", kernels.name);
+}
+
+CAS_TEST(KernelsInvert)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const std::vector<const CASKernelTable*> tables = CASTestTables();
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(kCASTestLengths)/sizeof(kCASTestLengths[0]); ++l){
+        std::vector<float> input(kCASTestLengths[l]);
+        CASTestFill(input, random);
+        std::vector<float> expected(input);
+        scalar->invert(expected.data(), expected.size());
+        for (size_t t = 0; t < tables.size(); ++t){
+            std::vector<float> actual(input);
+            tables[t]->invert(actual.data(), actual.size());
+            CAS_CHECK(actual == expected);
+        }
+    }
+}
+
+CAS_TEST(KernelsSum)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const std::vector<const CASKernelTable*> tables = CASTestTables();
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(kCASTestLengths)/sizeof(kCASTestLengths[0]); ++l){
+        std::vector<float> input(kCASTestLengths[l]);
+        CASTestFill(input, random);
+        const double expected = scalar->sum(input.data(), input.size());
+        for (size_t t = 0; t < tables.size(); ++t){
+            CAS_CHECK_CLOSE(tables[t]->sum(input.data(), input.size()), expected, 1e-6);
+        }
+    }
+}
+
+CAS_TEST(KernelsDivideFlat)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const std::vector<const CASKernelTable*> tables = CASTestTables();
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(kCASTestLengths)/sizeof(kCASTestLengths[0]); ++l){
+        std::vector<float> input(kCASTestLengths[l]), flat(kCASTestLengths[l]);
+        CASTestFill(input, random);
+        CASTestFill(flat, random);
+        for (size_t i = 0; i < flat.size(); i += 5){
+            flat[i] = 0; // dead pixels in the flat must leave the light untouched
+        }
+        std::vector<float> expected(input);
+        scalar->divideFlat(expected.data(), flat.data(), 0.5f, expected.size());
+        for (size_t i = 0; i < flat.size(); i += 5){
+            CAS_CHECK(expected[i] == input[i]);
+        }
+        for (size_t t = 0; t < tables.size(); ++t){
+            std::vector<float> actual(input);
+            tables[t]->divideFlat(actual.data(), flat.data(), 0.5f, actual.size());
+            for (size_t i = 0; i < actual.size(); ++i){
+                CAS_CHECK_CLOSE(actual[i], expected[i], 1e-6);
+            }
+        }
+    }
+}
+
+CAS_TEST(KernelsAverage)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const std::vector<const CASKernelTable*> tables = CASTestTables();
+    CASTestRandom random;
+    const size_t planeCounts[] = { 1, 2, 5 };
+    for (size_t p = 0; p < sizeof(planeCounts)/sizeof(planeCounts[0]); ++p){
+        for (size_t l = 0; l < sizeof(kCASTestLengths)/sizeof(kCASTestLengths[0]); ++l){
+            const size_t count = kCASTestLengths[l];
+            std::vector<std::vector<float> > storage(planeCounts[p], std::vector<float>(count));
+            std::vector<const float*> planes;
+            for (size_t j = 0; j < storage.size(); ++j){
+                CASTestFill(storage[j], random);
+                planes.push_back(storage[j].data());
+            }
+            std::vector<float> expected(count);
+            scalar->average(planes.data(), planes.size(), expected.data(), count);
+            for (size_t i = 0; i < count; ++i){
+                double total = 0;
+                for (size_t j = 0; j < storage.size(); ++j){
+                    total += storage[j][i];
+                }
+                CAS_CHECK_CLOSE(expected[i], total / storage.size(), 1e-6);
+            }
+            for (size_t t = 0; t < tables.size(); ++t){
+                std::vector<float> actual(count);
+                tables[t]->average(planes.data(), planes.size(), actual.data(), count);
+                for (size_t i = 0; i < count; ++i){
+                    CAS_CHECK_CLOSE(actual[i], expected[i], 1e-6);
+                }
+            }
+        }
+    }
+}
+
+CAS_TEST(KernelsLuminance)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const std::vector<const CASKernelTable*> tables = CASTestTables();
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(kCASTestLengths)/sizeof(kCASTestLengths[0]); ++l){
+        const size_t count = kCASTestLengths[l];
+        std::vector<float> rgba(count * 4);
+        CASTestFill(rgba, random);
+        for (size_t i = 0; i < rgba.size(); i += 7){
+            rgba[i] *= 3; // some out of range values to exercise the clamp
+        }
+        std::vector<float> expected(count);
+        scalar->luminance(rgba.data(), expected.data(), count);
+        for (size_t i = 0; i < count; ++i){
+            CAS_CHECK(expected[i] <= 1.0f);
+        }
+        for (size_t t = 0; t < tables.size(); ++t){
+            std::vector<float> actual(count);
+            tables[t]->luminance(rgba.data(), actual.data(), count);
+            for (size_t i = 0; i < count; ++i){
+                CAS_CHECK_CLOSE(actual[i], expected[i], 1e-6);
+            }
+        }
+    }
+}
+
+CAS_TEST(KernelsWidenU16)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const std::vector<const CASKernelTable*> tables = CASTestTables();
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(kCASTestLengths)/sizeof(kCASTestLengths[0]); ++l){
+        std::vector<uint16_t> input(kCASTestLengths[l]);
+        for (size_t i = 0; i < input.size(); ++i){
+            input[i] = random.sample();
+        }
+        if (!input.empty()){
+            input[0] = 65535;
+        }
+        std::vector<float> expected(input.size());
+        scalar->widenU16(input.data(), 65535, expected.data(), expected.size());
+        for (size_t i = 0; i < input.size(); ++i){
+            CAS_CHECK(expected[i] == input[i] / 65535.0f);
+        }
+        for (size_t t = 0; t < tables.size(); ++t){
+            std::vector<float> actual(input.size());
+            tables[t]->widenU16(input.data(), 65535, actual.data(), actual.size());
+            CAS_CHECK(actual == expected);
+        }
+    }
+}
+
+CAS_TEST(KernelsHalve)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    const std::vector<const CASKernelTable*> tables = CASTestTables();
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(kCASTestLengths)/sizeof(kCASTestLengths[0]); ++l){
+        
+        const size_t count = kCASTestLengths[l];
+        std::vector<uint16_t> row0(2 * count), row1(2 * count);
+        for (size_t i = 0; i < row0.size(); ++i){
+            row0[i] = random.sample();
+            row1[i] = random.sample();
+        }
+        if (count){
+            row0[0] = row0[1] = row1[0] = row1[1] = 65535; // the biggest sum
+        }
+        std::vector<uint16_t> expected(count);
+        scalar->halveU16(row0.data(), row1.data(), expected.data(), count);
+        for (size_t i = 0; i < count; ++i){
+            CAS_CHECK(expected[i] == (row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1] + 2) / 4);
+        }
+        for (size_t t = 0; t < tables.size(); ++t){
+            std::vector<uint16_t> actual(count);
+            tables[t]->halveU16(row0.data(), row1.data(), actual.data(), count);
+            CAS_CHECK(actual == expected);
+        }
+        
+        for (size_t channelCount = 1; channelCount <= 4; channelCount += 3){
+            std::vector<float> f0(2 * count * channelCount), f1(f0.size());
+            for (size_t i = 0; i < f0.size(); ++i){
+                f0[i] = random.unit();
+                f1[i] = random.unit();
+            }
+            std::vector<float> expected(count * channelCount);
+            scalar->halveFloat(f0.data(), f1.data(), expected.data(), count, channelCount);
+            if (count){
+                CAS_CHECK_CLOSE(expected[0], (f0[0] + f0[channelCount] + f1[0] + f1[channelCount]) / 4, 1e-6);
+            }
+            for (size_t t = 0; t < tables.size(); ++t){
+                std::vector<float> actual(expected.size());
+                tables[t]->halveFloat(f0.data(), f1.data(), actual.data(), count, channelCount);
+                CAS_CHECK(actual == expected);
+            }
+        }
+    }
+}
@@ -0,0 +1,83 @@
+//
+//  CASMedianFilterBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Compares the median filter engine with the per-pixel nth_element 3x3 filter it replaces.
+
+#include "CASTestSupport.h"
+#include "CASMedianFilter.h"
+#include <algorithm>
+
+CAS_BENCH(Median)
+{
+    const size_t width = ctx.width, height = ctx.height, count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<float> floats(count), floatOut(count);
+    std::vector<uint16_t> shorts(count), shortOut(count);
+    
+    // sky background with noise rather than uniform random values, which would put the median
+    // of each window in a different coarse bin far more often than real frames do
+    for (size_t i = 0; i < count; ++i){
+        shorts[i] = 2000 + (random.next() % 200);
+        floats[i] = shorts[i] / 65535.0f;
+    }
+    
+    ctx.measure("3x3 nth_element", 2.0 * count * sizeof(float), [&]{
+        for (size_t y = 1; y < height - 1; ++y){
+            for (size_t x = 1; x < width - 1; ++x){
+                float window[9];
+                int i = 0;
+                for (size_t y1 = y - 1; y1 <= y + 1; ++y1){
+                    for (size_t x1 = x - 1; x1 <= x + 1; ++x1){
+                        window[i++] = floats[x1 + y1 * width];
+                    }
+                }
+                std::nth_element(window, window + 4, window + 9);
+                floatOut[x + y * width] = window[4];
+            }
+        }
+    });
+    
+    const int radii[] = { 1, 2, 3, 7, 15 };
+    for (size_t r = 0; r < sizeof(radii)/sizeof(radii[0]); ++r){
+        
+        const int radius = radii[r];
+        char label[64];
+        
+        snprintf(label, sizeof(label), "%dx%d float", 2 * radius + 1, 2 * radius + 1);
+        ctx.measure(label, 2.0 * count * sizeof(float), [&]{
+            for (size_t t = 0; t < CASMedianFilterTileCount(height); ++t){
+                const size_t start = t * CAS_MEDIAN_FILTER_TILE_ROWS;
+                CASMedianFilterRows(floats.data(), floatOut.data(), width, height, radius, start, std::min<size_t>(CAS_MEDIAN_FILTER_TILE_ROWS, height - start));
+            }
+        });
+        
+        snprintf(label, sizeof(label), "%dx%d uint16", 2 * radius + 1, 2 * radius + 1);
+        ctx.measure(label, 2.0 * count * sizeof(uint16_t), [&]{
+            for (size_t t = 0; t < CASMedianFilterTileCount(height); ++t){
+                const size_t start = t * CAS_MEDIAN_FILTER_TILE_ROWS;
+                CASMedianFilterRows(shorts.data(), shortOut.data(), width, height, radius, start, std::min<size_t>(CAS_MEDIAN_FILTER_TILE_ROWS, height - start));
+            }
+        });
+    }
+}
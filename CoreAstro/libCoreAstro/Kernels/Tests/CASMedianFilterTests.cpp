@@ -0,0 +1,177 @@
+//
+//  CASMedianFilterTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASMedianFilter.h"
+#include <algorithm>
+
+static inline ptrdiff_t CASTestClamp(ptrdiff_t i, ptrdiff_t count)
+{
+    return std::max<ptrdiff_t>(0, std::min(i, count - 1));
+}
+
+static inline uint16_t CASTestKey(uint16_t v) { return v; }
+static inline uint16_t CASTestKey(float v) { return v <= 0 ? 0 : (v >= 1 ? 65535 : (uint16_t)(v * 65535.0f + 0.5f)); }
+
+// brute force median over an edge extended window, ranking keys rather than values when the filter does
+template <typename T>
+static std::vector<T> CASTestMedian(const std::vector<T>& in, size_t width, size_t height, int radius, bool keyed)
+{
+    std::vector<T> out(in.size());
+    std::vector<T> window;
+    std::vector<uint16_t> keys;
+    for (ptrdiff_t y = 0; y < (ptrdiff_t)height; ++y){
+        for (ptrdiff_t x = 0; x < (ptrdiff_t)width; ++x){
+            window.clear();
+            keys.clear();
+            for (ptrdiff_t dy = -radius; dy <= radius; ++dy){
+                for (ptrdiff_t dx = -radius; dx <= radius; ++dx){
+                    const T v = in[CASTestClamp(y + dy, height) * width + CASTestClamp(x + dx, width)];
+                    window.push_back(v);
+                    keys.push_back(CASTestKey(v));
+                }
+            }
+            if (keyed){
+                std::nth_element(keys.begin(), keys.begin() + keys.size()/2, keys.end());
+                const uint16_t key = keys[keys.size()/2];
+                out[y * width + x] = (sizeof(T) == sizeof(uint16_t)) ? (T)key : (T)(key / 65535.0f);
+            }
+            else {
+                std::nth_element(window.begin(), window.begin() + window.size()/2, window.end());
+                out[y * width + x] = window[window.size()/2];
+            }
+        }
+    }
+    return out;
+}
+
+CAS_TEST(KernelsMedian)
+{
+    const CASKernelTable* scalar = CASKernelsForISA(kCASKernelISAScalar);
+    CASTestRandom random;
+    const size_t count = 37, stride = count + 4;
+    std::vector<float> floats(5 * stride);
+    std::vector<uint16_t> shorts(5 * stride);
+    CASTestFill(floats, random);
+    CASTestFill(shorts, random);
+    const float* floatRows[5];
+    const uint16_t* shortRows[5];
+    for (int y = 0; y < 5; ++y){
+        floatRows[y] = &floats[y * stride];
+        shortRows[y] = &shorts[y * stride];
+    }
+    
+    for (int diameter = 3; diameter <= 5; diameter += 2){
+        
+        std::vector<float> expectedFloats(count);
+        std::vector<uint16_t> expectedShorts(count);
+        (diameter == 3 ? scalar->median3x3 : scalar->median5x5)(floatRows, expectedFloats.data(), count);
+        (diameter == 3 ? scalar->median3x3U16 : scalar->median5x5U16)(shortRows, expectedShorts.data(), count);
+        for (size_t i = 0; i < count; ++i){
+            std::vector<float> fw;
+            std::vector<uint16_t> sw;
+            for (int y = 0; y < diameter; ++y){
+                fw.insert(fw.end(), floatRows[y] + i, floatRows[y] + i + diameter);
+                sw.insert(sw.end(), shortRows[y] + i, shortRows[y] + i + diameter);
+            }
+            std::nth_element(fw.begin(), fw.begin() + fw.size()/2, fw.end());
+            std::nth_element(sw.begin(), sw.begin() + sw.size()/2, sw.end());
+            CAS_CHECK(expectedFloats[i] == fw[fw.size()/2]);
+            CAS_CHECK(expectedShorts[i] == sw[sw.size()/2]);
+        }
+        
+        for (int isa = kCASKernelISAScalar + 1; isa < kCASKernelISACount; ++isa){
+            const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+            if (table){
+                std::vector<float> actualFloats(count);
+                std::vector<uint16_t> actualShorts(count);
+                (diameter == 3 ? table->median3x3 : table->median5x5)(floatRows, actualFloats.data(), count);
+                (diameter == 3 ? table->median3x3U16 : table->median5x5U16)(shortRows, actualShorts.data(), count);
+                CAS_CHECK(actualFloats == expectedFloats);
+                CAS_CHECK(actualShorts == expectedShorts);
+            }
+        }
+    }
+}
+
+CAS_TEST(MedianFilterMatchesBruteForce)
+{
+    const int radii[] = { 0, 1, 2, 3, 4, 7, 12 };
+    const size_t sizes[][2] = { { 1, 1 }, { 3, 2 }, { 23, 17 }, { 150, 9 } };
+    CASTestRandom random;
+    for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s){
+        
+        const size_t width = sizes[s][0], height = sizes[s][1];
+        std::vector<float> floats(width * height);
+        std::vector<uint16_t> shorts(width * height);
+        CASTestFill(floats, random);
+        CASTestFill(shorts, random);
+        
+        // squeeze some of the samples into a narrow range so that windows have lots of samples in the same coarse bin
+        for (size_t i = 0; i < shorts.size(); i += 2){
+            shorts[i] = 0x4200 | (shorts[i] & 0x3f);
+        }
+        
+        for (size_t r = 0; r < sizeof(radii)/sizeof(radii[0]); ++r){
+            
+            const int radius = radii[r];
+            std::vector<float> floatOut(floats.size());
+            std::vector<uint16_t> shortOut(shorts.size());
+            
+            // filter in uneven bands to check that tiles join up
+            for (size_t y = 0; y < height; y += 5){
+                const size_t rows = std::min<size_t>(5, height - y);
+                CASMedianFilterRows(floats.data(), floatOut.data(), width, height, radius, y, rows);
+                CASMedianFilterRows(shorts.data(), shortOut.data(), width, height, radius, y, rows);
+            }
+            
+            CAS_CHECK(floatOut == CASTestMedian(floats, width, height, radius, radius > 2));
+            CAS_CHECK(shortOut == CASTestMedian(shorts, width, height, radius, false));
+        }
+    }
+}
+
+CAS_TEST(KernelsHistogramSlide)
+{
+    CASTestRandom random;
+    const size_t count = 259;
+    std::vector<uint8_t> add(count), remove(count);
+    std::vector<uint16_t> start(count);
+    for (size_t i = 0; i < count; ++i){
+        add[i] = random.next() & 0xff;
+        remove[i] = random.next() & 0xff;
+        start[i] = random.next() & 0xffff;
+    }
+    for (int isa = kCASKernelISAScalar; isa < kCASKernelISACount; ++isa){
+        const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+        if (table){
+            std::vector<uint16_t> h(start);
+            table->histogramSlide(h.data(), add.data(), remove.data(), count);
+            table->histogramSlide(h.data(), add.data(), NULL, count);
+            for (size_t i = 0; i < count; ++i){
+                CAS_CHECK(h[i] == (uint16_t)(start[i] + 2 * add[i] - remove[i]));
+            }
+        }
+    }
+}
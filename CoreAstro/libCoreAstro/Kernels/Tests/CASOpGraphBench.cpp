@@ -0,0 +1,80 @@
+//
+//  CASOpGraphBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  A preview of a raw colour frame worked out stage by stage over the whole frame against the op graph
+//  doing it a tile at a time, and rendering a 1920x1080 view of it as it's panned with and without a tile cache.
+
+
+#include "CASTestSupport.h"
+#include "CASOpGraph.h"
+#include "CASKernels.h"
+#include "CASParallel.h"
+
+CAS_BENCH(OpGraph)
+{
+    const size_t width = ctx.width, height = ctx.height, count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<uint16_t> raw(count);
+    CASTestFill(raw, random);
+    const CASDisplayStretch stretch = CASDisplayStretchMake(0.1f, 0.6f, 0.3f);
+    
+    std::vector<float> widened(count), rgba(count * 4);
+    std::vector<uint8_t> table(CAS_DISPLAY_STRETCH_TABLE_SIZE), display(count * 4);
+    ctx.measure("stage by stage", count * sizeof(uint16_t), [&]{
+        CASKernels().widenU16(raw.data(), CAS_PIXEL_UINT16_MAX, widened.data(), count);
+        CASDebayerBilinear(widened.data(), width, 0, 0, width, height, kCASBayerRGGB, 0, 0, width, height, rgba.data(), width * 4);
+        CASDisplayStretchBuildTable(stretch, CAS_PIXEL_UINT16_MAX, table.data());
+        CASDisplayStretchApplyTable(rgba.data(), width, height, 4, table.data(), display.data(), width * 4);
+    });
+    
+    CASOpGraph graph(CASPixelsMake(kCASPixelFormatUInt16, raw.data(), width, height, width));
+    graph.debayer(kCASBayerRGGB);
+    graph.stretch(stretch);
+    ctx.measure("op graph", count * sizeof(uint16_t), [&]{
+        CASOpGraphRender(graph, kCASOpDisplayRGBA8, display.data(), width * 4);
+    });
+    ctx.measure("op graph parallel", count * sizeof(uint16_t), [&]{
+        CASOpGraphRender(graph, kCASOpDisplayRGBA8, display.data(), width * 4, CASParallelApply);
+    });
+    
+    // pans a viewport across the frame a quarter of its width at a time
+    const CASOpRegion viewport = { 0, 0, std::min<size_t>(1920, width), std::min<size_t>(1080, height) };
+    const size_t step = viewport.width / 4, steps = (width - viewport.width) / std::max<size_t>(1, step) + 1;
+    std::vector<uint8_t> view(viewport.width * viewport.height * 4);
+    ctx.measure("viewport pan", count * sizeof(uint16_t), [&]{
+        for (size_t i = 0; i < steps; ++i){
+            CASOpRegion r = viewport;
+            r.x = i * step;
+            CASOpGraphRenderRegion(graph, kCASOpDisplayRGBA8, r, view.data(), viewport.width * 4, NULL, CASParallelApply);
+        }
+    });
+    ctx.measure("viewport pan cached", count * sizeof(uint16_t), [&]{
+        CASOpTileCache cache;
+        for (size_t i = 0; i < steps; ++i){
+            CASOpRegion r = viewport;
+            r.x = i * step;
+            CASOpGraphRenderRegion(graph, kCASOpDisplayRGBA8, r, view.data(), viewport.width * 4, &cache, CASParallelApply);
+        }
+    });
+}
@@ -0,0 +1,287 @@
+//
+//  CASOpGraphTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+
+#include "CASTestSupport.h"
+#include "CASOpGraph.h"
+#include "CASKernels.h"
+#include <algorithm>
+
+static void CASOpGraphApplyBackwards(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = count; i-- > 0;){
+        work(context, i);
+    }
+}
+
+// odd sizes so there are part tiles on the right and bottom
+static const size_t kWidth = CAS_OP_GRAPH_TILE_SIZE * 2 + 37, kHeight = CAS_OP_GRAPH_TILE_SIZE + 19;
+
+// the same stages one after another over the whole frame, as the processor used to
+static double CASOpGraphTestStretch(const CASDisplayStretch& stretch, double x)
+{
+    x = std::min(1.0, std::max(0.0, (x - stretch.lower) / (stretch.upper - stretch.lower)));
+    const double m = stretch.midtone;
+    x = ((m - 1) * x) / (((2 * m - 1) * x) - m);
+    return pow(x, (double)stretch.gamma);
+}
+
+static void CASOpGraphTestFlip(std::vector<float>& pixels, size_t width, size_t height, size_t channelCount, bool horizontal, bool vertical)
+{
+    std::vector<float> flipped(pixels.size());
+    for (size_t y = 0; y < height; ++y){
+        for (size_t x = 0; x < width; ++x){
+            const size_t sx = horizontal ? width - 1 - x : x, sy = vertical ? height - 1 - y : y;
+            std::copy(&pixels[(sy * width + sx) * channelCount], &pixels[(sy * width + sx) * channelCount] + channelCount, &flipped[(y * width + x) * channelCount]);
+        }
+    }
+    pixels.swap(flipped);
+}
+
+CAS_TEST(OpGraphPerPixelChain)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> light(kWidth * kHeight);
+    std::vector<float> bias(light.size()), flat(light.size());
+    CASTestFill(light, random);
+    for (size_t i = 0; i < light.size(); ++i){
+        bias[i] = random.unit() * 0.05f;
+        flat[i] = 0.5f + random.unit() * 0.1f;
+    }
+    const CASCalibrationMasters masters = { bias.data(), NULL, flat.data(), light.size() };
+    const CASCalibrationStatistics statistics = CASCalibrationStatisticsForMasters(masters);
+    const CASDisplayStretch stretch = CASDisplayStretchMake(0.1f, 0.7f, 0.3f, 0.8f);
+    
+    CASOpGraph graph(CASPixelsMake(kCASPixelFormatUInt16, light.data(), kWidth, kHeight, kWidth));
+    CAS_CHECK(graph.calibrate(masters, statistics));
+    CAS_CHECK(graph.stretch(stretch));
+    CAS_CHECK(graph.invert());
+    CAS_CHECK(graph.channelCount() == 1);
+    
+    std::vector<float> expected(light.size());
+    CASCalibrateRange(light.data(), masters, statistics, expected.data(), 0, light.size());
+    for (size_t i = 0; i < expected.size(); ++i){
+        expected[i] = 1.0 - CASOpGraphTestStretch(stretch, expected[i]);
+    }
+    
+    std::vector<float> out(kWidth * kHeight, -1);
+    CAS_CHECK(CASOpGraphEvaluate(graph, out.data(), kWidth, CASOpGraphApplyBackwards));
+    for (size_t i = 0; i < out.size(); ++i){
+        CAS_CHECK_CLOSE(out[i], expected[i], 1e-4);
+    }
+}
+
+CAS_TEST(OpGraphDebayerLuminanceFlip)
+{
+    CASTestRandom random;
+    std::vector<float> raw(kWidth * kHeight);
+    CASTestFill(raw, random);
+    
+    std::vector<float> rgba(raw.size() * 4), expected(raw.size());
+    CAS_CHECK(CASDebayerBilinear(raw.data(), kWidth, 0, 0, kWidth, kHeight, kCASBayerGRBG, 0, 0, kWidth, kHeight, rgba.data(), kWidth * 4));
+    
+    // flipped colour output
+    {
+        CASOpGraph graph(CASPixelsMake(kCASPixelFormatFloat, raw.data(), kWidth, kHeight, kWidth));
+        CAS_CHECK(graph.debayer(kCASBayerGRBG));
+        CAS_CHECK(graph.flip(true, true));
+        CAS_CHECK(graph.channelCount() == 4);
+        
+        std::vector<float> flipped(rgba);
+        CASOpGraphTestFlip(flipped, kWidth, kHeight, 4, true, true);
+        std::vector<float> out(rgba.size());
+        CAS_CHECK(CASOpGraphEvaluate(graph, out.data(), kWidth * 4));
+        CAS_CHECK(out == flipped);
+    }
+    
+    // and reduced to mono, with the flip before the debayer so it has to be pulled through it
+    {
+        CASOpGraph graph(CASPixelsMake(kCASPixelFormatFloat, raw.data(), kWidth, kHeight, kWidth));
+        CAS_CHECK(graph.flip(false, true));
+        CAS_CHECK(graph.debayer(kCASBayerGRBG));
+        CAS_CHECK(graph.luminance());
+        CAS_CHECK(graph.channelCount() == 1);
+        
+        std::vector<float> flippedRaw(raw);
+        CASOpGraphTestFlip(flippedRaw, kWidth, kHeight, 1, false, true);
+        CAS_CHECK(CASDebayerBilinear(flippedRaw.data(), kWidth, 0, 0, kWidth, kHeight, kCASBayerGRBG, 0, 0, kWidth, kHeight, rgba.data(), kWidth * 4));
+        CASKernels().luminance(rgba.data(), expected.data(), expected.size());
+        
+        std::vector<float> out(expected.size());
+        CAS_CHECK(CASOpGraphEvaluate(graph, out.data(), kWidth));
+        for (size_t i = 0; i < out.size(); ++i){
+            CAS_CHECK_CLOSE(out[i], expected[i], 1e-6);
+        }
+    }
+}
+
+CAS_TEST(OpGraphRender)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> light(kWidth * kHeight);
+    CASTestFill(light, random);
+    const CASDisplayStretch stretch = CASDisplayStretchMake(0.2f, 0.6f, 0.4f);
+    
+    // just a stretch and flip of 16-bit samples is one table lookup per sample, as the display stretch does
+    {
+        CASOpGraph graph(CASPixelsMake(kCASPixelFormatUInt16, light.data(), kWidth, kHeight, kWidth));
+        CAS_CHECK(graph.stretch(stretch));
+        CAS_CHECK(graph.flip(true, false));
+        
+        std::vector<uint8_t> table(CAS_DISPLAY_STRETCH_TABLE_SIZE), expected(light.size()), out(light.size());
+        CASDisplayStretchBuildTable(stretch, CAS_PIXEL_UINT16_MAX, table.data());
+        CAS_CHECK(CASDisplayStretchApplyTable(light.data(), kWidth, kHeight, 1, table.data(), expected.data(), kWidth));
+        CAS_CHECK(CASOpGraphRender(graph, kCASOpDisplayGray8, out.data(), kWidth, CASOpGraphApplyBackwards));
+        for (size_t y = 0; y < kHeight; ++y){
+            for (size_t x = 0; x < kWidth; ++x){
+                CAS_CHECK(abs(out[y * kWidth + x] - expected[y * kWidth + kWidth - 1 - x]) <= 1);
+            }
+        }
+    }
+    
+    // colour output matches evaluating to floats and quantising
+    {
+        CASOpGraph graph(CASPixelsMake(kCASPixelFormatUInt16, light.data(), kWidth, kHeight, kWidth));
+        CAS_CHECK(graph.debayer(kCASBayerRGGB));
+        CAS_CHECK(graph.stretch(stretch));
+        CAS_CHECK(graph.invert());
+        CAS_CHECK(!CASOpGraphRender(graph, kCASOpDisplayGray8, NULL, kWidth));
+        
+        std::vector<float> pixels(light.size() * 4);
+        CAS_CHECK(CASOpGraphEvaluate(graph, pixels.data(), kWidth * 4));
+        std::vector<uint8_t> out(light.size() * 4);
+        CAS_CHECK(CASOpGraphRender(graph, kCASOpDisplayBGRA8, out.data(), kWidth * 4));
+        for (size_t i = 0; i < light.size(); ++i){
+            const float* p = &pixels[i * 4];
+            const uint8_t* o = &out[i * 4];
+            CAS_CHECK(abs(o[2] - (int)(p[0] * 255 + 0.5f)) <= 1);
+            CAS_CHECK(abs(o[1] - (int)(p[1] * 255 + 0.5f)) <= 1);
+            CAS_CHECK(abs(o[0] - (int)(p[2] * 255 + 0.5f)) <= 1);
+            CAS_CHECK(o[3] == 255);
+        }
+    }
+}
+
+CAS_TEST(OpGraphRejectsMismatchedStages)
+{
+    std::vector<float> rgba(16 * 16 * 4);
+    CASOpGraph graph(CASPixelsMake(kCASPixelFormatRGBAFloat, rgba.data(), 16, 16, 16));
+    const CASCalibrationMasters masters = { NULL, NULL, NULL, 16 * 16 };
+    CAS_CHECK(!graph.calibrate(masters, CASCalibrationStatistics()));
+    CAS_CHECK(!graph.debayer(kCASBayerRGGB));
+    CAS_CHECK(graph.luminance());
+    CAS_CHECK(!graph.luminance());
+    CAS_CHECK(graph.ops.size() == 1);
+    
+    CASOpGraph empty(CASPixelsMake(kCASPixelFormatNone, NULL, 0, 0, 0));
+    std::vector<float> out(16);
+    CAS_CHECK(!CASOpGraphEvaluate(empty, out.data(), 16));
+}
+
+CAS_TEST(OpGraphRenderRegion)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> light(kWidth * kHeight);
+    CASTestFill(light, random);
+    
+    CASOpGraph graph(CASPixelsMake(kCASPixelFormatUInt16, light.data(), kWidth, kHeight, kWidth));
+    CAS_CHECK(graph.debayer(kCASBayerGBRG));
+    CAS_CHECK(graph.flip(true, false));
+    CAS_CHECK(graph.stretch(CASDisplayStretchMake(0.1f, 0.8f, 0.4f)));
+    CAS_CHECK(graph.flip(false, true));
+    
+    std::vector<uint8_t> full(kWidth * kHeight * 4);
+    CAS_CHECK(CASOpGraphRender(graph, kCASOpDisplayRGBA8, full.data(), kWidth * 4));
+    
+    // a region over 3x2 tiles, rendered on its own and through a cache, is the same part of the whole
+    const CASOpRegion region = { CAS_OP_GRAPH_TILE_SIZE - 5, 3, CAS_OP_GRAPH_TILE_SIZE + 20, CAS_OP_GRAPH_TILE_SIZE + 10 };
+    CASOpTileCache cache;
+    for (int pass = 0; pass < 3; ++pass){
+        std::vector<uint8_t> out(region.width * region.height * 4);
+        CAS_CHECK(CASOpGraphRenderRegion(graph, kCASOpDisplayRGBA8, region, out.data(), region.width * 4, pass ? &cache : NULL, CASOpGraphApplyBackwards));
+        for (size_t y = 0; y < region.height; ++y){
+            CAS_CHECK(std::equal(&out[y * region.width * 4], &out[(y + 1) * region.width * 4], &full[((region.y + y) * kWidth + region.x) * 4]));
+        }
+    }
+    CAS_CHECK(cache.misses() == 6 && cache.hits() == 6);
+    CAS_CHECK(cache.bytesCached() > 0);
+    
+    const CASOpRegion outside = { kWidth - 10, 0, 11, 10 };
+    std::vector<uint8_t> out(11 * 10 * 4);
+    CAS_CHECK(!CASOpGraphRenderRegion(graph, kCASOpDisplayRGBA8, outside, out.data(), 11 * 4, &cache));
+}
+
+CAS_TEST(OpGraphTileCacheInvalidation)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> light(kWidth * kHeight);
+    CASTestFill(light, random);
+    const CASOpRegion region = { 10, 10, 50, 40 };
+    std::vector<uint8_t> out(region.width * region.height), expected(out.size());
+    
+    CASOpTileCache cache;
+    CASOpGraph graph(CASPixelsMake(kCASPixelFormatUInt16, light.data(), kWidth, kHeight, kWidth));
+    CAS_CHECK(graph.stretch(CASDisplayStretchMake(0.2f, 0.6f)));
+    CAS_CHECK(CASOpGraphRenderRegion(graph, kCASOpDisplayGray8, region, out.data(), region.width, &cache));
+    
+    // a different stretch gets tiles of its own
+    const size_t tileCount = cache.misses();
+    CASOpGraph restretched(CASPixelsMake(kCASPixelFormatUInt16, light.data(), kWidth, kHeight, kWidth));
+    CAS_CHECK(restretched.stretch(CASDisplayStretchMake(0.3f, 0.5f)));
+    CAS_CHECK(CASOpGraphRenderRegion(restretched, kCASOpDisplayGray8, region, out.data(), region.width, &cache));
+    CAS_CHECK(CASOpGraphRenderRegion(restretched, kCASOpDisplayGray8, region, expected.data(), region.width));
+    CAS_CHECK(out == expected);
+    CAS_CHECK(cache.hits() == 0);
+    
+    // while the first one's are still there
+    CAS_CHECK(CASOpGraphRenderRegion(graph, kCASOpDisplayGray8, region, out.data(), region.width, &cache));
+    CAS_CHECK(cache.hits() == tileCount);
+    
+    // the same graph over changed samples needs clearing by hand
+    for (size_t i = 0; i < light.size(); ++i){
+        light[i] = CAS_PIXEL_UINT16_MAX - light[i];
+    }
+    cache.clear();
+    CAS_CHECK(cache.bytesCached() == 0);
+    CAS_CHECK(CASOpGraphRenderRegion(restretched, kCASOpDisplayGray8, region, out.data(), region.width, &cache));
+    CAS_CHECK(CASOpGraphRenderRegion(restretched, kCASOpDisplayGray8, region, expected.data(), region.width));
+    CAS_CHECK(out == expected);
+    
+    // and the least recently used tiles go once it's full
+    CASOpTileCache small(CAS_OP_GRAPH_TILE_SIZE * CAS_OP_GRAPH_TILE_SIZE);
+    const CASOpRegion all = { 0, 0, kWidth, kHeight };
+    std::vector<uint8_t> whole(kWidth * kHeight);
+    CAS_CHECK(CASOpGraphRenderRegion(restretched, kCASOpDisplayGray8, all, whole.data(), kWidth, &small));
+    CAS_CHECK(small.bytesCached() <= CAS_OP_GRAPH_TILE_SIZE * CAS_OP_GRAPH_TILE_SIZE);
+    
+    // as do the least recently rendered graphs once there are too many
+    for (size_t i = 0; i <= CAS_OP_TILE_CACHE_KEYS; ++i){
+        CASOpGraph stretched(CASPixelsMake(kCASPixelFormatUInt16, light.data(), kWidth, kHeight, kWidth));
+        CAS_CHECK(stretched.stretch(CASDisplayStretchMake(0.01f * i, 0.9f)));
+        CAS_CHECK(CASOpGraphRenderRegion(stretched, kCASOpDisplayGray8, region, out.data(), region.width, &cache));
+    }
+    const size_t hits = cache.hits();
+    CAS_CHECK(CASOpGraphRenderRegion(restretched, kCASOpDisplayGray8, region, out.data(), region.width, &cache));
+    CAS_CHECK(cache.hits() == hits);
+}
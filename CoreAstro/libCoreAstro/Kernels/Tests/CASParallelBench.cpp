@@ -0,0 +1,68 @@
+//
+//  CASParallelBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Overhead of the parallel loops against the same work on the calling thread, with the pool at its
+//  default size.
+
+#include "CASTestSupport.h"
+#include "CASParallel.h"
+#include "CASKernels.h"
+
+CAS_BENCH(Parallel)
+{
+    const size_t count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<float> pixels(count);
+    CASTestFill(pixels, random);
+    
+    ctx.measure("invert in order", count * 2 * sizeof(float), [&]{
+        CASKernels().invert(pixels.data(), count);
+    });
+    ctx.measure("invert parallel for", count * 2 * sizeof(float), [&]{
+        CASParallelFor(count, 0, [&](size_t begin, size_t end){
+            CASKernels().invert(pixels.data() + begin, end - begin);
+        });
+    });
+    ctx.measure("invert 4k grain", count * 2 * sizeof(float), [&]{
+        CASParallelFor(count, 4096, [&](size_t begin, size_t end){
+            CASKernels().invert(pixels.data() + begin, end - begin);
+        });
+    });
+    
+    double sum = 0;
+    ctx.measure("sum in order", count * sizeof(float), [&]{
+        sum = CASKernels().sum(pixels.data(), count);
+    });
+    ctx.measure("sum deterministic reduce", count * sizeof(float), [&]{
+        sum = CASParallelReduce(count, 0, 0.0, [&](size_t begin, size_t end){
+            return CASKernels().sum(pixels.data() + begin, end - begin);
+        }, [](double a, double b){ return a + b; });
+    });
+    ctx.measure("sum unordered reduce", count * sizeof(float), [&]{
+        sum = CASParallelReduce(count, 0, 0.0, [&](size_t begin, size_t end){
+            return CASKernels().sum(pixels.data() + begin, end - begin);
+        }, [](double a, double b){ return a + b; }, kCASParallelReduceUnordered);
+    });
+    (void)sum;
+}
@@ -0,0 +1,138 @@
+//
+//  CASParallelTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASParallel.h"
+#include <atomic>
+#include <thread>
+
+// more threads than this box may have cores so the stealing gets exercised
+static const bool sPoolSized = CASParallelSetThreadCount(4);
+
+CAS_TEST(ParallelForCoversRange)
+{
+    CAS_CHECK(sPoolSized && CASParallelThreadCount() == 4);
+    
+    const size_t counts[] = { 0, 1, 3, 1000, 100003 };
+    const size_t grains[] = { 0, 1, 7, 4096 };
+    for (size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c){
+        for (size_t g = 0; g < sizeof(grains)/sizeof(grains[0]); ++g){
+            
+            const size_t count = counts[c], grain = grains[g];
+            std::vector<std::atomic<int> > visits(count);
+            for (size_t i = 0; i < count; ++i){
+                visits[i] = 0;
+            }
+            CASParallelFor(count, grain, [&](size_t begin, size_t end){
+                CAS_CHECK(begin < end && end <= count);
+                CAS_CHECK(!grain || end - begin <= grain);
+                for (size_t i = begin; i < end; ++i){
+                    ++visits[i];
+                }
+            });
+            for (size_t i = 0; i < count; ++i){
+                CAS_CHECK(visits[i] == 1);
+            }
+        }
+    }
+}
+
+CAS_TEST(ParallelForBalancesUnevenWork)
+{
+    // all the work is at the start of the range, which only gets finished in reasonable time if it's shared out
+    const size_t count = 64;
+    std::atomic<size_t> total(0);
+    CASParallelFor(count, 1, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; ++i){
+            if (i < count / 4){
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            total += i;
+        }
+    });
+    CAS_CHECK(total == count * (count - 1) / 2);
+}
+
+CAS_TEST(ParallelNestedAndConcurrentCalls)
+{
+    // nested loops and loops from other threads while the pool is busy run on the calling thread
+    const size_t outer = 16, inner = 1000;
+    std::atomic<size_t> total(0);
+    std::thread other([&]{
+        for (int r = 0; r < 20; ++r){
+            CASParallelFor(inner, 10, [&](size_t begin, size_t end){ total += end - begin; });
+        }
+    });
+    CASParallelFor(outer, 1, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; ++i){
+            CASParallelFor(inner, 0, [&](size_t b, size_t e){ total += e - b; });
+        }
+    });
+    other.join();
+    CAS_CHECK(total == outer * inner + 20 * inner);
+    
+    std::vector<int> applied(100);
+    struct Apply {
+        static void work(void* context, size_t index) { ++(*(std::vector<int>*)context)[index]; }
+    };
+    CASParallelApply(applied.size(), &applied, Apply::work);
+    CAS_CHECK(applied == std::vector<int>(100, 1));
+}
+
+CAS_TEST(ParallelReduce)
+{
+    const size_t count = 1000003;
+    CASTestRandom random;
+    std::vector<float> values(count);
+    for (size_t i = 0; i < count; ++i){
+        values[i] = random.unit() * 1e6f;
+    }
+    
+    auto map = [&](size_t begin, size_t end){
+        float sum = 0;
+        for (size_t i = begin; i < end; ++i){
+            sum += values[i];
+        }
+        return sum;
+    };
+    auto combine = [](float a, float b){ return a + b; };
+    
+    // the deterministic mode gives the same bits as running the same chunks in order on one thread
+    const size_t grain = CASParallelReduceGrain(count, 0, kCASParallelReduceDeterministic);
+    CAS_CHECK(grain == (count + CAS_PARALLEL_REDUCE_CHUNKS - 1) / CAS_PARALLEL_REDUCE_CHUNKS);
+    float expected = 0;
+    for (size_t b = 0; b < count; b += grain){
+        expected += map(b, std::min(count, b + grain));
+    }
+    for (int r = 0; r < 10; ++r){
+        CAS_CHECK(CASParallelReduce(count, 0, 0.0f, map, combine) == expected);
+    }
+    
+    double exact = 0;
+    for (size_t i = 0; i < count; ++i){
+        exact += values[i];
+    }
+    CAS_CHECK_CLOSE(CASParallelReduce(count, 0, 0.0f, map, combine, kCASParallelReduceUnordered), exact, 1e-4);
+    CAS_CHECK(CASParallelReduce(0, 0, 7.0f, map, combine) == 7.0f);
+}
@@ -0,0 +1,158 @@
+//
+//  CASPixelViewTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASPixelView.h"
+
+CAS_TEST(PixelViewRegion)
+{
+    std::vector<uint16_t> samples(7 * 5);
+    for (size_t i = 0; i < samples.size(); ++i){
+        samples[i] = i;
+    }
+    const CASPixelView<uint16_t> view(samples.data(), 7, 5);
+    CAS_CHECK(view.contiguous());
+    CAS_CHECK(view.at(3, 2) == 17);
+    CAS_CHECK(view.row(4)[6] == 34);
+    
+    // regions share the stride and are clipped to the view
+    const CASPixelView<uint16_t> region = view.region(2, 1, 3, 2);
+    CAS_CHECK(region.width == 3 && region.height == 2 && region.stride == 7);
+    CAS_CHECK(!region.contiguous());
+    CAS_CHECK(region.at(0, 0) == 9);
+    CAS_CHECK(region.at(2, 1) == 18);
+    region.at(1, 1) = 1000;
+    CAS_CHECK(samples[17] == 1000);
+    
+    const CASPixelView<uint16_t> clipped = view.region(5, 3, 10, 10);
+    CAS_CHECK(clipped.width == 2 && clipped.height == 2);
+    CAS_CHECK(view.region(7, 0, 1, 1).empty());
+    CAS_CHECK(view.region(0, 5, 1, 1).empty());
+    
+    // the same on the untyped frame
+    const CASPixels frame = CASPixelsFromView(view);
+    const CASPixelView<const uint16_t> untyped = CASPixelsView<uint16_t>(CASPixelsRegion(frame, 2, 1, 3, 2));
+    CAS_CHECK(untyped.pixels == region.pixels && untyped.width == 3 && untyped.height == 2 && untyped.stride == 7);
+    CAS_CHECK(CASPixelsRegion(frame, 5, 3, 10, 10).width == 2);
+    CAS_CHECK(CASPixelsIsEmpty(CASPixelsRegion(frame, 0, 5, 1, 1)));
+    
+    const CASPixelView<const uint16_t> readOnly = region;
+    CAS_CHECK_CLOSE(readOnly.value(1, 1), 1000 / 65535.0, 1e-9);
+}
+
+CAS_TEST(PixelViewTraits)
+{
+    CAS_CHECK(CASPixelTraits<uint16_t>::toFloat(65535) == 1.0f);
+    CAS_CHECK(CASPixelTraits<const float>::toFloat(0.25f) == 0.25f);
+    const CASPixelRGBA grey = { 0.5f, 0.5f, 0.5f, 1.0f };
+    CAS_CHECK_CLOSE(CASPixelTraits<CASPixelRGBA>::toFloat(grey), 0.5, 1e-6);
+    const CASPixelRGBA bright = { 2.0f, 2.0f, 2.0f, 1.0f };
+    CAS_CHECK(CASPixelTraits<CASPixelRGBA>::toFloat(bright) == 1.0f);
+}
+
+// records which instantiation it was called with
+struct CASPixelViewTestFunctor {
+    CASPixelFormat format;
+    double total;
+    template <typename T> void operator()(const CASPixelView<const T>& view) {
+        format = CASPixelTraits<T>::format;
+        total = 0;
+        for (size_t y = 0; y < view.height; ++y){
+            for (size_t x = 0; x < view.width; ++x){
+                total += view.value(x, y);
+            }
+        }
+    }
+};
+
+CAS_TEST(PixelViewDispatch)
+{
+    std::vector<uint16_t> samples(4 * 3, 65535);
+    std::vector<float> floats(4 * 3, 0.5f);
+    std::vector<CASPixelRGBA> rgba(4 * 3);
+    for (size_t i = 0; i < rgba.size(); ++i){
+        const CASPixelRGBA p = { 0.25f, 0.25f, 0.25f, 1.0f };
+        rgba[i] = p;
+    }
+    
+    CASPixelViewTestFunctor f;
+    CAS_CHECK(CASPixelsDispatch(CASPixelsMake(kCASPixelFormatUInt16, samples.data(), 2, 3, 4), f));
+    CAS_CHECK(f.format == kCASPixelFormatUInt16);
+    CAS_CHECK_CLOSE(f.total, 6, 1e-6);
+    CAS_CHECK(CASPixelsDispatch(CASPixelsFromView(CASPixelView<float>(floats.data(), 4, 3)), f));
+    CAS_CHECK(f.format == kCASPixelFormatFloat);
+    CAS_CHECK_CLOSE(f.total, 6, 1e-6);
+    CAS_CHECK(CASPixelsDispatch(CASPixelsMake(kCASPixelFormatRGBAFloat, rgba.data(), 4, 3, 4), f));
+    CAS_CHECK(f.format == kCASPixelFormatRGBAFloat);
+    CAS_CHECK_CLOSE(f.total, 3, 1e-5);
+    
+    // nothing to look at, or a stride shorter than the rows
+    CAS_CHECK(!CASPixelsDispatch(CASPixelsMake(kCASPixelFormatUInt16, NULL, 4, 3, 4), f));
+    CAS_CHECK(!CASPixelsDispatch(CASPixelsMake(kCASPixelFormatFloat, floats.data(), 4, 3, 2), f));
+    CAS_CHECK(!CASPixelsDispatch(CASPixelsMake(kCASPixelFormatNone, floats.data(), 4, 3, 4), f));
+    
+    // asking for the wrong type gets an empty view
+    CAS_CHECK(CASPixelsView<float>(CASPixelsMake(kCASPixelFormatUInt16, samples.data(), 4, 3, 4)).empty());
+}
+
+CAS_TEST(PixelViewToFloat)
+{
+    const size_t width = 37, height = 9;
+    CASTestRandom random;
+    std::vector<uint16_t> samples(width * height);
+    for (size_t i = 0; i < samples.size(); ++i){
+        samples[i] = random.sample();
+    }
+    
+    // whole frame
+    std::vector<float> out(width * height);
+    CAS_CHECK(CASPixelsToFloat(CASPixelsMake(kCASPixelFormatUInt16, samples.data(), width, height, width), out.data(), width));
+    for (size_t i = 0; i < samples.size(); ++i){
+        CAS_CHECK(out[i] == samples[i] / 65535.0f);
+    }
+    
+    // a region into a padded buffer
+    const CASPixelView<const uint16_t> region = CASPixelView<const uint16_t>(samples.data(), width, height).region(3, 2, 20, 5);
+    std::vector<float> padded(24 * 5, -1.0f);
+    CAS_CHECK(CASPixelsToFloat(CASPixelsFromView(region), padded.data(), 24));
+    for (size_t y = 0; y < 5; ++y){
+        for (size_t x = 0; x < 24; ++x){
+            CAS_CHECK(padded[y * 24 + x] == (x < 20 ? region.value(x, y) : -1.0f));
+        }
+    }
+    
+    // floats are copied, RGBA keeps all four channels
+    std::vector<float> rgba(width * height * 4);
+    CASTestFill(rgba, random);
+    std::vector<float> copy(20 * 5 * 4);
+    const CASPixelView<const CASPixelRGBA> rgbaRegion = CASPixelView<const CASPixelRGBA>((const CASPixelRGBA*)rgba.data(), width, height).region(3, 2, 20, 5);
+    CAS_CHECK(CASPixelsToFloat(CASPixelsFromView(rgbaRegion), copy.data(), 20 * 4));
+    for (size_t y = 0; y < 5; ++y){
+        for (size_t x = 0; x < 20 * 4; ++x){
+            CAS_CHECK(copy[y * 80 + x] == rgba[((y + 2) * width + 3) * 4 + x]);
+        }
+    }
+    
+    CAS_CHECK(!CASPixelsToFloat(CASPixelsMake(kCASPixelFormatFloat, NULL, 1, 1, 1), copy.data(), 1));
+}
@@ -0,0 +1,45 @@
+//
+//  CASPyramidBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Building the pyramid of a 16-bit frame, one thread and across all of them.
+
+
+#include "CASTestSupport.h"
+#include "CASPyramid.h"
+#include "CASParallel.h"
+
+CAS_BENCH(Pyramid)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> samples(ctx.pixelCount());
+    CASTestFill(samples, random);
+    const CASPixels frame = CASPixelsMake(kCASPixelFormatUInt16, samples.data(), ctx.width, ctx.height, ctx.width);
+    std::vector<uint8_t> pyramid(CASPyramidSize(kCASPixelFormatUInt16, ctx.width, ctx.height));
+    ctx.measure("build", samples.size() * sizeof(uint16_t), [&]{
+        CASPyramidBuild(frame, pyramid.data());
+    });
+    ctx.measure("build parallel", samples.size() * sizeof(uint16_t), [&]{
+        CASPyramidBuild(frame, pyramid.data(), CASParallelApply);
+    });
+}
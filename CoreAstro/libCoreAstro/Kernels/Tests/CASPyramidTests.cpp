@@ -0,0 +1,145 @@
+//
+//  CASPyramidTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASPyramid.h"
+#include "CASParallel.h"
+
+static uint16_t CASPyramidTestAverage(uint16_t a, uint16_t b, uint16_t c, uint16_t d)
+{
+    return (a + b + c + d + 2) >> 2;
+}
+
+static float CASPyramidTestAverage(float a, float b, float c, float d)
+{
+    return ((a + b) + (c + d)) * 0.25f;
+}
+
+// the level below a frame worked out a pixel at a time, clamping at the odd edges
+template <typename T>
+static std::vector<T> CASPyramidTestHalve(const std::vector<T>& in, size_t width, size_t height, size_t channelCount)
+{
+    const size_t w = (width + 1) / 2, h = (height + 1) / 2;
+    std::vector<T> out(w * h * channelCount);
+    for (size_t y = 0; y < h; ++y){
+        const size_t y0 = 2 * y, y1 = std::min(2 * y + 1, height - 1);
+        for (size_t x = 0; x < w; ++x){
+            const size_t x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+            for (size_t c = 0; c < channelCount; ++c){
+                const T a = in[(y0 * width + x0) * channelCount + c], b = in[(y0 * width + x1) * channelCount + c];
+                const T d = in[(y1 * width + x0) * channelCount + c], e = in[(y1 * width + x1) * channelCount + c];
+                out[(y * w + x) * channelCount + c] = CASPyramidTestAverage(a, b, d, e);
+            }
+        }
+    }
+    return out;
+}
+
+CAS_TEST(PyramidLevels)
+{
+    CAS_CHECK(CASPyramidLevelCount(64, 64) == 0);
+    CAS_CHECK(CASPyramidLevelCount(65, 10) == 1);
+    CAS_CHECK(CASPyramidLevelCount(4096, 4096) == 6);
+    CAS_CHECK(CASPyramidLevelCount(1001, 3) == 4);
+    
+    size_t w, h;
+    CASPyramidLevelSize(1001, 3, 0, &w, &h);
+    CAS_CHECK(w == 1001 && h == 3);
+    CASPyramidLevelSize(1001, 3, 2, &w, &h);
+    CAS_CHECK(w == 251 && h == 1);
+    
+    CAS_CHECK(CASPyramidSize(kCASPixelFormatUInt16, 64, 64) == 0);
+    CAS_CHECK(CASPyramidSize(kCASPixelFormatUInt16, 200, 100) == (100 * 50 + 50 * 25) * sizeof(uint16_t));
+    CAS_CHECK(CASPyramidSize(kCASPixelFormatRGBAFloat, 200, 100) == (100 * 50 + 50 * 25) * 4 * sizeof(float));
+    
+    std::vector<uint8_t> pyramid(CASPyramidSize(kCASPixelFormatFloat, 200, 100));
+    const CASPixels level2 = CASPyramidLevel(kCASPixelFormatFloat, pyramid.data(), 200, 100, 2);
+    CAS_CHECK(level2.data == pyramid.data() + 100 * 50 * sizeof(float));
+    CAS_CHECK(level2.width == 50 && level2.height == 25 && level2.stride == 50);
+    CAS_CHECK(CASPixelsIsEmpty(CASPyramidLevel(kCASPixelFormatFloat, pyramid.data(), 200, 100, 0)));
+    CAS_CHECK(CASPixelsIsEmpty(CASPyramidLevel(kCASPixelFormatFloat, pyramid.data(), 200, 100, 3)));
+}
+
+CAS_TEST(PyramidOddEdges)
+{
+    const uint16_t samples[] = {
+        10, 20, 30,
+        40, 50, 60,
+        70, 80, 90
+    };
+    uint16_t out[4] = { 0 };
+    CAS_CHECK(CASPyramidHalve(CASPixelsMake(kCASPixelFormatUInt16, samples, 3, 3, 3), out, 2));
+    CAS_CHECK(out[0] == 30); // (10+20+40+50)/4
+    CAS_CHECK(out[1] == 45); // (30+30+60+60)/4
+    CAS_CHECK(out[2] == 75); // (70+80+70+80)/4
+    CAS_CHECK(out[3] == 90);
+}
+
+CAS_TEST(PyramidBuild)
+{
+    const size_t width = 301, height = 157;
+    CASTestRandom random;
+    
+    std::vector<uint16_t> u16(width * height);
+    CASTestFill(u16, random);
+    std::vector<uint8_t> pyramid(CASPyramidSize(kCASPixelFormatUInt16, width, height));
+    CAS_CHECK(CASPyramidBuild(CASPixelsMake(kCASPixelFormatUInt16, u16.data(), width, height, width), pyramid.data()));
+    std::vector<uint16_t> expected = u16;
+    size_t w = width, h = height;
+    for (size_t level = 1; level <= CASPyramidLevelCount(width, height); ++level){
+        expected = CASPyramidTestHalve(expected, w, h, 1);
+        w = (w + 1) / 2, h = (h + 1) / 2;
+        const CASPixels actual = CASPyramidLevel(kCASPixelFormatUInt16, pyramid.data(), width, height, level);
+        CAS_CHECK(std::equal(expected.begin(), expected.end(), (const uint16_t*)actual.data));
+    }
+    
+    for (size_t channelCount = 1; channelCount <= 4; channelCount += 3){
+        const CASPixelFormat format = (channelCount == 4) ? kCASPixelFormatRGBAFloat : kCASPixelFormatFloat;
+        std::vector<float> pixels(width * height * channelCount);
+        CASTestFill(pixels, random);
+        std::vector<uint8_t> pyramid(CASPyramidSize(format, width, height));
+        CAS_CHECK(CASPyramidBuild(CASPixelsMake(format, pixels.data(), width, height, width), pyramid.data()));
+        std::vector<float> expected = pixels;
+        size_t w = width, h = height;
+        for (size_t level = 1; level <= CASPyramidLevelCount(width, height); ++level){
+            expected = CASPyramidTestHalve(expected, w, h, channelCount);
+            w = (w + 1) / 2, h = (h + 1) / 2;
+            const CASPixels actual = CASPyramidLevel(format, pyramid.data(), width, height, level);
+            CAS_CHECK(std::equal(expected.begin(), expected.end(), (const float*)actual.data));
+        }
+    }
+}
+
+CAS_TEST(PyramidParallel)
+{
+    const size_t width = 1500, height = 1001;
+    CASTestRandom random;
+    std::vector<uint16_t> samples(width * height);
+    CASTestFill(samples, random);
+    const CASPixels frame = CASPixelsMake(kCASPixelFormatUInt16, samples.data(), width, height, width);
+    std::vector<uint8_t> serial(CASPyramidSize(kCASPixelFormatUInt16, width, height)), parallel(serial.size());
+    CAS_CHECK(CASPyramidBuild(frame, serial.data()));
+    CAS_CHECK(CASPyramidBuild(frame, parallel.data(), CASParallelApply));
+    CAS_CHECK(serial == parallel);
+}
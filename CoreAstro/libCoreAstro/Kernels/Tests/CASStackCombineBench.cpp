@@ -0,0 +1,67 @@
+//
+//  CASStackCombineBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Stack combine throughput against the frame count, with the scalar per-pixel sort for comparison.
+
+#include "CASTestSupport.h"
+#include "CASStackCombine.h"
+#include <algorithm>
+
+CAS_BENCH(Stack)
+{
+    // a one megapixel slice of each frame is enough to see the per-pixel cost
+    const size_t width = std::min<size_t>(ctx.width, 1024), height = std::min<size_t>(ctx.height, 1024);
+    const size_t count = width * height;
+    const size_t depths[] = { 8, 16, 32, 64, 128, 256 };
+    CASTestRandom random;
+    
+    for (size_t d = 0; d < sizeof(depths)/sizeof(depths[0]); ++d){
+        
+        const size_t depth = depths[d];
+        std::vector<float> strip(count * depth), out(count);
+        CASTestFill(strip, random);
+        char label[64];
+        
+        snprintf(label, sizeof(label), "%3zu frames std::sort median", depth);
+        ctx.measure(label, 4.0 * count * depth, [&]{
+            std::vector<float> s(depth);
+            for (size_t i = 0; i < count; ++i){
+                for (size_t f = 0; f < depth; ++f){
+                    s[f] = strip[f * count + i];
+                }
+                std::sort(s.begin(), s.end());
+                out[i] = s[depth / 2];
+            }
+        });
+        
+        const CASStackCombineMode modes[] = { kCASStackCombineMedian, kCASStackCombineKappaSigma, kCASStackCombineWinsorizedSigma, kCASStackCombineLinearFit };
+        const char* names[] = { "median", "kappa-sigma", "winsorized", "linear fit" };
+        for (size_t m = 0; m < sizeof(modes)/sizeof(modes[0]); ++m){
+            snprintf(label, sizeof(label), "%3zu frames %s", depth, names[m]);
+            ctx.measure(label, 4.0 * count * depth, [&]{
+                CASStackCombineRange(strip.data(), depth, count, CASStackCombineDefaultParameters(modes[m]), out.data(), 0, count);
+            });
+        }
+    }
+}
@@ -0,0 +1,252 @@
+//
+//  CASStackCombineTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASStackCombine.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <unistd.h>
+
+static std::vector<float> CASTestCombine(const std::vector<std::vector<float> >& frames, size_t width, size_t height, const CASStackCombineParameters& parameters)
+{
+    std::vector<CASStackFrame> stack(frames.size());
+    for (size_t f = 0; f < frames.size(); ++f){
+        stack[f].format = kCASStackSampleFloat;
+        stack[f].pixels = frames[f].data();
+        stack[f].path = NULL;
+        stack[f].offset = 0;
+    }
+    std::vector<float> out(width * height);
+    CAS_CHECK(CASStackCombine(stack.data(), stack.size(), width, height, parameters, out.data()));
+    return out;
+}
+
+CAS_TEST(KernelsSortColumns)
+{
+    // a comparator list that sorts 3 rows, applied to columns of every ISA
+    const uint16_t comparators[] = { 0, 1, 1, 2, 0, 1 };
+    CASTestRandom random;
+    const size_t count = 21;
+    std::vector<float> rows(3 * count);
+    CASTestFill(rows, random);
+    for (int isa = kCASKernelISAScalar; isa < kCASKernelISACount; ++isa){
+        const CASKernelTable* table = CASKernelsForISA((CASKernelISA)isa);
+        if (table){
+            std::vector<float> sorted(rows);
+            table->sortColumns(sorted.data(), count, comparators, 3, count);
+            for (size_t i = 0; i < count; ++i){
+                float expected[3] = { rows[i], rows[count + i], rows[2 * count + i] };
+                std::sort(expected, expected + 3);
+                CAS_CHECK(sorted[i] == expected[0] && sorted[count + i] == expected[1] && sorted[2 * count + i] == expected[2]);
+            }
+        }
+    }
+}
+
+CAS_TEST(StackMedianMatchesNthElement)
+{
+    CASTestRandom random;
+    const size_t width = 19, height = 3;
+    for (size_t depth = 1; depth <= CAS_STACK_NETWORK_MAX_FRAMES + 6; depth += (depth < 12 ? 1 : 101)){
+        std::vector<std::vector<float> > frames(depth, std::vector<float>(width * height));
+        for (size_t f = 0; f < depth; ++f){
+            CASTestFill(frames[f], random);
+        }
+        const std::vector<float> median = CASTestCombine(frames, width, height, CASStackCombineDefaultParameters(kCASStackCombineMedian));
+        for (size_t i = 0; i < width * height; ++i){
+            std::vector<float> s;
+            for (size_t f = 0; f < depth; ++f){
+                s.push_back(frames[f][i]);
+            }
+            std::sort(s.begin(), s.end());
+            const float expected = (depth & 1) ? s[depth / 2] : 0.5f * (s[depth / 2 - 1] + s[depth / 2]);
+            CAS_CHECK(median[i] == expected);
+        }
+    }
+}
+
+CAS_TEST(StackKappaSigmaMatchesReference)
+{
+    CASTestRandom random;
+    const size_t width = 13, height = 2, depth = 25;
+    std::vector<std::vector<float> > frames(depth, std::vector<float>(width * height));
+    for (size_t f = 0; f < depth; ++f){
+        for (size_t i = 0; i < width * height; ++i){
+            frames[f][i] = 0.2f + 0.01f * random.unit() + ((random.next() % 10) == 0 ? 0.5f : 0);
+        }
+    }
+    CASStackCombineParameters parameters = CASStackCombineDefaultParameters(kCASStackCombineKappaSigma);
+    parameters.kappaLow = parameters.kappaHigh = 2;
+    const std::vector<float> clipped = CASTestCombine(frames, width, height, parameters);
+    
+    // the same algorithm written out with a rejection mask over the unsorted samples
+    for (size_t i = 0; i < width * height; ++i){
+        std::vector<bool> keep(depth, true);
+        for (int iteration = 0; iteration < parameters.iterations; ++iteration){
+            std::vector<double> kept;
+            for (size_t f = 0; f < depth; ++f){
+                if (keep[f]) kept.push_back(frames[f][i]);
+            }
+            if (kept.size() <= 2) break;
+            double sum = 0, sumSq = 0;
+            for (size_t k = 0; k < kept.size(); ++k){
+                sum += kept[k];
+                sumSq += kept[k] * kept[k];
+            }
+            const double mean = sum / kept.size();
+            const double sigma = sqrt(std::max(0.0, sumSq / kept.size() - mean * mean));
+            std::sort(kept.begin(), kept.end());
+            const size_t n = kept.size();
+            const double median = (n & 1) ? (float)kept[n / 2] : 0.5f * ((float)kept[n / 2 - 1] + (float)kept[n / 2]);
+            bool changed = false;
+            std::vector<bool> next(keep);
+            size_t remaining = 0;
+            for (size_t f = 0; f < depth; ++f){
+                if (keep[f] && (frames[f][i] < median - 2 * sigma || frames[f][i] > median + 2 * sigma)){
+                    next[f] = false;
+                    changed = true;
+                }
+                remaining += next[f];
+            }
+            if (!changed || !remaining) break;
+            keep = next;
+        }
+        double sum = 0;
+        size_t n = 0;
+        for (size_t f = 0; f < depth; ++f){
+            if (keep[f]){
+                sum += frames[f][i];
+                ++n;
+            }
+        }
+        CAS_CHECK_CLOSE(clipped[i], sum / n, 1e-5);
+    }
+}
+
+CAS_TEST(StackClippingRejectsOutliers)
+{
+    CASTestRandom random;
+    const size_t width = 40, height = 5, depth = 30;
+    std::vector<std::vector<float> > frames(depth, std::vector<float>(width * height));
+    for (size_t f = 0; f < depth; ++f){
+        for (size_t i = 0; i < width * height; ++i){
+            frames[f][i] = 0.3f + 0.02f * (random.unit() - 0.5f);
+        }
+    }
+    
+    // satellite trail through one frame, a cold row through another
+    for (size_t x = 0; x < width; ++x){
+        frames[3][2 * width + x] = 1.0f;
+        frames[17][2 * width + x] = 0.0f;
+    }
+    
+    const CASStackCombineMode modes[] = { kCASStackCombineKappaSigma, kCASStackCombineWinsorizedSigma, kCASStackCombineLinearFit };
+    for (size_t m = 0; m < sizeof(modes)/sizeof(modes[0]); ++m){
+        const std::vector<float> combined = CASTestCombine(frames, width, height, CASStackCombineDefaultParameters(modes[m]));
+        for (size_t i = 0; i < width * height; ++i){
+            CAS_CHECK(fabs(combined[i] - 0.3f) < 0.006f);
+        }
+    }
+    
+    const std::vector<float> average = CASTestCombine(frames, width, height, CASStackCombineDefaultParameters(kCASStackCombineAverage));
+    CAS_CHECK(fabs(average[2 * width] - 0.3f) > 0.006f);
+}
+
+CAS_TEST(StackIgnoresFrameOrder)
+{
+    CASTestRandom random;
+    const size_t width = 37, height = 2, depth = 9;
+    std::vector<std::vector<float> > frames(depth, std::vector<float>(width * height));
+    for (size_t f = 0; f < depth; ++f){
+        CASTestFill(frames[f], random);
+    }
+    std::vector<std::vector<float> > reversed(frames.rbegin(), frames.rend());
+    for (int mode = kCASStackCombineMedian; mode <= kCASStackCombineLinearFit; ++mode){
+        const CASStackCombineParameters parameters = CASStackCombineDefaultParameters((CASStackCombineMode)mode);
+        CAS_CHECK(CASTestCombine(frames, width, height, parameters) == CASTestCombine(reversed, width, height, parameters));
+    }
+}
+
+CAS_TEST(StackStreamsFromFiles)
+{
+    CASTestRandom random;
+    const size_t width = 53, height = 31, depth = 7, offset = 12;
+    std::vector<std::vector<float> > frames(depth, std::vector<float>(width * height));
+    std::vector<CASStackFrame> stack(depth);
+    std::vector<std::string> paths;
+    
+    for (size_t f = 0; f < depth; ++f){
+        
+        // alternate 16-bit and float sample files, both behind a small header
+        char path[] = "/tmp/CASStackCombineTestsXXXXXX";
+        const int fd = mkstemp(path);
+        CAS_CHECK(fd != -1);
+        paths.push_back(path);
+        
+        std::vector<char> contents(offset, 0);
+        if (f & 1){
+            std::vector<uint16_t> samples(width * height);
+            CASTestFill(samples, random);
+            for (size_t i = 0; i < samples.size(); ++i){
+                frames[f][i] = samples[i] / 65535.0f;
+            }
+            contents.insert(contents.end(), (const char*)samples.data(), (const char*)(samples.data() + samples.size()));
+        }
+        else {
+            CASTestFill(frames[f], random);
+            contents.insert(contents.end(), (const char*)frames[f].data(), (const char*)(frames[f].data() + frames[f].size()));
+        }
+        CAS_CHECK(write(fd, contents.data(), contents.size()) == (ssize_t)contents.size());
+        close(fd);
+        
+        stack[f].format = (f & 1) ? kCASStackSampleUInt16 : kCASStackSampleFloat;
+        stack[f].pixels = NULL;
+        stack[f].path = paths.back().c_str();
+        stack[f].offset = offset;
+    }
+    
+    for (int mode = kCASStackCombineAverage; mode <= kCASStackCombineLinearFit; ++mode){
+        
+        // a limit small enough for only two rows of each frame at a time
+        CASStackCombineParameters parameters = CASStackCombineDefaultParameters((CASStackCombineMode)mode);
+        parameters.memoryLimit = 2 * width * depth * sizeof(float);
+        CAS_CHECK(CASStackStripRows(width, height, depth, parameters.memoryLimit) == 2);
+        
+        std::vector<float> streamed(width * height);
+        CAS_CHECK(CASStackCombine(stack.data(), depth, width, height, parameters, streamed.data()));
+        
+        const std::vector<float> expected = CASTestCombine(frames, width, height, parameters);
+        for (size_t i = 0; i < streamed.size(); ++i){
+            CAS_CHECK_CLOSE(streamed[i], expected[i], 1e-6);
+        }
+    }
+    
+    for (size_t f = 0; f < paths.size(); ++f){
+        unlink(paths[f].c_str());
+    }
+    
+    stack[0].path = "/nonexistent/samples.data";
+    std::vector<float> out(width * height);
+    CAS_CHECK(!CASStackCombine(stack.data(), depth, width, height, CASStackCombineDefaultParameters(kCASStackCombineMedian), out.data()));
+}
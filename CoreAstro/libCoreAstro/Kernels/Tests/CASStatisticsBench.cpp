@@ -0,0 +1,73 @@
+//
+//  CASStatisticsBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Compares the single pass statistics with the separate passes and full sort they replace.
+
+#include "CASTestSupport.h"
+#include "CASStatistics.h"
+#include <algorithm>
+
+CAS_BENCH(Statistics)
+{
+    const size_t count = ctx.pixelCount();
+    CASTestRandom random;
+    std::vector<uint16_t> shorts(count);
+    std::vector<float> floats(count);
+    for (size_t i = 0; i < count; ++i){
+        shorts[i] = 2000 + (random.next() % 200);
+        floats[i] = shorts[i] / 65535.0f;
+    }
+    
+    ctx.measure("separate passes + sort", 6.0 * count * sizeof(float), [&]{
+        std::vector<float> copy(floats);
+        std::sort(copy.begin(), copy.end());
+        volatile float median = copy[count / 2];
+        double total = 0;
+        float minimum = floats[0], maximum = floats[0];
+        for (size_t i = 0; i < count; ++i){
+            total += floats[i];
+            minimum = std::min(minimum, floats[i]);
+            maximum = std::max(maximum, floats[i]);
+        }
+        const float mean = total / count;
+        std::vector<float> working(count);
+        for (size_t i = 0; i < count; ++i){
+            working[i] = (floats[i] - mean) * (floats[i] - mean);
+        }
+        double squares = 0;
+        for (size_t i = 0; i < count; ++i){
+            squares += working[i];
+        }
+        volatile float deviation = sqrt(squares / count);
+        (void)median; (void)deviation;
+    });
+    
+    CASStatistics statistics;
+    ctx.measure("single pass uint16", count * sizeof(uint16_t), [&]{
+        CASStatisticsCompute(shorts.data(), count, 1.0f / 65535.0f, statistics);
+    });
+    ctx.measure("float", 3.0 * count * sizeof(float), [&]{
+        CASStatisticsCompute(floats.data(), count, statistics);
+    });
+}
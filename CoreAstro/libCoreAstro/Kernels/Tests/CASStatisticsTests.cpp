@@ -0,0 +1,196 @@
+//
+//  CASStatisticsTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASStatistics.h"
+#include <algorithm>
+
+// straightforward sort based versions of everything
+struct CASReferenceStatistics {
+    double mean, standardDeviation, median, medianDeviation;
+    std::vector<double> sorted;
+    
+    explicit CASReferenceStatistics(const std::vector<double>& values) : sorted(values) {
+        std::sort(sorted.begin(), sorted.end());
+        const size_t n = sorted.size();
+        double total = 0;
+        for (size_t i = 0; i < n; ++i){
+            total += sorted[i];
+        }
+        mean = total / n;
+        double squares = 0;
+        for (size_t i = 0; i < n; ++i){
+            squares += (sorted[i] - mean) * (sorted[i] - mean);
+        }
+        standardDeviation = sqrt(squares / n);
+        median = 0.5 * (sorted[(n - 1) / 2] + sorted[n / 2]);
+        std::vector<double> deviations(n);
+        for (size_t i = 0; i < n; ++i){
+            deviations[i] = fabs(sorted[i] - median);
+        }
+        std::sort(deviations.begin(), deviations.end());
+        medianDeviation = 0.5 * (deviations[(n - 1) / 2] + deviations[n / 2]);
+    }
+    
+    double percentile(double fraction) const {
+        const double rank = fraction * (sorted.size() - 1);
+        const size_t low = (size_t)rank, high = std::min(low + 1, sorted.size() - 1);
+        return sorted[low] + (sorted[high] - sorted[low]) * (rank - low);
+    }
+};
+
+static void CASStatisticsApplyBackwards(size_t count, void* context, void (*work)(void* context, size_t index))
+{
+    for (size_t i = count; i-- > 0;){
+        work(context, i);
+    }
+}
+
+CAS_TEST(StatisticsU16MatchesSort)
+{
+    const float scale = 1.0f / 65535.0f;
+    const size_t lengths[] = { 1, 2, 7, 1000, 1001, 3 * CAS_STATISTICS_CHUNK_PIXELS + 5 };
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(lengths)/sizeof(lengths[0]); ++l){
+        
+        // a sky background with a few hot pixels, like a real frame
+        std::vector<uint16_t> pixels(lengths[l]);
+        std::vector<double> values(pixels.size());
+        for (size_t i = 0; i < pixels.size(); ++i){
+            pixels[i] = (random.next() % 100) ? 1500 + random.next() % 300 : random.sample();
+            values[i] = pixels[i] * (double)scale;
+        }
+        const CASReferenceStatistics reference(values);
+        
+        CASStatistics statistics;
+        CAS_CHECK(CASStatisticsCompute(pixels.data(), pixels.size(), scale, statistics));
+        CAS_CHECK(statistics.exact);
+        CAS_CHECK(statistics.count == pixels.size());
+        CAS_CHECK_CLOSE(statistics.minimum, reference.sorted.front(), 1e-6);
+        CAS_CHECK_CLOSE(statistics.maximum, reference.sorted.back(), 1e-6);
+        CAS_CHECK_CLOSE(statistics.mean, reference.mean, 1e-9);
+        CAS_CHECK_CLOSE(statistics.standardDeviation, reference.standardDeviation, 1e-6);
+        CAS_CHECK_CLOSE(statistics.median, reference.median, 1e-6);
+        CAS_CHECK_CLOSE(statistics.medianDeviation, reference.medianDeviation, 1e-6);
+        const double fractions[] = { 0, 0.005, 0.25, 0.5, 0.75, 0.995, 1 };
+        for (size_t f = 0; f < sizeof(fractions)/sizeof(fractions[0]); ++f){
+            CAS_CHECK_CLOSE(CASStatisticsPercentile(statistics, fractions[f]), reference.percentile(fractions[f]), 1e-6);
+        }
+    }
+}
+
+CAS_TEST(StatisticsFloatMatchesSort)
+{
+    const size_t lengths[] = { 1, 2, 7, 1000, 1001, 2 * CAS_STATISTICS_CHUNK_PIXELS + 3 };
+    CASTestRandom random;
+    for (size_t l = 0; l < sizeof(lengths)/sizeof(lengths[0]); ++l){
+        
+        // calibrated frames go slightly negative and have the odd NaN where the flat was zero
+        std::vector<float> pixels(lengths[l]);
+        std::vector<double> values;
+        for (size_t i = 0; i < pixels.size(); ++i){
+            pixels[i] = random.unit() * random.unit() - 0.05f;
+            if (i && !(i % 997)){
+                pixels[i] = NAN;
+            }
+            else {
+                values.push_back(pixels[i]);
+            }
+        }
+        const CASReferenceStatistics reference(values);
+        
+        CASStatistics statistics;
+        CAS_CHECK(CASStatisticsCompute(pixels.data(), pixels.size(), statistics));
+        CAS_CHECK(statistics.count == values.size());
+        CAS_CHECK(statistics.minimum == (float)reference.sorted.front());
+        CAS_CHECK(statistics.maximum == (float)reference.sorted.back());
+        CAS_CHECK_CLOSE(statistics.mean, reference.mean, 1e-9);
+        CAS_CHECK_CLOSE(statistics.standardDeviation, reference.standardDeviation, 1e-9);
+        CAS_CHECK_CLOSE(statistics.median, reference.median, 1e-7);
+        
+        // the rest are to within a bin
+        const double binWidth = statistics.histogramBinWidth;
+        CAS_CHECK(fabs(statistics.medianDeviation - reference.medianDeviation) <= 1.01 * binWidth);
+        const double fractions[] = { 0, 0.01, 0.5, 0.99, 1 };
+        for (size_t f = 0; f < sizeof(fractions)/sizeof(fractions[0]); ++f){
+            CAS_CHECK(fabs(CASStatisticsPercentile(statistics, fractions[f]) - reference.percentile(fractions[f])) <= 1.01 * binWidth);
+        }
+    }
+}
+
+CAS_TEST(StatisticsEdgeCases)
+{
+    CASStatistics statistics;
+    CAS_CHECK(!CASStatisticsCompute((const uint16_t*)NULL, 0, 1, statistics));
+    
+    const std::vector<float> nans(10, NAN);
+    CAS_CHECK(!CASStatisticsCompute(nans.data(), nans.size(), statistics));
+    CAS_CHECK(statistics.count == 0);
+    
+    const std::vector<float> flat(100, 0.25f);
+    CAS_CHECK(CASStatisticsCompute(flat.data(), flat.size(), statistics));
+    CAS_CHECK(statistics.median == 0.25f && statistics.medianDeviation == 0 && statistics.standardDeviation == 0);
+    CAS_CHECK(CASStatisticsPercentile(statistics, 0.9) == 0.25f);
+}
+
+CAS_TEST(StatisticsIgnoreChunkOrder)
+{
+    CASTestRandom random;
+    std::vector<float> floats(5 * CAS_STATISTICS_CHUNK_PIXELS + 11);
+    std::vector<uint16_t> shorts(floats.size());
+    CASTestFill(floats, random);
+    CASTestFill(shorts, random);
+    
+    CASStatistics forwards, backwards;
+    CASStatisticsCompute(floats.data(), floats.size(), forwards);
+    CASStatisticsCompute(floats.data(), floats.size(), backwards, CASStatisticsApplyBackwards);
+    CAS_CHECK(forwards.mean == backwards.mean && forwards.standardDeviation == backwards.standardDeviation);
+    CAS_CHECK(forwards.median == backwards.median && forwards.histogram == backwards.histogram);
+    
+    CASStatisticsCompute(shorts.data(), shorts.size(), 1, forwards);
+    CASStatisticsCompute(shorts.data(), shorts.size(), 1, backwards, CASStatisticsApplyBackwards);
+    CAS_CHECK(forwards.mean == backwards.mean && forwards.median == backwards.median && forwards.histogram == backwards.histogram);
+}
+
+CAS_TEST(StatisticsLuminanceMatchesFrame)
+{
+    CASTestRandom random;
+    std::vector<float> rgba(4 * (2 * CAS_STATISTICS_CHUNK_PIXELS + 3));
+    CASTestFill(rgba, random);
+    
+    // the same weights and clip as the luminance kernel
+    std::vector<float> luminance(rgba.size() / 4);
+    for (size_t i = 0; i < luminance.size(); ++i){
+        const float* p = &rgba[4 * i];
+        luminance[i] = std::min(1.0f, (0.2126f * p[0]) + (0.7152f * p[1]) + (0.0722f * p[2]));
+    }
+    
+    CASStatistics fromRGBA, fromFrame;
+    CAS_CHECK(CASStatisticsComputeLuminance(rgba.data(), luminance.size(), fromRGBA, CASStatisticsApplyBackwards));
+    CAS_CHECK(CASStatisticsCompute(luminance.data(), luminance.size(), fromFrame));
+    CAS_CHECK(fromRGBA.count == fromFrame.count);
+    CAS_CHECK_CLOSE(fromRGBA.mean, fromFrame.mean, 1e-6);
+    CAS_CHECK_CLOSE(fromRGBA.median, fromFrame.median, 1e-6);
+    CAS_CHECK_CLOSE(fromRGBA.medianDeviation, fromFrame.medianDeviation, 1e-5);
+}
@@ -0,0 +1,55 @@
+//
+//  CASTestMain.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Runs every registered test, or those whose names contain the first argument.
+//  Exits non-zero if any fail.
+
+#include "CASTestSupport.h"
+#include <string.h>
+
+int main(int argc, char** argv)
+{
+    const char* filter = (argc > 1) ? argv[1] : NULL;
+    
+    int run = 0, failed = 0;
+    const std::vector<CASTest>& tests = CASTestRegistry();
+    for (size_t i = 0; i < tests.size(); ++i){
+        if (filter && !strstr(tests[i].name, filter)){
+            continue;
+        }
+        ++run;
+        try {
+            tests[i].fn();
+            printf("ok   %s\n", tests[i].name);
+        }
+        catch (const CASTestFailure&) {
+            ++failed;
+            printf("FAIL %s\n", tests[i].name);
+        }
+    }
+    
+    printf("%d tests, %d failed\n", run, failed);
+    
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+//
+//  CASTestSupport.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Shared by the test and benchmark runners.
+
+#include "CASTestSupport.h"
+#include <chrono>
+
+std::vector<CASTest>& CASTestRegistry()
+{
+    static std::vector<CASTest> registry;
+    return registry;
+}
+
+std::vector<CASBench>& CASBenchRegistry()
+{
+    static std::vector<CASBench> registry;
+    return registry;
+}
+
+void CASTestFill(std::vector<float>& values, CASTestRandom& random)
+{
+    for (size_t i = 0; i < values.size(); ++i){
+        values[i] = random.unit();
+    }
+}
+
+void CASTestFill(std::vector<uint16_t>& values, CASTestRandom& random)
+{
+    for (size_t i = 0; i < values.size(); ++i){
+        values[i] = random.sample();
+    }
+}
+
+void CASBenchContext::measure(const std::string& label, double bytes, const std::function<void()>& block) const
+{
+    double best = 1e30;
+    for (int i = 0; i < iterations; ++i){
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        block();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds < best){
+            best = seconds;
+        }
+    }
+    printf("  %-32s %6.1f MP %10.3f ms %10.1f MP/s %8.2f GB/s\n",
+           label.c_str(), megapixels, best * 1000.0, (pixelCount() / 1e6) / best, (bytes / 1e9) / best);
+    fflush(stdout);
+}
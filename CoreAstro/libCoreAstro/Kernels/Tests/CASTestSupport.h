@@ -0,0 +1,118 @@
+//
+//  CASTestSupport.h
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  Minimal test and benchmark registration for the portable kernels, kept dependency
+//  free so that it builds anywhere there's a C++11 compiler.
+
+#ifndef __CASTestSupport_h__
+#define __CASTestSupport_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// tests
+
+struct CASTestFailure {};
+
+struct CASTest {
+    const char* name;
+    void (*fn)();
+};
+
+std::vector<CASTest>& CASTestRegistry();
+
+struct CASTestRegistration {
+    CASTestRegistration(const char* name, void (*fn)()) {
+        CASTest test = { name, fn };
+        CASTestRegistry().push_back(test);
+    }
+};
+
+#define CAS_TEST(name) \
+    static void CASTest_##name(); \
+    static CASTestRegistration CASTestRegistration_##name(#name, CASTest_##name); \
+    static void CASTest_##name()
+
+#define CAS_CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); throw CASTestFailure(); } } while (0)
+
+#define CAS_CHECK_CLOSE(a, b, tolerance) \
+    do { const double _a = (a), _b = (b); \
+         if (!(fabs(_a - _b) <= (tolerance) * fmax(1.0, fmax(fabs(_a), fabs(_b))))) { \
+             fprintf(stderr, "%s:%d: check failed: %s (%.9g) ~= %s (%.9g)\n", __FILE__, __LINE__, #a, _a, #b, _b); throw CASTestFailure(); } } while (0)
+
+// deterministic pseudo random samples so failures are reproducible
+
+struct CASTestRandom {
+    uint64_t state;
+    explicit CASTestRandom(uint64_t seed = 0x2545F4914F6CDD1DULL) : state(seed) {}
+    uint32_t next() {
+        state ^= state >> 12; state ^= state << 25; state ^= state >> 27;
+        return (uint32_t)((state * 0x2545F4914F6CDD1DULL) >> 32);
+    }
+    float unit() { return (next() >> 8) * (1.0f / 16777216.0f); } // [0,1)
+    uint16_t sample() { return (uint16_t)(next() >> 16); }
+};
+
+void CASTestFill(std::vector<float>& values, CASTestRandom& random);
+void CASTestFill(std::vector<uint16_t>& values, CASTestRandom& random);
+
+// benchmarks
+
+struct CASBenchContext {
+    double megapixels;
+    size_t width, height;
+    int iterations;
+    
+    size_t pixelCount() const { return width * height; }
+    
+    // runs the block `iterations` times and reports the best time, bytes is the memory traffic of one run
+    void measure(const std::string& label, double bytes, const std::function<void()>& block) const;
+};
+
+struct CASBench {
+    const char* name;
+    void (*fn)(const CASBenchContext& ctx);
+};
+
+std::vector<CASBench>& CASBenchRegistry();
+
+struct CASBenchRegistration {
+    CASBenchRegistration(const char* name, void (*fn)(const CASBenchContext&)) {
+        CASBench bench = { name, fn };
+        CASBenchRegistry().push_back(bench);
+    }
+};
+
+#define CAS_BENCH(name) \
+    static void CASBench_##name(const CASBenchContext& ctx); \
+    static CASBenchRegistration CASBenchRegistration_##name(#name, CASBench_##name); \
+    static void CASBench_##name(const CASBenchContext& ctx)
+
+#endif
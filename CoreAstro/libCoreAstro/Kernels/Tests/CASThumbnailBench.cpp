@@ -0,0 +1,58 @@
+//
+//  CASThumbnailBench.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+//
+//  A 256 pixel wide library thumbnail straight from the frame against from the pyramid level nearest it.
+
+
+#include "CASTestSupport.h"
+#include "CASThumbnail.h"
+#include "CASPyramid.h"
+
+CAS_BENCH(Thumbnail)
+{
+    CASTestRandom random;
+    std::vector<uint16_t> samples(ctx.pixelCount());
+    CASTestFill(samples, random);
+    const CASPixels frame = CASPixelsMake(kCASPixelFormatUInt16, samples.data(), ctx.width, ctx.height, ctx.width);
+    const size_t width = 256, height = CASThumbnailHeight(ctx.width, ctx.height, width);
+    std::vector<uint8_t> thumbnail(width * height);
+    
+    ctx.measure("from the frame", samples.size() * sizeof(uint16_t), [&]{
+        CASThumbnailRender(frame, width, height, thumbnail.data(), width);
+    });
+    
+    std::vector<uint8_t> pyramid(CASPyramidSize(kCASPixelFormatUInt16, ctx.width, ctx.height));
+    CASPyramidBuild(frame, pyramid.data());
+    CASPixels level = frame;
+    for (size_t i = 1; i <= CASPyramidLevelCount(ctx.width, ctx.height); ++i){
+        const CASPixels next = CASPyramidLevel(kCASPixelFormatUInt16, pyramid.data(), ctx.width, ctx.height, i);
+        if (next.width < width){
+            break;
+        }
+        level = next;
+    }
+    ctx.measure("from the pyramid", samples.size() * sizeof(uint16_t), [&]{
+        CASThumbnailRender(level, width, height, thumbnail.data(), width);
+    });
+}
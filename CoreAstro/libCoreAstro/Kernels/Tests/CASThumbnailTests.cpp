@@ -0,0 +1,78 @@
+//
+//  CASThumbnailTests.cpp
+//  CoreAstro
+//
+//  Copyright (c) 2014, Simon Taylor
+// 
+//  Permission is hereby granted, free of charge, to any person obtaining a copy 
+//  of this software and associated documentation files (the "Software"), to deal 
+//  in the Software without restriction, including without limitation the rights 
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+//  copies of the Software, and to permit persons to whom the Software is furnished 
+//  to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in 
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+//  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+//  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+//  IN THE SOFTWARE.
+
+#include "CASTestSupport.h"
+#include "CASThumbnail.h"
+
+CAS_TEST(ThumbnailAverages)
+{
+    const uint16_t samples[] = {
+        0,     65535, 13107, 13107,
+        65535, 0,     13107, 13107
+    };
+    uint8_t out[2] = { 0 };
+    CAS_CHECK(CASThumbnailRender(CASPixelsMake(kCASPixelFormatUInt16, samples, 4, 2, 4), 2, 1, out, 2));
+    CAS_CHECK(out[0] == 128); // half of full scale, rounded
+    CAS_CHECK(out[1] == 51);  // a fifth
+    
+    // uneven boxes each average the whole frame pixels under them
+    const float pixels[] = {
+        0.1f, 0.2f, 0.3f, 0.4f, 0.5f,
+        0.2f, 0.3f, 0.4f, 0.5f, 0.6f,
+        0.3f, 0.4f, 0.5f, 0.6f, 0.7f
+    };
+    uint8_t uneven[4] = { 0 };
+    CAS_CHECK(CASThumbnailRender(CASPixelsMake(kCASPixelFormatFloat, pixels, 5, 3, 5), 2, 2, uneven, 2));
+    CAS_CHECK(uneven[0] == (uint8_t)(0.15f * 255 + 0.5f)); // columns 0-1, row 0
+    CAS_CHECK(uneven[1] == (uint8_t)(0.4f * 255 + 0.5f));  // columns 2-4, row 0
+    CAS_CHECK(uneven[2] == (uint8_t)(0.3f * 255 + 0.5f));  // columns 0-1, rows 1-2
+    CAS_CHECK(uneven[3] == (uint8_t)(0.55f * 255 + 0.5f)); // columns 2-4, rows 1-2
+}
+
+CAS_TEST(ThumbnailClampsAndColour)
+{
+    const float rgba[] = {
+        2.0f, -1.0f, 0.5f, 0.0f,   0.0f, -1.0f, 0.5f, 0.0f,
+    };
+    uint8_t out[4] = { 0 };
+    CAS_CHECK(CASThumbnailRender(CASPixelsMake(kCASPixelFormatRGBAFloat, rgba, 2, 1, 2), 1, 1, out, 4));
+    CAS_CHECK(out[0] == 255 && out[1] == 0 && out[2] == 128 && out[3] == 255);
+    
+    // bigger than the frame repeats its pixels
+    const uint16_t samples[] = { 0, 65535 };
+    uint8_t bigger[4] = { 1, 1, 1, 1 };
+    CAS_CHECK(CASThumbnailRender(CASPixelsMake(kCASPixelFormatUInt16, samples, 2, 1, 2), 4, 1, bigger, 4));
+    CAS_CHECK(bigger[0] == 0 && bigger[1] == 0 && bigger[2] == 255 && bigger[3] == 255);
+    
+    CAS_CHECK(!CASThumbnailRender(CASPixelsMake(kCASPixelFormatUInt16, samples, 2, 1, 2), 0, 1, bigger, 4));
+    CAS_CHECK(!CASThumbnailRender(CASPixelsMake(kCASPixelFormatUInt16, samples, 2, 1, 2), 4, 1, bigger, 3));
+}
+
+CAS_TEST(ThumbnailHeight)
+{
+    CAS_CHECK(CASThumbnailHeight(4896, 3264, 256) == 171);
+    CAS_CHECK(CASThumbnailHeight(3264, 4896, 256) == 384);
+    CAS_CHECK(CASThumbnailHeight(10000, 1, 256) == 1);
+    CAS_CHECK(CASThumbnailHeight(0, 100, 256) == 0);
+}
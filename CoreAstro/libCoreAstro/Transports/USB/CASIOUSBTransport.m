@@ -25,6 +25,7 @@
 
 #import "CASIOUSBTransport.h"
 #import "BusProberSharedFunctions.h"
+#import "CASFramePoolData.h"
 
 @interface CASIOUSBTransport ()
 @property (nonatomic,assign) IOCFPlugInInterface** plugin;
@@ -194,7 +195,11 @@ NSString* const kCASIOUSBTransportCompletionTimeoutDefaultsKey = @"CASIOUSBTrans
     
     NSError* error = nil;
     
-    NSMutableData* packetBuffer = [NSMutableData dataWithLength:MAX(self.inMaxSize,[data length])]; // cache this buffer ? also lots of copying going on
+    // frame sized for image reads so it comes from the pool rather than faulting in fresh pages every frame
+    NSMutableData* packetBuffer = [CASFramePoolData uninitialisedDataWithLength:MAX(self.inMaxSize,[data length])];
+    if (!packetBuffer){
+        return [NSError errorWithDomain:@"CASIOUSBTransport" code:kIOReturnNoMemory userInfo:nil];
+    }
     uint8_t* packetBufferPtr = (uint8_t*)[packetBuffer mutableBytes];
     
     // const NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
@@ -29,6 +29,7 @@
 #import "SXCCDDeviceFactory.h"
 #import "CASCCDExposure.h"
 #import "CASAutoGuider.h"
+#import "CASFramePoolData.h"
 
 @interface SXCCDDevice ()
 @property (nonatomic,assign) BOOL connected;
@@ -611,7 +612,7 @@
             // clear both fields first ??
             
             void (^combineAndComplete)(NSError*,NSData*,NSData*) = ^(NSError* error, NSData* evenField, NSData* oddField){
-                NSMutableData* combined = [NSMutableData dataWithLength:[evenField length] + [oddField length]];
+                NSMutableData* combined = [CASFramePoolData uninitialisedDataWithLength:[evenField length] + [oddField length]];
                 if (!combined){
                     // error
                 }
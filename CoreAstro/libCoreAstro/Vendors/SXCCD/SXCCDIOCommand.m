@@ -57,6 +57,7 @@
 */
 
 #import "SXCCDIOCommand.h"
+#import "CASFramePoolData.h"
 
 #define USHORT      uint16_t
 #define BYTE        int8_t
@@ -841,7 +842,7 @@ static uint8_t* sxReconstructM26CFields4x4(const uint8_t* field1Pixels,const uin
         
         // sxReconstructM25CFields()
         
-        NSMutableData* rearrangedPixels = [NSMutableData dataWithLength:[pixels length]];
+        NSMutableData* rearrangedPixels = [CASFramePoolData dataWithLength:[pixels length]];
         if ([rearrangedPixels length]){
             
             uint16_t* pixelsPtr = (uint16_t*)[pixels bytes];
@@ -1112,7 +1113,7 @@ static uint8_t* sxReconstructM26CFields4x4(const uint8_t* field1Pixels,const uin
     // de-interlace and normalise the two fields
     if ([pixels length]){
         
-        NSMutableData* rearrangedPixels = [NSMutableData dataWithLength:[pixels length]];
+        NSMutableData* rearrangedPixels = [CASFramePoolData dataWithLength:[pixels length]];
         if ([rearrangedPixels length]){
             
             uint16_t* pixelsPtr = (uint16_t*)[pixels bytes];
@@ -1245,11 +1246,11 @@ static uint8_t* sxReconstructM26CFields4x4(const uint8_t* field1Pixels,const uin
     }
     else {
         const NSInteger length = [_pixels length] + [data length];
-        uint8_t* final = malloc(length);
+        NSMutableData* final = [CASFramePoolData uninitialisedDataWithLength:length];
         if (final){
-            memcpy(final, [_pixels bytes], [_pixels length]);
-            memcpy(final + [_pixels length], [data bytes], [data length]);
-            _pixels = [NSData dataWithBytesNoCopy:final length:length freeWhenDone:YES];
+            memcpy([final mutableBytes], [_pixels bytes], [_pixels length]);
+            memcpy((uint8_t*)[final mutableBytes] + [_pixels length], [data bytes], [data length]);
+            _pixels = final;
         }
     }
     return nil;
@@ -137,3 +137,36 @@ PERF_TEST_P(Sz_ClipLimit, CLAHE,
 
     SANITY_CHECK(dst);
 }
+
+typedef tr1::tuple<Size, double, MatType> Sz_ClipLimit_Type_t;
+typedef TestBaseWithParam<Sz_ClipLimit_Type_t> Sz_ClipLimit_Type;
+
+PERF_TEST_P(Sz_ClipLimit_Type, CLAHE_16U_32F,
+            testing::Combine(testing::Values(::perf::szVGA, ::perf::sz720p, ::perf::sz1080p),
+                             testing::Values(0.0, 40.0),
+                             testing::Values(MatType(CV_16UC1), MatType(CV_32FC1)))
+            )
+{
+    const Size size = get<0>(GetParam());
+    const double clipLimit = get<1>(GetParam());
+    const int type = get<2>(GetParam());
+
+    Mat src(size, type);
+    if (type == CV_32FC1)
+    {
+        // float images are expected in [0,1]
+        randu(src, 0.0, 1.0);
+        declare.in(src);
+    }
+    else
+    {
+        declare.in(src, WARMUP_RNG);
+    }
+
+    Ptr<CLAHE> clahe = createCLAHE(clipLimit);
+    Mat dst;
+
+    TEST_CYCLE() clahe->apply(src, dst);
+
+    SANITY_CHECK(dst, 1);
+}
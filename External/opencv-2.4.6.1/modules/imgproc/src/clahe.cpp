@@ -46,6 +46,7 @@
 
 namespace
 {
+    template <class T, int histSize>
     class CLAHE_CalcLut_Body : public cv::ParallelLoopBody
     {
     public:
@@ -67,12 +68,15 @@ namespace
         float lutScale_;
     };
 
-    void CLAHE_CalcLut_Body::operator ()(const cv::Range& range) const
+    template <class T, int histSize>
+    void CLAHE_CalcLut_Body<T, histSize>::operator ()(const cv::Range& range) const
     {
-        const int histSize = 256;
+        T* tileLut = lut_.ptr<T>(range.start);
+        const size_t lut_step = lut_.step / sizeof(T);
 
-        uchar* tileLut = lut_.ptr(range.start);
-        const size_t lut_step = lut_.step;
+        // 65536 bins for 16-bit images is too much for the stack
+        cv::AutoBuffer<int> _tileHist(histSize);
+        int* tileHist = _tileHist;
 
         for (int k = range.start; k < range.end; ++k, tileLut += lut_step)
         {
@@ -91,11 +95,11 @@ namespace
 
             // calc histogram
 
-            int tileHist[histSize] = {0, };
+            std::fill(tileHist, tileHist + histSize, 0);
 
             int height = tileROI.height;
-            const size_t sstep = tile.step;
-            for (const uchar* ptr = tile.ptr<uchar>(0); height--; ptr += sstep)
+            const size_t sstep = tile.step / sizeof(T);
+            for (const T* ptr = tile.ptr<T>(0); height--; ptr += sstep)
             {
                 int x = 0;
                 for (; x <= tileROI.width - 4; x += 4)
@@ -132,8 +136,19 @@ namespace
                 for (int i = 0; i < histSize; ++i)
                     tileHist[i] += redistBatch;
 
-                for (int i = 0; i < residual; ++i)
-                    tileHist[i]++;
+                if (histSize == 256)
+                {
+                    for (int i = 0; i < residual; ++i)
+                        tileHist[i]++;
+                }
+                else if (residual > 0)
+                {
+                    // with 65536 bins the residual can be most of what was clipped, spread it across the range
+                    // rather than piling it into the darkest bins
+                    const int residualStep = std::max(histSize / residual, 1);
+                    for (int i = 0; i < histSize && residual > 0; i += residualStep, residual--)
+                        tileHist[i]++;
+                }
             }
 
             // calc Lut
@@ -142,17 +157,41 @@ namespace
             for (int i = 0; i < histSize; ++i)
             {
                 sum += tileHist[i];
-                tileLut[i] = cv::saturate_cast<uchar>(sum * lutScale_);
+                tileLut[i] = cv::saturate_cast<T>(sum * lutScale_);
             }
         }
     }
 
+    template <class T>
     class CLAHE_Interpolation_Body : public cv::ParallelLoopBody
     {
     public:
         CLAHE_Interpolation_Body(const cv::Mat& src, cv::Mat& dst, const cv::Mat& lut, cv::Size tileSize, int tilesX, int tilesY) :
             src_(src), dst_(dst), lut_(lut), tileSize_(tileSize), tilesX_(tilesX), tilesY_(tilesY)
         {
+            // the tiles and weights for each column are the same on every row so work them out once
+            buf_.allocate(src.cols * 3);
+            ind1_p = (int*)buf_;
+            ind2_p = ind1_p + src.cols;
+            xa_p = (float*)(ind2_p + src.cols);
+
+            const size_t lut_step = lut_.step / sizeof(T);
+
+            for (int x = 0; x < src.cols; ++x)
+            {
+                const float txf = (static_cast<float>(x) / tileSize_.width) - 0.5f;
+
+                int tx1 = cvFloor(txf);
+                int tx2 = tx1 + 1;
+
+                xa_p[x] = txf - tx1;
+
+                tx1 = std::max(tx1, 0);
+                tx2 = std::min(tx2, tilesX_ - 1);
+
+                ind1_p[x] = static_cast<int>(tx1 * lut_step);
+                ind2_p[x] = static_cast<int>(tx2 * lut_step);
+            }
         }
 
         void operator ()(const cv::Range& range) const;
@@ -165,16 +204,20 @@ namespace
         cv::Size tileSize_;
         int tilesX_;
         int tilesY_;
+
+        cv::AutoBuffer<int> buf_;
+        int* ind1_p;
+        int* ind2_p;
+        float* xa_p;
     };
 
-    void CLAHE_Interpolation_Body::operator ()(const cv::Range& range) const
+    template <class T>
+    void CLAHE_Interpolation_Body<T>::operator ()(const cv::Range& range) const
     {
-        const size_t lut_step = lut_.step;
-
         for (int y = range.start; y < range.end; ++y)
         {
-            const uchar* srcRow = src_.ptr<uchar>(y);
-            uchar* dstRow = dst_.ptr<uchar>(y);
+            const T* srcRow = src_.ptr<T>(y);
+            T* dstRow = dst_.ptr<T>(y);
 
             const float tyf = (static_cast<float>(y) / tileSize_.height) - 0.5f;
 
@@ -186,25 +229,17 @@ namespace
             ty1 = std::max(ty1, 0);
             ty2 = std::min(ty2, tilesY_ - 1);
 
-            const uchar* lutPlane1 = lut_.ptr(ty1 * tilesX_);
-            const uchar* lutPlane2 = lut_.ptr(ty2 * tilesX_);
+            const T* lutPlane1 = lut_.ptr<T>(ty1 * tilesX_);
+            const T* lutPlane2 = lut_.ptr<T>(ty2 * tilesX_);
 
             for (int x = 0; x < src_.cols; ++x)
             {
-                const float txf = (static_cast<float>(x) / tileSize_.width) - 0.5f;
-
-                int tx1 = cvFloor(txf);
-                int tx2 = tx1 + 1;
-
-                const float xa = txf - tx1;
-
-                tx1 = std::max(tx1, 0);
-                tx2 = std::min(tx2, tilesX_ - 1);
-
                 const int srcVal = srcRow[x];
 
-                const size_t ind1 = tx1 * lut_step + srcVal;
-                const size_t ind2 = tx2 * lut_step + srcVal;
+                const int ind1 = ind1_p[x] + srcVal;
+                const int ind2 = ind2_p[x] + srcVal;
+
+                const float xa = xa_p[x];
 
                 float res = 0;
 
@@ -213,7 +248,7 @@ namespace
                 res += lutPlane2[ind1] * ((1.0f - xa) * (ya));
                 res += lutPlane2[ind2] * ((xa) * (ya));
 
-                dstRow[x] = cv::saturate_cast<uchar>(res);
+                dstRow[x] = cv::saturate_cast<T>(res);
             }
         }
     }
@@ -258,14 +293,24 @@ namespace
     {
         cv::Mat src = _src.getMat();
 
-        CV_Assert( src.type() == CV_8UC1 );
+        CV_Assert( src.type() == CV_8UC1 || src.type() == CV_16UC1 || src.type() == CV_32FC1 );
+
+        // floating point images are taken to be in [0,1] and equalised at 16-bit precision
+        if (src.type() == CV_32FC1)
+        {
+            cv::Mat src16, dst16;
+            src.convertTo(src16, CV_16U, 65535.0);
+            apply(src16, dst16);
+            dst16.convertTo(_dst, CV_32F, 1.0 / 65535.0);
+            return;
+        }
 
         _dst.create( src.size(), src.type() );
         cv::Mat dst = _dst.getMat();
 
-        const int histSize = 256;
+        const int histSize = src.type() == CV_8UC1 ? 256 : 65536;
 
-        lut_.create(tilesX_ * tilesY_, histSize, CV_8UC1);
+        lut_.create(tilesX_ * tilesY_, histSize, src.type());
 
         cv::Size tileSize;
         cv::Mat srcForLut;
@@ -293,11 +338,22 @@ namespace
             clipLimit = std::max(clipLimit, 1);
         }
 
-        CLAHE_CalcLut_Body calcLutBody(srcForLut, lut_, tileSize, tilesX_, tilesY_, clipLimit, lutScale);
-        cv::parallel_for_(cv::Range(0, tilesX_ * tilesY_), calcLutBody);
+        if (src.type() == CV_8UC1)
+        {
+            CLAHE_CalcLut_Body<uchar, 256> calcLutBody(srcForLut, lut_, tileSize, tilesX_, tilesY_, clipLimit, lutScale);
+            cv::parallel_for_(cv::Range(0, tilesX_ * tilesY_), calcLutBody);
 
-        CLAHE_Interpolation_Body interpolationBody(src, dst, lut_, tileSize, tilesX_, tilesY_);
-        cv::parallel_for_(cv::Range(0, src.rows), interpolationBody);
+            CLAHE_Interpolation_Body<uchar> interpolationBody(src, dst, lut_, tileSize, tilesX_, tilesY_);
+            cv::parallel_for_(cv::Range(0, src.rows), interpolationBody);
+        }
+        else
+        {
+            CLAHE_CalcLut_Body<ushort, 65536> calcLutBody(srcForLut, lut_, tileSize, tilesX_, tilesY_, clipLimit, lutScale);
+            cv::parallel_for_(cv::Range(0, tilesX_ * tilesY_), calcLutBody);
+
+            CLAHE_Interpolation_Body<ushort> interpolationBody(src, dst, lut_, tileSize, tilesX_, tilesY_);
+            cv::parallel_for_(cv::Range(0, src.rows), interpolationBody);
+        }
     }
 
     void CLAHE_Impl::setClipLimit(double clipLimit)